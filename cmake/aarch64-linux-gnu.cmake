@@ -0,0 +1,29 @@
+# Cross build for the AArch64 controllers of the vehicles, with the GNU
+# toolchain of Debian and Ubuntu (g++-aarch64-linux-gnu):
+#
+#   cmake -DCMAKE_TOOLCHAIN_FILE=../cmake/aarch64-linux-gnu.cmake \
+#         -DMPC_SYSROOT=<root of the device> -DMPC_ARM_CPU=cortex-a72 ..
+#
+# Ipopt, libuv, uWS, OpenSSL and zlib are taken from the sysroot, a copy of
+# the root file system of the device or an image of it, under /usr and
+# /usr/local as on the host. MPC_ARM_CPU tunes the code for the cores of
+# the device (-mcpu), e.g. cortex-a53, cortex-a72 or neoverse-n1; the
+# baseline of AArch64 has NEON either way.
+
+set(CMAKE_SYSTEM_NAME Linux)
+set(CMAKE_SYSTEM_PROCESSOR aarch64)
+
+set(MPC_CROSS_PREFIX aarch64-linux-gnu- CACHE STRING "Prefix of the cross compilers")
+set(CMAKE_C_COMPILER ${MPC_CROSS_PREFIX}gcc)
+set(CMAKE_CXX_COMPILER ${MPC_CROSS_PREFIX}g++)
+
+set(MPC_SYSROOT "" CACHE PATH "Root file system of the device")
+if(MPC_SYSROOT)
+  set(CMAKE_SYSROOT ${MPC_SYSROOT})
+  set(CMAKE_FIND_ROOT_PATH ${MPC_SYSROOT})
+endif()
+# Programs of the host, libraries and headers of the device
+set(CMAKE_FIND_ROOT_PATH_MODE_PROGRAM NEVER)
+set(CMAKE_FIND_ROOT_PATH_MODE_LIBRARY ONLY)
+set(CMAKE_FIND_ROOT_PATH_MODE_INCLUDE ONLY)
+set(CMAKE_FIND_ROOT_PATH_MODE_PACKAGE ONLY)
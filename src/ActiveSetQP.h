@@ -0,0 +1,209 @@
+#ifndef ACTIVE_SET_QP_H
+#define ACTIVE_SET_QP_H
+
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/Cholesky"
+
+// Dense QP with box constraints only
+//
+//   min 0.5 x'Hx + g'x   s.t.   lb <= x <= ub
+//
+// of fixed size M, solved by a primal active-set method. The working set
+// holds the variables fixed at a bound; each iteration solves the equality
+// constrained QP in the others with an LLT of the free block of H (LDLT when
+// that block is only semi-definite), then either steps towards its solution
+// until a bound blocks, or releases the bound with the most negative
+// multiplier.
+//
+// The working set is kept between solves, so a sequence of similar QPs (one
+// per control tick) typically finishes in one or two factorizations.
+// Everything is sized at compile time, a solve never allocates. Scalar is
+// float for the single precision path of MixedPrecisionQP.
+template <int M, class Scalar = double>
+class ActiveSetQP {
+public:
+  typedef Eigen::Matrix<Scalar, M, M> Matrix;
+  typedef Eigen::Matrix<Scalar, M, 1> Vector;
+  // Per variable: -1 fixed at lb, +1 fixed at ub, 0 free
+  typedef Eigen::Matrix<int, M, 1> WorkingSet;
+
+  explicit ActiveSetQP(int max_iterations = 4 * M, Scalar tolerance = Scalar(1e-9))
+      : max_iterations_(max_iterations), tolerance_(tolerance) {
+    working_set_.setZero();
+  }
+
+  // Solve from the starting point x, with the working set of the last solve
+  // (see working_set). x is clamped to the box and moved onto the bounds of
+  // the working set first. The result is left in x. Return the number of
+  // iterations, or -1 if a free block of H is singular or indefinite.
+  int Solve(const Matrix &H, const Vector &g, const Vector &lb, const Vector &ub,
+            Vector &x) {
+    factorized_ = false;
+    x = x.cwiseMax(lb).cwiseMin(ub);
+    for (int i = 0; i < M; i++) {
+      if (working_set_[i] < 0) {
+        x[i] = lb[i];
+      } else if (working_set_[i] > 0) {
+        x[i] = ub[i];
+      } else if (lb[i] == ub[i]) {
+        working_set_[i] = -1;
+      }
+    }
+
+    for (int iter = 0; iter < max_iterations_; iter++) {
+      grad_.noalias() = H * x;
+      grad_ += g;
+
+      int n_free = 0;
+      for (int i = 0; i < M; i++) {
+        if (working_set_[i] == 0) {
+          free_[n_free++] = i;
+        }
+      }
+
+      // Step to the minimum over the free variables
+      Scalar step_norm = 0;
+      if (n_free > 0) {
+        h_free_.resize(n_free, n_free);
+        g_free_.resize(n_free);
+        for (int a = 0; a < n_free; a++) {
+          for (int b = 0; b < n_free; b++) {
+            h_free_(a, b) = H(free_[a], free_[b]);
+          }
+          g_free_[a] = -grad_[free_[a]];
+        }
+        if (!Factorize()) {
+          return -1;
+        }
+        step_norm = step_.template lpNorm<Eigen::Infinity>();
+      }
+
+      if (step_norm < tolerance_) {
+        // Stationary on the working set: release the bound whose multiplier
+        // has the wrong sign, or stop at the optimum
+        int release = -1;
+        Scalar worst = -tolerance_;
+        for (int i = 0; i < M; i++) {
+          const Scalar multiplier = working_set_[i] < 0 ? grad_[i] : -grad_[i];
+          if (working_set_[i] != 0 && lb[i] < ub[i] && multiplier < worst) {
+            worst = multiplier;
+            release = i;
+          }
+        }
+        if (release < 0) {
+          factorized_ = true;
+          n_free_ = n_free;
+          return iter;
+        }
+        working_set_[release] = 0;
+        continue;
+      }
+
+      // Longest feasible fraction of the step, fixing the blocking bound
+      Scalar alpha = 1;
+      int blocking = -1;
+      int blocking_side = 0;
+      for (int a = 0; a < n_free; a++) {
+        const int i = free_[a];
+        if (step_[a] < 0 && lb[i] - x[i] > alpha * step_[a]) {
+          alpha = (lb[i] - x[i]) / step_[a];
+          blocking = i;
+          blocking_side = -1;
+        } else if (step_[a] > 0 && ub[i] - x[i] < alpha * step_[a]) {
+          alpha = (ub[i] - x[i]) / step_[a];
+          blocking = i;
+          blocking_side = 1;
+        }
+      }
+      for (int a = 0; a < n_free; a++) {
+        x[free_[a]] += alpha * step_[a];
+      }
+      if (blocking >= 0) {
+        x[blocking] = blocking_side < 0 ? lb[blocking] : ub[blocking];
+        working_set_[blocking] = blocking_side;
+      }
+    }
+    return max_iterations_;
+  }
+
+  // Working set of the last solve, used as the start of the next one. The
+  // caller may shift it along with the variables, or clear it for a cold
+  // start.
+  WorkingSet &working_set() { return working_set_; }
+  const WorkingSet &working_set() const { return working_set_; }
+
+  // After a Solve that reached the optimum, the step -H_ff^-1 gradient_f on
+  // the free variables of its working set, zero on the others, from the
+  // factorization its last iteration left. Refining the solution costs two
+  // triangular solves this way. False if there is no such factorization
+  // (the last Solve failed or hit its iteration limit).
+  bool FreeStep(const Vector &gradient, Vector &step) {
+    if (!factorized_) {
+      return false;
+    }
+    step.setZero();
+    if (n_free_ == 0) {
+      return true;
+    }
+    g_free_.resize(n_free_);
+    for (int a = 0; a < n_free_; a++) {
+      g_free_[a] = -gradient[free_[a]];
+    }
+    if (ldlt_used_) {
+      step_ = ldlt_.solve(g_free_);
+    } else {
+      step_ = llt_.solve(g_free_);
+    }
+    for (int a = 0; a < n_free_; a++) {
+      step[free_[a]] = step_[a];
+    }
+    return true;
+  }
+
+  static Scalar Objective(const Matrix &H, const Vector &g, const Vector &x) {
+    return Scalar(0.5) * x.dot(H * x) + g.dot(x);
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic, 0, M, M> FreeMatrix;
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1, 0, M, 1> FreeVector;
+
+  // Solve h_free_ step_ = g_free_, falling back to LDLT when h_free_ is
+  // only semi-definite. Return false if neither works.
+  bool Factorize() {
+    llt_.compute(h_free_);
+    ldlt_used_ = llt_.info() != Eigen::Success;
+    if (!ldlt_used_) {
+      step_ = llt_.solve(g_free_);
+      return true;
+    }
+    ldlt_.compute(h_free_);
+    if (ldlt_.info() != Eigen::Success || !ldlt_.isPositive()) {
+      return false;
+    }
+    step_ = ldlt_.solve(g_free_);
+    return step_.allFinite();
+  }
+
+  int max_iterations_;
+  Scalar tolerance_;
+  WorkingSet working_set_;
+
+  // Scratch, kept here so a solve doesn't touch the heap
+  Vector grad_;
+  Eigen::Matrix<int, M, 1> free_;
+  FreeMatrix h_free_;
+  FreeVector g_free_;
+  FreeVector step_;
+  Eigen::LLT<FreeMatrix> llt_;
+  Eigen::LDLT<FreeMatrix> ldlt_;
+  // Whether the factorization of the last iteration is valid for FreeStep,
+  // its size and decomposition
+  bool factorized_ = false;
+  int n_free_ = 0;
+  bool ldlt_used_ = false;
+};
+
+#endif /* ACTIVE_SET_QP_H */
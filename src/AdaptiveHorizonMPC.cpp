@@ -0,0 +1,112 @@
+#include "AdaptiveHorizonMPC.h"
+#include <algorithm>
+#include <chrono>
+#include <ratio>
+
+AdaptiveHorizonMPC::AdaptiveHorizonMPC(const HorizonPolicy &policy) : policy_(policy) {}
+
+void AdaptiveHorizonMPC::AddVariant(std::unique_ptr<MPCBase> mpc, double min_speed) {
+  variants_.push_back(std::move(mpc));
+  min_speed_.push_back(min_speed);
+  cap_ = variants_.size() - 1;
+}
+
+void AdaptiveHorizonMPC::ControlEffort(const EffortPolicy &policy) {
+  for (const std::unique_ptr<MPCBase> &variant : variants_) {
+    variant->ControlEffort(policy);
+  }
+}
+
+void AdaptiveHorizonMPC::SoftenConstraints(double penalty) {
+  for (const std::unique_ptr<MPCBase> &variant : variants_) {
+    variant->SoftenConstraints(penalty);
+  }
+}
+
+void AdaptiveHorizonMPC::SampleReference(bool sampled) {
+  for (const std::unique_ptr<MPCBase> &variant : variants_) {
+    variant->SampleReference(sampled);
+  }
+}
+
+void AdaptiveHorizonMPC::SetReferenceOrder(size_t order) {
+  for (const std::unique_ptr<MPCBase> &variant : variants_) {
+    variant->SetReferenceOrder(order);
+  }
+}
+
+size_t AdaptiveHorizonMPC::slack_activations() const {
+  size_t count = 0;
+  for (const std::unique_ptr<MPCBase> &variant : variants_) {
+    count += variant->slack_activations();
+  }
+  return count;
+}
+
+size_t AdaptiveHorizonMPC::Select(double v) const {
+  const double band = 0.5 * policy_.speed_hysteresis;
+  size_t next = active_;
+  while (next + 1 < variants_.size() && v >= min_speed_[next + 1] + band) {
+    next++;
+  }
+  while (next > 0 && v < min_speed_[next] - band) {
+    next--;
+  }
+  return std::min(next, cap_);
+}
+
+MPCSolution AdaptiveHorizonMPC::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
+  const size_t next = Select(state[3]);
+  const bool cold = next != active_ || !has_solved_;
+  if (next != active_) {
+    variants_[next]->Reset();
+    active_ = next;
+    switches_++;
+  }
+
+  MPCBase &mpc = *variants_[active_];
+  mpc.prev_a = prev_a;
+  mpc.max_solve_time = max_solve_time;
+  mpc.cost_schedule = cost_schedule;
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  const MPCSolution result = mpc.Solve(state, coeffs);
+  const double elapsed =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  status_ = mpc.status();
+  cost_ = mpc.cost();
+  has_solved_ = true;
+
+  // Step down right away when the budget gets tight, step back up slowly. A
+  // cold solve is slower than the warm started ones, only its deadline counts.
+  const bool tight = (elapsed > policy_.budget_fraction * max_solve_time && !cold) ||
+                     (mpc.effort() != nullptr && mpc.effort()->saturated());
+  if (status_ == SolveStatus::kDeadline || tight) {
+    cap_ = active_ > 0 ? active_ - 1 : 0;
+    ticks_within_budget_ = 0;
+  } else if (++ticks_within_budget_ >= policy_.recovery_ticks && cap_ + 1 < variants_.size()) {
+    cap_++;
+    ticks_within_budget_ = 0;
+  }
+  return result;
+}
+
+std::unique_ptr<AdaptiveHorizonMPC> MakeAdaptiveMPC(const HorizonPolicy &policy,
+                                                    Derivatives derivatives) {
+  std::unique_ptr<AdaptiveHorizonMPC> mpc(new AdaptiveHorizonMPC(policy));
+  mpc->AddVariant(std::unique_ptr<MPCBase>(new MPC<10>(derivatives)), 0);
+  mpc->AddVariant(std::unique_ptr<MPCBase>(new MPC<15>(derivatives)), 20);
+  mpc->AddVariant(std::unique_ptr<MPCBase>(
+      new MPC<15, std::ratio<3, 20> >(derivatives)), 35);
+  return mpc;
+}
+
+std::unique_ptr<AdaptiveHorizonMPC> MakeVehicleModelMPC(const HorizonPolicy &policy,
+                                                        double dynamic_speed,
+                                                        Derivatives derivatives) {
+  std::unique_ptr<AdaptiveHorizonMPC> mpc(new AdaptiveHorizonMPC(policy));
+  mpc->AddVariant(MakeMPC(15, derivatives), 0);
+  mpc->AddVariant(MakeMPC(15, derivatives, false, HessianApproximation::kExact,
+                          VehicleModel::kDynamic),
+                  dynamic_speed);
+  return mpc;
+}
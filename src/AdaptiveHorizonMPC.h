@@ -0,0 +1,104 @@
+#ifndef ADAPTIVE_HORIZON_MPC_H
+#define ADAPTIVE_HORIZON_MPC_H
+
+#include <memory>
+#include <vector>
+#include "MPC.h"
+
+// When AdaptiveHorizonMPC moves between its variants
+struct HorizonPolicy {
+  // Width (mph, like the speed of the state) of the band around each speed
+  // threshold, so a speed sitting at a threshold doesn't switch every tick
+  double speed_hysteresis = 2.0;
+  // A solve that hit the deadline or took longer than this fraction of
+  // max_solve_time moves to the next shorter variant
+  double budget_fraction = 0.7;
+  // Solves well within the budget before a longer variant is allowed again
+  size_t recovery_ticks = 20;
+};
+
+// MPC picking its horizon length and timestep, or its vehicle model, every
+// tick.
+//
+// It holds a ladder of MPCs over any MPCBase, each with its own horizon and
+// therefore its own tape, solver and buffers, all made up front: switching
+// only changes which one is called. Each tick the longest variant whose
+// speed threshold the measured speed reaches is used, unless recent solves
+// came close to the time budget, in which case a shorter one is used until
+// the solves are back within budget for a while.
+//
+// A variant taken into use is Reset, its last plan is from an older tick.
+class AdaptiveHorizonMPC : public MPCBase {
+public:
+  explicit AdaptiveHorizonMPC(const HorizonPolicy &policy);
+
+  // Add a variant used from min_speed on. Variants are added from the
+  // shortest and cheapest to the longest, with increasing min_speed.
+  void AddVariant(std::unique_ptr<MPCBase> mpc, double min_speed);
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  void Prepare() override { variants_[active_]->Prepare(); }
+
+  void Reset() override { variants_[active_]->Reset(); }
+
+  // Every variant controls its own effort. One whose controller is
+  // saturated counts as a solve close to the budget, so the horizon length
+  // is the last knob.
+  void ControlEffort(const EffortPolicy &policy) override;
+  const EffortController *effort() const override { return variants_[active_]->effort(); }
+
+  void SoftenConstraints(double penalty) override;
+  size_t slack_activations() const override;
+
+  void SampleReference(bool sampled) override;
+  void SetReferenceOrder(size_t order) override;
+
+  size_t horizon_length() const override { return variants_[active_]->horizon_length(); }
+  double timestep() const override { return variants_[active_]->timestep(); }
+  double stage_time(size_t t) const override { return variants_[active_]->stage_time(t); }
+
+  MPCState planned_state(size_t t) const override {
+    return variants_[active_]->planned_state(t);
+  }
+
+  void planned_actuations(size_t t, double &delta, double &a) const override {
+    variants_[active_]->planned_actuations(t, delta, a);
+  }
+
+  // Variant of the last Solve, and the number of switches so far
+  size_t variant() const { return active_; }
+  size_t switches() const { return switches_; }
+
+private:
+  // Variant for the speed v within the budget cap
+  size_t Select(double v) const;
+
+  HorizonPolicy policy_;
+  std::vector<std::unique_ptr<MPCBase> > variants_;
+  std::vector<double> min_speed_;
+
+  size_t active_ = 0;
+  size_t switches_ = 0;
+  bool has_solved_ = false;
+  // Longest variant the recent solve times allow, and the solves within the
+  // budget since it was last lowered
+  size_t cap_ = 0;
+  size_t ticks_within_budget_ = 0;
+};
+
+// The Ipopt MPC over 10 steps of 0.1 s below 20 mph, 15 steps of 0.1 s
+// (the tuned default) up to 35 mph and 15 steps of 0.15 s above.
+std::unique_ptr<AdaptiveHorizonMPC> MakeAdaptiveMPC(const HorizonPolicy &policy,
+                                                    Derivatives derivatives = Derivatives::kTape);
+
+// The Ipopt MPC over 15 steps of 0.1 s with the kinematic model below
+// dynamic_speed (mph) and the dynamic one (Horizon15Dynamic) from there on,
+// where the tyres slip: the dynamic stages cost more (see ModelStageOps),
+// so a tick that comes close to the budget drops back to the kinematic
+// model as it would to a shorter horizon.
+std::unique_ptr<AdaptiveHorizonMPC> MakeVehicleModelMPC(
+    const HorizonPolicy &policy, double dynamic_speed,
+    Derivatives derivatives = Derivatives::kTape);
+
+#endif /* ADAPTIVE_HORIZON_MPC_H */
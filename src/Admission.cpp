@@ -0,0 +1,92 @@
+#include "Admission.h"
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
+const char kCapacityCloseReason[] = "server at capacity";
+
+double WorkerLoad::Expected(const AdmissionPolicy &policy) const {
+  return measured > 0 ? cores / measured : policy.first_session;
+}
+
+bool Admits(const WorkerLoad &load, const AdmissionPolicy &policy) {
+  // The sessions not measured yet are expected to use what the others do
+  const double expected = load.Expected(policy);
+  const double committed = load.cores + (load.sessions - load.measured) * expected;
+  return committed + expected <= policy.utilization;
+}
+
+bool ParsePriorityQuery(const MessageView &url, int &priority) {
+  const size_t npos = MessageView::npos;
+  const size_t query = url.find('?');
+  for (size_t begin = query == npos ? url.size() : query + 1; begin < url.size();) {
+    size_t end = url.find('&', begin);
+    end = end == npos ? url.size() : end;
+    const MessageView parameter = url.substr(begin, end - begin);
+    const size_t equals = parameter.find('=');
+    if (parameter.substr(0, equals).equals("priority")) {
+      const std::string value = equals == npos ? "" : parameter.substr(equals + 1).str();
+      char *parsed = nullptr;
+      const long number = std::strtol(value.c_str(), &parsed, 10);
+      if (value.empty() || *parsed != '\0') {
+        return false;
+      }
+      priority = static_cast<int>(number);
+    }
+    begin = end + 1;
+  }
+  return true;
+}
+
+size_t Shed(std::vector<SheddingEntry> &entries, const AdmissionPolicy &policy) {
+  double load = 0;
+  std::vector<size_t> order;
+  for (size_t k = 0; k < entries.size(); k++) {
+    load += entries[k].cores;
+  }
+  size_t changes = 0;
+  if (load > policy.utilization) {
+    for (size_t k = 0; k < entries.size(); k++) {
+      if (!entries[k].shed) {
+        order.push_back(k);
+      }
+    }
+    std::sort(order.begin(), order.end(), [&entries](size_t a, size_t b) {
+      return entries[a].priority != entries[b].priority
+                 ? entries[a].priority < entries[b].priority
+                 : entries[a].cores > entries[b].cores;
+    });
+    for (size_t k : order) {
+      if (load <= policy.utilization) {
+        break;
+      }
+      SheddingEntry &entry = entries[k];
+      entry.shed = true;
+      entry.full_cores = entry.cores;
+      load -= entry.cores * (1 - policy.degraded_share);
+      changes++;
+    }
+    return changes;
+  }
+  for (size_t k = 0; k < entries.size(); k++) {
+    if (entries[k].shed) {
+      order.push_back(k);
+    }
+  }
+  std::sort(order.begin(), order.end(), [&entries](size_t a, size_t b) {
+    return entries[a].priority != entries[b].priority
+               ? entries[a].priority > entries[b].priority
+               : entries[a].full_cores < entries[b].full_cores;
+  });
+  for (size_t k : order) {
+    SheddingEntry &entry = entries[k];
+    const double restored = load - entry.cores + entry.full_cores;
+    if (restored > policy.utilization * policy.release) {
+      break;
+    }
+    entry.shed = false;
+    load = restored;
+    changes++;
+  }
+  return changes;
+}
@@ -0,0 +1,85 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+#include "MessageView.h"
+
+// Admission control of the simulators a worker serves. A worker solves its
+// sessions on one thread, so once they need more of it than there is every
+// one of them misses its deadline at once. The CPU time their ticks take
+// (see SessionCpu) tells how much of the thread is left, and at capacity
+// the worker either turns new sessions away, with a close code the farm
+// can retry on elsewhere, or sheds the sessions of the lowest priority to
+// their RTI, a fraction of the cost, so that the others keep their
+// deadlines.
+enum class AdmissionMode {
+  // Close the connections that don't fit
+  kRefuse,
+  // Admit every one, and degrade the lowest priority sessions instead
+  kShed
+};
+
+struct AdmissionPolicy {
+  AdmissionMode mode = AdmissionMode::kRefuse;
+  // Cores of its solver thread the sessions of a worker may use together,
+  // the rest left for the bursts of their hard corners
+  double utilization = 0.8;
+  // Cores a new session is taken to use before any session of the worker
+  // has been measured
+  double first_session = 0.05;
+  // With shed: the share of its cores a session is expected to use on its
+  // RTI, how far under utilization the load must fall for a shed session to
+  // get its solver back, and how often the sessions are looked at, the
+  // window their use is averaged over (see CpuQuotaPolicy)
+  double degraded_share = 0.25;
+  double release = 0.8;
+  std::chrono::milliseconds interval{2000};
+};
+
+// The close code of a session refused at capacity, 1013 (Try Again Later
+// in the registry of RFC 6455), and its reason
+const int kCapacityCloseCode = 1013;
+extern const char kCapacityCloseReason[];
+
+// The load of the sessions of a worker, as their ticks measured it
+struct WorkerLoad {
+  // Cores used by the sessions measured, and the sessions in all
+  double cores = 0;
+  size_t sessions = 0;
+  size_t measured = 0;
+
+  // Cores a new session is expected to use: what those measured use on
+  // average, or first_session before there are any
+  double Expected(const AdmissionPolicy &policy) const;
+};
+
+// Whether a new session is expected to fit in what load leaves of policy's
+// utilization
+bool Admits(const WorkerLoad &load, const AdmissionPolicy &policy);
+
+// The priority a client asks for in the query of the url it connects to,
+// "priority=<n>" (higher is kept longer), other parameters ignored; 0 if
+// there is none, false with priority as it was if it isn't an integer
+bool ParsePriorityQuery(const MessageView &url, int &priority);
+
+// A session of a worker as Shed sees it
+struct SheddingEntry {
+  int priority = 0;
+  // Cores it uses as measured, on its RTI if it is shed
+  double cores = 0;
+  bool shed = false;
+  // Cores it used when it was shed
+  double full_cores = 0;
+};
+
+// Shed sessions of entries, the lowest priority first and of those the
+// costliest, while their load is over policy's utilization, each expected
+// to fall to degraded_share of its cores; under it, give the shed ones
+// their solvers back, the highest priority first, while the load with
+// their full cores stays under release of it. The number of sessions shed
+// or given back.
+size_t Shed(std::vector<SheddingEntry> &entries, const AdmissionPolicy &policy);
+
+#endif /* ADMISSION_H */
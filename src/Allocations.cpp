@@ -0,0 +1,149 @@
+#include "Allocations.h"
+#include <cstdlib>
+#include <new>
+
+// Without the instrumentation the allocators are those of the library (see
+// Allocations.h)
+#if MPC_INSTRUMENTATION >= MPC_INSTRUMENTATION_COUNTERS
+
+namespace {
+
+// The counts of every stage, then of the tick outside of them, then of the
+// allocations outside of a tick, which nothing reads
+const size_t kOutsideStages = kTickStages;
+const size_t kOutsideTick = kTickStages + 1;
+
+thread_local size_t stage = kOutsideTick;
+thread_local uint64_t counts[kTickStages + 2];
+thread_local uint64_t bytes[kTickStages + 2];
+
+void Count(std::size_t size) {
+  counts[stage]++;
+  bytes[stage] += size;
+}
+
+void *Allocate(std::size_t size) {
+#ifndef __GLIBC__
+  // Counted by the malloc below on glibc
+  Count(size);
+#endif
+  // operator new returns a distinct pointer for no bytes too
+  void *memory = std::malloc(size > 0 ? size : 1);
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+}  // namespace
+
+void BeginTickAllocations(TickStage first) {
+  for (size_t k = 0; k < kOutsideTick; k++) {
+    counts[k] = 0;
+    bytes[k] = 0;
+  }
+  stage = static_cast<size_t>(first);
+}
+
+void AllocationStage(TickStage next) { stage = static_cast<size_t>(next); }
+
+void AllocationOutsideStages() { stage = kOutsideStages; }
+
+TickAllocations EndTickAllocations() {
+  stage = kOutsideTick;
+  TickAllocations tick;
+  for (size_t k = 0; k < kTickStages; k++) {
+    tick.counts[k] = counts[k];
+    tick.bytes[k] = bytes[k];
+  }
+  tick.other_count = counts[kOutsideStages];
+  tick.other_bytes = bytes[kOutsideStages];
+  return tick;
+}
+
+void *operator new(std::size_t size) { return Allocate(size); }
+void *operator new[](std::size_t size) { return Allocate(size); }
+void operator delete(void *memory) noexcept { std::free(memory); }
+void operator delete[](void *memory) noexcept { std::free(memory); }
+
+#ifdef __GLIBC__
+// In front of the malloc of glibc, for the allocations that don't go
+// through operator new, those of Eigen among them. Its memalign and
+// posix_memalign are left alone: nothing of the tick aligns its own.
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t n, std::size_t size);
+void *__libc_realloc(void *memory, std::size_t size);
+
+void *malloc(std::size_t size) __THROW {
+  Count(size);
+  return __libc_malloc(size);
+}
+
+void *calloc(std::size_t n, std::size_t size) __THROW {
+  Count(n * size);
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *memory, std::size_t size) __THROW {
+  Count(size);
+  return __libc_realloc(memory, size);
+}
+}
+#endif  // __GLIBC__
+
+#endif  // MPC_INSTRUMENTATION
+
+uint64_t TickAllocations::TotalCount() const {
+  uint64_t total = other_count;
+  for (uint64_t count : counts) {
+    total += count;
+  }
+  return total;
+}
+
+uint64_t TickAllocations::TotalBytes() const {
+  uint64_t total = other_bytes;
+  for (uint64_t size : bytes) {
+    total += size;
+  }
+  return total;
+}
+
+bool ParseAllocationFree(const std::string &list, std::array<bool, kTickStages> &stages) {
+  stages.fill(false);
+  if (list == "all") {
+    stages.fill(true);
+    return true;
+  }
+  size_t begin = 0;
+  while (begin <= list.size()) {
+    size_t end = list.find(',', begin);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    const std::string name = list.substr(begin, end - begin);
+    size_t k = 0;
+    while (k < kTickStages && name != TickStageName(static_cast<TickStage>(k))) {
+      k++;
+    }
+    if (k == kTickStages) {
+      return false;
+    }
+    stages[k] = true;
+    begin = end + 1;
+  }
+  return true;
+}
+
+bool AllocationFreeViolation(const TickAllocations &tick,
+                             const std::array<bool, kTickStages> &allocation_free,
+                             TickStage &violated) {
+  for (size_t k = 0; k < kTickStages; k++) {
+    if (allocation_free[k] && tick.counts[k] > 0) {
+      violated = static_cast<TickStage>(k);
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,72 @@
+#ifndef ALLOCATIONS_H
+#define ALLOCATIONS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "Instrumentation.h"
+#include "Metrics.h"
+
+// Heap allocations of the ticks, by the stage of the tick they were made
+// in, for the allocations per tick of the metrics and for the stages that
+// must not allocate at all. Counted by the global operator new of
+// Allocations.cpp, and on glibc by its malloc, calloc and realloc as well,
+// which the Eigen matrices and vectors allocate with; only the programs
+// that link Allocations.cpp in count anything. Every count is a
+// thread-local increment, so counting costs no contention, and only the
+// allocations of the thread that runs the tick are its own: those of the
+// worker threads of a solver are not counted in. With the instrumentation
+// off (see Instrumentation.h) the allocators aren't replaced, the hooks
+// below are no code and every tick allocates nothing.
+
+// The allocations of the stages of one tick, of its thread
+struct TickAllocations {
+  // The allocations and the bytes asked for in each stage, and in the
+  // tick outside of the stages
+  std::array<uint64_t, kTickStages> counts;
+  std::array<uint64_t, kTickStages> bytes;
+  uint64_t other_count;
+  uint64_t other_bytes;
+
+  uint64_t count(TickStage stage) const { return counts[static_cast<size_t>(stage)]; }
+  uint64_t bytes_of(TickStage stage) const { return bytes[static_cast<size_t>(stage)]; }
+  // Of the whole tick
+  uint64_t TotalCount() const;
+  uint64_t TotalBytes() const;
+};
+
+#if MPC_INSTRUMENTATION >= MPC_INSTRUMENTATION_COUNTERS
+// A tick of this thread starts in stage: its allocations so far are
+// forgotten, and those from now on are counted to stage
+void BeginTickAllocations(TickStage stage);
+// The allocations of this thread are counted to stage from now on
+void AllocationStage(TickStage stage);
+// To the tick outside of its stages from now on
+void AllocationOutsideStages();
+// The tick of this thread ends: its allocations since BeginTickAllocations,
+// and those after are not counted to any tick
+TickAllocations EndTickAllocations();
+#else
+inline void BeginTickAllocations(TickStage) {}
+inline void AllocationStage(TickStage) {}
+inline void AllocationOutsideStages() {}
+inline TickAllocations EndTickAllocations() { return TickAllocations(); }
+#endif
+
+// The first ticks of a session size the buffers the later ones reuse (the
+// fields of the telemetry, the reply, the references of the track), so
+// their allocations aren't held against the stages that must not allocate
+const uint64_t kAllocationWarmTicks = 3;
+
+// The stages that must not allocate, of a list of their names separated by
+// commas like "fit,serialize", or "all" for the whole tick from the wait in
+// the mailbox to the send; false with an unknown name
+bool ParseAllocationFree(const std::string &list, std::array<bool, kTickStages> &stages);
+
+// The first stage of allocation_free that allocated in tick, false if none
+bool AllocationFreeViolation(const TickAllocations &tick,
+                             const std::array<bool, kTickStages> &allocation_free,
+                             TickStage &stage);
+
+#endif /* ALLOCATIONS_H */
@@ -0,0 +1,428 @@
+#include "ArrowFile.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace {
+
+// The schema of the Arrow format (format/Schema.fbs, Message.fbs and
+// File.fbs of the Arrow sources) this file takes: the slots of the fields
+// of each table, and the values of the enums and unions
+const int16_t kMetadataV5 = 4;
+const uint8_t kHeaderSchema = 1;
+const uint8_t kHeaderRecordBatch = 3;
+const uint8_t kTypeInt = 2;
+const uint8_t kTypeFloatingPoint = 3;
+const uint8_t kTypeBool = 6;
+const int16_t kPrecisionSingle = 1;
+const int16_t kPrecisionDouble = 2;
+
+const char kMagic[] = "ARROW1";
+
+// A flatbuffer as a tree, written front to back: every object after those
+// that refer to it, so each offset, unsigned, points forward as the
+// format wants
+struct FlatNode {
+  enum Kind { kTable, kString, kStructVector, kTableVector };
+
+  // A field of a table, a scalar of size bytes or an offset to child
+  struct Field {
+    int slot;
+    size_t size;
+    uint64_t bits;
+    std::shared_ptr<FlatNode> child;
+  };
+
+  Kind kind;
+  std::vector<Field> fields;
+  // The characters of a string, or the elements of a vector of structs
+  std::string bytes;
+  size_t count = 0;
+  std::vector<std::shared_ptr<FlatNode>> elements;
+};
+
+typedef std::shared_ptr<FlatNode> FlatPtr;
+
+FlatPtr Table() {
+  FlatPtr node = std::make_shared<FlatNode>();
+  node->kind = FlatNode::kTable;
+  return node;
+}
+
+template <class T>
+void AddScalar(const FlatPtr &table, int slot, T value) {
+  FlatNode::Field field = {slot, sizeof(T), 0, nullptr};
+  std::memcpy(&field.bits, &value, sizeof(T));
+  table->fields.push_back(field);
+}
+
+void AddChild(const FlatPtr &table, int slot, FlatPtr child) {
+  table->fields.push_back({slot, 4, 0, std::move(child)});
+}
+
+FlatPtr String(const std::string &value) {
+  FlatPtr node = std::make_shared<FlatNode>();
+  node->kind = FlatNode::kString;
+  node->bytes = value;
+  return node;
+}
+
+// count structs of 8 byte alignment, laid out in bytes
+FlatPtr StructVector(const std::string &bytes, size_t count) {
+  FlatPtr node = std::make_shared<FlatNode>();
+  node->kind = FlatNode::kStructVector;
+  node->bytes = bytes;
+  node->count = count;
+  return node;
+}
+
+FlatPtr TableVector(std::vector<FlatPtr> elements) {
+  FlatPtr node = std::make_shared<FlatNode>();
+  node->kind = FlatNode::kTableVector;
+  node->elements = std::move(elements);
+  return node;
+}
+
+template <class T>
+void Put(std::string &out, T value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <class T>
+void PutAt(std::string &out, size_t at, T value) {
+  std::memcpy(&out[at], &value, sizeof(T));
+}
+
+// Zeros up to the next position of out that is rest modulo alignment
+void Align(std::string &out, size_t alignment, size_t rest = 0) {
+  while (out.size() % alignment != rest) {
+    out.push_back(0);
+  }
+}
+
+// Write node into out, returning where it starts: the table after its
+// vtable, or the length of a string or vector
+size_t Emit(const FlatNode &node, std::string &out) {
+  std::vector<std::pair<size_t, const FlatNode *>> patches;
+  size_t start = 0;
+  switch (node.kind) {
+    case FlatNode::kString:
+      Align(out, 4);
+      start = out.size();
+      Put<uint32_t>(out, static_cast<uint32_t>(node.bytes.size()));
+      out += node.bytes;
+      out.push_back(0);
+      return start;
+    case FlatNode::kStructVector:
+      // The elements on 8 bytes, after the length
+      Align(out, 8, 4);
+      start = out.size();
+      Put<uint32_t>(out, static_cast<uint32_t>(node.count));
+      out += node.bytes;
+      return start;
+    case FlatNode::kTableVector:
+      Align(out, 4);
+      start = out.size();
+      Put<uint32_t>(out, static_cast<uint32_t>(node.elements.size()));
+      for (const FlatPtr &element : node.elements) {
+        patches.push_back(std::make_pair(out.size(), element.get()));
+        Put<uint32_t>(out, 0);
+      }
+      break;
+    case FlatNode::kTable: {
+      // The widest fields first, from a table start 4 bytes off 8, so that
+      // after its vtable offset every field is aligned to its size
+      std::vector<const FlatNode::Field *> fields;
+      int slots = 0;
+      for (const FlatNode::Field &field : node.fields) {
+        fields.push_back(&field);
+        slots = std::max(slots, field.slot + 1);
+      }
+      std::stable_sort(fields.begin(), fields.end(),
+                       [](const FlatNode::Field *a, const FlatNode::Field *b) {
+                         return a->size > b->size;
+                       });
+      std::vector<uint16_t> offsets(slots, 0);
+      size_t size = 4;
+      for (const FlatNode::Field *field : fields) {
+        offsets[field->slot] = static_cast<uint16_t>(size);
+        size += field->size;
+      }
+      Align(out, 2);
+      const size_t vtable = out.size();
+      Put<uint16_t>(out, static_cast<uint16_t>(4 + 2 * slots));
+      Put<uint16_t>(out, static_cast<uint16_t>(size));
+      for (uint16_t offset : offsets) {
+        Put<uint16_t>(out, offset);
+      }
+      Align(out, 8, 4);
+      start = out.size();
+      Put<int32_t>(out, static_cast<int32_t>(start - vtable));
+      for (const FlatNode::Field *field : fields) {
+        if (field->child) {
+          patches.push_back(std::make_pair(out.size(), field->child.get()));
+          Put<uint32_t>(out, 0);
+        } else {
+          out.append(reinterpret_cast<const char *>(&field->bits), field->size);
+        }
+      }
+      break;
+    }
+  }
+  for (const std::pair<size_t, const FlatNode *> &patch : patches) {
+    const size_t child = Emit(*patch.second, out);
+    PutAt<uint32_t>(out, patch.first, static_cast<uint32_t>(child - patch.first));
+  }
+  return start;
+}
+
+// The flatbuffer of root
+std::string Finish(const FlatNode &root) {
+  std::string out;
+  Put<uint32_t>(out, 0);
+  const size_t start = Emit(root, out);
+  PutAt<uint32_t>(out, 0, static_cast<uint32_t>(start));
+  return out;
+}
+
+size_t ByteWidth(ArrowType type) {
+  switch (type) {
+    case ArrowType::kBool:
+      return 0;
+    case ArrowType::kInt8:
+      return 1;
+    case ArrowType::kInt32:
+    case ArrowType::kFloat32:
+      return 4;
+    case ArrowType::kInt64:
+    case ArrowType::kUInt64:
+    case ArrowType::kFloat64:
+      return 8;
+  }
+  return 0;
+}
+
+FlatPtr Schema(const std::vector<ArrowColumn> &columns) {
+  std::vector<FlatPtr> fields;
+  for (const ArrowColumn &column : columns) {
+    FlatPtr type = Table();
+    uint8_t type_type = kTypeInt;
+    switch (column.type) {
+      case ArrowType::kBool:
+        type_type = kTypeBool;
+        break;
+      case ArrowType::kFloat32:
+      case ArrowType::kFloat64:
+        type_type = kTypeFloatingPoint;
+        AddScalar<int16_t>(type, 0, column.type == ArrowType::kFloat32 ? kPrecisionSingle
+                                                                       : kPrecisionDouble);
+        break;
+      default:
+        AddScalar<int32_t>(type, 0, static_cast<int32_t>(8 * ByteWidth(column.type)));
+        AddScalar<uint8_t>(type, 1, column.type != ArrowType::kUInt64);
+        break;
+    }
+    // Field: name, nullable, type_type, type, dictionary, children
+    FlatPtr field = Table();
+    AddChild(field, 0, String(column.name));
+    AddScalar<uint8_t>(field, 1, 0);
+    AddScalar<uint8_t>(field, 2, type_type);
+    AddChild(field, 3, type);
+    AddChild(field, 5, TableVector({}));
+    fields.push_back(field);
+  }
+  // Schema: endianness, fields
+  FlatPtr schema = Table();
+  AddScalar<int16_t>(schema, 0, 0);
+  AddChild(schema, 1, TableVector(fields));
+  return schema;
+}
+
+// Message: version, header_type, header, bodyLength
+std::string Message(uint8_t header_type, FlatPtr header, int64_t body_length) {
+  FlatPtr message = Table();
+  AddScalar<int16_t>(message, 0, kMetadataV5);
+  AddScalar<uint8_t>(message, 1, header_type);
+  AddChild(message, 2, std::move(header));
+  AddScalar<int64_t>(message, 3, body_length);
+  return Finish(*message);
+}
+
+}  // namespace
+
+ArrowFileWriter::ArrowFileWriter(const std::string &path, const std::vector<ArrowColumn> &columns,
+                                 size_t batch_rows)
+    : out_(path, std::ios::binary | std::ios::trunc),
+      columns_(columns),
+      batch_rows_(std::max<size_t>(1, batch_rows)) {
+  for (const ArrowColumn &column : columns_) {
+    buffers_.push_back({column.type, std::string()});
+  }
+  if (!out_) {
+    return;
+  }
+  out_.write(kMagic, 6);
+  out_.write("\0\0", 2);
+  offset_ = 8;
+  int64_t offset;
+  int32_t metadata_length;
+  WriteMessage(Message(kHeaderSchema, Schema(columns_), 0), offset, metadata_length);
+  ok_ = static_cast<bool>(out_);
+}
+
+ArrowFileWriter::~ArrowFileWriter() {
+  if (!closed_) {
+    Close();
+  }
+}
+
+void ArrowFileWriter::Append(size_t column, double value) {
+  Buffer &buffer = buffers_[column];
+  switch (buffer.type) {
+    case ArrowType::kFloat32:
+      Put<float>(buffer.bytes, static_cast<float>(value));
+      break;
+    case ArrowType::kFloat64:
+      Put<double>(buffer.bytes, value);
+      break;
+    default:
+      Append(column, static_cast<int64_t>(value));
+      break;
+  }
+}
+
+void ArrowFileWriter::Append(size_t column, int64_t value) {
+  Buffer &buffer = buffers_[column];
+  switch (buffer.type) {
+    case ArrowType::kBool:
+      if (batch_ % 8 == 0) {
+        buffer.bytes.push_back(0);
+      }
+      if (value != 0) {
+        buffer.bytes.back() = static_cast<char>(buffer.bytes.back() | (1 << (batch_ % 8)));
+      }
+      break;
+    case ArrowType::kInt8:
+      Put<int8_t>(buffer.bytes, static_cast<int8_t>(value));
+      break;
+    case ArrowType::kInt32:
+      Put<int32_t>(buffer.bytes, static_cast<int32_t>(value));
+      break;
+    case ArrowType::kInt64:
+      Put<int64_t>(buffer.bytes, value);
+      break;
+    case ArrowType::kUInt64:
+      Put<uint64_t>(buffer.bytes, static_cast<uint64_t>(value));
+      break;
+    case ArrowType::kFloat32:
+    case ArrowType::kFloat64:
+      Append(column, static_cast<double>(value));
+      break;
+  }
+}
+
+void ArrowFileWriter::Append(size_t column, uint64_t value) {
+  if (buffers_[column].type == ArrowType::kUInt64) {
+    Put<uint64_t>(buffers_[column].bytes, value);
+  } else {
+    Append(column, static_cast<int64_t>(value));
+  }
+}
+
+void ArrowFileWriter::EndRow() {
+  batch_++;
+  rows_++;
+  if (batch_ == batch_rows_) {
+    WriteBatch();
+  }
+}
+
+void ArrowFileWriter::WriteBatch() {
+  if (batch_ == 0) {
+    return;
+  }
+  // A node and two buffers a column, the validity bitmap of none of them
+  // null left empty, each buffer on 8 bytes of the body
+  std::string nodes;
+  std::string buffers;
+  int64_t body_length = 0;
+  for (const Buffer &buffer : buffers_) {
+    Put<int64_t>(nodes, static_cast<int64_t>(batch_));
+    Put<int64_t>(nodes, 0);
+    Put<int64_t>(buffers, body_length);
+    Put<int64_t>(buffers, 0);
+    Put<int64_t>(buffers, body_length);
+    Put<int64_t>(buffers, static_cast<int64_t>(buffer.bytes.size()));
+    body_length += static_cast<int64_t>((buffer.bytes.size() + 7) / 8 * 8);
+  }
+  // RecordBatch: length, nodes, buffers
+  FlatPtr batch = Table();
+  AddScalar<int64_t>(batch, 0, static_cast<int64_t>(batch_));
+  AddChild(batch, 1, StructVector(nodes, buffers_.size()));
+  AddChild(batch, 2, StructVector(buffers, 2 * buffers_.size()));
+  Block block;
+  block.body_length = body_length;
+  WriteMessage(Message(kHeaderRecordBatch, batch, body_length), block.offset,
+               block.metadata_length);
+  const char padding[8] = {0};
+  for (Buffer &buffer : buffers_) {
+    out_.write(buffer.bytes.data(), buffer.bytes.size());
+    out_.write(padding, (8 - buffer.bytes.size() % 8) % 8);
+    buffer.bytes.clear();
+  }
+  offset_ += body_length;
+  blocks_.push_back(block);
+  batch_ = 0;
+}
+
+void ArrowFileWriter::WriteMessage(const std::string &flatbuffer, int64_t &offset,
+                                   int32_t &metadata_length) {
+  // The continuation marker and the length of the flatbuffer, padded so
+  // that the body starts on 8 bytes
+  const size_t padded = (flatbuffer.size() + 7) / 8 * 8;
+  const int32_t marker = -1;
+  const int32_t length = static_cast<int32_t>(padded);
+  const char padding[8] = {0};
+  out_.write(reinterpret_cast<const char *>(&marker), 4);
+  out_.write(reinterpret_cast<const char *>(&length), 4);
+  out_.write(flatbuffer.data(), flatbuffer.size());
+  out_.write(padding, padded - flatbuffer.size());
+  offset = offset_;
+  metadata_length = static_cast<int32_t>(8 + padded);
+  offset_ += 8 + static_cast<int64_t>(padded);
+}
+
+bool ArrowFileWriter::Close() {
+  if (closed_) {
+    return ok_;
+  }
+  closed_ = true;
+  if (!ok_) {
+    return false;
+  }
+  WriteBatch();
+  // The end of the stream, then the footer: version, schema, dictionaries
+  // and record batches, the blocks of 24 bytes
+  const int32_t end[2] = {-1, 0};
+  out_.write(reinterpret_cast<const char *>(end), sizeof(end));
+  std::string blocks;
+  for (const Block &block : blocks_) {
+    Put<int64_t>(blocks, block.offset);
+    Put<int32_t>(blocks, block.metadata_length);
+    Put<int32_t>(blocks, 0);
+    Put<int64_t>(blocks, block.body_length);
+  }
+  FlatPtr footer = Table();
+  AddScalar<int16_t>(footer, 0, kMetadataV5);
+  AddChild(footer, 1, Schema(columns_));
+  AddChild(footer, 2, StructVector(std::string(), 0));
+  AddChild(footer, 3, StructVector(blocks, blocks_.size()));
+  const std::string flatbuffer = Finish(*footer);
+  const int32_t length = static_cast<int32_t>(flatbuffer.size());
+  out_.write(flatbuffer.data(), flatbuffer.size());
+  out_.write(reinterpret_cast<const char *>(&length), 4);
+  out_.write(kMagic, 6);
+  out_.close();
+  ok_ = !out_.fail();
+  return ok_;
+}
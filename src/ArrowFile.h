@@ -0,0 +1,97 @@
+#ifndef ARROW_FILE_H
+#define ARROW_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// The types of the columns of an ArrowFileWriter, each without nulls
+enum class ArrowType { kBool, kInt8, kInt32, kInt64, kUInt64, kFloat32, kFloat64 };
+
+struct ArrowColumn {
+  std::string name;
+  ArrowType type;
+};
+
+// A table written to an Arrow IPC file (Feather v2, ".arrow"), for the
+// analysis tools that scan columns, like pyarrow, polars or DuckDB, rather
+// than parse a line of text a row.
+//
+// The rows are appended a value a column at a time, into a buffer of each
+// column, and every batch_rows rows the buffers go to the file as a record
+// batch, so a file of millions of ticks is written with the memory of one
+// batch. The messages of the format, the schema, the record batches and
+// the footer, are flatbuffers written here, without the Arrow or
+// flatbuffers libraries, in the byte order of the host (little endian
+// assumed).
+//
+//   ArrowFileWriter writer(path, {{"session", ArrowType::kUInt64},
+//                                 {"solve_s", ArrowType::kFloat64}});
+//   writer.Append(0, session);
+//   writer.Append(1, seconds);
+//   writer.EndRow();
+//   ...
+//   writer.Close();
+class ArrowFileWriter {
+ public:
+  static const size_t kDefaultBatchRows = 65536;
+
+  // A file at path of columns; false from ok() if it can't be written
+  ArrowFileWriter(const std::string &path, const std::vector<ArrowColumn> &columns,
+                  size_t batch_rows = kDefaultBatchRows);
+  // Close it if it isn't yet
+  ~ArrowFileWriter();
+  ArrowFileWriter(const ArrowFileWriter &) = delete;
+  ArrowFileWriter &operator=(const ArrowFileWriter &) = delete;
+
+  bool ok() const { return ok_; }
+  size_t rows() const { return rows_; }
+
+  // The value of column for the row, converted to its type. Every column
+  // takes one value a row before EndRow.
+  void Append(size_t column, double value);
+  void Append(size_t column, int64_t value);
+  void Append(size_t column, uint64_t value);
+  void Append(size_t column, int value) { Append(column, static_cast<int64_t>(value)); }
+  void Append(size_t column, uint32_t value) { Append(column, static_cast<int64_t>(value)); }
+  void Append(size_t column, bool value) { Append(column, static_cast<int64_t>(value)); }
+  void EndRow();
+
+  // Write the last batch and the footer, false if any of the file couldn't
+  // be written
+  bool Close();
+
+ private:
+  // The values of a column in the batch, in its layout
+  struct Buffer {
+    ArrowType type;
+    std::string bytes;
+  };
+
+  void WriteBatch();
+  // The flatbuffer of a message written as an encapsulated message, its
+  // body to follow; its offset and metadata length
+  void WriteMessage(const std::string &flatbuffer, int64_t &offset, int32_t &metadata_length);
+
+  std::ofstream out_;
+  bool ok_ = false;
+  bool closed_ = false;
+  std::vector<ArrowColumn> columns_;
+  size_t batch_rows_;
+  std::vector<Buffer> buffers_;
+  size_t batch_ = 0;
+  size_t rows_ = 0;
+  int64_t offset_ = 0;
+  // Offset, metadata length and body length of each record batch, for the
+  // footer
+  struct Block {
+    int64_t offset;
+    int32_t metadata_length;
+    int64_t body_length;
+  };
+  std::vector<Block> blocks_;
+};
+
+#endif /* ARROW_FILE_H */
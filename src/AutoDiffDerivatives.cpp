@@ -0,0 +1,145 @@
+#include "AutoDiffDerivatives.h"
+#include <cmath>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/unsupported/Eigen/AutoDiff"
+#include "KinematicModel.h"
+#include "StageModel.h"
+
+namespace Eigen {
+
+// The polynomial heading of ModelStep needs atan, which AutoDiffScalar
+// lacks. Found by argument dependent lookup, also for nested scalars.
+template <typename DerType>
+inline AutoDiffScalar<typename internal::remove_all<DerType>::type::PlainObject> atan(
+    const AutoDiffScalar<DerType> &x) {
+  using std::atan;
+  typedef typename internal::traits<typename internal::remove_all<DerType>::type>::Scalar Scalar;
+  typedef typename internal::remove_all<DerType>::type::PlainObject Derivatives;
+  return AutoDiffScalar<Derivatives>(
+      atan(x.value()), x.derivatives() * (Scalar(1) / (Scalar(1) + x.value() * x.value())));
+}
+
+}  // namespace Eigen
+
+namespace {
+
+// Inputs of a stage: 6 states, delta and a, see StageModel
+const int kStageInputs = 8;
+typedef Eigen::Matrix<double, kStageInputs, 1> StageGradient;
+// First derivatives, and first derivatives of first derivatives
+typedef Eigen::AutoDiffScalar<StageGradient> FirstOrder;
+typedef Eigen::AutoDiffScalar<Eigen::Matrix<FirstOrder, kStageInputs, 1> > SecondOrder;
+
+}  // namespace
+
+template <class H>
+AutoDiffDerivatives<H>::AutoDiffDerivatives(const std::vector<size_t> &jac_rows,
+                                            const std::vector<size_t> &jac_cols,
+                                            const std::vector<size_t> &hes_rows,
+                                            const std::vector<size_t> &hes_cols)
+    : cost_(jac_rows, jac_cols, hes_rows, hes_cols),
+      jac_index_(H::n_constraints * H::n_vars, -1), hes_index_(H::n_vars * H::n_vars, -1),
+      jac_nnz_(jac_rows.size()) {
+  for (size_t k = 0; k < jac_nnz_; k++) {
+    jac_index_[jac_rows[k] * H::n_vars + jac_cols[k]] = static_cast<int>(k);
+  }
+  for (size_t k = 0; k < hes_rows.size(); k++) {
+    hes_index_[hes_rows[k] * H::n_vars + hes_cols[k]] = static_cast<int>(k);
+  }
+}
+
+template <class H>
+void AutoDiffDerivatives<H>::AddJacobian(size_t row, size_t col, double value,
+                                         double *values) {
+  const int k = jac_index_[row * H::n_vars + col];
+  if (k >= 0) {
+    values[k] += value;
+  } else if (value != 0) {
+    dropped_++;
+  }
+}
+
+template <class H>
+void AutoDiffDerivatives<H>::AddHessian(size_t row, size_t col, double value, double *values) {
+  // Lower triangle only
+  const int k = row >= col ? hes_index_[row * H::n_vars + col] : hes_index_[col * H::n_vars + row];
+  if (k >= 0) {
+    values[k] += value;
+  } else if (value != 0) {
+    dropped_++;
+  }
+}
+
+template <class H>
+void AutoDiffDerivatives<H>::Jacobian(const double *x, const double *coeffs, double *values) {
+  constexpr size_t N = H::N;
+  typedef StageModel<H> Model;
+  static_assert(Model::n_inputs == kStageInputs, "the derivatives are those of a stage");
+
+  for (size_t k = 0; k < jac_nnz_; k++) {
+    values[k] = 0;
+  }
+
+  // Dynamics rows: z[t+1] - F(z[t], u[t])
+  FirstOrder in[kStageInputs];
+  FirstOrder out[6];
+  for (size_t t = 0; t < N - 1; t++) {
+    for (int i = 0; i < kStageInputs; i++) {
+      in[i] = FirstOrder(x[Model::Variable(t, i)], StageGradient::Unit(i));
+    }
+    Model::Step(t, in, coeffs, out);
+
+    for (size_t k = 0; k < 6; k++) {
+      const size_t row = Model::Row(t, k);
+      AddJacobian(row, Model::NextVariable(t, k), 1, values);
+      for (int i = 0; i < kStageInputs; i++) {
+        AddJacobian(row, Model::Variable(t, i), -out[k].derivatives()[i], values);
+      }
+    }
+  }
+}
+
+template <class H>
+void AutoDiffDerivatives<H>::Hessian(const double *x, const double *coeffs,
+                                     const CostWeights &weights, double obj_factor,
+                                     const double *lambda, double *values) {
+  constexpr size_t N = H::N;
+  typedef StageModel<H> Model;
+
+  cost_.CostHessian(weights, obj_factor, values);
+
+  // Dynamics rows z[t+1] - F(z[t], u[t]): minus lambda times the second
+  // derivatives of F, the lower triangle of each stage block
+  SecondOrder in[kStageInputs];
+  SecondOrder out[6];
+  for (size_t t = 0; t < N - 1; t++) {
+    for (int i = 0; i < kStageInputs; i++) {
+      in[i].value() = FirstOrder(x[Model::Variable(t, i)], StageGradient::Unit(i));
+      in[i].derivatives().setConstant(FirstOrder(0, StageGradient::Zero()));
+      in[i].derivatives()[i] = FirstOrder(1, StageGradient::Zero());
+    }
+    Model::Step(t, in, coeffs, out);
+
+    for (int i = 0; i < kStageInputs; i++) {
+      for (int j = 0; j <= i; j++) {
+        double value = 0;
+        for (size_t k = 0; k < 6; k++) {
+          value -= lambda[Model::Row(t, k)] * out[k].derivatives()[i].derivatives()[j];
+        }
+        AddHessian(Model::Variable(t, i), Model::Variable(t, j), value, values);
+      }
+    }
+  }
+}
+
+template class AutoDiffDerivatives<Horizon10>;
+template class AutoDiffDerivatives<Horizon15>;
+template class AutoDiffDerivatives<Horizon25>;
+template class AutoDiffDerivatives<Horizon40>;
+template class AutoDiffDerivatives<Horizon15Coarse>;
+template class AutoDiffDerivatives<Horizon8RK4>;
+template class AutoDiffDerivatives<Horizon11Graded>;
+template class AutoDiffDerivatives<Horizon10Blocked>;
+template class AutoDiffDerivatives<Horizon15Blocked>;
+template class AutoDiffDerivatives<Horizon25Blocked>;
+template class AutoDiffDerivatives<Horizon15Dynamic>;
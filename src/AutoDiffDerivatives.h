@@ -0,0 +1,58 @@
+#ifndef AUTO_DIFF_DERIVATIVES_H
+#define AUTO_DIFF_DERIVATIVES_H
+
+#include <cstddef>
+#include <vector>
+#include "CostWeights.h"
+#include "Horizon.h"
+#include "ModelDerivatives.h"
+
+// Constraint Jacobian and Lagrangian Hessian of FG_eval by forward mode
+// automatic differentiation of each stage, with Eigen's AutoDiffScalar
+// instead of the CppAD tape.
+//
+// A step of the model depends on 8 inputs only, the 6 states and 2
+// actuations of its stage, so every stage is evaluated once on fixed-size
+// derivative vectors of 8: plain AutoDiffScalars for the Jacobian, nested
+// ones for the second derivatives of the Hessian, and the results are
+// scattered straight into the block-sparse patterns. The model is the
+// ModelStep of KinematicModel.h in whatever integrator H uses, taken stage
+// by stage through StageModel as FG_eval takes it, so unlike
+// ModelDerivatives nothing has to be derived by hand when it changes. The
+// cost Hessian is constant and comes in closed form from
+// ModelDerivatives::CostHessian.
+//
+// The patterns, dropped() and the instantiations are those of
+// ModelDerivatives (see ModelDerivatives.h).
+template <class H>
+class AutoDiffDerivatives {
+public:
+  // jac_rows are constraint indices (rows of fg minus one), hes_rows and
+  // hes_cols the lower triangle of the Hessian.
+  AutoDiffDerivatives(const std::vector<size_t> &jac_rows, const std::vector<size_t> &jac_cols,
+                      const std::vector<size_t> &hes_rows, const std::vector<size_t> &hes_cols);
+
+  // Constraint Jacobian at vars x with the polynomial coeffs (4 values)
+  void Jacobian(const double *x, const double *coeffs, double *values);
+
+  // Hessian of obj_factor * cost + lambda' * constraints, the cost with
+  // weights
+  void Hessian(const double *x, const double *coeffs, const CostWeights &weights,
+               double obj_factor, const double *lambda, double *values);
+
+  // Number of nonzero values that had no entry in the patterns
+  size_t dropped() const { return dropped_ + cost_.dropped(); }
+
+private:
+  void AddJacobian(size_t row, size_t col, double value, double *values);
+  void AddHessian(size_t row, size_t col, double value, double *values);
+
+  ModelDerivatives<H> cost_;
+  // Position of (row, col) in the pattern, -1 when it isn't in it
+  std::vector<int> jac_index_;
+  std::vector<int> hes_index_;
+  size_t jac_nnz_;
+  size_t dropped_ = 0;
+};
+
+#endif /* AUTO_DIFF_DERIVATIVES_H */
@@ -0,0 +1,106 @@
+#include "BatchMPC.h"
+#include <algorithm>
+#include "CppADThreads.h"
+
+BatchMPC::BatchMPC(std::unique_ptr<MPCBase> first, size_t n_vehicles, size_t n_threads)
+    : vehicles_(n_vehicles) {
+  vehicles_[0] = std::move(first);
+  n_threads_ = std::max<size_t>(
+      1, std::min(std::min(n_threads, vehicles_.size()), SetupCppADThreads(n_threads)));
+
+  // Every worker makes its vehicles before the first batch
+  running_ = n_threads_ - 1;
+  for (size_t j = 1; j < n_threads_; j++) {
+    workers_.push_back(std::thread(&BatchMPC::Work, this, j));
+  }
+  CloneShare(0);
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return running_ == 0; });
+}
+
+BatchMPC::~BatchMPC() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+}
+
+void BatchMPC::CloneShare(size_t j) {
+  for (size_t k = j; k < vehicles_.size(); k += n_threads_) {
+    if (k > 0) {
+      vehicles_[k] = vehicles_[0]->Clone();
+    }
+  }
+}
+
+void BatchMPC::SolveShare(size_t j) {
+  for (size_t k = j; k < vehicles_.size(); k += n_threads_) {
+    results_[k] = vehicles_[k]->Solve(states_[k], coeffs_[k]);
+  }
+}
+
+void BatchMPC::Work(size_t j) {
+  CppADThread cppad_thread;
+  CloneShare(j);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--running_ == 0) {
+      done_.notify_one();
+    }
+  }
+
+  size_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_.wait(lock, [this, seen] { return stop_ || tick_ != seen; });
+      if (stop_) {
+        break;
+      }
+      seen = tick_;
+    }
+    SolveShare(j);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--running_ == 0) {
+        done_.notify_one();
+      }
+    }
+  }
+
+  // Their memory goes back to the pool of this thread
+  for (size_t k = j; k < vehicles_.size(); k += n_threads_) {
+    vehicles_[k].reset();
+  }
+}
+
+void BatchMPC::SolveBatch(const MPCState *states, const MPCCoeffs *coeffs,
+                          MPCSolution *results) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    states_ = states;
+    coeffs_ = coeffs;
+    results_ = results;
+    running_ = workers_.size();
+    tick_++;
+  }
+  start_.notify_all();
+
+  SolveShare(0);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return running_ == 0; });
+}
+
+std::unique_ptr<BatchMPC> MakeBatchMPC(const MPCBase &prototype, size_t n_vehicles,
+                                       size_t n_threads) {
+  std::unique_ptr<MPCBase> first = n_vehicles > 0 ? prototype.Clone() : nullptr;
+  if (!first) {
+    return std::unique_ptr<BatchMPC>();
+  }
+  return std::unique_ptr<BatchMPC>(new BatchMPC(std::move(first), n_vehicles, n_threads));
+}
@@ -0,0 +1,83 @@
+#ifndef BATCH_MPC_H
+#define BATCH_MPC_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "MPC.h"
+
+// One MPC per vehicle of a fleet, all solving the same problem, solved in
+// one call across the cores.
+//
+// The vehicles are copies (MPCBase::Clone) of one MPC, so the Ipopt MPC
+// records its tape and computes its sparsity patterns and their colouring
+// once for the whole fleet. Every vehicle still keeps a tape, scratch
+// vectors and a solver of its own: a CppAD function can't be evaluated by
+// two threads at once, and every vehicle warm starts from its own last plan.
+//
+// Vehicle k belongs to thread k % threads() for the life of the batch, which
+// makes it, solves it and destroys it; thread 0 is the calling one. CppAD
+// runs in parallel mode meanwhile (see CppADThreads.h). All the vehicles of a
+// thread run to their own deadline one after the other, so a batch takes
+// size() / threads() solves.
+//
+// Separate Ipopt instances can solve concurrently only if the linear solver
+// Ipopt is built with is thread-safe, which MUMPS builds often aren't.
+class BatchMPC {
+public:
+  // first is vehicle 0, the others (n_vehicles > 0 in all) are copies of
+  // it. On up to n_threads threads, no more than there are vehicles or CppAD
+  // takes.
+  BatchMPC(std::unique_ptr<MPCBase> first, size_t n_vehicles, size_t n_threads);
+
+  // Destroys the vehicles of the workers on their threads and joins them
+  ~BatchMPC();
+
+  size_t size() const { return vehicles_.size(); }
+  size_t threads() const { return workers_.size() + 1; }
+
+  // MPC of vehicle k, for its settings (prev_a, max_solve_time,
+  // cost_schedule) and its plan. Not to be used during SolveBatch.
+  MPCBase &vehicle(size_t k) { return *vehicles_[k]; }
+  const MPCBase &vehicle(size_t k) const { return *vehicles_[k]; }
+
+  // Solve every vehicle k on states[k] and coeffs[k], its plan into
+  // results[k]. All three hold size() elements.
+  void SolveBatch(const MPCState *states, const MPCCoeffs *coeffs, MPCSolution *results);
+
+private:
+  // Loop of worker thread j
+  void Work(size_t j);
+
+  // Make and solve the vehicles of thread j
+  void CloneShare(size_t j);
+  void SolveShare(size_t j);
+
+  std::vector<std::unique_ptr<MPCBase> > vehicles_;
+  std::vector<std::thread> workers_;
+  size_t n_threads_;
+
+  // The problems of this batch, set before the workers are woken
+  const MPCState *states_ = nullptr;
+  const MPCCoeffs *coeffs_ = nullptr;
+  MPCSolution *results_ = nullptr;
+
+  // Batches handed to the workers, the workers still busy, and whether they
+  // are to stop
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  size_t tick_ = 0;
+  size_t running_ = 0;
+  bool stop_ = false;
+};
+
+// n_vehicles copies of prototype on up to n_threads threads. The prototype
+// itself is left alone. Null without vehicles or if it can't be copied (see
+// MPCBase::Clone).
+std::unique_ptr<BatchMPC> MakeBatchMPC(const MPCBase &prototype, size_t n_vehicles,
+                                       size_t n_threads);
+
+#endif /* BATCH_MPC_H */
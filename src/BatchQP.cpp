@@ -0,0 +1,24 @@
+#include "BatchQP.h"
+#include "BoxQPKernel.h"
+
+BatchQP::BatchQP(int m, size_t size)
+    : m_(m), size_(size), hessian_(m * m * size, 0.0), gradient_(m * size, 0.0),
+      lower_(m * size, 0.0), upper_(m * size, 0.0), x_(m * size, 0.0), working_(m * size, 0),
+      scratch_((m + 2) * m * size, 0.0), iterations_(size, 0) {}
+
+void BatchQP::Solve(int max_iterations, double tolerance) {
+#ifdef MPC_CUDA
+  on_gpu_ = SolveBoxQPsCuda(m_, size_, hessian_.data(), gradient_.data(), lower_.data(),
+                            upper_.data(), x_.data(), working_.data(), iterations_.data(),
+                            max_iterations, tolerance);
+  if (on_gpu_) {
+    return;
+  }
+#endif
+  const size_t n = m_ * size_;
+  for (size_t p = 0; p < size_; p++) {
+    iterations_[p] = SolveBoxQP(m_, size_, &hessian_[p], &gradient_[p], &lower_[p], &upper_[p],
+                                &x_[p], &working_[p], &scratch_[p], &scratch_[m_ * n + p],
+                                &scratch_[(m_ + 1) * n + p], max_iterations, tolerance);
+  }
+}
@@ -0,0 +1,101 @@
+#include "BatchQP.h"
+#include "BoxQPKernel.h"
+#include <cuda_runtime.h>
+#include <iostream>
+
+namespace {
+
+const int kThreadsPerBlock = 128;
+
+// One problem per thread, the scratch in the layout of the batch
+__global__ void SolveBoxQPsKernel(int m, size_t size, const double *hessian,
+                                  const double *gradient, const double *lower,
+                                  const double *upper, double *x, int *working,
+                                  double *scratch, int *iterations, int max_iterations,
+                                  double tolerance) {
+  const size_t p = blockIdx.x * static_cast<size_t>(blockDim.x) + threadIdx.x;
+  if (p >= size) {
+    return;
+  }
+  const size_t n = m * size;
+  iterations[p] = SolveBoxQP(m, size, hessian + p, gradient + p, lower + p, upper + p, x + p,
+                             working + p, scratch + p, scratch + m * n + p,
+                             scratch + (m + 1) * n + p, max_iterations, tolerance);
+}
+
+// Device copy of an array, freed with the object
+template <class T>
+class DeviceArray {
+public:
+  explicit DeviceArray(size_t n) : n_(n) {
+    if (cudaMalloc(&data_, n * sizeof(T)) != cudaSuccess) {
+      data_ = nullptr;
+    }
+  }
+  ~DeviceArray() { cudaFree(data_); }
+
+  T *data() const { return data_; }
+
+  bool CopyFrom(const T *host) {
+    return cudaMemcpy(data_, host, n_ * sizeof(T), cudaMemcpyHostToDevice) == cudaSuccess;
+  }
+  bool CopyTo(T *host) const {
+    return cudaMemcpy(host, data_, n_ * sizeof(T), cudaMemcpyDeviceToHost) == cudaSuccess;
+  }
+
+private:
+  T *data_ = nullptr;
+  size_t n_;
+};
+
+}  // namespace
+
+bool SolveBoxQPsCuda(int m, size_t size, const double *hessian, const double *gradient,
+                     const double *lower, const double *upper, double *x, int *working,
+                     int *iterations, int max_iterations, double tolerance) {
+  int devices = 0;
+  if (cudaGetDeviceCount(&devices) != cudaSuccess || devices == 0) {
+    std::cerr << "No CUDA device, solving the batch on the CPU" << std::endl;
+    return false;
+  }
+
+  const size_t n = m * size;
+  DeviceArray<double> d_hessian(m * n);
+  DeviceArray<double> d_gradient(n);
+  DeviceArray<double> d_lower(n);
+  DeviceArray<double> d_upper(n);
+  DeviceArray<double> d_x(n);
+  DeviceArray<int> d_working(n);
+  DeviceArray<double> d_scratch((m + 2) * n);
+  DeviceArray<int> d_iterations(size);
+  if (!d_hessian.data() || !d_gradient.data() || !d_lower.data() || !d_upper.data() ||
+      !d_x.data() || !d_working.data() || !d_scratch.data() || !d_iterations.data()) {
+    std::cerr << "Cannot allocate the batch on the GPU, solving it on the CPU" << std::endl;
+    return false;
+  }
+  if (!d_hessian.CopyFrom(hessian) || !d_gradient.CopyFrom(gradient) ||
+      !d_lower.CopyFrom(lower) || !d_upper.CopyFrom(upper) || !d_x.CopyFrom(x) ||
+      !d_working.CopyFrom(working)) {
+    std::cerr << "Cannot copy the batch to the GPU, solving it on the CPU" << std::endl;
+    return false;
+  }
+
+  const size_t blocks = (size + kThreadsPerBlock - 1) / kThreadsPerBlock;
+  SolveBoxQPsKernel<<<blocks, kThreadsPerBlock>>>(
+      m, size, d_hessian.data(), d_gradient.data(), d_lower.data(), d_upper.data(), d_x.data(),
+      d_working.data(), d_scratch.data(), d_iterations.data(), max_iterations, tolerance);
+  cudaError_t error = cudaGetLastError();
+  if (error == cudaSuccess) {
+    error = cudaDeviceSynchronize();
+  }
+  if (error != cudaSuccess) {
+    std::cerr << "The batch kernel failed: " << cudaGetErrorString(error)
+              << ", solving on the CPU" << std::endl;
+    return false;
+  }
+  if (!d_x.CopyTo(x) || !d_working.CopyTo(working) || !d_iterations.CopyTo(iterations)) {
+    std::cerr << "Cannot copy the solutions from the GPU, solving on the CPU" << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,87 @@
+#ifndef BATCH_QP_H
+#define BATCH_QP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// A batch of independent dense QPs of one size m with box constraints only
+//
+//   min 0.5 x'Hx + g'x   s.t.   lb <= x <= ub
+//
+// such as the condensed MPC QPs of many scenarios, solved in one call: on
+// the GPU in one kernel launch, one problem per thread, in builds with the
+// MPC_CUDA CMake option and a CUDA device; on the CPU otherwise. Both run
+// SolveBoxQP (BoxQPKernel.h).
+//
+// The arrays are structures of arrays: element e of problem p lies at
+// e * size() + p, so the threads of neighbouring problems read neighbouring
+// memory.
+class BatchQP {
+public:
+  BatchQP(int m, size_t size);
+
+  int m() const { return m_; }
+  size_t size() const { return size_; }
+
+  // Set problem p and its starting point (Eigen matrix and vectors of size m)
+  template <class Matrix, class Vector>
+  void Set(size_t p, const Matrix &hessian, const Vector &gradient, const Vector &lower,
+           const Vector &upper, const Vector &x) {
+    for (int i = 0; i < m_; i++) {
+      for (int j = 0; j < m_; j++) {
+        hessian_[(i * m_ + j) * size_ + p] = hessian(i, j);
+      }
+      gradient_[i * size_ + p] = gradient[i];
+      lower_[i * size_ + p] = lower[i];
+      upper_[i * size_ + p] = upper[i];
+      x_[i * size_ + p] = x[i];
+    }
+  }
+
+  // Solution of problem p after Solve
+  template <class Vector>
+  void Get(size_t p, Vector &x) const {
+    for (int i = 0; i < m_; i++) {
+      x[i] = x_[i * size_ + p];
+    }
+  }
+
+  // Solve every problem, each from its working set of the last Solve (see
+  // SolveBoxQP)
+  void Solve(int max_iterations = 200, double tolerance = 1e-9);
+
+  // Free every bound, for a cold start of the next Solve
+  void ClearWorkingSets() { std::fill(working_.begin(), working_.end(), 0); }
+
+  // Iterations problem p took in the last Solve, -1 if a block of its
+  // Hessian wasn't positive definite
+  int iterations(size_t p) const { return iterations_[p]; }
+
+  // Whether the last Solve ran on the GPU
+  bool on_gpu() const { return on_gpu_; }
+
+private:
+  int m_;
+  size_t size_;
+  std::vector<double> hessian_;
+  std::vector<double> gradient_;
+  std::vector<double> lower_;
+  std::vector<double> upper_;
+  std::vector<double> x_;
+  std::vector<int> working_;
+  // Scratch of SolveBoxQP on the CPU, (m + 2) * m * size
+  std::vector<double> scratch_;
+  std::vector<int> iterations_;
+  bool on_gpu_ = false;
+};
+
+#ifdef MPC_CUDA
+// SolveBoxQP over a batch in the layout of BatchQP, on the GPU (BatchQP.cu).
+// False, with the reason on stderr, when there is no device or CUDA fails.
+bool SolveBoxQPsCuda(int m, size_t size, const double *hessian, const double *gradient,
+                     const double *lower, const double *upper, double *x, int *working,
+                     int *iterations, int max_iterations, double tolerance);
+#endif
+
+#endif /* BATCH_QP_H */
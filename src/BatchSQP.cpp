@@ -0,0 +1,98 @@
+#include "BatchSQP.h"
+#include "KinematicModel.h"
+
+template <class H>
+BatchSQP<H>::BatchSQP(size_t size, int max_iterations, double tolerance)
+    : max_iterations_(max_iterations), tolerance_(tolerance), qps_(size), batch_(QP::n_u, size),
+      u_(size), du_(size), costs_(size, 0.0), converged_(size, false), failed_(size, false) {}
+
+template <class H>
+void BatchSQP<H>::Solve(const MPCState *states, const MPCCoeffs *coeffs,
+                        MPCSolution *results) {
+  for (size_t k = 0; k < size(); k++) {
+    qps_[k].SetWeights(cost_schedule.At(states[k][3]));
+    u_[k].setZero();
+    costs_[k] = qps_[k].Cost(states[k], u_[k], coeffs[k]);
+    converged_[k] = false;
+    failed_[k] = false;
+  }
+  batch_.ClearWorkingSets();
+
+  const typename QP::Vector zero = QP::Vector::Zero();
+  for (int iter = 0; iter < max_iterations_; iter++) {
+    size_t active = 0;
+    for (size_t k = 0; k < size(); k++) {
+      // A converged scenario keeps its last QP, its solution and working
+      // set, which the solver confirms at once
+      if (!converged_[k]) {
+        qps_[k].Linearize(states[k], u_[k], coeffs[k]);
+        qps_[k].Feedback(states[k], coeffs[k]);
+        batch_.Set(k, qps_[k].hessian(), qps_[k].gradient(), qps_[k].lower(), qps_[k].upper(),
+                   zero);
+        active++;
+      }
+    }
+    if (active == 0) {
+      break;
+    }
+    batch_.Solve();
+
+    for (size_t k = 0; k < size(); k++) {
+      if (converged_[k]) {
+        continue;
+      }
+      if (batch_.iterations(k) < 0) {
+        failed_[k] = iter == 0;
+        converged_[k] = true;
+        continue;
+      }
+      batch_.Get(k, du_[k]);
+
+      // Backtrack until the nonlinear cost decreases, like MPC_SQP
+      double alpha = 1.0;
+      double trial_cost = costs_[k];
+      typename QP::Vector trial;
+      for (; alpha > 1e-3; alpha *= 0.5) {
+        trial = u_[k] + alpha * du_[k];
+        trial_cost = qps_[k].Cost(states[k], trial, coeffs[k]);
+        if (trial_cost < costs_[k]) {
+          break;
+        }
+      }
+      if (trial_cost >= costs_[k]) {
+        converged_[k] = true;
+        continue;
+      }
+      u_[k] = trial;
+      costs_[k] = trial_cost;
+      if (alpha * du_[k].template lpNorm<Eigen::Infinity>() < tolerance_) {
+        converged_[k] = true;
+      }
+    }
+  }
+
+  // The plans, rolled out through the nonlinear model
+  for (size_t k = 0; k < size(); k++) {
+    const typename QP::Vector &u = u_[k];
+    MPCSolution &result = results[k];
+    result.stages = H::N;
+    result.set_times<H>();
+    result.status = failed_[k] ? SolveStatus::kFailed : SolveStatus::kSolved;
+    result.cost = costs_[k];
+    MPCState z = states[k];
+    result.set_state(0, z);
+    for (size_t t = 0; t + 1 < H::N; t++) {
+      result.delta[t] = u[H::block(t)];
+      result.a[t] = u[H::n_blocks + H::block(t)];
+      z = ModelStep(z, result.delta[t], result.a[t], coeffs[k], H::step(t));
+      result.set_state(t + 1, z);
+    }
+  }
+}
+
+template class BatchSQP<Horizon10>;
+template class BatchSQP<Horizon15>;
+template class BatchSQP<Horizon25>;
+template class BatchSQP<Horizon10Blocked>;
+template class BatchSQP<Horizon15Blocked>;
+template class BatchSQP<Horizon25Blocked>;
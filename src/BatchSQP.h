@@ -0,0 +1,66 @@
+#ifndef BATCH_SQP_H
+#define BATCH_SQP_H
+
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/StdVector"
+#include "BatchQP.h"
+#include "CondensedQP.h"
+#include "CostWeights.h"
+#include "Horizon.h"
+#include "MPC.h"
+
+// The SQP of MPC_SQP over a batch of independent scenarios, for offline
+// sweeps over tens of thousands of them.
+//
+// Every scenario starts cold from zero actuations. Each iteration
+// linearizes and condenses all of them on the CPU (CondensedQP), solves all
+// their QPs at once with BatchQP, on the GPU in MPC_CUDA builds, and then
+// backtracks every scenario on its nonlinear cost like MPC_SQP. The working
+// sets carry over from one iteration to the next. A scenario stops moving
+// once its step is below tolerance or its cost stops falling.
+//
+// H is the horizon layout (see Horizon.h). The instantiations are listed at
+// the end of BatchSQP.cpp.
+template <class H>
+class BatchSQP {
+public:
+  typedef CondensedQP<H> QP;
+
+  explicit BatchSQP(size_t size, int max_iterations = 10, double tolerance = 1e-6);
+
+  // Cost weights of each scenario, at the speed of its initial state
+  CostSchedule cost_schedule;
+
+  size_t size() const { return costs_.size(); }
+
+  // Solve scenario k from states[k] along coeffs[k], its plan (like
+  // MPCBase::Solve) into results[k]. All three hold size() elements.
+  void Solve(const MPCState *states, const MPCCoeffs *coeffs, MPCSolution *results);
+
+  // Nonlinear cost of the plan of scenario k, and whether its first QP
+  // failed (a Hessian that isn't positive definite), leaving zero actuations
+  double cost(size_t k) const { return costs_[k]; }
+  bool failed(size_t k) const { return failed_[k]; }
+
+  // Whether the QPs of the last Solve were solved on the GPU
+  bool on_gpu() const { return batch_.on_gpu(); }
+
+private:
+  typedef std::vector<QP, Eigen::aligned_allocator<QP> > QPVector;
+  typedef std::vector<typename QP::Vector, Eigen::aligned_allocator<typename QP::Vector> >
+      ActuationVector;
+
+  int max_iterations_;
+  double tolerance_;
+
+  QPVector qps_;
+  BatchQP batch_;
+  ActuationVector u_;
+  ActuationVector du_;
+  std::vector<double> costs_;
+  std::vector<bool> converged_;
+  std::vector<bool> failed_;
+};
+
+#endif /* BATCH_SQP_H */
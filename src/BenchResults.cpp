@@ -0,0 +1,262 @@
+#include "BenchResults.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <unordered_map>
+#include "SimdKernels.h"
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+// The 97.5th percentile of Student's t with df degrees of freedom, by the
+// expansion of Cornish and Fisher about the normal, within 0.3% from 3
+double StudentT975(double df) {
+  const double z = 1.959964;
+  const double z3 = z * z * z;
+  const double z5 = z3 * z * z;
+  const double z7 = z5 * z * z;
+  return z + (z3 + z) / (4 * df) + (5 * z5 + 16 * z3 + 3 * z) / (96 * df * df) +
+         (3 * z7 + 19 * z5 + 17 * z3 - 15 * z) / (384 * df * df * df);
+}
+
+// The mean and the variance of the mean of samples
+void MeanVariance(const std::vector<double> &samples, double &mean, double &variance) {
+  mean = 0;
+  for (double sample : samples) {
+    mean += sample;
+  }
+  mean /= samples.size();
+  double squares = 0;
+  for (double sample : samples) {
+    squares += (sample - mean) * (sample - mean);
+  }
+  variance = squares / (samples.size() - 1) / samples.size();
+}
+
+}  // namespace
+
+BenchResult SummarizeTimes(const std::string &name, const std::vector<double> &times) {
+  BenchResult result;
+  result.name = name;
+  result.count = times.size();
+  if (times.empty()) {
+    return result;
+  }
+  const size_t batches = std::min(kBenchBatches, times.size());
+  double sum = 0;
+  for (size_t b = 0; b < batches; b++) {
+    // The remainder of the division spread over the first batches
+    const size_t begin = b * times.size() / batches;
+    const size_t end = (b + 1) * times.size() / batches;
+    double batch = 0;
+    for (size_t k = begin; k < end; k++) {
+      batch += times[k];
+    }
+    sum += batch;
+    result.batches.push_back(batch / (end - begin));
+  }
+  std::vector<double> sorted(times);
+  std::sort(sorted.begin(), sorted.end());
+  const auto quantile = [&sorted](double q) {
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(q * sorted.size()))];
+  };
+  result.mean = sum / times.size();
+  result.p50 = quantile(0.5);
+  result.p90 = quantile(0.9);
+  result.p99 = quantile(0.99);
+  result.max = sorted.back();
+  return result;
+}
+
+bool WriteBenchJSON(const std::string &path, const std::string &tool,
+                    const std::vector<BenchResult> &results) {
+  json benchmarks = json::array();
+  for (const BenchResult &result : results) {
+    json counters = json::object();
+    for (const auto &counter : result.counters) {
+      counters[counter.first] = counter.second;
+    }
+    benchmarks.push_back({{"name", result.name},
+                          {"count", result.count},
+                          {"mean", result.mean},
+                          {"p50", result.p50},
+                          {"p90", result.p90},
+                          {"p99", result.p99},
+                          {"max", result.max},
+                          {"batches", result.batches},
+                          {"counters", counters}});
+  }
+  std::ofstream out(path);
+  out << json({{"tool", tool},
+               {"unit", "s"},
+               {"simd", SimdKernelTarget()},
+               {"benchmarks", benchmarks}})
+             .dump(1)
+      << "\n";
+  return static_cast<bool>(out);
+}
+
+bool WriteBenchCSV(const std::string &path, const std::vector<BenchResult> &results) {
+  std::ofstream out(path);
+  // The counters of every benchmark in columns of their own
+  std::vector<std::string> columns;
+  for (const BenchResult &result : results) {
+    for (const auto &counter : result.counters) {
+      if (std::find(columns.begin(), columns.end(), counter.first) == columns.end()) {
+        columns.push_back(counter.first);
+      }
+    }
+  }
+  out << "name,count,mean_s,p50_s,p90_s,p99_s,max_s";
+  for (const std::string &column : columns) {
+    out << "," << column;
+  }
+  out << "\n" << std::setprecision(9);
+  for (const BenchResult &result : results) {
+    out << result.name << "," << result.count << "," << result.mean << "," << result.p50 << ","
+        << result.p90 << "," << result.p99 << "," << result.max;
+    for (const std::string &column : columns) {
+      const auto counter = result.counters.find(column);
+      out << ",";
+      if (counter != result.counters.end()) {
+        out << counter->second;
+      }
+    }
+    out << "\n";
+  }
+  return static_cast<bool>(out);
+}
+
+bool ReadBenchJSON(const std::string &path, std::vector<BenchResult> &results,
+                   std::string &error) {
+  std::ifstream in(path);
+  if (!in) {
+    error = "could not open " + path;
+    return false;
+  }
+  try {
+    const json file = json::parse(in);
+    for (const json &benchmark : file.at("benchmarks")) {
+      BenchResult result;
+      result.name = benchmark.at("name").get<std::string>();
+      result.count = benchmark.at("count").get<size_t>();
+      result.mean = benchmark.at("mean").get<double>();
+      result.p50 = benchmark.at("p50").get<double>();
+      result.p90 = benchmark.at("p90").get<double>();
+      result.p99 = benchmark.at("p99").get<double>();
+      result.max = benchmark.at("max").get<double>();
+      result.batches = benchmark.at("batches").get<std::vector<double>>();
+      if (benchmark.count("counters") > 0) {
+        for (auto counter = benchmark["counters"].begin(); counter != benchmark["counters"].end();
+             ++counter) {
+          result.counters[counter.key()] = counter.value().get<double>();
+        }
+      }
+      results.push_back(result);
+    }
+  } catch (const std::exception &e) {
+    error = path + ": " + e.what();
+    return false;
+  }
+  return true;
+}
+
+bool CompareBench(const BenchResult &baseline, const BenchResult &candidate, BenchChange &change) {
+  if (baseline.batches.size() < 2 || candidate.batches.size() < 2 || baseline.mean <= 0 ||
+      candidate.mean <= 0) {
+    return false;
+  }
+  double mean_a, variance_a, mean_b, variance_b;
+  MeanVariance(baseline.batches, mean_a, variance_a);
+  MeanVariance(candidate.batches, mean_b, variance_b);
+  const double variance = variance_a + variance_b;
+  // Welch-Satterthwaite, and a difference that is exact, of batches all
+  // the same, as sure as it gets
+  const double df =
+      variance > 0 ? variance * variance /
+                         (variance_a * variance_a / (baseline.batches.size() - 1) +
+                          variance_b * variance_b / (candidate.batches.size() - 1))
+                   : INFINITY;
+  const double half = StudentT975(std::max(df, 1.0)) * std::sqrt(variance);
+  // Relative to the baseline as measured, its own uncertainty left out
+  change.mean = (mean_b - mean_a) / mean_a;
+  change.low = (mean_b - mean_a - half) / mean_a;
+  change.high = (mean_b - mean_a + half) / mean_a;
+  change.throughput = mean_a / mean_b - 1;
+  change.p99 = baseline.p99 > 0 ? (candidate.p99 - baseline.p99) / baseline.p99 : 0;
+  change.significant = change.low > 0 || change.high < 0;
+  return true;
+}
+
+size_t PrintBenchComparison(const std::vector<BenchResult> &baseline,
+                            const std::vector<BenchResult> &candidate, double threshold,
+                            std::ostream &out) {
+  std::unordered_map<std::string, const BenchResult *> by_name;
+  for (const BenchResult &result : baseline) {
+    by_name[result.name] = &result;
+  }
+  out << std::left << std::setw(34) << "benchmark" << std::right << std::setw(11) << "base us"
+      << std::setw(11) << "new us" << std::setw(9) << "mean" << std::setw(20) << "95% CI"
+      << std::setw(9) << "thrpt" << std::setw(9) << "p99" << "  verdict" << std::endl;
+  size_t regressions = 0;
+  size_t improvements = 0;
+  std::vector<std::string> unmatched;
+  for (const BenchResult &result : candidate) {
+    const auto base = by_name.find(result.name);
+    if (base == by_name.end()) {
+      unmatched.push_back(result.name);
+      continue;
+    }
+    const BenchResult &before = *base->second;
+    by_name.erase(base);
+    out << std::left << std::setw(34) << result.name << std::right << std::fixed
+        << std::setprecision(1) << std::setw(11) << before.mean * 1e6 << std::setw(11)
+        << result.mean * 1e6;
+    BenchChange change;
+    if (!CompareBench(before, result, change)) {
+      out << "  too few batches to compare" << std::endl;
+      continue;
+    }
+    char interval[32];
+    std::snprintf(interval, sizeof(interval), "[%+.1f, %+.1f]%%", change.low * 100,
+                  change.high * 100);
+    const char *verdict = "";
+    if (change.significant && change.mean > threshold) {
+      verdict = "slower";
+      regressions++;
+    } else if (change.significant && change.mean < -threshold) {
+      verdict = "faster";
+      improvements++;
+    } else if (change.significant) {
+      verdict = "within threshold";
+    }
+    out << std::showpos << std::setw(8) << change.mean * 100 << "%" << std::noshowpos
+        << std::setw(20) << interval << std::showpos << std::setw(8) << change.throughput * 100
+        << "%" << std::setw(8) << change.p99 * 100 << "%" << std::noshowpos << "  " << verdict
+        << std::endl;
+  }
+  out << std::endl
+      << regressions << " slower and " << improvements << " faster by more than "
+      << std::setprecision(1) << threshold * 100 << "%, significantly" << std::endl;
+  if (!unmatched.empty()) {
+    out << "Not in the baseline:";
+    for (const std::string &name : unmatched) {
+      out << " " << name;
+    }
+    out << std::endl;
+  }
+  if (!by_name.empty()) {
+    out << "Not in the candidate:";
+    for (const BenchResult &result : baseline) {
+      if (by_name.count(result.name) > 0) {
+        out << " " << result.name;
+      }
+    }
+    out << std::endl;
+  }
+  return regressions;
+}
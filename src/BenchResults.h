@@ -0,0 +1,77 @@
+#ifndef BENCH_RESULTS_H
+#define BENCH_RESULTS_H
+
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// The results of the benchmarks of mpc_bench and mpc_replay in files, JSON
+// to be kept as the baseline of a revision and compared with a later run,
+// CSV for a spreadsheet. The times of a benchmark are kept whole in the
+// quantiles, and as the means of consecutive batches of them: successive
+// solves of a trace share their plans and caches, and the state of the
+// host, so single times aren't independent, but the means of long enough
+// batches nearly are, and the difference of two runs is judged on those
+// (Welch's t-test). Two runs are only comparable on the same host, build
+// type and inputs, which the files don't check.
+
+// The batches of the times of a benchmark, fewer when it has fewer times
+const size_t kBenchBatches = 20;
+
+// One benchmark of a run, its times in seconds
+struct BenchResult {
+  std::string name;
+  size_t count = 0;
+  double mean = 0;
+  double p50 = 0;
+  double p90 = 0;
+  double p99 = 0;
+  double max = 0;
+  // The means of the batches of the times, in their order
+  std::vector<double> batches;
+  // What else the tool measured of it, e.g. the iterations a solve, kept
+  // in the files but not compared
+  std::map<std::string, double> counters;
+};
+
+// The result of the benchmark name from its times, in the order they were
+// taken; of no times, a count of 0
+BenchResult SummarizeTimes(const std::string &name, const std::vector<double> &times);
+
+// Write the results of tool to path, with the instruction set of the
+// kernels of the host (see SimdKernelTarget), false if it can't be written
+bool WriteBenchJSON(const std::string &path, const std::string &tool,
+                    const std::vector<BenchResult> &results);
+bool WriteBenchCSV(const std::string &path, const std::vector<BenchResult> &results);
+// The results of a file of WriteBenchJSON, false with the reason in error
+// if it can't be read
+bool ReadBenchJSON(const std::string &path, std::vector<BenchResult> &results,
+                   std::string &error);
+
+// The change of a benchmark from a baseline, relative to the baseline, with
+// the 95% confidence interval of the change of the means
+struct BenchChange {
+  double mean = 0;
+  double low = 0;
+  double high = 0;
+  // Of the throughput, the inverse of the mean time
+  double throughput = 0;
+  double p99 = 0;
+  // The interval excludes no change
+  bool significant = false;
+};
+
+// The change of candidate from baseline, false if either has fewer than
+// two batches to judge it on
+bool CompareBench(const BenchResult &baseline, const BenchResult &candidate, BenchChange &change);
+
+// Print the changes of the benchmarks of candidate from those of the same
+// names in baseline to out, and return the number that got significantly
+// slower by more than threshold, relative, in their means
+size_t PrintBenchComparison(const std::vector<BenchResult> &baseline,
+                            const std::vector<BenchResult> &candidate, double threshold,
+                            std::ostream &out);
+
+#endif /* BENCH_RESULTS_H */
@@ -0,0 +1,161 @@
+#ifndef BOX_QP_KERNEL_H
+#define BOX_QP_KERNEL_H
+
+#include <cmath>
+#include <cstddef>
+
+// The solver of one problem of a BatchQP, compiled both for the host and,
+// by nvcc, for the GPU. Plain loops over strided arrays: no Eigen, no
+// allocation, no library calls but sqrt.
+
+#ifdef __CUDACC__
+#define MPC_HOST_DEVICE __host__ __device__
+#else
+#define MPC_HOST_DEVICE
+#endif
+
+// Solve min 0.5 x'Hx + g'x  s.t.  lb <= x <= ub  of size m by the primal
+// active-set method of ActiveSetQP: each iteration takes the Newton step in
+// the variables off the working set (-1 fixed at lb, +1 at ub, 0 free), by a
+// Cholesky factorization of their block of H in place, then either steps
+// until a bound blocks or releases the bound with the most negative
+// multiplier. The working set is the starting one and is left for the next
+// solve. There is no LDLT fallback: a free block that isn't positive
+// definite fails the solve.
+//
+// Element e of each array lies at [e * stride]; H is row major. x holds the
+// starting point and receives the solution; factor (m * m), grad and step
+// (m each) are scratch. Return the iterations taken, max_iterations if the
+// working set still changed then, or -1 if the factorization failed.
+MPC_HOST_DEVICE inline int SolveBoxQP(int m, size_t stride, const double *H, const double *g,
+                                      const double *lb, const double *ub, double *x,
+                                      int *working, double *factor, double *grad, double *step,
+                                      int max_iterations, double tolerance) {
+  for (int i = 0; i < m; i++) {
+    const size_t e = i * stride;
+    double xi = x[e] < lb[e] ? lb[e] : x[e];
+    xi = xi > ub[e] ? ub[e] : xi;
+    if (working[e] < 0) {
+      xi = lb[e];
+    } else if (working[e] > 0) {
+      xi = ub[e];
+    } else if (lb[e] == ub[e]) {
+      working[e] = -1;
+    }
+    x[e] = xi;
+  }
+
+  for (int iter = 0; iter < max_iterations; iter++) {
+    for (int i = 0; i < m; i++) {
+      double sum = g[i * stride];
+      for (int j = 0; j < m; j++) {
+        sum += H[(i * m + j) * stride] * x[j * stride];
+      }
+      grad[i * stride] = sum;
+    }
+
+    // Lower Cholesky factor of the free block, then step = -(LL')^-1 grad
+    // over the free variables
+    for (int i = 0; i < m; i++) {
+      if (working[i * stride] != 0) {
+        continue;
+      }
+      for (int j = 0; j <= i; j++) {
+        if (working[j * stride] != 0) {
+          continue;
+        }
+        double sum = H[(i * m + j) * stride];
+        for (int k = 0; k < j; k++) {
+          if (working[k * stride] == 0) {
+            sum -= factor[(i * m + k) * stride] * factor[(j * m + k) * stride];
+          }
+        }
+        if (j < i) {
+          factor[(i * m + j) * stride] = sum / factor[(j * m + j) * stride];
+        } else if (sum > 0) {
+          factor[(i * m + i) * stride] = sqrt(sum);
+        } else {
+          return -1;
+        }
+      }
+    }
+    for (int i = 0; i < m; i++) {
+      if (working[i * stride] != 0) {
+        step[i * stride] = 0;
+        continue;
+      }
+      double sum = -grad[i * stride];
+      for (int k = 0; k < i; k++) {
+        if (working[k * stride] == 0) {
+          sum -= factor[(i * m + k) * stride] * step[k * stride];
+        }
+      }
+      step[i * stride] = sum / factor[(i * m + i) * stride];
+    }
+    double step_norm = 0;
+    for (int i = m - 1; i >= 0; i--) {
+      if (working[i * stride] != 0) {
+        continue;
+      }
+      double sum = step[i * stride];
+      for (int k = i + 1; k < m; k++) {
+        if (working[k * stride] == 0) {
+          sum -= factor[(k * m + i) * stride] * step[k * stride];
+        }
+      }
+      step[i * stride] = sum / factor[(i * m + i) * stride];
+      step_norm = fabs(step[i * stride]) > step_norm ? fabs(step[i * stride]) : step_norm;
+    }
+
+    if (step_norm < tolerance) {
+      // Stationary on the working set: release the bound whose multiplier
+      // has the wrong sign, or stop at the optimum
+      int release = -1;
+      double worst = -tolerance;
+      for (int i = 0; i < m; i++) {
+        const size_t e = i * stride;
+        const double multiplier = working[e] < 0 ? grad[e] : -grad[e];
+        if (working[e] != 0 && lb[e] < ub[e] && multiplier < worst) {
+          worst = multiplier;
+          release = i;
+        }
+      }
+      if (release < 0) {
+        return iter;
+      }
+      working[release * stride] = 0;
+      continue;
+    }
+
+    // Longest feasible fraction of the step, fixing the blocking bound
+    double alpha = 1.0;
+    int blocking = -1;
+    int blocking_side = 0;
+    for (int i = 0; i < m; i++) {
+      const size_t e = i * stride;
+      if (working[e] != 0) {
+        continue;
+      }
+      if (step[e] < 0 && lb[e] - x[e] > alpha * step[e]) {
+        alpha = (lb[e] - x[e]) / step[e];
+        blocking = i;
+        blocking_side = -1;
+      } else if (step[e] > 0 && ub[e] - x[e] < alpha * step[e]) {
+        alpha = (ub[e] - x[e]) / step[e];
+        blocking = i;
+        blocking_side = 1;
+      }
+    }
+    for (int i = 0; i < m; i++) {
+      x[i * stride] += alpha * step[i * stride];
+    }
+    if (blocking >= 0) {
+      const size_t e = blocking * stride;
+      x[e] = blocking_side < 0 ? lb[e] : ub[e];
+      working[e] = blocking_side;
+    }
+  }
+  return max_iterations;
+}
+
+#endif /* BOX_QP_KERNEL_H */
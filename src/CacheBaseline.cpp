@@ -0,0 +1,132 @@
+#include "CacheBaseline.h"
+#include <chrono>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Solve state, coeffs cold by mpc with the settings of like and prev_a, in
+// seconds and iterations
+void SolveCold(MPCBase &mpc, const MPCBase &like, double prev_a, const MPCState &state,
+               const MPCCoeffs &coeffs, double &seconds, int &iterations) {
+  mpc.prev_a = prev_a;
+  mpc.max_solve_time = like.max_solve_time;
+  mpc.cost_schedule = like.cost_schedule;
+  mpc.Reset();
+  const Clock::time_point start = Clock::now();
+  const MPCSolution solution = mpc.Solve(state, coeffs);
+  seconds = SecondsSince(start);
+  iterations = solution.statistics.iterations;
+}
+
+// Tolerances within which no pose is, so that no fit is reused
+ReferenceFitTolerance NoTolerance() {
+  ReferenceFitTolerance tolerance;
+  tolerance.position = -1;
+  tolerance.heading = -1;
+  return tolerance;
+}
+
+}  // namespace
+
+void RecordTickCaches(const TickCaches &tick, std::array<CacheCounters, kCaches> &caches) {
+  if (tick.fitted) {
+    caches[static_cast<size_t>(Cache::kFit)].Record(tick.fit_hit, tick.fit_seconds, 0);
+  }
+  if (tick.shared) {
+    caches[static_cast<size_t>(Cache::kSharedSolve)].Record(tick.shared_hit, tick.solve_seconds,
+                                                            tick.iterations);
+  }
+  if (tick.shared_hit) {
+    return;
+  }
+  const bool cold = tick.start == SolveStart::kCold;
+  if (tick.start == SolveStart::kWarm || cold) {
+    caches[static_cast<size_t>(Cache::kWarmStart)].Record(!cold, tick.solve_seconds,
+                                                          tick.iterations);
+  }
+  if (tick.start == SolveStart::kRecalled || (tick.recall && cold)) {
+    caches[static_cast<size_t>(Cache::kSolutionDatabase)].Record(!cold, tick.solve_seconds,
+                                                                 tick.iterations);
+  }
+  if (tick.table) {
+    caches[static_cast<size_t>(Cache::kLinearizationTable)].Record(true, tick.solve_seconds,
+                                                                   tick.iterations);
+  }
+  if (tick.speculated) {
+    caches[static_cast<size_t>(Cache::kSpeculation)].Record(
+        tick.speculation_hit, tick.solve_seconds, tick.iterations);
+  }
+}
+
+CacheBaseline::CacheBaseline(bool float_fit) : fit_(NoTolerance(), float_fit) {}
+
+void CacheBaseline::Reset() {
+  cold_.reset();
+  closed_form_.reset();
+  copied_ = false;
+}
+
+bool CacheBaseline::Measure(const MPCBase &mpc, const Telemetry::Waypoints &ptsx,
+                            const Telemetry::Waypoints &ptsy, double px, double py, double psi,
+                            const MPCState &state, const MPCCoeffs &coeffs,
+                            const TickCaches &tick,
+                            std::array<CacheCounters, kCaches> &caches) {
+  // With no tolerance the same waypoints are always transformed and fitted
+  // again, everything a hit skips
+  if (tick.fitted && tick.fit_hit) {
+    const Clock::time_point start = Clock::now();
+    fit_.Fit(ptsx, ptsy, px, py, psi);
+    caches[static_cast<size_t>(Cache::kFit)].RecordSaving(SecondsSince(start) - tick.fit_seconds,
+                                                          0);
+  }
+
+  if (!copied_) {
+    copied_ = true;
+    cold_ = mpc.Clone();
+    if (cold_) {
+      cold_->KeepSolutions(0);
+    }
+    if (cold_ && mpc.linearization_table) {
+      closed_form_ = cold_->Clone();
+      closed_form_->linearization_table = nullptr;
+    }
+  }
+  if (!cold_) {
+    return false;
+  }
+
+  double cold_seconds = 0;
+  int cold_iterations = 0;
+  SolveCold(*cold_, mpc, tick.prev_a, state, coeffs, cold_seconds, cold_iterations);
+  const double saved_seconds = cold_seconds - tick.solve_seconds;
+  const double saved_iterations = cold_iterations - tick.iterations;
+  if (tick.start == SolveStart::kWarm) {
+    caches[static_cast<size_t>(Cache::kWarmStart)].RecordSaving(saved_seconds, saved_iterations);
+  }
+  if (tick.start == SolveStart::kRecalled) {
+    caches[static_cast<size_t>(Cache::kSolutionDatabase)].RecordSaving(saved_seconds,
+                                                                       saved_iterations);
+  }
+  if (tick.shared_hit) {
+    caches[static_cast<size_t>(Cache::kSharedSolve)].RecordSaving(saved_seconds,
+                                                                  saved_iterations);
+  }
+  if (tick.speculated && tick.speculation_hit) {
+    caches[static_cast<size_t>(Cache::kSpeculation)].RecordSaving(saved_seconds,
+                                                                  saved_iterations);
+  }
+  if (tick.table && closed_form_) {
+    double closed_form_seconds = 0;
+    int closed_form_iterations = 0;
+    SolveCold(*closed_form_, mpc, tick.prev_a, state, coeffs, closed_form_seconds,
+              closed_form_iterations);
+    caches[static_cast<size_t>(Cache::kLinearizationTable)].RecordSaving(
+        closed_form_seconds - cold_seconds, closed_form_iterations - cold_iterations);
+  }
+  return true;
+}
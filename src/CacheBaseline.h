@@ -0,0 +1,80 @@
+#ifndef CACHE_BASELINE_H
+#define CACHE_BASELINE_H
+
+#include <array>
+#include <memory>
+#include <vector>
+#include "MPC.h"
+#include "Metrics.h"
+#include "ReferenceFit.h"
+
+// How the caches served one tick (see Cache in Metrics.h), and what the
+// stages they serve took on it
+struct TickCaches {
+  // Whether the tick fitted the waypoints, and reused the last fit as it was
+  bool fitted = false;
+  bool fit_hit = false;
+  double fit_seconds = 0;
+  // What the solve started from, whether the solver keeps past solutions
+  // and takes the linearization table, and whether a speculative plan was
+  // ready for the tick and taken
+  SolveStart start = SolveStart::kCold;
+  bool recall = false;
+  bool table = false;
+  bool speculated = false;
+  bool speculation_hit = false;
+  // Whether the solver looked the tick up in the solves shared by the
+  // sessions, and found it there, in which case none was made
+  bool shared = false;
+  bool shared_hit = false;
+  double solve_seconds = 0;
+  int iterations = 0;
+  // The previous throttle the solve had, set aside by the time it is
+  // measured (see MPCBase::prev_a)
+  double prev_a = 0;
+};
+
+// Count the hits and misses of the caches of tick into caches: a warm start
+// hits and a cold one misses, a recalled start hits the solution database
+// and, with recall, a cold one misses it, every solve with the table hits
+// it (it extrapolates outside its grid), a speculation hits when its plan
+// was taken, and a shared solve when another session solved the tick
+// before, none of the others then
+void RecordTickCaches(const TickCaches &tick, std::array<CacheCounters, kCaches> &caches);
+
+// The work of a tick done again without its caches, to measure what they
+// saved rather than estimate it: the waypoints fitted by a ReferenceFitCache
+// that never reuses a fit, and the state solved cold by a copy of the
+// solver that keeps no past solutions, and by another without the
+// linearization table when the solver takes one. Each cache that hit on
+// the tick is credited with the seconds and iterations of the baseline
+// beyond those of the tick; the table with those of the copy without it
+// beyond those of the copy with it, both cold.
+//
+// The copies are made by the first Measure after construction or Reset,
+// and take the max_solve_time and cost_schedule of the solver, and the
+// prev_a of the tick, at every Measure. Their solves cost as much as a cold solve of the tick, on
+// the thread that calls Measure, so it is for every few ticks at most.
+class CacheBaseline {
+public:
+  explicit CacheBaseline(bool float_fit);
+
+  // Copy the solver again at the next Measure, for one made anew
+  void Reset();
+
+  // Measure tick, whose fit of ptsx, ptsy from the pose (px, py, psi) and
+  // solve by mpc of state, coeffs took what tick says, into caches. False,
+  // measuring the fit only, if mpc can't be copied (see MPCBase::Clone).
+  bool Measure(const MPCBase &mpc, const Telemetry::Waypoints &ptsx,
+               const Telemetry::Waypoints &ptsy, double px, double py, double psi,
+               const MPCState &state, const MPCCoeffs &coeffs, const TickCaches &tick,
+               std::array<CacheCounters, kCaches> &caches);
+
+private:
+  ReferenceFitCache fit_;
+  std::unique_ptr<MPCBase> cold_;
+  std::unique_ptr<MPCBase> closed_form_;
+  bool copied_ = false;
+};
+
+#endif /* CACHE_BASELINE_H */
@@ -0,0 +1,68 @@
+#ifndef CACHE_LINE_H
+#define CACHE_LINE_H
+
+#include <stdlib.h>
+#include <cstddef>
+#include <new>
+
+// The structs that threads share are laid out by who writes their fields:
+// each group written by one thread (the event loop, the solver) starts on a
+// cache line of its own, alignas(kCacheLine), so that a write by one thread
+// doesn't take the line of the fields another is using away from its core
+// (false sharing), and fields only one thread touches, or that are set once,
+// go together.
+//
+// operator new of C++11 aligns to alignof(std::max_align_t) only, so such a
+// struct is allocated through CacheLineAllocator, as the Eigen types are
+// through Eigen::aligned_allocator, e.g. std::allocate_shared<Session>(
+// CacheLineAllocator<Session>(), ...), or by the operator new of
+// MPC_CACHE_LINE_OPERATOR_NEW when it is made with new. Either way the
+// object starts a line and, its size being a multiple of kCacheLine, none
+// of its neighbours on the heap shares its lines.
+
+// The line of the x86-64 and most ARM cores
+const size_t kCacheLine = 64;
+
+// Memory for n objects of T, aligned to a cache line
+template <class T>
+class CacheLineAllocator {
+public:
+  typedef T value_type;
+
+  CacheLineAllocator() = default;
+  template <class U>
+  CacheLineAllocator(const CacheLineAllocator<U> &) {}
+
+  T *allocate(size_t n) {
+    void *memory = nullptr;
+    if (posix_memalign(&memory, kCacheLine, n * sizeof(T)) != 0) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T *>(memory);
+  }
+  void deallocate(T *memory, size_t) { free(memory); }
+
+  template <class U>
+  struct rebind {
+    typedef CacheLineAllocator<U> other;
+  };
+};
+
+template <class T, class U>
+bool operator==(const CacheLineAllocator<T> &, const CacheLineAllocator<U> &) {
+  return true;
+}
+
+template <class T, class U>
+bool operator!=(const CacheLineAllocator<T> &, const CacheLineAllocator<U> &) {
+  return false;
+}
+
+// In the public part of a class aligned to cache lines and made with new
+#define MPC_CACHE_LINE_OPERATOR_NEW                                  \
+  static void *operator new(size_t size) {                           \
+    return CacheLineAllocator<char>().allocate(size);                \
+  }                                                                  \
+  static void operator delete(void *memory) { free(memory); }
+
+#endif /* CACHE_LINE_H */
@@ -0,0 +1,324 @@
+#include "ChunkedTapes.h"
+#include <algorithm>
+#include <cmath>
+#include "CppADThreads.h"
+#include "KinematicModel.h"
+
+namespace {
+
+// Inputs and outputs of a stage: 6 states, delta and a; the next state,
+// see StageModel
+const size_t kStageInputs = 8;
+const size_t kStageOutputs = 6;
+
+}  // namespace
+
+template <class H>
+ChunkedTapes<H>::ChunkedTapes(const std::vector<size_t> &jac_rows,
+                              const std::vector<size_t> &jac_cols,
+                              const std::vector<size_t> &hes_rows,
+                              const std::vector<size_t> &hes_cols, size_t n_threads)
+    : cost_(jac_rows, jac_cols, hes_rows, hes_cols),
+      jac_index_(H::n_constraints * H::n_vars, -1), hes_index_(H::n_vars * H::n_vars, -1),
+      jac_nnz_(jac_rows.size()) {
+  constexpr size_t N = H::N;
+  for (size_t k = 0; k < jac_nnz_; k++) {
+    jac_index_[jac_rows[k] * H::n_vars + jac_cols[k]] = static_cast<int>(k);
+  }
+  for (size_t k = 0; k < hes_rows.size(); k++) {
+    hes_index_[hes_rows[k] * H::n_vars + hes_cols[k]] = static_cast<int>(k);
+  }
+  for (size_t t = 0; t < N - 1; t++) {
+    for (size_t k = 0; k < kStageOutputs; k++) {
+      jac_ones_.push_back(jac_index_[H::constraint_row(k, t) * H::n_vars + k * N + t + 1]);
+    }
+  }
+
+  n_threads_ = std::max<size_t>(
+      1, std::min(std::min(n_threads, N - 1), SetupCppADThreads(n_threads)));
+  const size_t stages = (N - 1 + n_threads_ - 1) / n_threads_;
+  for (size_t first = 0; first < N - 1; first += stages) {
+    chunks_.emplace_back(new Chunk());
+    chunks_.back()->first = first;
+    chunks_.back()->last = std::min(first + stages, N - 1);
+  }
+
+  // Every worker records its chunks before the first evaluation
+  running_ = n_threads_ - 1;
+  for (size_t j = 1; j < n_threads_; j++) {
+    workers_.push_back(std::thread(&ChunkedTapes::Work, this, j));
+  }
+  RunShare(0, Task::kRecord);
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return running_ == 0; });
+}
+
+template <class H>
+ChunkedTapes<H>::~ChunkedTapes() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+}
+
+template <class H>
+void ChunkedTapes<H>::Record(Chunk &chunk) {
+  typedef CppAD::AD<double> AD;
+  typedef CPPAD_TESTVECTOR(AD) ADvector;
+  const size_t stages = chunk.last - chunk.first;
+  const size_t n_in = kStageInputs * stages;
+  const size_t n_out = kStageOutputs * stages;
+
+  // The model steps of the chunk, with no data dependent branches like
+  // FG_eval, so the values while taping don't matter
+  ADvector ain(n_in);
+  for (size_t i = 0; i < n_in; i++) {
+    ain[i] = 0.0;
+  }
+  ADvector acoeffs(4);
+  for (size_t i = 0; i < 4; i++) {
+    acoeffs[i] = 0.0;
+  }
+  CppAD::Independent(ain, 0, false, acoeffs);
+  ADvector aout(n_out);
+  for (size_t s = 0; s < stages; s++) {
+    const AD *in = &ain[kStageInputs * s];
+    Model::Step(chunk.first + s, in, acoeffs, &aout[kStageOutputs * s]);
+  }
+  chunk.fun.Dependent(ain, aout);
+  chunk.fun.optimize();
+  chunk.inputs.resize(n_in);
+  chunk.coeffs.resize(4);
+  chunk.weights.resize(n_out);
+
+  // Sparsity of the chunk's Jacobian and of the lower triangle of its
+  // Hessian, as MPC_NLP::ComputeSparsity does for the whole tape
+  CppAD::sparse_rc<Svector> identity(n_in, n_in, n_in);
+  for (size_t i = 0; i < n_in; i++) {
+    identity.set(i, i, i);
+  }
+  chunk.fun.for_jac_sparsity(identity, false, false, false, chunk.jac_pattern);
+  chunk.jac_subset = CppAD::sparse_rcv<Svector, Dvector>(chunk.jac_pattern);
+
+  CPPAD_TESTVECTOR(bool) select_range(n_out);
+  for (size_t i = 0; i < n_out; i++) {
+    select_range[i] = true;
+  }
+  CppAD::sparse_rc<Svector> hes;
+  chunk.fun.rev_hes_sparsity(select_range, false, false, hes);
+  size_t nnz = 0;
+  for (size_t k = 0; k < hes.nnz(); k++) {
+    if (hes.row()[k] >= hes.col()[k]) nnz++;
+  }
+  chunk.hes_pattern.resize(n_in, n_in, nnz);
+  nnz = 0;
+  for (size_t k = 0; k < hes.nnz(); k++) {
+    if (hes.row()[k] >= hes.col()[k]) {
+      chunk.hes_pattern.set(nnz++, hes.row()[k], hes.col()[k]);
+    }
+  }
+  chunk.hes_subset = CppAD::sparse_rcv<Svector, Dvector>(chunk.hes_pattern);
+
+  // Where the values go in the patterns of MPC_NLP: local input i of stage s
+  // is variable Model::Variable(first + s, i % 8), output k of it
+  // constraint row constraint_row(k, first + s)
+  chunk.jac_index.resize(chunk.jac_pattern.nnz());
+  for (size_t k = 0; k < chunk.jac_pattern.nnz(); k++) {
+    const size_t out = chunk.jac_pattern.row()[k];
+    const size_t in = chunk.jac_pattern.col()[k];
+    const size_t t = chunk.first + out / kStageOutputs;
+    const size_t row = H::constraint_row(out % kStageOutputs, t);
+    const size_t col = Model::Variable(chunk.first + in / kStageInputs, in % kStageInputs);
+    chunk.jac_index[k] = jac_index_[row * H::n_vars + col];
+  }
+  chunk.hes_index.resize(chunk.hes_pattern.nnz());
+  for (size_t k = 0; k < chunk.hes_pattern.nnz(); k++) {
+    const size_t r = chunk.hes_pattern.row()[k];
+    const size_t c = chunk.hes_pattern.col()[k];
+    const size_t row = Model::Variable(chunk.first + r / kStageInputs, r % kStageInputs);
+    const size_t col = Model::Variable(chunk.first + c / kStageInputs, c % kStageInputs);
+    chunk.hes_index[k] = row >= col ? hes_index_[row * H::n_vars + col]
+                                    : hes_index_[col * H::n_vars + row];
+  }
+
+  // Colour the patterns now, at a dummy point, so no solve pays for it
+  for (size_t i = 0; i < n_in; i++) {
+    chunk.inputs[i] = 0.0;
+  }
+  for (size_t i = 0; i < n_out; i++) {
+    chunk.weights[i] = 1.0;
+  }
+  chunk.fun.sparse_jac_for(n_in, chunk.inputs, chunk.jac_subset, chunk.jac_pattern, "cppad",
+                           chunk.jac_work);
+  chunk.fun.sparse_hes(chunk.inputs, chunk.weights, chunk.hes_subset, chunk.hes_pattern,
+                       "cppad.symmetric", chunk.hes_work);
+}
+
+template <class H>
+void ChunkedTapes<H>::Load(Chunk &chunk) {
+  for (size_t t = chunk.first; t < chunk.last; t++) {
+    for (size_t i = 0; i < kStageInputs; i++) {
+      chunk.inputs[kStageInputs * (t - chunk.first) + i] = x_[Model::Variable(t, i)];
+    }
+  }
+  bool changed = false;
+  for (size_t i = 0; i < 4; i++) {
+    changed |= chunk.coeffs[i] != coeffs_[i];
+    chunk.coeffs[i] = coeffs_[i];
+  }
+  if (changed) {
+    chunk.fun.new_dynamic(chunk.coeffs);
+  }
+}
+
+template <class H>
+void ChunkedTapes<H>::RunShare(size_t j, Task task) {
+  for (size_t k = j; k < chunks_.size(); k += n_threads_) {
+    Chunk &chunk = *chunks_[k];
+    switch (task) {
+      case Task::kRecord:
+        Record(chunk);
+        // A first Load always sets the coefficients
+        for (size_t i = 0; i < 4; i++) {
+          chunk.coeffs[i] = std::nan("");
+        }
+        break;
+      case Task::kJacobian:
+        Load(chunk);
+        chunk.fun.sparse_jac_for(chunk.inputs.size(), chunk.inputs, chunk.jac_subset,
+                                 chunk.jac_pattern, "cppad", chunk.jac_work);
+        break;
+      case Task::kHessian:
+        Load(chunk);
+        // The rows are z[t+1] - F(z[t], u[t])
+        for (size_t t = chunk.first; t < chunk.last; t++) {
+          for (size_t i = 0; i < kStageOutputs; i++) {
+            chunk.weights[kStageOutputs * (t - chunk.first) + i] =
+                -lambda_[H::constraint_row(i, t)];
+          }
+        }
+        chunk.fun.sparse_hes(chunk.inputs, chunk.weights, chunk.hes_subset, chunk.hes_pattern,
+                             "cppad.symmetric", chunk.hes_work);
+        break;
+    }
+  }
+}
+
+template <class H>
+void ChunkedTapes<H>::Work(size_t j) {
+  CppADThread cppad_thread;
+  RunShare(j, Task::kRecord);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--running_ == 0) {
+      done_.notify_one();
+    }
+  }
+
+  size_t seen = 0;
+  for (;;) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_.wait(lock, [this, seen] { return stop_ || tick_ != seen; });
+      if (stop_) {
+        break;
+      }
+      seen = tick_;
+      task = task_;
+    }
+    RunShare(j, task);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--running_ == 0) {
+        done_.notify_one();
+      }
+    }
+  }
+
+  // Their memory goes back to the pool of this thread
+  for (size_t k = j; k < chunks_.size(); k += n_threads_) {
+    chunks_[k].reset();
+  }
+}
+
+template <class H>
+void ChunkedTapes<H>::Run(Task task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = task;
+    running_ = workers_.size();
+    tick_++;
+  }
+  start_.notify_all();
+
+  RunShare(0, task);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return running_ == 0; });
+}
+
+template <class H>
+void ChunkedTapes<H>::Jacobian(const double *x, const double *coeffs, double *values) {
+  x_ = x;
+  coeffs_ = coeffs;
+  Run(Task::kJacobian);
+
+  for (size_t k = 0; k < jac_nnz_; k++) {
+    values[k] = 0;
+  }
+  for (int k : jac_ones_) {
+    if (k >= 0) {
+      values[k] += 1;
+    } else {
+      dropped_++;
+    }
+  }
+  for (const std::unique_ptr<Chunk> &chunk : chunks_) {
+    const Dvector &val = chunk->jac_subset.val();
+    for (size_t k = 0; k < chunk->jac_index.size(); k++) {
+      if (chunk->jac_index[k] >= 0) {
+        values[chunk->jac_index[k]] -= val[k];
+      } else if (val[k] != 0) {
+        dropped_++;
+      }
+    }
+  }
+}
+
+template <class H>
+void ChunkedTapes<H>::Hessian(const double *x, const double *coeffs, const CostWeights &weights,
+                              double obj_factor, const double *lambda, double *values) {
+  x_ = x;
+  coeffs_ = coeffs;
+  lambda_ = lambda;
+  Run(Task::kHessian);
+
+  cost_.CostHessian(weights, obj_factor, values);
+  for (const std::unique_ptr<Chunk> &chunk : chunks_) {
+    const Dvector &val = chunk->hes_subset.val();
+    for (size_t k = 0; k < chunk->hes_index.size(); k++) {
+      if (chunk->hes_index[k] >= 0) {
+        values[chunk->hes_index[k]] += val[k];
+      } else if (val[k] != 0) {
+        dropped_++;
+      }
+    }
+  }
+}
+
+template class ChunkedTapes<Horizon10>;
+template class ChunkedTapes<Horizon15>;
+template class ChunkedTapes<Horizon25>;
+template class ChunkedTapes<Horizon40>;
+template class ChunkedTapes<Horizon15Coarse>;
+template class ChunkedTapes<Horizon8RK4>;
+template class ChunkedTapes<Horizon11Graded>;
+template class ChunkedTapes<Horizon10Blocked>;
+template class ChunkedTapes<Horizon15Blocked>;
+template class ChunkedTapes<Horizon25Blocked>;
+template class ChunkedTapes<Horizon15Dynamic>;
@@ -0,0 +1,137 @@
+#ifndef CHUNKED_TAPES_H
+#define CHUNKED_TAPES_H
+
+#include <cppad/cppad.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "CostWeights.h"
+#include "Horizon.h"
+#include "ModelDerivatives.h"
+#include "StageModel.h"
+
+// Constraint Jacobian and Lagrangian Hessian of FG_eval from CppAD tapes of
+// chunks of the horizon, evaluated concurrently.
+//
+// The dynamics rows of stage t depend on the states and actuations of
+// stages t and t+1 only, so the horizon splits into chunks of consecutive
+// stages (0..k, k..2k, ...) that are differentiated independently. Every
+// chunk has a tape of its own, of the model steps of its stages alone: 8
+// inputs and 6 outputs per stage, the polynomial as dynamic parameters. The
+// chunks are spread over a few threads, the calling one among them, and each
+// sweeps them with its own coloured work objects; the results are scattered
+// into the patterns of MPC_NLP by the calling thread after, so that the
+// chunks never write to the same values (move blocking shares an actuation
+// between stages). The cost Hessian is constant and comes in closed form
+// from ModelDerivatives::CostHessian.
+//
+// It pays on long horizons, where one sweep of the whole tape costs more
+// than waking the threads: a tape cannot be swept by two threads at once.
+// CppAD runs in parallel mode while the object exists (see CppADThreads.h);
+// every chunk is recorded, swept and destroyed by the thread it belongs to.
+//
+// The patterns, dropped() and the instantiations are those of
+// ModelDerivatives (see ModelDerivatives.h).
+template <class H>
+class ChunkedTapes {
+public:
+  // jac_rows are constraint indices (rows of fg minus one), hes_rows and
+  // hes_cols the lower triangle of the Hessian. On up to n_threads threads
+  // with a chunk each, fewer if CppAD has no more or there are fewer stages.
+  ChunkedTapes(const std::vector<size_t> &jac_rows, const std::vector<size_t> &jac_cols,
+               const std::vector<size_t> &hes_rows, const std::vector<size_t> &hes_cols,
+               size_t n_threads);
+
+  // Destroys the chunks of the workers on their threads and joins them
+  ~ChunkedTapes();
+
+  // Constraint Jacobian at vars x with the polynomial coeffs (4 values)
+  void Jacobian(const double *x, const double *coeffs, double *values);
+
+  // Hessian of obj_factor * cost + lambda' * constraints, the cost with
+  // weights
+  void Hessian(const double *x, const double *coeffs, const CostWeights &weights,
+               double obj_factor, const double *lambda, double *values);
+
+  size_t threads() const { return workers_.size() + 1; }
+
+  // Number of nonzero values that had no entry in the patterns
+  size_t dropped() const { return dropped_ + cost_.dropped(); }
+
+private:
+  typedef CPPAD_TESTVECTOR(double) Dvector;
+  typedef CPPAD_TESTVECTOR(size_t) Svector;
+
+  // Stages [first, last) of the horizon, their tape and its sparse
+  // derivatives
+  struct Chunk {
+    size_t first;
+    size_t last;
+    CppAD::ADFun<double> fun;
+    Dvector inputs;
+    Dvector coeffs;
+    Dvector weights;
+    CppAD::sparse_rc<Svector> jac_pattern;
+    CppAD::sparse_rc<Svector> hes_pattern;
+    CppAD::sparse_rcv<Svector, Dvector> jac_subset;
+    CppAD::sparse_rcv<Svector, Dvector> hes_subset;
+    CppAD::sparse_jac_work jac_work;
+    CppAD::sparse_hes_work hes_work;
+    // Position of each value of the subsets in the patterns of MPC_NLP, -1
+    // when it isn't in them
+    std::vector<int> jac_index;
+    std::vector<int> hes_index;
+  };
+
+  enum class Task { kRecord, kJacobian, kHessian };
+
+  // Loop of worker thread j
+  void Work(size_t j);
+
+  // Run task on the chunks of thread j
+  void RunShare(size_t j, Task task);
+  // Record the tape of chunk, its sparsity patterns and their colouring
+  void Record(Chunk &chunk);
+  // Gather the inputs and coefficients of chunk from x_ and coeffs_
+  void Load(Chunk &chunk);
+
+  // Hand task to the workers, do the share of the calling thread and wait
+  void Run(Task task);
+
+  // Inputs of stage t, see StageModel
+  typedef StageModel<H> Model;
+
+  ModelDerivatives<H> cost_;
+  // Position of (row, col) in the patterns, -1 when it isn't in them
+  std::vector<int> jac_index_;
+  std::vector<int> hes_index_;
+  // Positions of the constant 1 of z[t+1] in the dynamics rows
+  std::vector<int> jac_ones_;
+  size_t jac_nnz_;
+  size_t dropped_ = 0;
+
+  // Chunk k belongs to thread k % threads()
+  std::vector<std::unique_ptr<Chunk> > chunks_;
+  std::vector<std::thread> workers_;
+  size_t n_threads_;
+
+  // The point of this evaluation, set before the workers are woken
+  Task task_ = Task::kRecord;
+  const double *x_ = nullptr;
+  const double *coeffs_ = nullptr;
+  const double *lambda_ = nullptr;
+
+  // Tasks handed to the workers, the workers still busy, and whether they
+  // are to stop
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  size_t tick_ = 0;
+  size_t running_ = 0;
+  bool stop_ = false;
+};
+
+#endif /* CHUNKED_TAPES_H */
@@ -0,0 +1,299 @@
+#include "ClosedLoop.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "CppADThreads.h"
+#include "KinematicModel.h"
+#include "LatencyEstimator.h"
+#include "Polynomial.h"
+#include "ReferenceFit.h"
+#include "SocketIOFrame.h"
+#include "SteerMessage.h"
+#include "Telemetry.h"
+#include "WarmUp.h"
+
+namespace {
+
+LatencyEstimator::Clock::time_point SimulatedTime(double seconds) {
+  return LatencyEstimator::Clock::time_point(
+      std::chrono::duration_cast<LatencyEstimator::Clock::duration>(
+          std::chrono::duration<double>(seconds)));
+}
+
+void AppendNumbers(const double *values, size_t n, std::string &out) {
+  char text[32];
+  out += '[';
+  for (size_t i = 0; i < n; i++) {
+    std::snprintf(text, sizeof(text), "%s%.17g", i > 0 ? "," : "", values[i]);
+    out += text;
+  }
+  out += ']';
+}
+
+// The telemetry event of the simulator for the car at (px, py) heading psi,
+// as DATA.md has it, into frame
+void WriteTelemetry(const double *ptsx, const double *ptsy, size_t n, double px, double py,
+                    double psi, double speed, double steering_angle, double throttle,
+                    std::string &frame) {
+  char text[256];
+  frame.assign("42[\"telemetry\",{\"ptsx\":");
+  AppendNumbers(ptsx, n, frame);
+  frame += ",\"ptsy\":";
+  AppendNumbers(ptsy, n, frame);
+  // Of navigation, clockwise from north
+  double psi_unity = std::fmod(5 * M_PI / 2 - psi, 2 * M_PI);
+  if (psi_unity < 0) {
+    psi_unity += 2 * M_PI;
+  }
+  std::snprintf(text, sizeof(text),
+                ",\"psi\":%.17g,\"psi_unity\":%.17g,\"speed\":%.17g,\"steering_angle\":%.17g,"
+                "\"throttle\":%.17g,\"x\":%.17g,\"y\":%.17g}]",
+                psi, psi_unity, speed, steering_angle, throttle, px, py);
+  frame += text;
+}
+
+}  // namespace
+
+std::string FormatReport(const SimReport &report) {
+  std::string line;
+  char text[32];
+  const auto add = [&](double value) {
+    std::snprintf(text, sizeof(text), "%s%.17g", line.empty() ? "" : " ", value);
+    line += text;
+  };
+  add(report.start);
+  add(report.off_track);
+  add(report.seconds);
+  add(static_cast<double>(report.ticks));
+  add(report.error_sum);
+  add(report.error_squares);
+  add(report.error_max);
+  add(report.speed_sum);
+  add(report.solve_seconds);
+  add(static_cast<double>(report.iterations));
+  add(static_cast<double>(report.failed));
+  add(static_cast<double>(report.lap_times.size()));
+  for (double lap : report.lap_times) {
+    add(lap);
+  }
+  add(static_cast<double>(report.tick_seconds.size()));
+  for (double tick : report.tick_seconds) {
+    add(tick);
+  }
+  return line;
+}
+
+bool ParseReport(const std::string &line, SimReport &report) {
+  std::istringstream in(line);
+  double off_track = 0;
+  double ticks = 0;
+  double iterations = 0;
+  double failed = 0;
+  double laps = 0;
+  double tick_seconds = 0;
+  in >> report.start >> off_track >> report.seconds >> ticks >> report.error_sum >>
+      report.error_squares >> report.error_max >> report.speed_sum >> report.solve_seconds >>
+      iterations >> failed >> laps;
+  if (!in || laps < 0) {
+    return false;
+  }
+  report.off_track = off_track != 0;
+  report.ticks = static_cast<size_t>(ticks);
+  report.iterations = static_cast<uint64_t>(iterations);
+  report.failed = static_cast<size_t>(failed);
+  report.lap_times.resize(static_cast<size_t>(laps));
+  for (double &lap : report.lap_times) {
+    in >> lap;
+  }
+  in >> tick_seconds;
+  if (!in || tick_seconds < 0) {
+    return false;
+  }
+  report.tick_seconds.resize(static_cast<size_t>(tick_seconds));
+  for (double &tick : report.tick_seconds) {
+    in >> tick;
+  }
+  return static_cast<bool>(in);
+}
+
+// Drive the car around track from the distance start along it with mpc
+// until it has done its laps or stops, into report, and the cost of every
+// tick into ticks
+void Drive(const TrackSpline &track, const std::vector<double> &xs, const std::vector<double> &ys,
+           MPCBase &mpc, const SimOptions &options, double start, SimReport &report,
+           LatencyHistogram &ticks) {
+  struct Actuation {
+    double due;
+    double delta;
+    double a;
+  };
+  const TrackPoint origin = track.At(start);
+  // [x, y, psi, v, cte, epsi], the errors unused
+  const double heading = std::atan2(origin.dy, origin.dx);
+  double s[6] = {origin.x - options.lateral_offset * std::sin(heading),
+                 origin.y + options.lateral_offset * std::cos(heading),
+                 heading + options.heading_offset, 0, 0, 0};
+  const double steering_scale = Lf / options.lf;
+  std::mt19937_64 random(options.seed);
+  std::normal_distribution<double> noise(0, 1);
+  double delta = 0;
+  double a = 0;
+  std::deque<Actuation> pending;
+  ReferenceFitCache reference_fit;
+  LatencyEstimator latency(options.latency);
+  Telemetry telemetry;
+  SteerMessage steer_message;
+  std::string frame;
+  double ptsx[kTelemetryWaypoints];
+  double ptsy[kTelemetryWaypoints];
+
+  const double length = track.length();
+  const size_t steps = std::max<size_t>(1, static_cast<size_t>(std::lround(options.tick / kPlantStep)));
+  double progress_s = start;
+  double progress = 0;
+  double lap_started = 0;
+  report.start = start;
+  double t = 0;
+  // The actuations due by t in effect
+  const auto actuate = [&] {
+    while (!pending.empty() && pending.front().due <= t + 1e-9) {
+      delta = pending.front().delta;
+      a = pending.front().a;
+      pending.pop_front();
+    }
+  };
+  while (report.lap_times.size() < options.laps && t - lap_started < kMaxLapTime) {
+    // The telemetry of the tick, from the waypoint behind the car, with the
+    // actuations in effect from now
+    actuate();
+    size_t closest = 0;
+    double best = INFINITY;
+    for (size_t i = 0; i < xs.size(); i++) {
+      const double d = (xs[i] - s[0]) * (xs[i] - s[0]) + (ys[i] - s[1]) * (ys[i] - s[1]);
+      if (d < best) {
+        best = d;
+        closest = i;
+      }
+    }
+    for (size_t k = 0; k < kTelemetryWaypoints; k++) {
+      const size_t i = (closest + xs.size() - 1 + k) % xs.size();
+      ptsx[k] = xs[i];
+      ptsy[k] = ys[i];
+    }
+    // As the sensors measure it
+    const double measured_x = s[0] + options.position_noise * noise(random);
+    const double measured_y = s[1] + options.position_noise * noise(random);
+    const double measured_psi = s[2] + options.heading_noise * noise(random);
+    const double measured_v = s[3] + options.speed_noise * noise(random);
+    WriteTelemetry(ptsx, ptsy, kTelemetryWaypoints, measured_x, measured_y, measured_psi,
+                   measured_v, delta, a, frame);
+
+    // The tick of the server
+    const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    SocketIOFrame event;
+    DecodeFrame(MessageView(frame.data(), frame.size()), event);
+    ParseTelemetry(event.data, telemetry);
+    const MPCCoeffs &coeffs = reference_fit.Fit(telemetry.ptsx, telemetry.ptsy, telemetry.x,
+                                                telemetry.y, telemetry.psi);
+    const MPCState state =
+        PredictState(telemetry.speed, telemetry.steering_angle, mpc.prev_a, polyeval(coeffs, 0),
+                     -atan(coeffs[1]), latency.latency());
+    const MPCSolution result = mpc.Solve(state, coeffs);
+    const double steer_value = SteerCommand(result.delta[0]);
+    const double throttle_value = result.a[0];
+    mpc.prev_a = throttle_value;
+    const size_t mpc_n = result.stages > 0 ? result.stages - 1 : 0;
+    const std::string &reply = steer_message.Write(
+        steer_value, throttle_value, result.x.data() + 1, result.y.data() + 1, mpc_n,
+        reference_fit.xs().data(), reference_fit.ys().data(), reference_fit.xs().size());
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    ticks.Record(seconds);
+    report.solve_seconds += seconds;
+    report.tick_seconds.push_back(seconds);
+    report.iterations += result.statistics.iterations;
+    report.failed += result.status == SolveStatus::kFailed;
+    report.ticks++;
+
+    // The simulator reads the reply and actuates it after the latency
+    SocketIOFrame steer;
+    double steering_angle = 0;
+    double throttle = 0;
+    DecodeFrame(MessageView(reply.data(), reply.size()), steer);
+    ParseSteer(steer.data, steering_angle, throttle);
+    pending.push_back({t + options.latency, SteerAngle(steering_angle), throttle});
+    latency.Sent(SimulatedTime(t), SimulatedTime(t + options.latency));
+
+    for (size_t k = 0; k < steps; k++) {
+      actuate();
+      IntegrateModel<Integrator::kRK4>(s, delta * steering_scale, a, kPlantStep);
+      t += kPlantStep;
+    }
+
+    // Along the track, unwrapped, and off it
+    const double at = track.Project(s[0], s[1], progress_s);
+    double moved = at - progress_s;
+    moved -= length * std::round(moved / length);
+    progress += moved;
+    progress_s = at;
+    const TrackPoint nearest = track.At(at);
+    const double error = std::hypot(s[0] - nearest.x, s[1] - nearest.y);
+    report.error_sum += error;
+    report.error_squares += error * error;
+    report.error_max = std::max(report.error_max, error);
+    report.speed_sum += s[3];
+    if (progress >= length * (report.lap_times.size() + 1)) {
+      report.lap_times.push_back(t - lap_started);
+      lap_started = t;
+    }
+    if (error > kOffTrack) {
+      report.off_track = true;
+      break;
+    }
+  }
+  report.seconds = t;
+}
+
+// Drive instances instances around track, each made, warmed up and driven
+// on a thread of its own with a solver of backend for problem, into reports
+// and ticks, and the seconds from the first start to the last stop into
+// wall; false if backend isn't compiled for problem
+bool Simulate(const TrackSpline &track, const std::vector<double> &xs, const std::vector<double> &ys,
+              SolverBackend backend, const MPCProblem &problem, const SimOptions &options,
+              size_t instances, size_t warm_up_rounds, std::vector<SimReport> &reports,
+              LatencyHistogram &ticks, double &wall) {
+  reports.assign(instances, SimReport());
+  // Made, solved and destroyed on the thread of its instance
+  const auto run = [&](size_t k) {
+    std::unique_ptr<MPCBase> mpc = MakeSolver(backend, problem);
+    if (!mpc) {
+      return false;
+    }
+    if (warm_up_rounds > 0) {
+      WarmUp(*mpc, WarmUpScenarios(), warm_up_rounds);
+    }
+    Drive(track, xs, ys, *mpc, options, track.length() * k / instances, reports[k], ticks);
+    return true;
+  };
+  const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (size_t k = 1; k < instances; k++) {
+    threads.push_back(std::thread([&run, k] {
+      CppADThread cppad_thread;
+      run(k);
+    }));
+  }
+  const bool made = run(0);
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  return made;
+}
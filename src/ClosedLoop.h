@@ -0,0 +1,105 @@
+#ifndef CLOSED_LOOP_H
+#define CLOSED_LOOP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "KinematicModel.h"
+#include "MPC.h"
+#include "Metrics.h"
+#include "SolverBackend.h"
+#include "TrackSpline.h"
+
+// The closed loop of mpc_sim, and of the episodes mpc_tune scores: the
+// controller of main.cpp driving the vehicle model around a track, in
+// simulated time.
+//
+// The plant is the kinematic model the solvers plan with (see ModelRates),
+// integrated by RK4 in steps of kPlantStep, its steering the reply's scaled
+// back by the 25 degrees and Lf the server divides it by, and its speed in
+// the units the server takes the speed of the telemetry in. Every tick the
+// plant sends the telemetry of DATA.md, the kTelemetryWaypoints waypoints of
+// the track around the car among them, as a socket.io frame; the controller
+// decodes and parses it, fits the reference, predicts the state over the
+// latency, solves and writes its steer reply, whose actuations the plant
+// reads back and applies once the latency has passed. The latency
+// estimator of the tick is fed with the simulated delays. A plant with
+// another Lf than the model turns by the same steering as the model would
+// with the steering scaled by their ratio. The solves take
+// no simulated time, so the loop runs as fast as they do.
+//
+// A car that leaves the track by more than kOffTrack, or takes more than
+// kMaxLapTime over a lap, stops there.
+
+// Step of the integration of the plant, in s
+const double kPlantStep = 0.01;
+// Waypoints the simulator sends, from the one behind the car
+const size_t kTelemetryWaypoints = 6;
+// Distance from the track that ends a drive, about the half width of the
+// road, in m, and the longest a lap may take, in s
+const double kOffTrack = 4;
+const double kMaxLapTime = 300;
+
+// The laps to drive, and the latency of the actuations and the period of
+// the ticks, in s.
+//
+// Then the plant and its sensors, as the Monte Carlo episodes of mpc_sim
+// vary them: the distance of the front axle of the plant from its center
+// of gravity, Lf of the model but for a mismatch; the standard deviations
+// of the noise on the position (m), heading (rad) and speed of the
+// telemetry, drawn from seed; and how far the car starts to the left of
+// the track (m) and turned left from it (rad).
+struct SimOptions {
+  size_t laps = 1;
+  double latency = 0.1;
+  double tick = 0.1;
+  double lf = Lf;
+  double position_noise = 0;
+  double heading_noise = 0;
+  double speed_noise = 0;
+  uint64_t seed = 0;
+  double lateral_offset = 0;
+  double heading_offset = 0;
+};
+
+// What a drive reports
+struct SimReport {
+  double start = 0;
+  std::vector<double> lap_times;
+  bool off_track = false;
+  double seconds = 0;
+  size_t ticks = 0;
+  double error_sum = 0;
+  double error_squares = 0;
+  double error_max = 0;
+  double speed_sum = 0;
+  double solve_seconds = 0;
+  // The cost of every tick, in its order
+  std::vector<double> tick_seconds;
+  uint64_t iterations = 0;
+  size_t failed = 0;
+};
+
+// report as a line of text, every number in full, and back, false if line
+// isn't one; for the results of the episodes of a cluster (see Cluster.h)
+std::string FormatReport(const SimReport &report);
+bool ParseReport(const std::string &line, SimReport &report);
+
+// Drive the car around track from the distance start along it with mpc
+// until it has done its laps or stops, into report, and the cost of every
+// tick into ticks
+void Drive(const TrackSpline &track, const std::vector<double> &xs, const std::vector<double> &ys,
+           MPCBase &mpc, const SimOptions &options, double start, SimReport &report,
+           LatencyHistogram &ticks);
+
+// Drive instances instances around track, each made, warmed up and driven
+// on a thread of its own with a solver of backend for problem, into reports
+// and ticks, and the seconds from the first start to the last stop into
+// wall; false if backend isn't compiled for problem
+bool Simulate(const TrackSpline &track, const std::vector<double> &xs, const std::vector<double> &ys,
+              SolverBackend backend, const MPCProblem &problem, const SimOptions &options,
+              size_t instances, size_t warm_up_rounds, std::vector<SimReport> &reports,
+              LatencyHistogram &ticks, double &wall);
+
+#endif /* CLOSED_LOOP_H */
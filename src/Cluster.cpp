@@ -0,0 +1,403 @@
+#include "Cluster.h"
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "CppADThreads.h"
+
+namespace {
+
+// Lines of more than this are taken for garbage, and the connection dropped
+const size_t kMaxLine = size_t(1) << 28;
+
+// Write all of the n bytes at data to the blocking socket fd, false if it
+// broke
+bool SendAll(int fd, const char *data, size_t n) {
+  while (n > 0) {
+    const ssize_t sent = send(fd, data, n, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    data += sent;
+    n -= static_cast<size_t>(sent);
+  }
+  return true;
+}
+
+// Take the first line of buffer, without its newline, into line; false if
+// it has none yet
+bool TakeLine(std::string &buffer, std::string &line) {
+  const size_t end = buffer.find('\n');
+  if (end == std::string::npos) {
+    return false;
+  }
+  line.assign(buffer, 0, end);
+  buffer.erase(0, end + 1);
+  return true;
+}
+
+// The first word of line into word and the rest, after a space, into rest
+void SplitWord(const std::string &line, std::string &word, std::string &rest) {
+  const size_t space = line.find(' ');
+  word = line.substr(0, space);
+  rest = space == std::string::npos ? std::string() : line.substr(space + 1);
+}
+
+// The connections are noticed when the peer dies (keepalive), and the short
+// lines go out at once
+void TuneSocket(int fd) {
+  const int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+}  // namespace
+
+ClusterCoordinator::ClusterCoordinator(const std::string &job) : job_(job) {}
+
+ClusterCoordinator::~ClusterCoordinator() {
+  for (Connection &connection : connections_) {
+    if (connection.greeted) {
+      fcntl(connection.fd, F_SETFL, fcntl(connection.fd, F_GETFL) & ~O_NONBLOCK);
+      connection.out += "done\n";
+      SendAll(connection.fd, connection.out.data(), connection.out.size());
+    }
+    close(connection.fd);
+  }
+  if (listener_ >= 0) {
+    close(listener_);
+  }
+}
+
+bool ClusterCoordinator::Listen(uint16_t port) {
+  listener_ = socket(AF_INET6, SOCK_STREAM, 0);
+  if (listener_ < 0) {
+    return false;
+  }
+  const int on = 1;
+  const int off = 0;
+  setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  // IPv4 too
+  setsockopt(listener_, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+  sockaddr_in6 address = {};
+  address.sin6_family = AF_INET6;
+  address.sin6_addr = in6addr_any;
+  address.sin6_port = htons(port);
+  if (bind(listener_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+      listen(listener_, 64) < 0) {
+    close(listener_);
+    listener_ = -1;
+    return false;
+  }
+  fcntl(listener_, F_SETFL, fcntl(listener_, F_GETFL) | O_NONBLOCK);
+  return true;
+}
+
+void ClusterCoordinator::Accept() {
+  for (;;) {
+    const int fd = accept(listener_, nullptr, nullptr);
+    if (fd < 0) {
+      return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    TuneSocket(fd);
+    Connection connection;
+    connection.fd = fd;
+    connections_.push_back(connection);
+  }
+}
+
+bool ClusterCoordinator::Read(Connection &connection) {
+  char buffer[65536];
+  for (;;) {
+    const ssize_t n = recv(connection.fd, buffer, sizeof(buffer), 0);
+    if (n > 0) {
+      connection.in.append(buffer, static_cast<size_t>(n));
+      if (connection.in.size() > kMaxLine) {
+        return false;
+      }
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+      return true;
+    }
+    return false;
+  }
+}
+
+bool ClusterCoordinator::Write(Connection &connection) {
+  while (!connection.out.empty()) {
+    const ssize_t n =
+        send(connection.fd, connection.out.data(), connection.out.size(), MSG_NOSIGNAL);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+      return true;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    connection.out.erase(0, static_cast<size_t>(n));
+  }
+  return true;
+}
+
+void ClusterCoordinator::Drop(size_t k) {
+  close(connections_[k].fd);
+  connections_.erase(connections_.begin() + k);
+}
+
+void ClusterCoordinator::Run(const std::vector<std::string> &items,
+                             const std::function<void(size_t, const std::string &)> &done) {
+  const uint64_t first_id = next_id_;
+  next_id_ += items.size();
+  std::deque<size_t> queue;
+  for (size_t k = 0; k < items.size(); k++) {
+    queue.push_back(k);
+  }
+  std::vector<bool> finished(items.size(), false);
+  // The copies of each item out on the workers
+  std::vector<size_t> out(items.size(), 0);
+  size_t remaining = items.size();
+  const auto ours = [&](uint64_t id) { return id >= first_id && id < first_id + items.size(); };
+  std::vector<pollfd> fds;
+  while (remaining > 0) {
+    for (Connection &connection : connections_) {
+      while (connection.greeted && connection.items.size() < connection.threads) {
+        size_t k = items.size();
+        if (!queue.empty()) {
+          k = queue.front();
+          queue.pop_front();
+        } else {
+          // A second copy of an item out on another worker
+          for (size_t j = 0; j < items.size() && k == items.size(); j++) {
+            if (!finished[j] && out[j] == 1 &&
+                std::find(connection.items.begin(), connection.items.end(), first_id + j) ==
+                    connection.items.end()) {
+              k = j;
+            }
+          }
+          if (k == items.size()) {
+            break;
+          }
+        }
+        out[k]++;
+        connection.items.push_back(first_id + k);
+        connection.out += "item " + std::to_string(first_id + k) + " " + items[k] + "\n";
+      }
+    }
+
+    fds.clear();
+    fds.push_back({listener_, POLLIN, 0});
+    for (const Connection &connection : connections_) {
+      fds.push_back({connection.fd,
+                     static_cast<short>(POLLIN | (connection.out.empty() ? 0 : POLLOUT)), 0});
+    }
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      continue;
+    }
+    // From the last, so that dropping one leaves the indices of the rest
+    for (size_t c = connections_.size(); c-- > 0;) {
+      Connection &connection = connections_[c];
+      const short events = fds[c + 1].revents;
+      // The lines it sent before it closed count
+      const bool open = !(events & (POLLIN | POLLHUP | POLLERR)) || Read(connection);
+      bool alive = true;
+      std::string line;
+      std::string word;
+      std::string rest;
+      while (alive && TakeLine(connection.in, line)) {
+        SplitWord(line, word, rest);
+        if (!connection.greeted && word == "hello") {
+          std::string threads;
+          std::string job;
+          SplitWord(rest, threads, job);
+          if (job != job_) {
+            connection.out += "refused\n";
+            Write(connection);
+            std::cerr << "Refused a worker of another job: " << job << std::endl;
+            alive = false;
+            break;
+          }
+          connection.greeted = true;
+          connection.threads = std::max<size_t>(1, std::strtoul(threads.c_str(), nullptr, 10));
+          std::cerr << "A worker of " << connection.threads << " threads joined, "
+                    << connections_.size() << " connected" << std::endl;
+        } else if (connection.greeted && word == "result") {
+          std::string id_text;
+          std::string result;
+          SplitWord(rest, id_text, result);
+          const uint64_t id = std::strtoull(id_text.c_str(), nullptr, 10);
+          connection.items.erase(
+              std::remove(connection.items.begin(), connection.items.end(), id),
+              connection.items.end());
+          if (!ours(id)) {
+            continue;
+          }
+          const size_t k = static_cast<size_t>(id - first_id);
+          out[k]--;
+          if (!finished[k]) {
+            finished[k] = true;
+            remaining--;
+            done(k, result);
+          }
+        } else {
+          alive = false;
+        }
+      }
+      alive &= open;
+      if (alive && (events & POLLOUT)) {
+        alive = Write(connection);
+      }
+      if (!alive) {
+        // Its items to the others
+        size_t lost = 0;
+        for (uint64_t id : connection.items) {
+          if (ours(id)) {
+            const size_t k = static_cast<size_t>(id - first_id);
+            if (--out[k] == 0 && !finished[k]) {
+              queue.push_front(k);
+              lost++;
+            }
+          }
+        }
+        if (connection.greeted) {
+          std::cerr << "A worker left, " << lost << " items to drive again, "
+                    << connections_.size() - 1 << " connected" << std::endl;
+        }
+        Drop(c);
+      }
+    }
+    if (fds[0].revents & POLLIN) {
+      Accept();
+    }
+  }
+}
+
+bool RunClusterWorker(const std::string &coordinator, const std::string &job, size_t threads,
+                      const std::function<ClusterWork()> &make_work) {
+  const size_t colon = coordinator.rfind(':');
+  if (colon == std::string::npos) {
+    std::cerr << "The coordinator is host:port, not " << coordinator << std::endl;
+    return false;
+  }
+  std::string host = coordinator.substr(0, colon);
+  if (host.size() > 1 && host.front() == '[' && host.back() == ']') {
+    host = host.substr(1, host.size() - 2);
+  }
+  const std::string port = coordinator.substr(colon + 1);
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *addresses = nullptr;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+    std::cerr << "Could not resolve " << coordinator << std::endl;
+    return false;
+  }
+  int fd = -1;
+  for (addrinfo *address = addresses; address != nullptr && fd < 0; address = address->ai_next) {
+    fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (fd >= 0 && connect(fd, address->ai_addr, address->ai_addrlen) < 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (fd < 0) {
+    std::cerr << "Could not connect to " << coordinator << std::endl;
+    return false;
+  }
+  TuneSocket(fd);
+
+  std::mutex mutex;
+  std::condition_variable posted;
+  std::deque<std::pair<std::string, std::string>> queue;
+  bool stopping = false;
+  std::mutex send_mutex;
+  bool sent = true;
+  const auto run = [&] {
+    CppADThread cppad_thread;
+    const ClusterWork work = make_work();
+    for (;;) {
+      std::pair<std::string, std::string> item;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        posted.wait(lock, [&] { return stopping || !queue.empty(); });
+        if (stopping) {
+          return;
+        }
+        item = std::move(queue.front());
+        queue.pop_front();
+      }
+      const std::string line = "result " + item.first + " " + work(item.second) + "\n";
+      std::lock_guard<std::mutex> lock(send_mutex);
+      sent = sent && SendAll(fd, line.data(), line.size());
+    }
+  };
+  const std::string hello = "hello " + std::to_string(threads) + " " + job + "\n";
+  bool finished = false;
+  if (SendAll(fd, hello.data(), hello.size())) {
+    std::vector<std::thread> workers;
+    for (size_t k = 0; k < threads; k++) {
+      workers.push_back(std::thread(run));
+    }
+    std::string in;
+    std::string line;
+    std::string word;
+    std::string rest;
+    char buffer[65536];
+    for (bool reading = true; reading;) {
+      const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        std::cerr << "Lost the coordinator " << coordinator << std::endl;
+        break;
+      }
+      in.append(buffer, static_cast<size_t>(n));
+      while (reading && TakeLine(in, line)) {
+        SplitWord(line, word, rest);
+        if (word == "item") {
+          std::string id;
+          std::string item;
+          SplitWord(rest, id, item);
+          std::lock_guard<std::mutex> lock(mutex);
+          queue.push_back(std::make_pair(id, item));
+          posted.notify_one();
+        } else if (word == "done") {
+          finished = true;
+          reading = false;
+        } else {
+          if (word == "refused") {
+            std::cerr << "The coordinator " << coordinator << " runs another job" << std::endl;
+          }
+          reading = false;
+        }
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    posted.notify_all();
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+  }
+  close(fd);
+  return finished;
+}
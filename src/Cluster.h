@@ -0,0 +1,88 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// The episodes of a campaign of mpc_tune or mpc_sim spread over the nodes of
+// a cluster, over plain TCP: a coordinator hands out the items of the work,
+// a line of text each, to the workers that connect to it, and takes back
+// the result of each, a line of text too, as soon as it is done.
+//
+// A worker says hello with its threads and the job it was started for, the
+// settings every item depends on but doesn't carry, and the coordinator
+// refuses one whose job isn't its own, so that every worker drives the
+// episodes the same. The coordinator keeps as many items on a worker as it
+// has threads, and a worker returns each result as it finishes the item,
+// so the results come back one by one while the rest are driven. The items
+// of a worker whose connection breaks go to the others; once no item is
+// left to hand out, an idle worker gets a copy of one still out on another,
+// so that one hung node doesn't hold the campaign up, and the first result
+// of an item is kept. The coordinator itself drives nothing.
+//
+// The lines:
+//
+//   hello <threads> <job>      worker to coordinator, first
+//   item <id> <item>           coordinator to worker
+//   result <id> <result>       worker to coordinator
+//   done                       coordinator to worker, the campaign is over
+//   refused                    coordinator to worker, another job
+
+// The coordinator of a campaign, listening for the workers of job
+class ClusterCoordinator {
+ public:
+  explicit ClusterCoordinator(const std::string &job);
+  // Tells every worker the campaign is over
+  ~ClusterCoordinator();
+  ClusterCoordinator(const ClusterCoordinator &) = delete;
+  ClusterCoordinator &operator=(const ClusterCoordinator &) = delete;
+
+  // Listen on port of every interface, false if it can't
+  bool Listen(uint16_t port);
+  // Hand items out to the workers until every one has its result, calling
+  // done(k, result) on this thread as the result of items[k] arrives. The
+  // workers stay connected for the next call.
+  void Run(const std::vector<std::string> &items,
+           const std::function<void(size_t, const std::string &)> &done);
+
+ private:
+  struct Connection {
+    int fd = -1;
+    std::string in;
+    std::string out;
+    bool greeted = false;
+    size_t threads = 0;
+    // The items it has, by id
+    std::vector<uint64_t> items;
+  };
+
+  void Accept();
+  // Read what fd has, false once it closed or broke
+  bool Read(Connection &connection);
+  bool Write(Connection &connection);
+  void Drop(size_t k);
+
+  const std::string job_;
+  int listener_ = -1;
+  std::vector<Connection> connections_;
+  // Ids go on across the calls of Run, so a late result of an earlier call
+  // is told apart
+  uint64_t next_id_ = 0;
+};
+
+// The work of a thread of a worker: the result of an item
+typedef std::function<std::string(const std::string &)> ClusterWork;
+
+// Work the items coordinator (host:port) hands out for job on threads
+// threads, each registered with CppAD (see CppADThreads.h) and working with
+// the ClusterWork make_work made on it, which is destroyed on it too, so
+// that it can hold a solver. Returns once the coordinator says the
+// campaign is over, true, or false if it can't be reached, refuses the job
+// or the connection breaks.
+bool RunClusterWorker(const std::string &coordinator, const std::string &job, size_t threads,
+                      const std::function<ClusterWork()> &make_work);
+
+#endif /* CLUSTER_H */
@@ -0,0 +1,44 @@
+#ifndef COMMAND_PLAN_H
+#define COMMAND_PLAN_H
+
+#include <cstddef>
+#include "MPCSolution.h"
+
+// The actuations of the last plan of a session, for the event loop to send
+// commands from between two solves (see SampleCommand): the solver thread
+// writes them after every tick and the event loop takes the latest as it
+// sends the reply of the tick, through a LatestValue (see Mailbox.h).
+struct CommandPlan {
+  // The actuations of the stages but the last, and the seconds from the
+  // first to each
+  size_t actuations = 0;
+  MPCSolution::StageArray time{};
+  // As the commands carry them: the steering in [-1, 1] and the throttle
+  MPCSolution::StageArray steering{};
+  MPCSolution::StageArray throttle{};
+};
+
+// The command of plan t seconds after its first, linear between the stages
+// where the model holds each actuation over its step, so that commands
+// sent faster than the plan's steps move smoothly from one to the next;
+// false past the last actuation, when the plan has nothing left to say.
+inline bool SampleCommand(const CommandPlan &plan, double t, double &steering, double &throttle) {
+  if (plan.actuations == 0 || t < 0 || t > plan.time[plan.actuations - 1]) {
+    return false;
+  }
+  size_t k = 0;
+  while (k + 1 < plan.actuations && plan.time[k + 1] <= t) {
+    k++;
+  }
+  if (k + 1 == plan.actuations) {
+    steering = plan.steering[k];
+    throttle = plan.throttle[k];
+    return true;
+  }
+  const double s = (t - plan.time[k]) / (plan.time[k + 1] - plan.time[k]);
+  steering = plan.steering[k] + s * (plan.steering[k + 1] - plan.steering[k]);
+  throttle = plan.throttle[k] + s * (plan.throttle[k + 1] - plan.throttle[k]);
+  return true;
+}
+
+#endif /* COMMAND_PLAN_H */
@@ -0,0 +1,317 @@
+#ifdef MPC_CODEGEN
+// Ahead of CppAD, which FG_eval.h includes
+#include <cppad/cg.hpp>
+#endif
+#include "CompiledModel.h"
+#include "FG_eval.h"
+#include "KinematicModel.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+// Hash of the sources that define the model (FG_eval.h, CostTerms.h,
+// StageModel.h, KinematicModel.h, CostWeights.h and Horizon.h), set by
+// CMake. Without it every build gets its own libraries.
+#ifndef MPC_MODEL_SOURCE_HASH
+#define MPC_MODEL_SOURCE_HASH __DATE__ " " __TIME__
+#endif
+
+template <class H>
+std::string CompiledModel<H>::DefaultDirectory() {
+  const char *cache = std::getenv("MPC_MODEL_CACHE");
+  if (cache != nullptr && *cache != '\0') {
+    return cache;
+  }
+  const char *xdg = std::getenv("XDG_CACHE_HOME");
+  if (xdg != nullptr && *xdg != '\0') {
+    return std::string(xdg) + "/mpc";
+  }
+  const char *home = std::getenv("HOME");
+  if (home != nullptr && *home != '\0') {
+    return std::string(home) + "/.cache/mpc";
+  }
+  return "mpc_model_cache";
+}
+
+template <class H>
+std::string CompiledModel<H>::Key() {
+  // Everything the generated code depends on: the model sources, and the
+  // layout and constants of H they are compiled with
+  std::ostringstream model;
+  model << MPC_MODEL_SOURCE_HASH << ' ' << H::N << ' ' << std::setprecision(17);
+  for (size_t t = 0; t < H::N - 1; t++) {
+    model << H::step(t) << ' ';
+  }
+  model << Lf << ' ' << n_params << ' ' << static_cast<int>(H::integrator) << ' '
+        << H::Vehicle::name();
+  for (size_t b = 0; b <= H::n_blocks; b++) {
+    model << ' ' << H::first_stage(b);
+  }
+
+  // 64 bit FNV-1a
+  uint64_t hash = 14695981039346656037ull;
+  for (char c : model.str()) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+  std::ostringstream key;
+  key << "mpc_model_" << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return key.str();
+}
+
+template <class H>
+CompiledModel<H>::CompiledModel(std::unique_ptr<Library> library, const std::string &path,
+                                bool compiled)
+    : library_(std::move(library)), path_(path), compiled_(compiled),
+      input_(H::n_vars + n_params) {}
+
+template <class H>
+void CompiledModel<H>::SetInput(const double *x, const double *params) {
+  for (size_t i = 0; i < H::n_vars; i++) {
+    input_[i] = x[i];
+  }
+  for (size_t i = 0; i < n_params; i++) {
+    input_[H::n_vars + i] = params[i];
+  }
+}
+
+#ifdef MPC_CODEGEN
+
+template <class H>
+struct CompiledModel<H>::Library {
+  // Declared after the library so it is destroyed first, it runs the code
+  // of the library
+  std::unique_ptr<CppAD::cg::DynamicLib<double> > lib;
+  std::unique_ptr<CppAD::cg::GenericModel<double> > model;
+  // Position in the patterns given to Load of each value the model returns
+  std::vector<size_t> jac_order;
+  std::vector<size_t> hes_order;
+};
+
+// Create directory and its parents, true if it exists afterwards
+static bool MakeDirectories(const std::string &directory) {
+  for (size_t end = directory.find('/', 1); ; end = directory.find('/', end + 1)) {
+    const std::string prefix = directory.substr(0, end);
+    if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+      return false;
+    }
+    if (end == std::string::npos) {
+      return true;
+    }
+  }
+}
+
+// Position in the (rows, cols) pattern of every entry of the model pattern
+// (model_rows, model_cols). False unless both hold the same entries.
+static bool MatchPattern(const std::vector<size_t> &rows, const std::vector<size_t> &cols,
+                         const std::vector<size_t> &model_rows,
+                         const std::vector<size_t> &model_cols, std::vector<size_t> &order) {
+  if (model_rows.size() != rows.size()) {
+    return false;
+  }
+  std::map<std::pair<size_t, size_t>, size_t> index;
+  for (size_t k = 0; k < rows.size(); k++) {
+    index[std::make_pair(rows[k], cols[k])] = k;
+  }
+  order.resize(model_rows.size());
+  for (size_t k = 0; k < model_rows.size(); k++) {
+    const auto entry = index.find(std::make_pair(model_rows[k], model_cols[k]));
+    if (entry == index.end()) {
+      return false;
+    }
+    order[k] = entry->second;
+  }
+  return true;
+}
+
+// Tape FG_eval<H> in code generation scalars and compile it into the library
+// directory/key. The inputs are the variables and then the parameters; the
+// Jacobian and the Hessian are only generated for the given entries.
+template <class H>
+static void Generate(const std::string &directory, const std::string &key,
+                     const std::vector<size_t> &jac_rows, const std::vector<size_t> &jac_cols,
+                     const std::vector<size_t> &hes_rows, const std::vector<size_t> &hes_cols) {
+  typedef CppAD::cg::CG<double> CGD;
+  typedef typename FG_eval<H, CGD>::ADvector ADvector;
+
+  ADvector ainput(H::n_vars + n_params);
+  for (size_t i = 0; i < ainput.size(); i++) {
+    ainput[i] = 0.0;
+  }
+  CppAD::Independent(ainput);
+  ADvector avars(H::n_vars);
+  for (size_t i = 0; i < H::n_vars; i++) {
+    avars[i] = ainput[i];
+  }
+  ADvector aparams(n_params);
+  for (size_t i = 0; i < n_params; i++) {
+    aparams[i] = ainput[H::n_vars + i];
+  }
+  ADvector afg(1 + H::n_constraints);
+  FG_eval<H, CGD> fg_eval(aparams);
+  fg_eval(afg, avars);
+  CppAD::ADFun<CGD> fun(ainput, afg);
+
+  CppAD::cg::ModelCSourceGen<double> source(fun, "fg");
+  source.setCreateForwardZero(true);
+  source.setCreateSparseJacobian(true);
+  source.setCustomSparseJacobianElements(jac_rows, jac_cols);
+  source.setCreateSparseHessian(true);
+  source.setCustomSparseHessianElements(hes_rows, hes_cols);
+  CppAD::cg::ModelLibraryCSourceGen<double> library(source);
+
+  // Compiled under a name of this process and renamed once complete, so a
+  // concurrent start never loads a partly written library
+  const std::string ext = CppAD::cg::system::SystemInfo<>::DYNAMIC_LIB_EXTENSION;
+  const std::string partial = directory + "/" + key + "." + std::to_string(getpid());
+  CppAD::cg::DynamicModelLibraryProcessor<double> processor(library, partial);
+  CppAD::cg::GccCompiler<double> compiler;
+  compiler.setTemporaryFolder(partial + ".src");
+  processor.createDynamicLibrary(compiler, false);
+  if (std::rename((partial + ext).c_str(), (directory + "/" + key + ext).c_str()) != 0) {
+    std::remove((partial + ext).c_str());
+    throw std::runtime_error("cannot move the library into the cache");
+  }
+}
+
+template <class H>
+std::unique_ptr<CompiledModel<H> > CompiledModel<H>::Load(const std::string &directory,
+                                                          const std::vector<size_t> &jac_rows,
+                                                          const std::vector<size_t> &jac_cols,
+                                                          const std::vector<size_t> &hes_rows,
+                                                          const std::vector<size_t> &hes_cols) {
+  const std::string path =
+      directory + "/" + Key() + CppAD::cg::system::SystemInfo<>::DYNAMIC_LIB_EXTENSION;
+  try {
+    bool compiled = false;
+    if (!std::ifstream(path.c_str()).good()) {
+      if (!MakeDirectories(directory)) {
+        std::cerr << "Cannot create the model cache " << directory << std::endl;
+        return std::unique_ptr<CompiledModel>();
+      }
+      std::cerr << "Compiling the model derivatives into " << path << std::endl;
+      Generate<H>(directory, Key(), jac_rows, jac_cols, hes_rows, hes_cols);
+      compiled = true;
+    }
+
+    std::unique_ptr<Library> library(new Library);
+    library->lib.reset(new CppAD::cg::LinuxDynamicLib<double>(path));
+    library->model = library->lib->model("fg");
+    if (!library->model || !library->model->isForwardZeroAvailable() ||
+        !library->model->isSparseJacobianAvailable() ||
+        !library->model->isSparseHessianAvailable()) {
+      std::cerr << "The compiled model " << path << " lacks the derivatives" << std::endl;
+      return std::unique_ptr<CompiledModel>();
+    }
+
+    std::vector<size_t> rows;
+    std::vector<size_t> cols;
+    library->model->getJacobianSparsityPattern(rows, cols);
+    const bool jac_match = MatchPattern(jac_rows, jac_cols, rows, cols, library->jac_order);
+    library->model->getHessianSparsityPattern(rows, cols);
+    const bool hes_match = MatchPattern(hes_rows, hes_cols, rows, cols, library->hes_order);
+    if (!jac_match || !hes_match) {
+      std::cerr << "The compiled model " << path << " has other sparsity patterns, remove it"
+                << std::endl;
+      return std::unique_ptr<CompiledModel>();
+    }
+
+    std::unique_ptr<CompiledModel> model(new CompiledModel(std::move(library), path, compiled));
+    model->values_.resize(std::max(jac_rows.size(), hes_rows.size()));
+    return model;
+  } catch (const std::exception &e) {
+    std::cerr << "No compiled model " << path << ": " << e.what() << std::endl;
+  }
+  return std::unique_ptr<CompiledModel>();
+}
+
+template <class H>
+void CompiledModel<H>::Forward(const double *x, const double *params, double *fg) {
+  SetInput(x, params);
+  library_->model->ForwardZero(CppAD::cg::ArrayView<const double>(input_.data(), input_.size()),
+                               CppAD::cg::ArrayView<double>(fg, 1 + H::n_constraints));
+}
+
+template <class H>
+void CompiledModel<H>::Jacobian(const double *x, const double *params, double *values) {
+  SetInput(x, params);
+  const size_t *row;
+  const size_t *col;
+  const std::vector<size_t> &order = library_->jac_order;
+  library_->model->SparseJacobian(
+      CppAD::cg::ArrayView<const double>(input_.data(), input_.size()),
+      CppAD::cg::ArrayView<double>(values_.data(), order.size()), &row, &col);
+  for (size_t k = 0; k < order.size(); k++) {
+    values[order[k]] = values_[k];
+  }
+}
+
+template <class H>
+void CompiledModel<H>::Hessian(const double *x, const double *params, const double *w,
+                               double *values) {
+  SetInput(x, params);
+  const size_t *row;
+  const size_t *col;
+  const std::vector<size_t> &order = library_->hes_order;
+  library_->model->SparseHessian(
+      CppAD::cg::ArrayView<const double>(input_.data(), input_.size()),
+      CppAD::cg::ArrayView<const double>(w, 1 + H::n_constraints),
+      CppAD::cg::ArrayView<double>(values_.data(), order.size()), &row, &col);
+  for (size_t k = 0; k < order.size(); k++) {
+    values[order[k]] = values_[k];
+  }
+}
+
+#else
+
+template <class H>
+struct CompiledModel<H>::Library {};
+
+template <class H>
+std::unique_ptr<CompiledModel<H> > CompiledModel<H>::Load(const std::string &directory,
+                                                          const std::vector<size_t> &jac_rows,
+                                                          const std::vector<size_t> &jac_cols,
+                                                          const std::vector<size_t> &hes_rows,
+                                                          const std::vector<size_t> &hes_cols) {
+  std::cerr << "No compiled model: built without MPC_CODEGEN" << std::endl;
+  return std::unique_ptr<CompiledModel>();
+}
+
+// Never called, Load gives no model
+template <class H>
+void CompiledModel<H>::Forward(const double *x, const double *params, double *fg) {}
+
+template <class H>
+void CompiledModel<H>::Jacobian(const double *x, const double *params, double *values) {}
+
+template <class H>
+void CompiledModel<H>::Hessian(const double *x, const double *params, const double *w,
+                               double *values) {}
+
+#endif
+
+template <class H>
+CompiledModel<H>::~CompiledModel() = default;
+
+template class CompiledModel<Horizon10>;
+template class CompiledModel<Horizon15>;
+template class CompiledModel<Horizon25>;
+template class CompiledModel<Horizon40>;
+template class CompiledModel<Horizon15Coarse>;
+template class CompiledModel<Horizon8RK4>;
+template class CompiledModel<Horizon11Graded>;
+template class CompiledModel<Horizon10Blocked>;
+template class CompiledModel<Horizon15Blocked>;
+template class CompiledModel<Horizon25Blocked>;
+template class CompiledModel<Horizon15Dynamic>;
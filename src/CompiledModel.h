@@ -0,0 +1,78 @@
+#ifndef COMPILED_MODEL_H
+#define COMPILED_MODEL_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Horizon.h"
+
+// FG_eval, its Jacobian and its Lagrangian Hessian generated as C source by
+// CppADCodeGen, compiled into a shared library and loaded with dlopen.
+//
+// Generating and compiling takes seconds, so the library is cached on disk
+// under a name keyed by a hash of the model sources and of the horizon
+// layout (see Key). Every later start only loads it. The variables and the
+// dynamic parameters of the tape (see n_params in FG_eval.h) are both inputs
+// of the generated functions, in the format 'vars params'.
+//
+// Only available in builds with the MPC_CODEGEN CMake option, Load returns
+// null otherwise.
+//
+// H is the horizon layout (see Horizon.h). The instantiations are listed at
+// the end of CompiledModel.cpp.
+template <class H>
+class CompiledModel {
+public:
+  // Load the cached library of H from directory, generating and compiling it
+  // first when there is none. The derivatives are evaluated in the order of
+  // jac_rows, jac_cols (rows of fg, the cost row included, over the
+  // variables) and hes_rows, hes_cols (lower triangle of the Hessian in the
+  // variables). Null, with the reason on stderr, when it fails.
+  static std::unique_ptr<CompiledModel> Load(const std::string &directory,
+                                             const std::vector<size_t> &jac_rows,
+                                             const std::vector<size_t> &jac_cols,
+                                             const std::vector<size_t> &hes_rows,
+                                             const std::vector<size_t> &hes_cols);
+
+  // Directory of the cache: $MPC_MODEL_CACHE, else mpc under
+  // $XDG_CACHE_HOME or ~/.cache
+  static std::string DefaultDirectory();
+
+  // File name of the library of H, without the directory
+  static std::string Key();
+
+  ~CompiledModel();
+
+  // fg = [cost, constraints...] at vars x with the parameters params
+  void Forward(const double *x, const double *params, double *fg);
+
+  // Jacobian of fg, in the order of the patterns given to Load
+  void Jacobian(const double *x, const double *params, double *values);
+
+  // Hessian of w' * fg, w = [obj_factor, lambda...], in the order of the
+  // Hessian pattern given to Load
+  void Hessian(const double *x, const double *params, const double *w, double *values);
+
+  // Path of the loaded library and whether it was compiled by this Load
+  const std::string &path() const { return path_; }
+  bool compiled() const { return compiled_; }
+
+private:
+  // Loaded library and model, kept out of this header since CppADCodeGen
+  // must be included ahead of CppAD
+  struct Library;
+
+  CompiledModel(std::unique_ptr<Library> library, const std::string &path, bool compiled);
+
+  // Copy x and params into input_
+  void SetInput(const double *x, const double *params);
+
+  std::unique_ptr<Library> library_;
+  std::string path_;
+  bool compiled_;
+  std::vector<double> input_;
+  std::vector<double> values_;
+};
+
+#endif /* COMPILED_MODEL_H */
@@ -0,0 +1,228 @@
+#include "CondensedQP.h"
+#include <cmath>
+#include "FrenetReference.h"
+#include "LinearizationTable.h"
+#include "ReferenceTable.h"
+
+template <class H>
+CondensedQP<H>::CondensedQP() {
+  SetWeights(CostWeights());
+
+  lb_.template head<n_blocks>().setConstant(-max_delta);
+  ub_.template head<n_blocks>().setConstant(max_delta);
+  lb_.template tail<n_blocks>().setConstant(-max_a);
+  ub_.template tail<n_blocks>().setConstant(max_a);
+
+  z_bar_.setZero();
+  u_bar_.setZero();
+  hessian_ = 2 * r_;
+  dz0_.setZero();
+  s_.setZero();
+  gradient_.setZero();
+  lb_du_ = lb_;
+  ub_du_ = ub_;
+}
+
+template <class H>
+void CondensedQP<H>::SetWeights(const CostWeights &weights) {
+  weights_ = weights;
+  q_ << 0, 0, 0, weights.v, weights.cte, weights.epsi;
+  ref_ << 0, 0, 0, weights.v_ref, ref_cte, ref_epsi;
+
+  // Same actuator terms as FG_eval, for delta (offset 0) and a (offset
+  // n_blocks)
+  r_.setZero();
+  const size_t offsets[2] = {0, n_blocks};
+  const double current[2] = {weights.current_delta, weights.current_a};
+  const double diff[2] = {weights.diff_delta, weights.diff_a};
+  for (size_t k = 0; k < 2; k++) {
+    const size_t o = offsets[k];
+    for (size_t t = 0; t < N - 1; t++) {
+      r_(o + H::block(t), o + H::block(t)) += current[k];
+    }
+    for (size_t i = 0; i + 1 < n_blocks; i++) {
+      r_(o + i, o + i) += diff[k];
+      r_(o + i + 1, o + i + 1) += diff[k];
+      r_(o + i, o + i + 1) -= diff[k];
+      r_(o + i + 1, o + i) -= diff[k];
+    }
+  }
+}
+
+template <class H>
+template <class Reference>
+void CondensedQP<H>::StageJacobians(const Reference &reference,
+                                    const LinearizationTable *table) {
+  // Their stage terms all at once
+  StageTerms<int(N - 1)> terms;
+  EvaluateStageTerms(z_bar_, reference, terms);
+  for (size_t t = 0; t < N - 1; t++) {
+    const size_t b = H::block(t);
+    if (table != nullptr) {
+      table->ModelJacobian(terms, t, z_bar_(3, t), z_bar_(2, t), u_bar_[b], H::step(t), a_[t],
+                           b_[t]);
+    } else {
+      ModelJacobian(terms, t, z_bar_(3, t), u_bar_[b], H::step(t), a_[t], b_[t]);
+    }
+  }
+}
+
+template <class H>
+void CondensedQP<H>::StageJacobians(const FrenetReference &reference,
+                                    const LinearizationTable *table) {
+  for (size_t t = 0; t < N - 1; t++) {
+    ModelJacobian(z_bar_.col(t), u_bar_[H::block(t)], reference, H::step(t), a_[t], b_[t]);
+  }
+}
+
+template <class H>
+template <class Reference>
+void CondensedQP<H>::LinearizeAlong(const MPCState &z0, const Vector &u,
+                                    const Reference &reference,
+                                    const LinearizationTable *table) {
+  u_bar_ = u;
+  z_bar_.col(0) = z0;
+  sx_[0].setIdentity();
+  su_[0].setZero();
+  for (size_t t = 0; t < N - 1; t++) {
+    const size_t b = H::block(t);
+    z_bar_.col(t + 1) =
+        ModelStep(z_bar_.col(t), u_bar_[b], u_bar_[n_blocks + b], reference, H::step(t));
+  }
+
+  // Jacobians along the rollout
+  StageJacobians(reference, table);
+  for (size_t t = 0; t < N - 1; t++) {
+    const size_t b = H::block(t);
+    // dz[t+1] = A dz[t] + B du[t]
+    sx_[t + 1].noalias() = a_[t] * sx_[t];
+    su_[t + 1].noalias() = a_[t] * su_[t];
+    su_[t + 1].col(b) += b_[t].col(0);
+    su_[t + 1].col(n_blocks + b) += b_[t].col(1);
+  }
+
+  // Gauss-Newton Hessian of the condensed cost: 2 * (sum Su' Q Su + R)
+  hessian_ = r_;
+  for (size_t t = 0; t < N; t++) {
+    hessian_.noalias() += su_[t].transpose() * q_.asDiagonal() * su_[t];
+  }
+  hessian_ *= 2;
+}
+
+template <class H>
+template <class Reference>
+void CondensedQP<H>::FeedbackAlong(const MPCState &state, const Reference &reference) {
+  // Initial value embedding: deviation of the measurement from the
+  // linearization point
+  dz0_ = state - z_bar_.col(0);
+
+  // Defects of the rollout under the new polynomial, propagated through the
+  // linearized model, and the gradient of the condensed cost at du = 0
+  gradient_.noalias() = 2 * r_ * u_bar_;
+  s_.col(0).setZero();
+  for (size_t t = 0; t < N; t++) {
+    const MPCState e = z_bar_.col(t) - ref_ + sx_[t] * dz0_ + s_.col(t);
+    gradient_.noalias() += 2 * su_[t].transpose() * q_.cwiseProduct(e);
+    if (t + 1 < N) {
+      const double delta = u_bar_[H::block(t)];
+      const double a = u_bar_[n_blocks + H::block(t)];
+      const MPCState d =
+          ModelStep(z_bar_.col(t), delta, a, reference, H::step(t)) - z_bar_.col(t + 1);
+      s_.col(t + 1).noalias() = a_[t] * s_.col(t);
+      s_.col(t + 1) += d;
+    }
+  }
+
+  lb_du_ = lb_ - u_bar_;
+  ub_du_ = ub_ - u_bar_;
+}
+
+template <class H>
+double CondensedQP<H>::Predict(const Vector &du, Vector &u, StateTrajectory &z) const {
+  u = u_bar_ + du;
+  double cost = u.dot(r_ * u);
+  for (size_t t = 0; t < N; t++) {
+    z.col(t) = z_bar_.col(t) + sx_[t] * dz0_ + su_[t] * du + s_.col(t);
+    const MPCState e = z.col(t) - ref_;
+    cost += e.dot(q_.cwiseProduct(e));
+  }
+  return cost;
+}
+
+template <class H>
+template <class Reference>
+double CondensedQP<H>::CostAlong(const MPCState &z0, const Vector &u,
+                                 const Reference &reference) const {
+  double cost = u.dot(r_ * u);
+  MPCState z = z0;
+  for (size_t t = 0; t < N; t++) {
+    const MPCState e = z - ref_;
+    cost += e.dot(q_.cwiseProduct(e));
+    if (t + 1 < N) {
+      const double delta = u[H::block(t)];
+      const double a = u[n_blocks + H::block(t)];
+      z = ModelStep(z, delta, a, reference, H::step(t));
+    }
+  }
+  return cost;
+}
+
+template <class H>
+void CondensedQP<H>::Linearize(const MPCState &z0, const Vector &u, const MPCCoeffs &coeffs,
+                               const LinearizationTable *table) {
+  LinearizeAlong(z0, u, coeffs, table);
+}
+
+template <class H>
+void CondensedQP<H>::Linearize(const MPCState &z0, const Vector &u,
+                               const ReferenceTable &reference,
+                               const LinearizationTable *table) {
+  LinearizeAlong(z0, u, reference, table);
+}
+
+template <class H>
+void CondensedQP<H>::Linearize(const MPCState &z0, const Vector &u,
+                               const FrenetReference &reference,
+                               const LinearizationTable *table) {
+  LinearizeAlong(z0, u, reference, table);
+}
+
+template <class H>
+void CondensedQP<H>::Feedback(const MPCState &state, const MPCCoeffs &coeffs) {
+  FeedbackAlong(state, coeffs);
+}
+
+template <class H>
+void CondensedQP<H>::Feedback(const MPCState &state, const ReferenceTable &reference) {
+  FeedbackAlong(state, reference);
+}
+
+template <class H>
+void CondensedQP<H>::Feedback(const MPCState &state, const FrenetReference &reference) {
+  FeedbackAlong(state, reference);
+}
+
+template <class H>
+double CondensedQP<H>::Cost(const MPCState &z0, const Vector &u,
+                            const MPCCoeffs &coeffs) const {
+  return CostAlong(z0, u, coeffs);
+}
+
+template <class H>
+double CondensedQP<H>::Cost(const MPCState &z0, const Vector &u,
+                            const ReferenceTable &reference) const {
+  return CostAlong(z0, u, reference);
+}
+
+template <class H>
+double CondensedQP<H>::Cost(const MPCState &z0, const Vector &u,
+                            const FrenetReference &reference) const {
+  return CostAlong(z0, u, reference);
+}
+
+template class CondensedQP<Horizon10>;
+template class CondensedQP<Horizon15>;
+template class CondensedQP<Horizon25>;
+template class CondensedQP<Horizon10Blocked>;
+template class CondensedQP<Horizon15Blocked>;
+template class CondensedQP<Horizon25Blocked>;
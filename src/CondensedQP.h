@@ -0,0 +1,158 @@
+#ifndef CONDENSED_QP_H
+#define CONDENSED_QP_H
+
+#include <array>
+#include "Eigen-3.3/Eigen/Core"
+#include "CostWeights.h"
+#include "Horizon.h"
+#include "KinematicModel.h"
+
+class FrenetReference;
+class LinearizationTable;
+class ReferenceTable;
+
+// The MPC problem of FG_eval linearized and condensed into a dense QP in the
+// actuators only.
+//
+// The states are fully determined by the initial state and the actuations
+// through the dynamics, so after linearizing the model around a rollout they
+// are eliminated:
+//
+//   z[t] = z_bar[t] + Sx[t] dz0 + Su[t] du + s[t]
+//
+// where dz0 is the deviation of the initial state, du the step of the
+// 2*H::n_blocks actuations (2*(N-1) without move blocking) and s the defects of the rollout propagated through the
+// linearized model. The cost of FG_eval is quadratic, so this gives the QP
+//
+//   min 0.5 du' Hess du + grad' du   s.t.   lb <= u_bar + du <= ub
+//
+// with the Gauss-Newton Hessian of the cost, built with dense products.
+//
+// The model follows a reference: the polynomial of the tick (MPCCoeffs), a
+// table of the track (ReferenceTable) or, in path coordinates, its
+// curvature (FrenetReference, see ModelStep).
+//
+// H is the horizon layout (see Horizon.h). The instantiations, of every
+// reference, are listed at the end of CondensedQP.cpp.
+template <class H>
+class CondensedQP {
+public:
+  static_assert(H::integrator == Integrator::kEuler,
+                "the linearization is that of the Euler step (ModelJacobian)");
+
+  static constexpr size_t N = H::N;
+  static constexpr size_t n_blocks = H::n_blocks;
+  // Number of QP variables, [delta..., a...] like the actuators of vars
+  static constexpr int n_u = 2 * n_blocks;
+
+  typedef Eigen::Matrix<double, n_u, n_u> Matrix;
+  typedef Eigen::Matrix<double, n_u, 1> Vector;
+  // One state per column, row major so that each state over the horizon is
+  // contiguous for EvaluateStageTerms
+  typedef Eigen::Matrix<double, 6, int(N), Eigen::RowMajor> StateTrajectory;
+
+  CondensedQP();
+
+  // Cost weights of the QPs from the next Linearize on
+  void SetWeights(const CostWeights &weights);
+  const CostWeights &weights() const { return weights_; }
+
+  // Roll the model out from z0 along the actuations u with the reference,
+  // linearize it at every stage and build the Hessian. This is the
+  // expensive part and needs no measurement. The Jacobians come from table
+  // if there is one, in closed form otherwise; always in closed form in
+  // path coordinates.
+  void Linearize(const MPCState &z0, const Vector &u, const MPCCoeffs &coeffs,
+                 const LinearizationTable *table = nullptr);
+  void Linearize(const MPCState &z0, const Vector &u, const ReferenceTable &reference,
+                 const LinearizationTable *table = nullptr);
+  void Linearize(const MPCState &z0, const Vector &u, const FrenetReference &reference,
+                 const LinearizationTable *table = nullptr);
+
+  // Fill the gradient and the bounds of du for the measured state and the
+  // reference of this tick. The model is not re-linearized: a change of
+  // reference only enters through the defects of the rollout.
+  void Feedback(const MPCState &state, const MPCCoeffs &coeffs);
+  void Feedback(const MPCState &state, const ReferenceTable &reference);
+  void Feedback(const MPCState &state, const FrenetReference &reference);
+
+  // Actuations and linear prediction of the states after the step du (in
+  // the state and polynomial of the last Feedback). Return the cost of the
+  // prediction.
+  double Predict(const Vector &du, Vector &u, StateTrajectory &z) const;
+
+  // Cost of FG_eval for the actuations u, rolling the nonlinear model out
+  // from z0.
+  double Cost(const MPCState &z0, const Vector &u, const MPCCoeffs &coeffs) const;
+  double Cost(const MPCState &z0, const Vector &u, const ReferenceTable &reference) const;
+  double Cost(const MPCState &z0, const Vector &u, const FrenetReference &reference) const;
+
+  const Matrix &hessian() const { return hessian_; }
+  const Vector &gradient() const { return gradient_; }
+  const Vector &lower() const { return lb_du_; }
+  const Vector &upper() const { return ub_du_; }
+  const Vector &u_bar() const { return u_bar_; }
+  const StateTrajectory &z_bar() const { return z_bar_; }
+
+  // Shift a vector laid out like the actuations one stage towards the
+  // present, holding the last stage (see Horizon::shifted_block)
+  template <class V>
+  static void ShiftActuations(const V &in, V &out) {
+    for (size_t b = 0; b < n_blocks; b++) {
+      out[b] = in[H::shifted_block(b)];
+      out[n_blocks + b] = in[n_blocks + H::shifted_block(b)];
+    }
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  typedef Eigen::Matrix<double, 6, n_u> StateSensitivity;
+
+  // Linearize, Feedback and Cost of any reference
+  template <class Reference>
+  void LinearizeAlong(const MPCState &z0, const Vector &u, const Reference &reference,
+                      const LinearizationTable *table);
+  template <class Reference>
+  void FeedbackAlong(const MPCState &state, const Reference &reference);
+  template <class Reference>
+  double CostAlong(const MPCState &z0, const Vector &u, const Reference &reference) const;
+
+  // The stage Jacobians a_ and b_ along z_bar_ and u_bar_
+  template <class Reference>
+  void StageJacobians(const Reference &reference, const LinearizationTable *table);
+  void StageJacobians(const FrenetReference &reference, const LinearizationTable *table);
+
+  CostWeights weights_;
+  // Weights of the state cost (diagonal) and its reference
+  MPCState q_;
+  MPCState ref_;
+  // Actuator cost: magnitudes and sequential differences
+  Matrix r_;
+  // Actuator limits
+  Vector lb_;
+  Vector ub_;
+
+  // Linearization point, stage Jacobians and sensitivities of every stage to
+  // the initial state and to the actuations
+  StateTrajectory z_bar_;
+  Vector u_bar_;
+  std::array<StateJacobian, N - 1> a_;
+  std::array<ActuationJacobian, N - 1> b_;
+  std::array<StateJacobian, N> sx_;
+  std::array<StateSensitivity, N> su_;
+  Matrix hessian_;
+
+  // Set by Feedback
+  MPCState dz0_;
+  StateTrajectory s_;
+  Vector gradient_;
+  Vector lb_du_;
+  Vector ub_du_;
+};
+
+template <class H> constexpr size_t CondensedQP<H>::N;
+template <class H> constexpr size_t CondensedQP<H>::n_blocks;
+template <class H> constexpr int CondensedQP<H>::n_u;
+
+#endif /* CONDENSED_QP_H */
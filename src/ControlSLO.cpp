@@ -0,0 +1,32 @@
+#include "ControlSLO.h"
+#include <cmath>
+
+bool MissedDeadline(const TickDeadline &tick, double period, DeadlineMiss &cause) {
+  if (tick.total() <= period) {
+    return false;
+  }
+  if (tick.wait >= tick.parse && tick.wait >= tick.solve && tick.wait >= tick.reply) {
+    cause = DeadlineMiss::kQueueing;
+  } else if (tick.parse >= tick.solve && tick.parse >= tick.reply) {
+    cause = DeadlineMiss::kParse;
+  } else if (tick.reply > tick.solve) {
+    cause = DeadlineMiss::kReply;
+  } else if (tick.restoration) {
+    cause = DeadlineMiss::kRestoration;
+  } else if (tick.iteration_cap) {
+    cause = DeadlineMiss::kIterationCap;
+  } else {
+    cause = DeadlineMiss::kSolve;
+  }
+  return true;
+}
+
+double CommandJitter::Sent(Clock::time_point arrival, Clock::time_point sent) {
+  const bool first = last_sent_ == Clock::time_point();
+  const double jitter = std::fabs(std::chrono::duration<double>((sent - last_sent_) -
+                                                                (arrival - last_arrival_))
+                                      .count());
+  last_arrival_ = arrival;
+  last_sent_ = sent;
+  return first ? -1 : jitter;
+}
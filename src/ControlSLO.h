@@ -0,0 +1,59 @@
+#ifndef CONTROL_SLO_H
+#define CONTROL_SLO_H
+
+#include <chrono>
+#include "Metrics.h"
+
+// The control period as an SLO: every tick is judged by whether the reply
+// to its telemetry was ready within the period of the arrival, the work of
+// the server before the emulated actuator latency, and a tick that wasn't
+// is put down to the stage that took longest, its solve broken down by how
+// it ended. The judgements are counted by cause in /metrics and kept over
+// the last ticks of each session as the compliance to alert on (see
+// SLOCompliance), and the commands of a session are timed as they go out
+// for the jitter of their period.
+
+// The control period of the server, the period of the simulator's
+// telemetry, unless slo=<ms> sets another
+const std::chrono::milliseconds kControlPeriod(100);
+
+// The seconds of one tick from the arrival of its telemetry to its reply,
+// by stage, and how its solve ended
+struct TickDeadline {
+  // In the mailbox
+  double wait = 0;
+  // Decoding and parsing the telemetry
+  double parse = 0;
+  // Fitting the reference, predicting over the latency and solving
+  double solve = 0;
+  // From the plan to the reply handed to be sent
+  double reply = 0;
+  // The solve stopped at its iteration limit or deadline, or went through
+  // the restoration phase
+  bool iteration_cap = false;
+  bool restoration = false;
+
+  double total() const { return wait + parse + solve + reply; }
+};
+
+// Whether tick missed period, in seconds, and if it did why in cause
+bool MissedDeadline(const TickDeadline &tick, double period, DeadlineMiss &cause);
+
+// The jitter of the commands of one session: how much the interval between
+// two consecutive commands strayed from that between their telemetry, a
+// delay the server added to the period the client keeps. On the thread
+// that sends them.
+class CommandJitter {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  // The jitter of the command for the telemetry of arrival, sent at sent,
+  // in seconds; negative for the first command
+  double Sent(Clock::time_point arrival, Clock::time_point sent);
+
+ private:
+  Clock::time_point last_arrival_;
+  Clock::time_point last_sent_;
+};
+
+#endif /* CONTROL_SLO_H */
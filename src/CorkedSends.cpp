@@ -0,0 +1,101 @@
+#include "CorkedSends.h"
+#include <algorithm>
+#include "Instrumentation.h"
+#include "Metrics.h"
+
+CorkedSends::CorkedSends(uS::Loop *loop, std::chrono::milliseconds flush)
+    : timer_(new uS::Timer(loop)), flush_(flush), armed_(false), count_(0) {
+  timer_->setData(this);
+}
+
+CorkedSends::~CorkedSends() {
+  timer_->stop();
+  // Freed by the loop once the handle is closed
+  timer_->close();
+}
+
+void CorkedSends::Send(uWS::WebSocket<uWS::SERVER> ws, const char *data, size_t length,
+                       uWS::OpCode op_code, const Written *written, Clock::time_point arrival,
+                       Clock::time_point sending) {
+  if (count_ == slots_.size()) {
+    slots_.emplace_back();
+  }
+  Frame &frame = slots_[count_++];
+  frame.ws = ws;
+  frame.socket = ws.getUserData();
+  frame.op_code = op_code;
+  frame.message.assign(data, length);
+  frame.written = written;
+  frame.arrival = arrival;
+  frame.sending = sending;
+  if (!armed_) {
+    armed_ = true;
+    timer_->start(Expired, static_cast<int>(flush_.count()), 0);
+  }
+}
+
+void CorkedSends::Drop(uWS::WebSocket<uWS::SERVER> ws) {
+  // The frames of the other sockets moved up, in their order
+  void *socket = ws.getUserData();
+  size_t kept = 0;
+  for (size_t k = 0; k < count_; k++) {
+    if (slots_[k].socket != socket) {
+      std::swap(slots_[kept++], slots_[k]);
+    }
+  }
+  count_ = kept;
+}
+
+void CorkedSends::Expired(uS::Timer *timer) {
+  static_cast<CorkedSends *>(timer->getData())->Flush();
+}
+
+void CorkedSends::Flush() {
+  MPC_TRACE_SCOPE("flush");
+  armed_ = false;
+  order_.resize(count_);
+  for (size_t k = 0; k < count_; k++) {
+    order_[k] = k;
+  }
+  std::stable_sort(order_.begin(), order_.end(), [this](size_t a, size_t b) {
+    return std::less<void *>()(slots_[a].socket, slots_[b].socket);
+  });
+  size_t writes = 0;
+  for (size_t first = 0; first < count_;) {
+    // The next frames of the socket with the op code of the first
+    Frame &head = slots_[order_[first]];
+    size_t end = first + 1;
+    while (end < count_ && slots_[order_[end]].socket == head.socket &&
+           slots_[order_[end]].op_code == head.op_code) {
+      end++;
+    }
+    if (end - first == 1) {
+      head.ws.send(head.message.data(), head.message.length(), head.op_code);
+    } else {
+      // Lent to the batch and back, the slots keep their buffers
+      batch_.resize(end - first);
+      for (size_t k = first; k < end; k++) {
+        batch_[k - first].swap(slots_[order_[k]].message);
+      }
+      uWS::WebSocket<uWS::SERVER>::PreparedMessage *prepared =
+          uWS::WebSocket<uWS::SERVER>::prepareMessageBatch(batch_, excluded_, head.op_code,
+                                                           false);
+      head.ws.sendPrepared(prepared);
+      uWS::WebSocket<uWS::SERVER>::finalizeMessage(prepared);
+      for (size_t k = first; k < end; k++) {
+        batch_[k - first].swap(slots_[order_[k]].message);
+      }
+    }
+    writes++;
+    for (size_t k = first; k < end; k++) {
+      const Frame &frame = slots_[order_[k]];
+      if (frame.written != nullptr && *frame.written) {
+        (*frame.written)(frame.arrival, frame.sending, frame.message);
+      }
+    }
+    first = end;
+  }
+  MPC_COUNT(Metrics().corked_frames.Add(count_));
+  MPC_COUNT(Metrics().corked_writes.Add(writes));
+  count_ = 0;
+}
@@ -0,0 +1,86 @@
+#ifndef CORKED_SENDS_H
+#define CORKED_SENDS_H
+
+#include <uWS/uWS.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// The frames an event loop sends to its sockets, held from when they are
+// sent until the loop flushes them all at once, a write for each socket
+// however many frames it got meanwhile, instead of a write for every
+// frame. With many sessions on a worker, the commands of the delay queues,
+// the plans of the problem service and their timers come many to an
+// iteration of the loop, and every one of them was a syscall of its own.
+//
+// The frames are flushed flush after the first of them is held, by a
+// timer of the loop, so that none waits longer than that; with a flush of
+// 0 they go out on the next turn of the loop, after the other timers due.
+// Those of a socket go out in the order they were sent, merged into one
+// buffer of uWS by op code (prepareMessageBatch), so that they take one
+// write while its buffer is empty. The sockets are told apart by their
+// user data, the sessions, and a socket must be dropped before it closes.
+//
+// The slots of the frames only grow, each keeping the buffer of its last
+// frame for the next, like those of DelayQueue.
+class CorkedSends {
+ public:
+  typedef std::chrono::steady_clock Clock;
+  // Called once a frame is written, with the arrival and the time of the
+  // send it was held with, and the frame
+  typedef std::function<void(Clock::time_point arrival, Clock::time_point sending,
+                             const std::string &message)>
+      Written;
+
+  CorkedSends(uS::Loop *loop, std::chrono::milliseconds flush);
+  // Drops the frames not written yet
+  ~CorkedSends();
+  CorkedSends(const CorkedSends &) = delete;
+  CorkedSends &operator=(const CorkedSends &) = delete;
+
+  // Hold a copy of the length bytes of data for ws, as a message of
+  // op_code; written, unless it is null, is called with arrival and
+  // sending once it is written, and must last until then or the socket is
+  // dropped
+  void Send(uWS::WebSocket<uWS::SERVER> ws, const char *data, size_t length,
+            uWS::OpCode op_code, const Written *written = nullptr,
+            Clock::time_point arrival = Clock::time_point(),
+            Clock::time_point sending = Clock::time_point());
+  // Forget the frames held for ws, which is closing
+  void Drop(uWS::WebSocket<uWS::SERVER> ws);
+  // Write every frame held
+  void Flush();
+
+  // Frames held and not written yet
+  size_t held() const { return count_; }
+
+ private:
+  struct Frame {
+    uWS::WebSocket<uWS::SERVER> ws;
+    // The user data of ws, which tells the sockets apart
+    void *socket;
+    uWS::OpCode op_code;
+    std::string message;
+    const Written *written;
+    Clock::time_point arrival;
+    Clock::time_point sending;
+  };
+
+  static void Expired(uS::Timer *timer);
+
+  uS::Timer *timer_;
+  std::chrono::milliseconds flush_;
+  bool armed_;
+  std::vector<Frame> slots_;
+  size_t count_;
+  // The frames by socket, then in the order they were held, and the
+  // messages of a batch, kept for their capacity
+  std::vector<size_t> order_;
+  std::vector<std::string> batch_;
+  std::vector<int> excluded_;
+};
+
+#endif /* CORKED_SENDS_H */
@@ -0,0 +1,247 @@
+#ifndef COST_TERMS_H
+#define COST_TERMS_H
+
+#include <cstddef>
+#include "CostWeights.h"
+#include "KinematicModel.h"
+
+// The cost of the MPC over the horizon H (see Horizon.h) as a sum of terms,
+// put together at compile time, CostSum<Terms...>, and summed stage by
+// stage in one loop over the horizon, every term adding its part of stage t
+// in the order of the list. Each term is a weighted square of residuals
+// affine in the variables of the horizon, and gives from the one
+// definition:
+//
+//   Value<H>(t, vars, weights, cost)   adds its value at stage t to cost
+//   Gradient<H>(t, vars, weights, grad) adds its gradient to grad
+//   GaussNewton<H>(t, weights, add)     calls add(row, col, value) for the
+//                                       lower triangle, row >= col, of its
+//                                       Hessian J'WJ, constant
+//
+// for t in [0, N), with vars and grad indexed like the variables of H. The
+// scalar of Value is that of cost: AD<Base> for the tape of FG_eval, double
+// elsewhere. weights is anything with the fields of CostWeights: a
+// CostWeights, or the CostTermWeights of tape parameters.
+//
+// MPCCost is the cost of FG_eval; ModelDerivatives::CostHessian is its
+// GaussNewton and MPC_NLP::eval_grad_f its Gradient.
+
+template <class T>
+T Square(const T &x) {
+  return x * x;
+}
+
+// The values of CostWeights as T, the parameters of a tape
+template <class T>
+struct CostTermWeights {
+  T cte;
+  T epsi;
+  T v;
+  T current_delta;
+  T current_a;
+  T diff_delta;
+  T diff_a;
+  T v_ref;
+  T terminal_cte;
+  T terminal_epsi;
+  T terminal_delta;
+  T terminal_cte_epsi;
+  T terminal_cte_delta;
+  T terminal_epsi_delta;
+  T terminal_v;
+
+  // From p[start...], stored by CostWeights::Store
+  template <class Vector>
+  void Load(const Vector &p, size_t start) {
+    cte = p[start];
+    epsi = p[start + 1];
+    v = p[start + 2];
+    current_delta = p[start + 3];
+    current_a = p[start + 4];
+    diff_delta = p[start + 5];
+    diff_a = p[start + 6];
+    v_ref = p[start + 7];
+    terminal_cte = p[start + 8];
+    terminal_epsi = p[start + 9];
+    terminal_delta = p[start + 10];
+    terminal_cte_epsi = p[start + 11];
+    terminal_cte_delta = p[start + 12];
+    terminal_epsi_delta = p[start + 13];
+    terminal_v = p[start + 14];
+  }
+};
+
+// Distance from the reference state, of every state
+struct TrackingTerm {
+  template <class H, class Vars, class W, class T>
+  static void Value(size_t t, const Vars &vars, const W &w, T &cost) {
+    cost += w.cte * Square(vars[H::cte_start + t] - ref_cte);
+    cost += w.epsi * Square(vars[H::epsi_start + t] - ref_epsi);
+    cost += w.v * Square(vars[H::v_start + t] - w.v_ref);
+  }
+  template <class H, class Vars, class W, class Grad>
+  static void Gradient(size_t t, const Vars &vars, const W &w, Grad &grad) {
+    grad[H::cte_start + t] += 2 * w.cte * (vars[H::cte_start + t] - ref_cte);
+    grad[H::epsi_start + t] += 2 * w.epsi * (vars[H::epsi_start + t] - ref_epsi);
+    grad[H::v_start + t] += 2 * w.v * (vars[H::v_start + t] - w.v_ref);
+  }
+  template <class H, class W, class Add>
+  static void GaussNewton(size_t t, const W &w, Add &add) {
+    add(H::cte_start + t, H::cte_start + t, 2 * w.cte);
+    add(H::epsi_start + t, H::epsi_start + t, 2 * w.epsi);
+    add(H::v_start + t, H::v_start + t, 2 * w.v);
+  }
+};
+
+// Use of the actuators. Every actuated stage counts, so a block weighs as
+// many times as it has stages.
+struct EffortTerm {
+  template <class H, class Vars, class W, class T>
+  static void Value(size_t t, const Vars &vars, const W &w, T &cost) {
+    if (t + 1 < H::N) {
+      cost += w.current_delta * Square(vars[H::delta_start + H::block(t)]);
+      cost += w.current_a * Square(vars[H::a_start + H::block(t)]);
+    }
+  }
+  template <class H, class Vars, class W, class Grad>
+  static void Gradient(size_t t, const Vars &vars, const W &w, Grad &grad) {
+    if (t + 1 < H::N) {
+      const size_t d = H::delta_start + H::block(t);
+      const size_t a = H::a_start + H::block(t);
+      grad[d] += 2 * w.current_delta * vars[d];
+      grad[a] += 2 * w.current_a * vars[a];
+    }
+  }
+  template <class H, class W, class Add>
+  static void GaussNewton(size_t t, const W &w, Add &add) {
+    if (t + 1 < H::N) {
+      const size_t d = H::delta_start + H::block(t);
+      const size_t a = H::a_start + H::block(t);
+      add(d, d, 2 * w.current_delta);
+      add(a, a, 2 * w.current_a);
+    }
+  }
+};
+
+// Gap between sequential actuators, zero inside a block: at stage t that of
+// blocks t and t + 1 (there are fewer blocks than stages)
+struct RateTerm {
+  template <class H, class Vars, class W, class T>
+  static void Value(size_t t, const Vars &vars, const W &w, T &cost) {
+    if (t + 1 < H::n_blocks) {
+      const size_t d = H::delta_start + t;
+      const size_t a = H::a_start + t;
+      cost += w.diff_delta * Square(vars[d + 1] - vars[d]);
+      cost += w.diff_a * Square(vars[a + 1] - vars[a]);
+    }
+  }
+  template <class H, class Vars, class W, class Grad>
+  static void Gradient(size_t t, const Vars &vars, const W &w, Grad &grad) {
+    if (t + 1 < H::n_blocks) {
+      const size_t d = H::delta_start + t;
+      const size_t a = H::a_start + t;
+      const double gd = 2 * w.diff_delta * (vars[d + 1] - vars[d]);
+      const double ga = 2 * w.diff_a * (vars[a + 1] - vars[a]);
+      grad[d] -= gd;
+      grad[d + 1] += gd;
+      grad[a] -= ga;
+      grad[a + 1] += ga;
+    }
+  }
+  template <class H, class W, class Add>
+  static void GaussNewton(size_t t, const W &w, Add &add) {
+    if (t + 1 < H::n_blocks) {
+      const size_t offsets[2] = {H::delta_start + t, H::a_start + t};
+      const double weights[2] = {2 * w.diff_delta, 2 * w.diff_a};
+      for (size_t k = 0; k < 2; k++) {
+        const size_t i = offsets[k];
+        add(i, i, weights[k]);
+        add(i + 1, i + 1, weights[k]);
+        add(i + 1, i, -weights[k]);
+      }
+    }
+  }
+};
+
+// Cost to go beyond the horizon, on the last state and actuation: the
+// quadratic form of the terminal weights on (cte, epsi, delta) and the
+// speed error (zero weights without one, see CostWeights)
+struct TerminalTerm {
+  template <class H, class Vars, class W, class T>
+  static void Value(size_t t, const Vars &vars, const W &w, T &cost) {
+    if (t + 1 == H::N) {
+      const T cte = vars[H::cte_start + t] - ref_cte;
+      const T epsi = vars[H::epsi_start + t] - ref_epsi;
+      const T delta = vars[H::delta_start + H::n_blocks - 1];
+      cost += w.terminal_cte * cte * cte + w.terminal_epsi * epsi * epsi +
+              w.terminal_delta * delta * delta;
+      cost += 2 * (w.terminal_cte_epsi * cte * epsi + w.terminal_cte_delta * cte * delta +
+                   w.terminal_epsi_delta * epsi * delta);
+      cost += w.terminal_v * Square(vars[H::v_start + t] - w.v_ref);
+    }
+  }
+  template <class H, class Vars, class W, class Grad>
+  static void Gradient(size_t t, const Vars &vars, const W &w, Grad &grad) {
+    if (t + 1 == H::N) {
+      const size_t i_cte = H::cte_start + t;
+      const size_t i_epsi = H::epsi_start + t;
+      const size_t i_delta = H::delta_start + H::n_blocks - 1;
+      const double cte = vars[i_cte] - ref_cte;
+      const double epsi = vars[i_epsi] - ref_epsi;
+      const double delta = vars[i_delta];
+      grad[i_cte] += 2 * (w.terminal_cte * cte + w.terminal_cte_epsi * epsi +
+                          w.terminal_cte_delta * delta);
+      grad[i_epsi] += 2 * (w.terminal_epsi * epsi + w.terminal_cte_epsi * cte +
+                           w.terminal_epsi_delta * delta);
+      grad[i_delta] += 2 * (w.terminal_delta * delta + w.terminal_cte_delta * cte +
+                            w.terminal_epsi_delta * epsi);
+      grad[H::v_start + t] += 2 * w.terminal_v * (vars[H::v_start + t] - w.v_ref);
+    }
+  }
+  template <class H, class W, class Add>
+  static void GaussNewton(size_t t, const W &w, Add &add) {
+    if (t + 1 == H::N) {
+      const size_t cte = H::cte_start + t;
+      const size_t epsi = H::epsi_start + t;
+      const size_t delta = H::delta_start + H::n_blocks - 1;
+      add(cte, cte, 2 * w.terminal_cte);
+      add(epsi, epsi, 2 * w.terminal_epsi);
+      add(delta, delta, 2 * w.terminal_delta);
+      add(epsi, cte, 2 * w.terminal_cte_epsi);
+      add(delta, cte, 2 * w.terminal_cte_delta);
+      add(delta, epsi, 2 * w.terminal_epsi_delta);
+      add(H::v_start + t, H::v_start + t, 2 * w.terminal_v);
+    }
+  }
+};
+
+// The sum of Terms, fused into one loop over the stages
+template <class... Terms>
+struct CostSum {
+  template <class H, class Vars, class W, class T>
+  static void Value(const Vars &vars, const W &w, T &cost) {
+    for (size_t t = 0; t < H::N; t++) {
+      const int expand[] = {0, (Terms::template Value<H>(t, vars, w, cost), 0)...};
+      (void)expand;
+    }
+  }
+  template <class H, class Vars, class W, class Grad>
+  static void Gradient(const Vars &vars, const W &w, Grad &grad) {
+    for (size_t t = 0; t < H::N; t++) {
+      const int expand[] = {0, (Terms::template Gradient<H>(t, vars, w, grad), 0)...};
+      (void)expand;
+    }
+  }
+  template <class H, class W, class Add>
+  static void GaussNewton(const W &w, Add &add) {
+    for (size_t t = 0; t < H::N; t++) {
+      const int expand[] = {0, (Terms::template GaussNewton<H>(t, w, add), 0)...};
+      (void)expand;
+    }
+  }
+};
+
+// The cost of FG_eval
+typedef CostSum<TrackingTerm, EffortTerm, RateTerm, TerminalTerm> MPCCost;
+
+#endif /* COST_TERMS_H */
@@ -0,0 +1,146 @@
+#ifndef COST_WEIGHTS_H
+#define COST_WEIGHTS_H
+
+#include <cstddef>
+#include <vector>
+#include "KinematicModel.h"
+
+// Weights of the terms of the MPC cost (see FG_eval) and the reference
+// speed. The defaults are the tuned constants of KinematicModel.h.
+//
+// The terminal weights are those of a quadratic form on the last stage,
+// x' P x with x = (cte, epsi, delta) for the last state and actuation, plus
+// terminal_v on the speed error: the cost of the road beyond the horizon,
+// see LQRTerminalCost. They are zero, no terminal cost, by default.
+struct CostWeights {
+  double cte = cost_cte_factor;
+  double epsi = cost_epsi_factor;
+  double v = cost_v_factor;
+  double current_delta = cost_current_delta_factor;
+  double current_a = cost_current_a_factor;
+  double diff_delta = cost_diff_delta_factor;
+  double diff_a = cost_diff_a_factor;
+  double v_ref = ref_v;
+  double terminal_cte = 0;
+  double terminal_epsi = 0;
+  double terminal_delta = 0;
+  double terminal_cte_epsi = 0;
+  double terminal_cte_delta = 0;
+  double terminal_epsi_delta = 0;
+  double terminal_v = 0;
+
+  // Number of values, and the values in the order above, which is how the
+  // tape parameters store them
+  static constexpr size_t size = 15;
+  void Store(double *p) const {
+    p[0] = cte;
+    p[1] = epsi;
+    p[2] = v;
+    p[3] = current_delta;
+    p[4] = current_a;
+    p[5] = diff_delta;
+    p[6] = diff_a;
+    p[7] = v_ref;
+    p[8] = terminal_cte;
+    p[9] = terminal_epsi;
+    p[10] = terminal_delta;
+    p[11] = terminal_cte_epsi;
+    p[12] = terminal_cte_delta;
+    p[13] = terminal_epsi_delta;
+    p[14] = terminal_v;
+  }
+  // The values of Store back
+  void Load(const double *p) {
+    cte = p[0];
+    epsi = p[1];
+    v = p[2];
+    current_delta = p[3];
+    current_a = p[4];
+    diff_delta = p[5];
+    diff_a = p[6];
+    v_ref = p[7];
+    terminal_cte = p[8];
+    terminal_epsi = p[9];
+    terminal_delta = p[10];
+    terminal_cte_epsi = p[11];
+    terminal_cte_delta = p[12];
+    terminal_epsi_delta = p[13];
+    terminal_v = p[14];
+  }
+
+  bool operator==(const CostWeights &o) const {
+    return cte == o.cte && epsi == o.epsi && v == o.v && current_delta == o.current_delta &&
+           current_a == o.current_a && diff_delta == o.diff_delta && diff_a == o.diff_a &&
+           v_ref == o.v_ref && terminal_cte == o.terminal_cte &&
+           terminal_epsi == o.terminal_epsi && terminal_delta == o.terminal_delta &&
+           terminal_cte_epsi == o.terminal_cte_epsi &&
+           terminal_cte_delta == o.terminal_cte_delta &&
+           terminal_epsi_delta == o.terminal_epsi_delta && terminal_v == o.terminal_v;
+  }
+  bool operator!=(const CostWeights &o) const { return !(*this == o); }
+
+  // (1 - s) * a + s * b, field by field
+  static CostWeights Blend(const CostWeights &a, const CostWeights &b, double s) {
+    CostWeights w;
+    w.cte = a.cte + s * (b.cte - a.cte);
+    w.epsi = a.epsi + s * (b.epsi - a.epsi);
+    w.v = a.v + s * (b.v - a.v);
+    w.current_delta = a.current_delta + s * (b.current_delta - a.current_delta);
+    w.current_a = a.current_a + s * (b.current_a - a.current_a);
+    w.diff_delta = a.diff_delta + s * (b.diff_delta - a.diff_delta);
+    w.diff_a = a.diff_a + s * (b.diff_a - a.diff_a);
+    w.v_ref = a.v_ref + s * (b.v_ref - a.v_ref);
+    w.terminal_cte = a.terminal_cte + s * (b.terminal_cte - a.terminal_cte);
+    w.terminal_epsi = a.terminal_epsi + s * (b.terminal_epsi - a.terminal_epsi);
+    w.terminal_delta = a.terminal_delta + s * (b.terminal_delta - a.terminal_delta);
+    w.terminal_cte_epsi = a.terminal_cte_epsi + s * (b.terminal_cte_epsi - a.terminal_cte_epsi);
+    w.terminal_cte_delta =
+        a.terminal_cte_delta + s * (b.terminal_cte_delta - a.terminal_cte_delta);
+    w.terminal_epsi_delta =
+        a.terminal_epsi_delta + s * (b.terminal_epsi_delta - a.terminal_epsi_delta);
+    w.terminal_v = a.terminal_v + s * (b.terminal_v - a.terminal_v);
+    return w;
+  }
+};
+
+// Gain schedule of the cost weights over the speed (mph, like the state):
+// linear between its points and held beyond the first and the last. Without
+// points it gives the default weights.
+class CostSchedule {
+public:
+  // Use weights at speed v. Points are added in increasing v.
+  void AddPoint(double v, const CostWeights &weights) {
+    speeds_.push_back(v);
+    weights_.push_back(weights);
+  }
+
+  void Clear() {
+    speeds_.clear();
+    weights_.clear();
+  }
+
+  // Whether it has no points, and gives the default weights
+  bool empty() const { return speeds_.empty(); }
+
+  CostWeights At(double v) const {
+    if (speeds_.empty()) {
+      return CostWeights();
+    }
+    if (v <= speeds_.front()) {
+      return weights_.front();
+    }
+    for (size_t k = 1; k < speeds_.size(); k++) {
+      if (v < speeds_[k]) {
+        const double s = (v - speeds_[k - 1]) / (speeds_[k] - speeds_[k - 1]);
+        return CostWeights::Blend(weights_[k - 1], weights_[k], s);
+      }
+    }
+    return weights_.back();
+  }
+
+private:
+  std::vector<double> speeds_;
+  std::vector<CostWeights> weights_;
+};
+
+#endif /* COST_WEIGHTS_H */
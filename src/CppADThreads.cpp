@@ -0,0 +1,78 @@
+#include "CppADThreads.h"
+#include <cppad/cppad.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// Guards the thread numbers
+std::mutex registry_mutex;
+// Thread numbers CppAD is set up for and whether each is taken; 0 is the
+// main thread
+std::vector<bool> taken(1, true);
+// Registered threads. CppAD asks for it on every allocation, so it is read
+// without the lock.
+std::atomic<size_t> n_registered(0);
+// Number of the calling thread, 0 unless it holds a CppADThread
+thread_local size_t thread_number = 0;
+
+bool InParallel() { return n_registered.load(std::memory_order_acquire) > 0; }
+
+size_t ThreadNumber() { return thread_number; }
+
+}  // namespace
+
+size_t SetupCppADThreads(size_t n) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  n = std::min<size_t>(n, CPPAD_MAX_NUM_THREADS);
+  // CppAD can only be set up again in sequential mode
+  if (n > taken.size() && n_registered.load() == 0) {
+    CppAD::thread_alloc::parallel_setup(n, InParallel, ThreadNumber);
+    // Freed memory stays in the pool of its thread for the next solve
+    CppAD::thread_alloc::hold_memory(true);
+    CppAD::parallel_ad<double>();
+    taken.resize(n, false);
+  }
+  return 1 + std::count(taken.begin() + 1, taken.end(), false);
+}
+
+void HoldCppADMemory() {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  if (n_registered.load() == 0) {
+    CppAD::thread_alloc::hold_memory(true);
+  }
+}
+
+CppADPool CppADPoolOfThread() {
+  const size_t thread = CppAD::thread_alloc::thread_num();
+  CppADPool pool;
+  pool.inuse = CppAD::thread_alloc::inuse(thread);
+  pool.available = CppAD::thread_alloc::available(thread);
+  return pool;
+}
+
+CppADThread::CppADThread() : number_(0) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  for (size_t k = 1; k < taken.size(); k++) {
+    if (!taken[k]) {
+      number_ = k;
+      break;
+    }
+  }
+  assert(number_ > 0 && "more CppAD threads than SetupCppADThreads allowed");
+  taken[number_] = true;
+  thread_number = number_;
+  n_registered++;
+}
+
+CppADThread::~CppADThread() {
+  // The pool of this thread, before another thread takes its number
+  CppAD::thread_alloc::free_available(number_);
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  taken[number_] = false;
+  thread_number = 0;
+  n_registered--;
+}
@@ -0,0 +1,48 @@
+#ifndef CPPAD_THREADS_H
+#define CPPAD_THREADS_H
+
+#include <cstddef>
+
+// CppAD keeps its memory in per-thread pools (thread_alloc). Threads that
+// use CppAD at the same time must each be known to it by a number, and
+// memory must go back to the pool of the thread that took it. So every model
+// is made, solved and destroyed on one thread, and every thread but the
+// main one holds a CppADThread while it does.
+
+// Get CppAD ready for up to n threads at once, the main thread included, and
+// return how many the caller can use: itself and the numbers no CppADThread
+// holds. CppAD takes no more than CPPAD_MAX_NUM_THREADS, and can't take more
+// than before while a CppADThread exists. Call from the main thread before
+// starting the threads.
+size_t SetupCppADThreads(size_t n);
+
+// Keep what CppAD frees in the pool of the thread that freed it, for the
+// next tape and sweep of that thread, instead of handing it back to the
+// system; SetupCppADThreads does it too. For a process that solves on its
+// main thread only, from it before anything uses CppAD.
+void HoldCppADMemory();
+
+// The bytes of the pool of the calling thread: in use by CppAD, and freed
+// and held for its next allocations
+struct CppADPool {
+  size_t inuse;
+  size_t available;
+};
+CppADPool CppADPoolOfThread();
+
+// Registration of the thread making it with CppAD, for the lifetime of the
+// object. Made by every worker thread before it touches a model; there must
+// be a number free (see SetupCppADThreads).
+class CppADThread {
+public:
+  CppADThread();
+  ~CppADThread();
+
+  // Number of the thread in CppAD, 1 or above
+  size_t number() const { return number_; }
+
+private:
+  size_t number_;
+};
+
+#endif /* CPPAD_THREADS_H */
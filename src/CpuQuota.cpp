@@ -0,0 +1,64 @@
+#include "CpuQuota.h"
+#include <time.h>
+#include <algorithm>
+#include <cmath>
+
+double ThreadCpuSeconds() {
+  timespec now;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+    return 0;
+  }
+  return static_cast<double>(now.tv_sec) + static_cast<double>(now.tv_nsec) * 1e-9;
+}
+
+bool SessionCpu::Charge(double cpu_seconds, Clock::time_point now,
+                        const CpuQuotaPolicy &policy) {
+  const double window = policy.window > 0 ? policy.window : 1;
+  if (known_.load(std::memory_order_relaxed)) {
+    const double elapsed = std::chrono::duration<double>(now - last_).count();
+    sum_ *= std::exp(-std::max(elapsed, 0.0) / window);
+  }
+  sum_ += cpu_seconds;
+  last_ = now;
+  const double cores = sum_ / window;
+  cores_.Set(cores);
+  seconds_.Add(cpu_seconds);
+  known_.store(true, std::memory_order_relaxed);
+
+  bool over = over_.load(std::memory_order_relaxed);
+  if (policy.cores <= 0) {
+    over = false;
+  } else if (!over) {
+    over = cores > policy.cores;
+  } else {
+    over = cores >= policy.release * policy.cores;
+  }
+  over_.store(over, std::memory_order_relaxed);
+  return over;
+}
+
+void SessionCpu::Render(uint64_t session, std::string &out) const {
+  if (!known_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  const std::string prefix =
+      "mpc_session_cpu{session=\"" + std::to_string(session) + "\",quantity=\"";
+  const struct {
+    const char *name;
+    double value;
+  } quantities[] = {{"seconds", seconds()},
+                    {"cores", cores()},
+                    {"over_quota", over() ? 1.0 : 0.0},
+                    {"degraded_ticks", static_cast<double>(degraded())}};
+  for (const auto &quantity : quantities) {
+    out.append(prefix).append(quantity.name).append("\"} ");
+    out.append(std::to_string(quantity.value)).append("\n");
+  }
+}
+
+void RenderSessionCpuHeader(std::string &out) {
+  out.append("# HELP mpc_session_cpu CPU time of the ticks of a session on the solver threads: "
+             "its seconds in all, the cores it used over the quota window, whether it is over "
+             "its quota, and the ticks degraded for it\n");
+  out.append("# TYPE mpc_session_cpu gauge\n");
+}
@@ -0,0 +1,74 @@
+#ifndef CPU_QUOTA_H
+#define CPU_QUOTA_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "Metrics.h"
+
+// The CPU time the calling thread has run, in seconds, from its thread CPU
+// clock (CLOCK_THREAD_CPUTIME_ID): what it computed, not what it waited or
+// was preempted for
+double ThreadCpuSeconds();
+
+// How much of the solver threads a session may take
+struct CpuQuotaPolicy {
+  // Cores a session may use on average, e.g. 0.3 for 30% of one; 0 for no
+  // quota
+  double cores = 0;
+  // Seconds the use is averaged over, so that a few hard corners in a row
+  // don't count against it, but seconds of them do
+  double window = 2;
+  // A session over the quota is let off it once its use falls below this
+  // fraction of it, so it doesn't flap at the limit
+  double release = 0.8;
+};
+
+// The CPU time of the ticks of one session, charged by the solver threads
+// that ran them and read by Render on any other, and whether it is over
+// its quota.
+//
+// The use is an exponential average of the CPU seconds per second of wall
+// time over the window, so it needs no history of the ticks: every Charge
+// decays the sum since the last by the time between them and adds its own.
+class SessionCpu {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  // cpu_seconds of the session's ticks up to now; true when that takes it
+  // over policy's quota, or keeps it there
+  bool Charge(double cpu_seconds, Clock::time_point now, const CpuQuotaPolicy &policy);
+
+  // Whether the session is over its quota, as of the last Charge
+  bool over() const { return over_.load(std::memory_order_relaxed); }
+  // Cores the session used over the window, as of the last Charge
+  double cores() const { return cores_.value(); }
+  // CPU seconds charged in all
+  double seconds() const { return seconds_.value(); }
+
+  // A tick of the session run degraded for the quota
+  void Degraded() { degraded_.fetch_add(1, std::memory_order_relaxed); }
+  uint64_t degraded() const { return degraded_.load(std::memory_order_relaxed); }
+
+  // Append the CPU seconds, cores, quota state and degraded ticks of the
+  // session, under the header of RenderSessionCpuHeader, to out; nothing
+  // before the first Charge
+  void Render(uint64_t session, std::string &out) const;
+
+ private:
+  // On the solver threads, one at a time
+  double sum_ = 0;
+  Clock::time_point last_;
+  // For Render
+  std::atomic<bool> known_{false};
+  MetricGauge cores_;
+  MetricGauge seconds_;
+  std::atomic<bool> over_{false};
+  std::atomic<uint64_t> degraded_{0};
+};
+
+// The header of the gauges of SessionCpu::Render
+void RenderSessionCpuHeader(std::string &out);
+
+#endif /* CPU_QUOTA_H */
@@ -0,0 +1,95 @@
+#include "DelayQueue.h"
+#include <algorithm>
+#include "Instrumentation.h"
+
+constexpr std::chrono::milliseconds DelayQueue::kCongestionRetry;
+
+DelayQueue::DelayQueue(uS::Loop *loop, uWS::WebSocket<uWS::SERVER> ws, SentCallback sent,
+                       uWS::OpCode op_code, size_t max_buffered, CorkedSends *cork)
+    : timer_(new uS::Timer(loop)),
+      ws_(ws),
+      sent_(sent),
+      op_code_(op_code),
+      max_buffered_(max_buffered),
+      cork_(cork),
+      congested_(false),
+      dropped_(0),
+      first_(0),
+      count_(0) {
+  timer_->setData(this);
+}
+
+DelayQueue::~DelayQueue() {
+  timer_->stop();
+  // Freed by the loop once the handle is closed
+  timer_->close();
+}
+
+void DelayQueue::Send(const std::string &message, std::chrono::milliseconds delay,
+                      Clock::time_point arrival) {
+  if (count_ == slots_.size()) {
+    // One more slot, after the commands queued put back in order
+    std::rotate(slots_.begin(), slots_.begin() + first_, slots_.end());
+    first_ = 0;
+    slots_.emplace_back();
+  }
+  Command &command = queued(count_++);
+  command.message.assign(message);
+  command.due = Clock::now() + delay;
+  command.arrival = arrival;
+  if (count_ == 1) {
+    Arm();
+  }
+}
+
+void DelayQueue::Expired(uS::Timer *timer) {
+  static_cast<DelayQueue *>(timer->getData())->SendDue();
+}
+
+void DelayQueue::SendDue() {
+  MPC_TRACE_SCOPE("timer");
+  const Clock::time_point now = Clock::now();
+  congested_ = max_buffered_ > 0 && ws_.getBufferedAmount() > max_buffered_;
+  if (congested_) {
+    // Of the commands due, only the newest is still worth sending once the
+    // client catches up
+    while (count_ > 1 && queued(1).due <= now) {
+      Recycle();
+      dropped_++;
+    }
+    Arm(kCongestionRetry);
+    return;
+  }
+  while (count_ > 0 && queued(0).due <= now) {
+    Command &command = queued(0);
+    const Clock::time_point sending = Clock::now();
+    if (cork_ != nullptr) {
+      cork_->Send(ws_, command.message.data(), command.message.length(), op_code_,
+                  sent_ ? &sent_ : nullptr, command.arrival, sending);
+      Recycle();
+      continue;
+    }
+    ws_.send(command.message.data(), command.message.length(), op_code_);
+    if (sent_) {
+      sent_(command.arrival, sending, command.message);
+    }
+    Recycle();
+  }
+  Arm();
+}
+
+void DelayQueue::Recycle() {
+  first_ = (first_ + 1) % slots_.size();
+  count_--;
+}
+
+void DelayQueue::Arm(Clock::duration at_least) {
+  if (count_ == 0) {
+    return;
+  }
+  // Rounded up, a timer that fires early would only be armed again
+  const auto wait = std::max(queued(0).due - Clock::now(), at_least);
+  const auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(
+      wait + std::chrono::milliseconds(1) - Clock::duration(1));
+  timer_->start(Expired, milliseconds.count() > 0 ? static_cast<int>(milliseconds.count()) : 0, 0);
+}
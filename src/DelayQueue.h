@@ -0,0 +1,94 @@
+#ifndef DELAY_QUEUE_H
+#define DELAY_QUEUE_H
+
+#include <uWS/uWS.h>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "CorkedSends.h"
+
+// The commands to one connection held back by the emulated actuator
+// latency, sent by a timer of the event loop when they are due rather than
+// by sleeping in the message handler, so that the loop keeps serving the
+// other sockets and the next messages meanwhile.
+//
+// The commands go out in the order they were queued, each once its delay
+// has passed, and the timer is armed for the first of them only. They are
+// queued in a ring of slots that only grows, each keeping the buffer of its
+// last command for the next, so queueing allocates nothing once there have
+// been as many in flight as there will be.
+//
+// A client that reads slower than the commands come leaves them in the
+// buffers of uWS, where they would grow late and without bound. So while
+// more than max_buffered bytes wait there the queue is congested: it sends
+// nothing, drops every command that is due but the newest, and looks again
+// every kCongestionRetry. The socket's buffers then hold at most
+// max_buffered bytes and one command, the queue the commands of a delay.
+//
+// With the CorkedSends of the loop, the commands due are held there with
+// the frames of the other sockets and written with them, and the sent
+// callback comes once they are.
+class DelayQueue {
+ public:
+  typedef std::chrono::steady_clock Clock;
+  // Called with the arrival a command was queued with, once it is sent,
+  // when its send began, and the command
+  typedef CorkedSends::Written SentCallback;
+
+  // How often a congested queue looks at the socket's buffers again
+  static constexpr std::chrono::milliseconds kCongestionRetry{5};
+
+  // The commands go out as messages of op_code, text or binary, through
+  // cork unless it is null; a max_buffered of 0 never congests
+  DelayQueue(uS::Loop *loop, uWS::WebSocket<uWS::SERVER> ws, SentCallback sent = nullptr,
+             uWS::OpCode op_code = uWS::OpCode::TEXT, size_t max_buffered = 0,
+             CorkedSends *cork = nullptr);
+  // Drops the commands not sent yet
+  ~DelayQueue();
+  DelayQueue(const DelayQueue &) = delete;
+  DelayQueue &operator=(const DelayQueue &) = delete;
+
+  // Send a copy of message delay from now, for the message that arrived at
+  // arrival, or Clock::time_point() for a command that answers none
+  void Send(const std::string &message, std::chrono::milliseconds delay,
+            Clock::time_point arrival);
+
+  // Commands queued and not sent yet
+  size_t pending() const { return count_; }
+  // Whether the socket had more than max_buffered bytes unsent when the
+  // queue last looked, and the commands dropped for it so far
+  bool congested() const { return congested_; }
+  size_t dropped() const { return dropped_; }
+
+ private:
+  struct Command {
+    Clock::time_point due;
+    Clock::time_point arrival;
+    std::string message;
+  };
+
+  static void Expired(uS::Timer *timer);
+  // Send the commands that are due, then arm the timer for the next
+  void SendDue();
+  // Arm the timer for the first command, at least at_least from now
+  void Arm(Clock::duration at_least = Clock::duration::zero());
+  // The k-th command queued, from the first
+  Command &queued(size_t k) { return slots_[(first_ + k) % slots_.size()]; }
+  // Drop the first command, its slot and buffer kept for the next
+  void Recycle();
+
+  uS::Timer *timer_;
+  uWS::WebSocket<uWS::SERVER> ws_;
+  SentCallback sent_;
+  uWS::OpCode op_code_;
+  size_t max_buffered_;
+  CorkedSends *cork_;
+  bool congested_;
+  size_t dropped_;
+  std::vector<Command> slots_;
+  size_t first_;
+  size_t count_;
+};
+
+#endif /* DELAY_QUEUE_H */
@@ -0,0 +1,51 @@
+#include "EffortController.h"
+#include <algorithm>
+
+EffortController::EffortController(const EffortPolicy &policy,
+                                   const std::vector<EffortLevel> &levels)
+    : policy_(policy), levels_(levels) {
+  samples_.reserve(policy_.window);
+  sorted_.reserve(policy_.window);
+}
+
+bool EffortController::Record(double seconds) {
+  if (samples_.size() < policy_.window) {
+    samples_.push_back(seconds);
+  } else {
+    samples_[next_] = seconds;
+    next_ = (next_ + 1) % policy_.window;
+  }
+
+  // Percentile of the window by partial sort, a few hundred values
+  sorted_ = samples_;
+  const size_t k = std::min(sorted_.size() - 1,
+                            static_cast<size_t>(policy_.percentile * sorted_.size()));
+  std::nth_element(sorted_.begin(), sorted_.begin() + k, sorted_.end());
+  latency_ = sorted_[k];
+
+  size_t next = level_;
+  if (latency_ > policy_.target_latency && samples_.size() >= policy_.min_samples &&
+      level_ + 1 < levels_.size()) {
+    next = level_ + 1;
+  } else if (latency_ < policy_.recovery_fraction * policy_.target_latency &&
+             samples_.size() >= policy_.window && level_ > 0) {
+    next = level_ - 1;
+  }
+  if (next == level_) {
+    return false;
+  }
+  level_ = next;
+  samples_.clear();
+  next_ = 0;
+  return true;
+}
+
+bool EffortController::saturated() const {
+  return level_ + 1 == levels_.size() && samples_.size() >= policy_.min_samples &&
+         latency_ > policy_.target_latency;
+}
+
+std::vector<EffortLevel> IpoptEffortLevels() {
+  return {{1e-8, 1e-6, 3000}, {1e-6, 1e-4, 100}, {1e-5, 1e-3, 50}, {1e-4, 1e-3, 25},
+          {1e-3, 1e-2, 10}};
+}
@@ -0,0 +1,82 @@
+#ifndef EFFORT_CONTROLLER_H
+#define EFFORT_CONTROLLER_H
+
+#include <cstddef>
+#include <vector>
+
+// How hard Ipopt works on a solve: its convergence tolerances and iteration
+// limit
+struct EffortLevel {
+  double tol;
+  double acceptable_tol;
+  int max_iter;
+};
+
+// Target of EffortController
+struct EffortPolicy {
+  // Wall time in seconds the percentile of the solve times is held under
+  double target_latency = 0.03;
+  double percentile = 0.99;
+  // Solve times the percentile is estimated over, the most recent ones
+  size_t window = 200;
+  // Solve times needed since the last change before the effort is lowered
+  // again; raising it waits for a full window
+  size_t min_samples = 20;
+  // The effort is raised once the percentile is below this fraction of the
+  // target, so it doesn't go back and forth around it
+  double recovery_fraction = 0.6;
+};
+
+// Closed loop on the measured solve times of an MPC, picking the effort of
+// each solve from a ladder so that the policy's percentile of the wall time
+// stays under its target.
+//
+// Unlike max_solve_time, which cuts a single slow solve short, this follows
+// the load of the host: when another process steals CPU the solves slow
+// down, the percentile rises and the controller steps down to looser
+// tolerances and fewer iterations, until the solves are fast enough; it
+// steps back up once the percentile is well below the target over a full
+// window. The window starts over at every change, so that the percentile
+// only holds solve times of the current level.
+class EffortController {
+public:
+  // levels from the most to the least effort
+  EffortController(const EffortPolicy &policy, const std::vector<EffortLevel> &levels);
+
+  // Add the wall time of a solve made at the current level. Return true if
+  // the level changed.
+  bool Record(double seconds);
+
+  // Level to solve at, the setpoint of the loop, and its index in the
+  // ladder (0 is full effort)
+  const EffortLevel &setpoint() const { return levels_[level_]; }
+  size_t level() const { return level_; }
+
+  // Estimate of the policy's percentile over the current window, 0 before
+  // any solve
+  double latency() const { return latency_; }
+
+  // The least effort is in use and the solves are still too slow: the
+  // controller can't do more, only a smaller problem will help
+  bool saturated() const;
+
+  const EffortPolicy &policy() const { return policy_; }
+
+private:
+  EffortPolicy policy_;
+  std::vector<EffortLevel> levels_;
+  size_t level_ = 0;
+  double latency_ = 0;
+
+  // Ring of the solve times of the window, and scratch to take the
+  // percentile on
+  std::vector<double> samples_;
+  size_t next_ = 0;
+  std::vector<double> sorted_;
+};
+
+// The Ipopt ladder: its defaults (tol 1e-8, acceptable_tol 1e-6, 3000
+// iterations) down to 1e-3 and 10 iterations in four steps
+std::vector<EffortLevel> IpoptEffortLevels();
+
+#endif /* EFFORT_CONTROLLER_H */
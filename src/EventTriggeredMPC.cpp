@@ -0,0 +1,96 @@
+#include "EventTriggeredMPC.h"
+#include <cmath>
+
+const char *TriggerReasonName(TriggerReason reason) {
+  switch (reason) {
+    case TriggerReason::kWithinTolerance:
+      return "plan within tolerance";
+    case TriggerReason::kNoPlan:
+      return "no plan";
+    case TriggerReason::kLastSolveFailed:
+      return "last solve failed";
+    case TriggerReason::kPlanExhausted:
+      return "plan exhausted";
+    case TriggerReason::kMaxSkips:
+      return "max skips";
+    case TriggerReason::kCte:
+      return "cte off the plan";
+    case TriggerReason::kEpsi:
+      return "epsi off the plan";
+    case TriggerReason::kV:
+      return "v off the plan";
+  }
+  return "";
+}
+
+EventTriggeredMPC::EventTriggeredMPC(std::unique_ptr<MPCBase> mpc, const EventTrigger &trigger)
+    : mpc_(std::move(mpc)), trigger_(trigger) {}
+
+TriggerReason EventTriggeredMPC::Decide(const MPCState &state) const {
+  if (!has_plan_) {
+    return TriggerReason::kNoPlan;
+  }
+  if (mpc_->status() == SolveStatus::kFailed) {
+    return TriggerReason::kLastSolveFailed;
+  }
+  // The plan needs the actuations of this tick and one more displayed step
+  const size_t k = plan_age_ + 1;
+  if (k + 1 >= mpc_->horizon_length()) {
+    return TriggerReason::kPlanExhausted;
+  }
+  if (plan_age_ >= trigger_.max_skips) {
+    return TriggerReason::kMaxSkips;
+  }
+
+  // cte, epsi and v don't depend on the vehicle frame, so the plan can be
+  // compared in its own frame
+  const MPCState predicted = mpc_->planned_state(k);
+  if (fabs(state[4] - predicted[4]) > trigger_.cte_tolerance) {
+    return TriggerReason::kCte;
+  }
+  if (fabs(state[5] - predicted[5]) > trigger_.epsi_tolerance) {
+    return TriggerReason::kEpsi;
+  }
+  if (fabs(state[3] - predicted[3]) > trigger_.v_tolerance) {
+    return TriggerReason::kV;
+  }
+  return TriggerReason::kWithinTolerance;
+}
+
+MPCSolution EventTriggeredMPC::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
+  reason_ = Decide(state);
+  if (reason_ != TriggerReason::kWithinTolerance) {
+    mpc_->prev_a = prev_a;
+    mpc_->max_solve_time = max_solve_time;
+    mpc_->cost_schedule = cost_schedule;
+    const MPCSolution result = mpc_->Solve(state, coeffs);
+    status_ = mpc_->status();
+    cost_ = mpc_->cost();
+    has_plan_ = true;
+    plan_age_ = 0;
+    solves_++;
+    return result;
+  }
+
+  // Serve stage k of the plan on, moved rigidly so that stage k sits at the
+  // measured pose
+  plan_age_++;
+  skips_++;
+  status_ = SolveStatus::kSolved;
+  MPCSolution result = mpc_->PlannedSolution(plan_age_, state);
+  result.status = status_;
+  return result;
+}
+
+void EventTriggeredMPC::Prepare() {
+  // Only a fresh plan is worth preparing from, see the class comment
+  if (plan_age_ == 0) {
+    mpc_->Prepare();
+  }
+}
+
+void EventTriggeredMPC::Reset() {
+  mpc_->Reset();
+  has_plan_ = false;
+  plan_age_ = 0;
+}
@@ -0,0 +1,82 @@
+#ifndef EVENT_TRIGGERED_MPC_H
+#define EVENT_TRIGGERED_MPC_H
+
+#include <memory>
+#include <vector>
+#include "MPC.h"
+
+// Tolerances deciding when the stored plan is still valid. The errors are
+// those of the measured state against the plan prediction for this tick.
+struct EventTrigger {
+  double cte_tolerance = 0.05;
+  double epsi_tolerance = 0.01;
+  double v_tolerance = 0.5;
+  // Longest run of ticks served from one plan
+  size_t max_skips = 3;
+};
+
+// Why the last Solve re-optimized, or didn't
+enum class TriggerReason {
+  kWithinTolerance,  // skipped: the plan still holds
+  kNoPlan,
+  kLastSolveFailed,
+  kPlanExhausted,
+  kMaxSkips,
+  kCte,
+  kEpsi,
+  kV
+};
+
+const char *TriggerReasonName(TriggerReason reason);
+
+// Event-triggered MPC over any MPCBase.
+//
+// Each tick the measured state is compared with what the stored plan
+// predicted for it. While the cross-track error, orientation error and speed
+// stay within the tolerances, the next actuations of the plan are returned
+// and the inner MPC isn't called. Otherwise the inner MPC re-optimizes.
+//
+// The inner MPC doesn't see the skipped ticks, so its first warm start
+// after a run of skips is older; max_skips bounds that.
+class EventTriggeredMPC : public MPCBase {
+public:
+  EventTriggeredMPC(std::unique_ptr<MPCBase> mpc, const EventTrigger &trigger);
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  void Prepare() override;
+
+  void Reset() override;
+
+  size_t horizon_length() const override { return mpc_->horizon_length(); }
+  double timestep() const override { return mpc_->timestep(); }
+  double stage_time(size_t t) const override { return mpc_->stage_time(t); }
+  const EffortController *effort() const override { return mpc_->effort(); }
+  size_t slack_activations() const override { return mpc_->slack_activations(); }
+
+  MPCState planned_state(size_t t) const override { return mpc_->planned_state(t); }
+
+  void planned_actuations(size_t t, double &delta, double &a) const override {
+    mpc_->planned_actuations(t, delta, a);
+  }
+
+  TriggerReason reason() const { return reason_; }
+  size_t solves() const { return solves_; }
+  size_t skips() const { return skips_; }
+
+private:
+  // Decide whether the plan, k ticks old, is still valid for state
+  TriggerReason Decide(const MPCState &state) const;
+
+  std::unique_ptr<MPCBase> mpc_;
+  EventTrigger trigger_;
+
+  bool has_plan_ = false;
+  // Ticks since the plan was made
+  size_t plan_age_ = 0;
+  TriggerReason reason_ = TriggerReason::kNoPlan;
+  size_t solves_ = 0;
+  size_t skips_ = 0;
+};
+
+#endif /* EVENT_TRIGGERED_MPC_H */
@@ -0,0 +1,332 @@
+#include "ExplicitMPC.h"
+#include <sys/stat.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include "KinematicModel.h"
+
+constexpr size_t ExplicitMPC::n_inputs;
+
+// First line of a table file, with the format version
+static const char *const kTableHeader = "explicit_mpc";
+static const int kTableVersion = 1;
+
+// Start of the binary artifact of Share: the magic, the nodes and the axes,
+// then the steerings and the throttles of the nodes as floats
+static const char kArtifactMagic[8] = {'M', 'P', 'C', 'T', 'A', 'B', 'L', 'E'};
+struct ArtifactHeader {
+  char magic[8];
+  uint64_t nodes;
+  double min[ExplicitMPC::n_inputs];
+  double max[ExplicitMPC::n_inputs];
+  uint64_t count[ExplicitMPC::n_inputs];
+};
+
+ExplicitMPC::ExplicitMPC(const Axes &axes) : axes_(axes) {
+  size_t n = 1;
+  for (size_t k = 0; k < n_inputs; k++) {
+    n *= axes_[k].count;
+  }
+  nodes_ = n;
+  delta_.assign(n, std::numeric_limits<float>::quiet_NaN());
+  a_.assign(n, std::numeric_limits<float>::quiet_NaN());
+  delta_values_ = delta_.data();
+  a_values_ = a_.data();
+}
+
+ExplicitMPC::Axes ExplicitMPC::DefaultAxes() {
+  Axes axes;
+  axes[0] = {0, 60, 13};
+  axes[1] = {-2, 2, 9};
+  axes[2] = {-0.3, 0.3, 9};
+  axes[3] = {-0.02, 0.02, 9};
+  return axes;
+}
+
+ExplicitMPC::Input ExplicitMPC::Reduce(const MPCState &state, const MPCCoeffs &coeffs) {
+  Input p;
+  p[0] = state[3];
+  p[1] = state[4];
+  p[2] = state[5];
+  p[3] = 2 * coeffs[2] + 6 * coeffs[3] * state[0];
+  return p;
+}
+
+void ExplicitMPC::Expand(const Input &p, MPCState &state, MPCCoeffs &coeffs) {
+  // cte = f(0) and epsi = -atan(f'(0)) at the origin pose, like main.cpp
+  state << 0, 0, 0, p[0], p[1], p[2];
+  coeffs << p[1], -tan(p[2]), 0.5 * p[3], 0;
+}
+
+size_t ExplicitMPC::Node(const std::array<size_t, n_inputs> &i) const {
+  size_t node = 0;
+  for (size_t k = 0; k < n_inputs; k++) {
+    node = node * axes_[k].count + i[k];
+  }
+  return node;
+}
+
+size_t ExplicitMPC::Generate(MPCBase &mpc) {
+  size_t failed = 0;
+  std::array<size_t, n_inputs> i = {{0, 0, 0, 0}};
+  for (size_t node = 0; node < delta_.size(); node++) {
+    // Grid coordinates of node, the last input varying fastest
+    size_t rest = node;
+    for (size_t k = n_inputs; k-- > 0;) {
+      i[k] = rest % axes_[k].count;
+      rest /= axes_[k].count;
+    }
+
+    Input p;
+    for (size_t k = 0; k < n_inputs; k++) {
+      const TableAxis &axis = axes_[k];
+      p[k] = axis.count > 1 ? axis.min + (axis.max - axis.min) * i[k] / (axis.count - 1)
+                            : axis.min;
+    }
+    MPCState state;
+    MPCCoeffs coeffs;
+    Expand(p, state, coeffs);
+
+    mpc.Reset();
+    mpc.prev_a = 0;
+    const MPCSolution result = mpc.Solve(state, coeffs);
+    if (result.status == SolveStatus::kFailed) {
+      failed++;
+      continue;
+    }
+    delta_[Node(i)] = static_cast<float>(result.delta[0]);
+    a_[Node(i)] = static_cast<float>(result.a[0]);
+  }
+  return failed;
+}
+
+bool ExplicitMPC::Evaluate(const MPCState &state, const MPCCoeffs &coeffs, double &delta,
+                           double &a) const {
+  const Input p = Reduce(state, coeffs);
+
+  // Cell holding p and the position of p within it
+  std::array<size_t, n_inputs> lower;
+  std::array<double, n_inputs> w;
+  for (size_t k = 0; k < n_inputs; k++) {
+    const TableAxis &axis = axes_[k];
+    if (axis.count < 2) {
+      if (p[k] != axis.min) {
+        return false;
+      }
+      lower[k] = 0;
+      w[k] = 0;
+      continue;
+    }
+    const double u = (p[k] - axis.min) / (axis.max - axis.min) * (axis.count - 1);
+    if (!(u >= 0 && u <= axis.count - 1)) {
+      return false;
+    }
+    lower[k] = std::min(static_cast<size_t>(u), axis.count - 2);
+    w[k] = u - lower[k];
+  }
+
+  // Weighted sum over the 2^n_inputs corners of the cell
+  delta = 0;
+  a = 0;
+  std::array<size_t, n_inputs> i;
+  for (size_t corner = 0; corner < (size_t(1) << n_inputs); corner++) {
+    double weight = 1;
+    for (size_t k = 0; k < n_inputs; k++) {
+      const bool upper = (corner >> k) & 1;
+      i[k] = lower[k] + upper;
+      weight *= upper ? w[k] : 1 - w[k];
+    }
+    if (weight == 0) {
+      continue;
+    }
+    const size_t node = Node(i);
+    if (std::isnan(delta_values_[node])) {
+      return false;
+    }
+    delta += weight * delta_values_[node];
+    a += weight * a_values_[node];
+  }
+  return true;
+}
+
+bool ExplicitMPC::Save(const std::string &path) const {
+  std::ofstream out(path.c_str());
+  out << kTableHeader << " " << kTableVersion << "\n";
+  for (size_t k = 0; k < n_inputs; k++) {
+    out << axes_[k].min << " " << axes_[k].max << " " << axes_[k].count << "\n";
+  }
+  out.precision(9);
+  for (size_t node = 0; node < nodes_; node++) {
+    out << delta_values_[node] << " " << a_values_[node] << "\n";
+  }
+  return static_cast<bool>(out);
+}
+
+std::unique_ptr<ExplicitMPC> ExplicitMPC::Load(const std::string &path) {
+  std::ifstream in(path.c_str());
+  std::string header;
+  int version = 0;
+  in >> header >> version;
+  if (!in || header != kTableHeader || version != kTableVersion) {
+    return std::unique_ptr<ExplicitMPC>();
+  }
+  Axes axes;
+  for (size_t k = 0; k < n_inputs; k++) {
+    in >> axes[k].min >> axes[k].max >> axes[k].count;
+  }
+  if (!in) {
+    return std::unique_ptr<ExplicitMPC>();
+  }
+
+  std::unique_ptr<ExplicitMPC> table(new ExplicitMPC(axes));
+  // "nan" isn't read back by operator>>, so go through strings
+  std::string delta;
+  std::string a;
+  for (size_t node = 0; node < table->size(); node++) {
+    if (!(in >> delta >> a)) {
+      return std::unique_ptr<ExplicitMPC>();
+    }
+    table->delta_[node] = std::strtof(delta.c_str(), nullptr);
+    table->a_[node] = std::strtof(a.c_str(), nullptr);
+  }
+  return table;
+}
+
+std::shared_ptr<const ExplicitMPC> ExplicitMPC::Share(const std::string &path,
+                                                      const std::string &directory,
+                                                      std::string &error) {
+  struct stat status;
+  if (stat(path.c_str(), &status) != 0) {
+    error = "cannot read " + path;
+    return std::shared_ptr<const ExplicitMPC>();
+  }
+  // A table written again is another artifact
+  const std::string source = std::to_string(kTableVersion) + " " + path + " " +
+                             std::to_string(status.st_size) + " " +
+                             std::to_string(status.st_mtime);
+  std::string artifact;
+  if (!ShareArtifact(directory, "table-" + ArtifactKey(source) + ".bin",
+                     [&path](const std::string &partial) {
+                       const std::unique_ptr<ExplicitMPC> table = Load(path);
+                       if (!table) {
+                         return false;
+                       }
+                       ArtifactHeader header;
+                       std::memset(&header, 0, sizeof(header));
+                       std::memcpy(header.magic, kArtifactMagic, sizeof(header.magic));
+                       header.nodes = table->nodes_;
+                       for (size_t k = 0; k < n_inputs; k++) {
+                         header.min[k] = table->axes_[k].min;
+                         header.max[k] = table->axes_[k].max;
+                         header.count[k] = table->axes_[k].count;
+                       }
+                       std::ofstream out(partial.c_str(), std::ios::binary);
+                       out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+                       out.write(reinterpret_cast<const char *>(table->delta_values_),
+                                 table->nodes_ * sizeof(float));
+                       out.write(reinterpret_cast<const char *>(table->a_values_),
+                                 table->nodes_ * sizeof(float));
+                       return static_cast<bool>(out);
+                     },
+                     artifact, error)) {
+    return std::shared_ptr<const ExplicitMPC>();
+  }
+
+  std::unique_ptr<ExplicitMPC> table(new ExplicitMPC());
+  table->mapping_ = MappedFile::Map(artifact);
+  ArtifactHeader header;
+  if (!table->mapping_ || table->mapping_->size() < sizeof(header)) {
+    error = "cannot map " + artifact;
+    return std::shared_ptr<const ExplicitMPC>();
+  }
+  std::memcpy(&header, table->mapping_->data(), sizeof(header));
+  size_t nodes = 1;
+  for (size_t k = 0; k < n_inputs; k++) {
+    table->axes_[k] = {header.min[k], header.max[k], static_cast<size_t>(header.count[k])};
+    nodes *= table->axes_[k].count;
+  }
+  if (std::memcmp(header.magic, kArtifactMagic, sizeof(header.magic)) != 0 ||
+      header.nodes != nodes ||
+      table->mapping_->size() != sizeof(header) + 2 * nodes * sizeof(float)) {
+    error = artifact + " isn't a table";
+    return std::shared_ptr<const ExplicitMPC>();
+  }
+  table->nodes_ = nodes;
+  table->delta_values_ =
+      reinterpret_cast<const float *>(table->mapping_->data() + sizeof(header));
+  table->a_values_ = table->delta_values_ + nodes;
+  return std::shared_ptr<const ExplicitMPC>(table.release());
+}
+
+TableMPC::TableMPC(std::unique_ptr<MPCBase> mpc, std::shared_ptr<const ExplicitMPC> table,
+                   TableMode mode)
+    : mpc_(std::move(mpc)), table_(std::move(table)), mode_(mode),
+      plan_z_(mpc_->horizon_length()) {}
+
+MPCSolution TableMPC::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
+  double delta;
+  double a;
+  if (mode_ == TableMode::kTableFirst && table_->Evaluate(state, coeffs, delta, a)) {
+    return TableResult(state, coeffs, delta, a);
+  }
+
+  if (inner_stale_) {
+    mpc_->Reset();
+    inner_stale_ = false;
+  }
+  mpc_->prev_a = prev_a;
+  mpc_->max_solve_time = max_solve_time;
+  mpc_->cost_schedule = cost_schedule;
+  const MPCSolution result = mpc_->Solve(state, coeffs);
+  status_ = mpc_->status();
+  cost_ = mpc_->cost();
+  used_table_ = false;
+
+  if (mode_ == TableMode::kSolverFirst && status_ == SolveStatus::kFailed &&
+      table_->Evaluate(state, coeffs, delta, a)) {
+    return TableResult(state, coeffs, delta, a);
+  }
+  return result;
+}
+
+MPCSolution TableMPC::TableResult(const MPCState &state, const MPCCoeffs &coeffs, double delta,
+                                  double a) {
+  used_table_ = true;
+  inner_stale_ = true;
+  table_ticks_++;
+  status_ = SolveStatus::kSolved;
+  plan_delta_ = delta;
+  plan_a_ = a;
+
+  const size_t n = mpc_->horizon_length();
+  plan_z_.resize(n);
+  plan_z_[0] = state;
+  for (size_t t = 0; t + 1 < n; t++) {
+    plan_z_[t + 1] = ModelStep(plan_z_[t], delta, a, coeffs,
+                               mpc_->stage_time(t + 1) - mpc_->stage_time(t));
+  }
+  return PlannedSolution();
+}
+
+void TableMPC::Prepare() {
+  if (!used_table_) {
+    mpc_->Prepare();
+  }
+}
+
+MPCState TableMPC::planned_state(size_t t) const {
+  return used_table_ ? plan_z_[t] : mpc_->planned_state(t);
+}
+
+void TableMPC::planned_actuations(size_t t, double &delta, double &a) const {
+  if (used_table_) {
+    delta = plan_delta_;
+    a = plan_a_;
+  } else {
+    mpc_->planned_actuations(t, delta, a);
+  }
+}
@@ -0,0 +1,150 @@
+#ifndef EXPLICIT_MPC_H
+#define EXPLICIT_MPC_H
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MPC.h"
+#include "SharedArtifact.h"
+
+// Regular grid of one input of the table: count nodes from min to max
+struct TableAxis {
+  double min;
+  double max;
+  size_t count;
+};
+
+// Explicit (approximate) MPC: the first actuations of MPC::Solve tabulated
+// over a reduced input space and interpolated multilinearly.
+//
+// The reduced input is p = [v, cte, epsi, curvature], with the curvature
+// f'' of the reference polynomial at the vehicle. Every node is the solution
+// of the FG_eval problem from the pose [0, 0, 0] with the polynomial
+// [cte, -tan(epsi), curvature / 2, 0], so the cubic term, i.e. the change of
+// curvature along the horizon, is left out. At runtime the measured state and
+// polynomial are reduced the same way.
+//
+// Tables are made offline by Generate (see generate_table.cpp) and stored
+// as text. A table is immutable once loaded, so one serves any number of
+// TableMPCs, and with Share one mapped file every process of the host.
+class ExplicitMPC {
+public:
+  static constexpr size_t n_inputs = 4;
+  typedef std::array<double, n_inputs> Input;
+  typedef std::array<TableAxis, n_inputs> Axes;
+
+  explicit ExplicitMPC(const Axes &axes);
+
+  ExplicitMPC(const ExplicitMPC &) = delete;
+  ExplicitMPC &operator=(const ExplicitMPC &) = delete;
+
+  // Default grid: v 0..60, cte -2..2, epsi -0.3..0.3, curvature -0.02..0.02
+  static Axes DefaultAxes();
+
+  // Reduced input of a state and polynomial handed to MPCBase::Solve
+  static Input Reduce(const MPCState &state, const MPCCoeffs &coeffs);
+
+  // The problem a node at p is solved for
+  static void Expand(const Input &p, MPCState &state, MPCCoeffs &coeffs);
+
+  // Solve every node with mpc, cold started. Nodes whose solve failed are
+  // left out of the table. Return the number of them. Not of a shared
+  // table.
+  size_t Generate(MPCBase &mpc);
+
+  // Interpolated first actuations. Return false outside the grid, or next to
+  // a node that failed to solve.
+  bool Evaluate(const MPCState &state, const MPCCoeffs &coeffs, double &delta, double &a) const;
+
+  bool Save(const std::string &path) const;
+  // Null if path can't be read or isn't a table
+  static std::unique_ptr<ExplicitMPC> Load(const std::string &path);
+  // The table of the file path of Save, read once per host into a binary
+  // artifact of directory that the processes map (see SharedArtifact.h),
+  // keyed by the path, size and time of the file; null with the reason in
+  // error if it can't be
+  static std::shared_ptr<const ExplicitMPC> Share(const std::string &path,
+                                                  const std::string &directory,
+                                                  std::string &error);
+
+  const Axes &axes() const { return axes_; }
+  size_t size() const { return nodes_; }
+  // Whether the actuations are those of a mapped artifact
+  bool mapped() const { return mapping_ != nullptr; }
+
+private:
+  ExplicitMPC() = default;
+
+  // Index of a node from its grid coordinates
+  size_t Node(const std::array<size_t, n_inputs> &i) const;
+
+  Axes axes_;
+  size_t nodes_ = 0;
+  // Actuations per node, NaN where the solve failed, in the vectors or in
+  // the mapped artifact
+  const float *delta_values_ = nullptr;
+  const float *a_values_ = nullptr;
+  std::vector<float> delta_;
+  std::vector<float> a_;
+  std::unique_ptr<MappedFile> mapping_;
+};
+
+// How TableMPC uses its table
+enum class TableMode {
+  // The table inside its region, the MPC outside
+  kTableFirst,
+  // The MPC, the table when the MPC fails
+  kSolverFirst
+};
+
+// MPC with an ExplicitMPC fast path or fallback over any MPCBase.
+//
+// On a table tick the plan is the model rolled out holding the table
+// actuations over the horizon of the inner MPC, so the displayed trajectory
+// and planned_state stay meaningful.
+class TableMPC : public MPCBase {
+public:
+  TableMPC(std::unique_ptr<MPCBase> mpc, std::shared_ptr<const ExplicitMPC> table,
+           TableMode mode);
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  // The inner MPC only prepares from a plan of its own
+  void Prepare() override;
+
+  void Reset() override { mpc_->Reset(); }
+
+  size_t horizon_length() const override { return mpc_->horizon_length(); }
+  double timestep() const override { return mpc_->timestep(); }
+  double stage_time(size_t t) const override { return mpc_->stage_time(t); }
+  const EffortController *effort() const override { return mpc_->effort(); }
+  size_t slack_activations() const override { return mpc_->slack_activations(); }
+
+  MPCState planned_state(size_t t) const override;
+  void planned_actuations(size_t t, double &delta, double &a) const override;
+
+  // Whether the last Solve used the table, and the ticks that did so far
+  bool used_table() const { return used_table_; }
+  size_t table_ticks() const { return table_ticks_; }
+
+private:
+  // Result of a table tick with the actuations delta, a
+  MPCSolution TableResult(const MPCState &state, const MPCCoeffs &coeffs, double delta,
+                          double a);
+
+  std::unique_ptr<MPCBase> mpc_;
+  std::shared_ptr<const ExplicitMPC> table_;
+  TableMode mode_;
+
+  bool used_table_ = false;
+  size_t table_ticks_ = 0;
+  // The inner MPC's plan predates the table ticks since it last solved
+  bool inner_stale_ = false;
+  // Plan of the last table tick
+  std::vector<MPCState, Eigen::aligned_allocator<MPCState> > plan_z_;
+  double plan_delta_ = 0;
+  double plan_a_ = 0;
+};
+
+#endif /* EXPLICIT_MPC_H */
@@ -0,0 +1,151 @@
+#ifndef FG_EVAL_H
+#define FG_EVAL_H
+
+#include <cppad/cppad.hpp>
+#include "CostTerms.h"
+#include "CostWeights.h"
+#include "Horizon.h"
+#include "KinematicModel.h"
+#include "StageCheckpoints.h"
+#include "StageModel.h"
+
+using CppAD::AD;
+
+// Dynamic parameters of the recorded tape, stored in the format
+// 'coeffs[0..3] weights[0..14]', the weights in the order of
+// CostWeights::Store. They change every control tick without re-recording
+// the tape. The initial state is no parameter: its variables are fixed by
+// their bounds, and Ipopt takes fixed variables out of the problem.
+const size_t n_coeffs = 4;
+const size_t coeffs_start = 0;
+const size_t weights_start = coeffs_start + n_coeffs;
+const size_t n_params = weights_start + CostWeights::size;
+
+// With a sampled reference (see FG_eval) the LinearReference of every
+// stage t < N - 1 follows, 'reference[5 t .. 5 t + 4]' in the order of its
+// members; the coefficients are still there but unused.
+const size_t reference_start = n_params;
+const size_t n_reference_terms = 5;
+template <class H>
+constexpr size_t n_sampled_params() {
+  return reference_start + n_reference_terms * (H::N - 1);
+}
+
+
+// Cost and constraints of the MPC over the horizon H (see Horizon.h). Base
+// is the scalar type taped: double, or the code generation type of
+// CompiledModel.
+//
+// With Sampled, the model steps follow a LinearReference per stage, taken
+// from the parameters, instead of the polynomial: the tape holds no cubic
+// or atan, only the affine reference about each sample, and the curvature
+// of the reference leaves the Hessian.
+//
+// Without it, a reference_order of 1 or 2 steps the model along a
+// TruncatedPolynomial: the tape of a line or a parabola records neither the
+// terms of the cubic nor, for a line, a heading that depends on x, so it
+// holds fewer operations and its Jacobian and Hessian fewer nonzeros. The
+// coefficients above the order stay parameters, unused.
+//
+// With checkpoints, of the reference the tape follows, each stage calls the
+// step recorded once (see StageCheckpoints) instead of recording it again.
+template <class H, class Base = double, bool Sampled = false>
+class FG_eval {
+public:
+  typedef CPPAD_TESTVECTOR(AD<Base>) ADvector;
+
+  // Fitted polynomial coefficients
+  ADvector coeffs;
+  // The sampled reference of every stage but the last, with Sampled
+  LinearReference<AD<Base> > reference[H::N - 1];
+  // Cost weights and reference speed, see CostWeights
+  CostTermWeights<AD<Base> > weights;
+  // Order of the polynomial of the reference, 1 to 3
+  size_t reference_order;
+  // The steps of the stages as checkpoint functions, null to record them
+  const StageCheckpoints<H> *checkpoints = nullptr;
+
+  // params are the dynamic parameters of the tape (see n_params)
+  explicit FG_eval(const ADvector &params, size_t reference_order = 3)
+      : coeffs(n_coeffs), reference_order(reference_order) {
+    for (size_t i = 0; i < n_coeffs; i++) {
+      coeffs[i] = params[coeffs_start + i];
+    }
+    weights.Load(params, weights_start);
+    for (size_t t = 0; Sampled && t < H::N - 1; t++) {
+      const size_t p = reference_start + n_reference_terms * t;
+      reference[t] = LinearReference<AD<Base> >{params[p], params[p + 1], params[p + 2],
+                                                params[p + 3], params[p + 4]};
+    }
+  }
+
+  void operator()(ADvector& fg, const ADvector& vars) {
+    // Layout of the horizon and its stages, known at compile time
+    constexpr size_t N = H::N;
+    typedef StageModel<H> Model;
+
+    /* Calculates cost of current state and predicts future states.
+
+     */
+    // fg is a vector of cost and constraints,
+    // vars is a vector containing state and actuator var values and constraints.
+    // NOTE: You'll probably go back and forth between this function and
+    // the Solver function below.
+    //
+    // Reference state cost
+    //
+
+    // Cost increases with distance from the reference state, with use of
+    // the actuators and with the gap between sequential ones, and the cost
+    // to go beyond the horizon: the terms of MPCCost, see CostTerms.h
+    fg[0] = 0;
+    MPCCost::Value<H>(vars, weights, fg[0]);
+
+    //
+    // Constraints
+    //
+
+    // Set predicted states at other timesteps (from eqns)
+    // N - 1 because we're only predicting (N-1) times. The first stage holds
+    // the measured state, fixed by its bounds.
+    for (size_t i = 0; i < N - 1; i++) {
+      // The state at time t and the actuation at time t, shared by its
+      // block, see StageModel
+      AD<Base> in[Model::n_inputs];
+      Model::Gather(i, vars, in);
+
+      // The state predicted at time t+1, integrated over the step dt of
+      // stage t (see Horizon::step) by the scheme of the horizon. With Euler
+      // the equations for the model are:
+      // x_[t]    = x[t-1]    + v[t-1] * cos(psi[t-1]) * dt
+      // y_[t]    = y[t-1]    + v[t-1] * sin(psi[t-1]) * dt
+      // psi_[t]  = psi[t-1]  - v[t-1] / Lf * delta[t-1] * dt
+      // v_[t]    = v[t-1]    + a[t-1] * dt
+      // cte[t]   = f(x[t-1]) - y[t-1]      + v[t-1] * sin(epsi[t-1]) * dt
+      // epsi[t]  = psi[t]    - psides[t-1] - v[t-1] * delta[t-1] / Lf * dt
+      AD<Base> z1[Model::n_states];
+      const bool called = Sampled ? CheckpointStep(checkpoints, i, in, reference[i], z1)
+                                  : CheckpointStep(checkpoints, i, in, coeffs, z1);
+      if (called) {
+        // The step of the stage is on the tape once, as its checkpoint
+      } else if (Sampled) {
+        Model::Step(i, in, reference[i], z1);
+      } else if (reference_order == 1) {
+        Model::Step(i, in, TruncatedPolynomial<1, ADvector>{coeffs}, z1);
+      } else if (reference_order == 2) {
+        Model::Step(i, in, TruncatedPolynomial<2, ADvector>{coeffs}, z1);
+      } else {
+        Model::Step(i, in, coeffs, z1);
+      }
+
+      // Fill in fg with differences between actual and predicted states
+      // add 1 to the rows because the cost is at fg[0]
+      for (size_t k = 0; k < Model::n_states; k++) {
+        fg[1 + Model::Row(i, k)] = vars[Model::NextVariable(i, k)] - z1[k];
+      }
+    }
+
+  }
+};
+
+#endif /* FG_EVAL_H */
@@ -0,0 +1,76 @@
+#ifndef FIXED_VECTOR_H
+#define FIXED_VECTOR_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+
+// A vector of at most Capacity values of T held in place, for the short
+// arrays of every tick whose bound is known (the waypoints of a message and
+// the vehicle frame they are fitted in): they live inside the struct that
+// holds them, in the session or on the stack, with no heap block and no
+// pointer to follow. The part of std::vector these take, with the values
+// past size() left as they were; growing past Capacity is a bug, checked
+// by assert, so parsers check the bound first.
+template <class T, size_t Capacity>
+class FixedVector {
+public:
+  static const size_t kCapacity = Capacity;
+
+  FixedVector() = default;
+  template <class Iterator>
+  FixedVector(Iterator first, Iterator last) {
+    assign(first, last);
+  }
+
+  size_t size() const { return size_; }
+  static size_t capacity() { return Capacity; }
+  bool empty() const { return size_ == 0; }
+  bool full() const { return size_ == Capacity; }
+
+  T *data() { return values_; }
+  const T *data() const { return values_; }
+  T *begin() { return values_; }
+  const T *begin() const { return values_; }
+  T *end() { return values_ + size_; }
+  const T *end() const { return values_ + size_; }
+
+  T &operator[](size_t i) { return values_[i]; }
+  const T &operator[](size_t i) const { return values_[i]; }
+  T &front() { return values_[0]; }
+  const T &front() const { return values_[0]; }
+  T &back() { return values_[size_ - 1]; }
+  const T &back() const { return values_[size_ - 1]; }
+
+  void clear() { size_ = 0; }
+  void push_back(const T &value) {
+    assert(size_ < Capacity && "FixedVector is full");
+    values_[size_++] = value;
+  }
+  // The values past the old size are left as they were
+  void resize(size_t n) {
+    assert(n <= Capacity && "FixedVector holds fewer");
+    size_ = n;
+  }
+  template <class Iterator>
+  void assign(Iterator first, Iterator last) {
+    size_ = 0;
+    for (; first != last; ++first) {
+      push_back(static_cast<T>(*first));
+    }
+  }
+
+  bool operator==(const FixedVector &other) const {
+    return size_ == other.size_ && std::equal(begin(), end(), other.begin());
+  }
+  bool operator!=(const FixedVector &other) const { return !(*this == other); }
+
+private:
+  T values_[Capacity];
+  size_t size_ = 0;
+};
+
+template <class T, size_t Capacity>
+const size_t FixedVector<T, Capacity>::kCapacity;
+
+#endif /* FIXED_VECTOR_H */
@@ -0,0 +1,580 @@
+#include "FlightRecorder.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "Log.h"
+
+struct FlightRecorder::Segment {
+  std::string path;
+  char *base;
+  size_t capacity;
+  // The end of the records placed, past the capacity once one didn't fit
+  std::atomic<size_t> used;
+  // Recording into it now
+  std::atomic<unsigned> writers;
+};
+
+namespace {
+
+uint64_t Nanoseconds(std::chrono::steady_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+// The header of the record at at of the size bytes at base, false if there
+// is none
+bool RecordAt(const char *base, size_t size, size_t at, FlightRecordHeader &record) {
+  if (at + sizeof(record) > size) {
+    return false;
+  }
+  std::memcpy(&record, base + at, sizeof(record));
+  return record.size >= sizeof(record) + record.length && record.size <= size - at;
+}
+
+void PutVarint(uint64_t value, std::string &out) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+// The varint at at, advanced past it, false if it runs past end
+bool GetVarint(const char *&at, const char *end, uint64_t &value) {
+  value = 0;
+  for (unsigned shift = 0; at < end && shift < 64; shift += 7) {
+    const uint8_t byte = static_cast<uint8_t>(*at++);
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Small differences of either sign to small numbers
+uint64_t ZigZag(uint64_t to, uint64_t from) {
+  const int64_t difference = static_cast<int64_t>(to - from);
+  return (static_cast<uint64_t>(difference) << 1) ^ static_cast<uint64_t>(difference >> 63);
+}
+
+uint64_t UnZigZag(uint64_t zigzag, uint64_t from) {
+  return from + ((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+}
+
+// The columns of records and their payloads
+void EncodeColumns(const std::vector<FlightRecordHeader> &records,
+                   const std::vector<MessageView> &payloads, std::string &columns) {
+  columns.clear();
+  for (const FlightRecordHeader &record : records) {
+    columns.push_back(static_cast<char>(record.type));
+  }
+  for (const FlightRecordHeader &record : records) {
+    columns.push_back(static_cast<char>(record.format));
+  }
+  for (const FlightRecordHeader &record : records) {
+    PutVarint(record.length, columns);
+  }
+  uint64_t session = 0;
+  uint64_t time = 0;
+  for (const FlightRecordHeader &record : records) {
+    PutVarint(ZigZag(record.session, session), columns);
+    session = record.session;
+  }
+  for (const FlightRecordHeader &record : records) {
+    PutVarint(ZigZag(record.time_ns, time), columns);
+    time = record.time_ns;
+  }
+  for (const FlightRecordHeader &record : records) {
+    PutVarint(record.arrival_ns == 0 ? 0 : 1 + ZigZag(record.arrival_ns, record.time_ns),
+              columns);
+  }
+  for (const MessageView &payload : payloads) {
+    columns.append(payload.data, payload.size());
+  }
+}
+
+// The records of the columns of a chunk of n records appended to out as
+// they are in a segment, false if the columns don't hold them
+bool DecodeColumns(const char *at, const char *end, size_t n, std::string &out) {
+  if (static_cast<size_t>(end - at) < 2 * n) {
+    return false;
+  }
+  std::vector<FlightRecordHeader> records(n);
+  for (size_t k = 0; k < n; k++) {
+    records[k].type = static_cast<uint8_t>(at[k]);
+    records[k].format = static_cast<uint8_t>(at[n + k]);
+  }
+  at += 2 * n;
+  uint64_t value = 0;
+  uint64_t payload_bytes = 0;
+  for (FlightRecordHeader &record : records) {
+    if (!GetVarint(at, end, value) || value > UINT32_MAX) {
+      return false;
+    }
+    record.length = static_cast<uint32_t>(value);
+    payload_bytes += value;
+  }
+  uint64_t session = 0;
+  uint64_t time = 0;
+  for (FlightRecordHeader &record : records) {
+    if (!GetVarint(at, end, value)) {
+      return false;
+    }
+    session = record.session = UnZigZag(value, session);
+  }
+  for (FlightRecordHeader &record : records) {
+    if (!GetVarint(at, end, value)) {
+      return false;
+    }
+    time = record.time_ns = UnZigZag(value, time);
+  }
+  for (FlightRecordHeader &record : records) {
+    if (!GetVarint(at, end, value)) {
+      return false;
+    }
+    record.arrival_ns = value == 0 ? 0 : UnZigZag(value - 1, record.time_ns);
+  }
+  if (static_cast<uint64_t>(end - at) != payload_bytes) {
+    return false;
+  }
+  const char zeros[8] = {};
+  for (FlightRecordHeader &record : records) {
+    record.size = static_cast<uint32_t>((sizeof(record) + record.length + 7) & ~size_t(7));
+    out.append(reinterpret_cast<const char *>(&record), sizeof(record));
+    out.append(at, record.length);
+    out.append(zeros, record.size - sizeof(record) - record.length);
+    at += record.length;
+  }
+  return true;
+}
+
+// The records of the chunks of a compressed segment of size bytes at base,
+// inflated on up to threads threads, after the header of a segment, those
+// of the chunks before the first cut short or corrupt
+std::string Inflate(const char *base, size_t size, size_t threads) {
+  std::vector<FlightChunkHeader> chunks;
+  std::vector<const char *> deflated;
+  for (size_t at = sizeof(FlightSegmentHeader); at + sizeof(FlightChunkHeader) <= size;) {
+    FlightChunkHeader chunk;
+    std::memcpy(&chunk, base + at, sizeof(chunk));
+    at += sizeof(chunk);
+    if (chunk.compressed_bytes > size - at) {
+      break;
+    }
+    chunks.push_back(chunk);
+    deflated.push_back(base + at);
+    at += chunk.compressed_bytes;
+  }
+  std::vector<std::string> parts(chunks.size());
+  std::vector<char> whole(chunks.size(), 0);
+  std::atomic<size_t> next{0};
+  const auto inflate = [&] {
+    std::string columns;
+    for (size_t k = next++; k < chunks.size(); k = next++) {
+      // Each chunk has its columns in a buffer of their own
+      columns.resize(chunks[k].column_bytes);
+      uLongf column_bytes = static_cast<uLongf>(columns.size());
+      whole[k] =
+          uncompress(reinterpret_cast<Bytef *>(&columns[0]), &column_bytes,
+                     reinterpret_cast<const Bytef *>(deflated[k]),
+                     static_cast<uLong>(chunks[k].compressed_bytes)) == Z_OK &&
+          column_bytes == columns.size() &&
+          DecodeColumns(columns.data(), columns.data() + columns.size(), chunks[k].records,
+                        parts[k]);
+    }
+  };
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::min(threads, chunks.size());
+  std::vector<std::thread> inflaters;
+  for (size_t k = 1; k < threads; k++) {
+    inflaters.push_back(std::thread(inflate));
+  }
+  inflate();
+  for (std::thread &thread : inflaters) {
+    thread.join();
+  }
+
+  FlightSegmentHeader header;
+  std::memcpy(&header, base, sizeof(header));
+  header.magic = kFlightMagic;
+  header.version = kFlightVersion;
+  size_t bytes = sizeof(header);
+  size_t n = 0;
+  for (; n < parts.size() && whole[n]; n++) {
+    bytes += parts[n].size();
+  }
+  if (n < parts.size()) {
+    Log(LogLevel::kWarning, "Flight recorder: {} of {} chunks of a compressed segment read", n,
+        parts.size());
+  }
+  std::string records;
+  records.reserve(bytes);
+  records.append(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (size_t k = 0; k < n; k++) {
+    records.append(parts[k]);
+  }
+  return records;
+}
+
+}  // namespace
+
+bool CompressFlightSegment(const std::string &path, const std::string &compressed_path,
+                           std::string &error) {
+  // One thread, the records being laid out already
+  std::unique_ptr<FlightReader> reader = FlightReader::Open(path, 1);
+  if (!reader) {
+    error = "not a flight segment";
+    return false;
+  }
+  std::ofstream out(compressed_path, std::ios::binary | std::ios::trunc);
+  FlightSegmentHeader header = reader->header();
+  header.magic = kFlightCompressedMagic;
+  header.version = kFlightCompressedVersion;
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  std::vector<FlightRecordHeader> records;
+  std::vector<MessageView> payloads;
+  std::string columns;
+  std::string deflated;
+  size_t chunk_bytes = 0;
+  const auto write_chunk = [&]() -> bool {
+    EncodeColumns(records, payloads, columns);
+    uLongf deflated_bytes = compressBound(static_cast<uLong>(columns.size()));
+    deflated.resize(deflated_bytes);
+    if (compress2(reinterpret_cast<Bytef *>(&deflated[0]), &deflated_bytes,
+                  reinterpret_cast<const Bytef *>(columns.data()),
+                  static_cast<uLong>(columns.size()), Z_DEFAULT_COMPRESSION) != Z_OK) {
+      return false;
+    }
+    FlightChunkHeader chunk = {};
+    chunk.records = static_cast<uint32_t>(records.size());
+    chunk.column_bytes = columns.size();
+    chunk.compressed_bytes = deflated_bytes;
+    out.write(reinterpret_cast<const char *>(&chunk), sizeof(chunk));
+    out.write(deflated.data(), static_cast<std::streamsize>(deflated_bytes));
+    records.clear();
+    payloads.clear();
+    chunk_bytes = 0;
+    return true;
+  };
+  FlightRecordHeader record;
+  MessageView payload;
+  while (reader->Next(record, payload)) {
+    if (!records.empty() && chunk_bytes + record.size > kFlightChunkBytes && !write_chunk()) {
+      error = "couldn't deflate a chunk";
+      return false;
+    }
+    records.push_back(record);
+    payloads.push_back(payload);
+    chunk_bytes += record.size;
+  }
+  if (!records.empty() && !write_chunk()) {
+    error = "couldn't deflate a chunk";
+    return false;
+  }
+  out.close();
+  if (!out) {
+    error = "couldn't write " + compressed_path;
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<FlightRecorder> FlightRecorder::Open(const std::string &directory,
+                                                     size_t segment_bytes, size_t keep,
+                                                     bool compress) {
+  if (segment_bytes < sizeof(FlightSegmentHeader) + sizeof(FlightRecordHeader)) {
+    return nullptr;
+  }
+  std::unique_ptr<FlightRecorder> recorder(
+      new FlightRecorder(directory, segment_bytes, keep, compress));
+  Segment *first = recorder->Make(recorder->next_index_++);
+  if (first == nullptr) {
+    return nullptr;
+  }
+  recorder->current_.store(first);
+  recorder->preparer_ = std::thread(&FlightRecorder::Prepare, recorder.get());
+  return recorder;
+}
+
+FlightRecorder::FlightRecorder(const std::string &directory, size_t segment_bytes, size_t keep,
+                               bool compress)
+    : directory_(directory),
+      segment_bytes_(segment_bytes),
+      keep_(keep),
+      compress_(compress),
+      current_(nullptr) {}
+
+FlightRecorder::~FlightRecorder() {
+  if (preparer_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    prepare_.notify_one();
+    preparer_.join();
+  }
+  for (Segment *segment : retired_) {
+    Close(segment);
+  }
+  if (current_.load() != nullptr) {
+    Close(current_.load());
+  }
+  Prune(keep_);
+  if (spare_ != nullptr) {
+    // Made ready and never written
+    munmap(spare_->base, spare_->capacity);
+    unlink(spare_->path.c_str());
+    delete spare_;
+  }
+  for (Segment *segment : free_) {
+    delete segment;
+  }
+}
+
+bool FlightRecorder::Record(FlightRecordType type, WireFormat format, uint64_t session,
+                            std::chrono::steady_clock::time_point time,
+                            const MessageView &payload,
+                            std::chrono::steady_clock::time_point arrival) {
+  const size_t size = (sizeof(FlightRecordHeader) + payload.size() + 7) & ~size_t(7);
+  if (size > segment_bytes_ - sizeof(FlightSegmentHeader)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  for (;;) {
+    Segment *segment = current_.load();
+    // Counted in before it is looked at again, so that Close waits for
+    // this write unless the segment was already replaced
+    segment->writers.fetch_add(1);
+    if (segment == current_.load()) {
+      const size_t at = segment->used.fetch_add(size, std::memory_order_relaxed);
+      if (at + size <= segment->capacity) {
+        FlightRecordHeader header = {};
+        header.type = static_cast<uint16_t>(type);
+        header.format = static_cast<uint8_t>(format);
+        header.length = static_cast<uint32_t>(payload.size());
+        header.session = session;
+        header.time_ns = Nanoseconds(time);
+        header.arrival_ns = Nanoseconds(arrival);
+        char *record = segment->base + at;
+        std::memcpy(record + sizeof(header.size),
+                    reinterpret_cast<const char *>(&header) + sizeof(header.size),
+                    sizeof(header) - sizeof(header.size));
+        std::memcpy(record + sizeof(header), payload.data, payload.size());
+        // The size last, so that the records of a process that died end at
+        // the last one written whole
+        const uint32_t record_size = static_cast<uint32_t>(size);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(record, &record_size, sizeof(record_size));
+        segment->writers.fetch_sub(1, std::memory_order_release);
+        records_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    segment->writers.fetch_sub(1, std::memory_order_release);
+    if (!Rotate(segment)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  }
+}
+
+bool FlightRecorder::Rotate(Segment *full) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (current_.load() != full) {
+    return true;
+  }
+  if (spare_ == nullptr) {
+    return false;
+  }
+  current_.store(spare_);
+  spare_ = nullptr;
+  retired_.push_back(full);
+  prepare_.notify_one();
+  return true;
+}
+
+FlightRecorder::Segment *FlightRecorder::Make(uint64_t index) {
+  char name[64];
+  std::snprintf(name, sizeof(name), "/flight-%ld-%06llu.rec", static_cast<long>(getpid()),
+                static_cast<unsigned long long>(index));
+  const std::string path = directory_ + name;
+  const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return nullptr;
+  }
+  void *memory = MAP_FAILED;
+  if (ftruncate(fd, static_cast<off_t>(segment_bytes_)) == 0) {
+    memory = mmap(nullptr, segment_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (memory == MAP_FAILED) {
+    unlink(path.c_str());
+    return nullptr;
+  }
+  // Every page written once here rather than faulted in by a record
+  volatile char *base = static_cast<volatile char *>(memory);
+  const long page = sysconf(_SC_PAGESIZE);
+  for (size_t k = 0; k < segment_bytes_; k += page > 0 ? static_cast<size_t>(page) : 4096) {
+    base[k] = 0;
+  }
+  FlightSegmentHeader header = {};
+  header.magic = kFlightMagic;
+  header.version = kFlightVersion;
+  header.index = index;
+  header.pid = static_cast<uint64_t>(getpid());
+  header.steady_ns = Nanoseconds(std::chrono::steady_clock::now());
+  header.system_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+  std::memcpy(memory, &header, sizeof(header));
+  Segment *segment = free_.empty() ? new Segment() : free_.front();
+  if (!free_.empty()) {
+    free_.pop_front();
+  }
+  segment->path = path;
+  segment->base = static_cast<char *>(memory);
+  segment->capacity = segment_bytes_;
+  segment->used.store(sizeof(header));
+  segment->writers.store(0);
+  return segment;
+}
+
+void FlightRecorder::Close(Segment *segment) {
+  // The writers that saw it still current copy a record at most
+  while (segment->writers.load(std::memory_order_acquire) != 0) {
+    std::this_thread::yield();
+  }
+  size_t end = sizeof(FlightSegmentHeader);
+  FlightRecordHeader record;
+  while (RecordAt(segment->base, segment->capacity, end, record)) {
+    end += record.size;
+  }
+  munmap(segment->base, segment->capacity);
+  if (truncate(segment->path.c_str(), static_cast<off_t>(end)) != 0) {
+    Log(LogLevel::kWarning, "Flight recorder: couldn't cut {} to its records", segment->path);
+  }
+  std::string error;
+  const std::string compressed_path = segment->path + "z";
+  if (!compress_) {
+    closed_.push_back(segment->path);
+  } else if (CompressFlightSegment(segment->path, compressed_path, error)) {
+    unlink(segment->path.c_str());
+    closed_.push_back(compressed_path);
+  } else {
+    // The segment as it is rather than none
+    Log(LogLevel::kWarning, "Flight recorder: couldn't compress {}, {}", segment->path, error);
+    unlink(compressed_path.c_str());
+    closed_.push_back(segment->path);
+  }
+  free_.push_back(segment);
+}
+
+void FlightRecorder::Prune(size_t n) {
+  while (keep_ > 0 && closed_.size() > n) {
+    unlink(closed_.front().c_str());
+    closed_.pop_front();
+  }
+}
+
+void FlightRecorder::Prepare() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  bool made = true;
+  while (!stopping_) {
+    // The next segment first, ready before the one being written fills up
+    // while a full one is compressed
+    if (spare_ == nullptr && made) {
+      const uint64_t index = next_index_++;
+      lock.unlock();
+      Segment *segment = Make(index);
+      lock.lock();
+      spare_ = segment;
+      made = segment != nullptr;
+      if (!made) {
+        Log(LogLevel::kWarning, "Flight recorder: couldn't make segment {} in {}", index,
+            directory_);
+      }
+    } else if (!retired_.empty()) {
+      Segment *segment = retired_.front();
+      retired_.pop_front();
+      lock.unlock();
+      Close(segment);
+      // The one being written is kept too
+      Prune(keep_ - 1);
+      lock.lock();
+    } else if (spare_ == nullptr) {
+      // Tried again a second after it failed
+      prepare_.wait_for(lock, std::chrono::seconds(1));
+      made = true;
+    } else {
+      prepare_.wait(lock);
+    }
+  }
+}
+
+std::unique_ptr<FlightReader> FlightReader::Open(const std::string &path, size_t threads) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat status;
+  void *memory = MAP_FAILED;
+  size_t size = 0;
+  if (fstat(fd, &status) == 0 &&
+      static_cast<size_t>(status.st_size) >= sizeof(FlightSegmentHeader)) {
+    size = static_cast<size_t>(status.st_size);
+    memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (memory == MAP_FAILED) {
+    return nullptr;
+  }
+  const FlightSegmentHeader *header = static_cast<const FlightSegmentHeader *>(memory);
+  if (header->magic == kFlightCompressedMagic && header->version == kFlightCompressedVersion) {
+    std::string inflated = Inflate(static_cast<const char *>(memory), size, threads);
+    munmap(memory, size);
+    return std::unique_ptr<FlightReader>(new FlightReader(std::move(inflated)));
+  }
+  if (header->magic != kFlightMagic || header->version != kFlightVersion) {
+    munmap(memory, size);
+    return nullptr;
+  }
+  return std::unique_ptr<FlightReader>(new FlightReader(static_cast<const char *>(memory), size));
+}
+
+FlightReader::FlightReader(const char *base, size_t size)
+    : base_(base),
+      size_(size),
+      header_(reinterpret_cast<const FlightSegmentHeader *>(base)),
+      at_(sizeof(FlightSegmentHeader)) {}
+
+FlightReader::FlightReader(std::string inflated)
+    : inflated_(std::move(inflated)),
+      base_(inflated_.data()),
+      size_(inflated_.size()),
+      header_(reinterpret_cast<const FlightSegmentHeader *>(base_)),
+      at_(sizeof(FlightSegmentHeader)) {}
+
+FlightReader::~FlightReader() {
+  if (inflated_.empty()) {
+    munmap(const_cast<char *>(base_), size_);
+  }
+}
+
+bool FlightReader::Next(FlightRecordHeader &record, MessageView &payload) {
+  if (!RecordAt(base_, size_, at_, record)) {
+    return false;
+  }
+  payload = MessageView(base_ + at_ + sizeof(record), record.length);
+  at_ += record.size;
+  return true;
+}
@@ -0,0 +1,211 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "MessagePack.h"
+#include "MessageView.h"
+
+// Every telemetry frame that came in and every command that went out, as
+// they were on the wire, with the time of each in nanoseconds, for the
+// problems of a server in production to be replayed offline.
+//
+// The records are appended to segments, files of a fixed size mapped into
+// memory: a record takes its place with an atomic add on the end of the
+// segment and is copied in, so recording makes no system call and, the
+// pages of a segment faulted in as it is made, takes no page fault either;
+// any thread records at once. A background thread keeps the next segment
+// ready, and closes each once it is full and replaced, cut to the records
+// it holds, deleting the oldest beyond those to keep. A record that comes
+// while no segment is ready is dropped and counted instead of waiting.
+//
+// A segment is a FlightSegmentHeader, then the records one after another,
+// each a FlightRecordHeader, its payload and zeros up to 8 bytes; the
+// records end at a header of size 0 or at the end of the file. The fields
+// are in the byte order of the host.
+//
+// A recorder made with compress writes each segment it closes again, on
+// its background thread, as a compressed segment next to it (".recz" for
+// ".rec") and removes the first, so what stays on disk is the compressed
+// ones; CompressFlightSegment does the same to a segment already written.
+// A compressed segment is the FlightSegmentHeader of the segment under
+// kFlightCompressedMagic, then chunks of up to kFlightChunkBytes of
+// records, each a FlightChunkHeader and its columns deflated by zlib on
+// their own, so that a reader inflates the chunks on as many threads as it
+// has. The columns of a chunk are those of the record headers, one after
+// another, then the payloads: the types and formats a byte each, then as
+// LEB128 varints the lengths, the sessions and the times each as the
+// zigzag of its difference from the one before, and the arrivals as 1 +
+// the zigzag of their difference from the time of their record, 0 for
+// none; numbers that change little from one record to the next, which
+// deflate makes a few bits of. The payloads are kept as they were, for the
+// replay to decode them as the server did.
+
+// "MPCF", and the version of the layout
+const uint32_t kFlightMagic = 0x4643504d;
+const uint32_t kFlightVersion = 2;
+
+// "MPCZ", and the version of the layout of the chunks
+const uint32_t kFlightCompressedMagic = 0x5a43504d;
+const uint32_t kFlightCompressedVersion = 1;
+
+// The records of a chunk of a compressed segment, at most
+const size_t kFlightChunkBytes = 1 << 20;
+
+enum class FlightRecordType : uint16_t { kTelemetry = 1, kCommand = 2 };
+
+struct FlightSegmentHeader {
+  uint32_t magic;
+  uint32_t version;
+  // Of the segment among those of the process, from 0
+  uint64_t index;
+  uint64_t pid;
+  // The steady clock of the records and the wall clock at the same moment,
+  // in ns, to place them in time
+  uint64_t steady_ns;
+  uint64_t system_ns;
+  uint64_t reserved[3];
+};
+
+struct FlightRecordHeader {
+  // Bytes of the record, the header and padding included, written last
+  uint32_t size;
+  uint16_t type;
+  // The WireFormat of the payload
+  uint8_t format;
+  uint8_t reserved;
+  uint32_t length;
+  uint32_t reserved2;
+  // The session of the connection (see Session::id)
+  uint64_t session;
+  // On the steady clock, in ns: the arrival of a telemetry frame, the
+  // start of the send of a command
+  uint64_t time_ns;
+  // Of a command, the arrival of the telemetry it answers, to pair them;
+  // 0 for telemetry
+  uint64_t arrival_ns;
+};
+
+struct FlightChunkHeader {
+  uint32_t records;
+  uint32_t reserved;
+  // Bytes of the columns, and of them deflated, which follow
+  uint64_t column_bytes;
+  uint64_t compressed_bytes;
+};
+
+static_assert(sizeof(FlightSegmentHeader) == 64, "The segment header is a cache line");
+static_assert(sizeof(FlightChunkHeader) == 24, "The chunks are aligned to 8 bytes");
+static_assert(sizeof(FlightRecordHeader) == 40, "The records are aligned to 8 bytes");
+
+class FlightRecorder {
+ public:
+  // Record into segments of segment_bytes in directory, keeping the newest
+  // keep of them, 0 for all, compressed once closed with compress. Null if
+  // the first segment can't be made.
+  static std::unique_ptr<FlightRecorder> Open(const std::string &directory,
+                                              size_t segment_bytes, size_t keep,
+                                              bool compress = false);
+  // The segment being written closed, the one made ready removed
+  ~FlightRecorder();
+  FlightRecorder(const FlightRecorder &) = delete;
+  FlightRecorder &operator=(const FlightRecorder &) = delete;
+
+  // Append a record of payload, false if it was dropped; arrival is that of
+  // the telemetry a command answers
+  bool Record(FlightRecordType type, WireFormat format, uint64_t session,
+              std::chrono::steady_clock::time_point time, const MessageView &payload,
+              std::chrono::steady_clock::time_point arrival =
+                  std::chrono::steady_clock::time_point());
+
+  uint64_t records() const { return records_.load(std::memory_order_relaxed); }
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  struct Segment;
+
+  FlightRecorder(const std::string &directory, size_t segment_bytes, size_t keep, bool compress);
+
+  // A new segment of the next index, mapped and faulted in; null on failure
+  Segment *Make(uint64_t index);
+  // Unmap segment once its writers are done and cut its file to its
+  // records, or compress it with compress_
+  void Close(Segment *segment);
+  // Remove the oldest files closed beyond n
+  void Prune(size_t n);
+  // Put the segment ready in place of full, unless another writer already
+  // did; false if none is ready
+  bool Rotate(Segment *full);
+  // Of the background thread
+  void Prepare();
+
+  const std::string directory_;
+  const size_t segment_bytes_;
+  const size_t keep_;
+  const bool compress_;
+  std::atomic<Segment *> current_;
+  std::atomic<uint64_t> records_{0};
+  std::atomic<uint64_t> dropped_{0};
+
+  // Under mutex_
+  std::mutex mutex_;
+  std::condition_variable prepare_;
+  Segment *spare_ = nullptr;
+  std::deque<Segment *> retired_;
+  uint64_t next_index_ = 0;
+  bool stopping_ = false;
+  // Of the background thread: the files closed, and the segments that were,
+  // made again rather than freed, since a writer may still be about to
+  // count itself into one
+  std::deque<std::string> closed_;
+  std::deque<Segment *> free_;
+  std::thread preparer_;
+};
+
+// Write the segment at path as a compressed segment to compressed_path,
+// false with the reason in error if it can't be. The records are those a
+// FlightReader reads of it.
+bool CompressFlightSegment(const std::string &path, const std::string &compressed_path,
+                           std::string &error);
+
+// The records of a segment, read through a mapping of its file, or of a
+// compressed segment, inflated into memory as it is opened
+class FlightReader {
+ public:
+  // Null if path isn't a segment of this version, compressed or not. The
+  // chunks of a compressed one are inflated on up to threads threads, 0 for
+  // one a core; those past a chunk cut short or corrupt are dropped, as the
+  // records past one cut short of a segment are.
+  static std::unique_ptr<FlightReader> Open(const std::string &path, size_t threads = 0);
+  ~FlightReader();
+  FlightReader(const FlightReader &) = delete;
+  FlightReader &operator=(const FlightReader &) = delete;
+
+  const FlightSegmentHeader &header() const { return *header_; }
+  // The next record and a view of its payload in the mapping, false past
+  // the last
+  bool Next(FlightRecordHeader &record, MessageView &payload);
+
+ private:
+  FlightReader(const char *base, size_t size);
+  // Over the records inflated from a compressed segment, in the layout of
+  // a segment
+  explicit FlightReader(std::string inflated);
+
+  // Those of the segment inflated, empty for a mapping
+  std::string inflated_;
+  const char *base_;
+  size_t size_;
+  const FlightSegmentHeader *header_;
+  size_t at_;
+};
+
+#endif /* FLIGHT_RECORDER_H */
@@ -0,0 +1,91 @@
+#include "FrenetReference.h"
+#include <algorithm>
+
+namespace {
+
+// Distance along the track behind the vehicle where the samples start, in m
+const double kBehind = 10;
+
+// Curvature of the track at p and its rate by the distance along it
+void Curvature(const TrackPoint &p, double &kappa, double &dkappa) {
+  const double speed2 = p.dx * p.dx + p.dy * p.dy;
+  const double speed = std::sqrt(speed2);
+  const double cross = p.dx * p.ddy - p.dy * p.ddx;
+  const double dcross = p.dx * p.dddy - p.dy * p.dddx;
+  const double dspeed = (p.dx * p.ddx + p.dy * p.ddy) / speed;
+  kappa = cross / (speed2 * speed);
+  dkappa = (dcross - 3 * cross * dspeed / speed) / (speed2 * speed * speed);
+}
+
+}  // namespace
+
+FrenetReference::FrenetReference(const TrackSpline &track, double s, double look_ahead,
+                                 double spacing)
+    : track_(track), front_(-kBehind) {
+  Build(s, look_ahead, spacing);
+}
+
+void FrenetReference::Build(double s, double look_ahead, double spacing) {
+  s0_ = s;
+  spacing_ = spacing;
+  kappa_.clear();
+  dkappa_.clear();
+  for (double d = front_; d <= look_ahead + spacing; d += spacing) {
+    double kappa;
+    double dkappa;
+    ::Curvature(track_.At(s + d), kappa, dkappa);
+    kappa_.push_back(kappa);
+    dkappa_.push_back(dkappa);
+  }
+}
+
+void FrenetReference::At(double s, double &kappa, double &dkappa) const {
+  const double t = (s - front_) / spacing_;
+  if (t <= 0 || t >= kappa_.size() - 1) {
+    const size_t k = t <= 0 ? 0 : kappa_.size() - 1;
+    kappa = kappa_[k];
+    dkappa = 0;
+    return;
+  }
+  const size_t k = static_cast<size_t>(t);
+  const double h = spacing_;
+  const double u = t - k;
+  const double u2 = u * u;
+  const double u3 = u2 * u;
+  // Hermite basis and its derivative by u
+  const double h00 = 2 * u3 - 3 * u2 + 1;
+  const double h10 = u3 - 2 * u2 + u;
+  const double h01 = 3 * u2 - 2 * u3;
+  const double h11 = u3 - u2;
+  const double d00 = 6 * u2 - 6 * u;
+  const double d10 = 3 * u2 - 4 * u + 1;
+  const double d11 = 3 * u2 - 2 * u;
+  kappa = h00 * kappa_[k] + h10 * h * dkappa_[k] + h01 * kappa_[k + 1] + h11 * h * dkappa_[k + 1];
+  dkappa = (d00 * (kappa_[k] - kappa_[k + 1])) / h + d10 * dkappa_[k] + d11 * dkappa_[k + 1];
+}
+
+double FrenetReference::Curvature(double s) const {
+  double kappa;
+  double dkappa;
+  At(s, kappa, dkappa);
+  return kappa;
+}
+
+MPCState FrenetReference::State(const TrackSpline &track, double px, double py, double psi,
+                                double v, double s) {
+  const TrackPoint p = track.At(s);
+  const double speed = std::hypot(p.dx, p.dy);
+  // Offset to the left of the tangent, and the heading relative to it
+  const double d = (p.dx * (py - p.y) - p.dy * (px - p.x)) / speed;
+  const double mu = std::remainder(psi - std::atan2(p.dy, p.dx), 2 * M_PI);
+  MPCState z;
+  z << 0, d, mu, v, -d, mu;
+  return z;
+}
+
+void FrenetReference::Position(double s, double d, double &x, double &y) const {
+  const TrackPoint p = track_.At(s0_ + s);
+  const double speed = std::hypot(p.dx, p.dy);
+  x = p.x - d * p.dy / speed;
+  y = p.y + d * p.dx / speed;
+}
@@ -0,0 +1,145 @@
+#ifndef FRENET_REFERENCE_H
+#define FRENET_REFERENCE_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "KinematicModel.h"
+#include "TrackSpline.h"
+
+// The track ahead of the vehicle for the model in path coordinates: its
+// curvature over the distance along it, sampled every spacing meters from a
+// little behind the vehicle's projection to look_ahead ahead of it and
+// interpolated by cubic Hermite pieces of the curvature and its rate at the
+// samples, so that the rate the linearization takes is the exact
+// derivative (see ReferenceTable).
+//
+// In path coordinates the model state keeps the layout of ModelStep, z =
+// [s, d, mu, v, cte, epsi]: the progress s along the track from the
+// projection of the vehicle, the offset d to the left of it, the heading
+// mu relative to its tangent, and cte = -d and epsi = mu for the cost. The
+// kinematic bicycle then moves along the track by
+//
+//   ds/dt = v cos(mu) / (1 - kappa(s) d),  dd/dt = v sin(mu),
+//   dmu/dt = -v delta / Lf - kappa(s) ds/dt
+//
+// which is exactly the model of a straight road where the track is
+// straight and about linear in d and mu near it: no polynomial, no atan
+// and no heading of the reference, only a curvature per stage. One is built
+// per tick from the projection of its telemetry, see
+// MPCBase::frenet_reference, or rebuilt in place along the same track by
+// Build, without allocating.
+class FrenetReference {
+public:
+  // The track from s along it, the distance of the vehicle (see
+  // TrackSpline::Project)
+  FrenetReference(const TrackSpline &track, double s, double look_ahead = 100,
+                  double spacing = 1);
+
+  // The reference of the constructor from s along the same track, in place
+  // of this one
+  void Build(double s, double look_ahead = 100, double spacing = 1);
+
+  // Curvature at progress s from the vehicle's projection, and its rate by
+  // s; the curvature of the first or the last sample past the ends
+  void At(double s, double &kappa, double &dkappa) const;
+  double Curvature(double s) const;
+
+  // The state in path coordinates of the vehicle at (px, py) heading psi at
+  // speed v, projected at s along track
+  static MPCState State(const TrackSpline &track, double px, double py, double psi, double v,
+                        double s);
+
+  // The point of offset d at progress s from the vehicle's projection, in
+  // the map frame
+  void Position(double s, double d, double &x, double &y) const;
+
+private:
+  const TrackSpline &track_;
+  double s0_;
+  double front_;
+  double spacing_;
+  std::vector<double> kappa_;
+  std::vector<double> dkappa_;
+};
+
+// Rates of change of z = [s, d, mu, v, cte, epsi] in path coordinates, see
+// FrenetReference
+inline void FrenetRates(const double *z, double delta, double a,
+                        const FrenetReference &reference, double *rates) {
+  const double kappa = reference.Curvature(z[0]);
+  const double s_rate = z[3] * std::cos(z[2]) / (1 - kappa * z[1]);
+  const double d_rate = z[3] * std::sin(z[2]);
+  const double mu_rate = -z[3] * delta / Lf - kappa * s_rate;
+  rates[0] = s_rate;
+  rates[1] = d_rate;
+  rates[2] = mu_rate;
+  rates[3] = a;
+  rates[4] = -d_rate;
+  rates[5] = mu_rate;
+}
+
+// ModelStep in path coordinates, in place of the polynomial's. In doubles
+// only: the curvature is a table. The rates are those of the kinematic
+// model whatever Vehicle, which only keeps the template arguments of the
+// polynomial's.
+template <Integrator I, class Vehicle = KinematicBicycle>
+inline void ModelStep(const double *z, const double &delta, const double &a,
+                      const FrenetReference &reference, double dt, double *z1) {
+  for (size_t i = 0; i < 6; i++) {
+    z1[i] = z[i];
+  }
+  Integrate<I>(z1,
+               [&delta, &a, &reference](const double *s, double *rates) {
+                 FrenetRates(s, delta, a, reference, rates);
+               },
+               dt);
+}
+
+// Closed form Jacobians of the Euler ModelStep in path coordinates at
+// (z, delta), like ModelJacobian of the polynomial's
+inline void ModelJacobian(const MPCState &z, double delta, const FrenetReference &reference,
+                          double dt, StateJacobian &A, ActuationJacobian &B) {
+  double kappa;
+  double dkappa;
+  reference.At(z[0], kappa, dkappa);
+  const double d = z[1];
+  const double c = std::cos(z[2]);
+  const double sn = std::sin(z[2]);
+  const double v = z[3];
+  const double g = 1 / (1 - kappa * d);
+
+  // Rates of ds/dt and of the curvature term kappa ds/dt of dmu/dt by s, d,
+  // mu and v
+  const double s_s = v * c * dkappa * d * g * g;
+  const double s_d = v * c * kappa * g * g;
+  const double s_mu = -v * sn * g;
+  const double s_v = c * g;
+  const double q_s = v * c * dkappa * g * g;
+  const double q_d = kappa * s_d;
+  const double q_mu = kappa * s_mu;
+  const double q_v = kappa * s_v;
+
+  A.setIdentity();
+  A(0, 0) += s_s * dt;
+  A(0, 1) = s_d * dt;
+  A(0, 2) = s_mu * dt;
+  A(0, 3) = s_v * dt;
+  A(1, 2) = v * c * dt;
+  A(1, 3) = sn * dt;
+  for (int row : {2, 5}) {
+    A(row, 0) = -q_s * dt;
+    A(row, 1) = -q_d * dt;
+    A(row, 2) -= q_mu * dt;
+    A(row, 3) = (-delta / Lf - q_v) * dt;
+  }
+  A(4, 2) = -v * c * dt;
+  A(4, 3) = -sn * dt;
+
+  B.setZero();
+  B(2, 0) = -v / Lf * dt;
+  B(3, 1) = dt;
+  B(5, 0) = -v / Lf * dt;
+}
+
+#endif /* FRENET_REFERENCE_H */
@@ -0,0 +1,221 @@
+#ifndef HORIZON_H
+#define HORIZON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ratio>
+#include "Eigen-3.3/Eigen/Core"
+
+// Initial state [x,y,psi,v,cte,epsi] and cubic polynomial coefficients
+// handed to MPC::Solve
+typedef Eigen::Matrix<double, 6, 1> MPCState;
+typedef Eigen::Matrix<double, 4, 1> MPCCoeffs;
+
+// Move blocking: delta and a are held constant over blocks of consecutive
+// stages, from the present on. L are the block lengths in stages and must add
+// up to the N - 1 actuated stages, e.g. MoveBlocks<1, 1, 2, 2, 4, 4> for
+// N = 15. Fewer actuator variables make a smaller KKT system, so a horizon
+// can be longer at the same solve cost.
+template <size_t... L>
+struct MoveBlocks {};
+
+// One block per stage
+struct NoBlocking {};
+
+// Map between the n_stages actuated stages and the blocks of B
+template <class B, size_t n_stages>
+struct BlockLayout;
+
+template <size_t n_stages>
+struct BlockLayout<NoBlocking, n_stages> {
+  static constexpr size_t n_blocks = n_stages;
+
+  static constexpr size_t block(size_t t) { return t; }
+  static constexpr size_t first_stage(size_t b) { return b; }
+};
+
+template <size_t n_stages, size_t... L>
+struct BlockLayout<MoveBlocks<L...>, n_stages> {
+  static constexpr size_t n_blocks = sizeof...(L);
+  static constexpr size_t lengths[n_blocks] = {L...};
+
+  // Block holding stage t (< n_stages)
+  static constexpr size_t block(size_t t, size_t b = 0) {
+    return t < lengths[b] ? b : block(t - lengths[b], b + 1);
+  }
+  // First stage of block b (<= n_blocks)
+  static constexpr size_t first_stage(size_t b) {
+    return b == 0 ? 0 : first_stage(b - 1) + lengths[b - 1];
+  }
+};
+
+template <size_t n_stages, size_t... L>
+constexpr size_t BlockLayout<MoveBlocks<L...>, n_stages>::lengths[];
+
+// Non-uniform timesteps, in place of the std::ratio of a uniform horizon:
+// stage t is integrated over Ms[t] milliseconds. The near stages can be
+// short and the far, low weight ones long, e.g.
+// StepSchedule<50, 50, 50, 100, 100, 150, 200, 250, 250, 300> looks 1.5 s
+// ahead in 11 stages where 0.1 s steps take 16.
+template <size_t... Ms>
+struct StepSchedule {};
+
+// Length of each of the n_steps steps of Dt, a std::ratio or a StepSchedule
+template <class Dt, size_t n_steps>
+struct StepLayout;
+
+template <intmax_t Num, intmax_t Den, size_t n_steps>
+struct StepLayout<std::ratio<Num, Den>, n_steps> {
+  static constexpr double step(size_t) { return static_cast<double>(Num) / Den; }
+};
+
+template <size_t n_steps, size_t... Ms>
+struct StepLayout<StepSchedule<Ms...>, n_steps> {
+  static_assert(sizeof...(Ms) == n_steps, "a StepSchedule needs one step per actuated stage");
+  static constexpr double steps[n_steps] = {Ms / 1000.0 ...};
+
+  static constexpr double step(size_t t) { return steps[t]; }
+};
+
+template <size_t n_steps, size_t... Ms>
+constexpr double StepLayout<StepSchedule<Ms...>, n_steps>::steps[];
+
+// Numerical integration of the model over one timestep (see IntegrateModel
+// in KinematicModel.h)
+enum class Integrator {
+  // Explicit Euler, the model the cost is tuned with: one evaluation of the
+  // rates per step
+  kEuler,
+  // Explicit midpoint, second order: two evaluations
+  kMidpoint,
+  // Classic Runge-Kutta, fourth order: four evaluations
+  kRK4
+};
+
+// The vehicle models of KinematicModel.h
+struct KinematicBicycle;
+struct DynamicBicycle;
+
+// Longest horizon any MPC is instantiated for, the capacity of MPCSolution
+const size_t kMaxHorizon = 40;
+
+// Timestep length and duration of the prediction horizon, fixed at compile
+// time. Every container of a horizon is sized from these constants, so the
+// stage loops unroll and no solve touches the heap for its layout.
+//
+// Dt is a std::ratio in seconds, e.g. std::ratio<1, 10> for 0.1 s, or a
+// StepSchedule of steps growing along the horizon. Blocks_
+// is NoBlocking or a MoveBlocks, and sets how many actuator variables there
+// are. A higher order I_ keeps the prediction accurate over longer steps, so
+// the same look ahead takes fewer stages. Vehicle_ is the model the stages
+// follow (see KinematicModel.h).
+template <size_t N_, class Dt_ = std::ratio<1, 10>, class Blocks_ = NoBlocking,
+          Integrator I_ = Integrator::kEuler, class Vehicle_ = KinematicBicycle>
+struct Horizon {
+  static_assert(N_ >= 3, "the cost needs at least two actuator steps");
+  static_assert(N_ <= kMaxHorizon, "MPCSolution holds up to kMaxHorizon stages");
+
+  typedef BlockLayout<Blocks_, N_ - 1> Blocks;
+  static_assert(Blocks::first_stage(Blocks::n_blocks) == N_ - 1,
+                "the block lengths must add up to the N - 1 actuated stages");
+
+  // size_t: type returned by sizeof, widely used to represent sizes and counts
+  static constexpr size_t N = N_;
+  // Length of the step from stage t to t + 1, and time of stage t from the
+  // initial state, in seconds
+  static constexpr double step(size_t t) { return StepLayout<Dt_, N_ - 1>::step(t); }
+  static constexpr double time(size_t t) { return t == 0 ? 0 : time(t - 1) + step(t - 1); }
+  // The first step, which the plan is shifted by from one tick to the next
+  static constexpr double dt = step(0);
+  static constexpr Integrator integrator = I_;
+  typedef Vehicle_ Vehicle;
+  // Number of values of each actuator, N - 1 without blocking
+  static constexpr size_t n_blocks = Blocks::n_blocks;
+
+  // Offset of the actuations of stage t from delta_start or a_start
+  static constexpr size_t block(size_t t) { return Blocks::block(t); }
+  static constexpr size_t first_stage(size_t b) { return Blocks::first_stage(b); }
+  // Block whose actuations seed block b once a plan is shifted one stage
+  // towards the present, holding the last stage
+  static constexpr size_t shifted_block(size_t b) {
+    return block(first_stage(b) + 1 < N_ - 1 ? first_stage(b) + 1 : N_ - 2);
+  }
+
+  // Mark when each variable starts for convenience
+  // since state and actuator variables are stored in one vector
+  // in the format 'x...(N)x y...(N)y...', then 'delta...(n_blocks)delta
+  // a...(n_blocks)a'
+  static constexpr size_t x_start = 0;
+  static constexpr size_t y_start = x_start + N;
+  static constexpr size_t psi_start = y_start + N;
+  static constexpr size_t v_start = psi_start + N;
+  static constexpr size_t cte_start = v_start + N;
+  static constexpr size_t epsi_start = cte_start + N;
+  static constexpr size_t delta_start = epsi_start + N;
+  static constexpr size_t a_start = delta_start + n_blocks;
+
+  // Number of model variables (includes both states and inputs).
+  // For example: If the state is a 4 element vector, the actuators is a 2
+  // element vector and there are 10 timesteps. The number of variables is:
+  //
+  // 4 * 10 + 2 * 9
+  // State: [x,y,psi,v,cte,epsi]
+  // Actuators: [delta,a], one per block
+  static constexpr size_t n_vars = 6 * N + 2 * n_blocks;
+  // Number of constraints: the dynamics between neighbouring stages. The
+  // first stage is pinned to the measured state by its bounds, so it has no
+  // rows (see MPC_NLP::get_bounds_info).
+  static constexpr size_t n_constraints = 6 * (N - 1);
+  // Row of the constraint of state k ([x,y,psi,v,cte,epsi]) from stage t to
+  // t + 1, rows are stored like the states without the first stage
+  static constexpr size_t constraint_row(size_t k, size_t t) { return k * (N - 1) + t; }
+};
+
+template <size_t N_, class Dt_, class B_, Integrator I_, class V_> constexpr size_t Horizon<N_, Dt_, B_, I_, V_>::N;
+template <size_t N_, class Dt_, class B_, Integrator I_, class V_> constexpr double Horizon<N_, Dt_, B_, I_, V_>::dt;
+template <size_t N_, class Dt_, class B_, Integrator I_, class V_>
+constexpr Integrator Horizon<N_, Dt_, B_, I_, V_>::integrator;
+template <size_t N_, class Dt_, class B_, Integrator I_, class V_> constexpr size_t Horizon<N_, Dt_, B_, I_, V_>::n_blocks;
+template <size_t N_, class Dt_, class B_, Integrator I_, class V_> constexpr size_t Horizon<N_, Dt_, B_, I_, V_>::x_start;
+template <size_t N_, class Dt_, class B_, Integrator I_, class V_> constexpr size_t Horizon<N_, Dt_, B_, I_, V_>::y_start;
+template <size_t N_, class Dt_, class B_, Integrator I_, class V_> constexpr size_t Horizon<N_, Dt_, B_, I_, V_>::psi_start;
+template <size_t N_, class Dt_, class B_, Integrator I_, class V_> constexpr size_t Horizon<N_, Dt_, B_, I_, V_>::v_start;
+template <size_t N_, class Dt_, class B_, Integrator I_, class V_> constexpr size_t Horizon<N_, Dt_, B_, I_, V_>::cte_start;
+template <size_t N_, class Dt_, class B_, Integrator I_, class V_> constexpr size_t Horizon<N_, Dt_, B_, I_, V_>::epsi_start;
+template <size_t N_, class Dt_, class B_, Integrator I_, class V_> constexpr size_t Horizon<N_, Dt_, B_, I_, V_>::delta_start;
+template <size_t N_, class Dt_, class B_, Integrator I_, class V_> constexpr size_t Horizon<N_, Dt_, B_, I_, V_>::a_start;
+template <size_t N_, class Dt_, class B_, Integrator I_, class V_> constexpr size_t Horizon<N_, Dt_, B_, I_, V_>::n_vars;
+template <size_t N_, class Dt_, class B_, Integrator I_, class V_> constexpr size_t Horizon<N_, Dt_, B_, I_, V_>::n_constraints;
+
+// Horizons compiled into the binary, see MakeMPC.
+// N = 15 with dt = 0.1 is the tuned default (see README).
+typedef Horizon<10> Horizon10;
+typedef Horizon<15> Horizon15;
+typedef Horizon<25> Horizon25;
+// 4 s ahead for high speed runs, with the derivatives in chunks (see
+// ChunkedTapes)
+typedef Horizon<40> Horizon40;
+// Coarser steps for a longer look ahead at speed, see MakeAdaptiveMPC
+typedef Horizon<15, std::ratio<3, 20> > Horizon15Coarse;
+// The look ahead of Horizon15 in half the stages, accurate enough with RK4
+// (see benchmark_integrators.cpp)
+typedef Horizon<8, std::ratio<1, 5>, NoBlocking, Integrator::kRK4> Horizon8RK4;
+// The 1.5 s look ahead in 11 stages, fine near the car and coarse at the
+// tail (see StepSchedule)
+typedef StepSchedule<50, 50, 50, 100, 100, 150, 200, 250, 250, 300> GradedSteps;
+typedef Horizon<11, GradedSteps> Horizon11Graded;
+// The tuned default over the dynamic bicycle, for the speeds where the
+// tyres slip (see MakeVehicleModelMPC)
+typedef Horizon<15, std::ratio<1, 10>, NoBlocking, Integrator::kEuler, DynamicBicycle>
+    Horizon15Dynamic;
+
+// Blocked variants of the same horizons (see MoveBlocks), 5, 6 and 8 values
+// per actuator instead of 9, 14 and 24
+typedef MoveBlocks<1, 1, 2, 2, 3> Blocks10;
+typedef MoveBlocks<1, 1, 2, 2, 4, 4> Blocks15;
+typedef MoveBlocks<1, 1, 2, 2, 4, 4, 5, 5> Blocks25;
+typedef Horizon<10, std::ratio<1, 10>, Blocks10> Horizon10Blocked;
+typedef Horizon<15, std::ratio<1, 10>, Blocks15> Horizon15Blocked;
+typedef Horizon<25, std::ratio<1, 10>, Blocks25> Horizon25Blocked;
+
+#endif /* HORIZON_H */
@@ -0,0 +1,192 @@
+#ifndef INCREMENTAL_FIT_H
+#define INCREMENTAL_FIT_H
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include "Eigen-3.3/Eigen/Core"
+
+// Least-squares polynomial fit of order Order over a sliding window of
+// points, kept up to date by rank-one changes of its factorization instead
+// of refitting (see polyfit in Polynomial.h for the fit from scratch).
+//
+// The window holds up to Capacity points in the order they came. The fit
+// keeps the triangular factor R of the scaled Vandermonde matrix of the
+// window and Q' y: a point entering is a Givens update of R, the oldest
+// point leaving a hyperbolic downdate, both O(Order^2). Downdates lose
+// accuracy as they accumulate, so every refactor_period changes, or when a
+// downdate would make R singular, R is rebuilt from the points in the
+// window by Givens rotations.
+//
+// The abscissae are those of a frame that holds still between changes:
+// the points of a map, or of a frame re-anchored by the caller, who then
+// Clears the fit. Waypoints in the vehicle frame all move every tick and
+// need the full fit. center and scale map the expected abscissae to about
+// [-1, 1], which keeps R well conditioned.
+template <int Order, size_t Capacity = 32>
+class IncrementalFit {
+public:
+  static const int kTerms = Order + 1;
+  typedef Eigen::Matrix<double, kTerms, 1> Coefficients;
+
+  IncrementalFit(double center, double scale, size_t refactor_period = 64)
+      : center_(center), scale_(scale), refactor_period_(refactor_period) {
+    Clear();
+  }
+
+  void Clear() {
+    R_.setZero();
+    qty_.setZero();
+    first_ = 0;
+    size_ = 0;
+    changes_ = 0;
+  }
+
+  // Add (x, y) as the newest point, the oldest one leaving first if the
+  // window is full
+  void Push(double x, double y) {
+    if (size_ == Capacity) {
+      Pop();
+    }
+    const size_t k = (first_ + size_) % Capacity;
+    xs_[k] = x;
+    ys_[k] = y;
+    size_++;
+    Update(x, y);
+    Changed();
+  }
+
+  // Remove the oldest point
+  void Pop() {
+    assert(size_ > 0);
+    const double x = xs_[first_];
+    const double y = ys_[first_];
+    first_ = (first_ + 1) % Capacity;
+    size_--;
+    if (!Downdate(x, y)) {
+      Refactor();
+      return;
+    }
+    Changed();
+  }
+
+  size_t size() const { return size_; }
+
+  // Coefficients of the fit from the constant one up, like polyfit; needs
+  // more than Order points
+  Coefficients Solve() const {
+    assert(size_ > size_t(Order));
+    Coefficients result = R_.template triangularView<Eigen::Upper>().solve(qty_);
+    double power = 1;
+    for (int i = 1; i < kTerms; i++) {
+      power *= scale_;
+      result(i) /= power;
+    }
+    for (int k = 0; k < Order; k++) {
+      for (int i = Order - 1; i >= k; i--) {
+        result(i) -= center_ * result(i + 1);
+      }
+    }
+    return result;
+  }
+
+  // Rebuild the factorization from the points in the window
+  void Refactor() {
+    R_.setZero();
+    qty_.setZero();
+    for (size_t i = 0; i < size_; i++) {
+      const size_t k = (first_ + i) % Capacity;
+      Update(xs_[k], ys_[k]);
+    }
+    changes_ = 0;
+  }
+
+private:
+  typedef Eigen::Matrix<double, kTerms, 1> Row;
+
+  Row Vandermonde(double x) const {
+    const double t = (x - center_) / scale_;
+    Row a;
+    a(0) = 1;
+    for (int i = 1; i < kTerms; i++) {
+      a(i) = a(i - 1) * t;
+    }
+    return a;
+  }
+
+  // R' R + a a', by a Givens rotation per row of R
+  void Update(double x, double y) {
+    Row a = Vandermonde(x);
+    for (int k = 0; k < kTerms; k++) {
+      const double r = std::hypot(R_(k, k), a(k));
+      if (r == 0) {
+        continue;
+      }
+      const double c = R_(k, k) / r;
+      const double s = a(k) / r;
+      R_(k, k) = r;
+      for (int j = k + 1; j < kTerms; j++) {
+        const double rkj = R_(k, j);
+        R_(k, j) = c * rkj + s * a(j);
+        a(j) = c * a(j) - s * rkj;
+      }
+      const double z = qty_(k);
+      qty_(k) = c * z + s * y;
+      y = c * y - s * z;
+    }
+  }
+
+  // R' R - a a', by a hyperbolic rotation per row of R; false, R left as it
+  // was, if it would no longer be positive definite
+  bool Downdate(double x, double y) {
+    const Eigen::Matrix<double, kTerms, kTerms> R = R_;
+    const Coefficients qty = qty_;
+    Row a = Vandermonde(x);
+    for (int k = 0; k < kTerms; k++) {
+      const double rkk = R_(k, k);
+      const double r2 = rkk * rkk - a(k) * a(k);
+      if (!(r2 > kMinPivot * rkk * rkk)) {
+        R_ = R;
+        qty_ = qty;
+        return false;
+      }
+      const double r = std::sqrt(r2);
+      const double c = r / rkk;
+      const double s = a(k) / rkk;
+      R_(k, k) = r;
+      for (int j = k + 1; j < kTerms; j++) {
+        R_(k, j) = (R_(k, j) - s * a(j)) / c;
+        a(j) = c * a(j) - s * R_(k, j);
+      }
+      qty_(k) = (qty_(k) - s * y) / c;
+      y = c * y - s * qty_(k);
+    }
+    return true;
+  }
+
+  void Changed() {
+    if (++changes_ >= refactor_period_) {
+      Refactor();
+    }
+  }
+
+  // Smallest ratio of a pivot of R to its value before a downdate
+  static constexpr double kMinPivot = 1e-8;
+
+  double center_;
+  double scale_;
+  size_t refactor_period_;
+  Eigen::Matrix<double, kTerms, kTerms> R_;
+  Coefficients qty_;
+  // Ring of the points of the window, from first_
+  double xs_[Capacity];
+  double ys_[Capacity];
+  size_t first_;
+  size_t size_;
+  size_t changes_;
+};
+
+template <int Order, size_t Capacity>
+constexpr double IncrementalFit<Order, Capacity>::kMinPivot;
+
+#endif /* INCREMENTAL_FIT_H */
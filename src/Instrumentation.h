@@ -0,0 +1,66 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <chrono>
+#include "Trace.h"
+
+// How much of the measurement of the control path is compiled in, one
+// level for the whole build (cmake -DMPC_INSTRUMENTATION=off|counters|full):
+//
+//   off       nothing is measured on the control path, for the builds of the
+//             lowest latency: no stage times, no counters or histograms of
+//             the ticks and the solves, no timed phases, no hardware
+//             counters and no counting of the allocations, whose operator
+//             new and malloc aren't replaced. /metrics serves the gauges
+//             alone, the ticks aren't judged against the control period,
+//             and the options that need the measurements (perf, allocfree,
+//             capture) are refused.
+//   counters  all of the metrics of Metrics.h, the stage histograms, the
+//             phases of the solves, the allocations of Allocations.h and,
+//             with perf, the hardware counters of PerfCounters.h; the
+//             default.
+//   full      those and the timeline of Trace.h (MPC_TRACE).
+//
+// The hooks go through this header: InstrumentNow for the clock of a point
+// that is only measured, MPC_COUNT for a single update of a metric, the
+// scoped timer MPC_SCOPED_PHASE of PerfCounters.h and MPC_TRACE_SCOPE of
+// Trace.h, which all expand to nothing when off, and the blocks of several
+// under if (kInstrumentCounters), which the compiler drops but still
+// checks, so that the off build doesn't rot. The clocks the control
+// itself reads, the deadlines of the solves and the latency of the
+// commands, are read at every level.
+
+#define MPC_INSTRUMENTATION_OFF 0
+#define MPC_INSTRUMENTATION_COUNTERS 1
+#define MPC_INSTRUMENTATION_FULL 2
+
+#ifndef MPC_INSTRUMENTATION
+#ifdef MPC_TRACE
+#define MPC_INSTRUMENTATION MPC_INSTRUMENTATION_FULL
+#else
+#define MPC_INSTRUMENTATION MPC_INSTRUMENTATION_COUNTERS
+#endif
+#endif
+
+#if defined(MPC_TRACE) && MPC_INSTRUMENTATION != MPC_INSTRUMENTATION_FULL
+#error "The trace (MPC_TRACE) is the full level of instrumentation"
+#endif
+
+constexpr bool kInstrumentCounters = MPC_INSTRUMENTATION >= MPC_INSTRUMENTATION_COUNTERS;
+constexpr bool kInstrumentFull = MPC_INSTRUMENTATION >= MPC_INSTRUMENTATION_FULL;
+
+// The time of a point that is only measured, the epoch when off so that no
+// clock is read and every duration between two points is 0
+inline std::chrono::steady_clock::time_point InstrumentNow() {
+  return kInstrumentCounters ? std::chrono::steady_clock::now()
+                             : std::chrono::steady_clock::time_point();
+}
+
+// The statement, an update of a metric, only when counting
+#if MPC_INSTRUMENTATION >= MPC_INSTRUMENTATION_COUNTERS
+#define MPC_COUNT(...) __VA_ARGS__
+#else
+#define MPC_COUNT(...) ((void)0)
+#endif
+
+#endif /* INSTRUMENTATION_H */
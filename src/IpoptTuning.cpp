@@ -0,0 +1,372 @@
+#include "IpoptTuning.h"
+#include <cppad/configure.hpp>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <set>
+#include <thread>
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+// See CompiledModel.cpp
+#ifndef MPC_MODEL_SOURCE_HASH
+#define MPC_MODEL_SOURCE_HASH __DATE__ " " __TIME__
+#endif
+
+namespace {
+
+// The statuses and costs of the solves of the untimed round over the
+// scenarios, and the seconds of the timed ones
+struct CorpusRun {
+  std::vector<SolveStatus> statuses;
+  std::vector<double> costs;
+  double seconds = 0;
+  size_t solves = 0;
+};
+
+// Solve every scenario cold then twice warm, like WarmUp: the statuses and
+// costs kept in run, or the solves timed
+void SolveCorpus(MPCBase &mpc, const std::vector<WarmUpScenario> &scenarios, bool timed,
+                 CorpusRun &run) {
+  typedef std::chrono::steady_clock Clock;
+  const Clock::time_point start = Clock::now();
+  for (const WarmUpScenario &scenario : scenarios) {
+    mpc.Reset();
+    mpc.prev_a = 0;
+    for (int tick = 0; tick < 3; tick++) {
+      const MPCSolution plan = mpc.Solve(scenario.state, scenario.coeffs);
+      mpc.prev_a = plan.a[0];
+      mpc.Prepare();
+      if (timed) {
+        run.solves++;
+      } else {
+        run.statuses.push_back(mpc.status());
+        run.costs.push_back(mpc.cost());
+      }
+    }
+  }
+  if (timed) {
+    run.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+  }
+}
+
+// Whether any solve of run ended worse than that of baseline
+bool Worse(const CorpusRun &run, const CorpusRun &baseline) {
+  for (size_t k = 0; k < run.statuses.size() && k < baseline.statuses.size(); k++) {
+    if (static_cast<int>(run.statuses[k]) > static_cast<int>(baseline.statuses[k])) {
+      return true;
+    }
+    if (run.statuses[k] != SolveStatus::kFailed &&
+        run.costs[k] > baseline.costs[k] + 0.01 * std::fabs(baseline.costs[k]) + 1e-9) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AllFailed(const CorpusRun &run) {
+  for (SolveStatus status : run.statuses) {
+    if (status != SolveStatus::kFailed) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The first line of /proc/cpuinfo starting with key, past its colon
+std::string CpuInfo(const std::string &key) {
+  std::ifstream in("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.compare(0, key.size(), key) == 0) {
+      const size_t colon = line.find(':');
+      if (colon != std::string::npos) {
+        const size_t start = line.find_first_not_of(" \t", colon + 1);
+        return start == std::string::npos ? std::string() : line.substr(start);
+      }
+    }
+  }
+  return std::string();
+}
+
+// Create the directory of path and its parents, true if it exists after
+bool MakeParentDirectories(const std::string &path) {
+  const size_t last = path.rfind('/');
+  if (last == std::string::npos || last == 0) {
+    return true;
+  }
+  const std::string directory = path.substr(0, last);
+  for (size_t end = directory.find('/', 1); ; end = directory.find('/', end + 1)) {
+    const std::string prefix = directory.substr(0, end);
+    if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+      return false;
+    }
+    if (end == std::string::npos) {
+      return true;
+    }
+  }
+}
+
+}  // namespace
+
+std::string HostFingerprint() {
+  // x86 names its model, ARM its implementer and part
+  std::string cpu = CpuInfo("model name");
+  if (cpu.empty()) {
+    const std::string implementer = CpuInfo("CPU implementer");
+    const std::string part = CpuInfo("CPU part");
+    cpu = implementer.empty() ? "unknown cpu" : "cpu " + implementer + " " + part;
+  }
+  return cpu + ", " + std::to_string(std::thread::hardware_concurrency()) + " threads, model " +
+         MPC_MODEL_SOURCE_HASH;
+}
+
+std::vector<IpoptOptions> IpoptCandidates(bool chunked, size_t linear_solver_threads) {
+  const char *linear_solvers[] = {"mumps", "ma27", "ma57", "ma86", "ma97", "pardiso"};
+  const char *mu_strategies[] = {"monotone", "adaptive"};
+  const char *hessians[] = {"exact", "limited-memory"};
+  const size_t threads[] = {1, 2, 4, 0};
+  std::vector<IpoptOptions> candidates(1);
+  candidates[0].linear_solver_threads = linear_solver_threads;
+  for (const char *linear_solver : linear_solvers) {
+    for (const char *mu_strategy : mu_strategies) {
+      for (const char *hessian : hessians) {
+        IpoptOptions options;
+        options.linear_solver = linear_solver;
+        options.mu_strategy = mu_strategy;
+        options.hessian = hessian;
+        options.linear_solver_threads = linear_solver_threads;
+        if (!chunked) {
+          candidates.push_back(options);
+          continue;
+        }
+        for (size_t n : threads) {
+          options.threads = n;
+          candidates.push_back(options);
+        }
+      }
+    }
+  }
+  return candidates;
+}
+
+bool TapeColPackAvailable() {
+#if CPPAD_HAS_COLPACK
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::vector<IpoptOptions> TapeSparsityCandidates(const IpoptOptions &base) {
+  const char *jacobians[] = {"forward", "reverse"};
+  const char *colorings[] = {"cppad", "colpack"};
+  const char *hessian_colorings[] = {"cppad.symmetric", "cppad.general", "colpack.symmetric",
+                                     "colpack.general"};
+  const std::string first = TapeSparsityName(base);
+  std::vector<IpoptOptions> candidates(1, base);
+  for (const char *jacobian : jacobians) {
+    for (const char *coloring : colorings) {
+      for (const char *hessian_coloring : hessian_colorings) {
+        IpoptOptions options = base;
+        options.jacobian = jacobian;
+        options.coloring = coloring;
+        options.hessian_coloring = hessian_coloring;
+        if (ParseTapeSparsity(TapeSparsityName(options), options) &&
+            TapeSparsityName(options) != first) {
+          candidates.push_back(options);
+        }
+      }
+    }
+  }
+  return candidates;
+}
+
+bool ParseTapeSparsity(const std::string &text, IpoptOptions &options) {
+  const size_t first = text.find(',');
+  const size_t second = first == std::string::npos ? first : text.find(',', first + 1);
+  if (second == std::string::npos) {
+    return false;
+  }
+  const std::string jacobian = text.substr(0, first);
+  const std::string coloring = text.substr(first + 1, second - first - 1);
+  const std::string hessian_coloring = text.substr(second + 1);
+  const bool colpack = coloring == "colpack" || hessian_coloring.compare(0, 8, "colpack.") == 0;
+  if ((jacobian != "forward" && jacobian != "reverse") ||
+      (coloring != "cppad" && coloring != "colpack") ||
+      (hessian_coloring != "cppad.symmetric" && hessian_coloring != "cppad.general" &&
+       hessian_coloring != "colpack.symmetric" && hessian_coloring != "colpack.general") ||
+      (colpack && !TapeColPackAvailable())) {
+    return false;
+  }
+  options.jacobian = jacobian;
+  options.coloring = coloring;
+  options.hessian_coloring = hessian_coloring;
+  return true;
+}
+
+std::string TapeSparsityName(const IpoptOptions &options) {
+  return (options.jacobian.empty() ? "forward" : options.jacobian) + "," +
+         (options.coloring.empty() ? "cppad" : options.coloring) + "," +
+         (options.hessian_coloring.empty() ? "cppad.symmetric" : options.hessian_coloring);
+}
+
+IpoptCalibration CalibrateIpopt(const MPCBase &prototype,
+                                const std::vector<WarmUpScenario> &scenarios,
+                                const std::vector<IpoptOptions> &candidates, size_t rounds) {
+  IpoptCalibration calibration;
+  if (candidates.empty() || !prototype.Clone()) {
+    return calibration;
+  }
+  rounds = std::max<size_t>(rounds, 1);
+  CorpusRun baseline;
+  double best = 0;
+  // Linear solvers that failed every solve, not there to be loaded
+  std::set<std::string> missing;
+  for (size_t c = 0; c < candidates.size(); c++) {
+    const IpoptOptions &candidate = candidates[c];
+    calibration.candidates++;
+    if (missing.count(candidate.linear_solver) > 0) {
+      calibration.rejected++;
+      continue;
+    }
+    std::unique_ptr<MPCBase> mpc = prototype.Clone();
+    mpc->SetIpoptOptions(candidate);
+    CorpusRun run;
+    SolveCorpus(*mpc, scenarios, false, run);
+    if (c == 0) {
+      baseline = run;
+    } else if (AllFailed(run) && !AllFailed(baseline)) {
+      if (candidate.linear_solver != candidates[0].linear_solver) {
+        missing.insert(candidate.linear_solver);
+      }
+      calibration.rejected++;
+      continue;
+    } else if (Worse(run, baseline)) {
+      calibration.rejected++;
+      continue;
+    }
+    for (size_t round = 0; round < rounds; round++) {
+      SolveCorpus(*mpc, scenarios, true, run);
+    }
+    const double seconds = run.solves > 0 ? run.seconds / run.solves : 0;
+    if (c == 0) {
+      calibration.default_seconds = seconds;
+    }
+    if (c == 0 || seconds < best) {
+      best = seconds;
+      calibration.best = candidate;
+      calibration.seconds = seconds;
+    }
+  }
+  return calibration;
+}
+
+std::string IpoptTuningFile::DefaultPath() {
+  const char *file = std::getenv("MPC_IPOPT_TUNING");
+  if (file != nullptr && *file != '\0') {
+    return file;
+  }
+  const char *xdg = std::getenv("XDG_CACHE_HOME");
+  if (xdg != nullptr && *xdg != '\0') {
+    return std::string(xdg) + "/mpc/ipopt_tuning.json";
+  }
+  const char *home = std::getenv("HOME");
+  if (home != nullptr && *home != '\0') {
+    return std::string(home) + "/.cache/mpc/ipopt_tuning.json";
+  }
+  return "ipopt_tuning.json";
+}
+
+bool IpoptTuningFile::Load(const std::string &path, std::string &error) {
+  entries_.clear();
+  std::ifstream in(path);
+  if (!in) {
+    return true;
+  }
+  try {
+    const json file = json::parse(in);
+    for (json::const_iterator host = file.begin(); host != file.end(); ++host) {
+      for (json::const_iterator problem = host->begin(); problem != host->end(); ++problem) {
+        Entry entry;
+        entry.options.linear_solver = problem->at("linear_solver").get<std::string>();
+        entry.options.mu_strategy = problem->at("mu_strategy").get<std::string>();
+        entry.options.hessian = problem->at("hessian").get<std::string>();
+        entry.options.threads = problem->at("threads").get<size_t>();
+        entry.options.linear_solver_threads = problem->value("linear_solver_threads", size_t(0));
+        entry.options.jacobian = problem->value("jacobian", std::string());
+        entry.options.coloring = problem->value("coloring", std::string());
+        entry.options.hessian_coloring = problem->value("hessian_coloring", std::string());
+        entry.seconds = problem->at("seconds").get<double>();
+        entries_[std::make_pair(host.key(), problem.key())] = entry;
+      }
+    }
+  } catch (const std::exception &e) {
+    entries_.clear();
+    error = path + ": " + e.what();
+    return false;
+  }
+  return true;
+}
+
+bool IpoptTuningFile::Save(const std::string &path, std::string &error) const {
+  json file = json::object();
+  for (const auto &entry : entries_) {
+    const IpoptOptions &options = entry.second.options;
+    file[entry.first.first][entry.first.second] = {{"linear_solver", options.linear_solver},
+                                                   {"mu_strategy", options.mu_strategy},
+                                                   {"hessian", options.hessian},
+                                                   {"threads", options.threads},
+                                                   {"linear_solver_threads",
+                                                    options.linear_solver_threads},
+                                                   {"jacobian", options.jacobian},
+                                                   {"coloring", options.coloring},
+                                                   {"hessian_coloring", options.hessian_coloring},
+                                                   {"seconds", entry.second.seconds}};
+  }
+  if (!MakeParentDirectories(path)) {
+    error = "cannot create the directory of " + path;
+    return false;
+  }
+  const std::string partial = path + "." + std::to_string(getpid());
+  {
+    std::ofstream out(partial);
+    out << std::setw(1) << file << "\n";
+    if (!out) {
+      error = "cannot write " + partial;
+      return false;
+    }
+  }
+  if (std::rename(partial.c_str(), path.c_str()) != 0) {
+    std::remove(partial.c_str());
+    error = "cannot move " + partial + " to " + path;
+    return false;
+  }
+  return true;
+}
+
+bool IpoptTuningFile::Find(const std::string &host, const std::string &problem,
+                           IpoptOptions &options) const {
+  const auto found = entries_.find(std::make_pair(host, problem));
+  if (found == entries_.end()) {
+    return false;
+  }
+  options = found->second.options;
+  return true;
+}
+
+void IpoptTuningFile::Set(const std::string &host, const std::string &problem,
+                          const IpoptOptions &options, double seconds) {
+  Entry &entry = entries_[std::make_pair(host, problem)];
+  entry.options = options;
+  entry.seconds = seconds;
+}
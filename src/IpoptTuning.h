@@ -0,0 +1,116 @@
+#ifndef IPOPT_TUNING_H
+#define IPOPT_TUNING_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "MPC.h"
+#include "WarmUp.h"
+
+// The Ipopt options of a host, measured once and kept for its later starts.
+//
+// Which linear solver factors the KKT systems of the MPC fastest, whether
+// the adaptive barrier update saves iterations, whether the exact Hessian
+// pays for its sweeps and how many threads the chunked derivatives are
+// worth depend on the CPU, its caches and cores, and on the Ipopt and HSL
+// the binary finds, more than on the problem. CalibrateIpopt solves a
+// corpus of problems with every candidate and picks the fastest of those
+// that solve them as well as Ipopt's defaults; IpoptTuningFile keeps it
+// under the fingerprint of the host and the problem, for the server to
+// load on the starts after (see "tune" in main.cpp).
+
+// The host as far as the speed of the solver goes: its CPU model and
+// logical cores, and the model the derivatives are made of
+// (MPC_MODEL_SOURCE_HASH). The Ipopt and HSL libraries aren't in it,
+// calibrate again after changing them.
+std::string HostFingerprint();
+
+// The options to try, Ipopt's defaults first: MUMPS, the HSL solvers MA27,
+// MA57, MA86 and MA97 and Pardiso, the monotone and the adaptive barrier
+// update, and the exact and the limited-memory Hessian; for chunked
+// derivatives each of those with 1, 2 and 4 threads and one per core. The
+// factorizations of every candidate are on linear_solver_threads threads
+// (see IpoptOptions), the share of the cores of a solver thread.
+std::vector<IpoptOptions> IpoptCandidates(bool chunked, size_t linear_solver_threads = 0);
+
+// Whether CppAD was built with ColPack, for the "colpack" colourings of the
+// tape's derivatives
+bool TapeColPackAvailable();
+
+// The strategies of the tape's sparse derivatives to try on top of base,
+// base first (see IpoptOptions::jacobian): the forward and the reverse
+// Jacobian, each with the CppAD colouring and the ColPack one where CppAD
+// has it, and the Hessian coloured by CppAD and by ColPack, symmetric and
+// general. The other options are those of base.
+std::vector<IpoptOptions> TapeSparsityCandidates(const IpoptOptions &base);
+
+// The strategy of the "sparsity=<jacobian>,<coloring>,<hessian coloring>"
+// option of main.cpp into options, e.g. "reverse,cppad,colpack.symmetric";
+// false if a part is unknown, or is of ColPack where CppAD hasn't it
+bool ParseTapeSparsity(const std::string &text, IpoptOptions &options);
+
+// The strategy of options as ParseTapeSparsity reads it, the defaults
+// named
+std::string TapeSparsityName(const IpoptOptions &options);
+
+// The outcome of CalibrateIpopt
+struct IpoptCalibration {
+  IpoptOptions best;
+  // Mean seconds of a solve with best and with the defaults
+  double seconds = 0;
+  double default_seconds = 0;
+  // Candidates measured, and of them those rejected: failed to set up
+  // (e.g. HSL not found), or solved worse than the defaults
+  size_t candidates = 0;
+  size_t rejected = 0;
+};
+
+// Measure every candidate on a copy of prototype (see MPCBase::Clone) over
+// scenarios, each solved cold then twice warm as in WarmUp, one round
+// untimed for the setup and the first factorizations then rounds timed,
+// and return the fastest on average. A candidate is rejected if any of
+// its solves ends worse than that of the first candidate, the defaults:
+// with a worse status, or a cost more than 1% above. The defaults, as
+// they are, if prototype can't be copied.
+IpoptCalibration CalibrateIpopt(const MPCBase &prototype,
+                                const std::vector<WarmUpScenario> &scenarios,
+                                const std::vector<IpoptOptions> &candidates, size_t rounds = 2);
+
+// The options calibrated on hosts, by host fingerprint and problem, e.g.
+// "ipopt/15", in a JSON file:
+//
+//   {"<fingerprint>": {"ipopt/15": {"linear_solver": "ma57", "mu_strategy":
+//    "adaptive", "hessian": "exact", "threads": 0, "linear_solver_threads":
+//    4, "jacobian": "reverse", "coloring": "cppad", "hessian_coloring":
+//    "cppad.general", "seconds": 0.0011}}}
+//
+// so that hosts sharing a home directory keep theirs apart. The strategy
+// of the sparse derivatives is the defaults', and the linear solver
+// threads OpenMP's, for a file of an older build without them.
+class IpoptTuningFile {
+ public:
+  // $MPC_IPOPT_TUNING, or ipopt_tuning.json in the cache directory of the
+  // compiled models ($XDG_CACHE_HOME/mpc or ~/.cache/mpc)
+  static std::string DefaultPath();
+
+  // Read path; true and no options if it doesn't exist
+  bool Load(const std::string &path, std::string &error);
+  // Write it whole under a name of this process, then rename it over path,
+  // so that a concurrent start never reads it half written
+  bool Save(const std::string &path, std::string &error) const;
+
+  bool Find(const std::string &host, const std::string &problem, IpoptOptions &options) const;
+  void Set(const std::string &host, const std::string &problem, const IpoptOptions &options,
+           double seconds);
+
+ private:
+  struct Entry {
+    IpoptOptions options;
+    double seconds = 0;
+  };
+  std::map<std::pair<std::string, std::string>, Entry> entries_;
+};
+
+#endif /* IPOPT_TUNING_H */
@@ -0,0 +1,188 @@
+#include "KKTDump.h"
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+
+namespace {
+
+// path with suffix before its ".mtx", or after it without one
+std::string Sibling(const std::string &path, const std::string &suffix) {
+  const std::string extension = ".mtx";
+  if (path.size() >= extension.size() &&
+      path.compare(path.size() - extension.size(), extension.size(), extension) == 0) {
+    return path.substr(0, path.size() - extension.size()) + suffix + extension;
+  }
+  return path + suffix + extension;
+}
+
+// The next line of in that isn't a comment, false at the end
+bool DataLine(std::istream &in, std::string &line) {
+  while (std::getline(in, line)) {
+    if (!line.empty() && line[0] != '%') {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The n values of the dense column of the array file at path
+template <class T>
+bool ReadArray(const std::string &path, size_t n, std::vector<T> &values, std::string &error) {
+  std::ifstream in(path);
+  std::string line;
+  if (!std::getline(in, line) || line.compare(0, 14, "%%MatrixMarket") != 0 ||
+      line.find(" array ") == std::string::npos) {
+    error = path + " is not a Matrix Market array";
+    return false;
+  }
+  size_t rows = 0;
+  size_t cols = 0;
+  if (!DataLine(in, line) || !(std::istringstream(line) >> rows >> cols) || rows != n ||
+      cols != 1) {
+    error = path + " is not a column of " + std::to_string(n);
+    return false;
+  }
+  values.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    if (!DataLine(in, line) || !(std::istringstream(line) >> values[i])) {
+      error = path + " ends before its " + std::to_string(n) + " values";
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+bool WriteKKTSystem(const std::string &path, const KKTSystem &system) {
+  // By columns then rows, the duplicates summed
+  std::vector<size_t> order(system.values.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&system](size_t a, size_t b) {
+    return system.cols[a] != system.cols[b] ? system.cols[a] < system.cols[b]
+                                            : system.rows[a] < system.rows[b];
+  });
+  std::vector<size_t> firsts;
+  std::vector<double> sums;
+  for (size_t k : order) {
+    if (!firsts.empty() && system.rows[firsts.back()] == system.rows[k] &&
+        system.cols[firsts.back()] == system.cols[k]) {
+      sums.back() += system.values[k];
+    } else {
+      firsts.push_back(k);
+      sums.push_back(system.values[k]);
+    }
+  }
+
+  FILE *matrix = std::fopen(path.c_str(), "w");
+  if (matrix == nullptr) {
+    return false;
+  }
+  std::fprintf(matrix, "%%%%MatrixMarket matrix coordinate real symmetric\n");
+  std::fprintf(matrix, "%zu %zu %zu\n", system.n, system.n, firsts.size());
+  for (size_t e = 0; e < firsts.size(); e++) {
+    std::fprintf(matrix, "%d %d %.17g\n", system.rows[firsts[e]] + 1, system.cols[firsts[e]] + 1,
+                 sums[e]);
+  }
+  bool written = std::fclose(matrix) == 0;
+
+  FILE *rhs = std::fopen(Sibling(path, "-rhs").c_str(), "w");
+  if (rhs == nullptr) {
+    return false;
+  }
+  std::fprintf(rhs, "%%%%MatrixMarket matrix array real general\n%zu 1\n", system.rhs.size());
+  for (double value : system.rhs) {
+    std::fprintf(rhs, "%.17g\n", value);
+  }
+  written &= std::fclose(rhs) == 0;
+
+  FILE *stages = std::fopen(Sibling(path, "-stage").c_str(), "w");
+  if (stages == nullptr) {
+    return false;
+  }
+  std::fprintf(stages, "%%%%MatrixMarket matrix array integer general\n%zu 1\n",
+               system.stages.size());
+  for (int stage : system.stages) {
+    std::fprintf(stages, "%d\n", stage);
+  }
+  written &= std::fclose(stages) == 0;
+  return written;
+}
+
+bool ReadKKTSystem(const std::string &path, KKTSystem &system, std::string &error) {
+  system = KKTSystem();
+  std::ifstream in(path);
+  std::string line;
+  if (!std::getline(in, line)) {
+    error = "Could not read " + path;
+    return false;
+  }
+  if (line.compare(0, 14, "%%MatrixMarket") != 0 ||
+      line.find(" coordinate ") == std::string::npos ||
+      line.find(" symmetric") == std::string::npos ||
+      line.find(" complex ") != std::string::npos) {
+    error = path + " is not a coordinate real symmetric Matrix Market matrix";
+    return false;
+  }
+  size_t rows = 0;
+  size_t cols = 0;
+  size_t entries = 0;
+  if (!DataLine(in, line) || !(std::istringstream(line) >> rows >> cols >> entries) ||
+      rows != cols) {
+    error = path + " has no size, or isn't square";
+    return false;
+  }
+  system.n = rows;
+  system.rows.reserve(entries);
+  system.cols.reserve(entries);
+  system.values.reserve(entries);
+  for (size_t k = 0; k < entries; k++) {
+    long row = 0;
+    long col = 0;
+    double value = 0;
+    if (!DataLine(in, line) || !(std::istringstream(line) >> row >> col >> value) || row < 1 ||
+        col < 1 || static_cast<size_t>(row) > rows || static_cast<size_t>(col) > rows) {
+      error = path + " has a bad entry, or ends before its " + std::to_string(entries);
+      return false;
+    }
+    // Either triangle, kept as the lower
+    system.rows.push_back(static_cast<int>(std::max(row, col) - 1));
+    system.cols.push_back(static_cast<int>(std::min(row, col) - 1));
+    system.values.push_back(value);
+  }
+
+  const std::string rhs_path = Sibling(path, "-rhs");
+  if (access(rhs_path.c_str(), R_OK) == 0) {
+    if (!ReadArray(rhs_path, rows, system.rhs, error)) {
+      return false;
+    }
+  } else {
+    system.rhs.assign(rows, 1.0);
+  }
+  const std::string stage_path = Sibling(path, "-stage");
+  if (access(stage_path.c_str(), R_OK) == 0 &&
+      !ReadArray(stage_path, rows, system.stages, error)) {
+    return false;
+  }
+  return true;
+}
+
+KKTDump::KKTDump(const std::string &directory, size_t keep)
+    : directory_(directory), keep_(keep) {
+  ok_ = access(directory_.c_str(), W_OK) == 0;
+}
+
+bool KKTDump::Write(uint64_t solve, int iteration, const KKTSystem &system) {
+  // Claimed before it is written, so that threads dumping at once write
+  // keep at most between them
+  if (!ok_ || written_.fetch_add(1, std::memory_order_relaxed) >= keep_) {
+    return false;
+  }
+  char name[64];
+  std::snprintf(name, sizeof(name), "/kkt-%06llu-%03d.mtx",
+                static_cast<unsigned long long>(solve), iteration);
+  return WriteKKTSystem(directory_ + name, system);
+}
@@ -0,0 +1,87 @@
+#ifndef KKT_DUMP_H
+#define KKT_DUMP_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The KKT systems Ipopt factors in the solves of the Ipopt MPC, written at
+// every iteration to files in Matrix Market format, for benchmark_kkt to
+// factor with each sparse solver at hand: what picking one over the others,
+// or over a Riccati recursion, would save on the systems of our problems
+// rather than on those of a test set.
+//
+// Ipopt's own matrix can't be reached from the problem, so the system is
+// put together again at the iterate, in the space of the variables Ipopt
+// keeps (the fixed ones of the first stage left out):
+//
+//   [ W + Sigma + delta I   J' ] [dx]   [ -(grad phi + J' lambda) ]
+//   [ J                     0  ] [dl] = [ -g                      ]
+//
+// W the Hessian of the Lagrangian, J the Jacobian of the constraints, all
+// equalities, Sigma the diagonal of the bound multipliers over the
+// distances to the bounds, delta the regularization of the iteration and
+// phi the barrier function of mu. Ipopt's scaling and bound relaxation are
+// left out, so the values are close to, not the same as, those it factors;
+// the pattern is the same.
+
+// A KKT system: a symmetric matrix of n rows by its lower triangle, a right
+// hand side and the position of every row along the horizon, 2t for the
+// variables of stage t and 2t + 1 for the constraints of its step (and
+// their slacks), for an ordering that follows the stages the way a Riccati
+// recursion does
+struct KKTSystem {
+  size_t n = 0;
+  // Entries of the lower triangle, 0 based; duplicates are summed
+  std::vector<int> rows;
+  std::vector<int> cols;
+  std::vector<double> values;
+  std::vector<double> rhs;
+  std::vector<int> stages;
+};
+
+// Write system to path, a coordinate real symmetric Matrix Market file,
+// and its right hand side and stages next to it, path with "-rhs" and
+// "-stage" before its ".mtx"; false if any can't be written
+bool WriteKKTSystem(const std::string &path, const KKTSystem &system);
+// The system of the files of WriteKKTSystem at path, the stages empty
+// without their file; false with the reason in error. Any coordinate
+// real symmetric matrix is read, with a right hand side of ones if it has
+// none.
+bool ReadKKTSystem(const std::string &path, KKTSystem &system, std::string &error);
+
+// Writes the KKT systems of the solves into directory, as
+// kkt-<solve>-<iteration>.mtx, up to keep systems. They are written on the
+// solver's thread, inside its iterations, so the solves that dump are
+// slowed by it; it is for mpc_replay, not the server.
+class KKTDump {
+ public:
+  // false from ok() if directory can't be written
+  KKTDump(const std::string &directory, size_t keep);
+
+  bool ok() const { return ok_; }
+  // Whether keep systems are written
+  bool full() const { return written_.load(std::memory_order_relaxed) >= keep_; }
+  size_t written() const {
+    return std::min(written_.load(std::memory_order_relaxed), keep_);
+  }
+
+  // The number of a new solve, for the names of its files
+  uint64_t BeginSolve() { return solves_.fetch_add(1, std::memory_order_relaxed); }
+
+  // Write system of iteration of solve; false if it can't be, or keep are
+  // written
+  bool Write(uint64_t solve, int iteration, const KKTSystem &system);
+
+ private:
+  const std::string directory_;
+  const size_t keep_;
+  bool ok_ = false;
+  std::atomic<uint64_t> solves_{0};
+  std::atomic<size_t> written_{0};
+};
+
+#endif /* KKT_DUMP_H */
@@ -0,0 +1,395 @@
+#ifndef KINEMATIC_MODEL_H
+#define KINEMATIC_MODEL_H
+
+#include <cmath>
+#include "Eigen-3.3/Eigen/Core"
+#include "Horizon.h"
+
+// Set cost factors
+/// Tune cost factors
+const int cost_cte_factor = 3000;
+const int cost_epsi_factor = 500; // made initial portion etc much less snaky
+const int cost_v_factor = 1;
+const int cost_current_delta_factor = 1;
+const int cost_diff_delta_factor = 200;
+const int cost_current_a_factor = 1;
+const int cost_diff_a_factor = 1;
+
+// This value assumes the model presented in the classroom is used.
+//
+// It was obtained by measuring the radius formed by running the vehicle in the
+// simulator around in a circle with a constant steering angle and velocity on a
+// flat terrain.
+//
+// Lf was tuned until the the radius formed by the simulating the model
+// presented in the classroom matched the previous radius.
+//
+// This is the length from front to CoG that has a similar radius.
+const double Lf = 2.67;
+
+// Reference cross-track error and orientation error = 0
+const double ref_cte = 0;
+const double ref_epsi = 0;
+const double ref_v = 40;
+
+// Actuator limits, max values allowed in simulator
+const double max_delta = M_PI / 8;
+const double max_a = 1.0;
+
+// The steering of the simulator at full lock, in radians
+const double kMaxSteering = 25 * M_PI / 180;
+
+// The steering command of the simulator, -1 to 1 at full lock, for the
+// steering delta of the model, and back
+inline double SteerCommand(double delta) { return delta / (kMaxSteering * Lf); }
+inline double SteerAngle(double command) { return command * kMaxSteering * Lf; }
+
+// Jacobians of one model step with respect to the state and to [delta, a]
+typedef Eigen::Matrix<double, 6, 6> StateJacobian;
+typedef Eigen::Matrix<double, 6, 2> ActuationJacobian;
+
+// Rates of change of s = [x, y, psi, v, cte, epsi] under the actuation
+// delta, a: the kinematic bicycle model, with the cross track error growing
+// with the heading error. T is double or a CppAD scalar.
+template <class T>
+inline void ModelRates(const T *s, const T &delta, const T &a, T *rates) {
+  using std::cos;
+  using std::sin;
+  rates[0] = s[3] * cos(s[2]);
+  rates[1] = s[3] * sin(s[2]);
+  rates[2] = -s[3] * delta / Lf;
+  rates[3] = a;
+  rates[4] = s[3] * sin(s[5]);
+  rates[5] = -s[3] * delta / Lf;
+}
+
+// The vehicle models the MPC can plan with, a parameter of the horizon (see
+// Horizon.h). A model is a struct with
+//
+//   static const char *name();
+//   template <class T>
+//   static void Rates(const T *s, const T &delta, const T &a, T *rates);
+//
+// the rates of change of the state s = [x, y, psi, v, cte, epsi] under the
+// actuation, generic over the scalar like ModelRates, so that the tape, the
+// AutoDiff stages and the generated code of every Ipopt backend follow it
+// through StageModel. The closed form derivatives (ModelDerivatives) and the
+// QP backends are those of the kinematic model.
+
+// ModelRates, the model the cost is tuned with
+struct KinematicBicycle {
+  static const char *name() { return "kinematic"; }
+  template <class T>
+  static void Rates(const T *s, const T &delta, const T &a, T *rates) {
+    ModelRates(s, delta, a, rates);
+  }
+};
+
+// The dynamic bicycle with linear tyres in the steady state of its lateral
+// motion, for the speeds where the tyres slip: a cornering force C alpha on
+// each axle for the slip angle alpha, the axles lf = lr = Lf / 2 from the
+// centre of mass. The lateral velocity and the yaw rate settle within a
+// fraction of a step, so they are not states; the yaw rate is that of the
+// kinematic model scaled by the understeer, 1 / (1 + K u^2) with K = m / Lf
+// (lr / Cf - lf / Cr), and the rear axle, the point the state follows,
+// slides out of the turn by the slip angle of its tyres, beta = m lf u^2 /
+// (Cr Lf^2) of the effective steering, u the speed in m/s. Both vanish with
+// the speed, where it is the kinematic model.
+const double kVehicleMass = 1500;
+// Cornering stiffness of the front and rear axles, N/rad
+const double kCorneringFront = 144000;
+const double kCorneringRear = 150000;
+// The speed of the state (mph) in m/s
+const double kMphToMs = 0.44704;
+const double kUndersteerGradient =
+    kVehicleMass / Lf * (0.5 * Lf / kCorneringFront - 0.5 * Lf / kCorneringRear);
+const double kRearSlipGradient = kVehicleMass * 0.5 * Lf / (kCorneringRear * Lf * Lf);
+
+struct DynamicBicycle {
+  static const char *name() { return "dynamic"; }
+  template <class T>
+  static void Rates(const T *s, const T &delta, const T &a, T *rates) {
+    using std::cos;
+    using std::sin;
+    const T u2 = kMphToMs * kMphToMs * s[3] * s[3];
+    const T steer = delta / (1 + kUndersteerGradient * u2);
+    const T beta = kRearSlipGradient * u2 * steer;
+    rates[0] = s[3] * cos(s[2] + beta);
+    rates[1] = s[3] * sin(s[2] + beta);
+    rates[2] = -s[3] * steer / Lf;
+    rates[3] = a;
+    rates[4] = s[3] * sin(s[5] + beta);
+    rates[5] = -s[3] * steer / Lf;
+  }
+};
+
+// Advance s over dt by the scheme I, with rates(s, k) writing the rates of
+// change at s into k, the actuation held. T is double or a CppAD scalar.
+template <Integrator I, class T, class Rates>
+inline void Integrate(T *s, const Rates &rates, double dt) {
+  T k1[6];
+  rates(s, k1);
+  if (I == Integrator::kEuler) {
+    for (size_t i = 0; i < 6; i++) {
+      s[i] += dt * k1[i];
+    }
+    return;
+  }
+
+  T mid[6];
+  T k2[6];
+  for (size_t i = 0; i < 6; i++) {
+    mid[i] = s[i] + 0.5 * dt * k1[i];
+  }
+  rates(mid, k2);
+  if (I == Integrator::kMidpoint) {
+    for (size_t i = 0; i < 6; i++) {
+      s[i] += dt * k2[i];
+    }
+    return;
+  }
+
+  T k3[6];
+  T k4[6];
+  for (size_t i = 0; i < 6; i++) {
+    mid[i] = s[i] + 0.5 * dt * k2[i];
+  }
+  rates(mid, k3);
+  for (size_t i = 0; i < 6; i++) {
+    mid[i] = s[i] + dt * k3[i];
+  }
+  rates(mid, k4);
+  for (size_t i = 0; i < 6; i++) {
+    s[i] += dt / 6 * (k1[i] + 2 * k2[i] + 2 * k3[i] + k4[i]);
+  }
+}
+
+// Advance s (see ModelRates) over dt by the scheme I with the rates of
+// Vehicle, the actuation held
+template <Integrator I, class Vehicle = KinematicBicycle, class T>
+inline void IntegrateModel(T *s, const T &delta, const T &a, double dt) {
+  Integrate<I>(s, [&delta, &a](const T *z, T *rates) { Vehicle::Rates(z, delta, a, rates); },
+               dt);
+}
+
+// The state of the vehicle in its own frame (x = y = psi = 0) one Euler step
+// of dt ahead, from its speed v, steering delta and last throttle prev_a
+// and its errors against the reference: the state a tick solves for, past
+// the latency of its actuation
+inline MPCState PredictState(double v, double delta, double prev_a, double cte, double epsi,
+                             double dt) {
+  const double predicted_psi = -v * delta / Lf * dt;
+  MPCState state;
+  state << v * dt, 0, predicted_psi, v + prev_a * dt, cte + v * std::sin(epsi) * dt,
+      epsi + predicted_psi;
+  return state;
+}
+
+// The reference of the model at x from the cubic coeffs [c0, c1, c2, c3]:
+// its lateral offset f(x) and its heading atan(f'(x)). Other references
+// overload these, see ReferenceTable.
+template <class Coeffs, class T>
+inline T ReferenceOffset(const Coeffs &coeffs, const T &x) {
+  return coeffs[0] + coeffs[1] * x + coeffs[2] * x * x + coeffs[3] * x * x * x;
+}
+
+template <class Coeffs, class T>
+inline T ReferenceHeading(const Coeffs &coeffs, const T &x) {
+  using std::atan;
+  return atan(coeffs[1] + 2 * coeffs[2] * x + 3 * coeffs[3] * x * x);
+}
+
+// The polynomial coeffs of a reference of order Order below the cubic, the
+// coefficients above it left out rather than multiplied by their zeros, so
+// that a tape of a line or a parabola records none of the terms of the
+// cubic: the offset by Horner's scheme up to Order, and the heading of a
+// line, atan(c1), a function of the coefficients alone. FG_eval takes one
+// with a reference order below 3 (see MPCBase::SetReferenceOrder).
+template <size_t Order, class Coeffs>
+struct TruncatedPolynomial {
+  const Coeffs &coeffs;
+};
+
+template <size_t Order, class Coeffs, class T>
+inline T ReferenceOffset(const TruncatedPolynomial<Order, Coeffs> &reference, const T &x) {
+  T offset = reference.coeffs[Order];
+  for (size_t i = Order; i-- > 0;) {
+    offset = offset * x + reference.coeffs[i];
+  }
+  return offset;
+}
+
+template <size_t Order, class Coeffs, class T>
+inline T ReferenceHeading(const TruncatedPolynomial<Order, Coeffs> &reference, const T &x) {
+  using std::atan;
+  T slope = static_cast<double>(Order) * reference.coeffs[Order];
+  for (size_t i = Order - 1; i > 0; i--) {
+    slope = slope * x + static_cast<double>(i) * reference.coeffs[i];
+  }
+  return atan(slope);
+}
+
+// The reference linearized about the abscissa x: its offset f and heading
+// psides there and their slopes by x, so that the reference at x + dx is
+// f + df dx and psides + dpsides dx. FG_eval takes one per stage, sampled
+// along the starting point of the solve, as parameters instead of the
+// polynomial (see MPCBase::SampleReference).
+template <class T>
+struct LinearReference {
+  T x;
+  T f;
+  T df;
+  T psides;
+  T dpsides;
+};
+
+template <class T>
+inline T ReferenceOffset(const LinearReference<T> &reference, const T &x) {
+  return reference.f + reference.df * (x - reference.x);
+}
+
+template <class T>
+inline T ReferenceHeading(const LinearReference<T> &reference, const T &x) {
+  return reference.psides + reference.dpsides * (x - reference.x);
+}
+
+// The cubic coeffs linearized about x
+template <class Coeffs>
+inline LinearReference<double> LinearizeReference(const Coeffs &coeffs, double x) {
+  const double df = coeffs[1] + 2 * coeffs[2] * x + 3 * coeffs[3] * x * x;
+  const double ddf = 2 * coeffs[2] + 6 * coeffs[3] * x;
+  return LinearReference<double>{x, ReferenceOffset(coeffs, x), df, std::atan(df),
+                                 ddf / (1 + df * df)};
+}
+
+// One step of dt of the kinematic model of FG_eval, from the stage state
+// z = [x,y,psi,v,cte,epsi] and the reference polynomial coeffs. The errors
+// start from the pose measured against the polynomial at x: cte from
+// f(x) - y, and epsi ends at the integrated heading minus the polynomial
+// heading. T is double or a CppAD scalar, Vehicle one of the vehicle models
+// above.
+template <Integrator I, class Vehicle = KinematicBicycle, class T, class Coeffs>
+inline void ModelStep(const T *z, const T &delta, const T &a, const Coeffs &coeffs, double dt,
+                      T *z1) {
+  const T &x0 = z[0];
+  const T f0 = ReferenceOffset(coeffs, x0);
+  const T psides0 = ReferenceHeading(coeffs, x0);
+
+  z1[0] = z[0];
+  z1[1] = z[1];
+  z1[2] = z[2];
+  z1[3] = z[3];
+  z1[4] = f0 - z[1];
+  z1[5] = z[5];
+  IntegrateModel<I, Vehicle>(z1, delta, a, dt);
+  z1[5] = z1[2] - psides0;
+}
+
+// ModelStep in plain doubles. With Euler and the kinematic model, the
+// defaults, it is the step the linearization below and the QP backends are
+// built on.
+template <Integrator I = Integrator::kEuler, class Vehicle = KinematicBicycle,
+          class Coeffs = MPCCoeffs>
+inline MPCState ModelStep(const MPCState &z, double delta, double a, const Coeffs &coeffs,
+                          double dt) {
+  MPCState z1;
+  ModelStep<I, Vehicle>(z.data(), delta, a, coeffs, dt, z1.data());
+  return z1;
+}
+
+// ModelJacobian from the terms of its stage that need transcendental
+// functions or the polynomial: the heading psi0 and error epsi0 through
+// their cosines and sines, and the slope df0 and curvature ddf0 of the
+// reference polynomial at x0.
+inline void ModelJacobian(double cos_psi0, double sin_psi0, double cos_epsi0, double sin_epsi0,
+                          double df0, double ddf0, double v0, double delta, double dt,
+                          StateJacobian &A, ActuationJacobian &B) {
+  A.setZero();
+  A(0, 0) = 1;
+  A(0, 2) = -v0 * sin_psi0 * dt;
+  A(0, 3) = cos_psi0 * dt;
+  A(1, 1) = 1;
+  A(1, 2) = v0 * cos_psi0 * dt;
+  A(1, 3) = sin_psi0 * dt;
+  A(2, 2) = 1;
+  A(2, 3) = -delta / Lf * dt;
+  A(3, 3) = 1;
+  A(4, 0) = df0;
+  A(4, 1) = -1;
+  A(4, 3) = sin_epsi0 * dt;
+  A(4, 5) = v0 * cos_epsi0 * dt;
+  A(5, 0) = -ddf0 / (1 + df0 * df0);
+  A(5, 2) = 1;
+  A(5, 3) = -delta / Lf * dt;
+
+  B.setZero();
+  B(2, 0) = -v0 / Lf * dt;
+  B(3, 1) = dt;
+  B(5, 0) = -v0 / Lf * dt;
+}
+
+// Closed form Jacobians of ModelStep at (z, delta). The step is affine in a,
+// so the Jacobians don't depend on it.
+inline void ModelJacobian(const MPCState &z, double delta, const MPCCoeffs &coeffs,
+                          double dt, StateJacobian &A, ActuationJacobian &B) {
+  const double x0 = z[0];
+  const double psi0 = z[2];
+  const double epsi0 = z[5];
+
+  // Slope and curvature of the reference polynomial at x0
+  const double df0 = coeffs[1] + 2 * coeffs[2] * x0 + 3 * coeffs[3] * x0 * x0;
+  const double ddf0 = 2 * coeffs[2] + 6 * coeffs[3] * x0;
+
+  ModelJacobian(cos(psi0), sin(psi0), cos(epsi0), sin(epsi0), df0, ddf0, z[3], delta, dt, A, B);
+}
+
+// The terms of ModelJacobian for S stages at once, a structure of arrays
+// with one entry per stage. Evaluated by Eigen array expressions over whole
+// rows of a trajectory, so that the polynomial and the products run in SIMD
+// packets instead of one stage at a time.
+template <int S>
+struct StageTerms {
+  typedef Eigen::Array<double, S, 1> Row;
+
+  Row cos_psi;
+  Row sin_psi;
+  Row cos_epsi;
+  Row sin_epsi;
+  // Slope and curvature of the reference polynomial
+  Row df;
+  Row ddf;
+};
+
+// StageTerms of the stages with positions x, headings psi and heading
+// errors epsi, any array expressions of S entries
+template <int S, class X, class Psi, class Epsi>
+inline void EvaluateStageTerms(const Eigen::ArrayBase<X> &x, const Eigen::ArrayBase<Psi> &psi,
+                               const Eigen::ArrayBase<Epsi> &epsi, const MPCCoeffs &coeffs,
+                               StageTerms<S> &terms) {
+  terms.cos_psi = psi.cos();
+  terms.sin_psi = psi.sin();
+  terms.cos_epsi = epsi.cos();
+  terms.sin_epsi = epsi.sin();
+  terms.df = coeffs[1] + x * (2 * coeffs[2] + 3 * coeffs[3] * x);
+  terms.ddf = 2 * coeffs[2] + 6 * coeffs[3] * x;
+}
+
+// StageTerms of the first S stages of the trajectory z, one state per
+// column. Rows of a row major z are contiguous.
+template <int S, class Trajectory>
+inline void EvaluateStageTerms(const Eigen::MatrixBase<Trajectory> &z, const MPCCoeffs &coeffs,
+                               StageTerms<S> &terms) {
+  EvaluateStageTerms(z.row(0).template head<S>().transpose().array(),
+                     z.row(2).template head<S>().transpose().array(),
+                     z.row(5).template head<S>().transpose().array(), coeffs, terms);
+}
+
+// ModelJacobian of stage t of terms, at speed v0 and steering delta
+template <int S>
+inline void ModelJacobian(const StageTerms<S> &terms, size_t t, double v0, double delta,
+                          double dt, StateJacobian &A, ActuationJacobian &B) {
+  ModelJacobian(terms.cos_psi[t], terms.sin_psi[t], terms.cos_epsi[t], terms.sin_epsi[t],
+                terms.df[t], terms.ddf[t], v0, delta, dt, A, B);
+}
+
+#endif /* KINEMATIC_MODEL_H */
@@ -0,0 +1,23 @@
+#include "LatencyEstimator.h"
+
+LatencyEstimator::LatencyEstimator(double initial, double smoothing)
+    : smoothing_(smoothing), latency_(initial) {}
+
+void LatencyEstimator::Arrived(Clock::time_point time) {
+  arrival_ = time;
+  pending_ = true;
+}
+
+void LatencyEstimator::Sent(Clock::time_point time) {
+  if (!pending_) {
+    return;
+  }
+  pending_ = false;
+  Sent(arrival_, time);
+}
+
+void LatencyEstimator::Sent(Clock::time_point arrival, Clock::time_point time) {
+  last_ = std::chrono::duration<double>(time - arrival).count();
+  latency_ += smoothing_ * (last_ - latency_);
+  samples_++;
+}
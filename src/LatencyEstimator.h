@@ -0,0 +1,47 @@
+#ifndef LATENCY_ESTIMATOR_H
+#define LATENCY_ESTIMATOR_H
+
+#include <chrono>
+#include <cstddef>
+
+// Moving estimate of the delay between a telemetry message and the
+// actuations it leads to, for the state prediction of main.
+//
+// Each tick is timestamped on a monotonic clock when its message arrives
+// and when its command is sent; the delay between them, the processing
+// and the simulated actuator latency, is smoothed exponentially. The
+// estimate starts at initial seconds, the nominal latency, and is the
+// prediction interval of the next tick: the current tick's own delay is
+// only known once its command is out. The time the message and the command
+// spend in transit isn't measured.
+class LatencyEstimator {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  // smoothing is the weight of each new delay, in (0, 1]
+  explicit LatencyEstimator(double initial = 0.1, double smoothing = 0.2);
+
+  // The message of a tick arrived at time
+  void Arrived(Clock::time_point time = Clock::now());
+  // Its command was sent at time; ignored without an arrival before it
+  void Sent(Clock::time_point time = Clock::now());
+  // The command of the message that arrived at arrival was sent at time,
+  // for commands held back while the next messages arrive
+  void Sent(Clock::time_point arrival, Clock::time_point time);
+
+  // Estimated delay in seconds
+  double latency() const { return latency_; }
+  // Delay of the last tick in seconds, and the ticks measured
+  double last() const { return last_; }
+  size_t samples() const { return samples_; }
+
+private:
+  double smoothing_;
+  double latency_;
+  double last_ = 0;
+  size_t samples_ = 0;
+  Clock::time_point arrival_;
+  bool pending_ = false;
+};
+
+#endif /* LATENCY_ESTIMATOR_H */
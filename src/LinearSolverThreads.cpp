@@ -0,0 +1,39 @@
+#include "LinearSolverThreads.h"
+#include <dlfcn.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace {
+
+typedef void (*SetNumThreads)(int);
+
+// omp_set_num_threads of the process, null without OpenMP. Looked up on
+// every call until found: the linear solver's library may be loaded after
+// the first, as Ipopt sets up its first problem.
+SetNumThreads FindSetNumThreads() {
+  static std::atomic<SetNumThreads> found(nullptr);
+  SetNumThreads set_num_threads = found.load(std::memory_order_relaxed);
+  if (set_num_threads == nullptr) {
+    set_num_threads =
+        reinterpret_cast<SetNumThreads>(dlsym(RTLD_DEFAULT, "omp_set_num_threads"));
+    found.store(set_num_threads, std::memory_order_relaxed);
+  }
+  return set_num_threads;
+}
+
+}  // namespace
+
+bool SetLinearSolverThreads(size_t threads) {
+  const SetNumThreads set_num_threads = FindSetNumThreads();
+  if (set_num_threads == nullptr) {
+    return false;
+  }
+  set_num_threads(static_cast<int>(std::max<size_t>(threads, 1)));
+  return true;
+}
+
+size_t LinearSolverThreadsFor(size_t solver_threads) {
+  const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  return std::max<size_t>(1, cores / std::max<size_t>(solver_threads, 1));
+}
@@ -0,0 +1,28 @@
+#ifndef LINEAR_SOLVER_THREADS_H
+#define LINEAR_SOLVER_THREADS_H
+
+#include <cstddef>
+
+// The threads of the multithreaded sparse linear solvers Ipopt factors the
+// KKT systems of the long horizons with (see IpoptOptions::linear_solver):
+// MA86 and MA97 of HSL, Pardiso, and MUMPS and the BLAS where they were
+// built with OpenMP. They take their threads from OpenMP, whose count is
+// one per core for every thread that starts a parallel region unless set;
+// with a solver thread per worker, every solve would start a thread per
+// core, each worker's fighting the others' for the cores. The count is an
+// OpenMP setting of the calling thread, so each solver thread sets its own
+// before its solves (see MPC::Solve).
+//
+// The binary doesn't link OpenMP: omp_set_num_threads is looked up in the
+// process, where the linear solver's library brought it in, and the calls
+// do nothing where it didn't.
+
+// Factor on threads threads, from now on on the calling thread; false if
+// OpenMP isn't in the process
+bool SetLinearSolverThreads(size_t threads);
+
+// The threads of the factorizations of each of solver_threads threads
+// solving at once, the cores shared among them and one at least
+size_t LinearSolverThreadsFor(size_t solver_threads);
+
+#endif /* LINEAR_SOLVER_THREADS_H */
@@ -0,0 +1,131 @@
+#include "LinearizationTable.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+// Version of the artifact of the nodes, a change of Rates or of their order
+// is a new one
+const int kArtifactVersion = 1;
+
+// Cell of x on a grid from min with the given step and nodes, clamped to the
+// edge cells, and the offset of x in it (outside [0, 1] past the edges)
+size_t Cell(double x, double min, double step, size_t nodes, double &offset) {
+  const double p = (x - min) / step;
+  const double i = std::min(std::max(std::floor(p), 0.0), static_cast<double>(nodes - 2));
+  offset = p - i;
+  return static_cast<size_t>(i);
+}
+
+}  // namespace
+
+constexpr size_t LinearizationTable::kRates;
+
+LinearizationTable::LinearizationTable(const Axis &v, size_t psi_nodes, const Axis &delta)
+    : LinearizationTable(v, psi_nodes, delta, std::unique_ptr<MappedFile>()) {
+  owned_.resize(kRates * v.nodes * psi_nodes * delta.nodes);
+  Tabulate(owned_.data());
+  rates_ = owned_.data();
+}
+
+LinearizationTable::LinearizationTable(const Axis &v, size_t psi_nodes, const Axis &delta,
+                                       std::unique_ptr<MappedFile> mapping)
+    : v_(v), delta_(delta), psi_nodes_(psi_nodes),
+      v_step_((v.max - v.min) / (v.nodes - 1)), psi_step_(2 * M_PI / psi_nodes),
+      delta_step_((delta.max - delta.min) / (delta.nodes - 1)), mapping_(std::move(mapping)) {
+  if (mapping_) {
+    rates_ = reinterpret_cast<const double *>(mapping_->data());
+  }
+}
+
+std::shared_ptr<const LinearizationTable> LinearizationTable::Share(const std::string &directory,
+                                                                    std::string &error) {
+  const Axis v{-10, 110, 13};
+  const size_t psi_nodes = 512;
+  const Axis delta{-max_delta, max_delta, 3};
+  // Everything the nodes depend on
+  std::ostringstream grid;
+  grid.precision(17);
+  grid << kArtifactVersion << ' ' << v.min << ' ' << v.max << ' ' << v.nodes << ' '
+       << psi_nodes << ' ' << delta.min << ' ' << delta.max << ' ' << delta.nodes << ' ' << Lf
+       << ' ' << kRates;
+  std::unique_ptr<LinearizationTable> table(
+      new LinearizationTable(v, psi_nodes, delta, std::unique_ptr<MappedFile>()));
+  const size_t bytes = table->size();
+  std::string path;
+  if (!ShareArtifact(directory, "lintable-" + ArtifactKey(grid.str()) + ".bin",
+                     [&table, bytes](const std::string &partial) {
+                       std::vector<double> rates(bytes / sizeof(double));
+                       table->Tabulate(rates.data());
+                       std::ofstream out(partial.c_str(), std::ios::binary);
+                       out.write(reinterpret_cast<const char *>(rates.data()), bytes);
+                       return static_cast<bool>(out);
+                     },
+                     path, error)) {
+    return std::shared_ptr<const LinearizationTable>();
+  }
+  table->mapping_ = MappedFile::Map(path);
+  if (!table->mapping_ || table->mapping_->size() != bytes) {
+    error = "cannot map " + path + " as a table of " + std::to_string(bytes) + " bytes";
+    return std::shared_ptr<const LinearizationTable>();
+  }
+  table->rates_ = reinterpret_cast<const double *>(table->mapping_->data());
+  return std::shared_ptr<const LinearizationTable>(table.release());
+}
+
+void LinearizationTable::Tabulate(double *rates) const {
+  for (size_t i = 0; i < v_.nodes; i++) {
+    for (size_t j = 0; j < psi_nodes_; j++) {
+      for (size_t k = 0; k < delta_.nodes; k++) {
+        Rates(v_.min + i * v_step_, j * psi_step_, delta_.min + k * delta_step_, rates);
+        rates += kRates;
+      }
+    }
+  }
+}
+
+void LinearizationTable::Rates(double v, double psi, double delta, double *rates) {
+  rates[0] = -v * std::sin(psi);
+  rates[1] = std::cos(psi);
+  rates[2] = v * std::cos(psi);
+  rates[3] = std::sin(psi);
+  rates[4] = -delta / Lf;
+  rates[5] = -v / Lf;
+}
+
+void LinearizationTable::Interpolate(double v, double psi, double delta, double *rates) const {
+  double fv;
+  double fd;
+  const size_t i = Cell(v, v_.min, v_step_, v_.nodes, fv);
+  const size_t k = Cell(delta, delta_.min, delta_step_, delta_.nodes, fd);
+
+  // The heading wraps around
+  const double p = psi / psi_step_;
+  const double floor_p = std::floor(p);
+  const double fp = p - floor_p;
+  const long n = static_cast<long>(psi_nodes_);
+  const size_t j0 = static_cast<size_t>(((static_cast<long>(floor_p) % n) + n) % n);
+  const size_t j1 = j0 + 1 == psi_nodes_ ? 0 : j0 + 1;
+
+  for (size_t r = 0; r < kRates; r++) {
+    rates[r] = 0;
+  }
+  const size_t is[2] = {i, i + 1};
+  const size_t js[2] = {j0, j1};
+  const double wv[2] = {1 - fv, fv};
+  const double wp[2] = {1 - fp, fp};
+  const double wd[2] = {1 - fd, fd};
+  for (size_t a = 0; a < 2; a++) {
+    for (size_t b = 0; b < 2; b++) {
+      const double *node = &rates_[kRates * ((is[a] * psi_nodes_ + js[b]) * delta_.nodes + k)];
+      for (size_t c = 0; c < 2; c++) {
+        const double w = wv[a] * wp[b] * wd[c];
+        for (size_t r = 0; r < kRates; r++) {
+          rates[r] += w * node[kRates * c + r];
+        }
+      }
+    }
+  }
+}
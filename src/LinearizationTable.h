@@ -0,0 +1,105 @@
+#ifndef LINEARIZATION_TABLE_H
+#define LINEARIZATION_TABLE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "KinematicModel.h"
+#include "SharedArtifact.h"
+
+// The entries of the model Jacobians (ModelJacobian) that depend on the
+// speed, the heading and the steering, tabulated at startup over a grid of
+// (v, psi, delta) and interpolated trilinearly, for the backends that
+// linearize the model along their plan every tick (CondensedQP, MPC_ADMM).
+//
+// Per unit of dt these are -v sin(psi), cos(psi), v cos(psi) and sin(psi) of
+// the position rows, and -delta / Lf and -v / Lf of the heading rows, so no
+// solve needs the trigonometry of the heading. The other entries of the
+// Jacobians come from the road, the heading error and the polynomial at the
+// stage, and are evaluated as before: only the table's are shared between
+// polynomials.
+//
+// The entries are linear in v and delta, so the interpolation is exact along
+// those axes, also outside their range where the edge cells extrapolate; the
+// heading axis is periodic and the error is that of interpolating cos and
+// sin over a cell, about step^2 / 8, 2e-5 with the default 512 nodes.
+//
+// The table is immutable once built: one instance serves every MPC and any
+// number of threads, see MPCBase::linearization_table, and with Share one
+// file of nodes every process of the host.
+class LinearizationTable {
+public:
+  // The grid of an axis, nodes >= 2 from min to max
+  struct Axis {
+    double min;
+    double max;
+    size_t nodes;
+  };
+
+  LinearizationTable(const Axis &v = Axis{-10, 110, 13}, size_t psi_nodes = 512,
+                     const Axis &delta = Axis{-max_delta, max_delta, 3});
+
+  LinearizationTable(const LinearizationTable &) = delete;
+  LinearizationTable &operator=(const LinearizationTable &) = delete;
+
+  // The table of the default grid with its nodes mapped from the artifacts
+  // of directory, tabulated there by the first process of the host that
+  // needs it (see SharedArtifact.h); null with the reason in error if it
+  // can't be
+  static std::shared_ptr<const LinearizationTable> Share(const std::string &directory,
+                                                         std::string &error);
+
+  // ModelJacobian of stage t of terms at speed v0, heading psi0 and steering
+  // delta; the heading terms of terms are not used
+  template <int S>
+  void ModelJacobian(const StageTerms<S> &terms, size_t t, double v0, double psi0,
+                     double delta, double dt, StateJacobian &A, ActuationJacobian &B) const {
+    double rates[kRates];
+    Interpolate(v0, psi0, delta, rates);
+    ::ModelJacobian(rates[1], rates[3], terms.cos_epsi[t], terms.sin_epsi[t], terms.df[t],
+                    terms.ddf[t], v0, delta, dt, A, B);
+    A(0, 2) = rates[0] * dt;
+    A(1, 2) = rates[2] * dt;
+    A(2, 3) = rates[4] * dt;
+    A(5, 3) = rates[4] * dt;
+    B(2, 0) = rates[5] * dt;
+    B(5, 0) = rates[5] * dt;
+  }
+
+  // Memory of the nodes of the table, in bytes, and whether they are those
+  // of a mapped artifact
+  size_t size() const { return kRates * v_.nodes * psi_nodes_ * delta_.nodes * sizeof(double); }
+  bool mapped() const { return mapping_ != nullptr; }
+
+private:
+  // Entries per node, in the order of the comment above
+  static constexpr size_t kRates = 6;
+
+  // The grid without its nodes, for the constructors to fill
+  LinearizationTable(const Axis &v, size_t psi_nodes, const Axis &delta,
+                     std::unique_ptr<MappedFile> mapping);
+
+  // Rates at the node (v, psi, delta)
+  static void Rates(double v, double psi, double delta, double *rates);
+  // Every node of the grid into rates, delta fastest, then psi, then v
+  void Tabulate(double *rates) const;
+
+  // Trilinear interpolation of the rates at (v, psi, delta)
+  void Interpolate(double v, double psi, double delta, double *rates) const;
+
+  Axis v_;
+  Axis delta_;
+  size_t psi_nodes_;
+  // Node spacings
+  double v_step_;
+  double psi_step_;
+  double delta_step_;
+  // kRates per node, delta fastest, then psi, then v, in owned_ or in the
+  // mapped artifact
+  const double *rates_ = nullptr;
+  std::vector<double> owned_;
+  std::unique_ptr<MappedFile> mapping_;
+};
+
+#endif /* LINEARIZATION_TABLE_H */
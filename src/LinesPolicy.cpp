@@ -0,0 +1,53 @@
+#include "LinesPolicy.h"
+#include <cstdlib>
+
+namespace {
+
+const size_t npos = MessageView::npos;
+
+// The integer that is all of text, false if there is none
+bool ParseInteger(const MessageView &text, long &value) {
+  // As a string of its own, the url isn't null terminated
+  char digits[24];
+  if (text.empty() || text.size() >= sizeof(digits)) {
+    return false;
+  }
+  for (size_t k = 0; k < text.size(); k++) {
+    digits[k] = text[k];
+  }
+  digits[text.size()] = '\0';
+  char *end = nullptr;
+  value = std::strtol(digits, &end, 10);
+  return *end == '\0';
+}
+
+}  // namespace
+
+bool ParseLinesQuery(const MessageView &url, LinesPolicy &policy) {
+  LinesPolicy parsed = policy;
+  const size_t query = url.find('?');
+  for (size_t begin = query == npos ? url.size() : query + 1; begin < url.size();) {
+    size_t end = url.find('&', begin);
+    end = end == npos ? url.size() : end;
+    const MessageView parameter = url.substr(begin, end - begin);
+    const size_t equals = parameter.find('=');
+    const MessageView key = parameter.substr(0, equals);
+    const MessageView value = equals == npos ? MessageView() : parameter.substr(equals + 1);
+    long number = 0;
+    if (key.equals("lines")) {
+      if (!ParseInteger(value, number) || number < 0) {
+        return false;
+      }
+      parsed.every = static_cast<size_t>(number);
+    } else if (key.equals("decimals")) {
+      if (!ParseInteger(value, number)) {
+        return false;
+      }
+      // SteerMessage writes no more than 9
+      parsed.precision = number < 0 ? -1 : number > 9 ? 9 : static_cast<int>(number);
+    }
+    begin = end + 1;
+  }
+  policy = parsed;
+  return true;
+}
@@ -0,0 +1,32 @@
+#ifndef LINES_POLICY_H
+#define LINES_POLICY_H
+
+#include <cstddef>
+#include <cstdint>
+#include "MessageView.h"
+
+// How a session gets the lines the simulator draws, the plan in green and
+// the reference in yellow. They make up most of the bytes of a reply and of
+// the time to write it, and are only looked at, so a session can take them
+// on every reply, on every few, at fewer decimals, or not at all. The
+// replies without them carry empty arrays; the actuations go out on every
+// reply regardless.
+struct LinesPolicy {
+  // Every how many replies carry the lines, 0 for none
+  size_t every = 1;
+  // Their decimals in JSON, negative for the shortest that round trip (see
+  // SteerMessage)
+  int precision = 3;
+
+  // Whether the reply of the given tick, counted from 0, carries the lines
+  bool Due(uint64_t tick) const { return every > 0 && tick % every == 0; }
+};
+
+// Set the fields of policy given by the query of the url a client connects
+// to, "lines" for every and "decimals" for precision, e.g.
+// "/?lines=5&decimals=1" or "/?lines=0" to draw nothing; other parameters
+// are ignored. False, with policy as it was, if either isn't an integer or
+// lines is negative.
+bool ParseLinesQuery(const MessageView &url, LinesPolicy &policy);
+
+#endif /* LINES_POLICY_H */
@@ -0,0 +1,332 @@
+#include "Log.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+namespace {
+
+// Slots of the ring, a power of two, and the bytes of fields each holds
+const size_t kSlots = 512;
+const size_t kFieldBytes = 2000;
+// How long the drain sleeps once the ring is empty
+const std::chrono::milliseconds kDrainInterval(5);
+
+// The tag byte of each field in a slot
+enum FieldType : unsigned char { kBool, kSigned, kUnsigned, kDouble, kText };
+
+std::atomic<int> log_level(static_cast<int>(LogLevel::kInfo));
+
+int64_t Nanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace
+
+// A record in the ring. sequence is the position of the record the slot
+// is free for, or that position plus one once that record is published.
+struct LogSlot {
+  std::atomic<size_t> sequence;
+  const char *format;
+  uint64_t suppressed;
+  size_t size;
+  bool truncated;
+  unsigned char fields[kFieldBytes];
+};
+
+namespace {
+
+// A bounded ring of LogSlots with any number of producers and a single
+// consumer, the drain thread, after Vyukov's MPMC queue: producers claim a
+// position with a compare and swap and publish its slot by its sequence,
+// the drain writes the published records out in order to stdout.
+class LogRing {
+ public:
+  LogRing() : slots_(new LogSlot[kSlots]), enqueue_(0), dequeue_(0), dropped_(0), stop_(false) {
+    for (size_t i = 0; i < kSlots; i++) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    drain_ = std::thread(&LogRing::Drain, this);
+  }
+
+  ~LogRing() {
+    stop_.store(true, std::memory_order_release);
+    drain_.join();
+  }
+
+  // The free slot of the next position, null if the ring is full
+  LogSlot *Claim(size_t &sequence) {
+    size_t position = enqueue_.load(std::memory_order_relaxed);
+    for (;;) {
+      LogSlot &slot = slots_[position & (kSlots - 1)];
+      const size_t free = slot.sequence.load(std::memory_order_acquire);
+      if (free == position) {
+        if (enqueue_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          sequence = position;
+          return &slot;
+        }
+      } else if (free < position) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      } else {
+        position = enqueue_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void Publish(LogSlot *slot, size_t sequence) {
+    slot->sequence.store(sequence + 1, std::memory_order_release);
+  }
+
+  void Flush() {
+    const size_t end = enqueue_.load(std::memory_order_acquire);
+    while (dequeue_.load(std::memory_order_acquire) < end) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+ private:
+  void Drain() {
+    std::string line;
+    for (;;) {
+      const bool stop = stop_.load(std::memory_order_acquire);
+      bool wrote = false;
+      for (;;) {
+        const size_t position = dequeue_.load(std::memory_order_relaxed);
+        LogSlot &slot = slots_[position & (kSlots - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+          break;
+        }
+        Format(slot, line);
+        slot.sequence.store(position + kSlots, std::memory_order_release);
+        std::fwrite(line.data(), 1, line.size(), stdout);
+        dequeue_.store(position + 1, std::memory_order_release);
+        wrote = true;
+      }
+      const uint64_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+      if (dropped > 0) {
+        std::fprintf(stdout, "Log: %llu records dropped, the ring was full\n",
+                     static_cast<unsigned long long>(dropped));
+        wrote = true;
+      }
+      if (wrote) {
+        std::fflush(stdout);
+      }
+      if (stop) {
+        return;
+      }
+      std::this_thread::sleep_for(kDrainInterval);
+    }
+  }
+
+  // The line of the record in slot
+  static void Format(const LogSlot &slot, std::string &line) {
+    line.clear();
+    size_t i = 0;
+    for (const char *c = slot.format; *c != '\0'; c++) {
+      if (c[0] == '{' && c[1] == '}' && i < slot.size) {
+        i = FormatField(slot, i, line);
+        c++;
+      } else {
+        line.push_back(*c);
+      }
+    }
+    while (i < slot.size) {
+      line.push_back(' ');
+      i = FormatField(slot, i, line);
+    }
+    if (slot.truncated) {
+      line.append("...");
+    }
+    if (slot.suppressed > 0) {
+      char text[48];
+      std::snprintf(text, sizeof(text), " (%llu more suppressed)",
+                    static_cast<unsigned long long>(slot.suppressed));
+      line.append(text);
+    }
+    line.push_back('\n');
+  }
+
+  // Past the field at i of slot, appended to line
+  static size_t FormatField(const LogSlot &slot, size_t i, std::string &line) {
+    const unsigned char *field = slot.fields + i;
+    char text[32];
+    switch (field[0]) {
+      case kBool:
+        line.append(field[1] ? "true" : "false");
+        return i + 2;
+      case kSigned: {
+        long long value;
+        std::memcpy(&value, field + 1, sizeof(value));
+        line.append(text, std::snprintf(text, sizeof(text), "%lld", value));
+        return i + 1 + sizeof(value);
+      }
+      case kUnsigned: {
+        unsigned long long value;
+        std::memcpy(&value, field + 1, sizeof(value));
+        line.append(text, std::snprintf(text, sizeof(text), "%llu", value));
+        return i + 1 + sizeof(value);
+      }
+      case kDouble: {
+        double value;
+        std::memcpy(&value, field + 1, sizeof(value));
+        // As std::cout prints it by default
+        line.append(text, std::snprintf(text, sizeof(text), "%g", value));
+        return i + 1 + sizeof(value);
+      }
+      default: {
+        uint32_t length;
+        std::memcpy(&length, field + 1, sizeof(length));
+        line.append(reinterpret_cast<const char *>(field + 1 + sizeof(length)), length);
+        return i + 1 + sizeof(length) + length;
+      }
+    }
+  }
+
+  std::unique_ptr<LogSlot[]> slots_;
+  std::atomic<size_t> enqueue_;
+  std::atomic<size_t> dequeue_;
+  std::atomic<uint64_t> dropped_;
+  std::atomic<bool> stop_;
+  std::thread drain_;
+};
+
+// Started with the first record, drained out when the program exits
+LogRing &Ring() {
+  static LogRing ring;
+  return ring;
+}
+
+}  // namespace
+
+bool ParseLogLevel(const std::string &name, LogLevel &level) {
+  const struct {
+    const char *name;
+    LogLevel level;
+  } levels[] = {{"debug", LogLevel::kDebug},
+                {"info", LogLevel::kInfo},
+                {"warning", LogLevel::kWarning},
+                {"error", LogLevel::kError},
+                {"off", LogLevel::kOff}};
+  for (const auto &entry : levels) {
+    if (name == entry.name) {
+      level = entry.level;
+      return true;
+    }
+  }
+  return false;
+}
+
+void SetLogLevel(LogLevel level) {
+  log_level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+bool LogEnabled(LogLevel level) {
+  return level != LogLevel::kOff &&
+         static_cast<int>(level) >= log_level.load(std::memory_order_relaxed);
+}
+
+void FlushLog() { Ring().Flush(); }
+
+LogRateLimit::LogRateLimit(double per_second, unsigned burst)
+    : interval_(static_cast<int64_t>(1e9 / per_second)),
+      tolerance_(static_cast<int64_t>(burst > 0 ? burst - 1 : 0) * interval_),
+      arrival_(0),
+      suppressed_(0) {}
+
+bool LogRateLimit::Allow() {
+  const int64_t now = Nanoseconds();
+  int64_t arrival = arrival_.load(std::memory_order_relaxed);
+  for (;;) {
+    // The arrival time the records so far have earned, at the earliest now
+    const int64_t earned = arrival > now ? arrival : now;
+    if (earned - now > tolerance_) {
+      suppressed_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    if (arrival_.compare_exchange_weak(arrival, earned + interval_, std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+}
+
+LogRecord::LogRecord(const char *format) : sequence_(0) {
+  slot_ = Ring().Claim(sequence_);
+  if (slot_ != nullptr) {
+    slot_->format = format;
+    slot_->suppressed = 0;
+    slot_->size = 0;
+    slot_->truncated = false;
+  }
+}
+
+LogRecord::~LogRecord() {
+  if (slot_ != nullptr) {
+    Ring().Publish(slot_, sequence_);
+  }
+}
+
+void LogRecord::Add(bool value) {
+  const unsigned char byte = value ? 1 : 0;
+  AddBytes(kBool, &byte, 1);
+}
+
+void LogRecord::Add(int value) { Add(static_cast<long long>(value)); }
+
+void LogRecord::Add(long value) { Add(static_cast<long long>(value)); }
+
+void LogRecord::Add(long long value) { AddBytes(kSigned, &value, sizeof(value)); }
+
+void LogRecord::Add(unsigned value) { Add(static_cast<unsigned long long>(value)); }
+
+void LogRecord::Add(unsigned long value) { Add(static_cast<unsigned long long>(value)); }
+
+void LogRecord::Add(unsigned long long value) { AddBytes(kUnsigned, &value, sizeof(value)); }
+
+void LogRecord::Add(double value) { AddBytes(kDouble, &value, sizeof(value)); }
+
+void LogRecord::Add(const char *text) { Add(MessageView(text, std::strlen(text))); }
+
+void LogRecord::Add(const std::string &text) { Add(MessageView(text.data(), text.size())); }
+
+void LogRecord::Add(const MessageView &text) {
+  if (slot_ == nullptr || slot_->truncated) {
+    return;
+  }
+  const size_t header = 1 + sizeof(uint32_t);
+  if (slot_->size + header > kFieldBytes) {
+    slot_->truncated = true;
+    return;
+  }
+  unsigned char *field = slot_->fields + slot_->size;
+  const size_t room = kFieldBytes - slot_->size - header;
+  const uint32_t length = static_cast<uint32_t>(text.size() < room ? text.size() : room);
+  field[0] = kText;
+  std::memcpy(field + 1, &length, sizeof(length));
+  std::memcpy(field + header, text.data, length);
+  slot_->size += header + length;
+  slot_->truncated = length < text.size();
+}
+
+void LogRecord::Suppressed(uint64_t count) {
+  if (slot_ != nullptr) {
+    slot_->suppressed = count;
+  }
+}
+
+void LogRecord::AddBytes(unsigned char type, const void *bytes, size_t n) {
+  if (slot_ == nullptr || slot_->truncated) {
+    return;
+  }
+  if (slot_->size + 1 + n > kFieldBytes) {
+    slot_->truncated = true;
+    return;
+  }
+  unsigned char *field = slot_->fields + slot_->size;
+  field[0] = type;
+  std::memcpy(field + 1, bytes, n);
+  slot_->size += 1 + n;
+}
@@ -0,0 +1,118 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "MessageView.h"
+
+// Severity of a log record; records below the level set are dropped where
+// they are made.
+enum class LogLevel { kDebug, kInfo, kWarning, kError, kOff };
+
+// The level named "debug", "info", "warning", "error" or "off", false for
+// any other name
+bool ParseLogLevel(const std::string &name, LogLevel &level);
+
+// Records below level are dropped from now on, on every thread; kInfo until
+// it is set
+void SetLogLevel(LogLevel level);
+
+// Whether records of level are kept, a relaxed load and a compare
+bool LogEnabled(LogLevel level);
+
+// Wait for the records made so far to be written out
+void FlushLog();
+
+// At most per_second records on average through Allow(), in bursts of up
+// to burst, lock-free over every thread that shares it (the generic cell
+// rate algorithm on an atomic arrival time). The records it refused are
+// counted for the next one it allows to report.
+class LogRateLimit {
+ public:
+  explicit LogRateLimit(double per_second, unsigned burst = 1);
+
+  bool Allow();
+  // The records refused since the last call
+  uint64_t TakeSuppressed() { return suppressed_.exchange(0, std::memory_order_relaxed); }
+
+ private:
+  const int64_t interval_;
+  const int64_t tolerance_;
+  std::atomic<int64_t> arrival_;
+  std::atomic<uint64_t> suppressed_;
+};
+
+struct LogSlot;
+
+// A record being written into its slot of the log's ring, published when it
+// goes out of scope. The fields are encoded in binary as they are added
+// and formatted by the thread that drains the ring: each "{}" of format,
+// which must outlive the program like a literal, takes the next field, and
+// any fields left over follow separated by spaces. Text that doesn't fit in
+// the slot (2000 bytes of fields) is cut short and the line ends in "...".
+// When the ring is full the record is dropped and counted instead of
+// waiting for the drain.
+class LogRecord {
+ public:
+  explicit LogRecord(const char *format);
+  ~LogRecord();
+  LogRecord(const LogRecord &) = delete;
+  LogRecord &operator=(const LogRecord &) = delete;
+
+  void Add(bool value);
+  void Add(int value);
+  void Add(long value);
+  void Add(long long value);
+  void Add(unsigned value);
+  void Add(unsigned long value);
+  void Add(unsigned long long value);
+  void Add(double value);
+  // Copied, so they needn't outlive the record
+  void Add(const char *text);
+  void Add(const std::string &text);
+  void Add(const MessageView &text);
+  // Records a LogRateLimit refused before this one
+  void Suppressed(uint64_t count);
+
+ private:
+  void AddBytes(unsigned char type, const void *bytes, size_t n);
+
+  LogSlot *slot_;
+  size_t sequence_;
+};
+
+inline void AddLogFields(LogRecord &) {}
+
+template <class Field, class... Fields>
+void AddLogFields(LogRecord &record, const Field &field, const Fields &... fields) {
+  record.Add(field);
+  AddLogFields(record, fields...);
+}
+
+// Log a record of level, e.g. Log(LogLevel::kInfo, "cte: {} m", cte), off
+// the calling thread: the caller only encodes the fields into the ring,
+// and not even that below the level set.
+template <class... Fields>
+void Log(LogLevel level, const char *format, const Fields &... fields) {
+  if (!LogEnabled(level)) {
+    return;
+  }
+  LogRecord record(format);
+  AddLogFields(record, fields...);
+}
+
+// The same, unless limit refuses it; the next record it allows says how
+// many it refused
+template <class... Fields>
+void Log(LogRateLimit &limit, LogLevel level, const char *format, const Fields &... fields) {
+  if (!LogEnabled(level) || !limit.Allow()) {
+    return;
+  }
+  LogRecord record(format);
+  record.Suppressed(limit.TakeSuppressed());
+  AddLogFields(record, fields...);
+}
+
+#endif /* LOG_H */
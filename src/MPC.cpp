@@ -1,305 +1,834 @@
 #include "MPC.h"
-#include <cppad/cppad.hpp>
-#include <cppad/ipopt/solve.hpp>
+#include "FG_eval.h"
+#include "LinearSolverThreads.h"
+#include "Log.h"
+#include "MPC_NLP.h"
+#include "ReferenceTable.h"
+#include <coin/IpIpoptApplication.hpp>
 #include "Eigen-3.3/Eigen/Core"
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <iostream>
+#include <thread>
+#include <type_traits>
 #include <utility>
 
-using CppAD::AD;
+// Slack above which a soft constrained plan violates the model, the
+// feasibility tolerance of Ipopt
+static const double kSlackTolerance = 1e-4;
 
-// Set the timestep length and duration
-// size_t: type returned by sizeof, widely used to represent sizes and counts
-const size_t N = 15;
-const double dt = 0.1;
-
-// Set cost factors
-/// Tune cost factors
-const int cost_cte_factor = 3000;
-const int cost_epsi_factor = 500; // made initial portion etc much less snaky
-const int cost_v_factor = 1;
-const int cost_current_delta_factor = 1;
-const int cost_diff_delta_factor = 200;
-const int cost_current_a_factor = 1;
-const int cost_diff_a_factor = 1;
-
-// This value assumes the model presented in the classroom is used.
 //
-// It was obtained by measuring the radius formed by running the vehicle in the
-// simulator around in a circle with a constant steering angle and velocity on a
-// flat terrain.
-//
-// Lf was tuned until the the radius formed by the simulating the model
-// presented in the classroom matched the previous radius.
+// MPC class definition implementation.
 //
-// This is the length from front to CoG that has a similar radius.
-const double Lf = 2.67;
-
-// Reference cross-track error and orientation error = 0
-double ref_cte = 0;
-double ref_epsi = 0;
-double ref_v = 40;
-
-// Mark when each variable starts for convenience
-// since state and actuator variables are stored in one vector
-// in the format 'x...(N)x y...(N)y...'
-const size_t x_start = 0;
-const size_t y_start = x_start + N;
-const size_t psi_start = y_start + N;
-const size_t v_start = psi_start + N;
-const size_t cte_start = v_start + N;
-const size_t epsi_start = cte_start + N;
-const size_t delta_start = epsi_start + N;
-const size_t a_start = delta_start + N - 1;
-
-
-class FG_eval {
-public:
-  // Fitted polynomial coefficients
-  Eigen::VectorXd coeffs;
-
-  explicit FG_eval(Eigen::VectorXd coeffs) { this->coeffs = std::move(coeffs); }
-
-  typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
-  void operator()(ADvector& fg, const ADvector& vars) {
-    /* Calculates cost of current state and predicts future states.
-
-     */
-    // fg is a vector of cost and constraints,
-    // vars is a vector containing state and actuator var values and constraints.
-    // NOTE: You'll probably go back and forth between this function and
-    // the Solver function below.
-    //
-    // Reference state cost
-    //
-
-    // Initialise cost to zero
-    fg[0] = 0;
-
-    // Cost increases with distance from reference state
-    // Multiply squared devation by 'cost factors' to adjust contribution of each deviation to cost
-    for (size_t i = 0; i < N; i++) {
-      fg[0] += cost_cte_factor*pow(vars[cte_start + i] - ref_cte, 2);
-      fg[0] += cost_epsi_factor*pow(vars[epsi_start + i] - ref_epsi, 2);
-      fg[0] += cost_v_factor*pow(vars[v_start + i] - ref_v, 2);
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+MPC<N, Dt, Blocks, I, Vehicle>::MPC(Derivatives derivatives, HessianApproximation hessian)
+    : nlp_(new MPC_NLP<H>()) {
+  prev_x_.fill(0.0);
+  prev_z_l_.fill(0.0);
+  prev_z_u_.fill(0.0);
+  prev_lambda_.fill(0.0);
+
+  if (derivatives != Derivatives::kTape) {
+    UseDerivatives(derivatives);
+  }
+  // After the check against the tape, which compares exact Hessians
+  nlp_->SetGaussNewtonHessian(hessian == HessianApproximation::kGaussNewton);
+  SetupIpopt();
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+MPC<N, Dt, Blocks, I, Vehicle>::MPC(const MPC &prototype)
+    : nlp_(new MPC_NLP<H>(*prototype.nlp_)),
+      options_(prototype.options_),
+      jump_(prototype.jump_) {
+  CopySettings(prototype);
+  if (prototype.database_) {
+    database_.reset(new SolutionDatabase(*prototype.database_));
+  }
+  if (prototype.track_cache_) {
+    track_cache_.reset(new TrackSolutionCache(*prototype.track_cache_));
+  }
+  prev_x_.fill(0.0);
+  prev_z_l_.fill(0.0);
+  prev_z_u_.fill(0.0);
+  prev_lambda_.fill(0.0);
+  SetupIpopt();
+  if (prototype.effort_) {
+    effort_.reset(new EffortController(*prototype.effort_));
+    ApplyEffort();
+  }
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+std::unique_ptr<MPCBase> MPC<N, Dt, Blocks, I, Vehicle>::Clone() const {
+  return std::unique_ptr<MPCBase>(new MPC(*this));
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+SolverFootprint MPC<N, Dt, Blocks, I, Vehicle>::Footprint() const {
+  SolverFootprint footprint;
+  // The plans, multipliers and starting points are arrays of the object;
+  // the past solutions are each a key and the actuations of the blocks
+  footprint.workspace_bytes = sizeof(*this) + recalled_.size() * sizeof(double);
+  if (database_) {
+    footprint.workspace_bytes +=
+        database_->size() * (sizeof(SolutionDatabase::Key) + sizeof(size_t) +
+                             sizeof(std::vector<double>) + 2 * H::n_blocks * sizeof(double));
+  }
+  if (track_cache_) {
+    footprint.workspace_bytes += track_cache_->bytes();
+  }
+  nlp_->Footprint(footprint);
+  return footprint;
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::SetupIpopt() {
+  //
+  // NOTE: You don't have to worry about these options
+  //
+  // options for IPOPT solver, parsed once
+  app_ = IpoptApplicationFactory();
+  // Uncomment this if you'd like more print information
+  app_->Options()->SetIntegerValue("print_level", 0);
+  app_->Options()->SetStringValue("sb", "yes");
+  // NOTE: Currently the solver has a maximum time limit of 0.5 seconds.
+  // It is CPU time and only a backstop, the wall-clock deadline of a Solve
+  // is max_solve_time.
+  app_->Options()->SetNumericValue("max_cpu_time", 0.5);
+  // Pushes used when the multipliers of the last solve are reused
+  app_->Options()->SetNumericValue("warm_start_bound_push", 1e-6);
+  app_->Options()->SetNumericValue("warm_start_slack_bound_push", 1e-6);
+  app_->Options()->SetNumericValue("warm_start_mult_bound_push", 1e-6);
+  // The first stage is fixed by its bounds, take it out of the problem (the
+  // default, but the formulation relies on it)
+  app_->Options()->SetStringValue("fixed_variable_treatment", "make_parameter");
+  // Those of the host, see SetIpoptOptions
+  ApplyOptions();
+
+  // Loads the linear solver once
+  Ipopt::ApplicationReturnStatus status = app_->Initialize();
+  if (status != Ipopt::Solve_Succeeded) {
+    std::cerr << "Ipopt failed to initialize" << std::endl;
+  }
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::ControlEffort(const EffortPolicy &policy) {
+  effort_.reset(new EffortController(policy, IpoptEffortLevels()));
+  ApplyEffort();
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::ApplyEffort() {
+  const EffortLevel &level = effort_->setpoint();
+  app_->Options()->SetNumericValue("tol", level.tol);
+  app_->Options()->SetNumericValue("acceptable_tol", level.acceptable_tol);
+  app_->Options()->SetIntegerValue("max_iter", level.max_iter);
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::SetTolerances(double tolerance, int max_iterations) {
+  if (tolerance > 0) {
+    app_->Options()->SetNumericValue("tol", tolerance);
+  }
+  if (max_iterations > 0) {
+    app_->Options()->SetIntegerValue("max_iter", max_iterations);
+  }
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::ApplyOptions() {
+  const std::pair<const char *, const std::string *> values[] = {
+      {"linear_solver", &options_.linear_solver},
+      {"mu_strategy", &options_.mu_strategy},
+      {"hessian_approximation", &options_.hessian}};
+  for (const auto &value : values) {
+    if (!value.second->empty()) {
+      app_->Options()->SetStringValue(value.first, *value.second);
+    }
+  }
+  nlp_->SetTapeSparsity(options_.jacobian == "reverse",
+                        options_.coloring.empty() ? "cppad" : options_.coloring,
+                        options_.hessian_coloring.empty() ? "cppad.symmetric"
+                                                          : options_.hessian_coloring);
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::SetIpoptOptions(const IpoptOptions &options) {
+  options_ = options;
+  ApplyOptions();
+  if (nlp_->chunked_threads() > 0) {
+    const size_t threads =
+        options.threads > 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    if (threads != nlp_->chunked_threads()) {
+      nlp_->SetChunkedDerivatives(threads);
     }
+  }
+  // The linear solver is made as Ipopt is set up for a problem
+  app_optimized_ = false;
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::SoftenConstraints(double penalty) {
+  nlp_->SetSoftConstraints(penalty);
+  // The problem has another size, no re-optimization
+  app_optimized_ = false;
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::SaveStart(std::vector<double> &start) const {
+  // The flags and the effort, then the arrays as they were handed to Ipopt
+  start.assign({start_cold_ ? 1.0 : 0.0, start_warm_ ? 1.0 : 0.0, start_level_.tol,
+                start_level_.acceptable_tol, static_cast<double>(start_level_.max_iter)});
+  start.insert(start.end(), start_x_.begin(), start_x_.end());
+  start.insert(start.end(), start_z_l_.begin(), start_z_l_.end());
+  start.insert(start.end(), start_z_u_.begin(), start_z_u_.end());
+  start.insert(start.end(), start_lambda_.begin(), start_lambda_.end());
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+bool MPC<N, Dt, Blocks, I, Vehicle>::RestoreStart(const std::vector<double> &start) {
+  if (start.size() != 5 + 3 * H::n_vars + H::n_constraints) {
+    return false;
+  }
+  start_cold_ = start[0] != 0;
+  start_warm_ = start[1] != 0;
+  // The options of the effort it ran at, if it had a controller
+  if (start[2] > 0) {
+    app_->Options()->SetNumericValue("tol", start[2]);
+    app_->Options()->SetNumericValue("acceptable_tol", start[3]);
+    app_->Options()->SetIntegerValue("max_iter", static_cast<int>(start[4]));
+  }
+  const double *values = start.data() + 5;
+  std::copy(values, values + H::n_vars, start_x_.begin());
+  values += H::n_vars;
+  std::copy(values, values + H::n_vars, start_z_l_.begin());
+  values += H::n_vars;
+  std::copy(values, values + H::n_vars, start_z_u_.begin());
+  values += H::n_vars;
+  std::copy(values, values + H::n_constraints, start_lambda_.begin());
+  restored_ = true;
+  return true;
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::SaveCaches(std::vector<double> &caches) const {
+  caches.clear();
+  const size_t solutions = database_ ? database_->size() : 0;
+  caches.push_back(static_cast<double>(solutions));
+  for (size_t k = 0; k < solutions; k++) {
+    const SolutionDatabase::Key &key = database_->key(k);
+    const std::vector<double> &actuations = database_->actuations(k);
+    caches.insert(caches.end(), key.begin(), key.end());
+    caches.insert(caches.end(), actuations.begin(), actuations.end());
+  }
+  caches.push_back(static_cast<double>(track_cache_ ? track_cache_->size() : 0));
+  if (track_cache_) {
+    track_cache_->Save(caches);
+  }
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+bool MPC<N, Dt, Blocks, I, Vehicle>::RestoreCaches(const std::vector<double> &caches) {
+  // Each entry its key, the progress and speed of its bin for the track,
+  // then the delta of each block and the a
+  const size_t actuations = 2 * H::n_blocks;
+  const size_t solution_size = SolutionDatabase::n_keys + actuations;
+  const size_t track_size = 2 + actuations;
+  if (caches.empty()) {
+    return false;
+  }
+  const size_t solutions = static_cast<size_t>(caches[0]);
+  const size_t track_at = 1 + solutions * solution_size;
+  if (track_at >= caches.size() ||
+      caches.size() != track_at + 1 + static_cast<size_t>(caches[track_at]) * track_size) {
+    return false;
+  }
+  const size_t bins = static_cast<size_t>(caches[track_at]);
+  if (database_) {
+    for (size_t k = 0; k < solutions; k++) {
+      const double *entry = caches.data() + 1 + k * solution_size;
+      SolutionDatabase::Key key;
+      std::copy(entry, entry + SolutionDatabase::n_keys, key.begin());
+      database_->Insert(key, std::vector<double>(entry + SolutionDatabase::n_keys,
+                                                 entry + solution_size));
+    }
+  }
+  if (track_cache_) {
+    for (size_t k = 0; k < bins; k++) {
+      const double *entry = caches.data() + track_at + 1 + k * track_size;
+      track_cache_->Insert(entry[0], entry[1], entry + 2);
+    }
+  }
+  return true;
+}
 
-    // Cost increases with use of actuators
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::SampleReference(bool sampled) {
+  if (sampled == nlp_->sampled_reference()) {
+    return;
+  }
+  if (nlp_->analytic_derivatives() || nlp_->autodiff_derivatives() ||
+      nlp_->chunked_threads() > 0 || nlp_->compiled_derivatives()) {
+    std::cerr << "The sampled reference is differentiated on the tape, using CppAD"
+              << std::endl;
+  }
+  const bool gauss_newton = nlp_->gauss_newton_hessian();
+  const double soft_penalty = nlp_->soft_penalty();
+  nlp_ = new MPC_NLP<H>(sampled, 3, nlp_->checkpoint_stages());
+  nlp_->SetGaussNewtonHessian(gauss_newton);
+  nlp_->SetSoftConstraints(soft_penalty);
+  // Another tape and another problem, no re-optimization
+  app_optimized_ = false;
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::SetReferenceOrder(size_t order) {
+  order = std::min<size_t>(std::max<size_t>(order, 1), 3);
+  if (order == nlp_->reference_order() || nlp_->sampled_reference() ||
+      nlp_->analytic_derivatives() || nlp_->autodiff_derivatives() ||
+      nlp_->chunked_threads() > 0 || nlp_->compiled_derivatives()) {
+    return;
+  }
+  order_nlps_[nlp_->reference_order() - 1] = nlp_;
+  Ipopt::SmartPtr<MPC_NLP<H> > &nlp = order_nlps_[order - 1];
+  if (Ipopt::IsNull(nlp)) {
+    nlp = new MPC_NLP<H>(false, order, nlp_->checkpoint_stages());
+  }
+  nlp->TakeSettings(*nlp_);
+  nlp_ = nlp;
+  // Another tape and another problem, no re-optimization
+  app_optimized_ = false;
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::CheckpointStages(bool checkpoint) {
+  if (checkpoint == nlp_->checkpoint_stages()) {
+    return;
+  }
+  Ipopt::SmartPtr<MPC_NLP<H> > nlp =
+      new MPC_NLP<H>(nlp_->sampled_reference(), nlp_->reference_order(), checkpoint);
+  if (checkpoint && !nlp->checkpoint_stages()) {
+    Log(LogLevel::kWarning, "The stage functions can't be made on a solver thread, recording "
+                            "every stage");
+    return;
+  }
+  nlp->TakeSettings(*nlp_);
+  if (nlp_->analytic_derivatives()) {
+    nlp->SetAnalyticDerivatives(true);
+  }
+  if (nlp_->autodiff_derivatives()) {
+    nlp->SetAutoDiffDerivatives(true);
+  }
+  if (nlp_->chunked_threads() > 0) {
+    nlp->SetChunkedDerivatives(nlp_->chunked_threads());
+  }
+  if (nlp_->compiled_derivatives()) {
+    nlp->SetCompiledDerivatives(true);
+  }
+  nlp_ = nlp;
+  for (Ipopt::SmartPtr<MPC_NLP<H> > &order_nlp : order_nlps_) {
+    order_nlp = Ipopt::SmartPtr<MPC_NLP<H> >();
+  }
+  // Another tape, no re-optimization
+  app_optimized_ = false;
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::LinearizeReferenceAlong(const MPCState &state,
+                                                    const MPCCoeffs &coeffs, bool cold) {
+  for (size_t t = 0; t + 1 < N; t++) {
+    const double x = cold ? state[0] + state[3] * cos(state[2]) * H::time(t)
+                          : start_x_[H::x_start + t];
+    reference_[t] = reference_table ? LinearizeReference(*reference_table, x)
+                                    : LinearizeReference(coeffs, x);
+  }
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+MPC<N, Dt, Blocks, I, Vehicle>::~MPC() = default;
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::UseDerivatives(Derivatives derivatives) {
+  // Compare with the tape at an arbitrary curved, moving point with nonzero
+  // multipliers, and keep the tape if they disagree.
+  MPCState state;
+  state << 1.5, -0.2, 0.05, 20, 0.3, -0.1;
+  MPCCoeffs coeffs;
+  coeffs << 0.4, -0.1, 0.02, -0.003;
+  // Weights apart from each other, so a mixed up weight shows
+  CostWeights weights;
+  weights.cte = 2100;
+  weights.epsi = 650;
+  weights.v = 1.5;
+  weights.current_delta = 3;
+  weights.current_a = 7;
+  weights.diff_delta = 170;
+  weights.diff_a = 11;
+  weights.terminal_cte = 900;
+  weights.terminal_epsi = 4000;
+  weights.terminal_delta = 60;
+  weights.terminal_cte_epsi = 1300;
+  weights.terminal_cte_delta = -40;
+  weights.terminal_epsi_delta = -250;
+  weights.terminal_v = 9;
+  nlp_->SetParameters(state, coeffs, weights);
+
+  VarArray x;
+  ConstraintArray lambda;
+  for (size_t i = 0; i < H::n_vars; i++) {
+    x[i] = 0.3 * sin(0.7 * i) + (i >= H::v_start && i < H::cte_start ? 20 : 0);
+  }
+  for (size_t i = 0; i < H::n_constraints; i++) {
+    lambda[i] = cos(1.3 * i);
+  }
+
+  const bool analytic = derivatives == Derivatives::kAnalytic;
+  if (analytic && (I != Integrator::kEuler || !std::is_same<Vehicle, KinematicBicycle>::value)) {
+    std::cerr << "The analytic derivatives are those of the Euler step of the kinematic model, "
+                 "using CppAD"
+              << std::endl;
+    return;
+  }
+  const char *name = "Compiled";
+  if (analytic) {
+    name = "Analytic";
+    nlp_->SetAnalyticDerivatives(true);
+  } else if (derivatives == Derivatives::kAutoDiff) {
+    name = "AutoDiff";
+    nlp_->SetAutoDiffDerivatives(true);
+  } else if (derivatives == Derivatives::kChunked) {
+    name = "Chunked";
+    nlp_->SetChunkedDerivatives(std::max(1u, std::thread::hardware_concurrency()));
+  } else if (!nlp_->SetCompiledDerivatives(true)) {
+    std::cerr << "Using CppAD" << std::endl;
+    return;
+  }
+  const double error = nlp_->CheckDerivatives(x.data(), 0.5, lambda.data());
+  if (error > 1e-8) {
+    std::cerr << name << " derivatives differ from CppAD by " << error << ", using CppAD"
+              << std::endl;
+    nlp_->SetAnalyticDerivatives(false);
+    nlp_->SetAutoDiffDerivatives(false);
+    nlp_->SetChunkedDerivatives(0);
+    nlp_->SetCompiledDerivatives(false);
+  }
+}
+
+// Shift one block of a vector stored like vars ('x...(N)x y...(N)y...') one
+// stage towards the present, holding the last stage.
+template <class Array>
+static void ShiftBlock(const Array &prev, Array &next, size_t start, size_t len) {
+  for (size_t i = 0; i + 1 < len; i++) {
+    next[start + i] = prev[start + i + 1];
+  }
+  next[start + len - 1] = prev[start + len - 1];
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::KeepSolutions(size_t capacity, double jump) {
+  database_.reset(capacity > 0 ? new SolutionDatabase(capacity) : nullptr);
+  jump_ = jump;
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::KeepTrackSolutions(size_t capacity) {
+  track_cache_.reset(capacity > 0 ? new TrackSolutionCache(capacity, 2 * H::n_blocks) : nullptr);
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+bool MPC<N, Dt, Blocks, I, Vehicle>::Recall(const SolutionDatabase::Key &key, double v) {
+  // A failed solve left the shifted plan before it, no better a start
+  if (has_prev_x_ && status_ != SolveStatus::kFailed) {
+    // The second stage of the last plan is where the car should be now, the
+    // first after RepeatTick
+    const size_t now = repeat_ ? 0 : 1;
+    MPCState predicted;
+    for (size_t k = 0; k < 6; k++) {
+      predicted[k] = prev_x_[k * N + now];
+    }
+    // The polynomial doesn't enter StateDistance
+    const SolutionDatabase::Key expected =
+        SolutionDatabase::MakeKey(predicted, MPCCoeffs::Zero());
+    if (SolutionDatabase::StateDistance(key, expected) <= jump_) {
+      return false;
+    }
+  }
+  // The bin of the track tells the corners apart, the key doesn't
+  const double *binned = track_cache_ ? track_cache_->Find(track_position_, v) : nullptr;
+  if (binned != nullptr) {
+    recalled_.assign(binned, binned + 2 * H::n_blocks);
+    return true;
+  }
+  const std::vector<double> *actuations = database_ ? database_->Nearest(key) : nullptr;
+  if (actuations == nullptr) {
+    return false;
+  }
+  recalled_ = *actuations;
+  return true;
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::WarmStart(const MPCState &state, const MPCCoeffs &coeffs,
+                           VarArray &vars) const {
+  constexpr size_t x_start = H::x_start;
+  constexpr size_t y_start = H::y_start;
+  constexpr size_t psi_start = H::psi_start;
+  constexpr size_t v_start = H::v_start;
+  constexpr size_t cte_start = H::cte_start;
+  constexpr size_t epsi_start = H::epsi_start;
+  constexpr size_t delta_start = H::delta_start;
+  constexpr size_t a_start = H::a_start;
+  constexpr size_t n_vars = H::n_vars;
+
+  if (seeded_ || recall_) {
+    // Hold the seed over the horizon, or take the recalled actuations, each
+    // stage its model step
+    for (size_t b = 0; b < H::n_blocks; b++) {
+      vars[delta_start + b] = seeded_ ? seed_delta_ : recalled_[b];
+      vars[a_start + b] = seeded_ ? seed_a_ : recalled_[H::n_blocks + b];
+    }
+    MPCState z = state;
+    for (size_t t = 0; t < N; t++) {
+      for (size_t k = 0; k < 6; k++) {
+        vars[x_start + k * N + t] = z[k];
+      }
+      if (t + 1 < N) {
+        const size_t b = H::block(t);
+        z = ModelStep<I, Vehicle>(z, vars[delta_start + b], vars[a_start + b], coeffs,
+                                  H::step(t));
+      }
+    }
+  } else if (!has_prev_x_) {
+    // Cold start: SHOULD BE 0 besides initial state.
+    vars.fill(0.0);
+  } else if (repeat_) {
+    // The previous plan is for this tick already. Move it rigidly until its
+    // first stage lands on the initial state, without shifting it.
+    const double ox = prev_x_[x_start];
+    const double oy = prev_x_[y_start];
+    const double dpsi = state[2] - prev_x_[psi_start];
+    const double c = cos(dpsi);
+    const double s = sin(dpsi);
+    vars = prev_x_;
+    for (size_t i = 0; i < N; i++) {
+      const double px = prev_x_[x_start + i] - ox;
+      const double py = prev_x_[y_start + i] - oy;
+      vars[x_start + i] = state[0] + c * px - s * py;
+      vars[y_start + i] = state[1] + s * px + c * py;
+      vars[psi_start + i] = prev_x_[psi_start + i] + dpsi;
+    }
+  } else {
+    // The previous plan is expressed in the vehicle frame of the last tick.
+    // Its second stage is where the car is now, so move the whole plan
+    // rigidly until that stage lands on the new initial state.
+    const double ox = prev_x_[x_start + 1];
+    const double oy = prev_x_[y_start + 1];
+    const double dpsi = state[2] - prev_x_[psi_start + 1];
+    const double c = cos(dpsi);
+    const double s = sin(dpsi);
+
+    // Shift every stage one step towards the present. With a StepSchedule
+    // the stages don't line up after the shift, it is only a rougher start.
     for (size_t i = 0; i < N - 1; i++) {
-      fg[0] += cost_current_delta_factor*pow(vars[delta_start + i], 2);
-      fg[0] += cost_current_a_factor*pow(vars[a_start + i], 2);
+      const double px = prev_x_[x_start + i + 1] - ox;
+      const double py = prev_x_[y_start + i + 1] - oy;
+      vars[x_start + i] = state[0] + c * px - s * py;
+      vars[y_start + i] = state[1] + s * px + c * py;
+      vars[psi_start + i] = prev_x_[psi_start + i + 1] + dpsi;
+      vars[v_start + i] = prev_x_[v_start + i + 1];
+      vars[cte_start + i] = prev_x_[cte_start + i + 1];
+      vars[epsi_start + i] = prev_x_[epsi_start + i + 1];
     }
-
-    // Cost increases with value gap between sequential actuators
-    for (size_t i=0; i < N-2; i++) {
-      fg[0] += cost_diff_delta_factor*pow(vars[delta_start + i + 1] - vars[delta_start + i], 2);
-      fg[0] += cost_diff_a_factor*pow(vars[a_start + i + 1] - vars[a_start + i], 2);
+    for (size_t b = 0; b < H::n_blocks; b++) {
+      vars[delta_start + b] = prev_x_[delta_start + H::shifted_block(b)];
+      vars[a_start + b] = prev_x_[a_start + H::shifted_block(b)];
     }
 
-    //
-    // Constraints
-    //
-
-    // Set initial state (take from vars)
-    // Add 1 to each of the starting indices since cost is at fg[0]
-    fg[1 + x_start] = vars[x_start];
-    fg[1 + y_start] = vars[y_start];
-    fg[1 + psi_start] = vars[psi_start];
-    fg[1 + v_start] = vars[v_start];
-    fg[1 + cte_start] = vars[cte_start];
-    fg[1 + epsi_start] = vars[epsi_start];
-
-    // Set predicted states at other timesteps (from eqns)
-    // N - 1 because we're only predicting (N-1) times
-    for (size_t i = 0; i < N - 1; i++) {
-      // The state at time t+1 .
-      const AD<double> x1 = vars[x_start + i + 1];
-      const AD<double> y1 = vars[y_start + i + 1];
-      const AD<double> psi1 = vars[psi_start + i + 1];
-      const AD<double> v1 = vars[v_start + i + 1];
-      const AD<double> cte1 = vars[cte_start + i + 1];
-      const AD<double> epsi1 = vars[epsi_start + i + 1];
-
-      // The state at time t.
-      const AD<double> x0 = vars[x_start + i];
-      const AD<double> y0 = vars[y_start + i];
-      const AD<double> psi0 = vars[psi_start + i];
-      const AD<double> v0 = vars[v_start + i];
-      const AD<double> cte0 = vars[cte_start + i];
-      const AD<double> epsi0 = vars[epsi_start + i];
-
-      // Only consider the actuation at time t.
-      const AD<double> delta0 = vars[delta_start + i];
-      const AD<double> a0 = vars[a_start + i];
-
-      const AD<double> f0 = coeffs[0] + coeffs[1] * x0 + coeffs[2] * CppAD::pow(x0,2) + coeffs[3] * CppAD::pow(x0,3);
-      const AD<double> psides0 = CppAD::atan(coeffs[1] + (2 * coeffs[2] * x0) + (3 * coeffs[3]* CppAD::pow(x0,2) ));
-
-      // Fill in fg with differences between actual and predicted states
-      // add 2 to indices because (+1) from cost and (+1) because logging error of prediction (next timestep)
-      // Recall the equations for the model:
-      // x_[t]    = x[t-1]    + v[t-1] * cos(psi[t-1]) * dt
-      // y_[t]    = y[t-1]    + v[t-1] * sin(psi[t-1]) * dt
-      // psi_[t]  = psi[t-1]  - v[t-1] / Lf * delta[t-1] * dt
-      // v_[t]    = v[t-1]    + a[t-1] * dt
-      // cte[t]   = f(x[t-1]) - y[t-1]      + v[t-1] * sin(epsi[t-1]) * dt
-      // epsi[t]  = psi[t]    - psides[t-1] - v[t-1] * delta[t-1] / Lf * dt
-      fg[2 + x_start + i] = x1 - (x0 + v0 * CppAD::cos(psi0) * dt);
-      fg[2 + y_start + i] = y1 - (y0 + v0 * CppAD::sin(psi0) * dt);
-      fg[2 + psi_start + i] = psi1 - (psi0 - v0 * delta0 / Lf * dt);
-      fg[2 + v_start + i] = v1 - (v0 + a0 * dt);
-      fg[2 + cte_start + i] =
-          cte1 - ((f0 - y0) + (v0 * CppAD::sin(epsi0) * dt));
-      fg[2 + epsi_start + i] =
-          epsi1 - ((psi0 - psides0) - v0 * delta0 / Lf * dt);
+    // The last actuation is held, extend the tail by one step of the model
+    const double delta0 = vars[a_start - 1];
+    const double a0 = vars[n_vars - 1];
+
+    const size_t t = N - 2;
+    MPCState z;
+    for (size_t k = 0; k < 6; k++) {
+      z[k] = vars[x_start + k * N + t];
     }
+    const MPCState z1 = ModelStep<I, Vehicle>(z, delta0, a0, coeffs, H::step(t));
+    for (size_t k = 0; k < 6; k++) {
+      vars[x_start + k * N + t + 1] = z1[k];
+    }
+  }
 
+  // The first stage is the measured state
+  vars[x_start] = state[0];
+  vars[y_start] = state[1];
+  vars[psi_start] = state[2];
+  vars[v_start] = state[3];
+  vars[cte_start] = state[4];
+  vars[epsi_start] = state[5];
+}
+
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+void MPC<N, Dt, Blocks, I, Vehicle>::WarmStartMultipliers() {
+  if (repeat_) {
+    start_z_l_ = prev_z_l_;
+    start_z_u_ = prev_z_u_;
+    start_lambda_ = prev_lambda_;
+    return;
   }
-};
 
-//
-// MPC class definition implementation.
-//
-MPC::MPC() = default;
+  // Bound multipliers follow the layout of vars. Only the actuators have
+  // finite bounds, the state multipliers are zero.
+  for (size_t b = 0; b < 6; b++) {
+    ShiftBlock(prev_z_l_, start_z_l_, b * N, N);
+    ShiftBlock(prev_z_u_, start_z_u_, b * N, N);
+  }
+  for (size_t b = 0; b < H::n_blocks; b++) {
+    const size_t from = H::shifted_block(b);
+    start_z_l_[H::delta_start + b] = prev_z_l_[H::delta_start + from];
+    start_z_u_[H::delta_start + b] = prev_z_u_[H::delta_start + from];
+    start_z_l_[H::a_start + b] = prev_z_l_[H::a_start + from];
+    start_z_u_[H::a_start + b] = prev_z_u_[H::a_start + from];
+  }
 
-MPC::~MPC() = default;
+  // The 6*(N-1) constraints are stored like the states without the first
+  // stage, one block per state
+  for (size_t b = 0; b < 6; b++) {
+    ShiftBlock(prev_lambda_, start_lambda_, H::constraint_row(b, 0), N - 1);
+  }
+}
 
-vector<double> MPC::Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs) {
+template <size_t N, class Dt, class Blocks, Integrator I, class Vehicle>
+MPCSolution MPC<N, Dt, Blocks, I, Vehicle>::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
   /* Minimises cost. */
-  typedef CPPAD_TESTVECTOR(double) Dvector;
-
-  /// Set the number of model variables (includes both states and inputs).
-  // For example: If the state is a 4 element vector, the actuators is a 2
-  // element vector and there are 10 timesteps. The number of variables is:
-  //
-  // 4 * 10 + 2 * 9
-  // State: [x,y,psi,v,cte,epsi]
-  // Actuators: [delta,a]
-  size_t n_vars = 6 * N + 2 * (N - 1);
-  ///Set the number of constraints
-  size_t n_constraints = 6 * N;
-
-  // Initial value of the independent variables.
-  // SHOULD BE 0 besides initial state.
-  Dvector vars(n_vars);
-  for (size_t i = 0; i < n_vars; i++) {
-    vars[i] = 0.0;
-  }
-  // Get init state
-  const double x = state[0];
-  const double y = state[1];
-  const double psi = state[2];
-  const double v = state[3];
-  const double cte = state[4];
-  const double epsi = state[5];
-
-  // Set initial variable values to init state
-  // but will be implicitly set by upper and lower bounds later so can remove this
-  vars[x_start] = x;
-  vars[y_start] = y;
-  vars[psi_start] = psi;
-  vars[v_start] = v;
-  vars[cte_start] = cte;
-  vars[epsi_start] = epsi;
-
-  Dvector vars_lowerbound(n_vars);
-  Dvector vars_upperbound(n_vars);
-  ///Setting the lower and upper limits for variables
-  for (size_t i = 0; i < delta_start; i++) {
-    vars_upperbound[i] = 1.0e19;
-    vars_lowerbound[i] = -1.0e19;
-  }
-
-  // Steering angle (deltas)
-  for (size_t i = delta_start; i < a_start; i++)
-  {
-    vars_upperbound[i] = M_PI/8; // max values allowed in simulator
-    vars_lowerbound[i] = -M_PI/8;
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  if (options_.linear_solver_threads > 0) {
+    SetLinearSolverThreads(options_.linear_solver_threads);
   }
 
-  // Acceleration
-  for (size_t i = a_start; i < n_vars; i++)
-  {
-    vars_upperbound[i] = 1.0;
-    vars_lowerbound[i] = -1.0;
-  }
-
-  // Lower and upper limits for the constraints
-  // Should be 0 besides initial state.
-  Dvector constraints_lowerbound(n_constraints);
-  Dvector constraints_upperbound(n_constraints);
-  for (size_t i = 0; i < n_constraints; i++) {
-    constraints_lowerbound[i] = 0;
-    constraints_upperbound[i] = 0;
-  }
-  // Set init state lower and upper limits
-  constraints_lowerbound[x_start] = x;
-  constraints_lowerbound[y_start] = y;
-  constraints_lowerbound[psi_start] = psi;
-  constraints_lowerbound[v_start] = v;
-  constraints_lowerbound[cte_start] = cte;
-  constraints_lowerbound[epsi_start] = epsi;
-
-  constraints_upperbound[x_start] = x;
-  constraints_upperbound[y_start] = y;
-  constraints_upperbound[psi_start] = psi;
-  constraints_upperbound[v_start] = v;
-  constraints_upperbound[cte_start] = cte;
-  constraints_upperbound[epsi_start] = epsi;
-
-  // object that computes objective and constraints
-  FG_eval fg_eval(std::move(coeffs));
-
-  //
-  // NOTE: You don't have to worry about these options
-  //
-  // options for IPOPT solver
-  std::string options;
-  // Uncomment this if you'd like more print information
-  options += "Integer print_level  0\n";
-  // NOTE: Setting sparse to true allows the solver to take advantage
-  // of sparse routines, this makes the computation MUCH FASTER. If you
-  // can uncomment 1 of these and see if it makes a difference or not but
-  // if you uncomment both the computation time should go up in orders of
-  // magnitude.
-  options += "Sparse  true        forward\n";
-  options += "Sparse  true        reverse\n";
-  // NOTE: Currently the solver has a maximum time limit of 0.5 seconds.
-  // Change this as you see fit.
-  options += "Numeric max_cpu_time          0.5\n";
+  // Wall-clock deadline of this call, enforced between Ipopt iterations
+  nlp_->SetDeadline(start +
+                    std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double>(max_solve_time)));
+  nlp_->SetPreempt(preempt);
+  nlp_->SetKKTDump(kkt_dump_);
+
+  // Start from the seed, a past solution where the last plan is a poor
+  // start, or the shifted previous plan, unless the start was restored as
+  // it is
+  const SolutionDatabase::Key key = SolutionDatabase::MakeKey(state, coeffs);
+  const bool restored = restored_;
+  const bool seeded = seeded_;
+  if (!restored_) {
+    recall_ = !seeded_ && (database_ || track_cache_) && Recall(key, state[3]);
+    WarmStart(state, coeffs, start_x_);
+    start_cold_ = !has_prev_x_ && !seeded_ && !recall_;
+    start_warm_ = has_prev_x_ && !seeded_ && !recall_;
+    if (start_warm_) {
+      WarmStartMultipliers();
+    }
+  }
+  nlp_->SetStartingPoint(start_x_.data());
 
+  // Swap the initial state, the coefficients and the scheduled weights into
+  // the recorded tape, or the reference sampled along the starting point
+  const bool sampled = nlp_->sampled_reference();
+  if (sampled) {
+    LinearizeReferenceAlong(state, coeffs, start_cold_);
+  }
+  nlp_->SetParameters(state, coeffs, cost_schedule.At(state[3]),
+                      sampled ? reference_.data() : nullptr);
+  const bool warm = start_warm_;
+  if (warm) {
+    nlp_->SetStartingMultipliers(start_z_l_.data(), start_z_u_.data(), start_lambda_.data());
+  }
+  if (effort_) {
+    start_level_ = effort_->setpoint();
+  }
+  restored_ = false;
+  seeded_ = false;
+  repeat_ = false;
+
+  // Reuse the multipliers of the last solve when there is one. Setting an
+  // option builds strings in the option list, so only when it changes.
+  if (warm != warm_start_option_) {
+    app_->Options()->SetStringValue("warm_start_init_point", warm ? "yes" : "no");
+    warm_start_option_ = warm;
+  }
 
-  // place to return solution
-  CppAD::ipopt::solve_result<Dvector> solution;
+  // solve the problem, the structure never changes after the first one
+  double optimized = 0;
+  PerfCounts optimized_events;
+  Ipopt::ApplicationReturnStatus returned = Ipopt::Internal_Error;
+  {
+    MPC_SCOPED_PHASE(optimized, optimized_events);
+    if (app_optimized_) {
+      returned = app_->ReOptimizeTNLP(nlp_);
+    } else {
+      returned = app_->OptimizeTNLP(nlp_);
+      app_optimized_ = true;
+    }
+  }
+  // Of Ipopt's time, that outside the callbacks goes mostly to factoring
+  // and solving the KKT systems
+  SolveStatistics statistics = nlp_->statistics();
+  SolvePhases &phases = statistics.phases;
+  phases.linear_solve = std::max(0.0, optimized - phases.model - phases.derivatives);
+  phases.linear_solve_events = optimized_events;
+  phases.linear_solve_events -= phases.model_events;
+  phases.linear_solve_events -= phases.derivative_events;
+  statistics.solver_status = static_cast<int>(nlp_->status());
+  statistics.start = restored      ? SolveStart::kRestored
+                     : seeded      ? SolveStart::kSeeded
+                     : recall_     ? SolveStart::kRecalled
+                     : start_warm_ ? SolveStart::kWarm
+                                   : SolveStart::kCold;
+
+  iterations_ = nlp_->iterations();
+  statistics.iterations = iterations_;
+  if (nlp_->max_slack() > kSlackTolerance) {
+    slack_activations_++;
+  }
+  if (nlp_->restored()) {
+    restorations_++;
+  }
 
-  // solve the problem
-  CppAD::ipopt::solve<Dvector, FG_eval>(
-      options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
-      constraints_upperbound, fg_eval, solution);
+  // Check some of the solution values. Ipopt stops before the first
+  // iterate on an error of its setup, e.g. without the linear solver of its
+  // options, and nothing of nlp_ is then of this solve.
+  const bool iterated = returned > Ipopt::Not_Enough_Degrees_Of_Freedom;
+  bool ok = iterated;
+  ok &= nlp_->status() == Ipopt::SUCCESS || nlp_->status() == Ipopt::STOP_AT_ACCEPTABLE_POINT;
+  if (ok) {
+    status_ = SolveStatus::kSolved;
+  } else if (iterated &&
+             (nlp_->deadline_expired() || nlp_->status() == Ipopt::MAXITER_EXCEEDED) &&
+             nlp_->has_feasible_iterate()) {
+    // Out of time, or of the iterations the effort controller allows
+    status_ = SolveStatus::kDeadline;
+  } else {
+    status_ = SolveStatus::kFailed;
+  }
 
-  // Check some of the solution values
-  bool ok = true;
-  ok &= solution.status == CppAD::ipopt::solve_result<Dvector>::success;
+  // Keep the plan for the next warm start. A failed solve is a poor seed,
+  // fall back to the shifted previous plan and keep its multipliers.
+  if (status_ == SolveStatus::kFailed) {
+    prev_x_ = start_x_;
+  } else {
+    const typename MPC_NLP<H>::Dvector &solution = nlp_->solution();
+    for (size_t i = 0; i < H::n_vars; i++) {
+      prev_x_[i] = solution[i];
+      prev_z_l_[i] = nlp_->solution_z_l()[i];
+      prev_z_u_[i] = nlp_->solution_z_u()[i];
+    }
+    for (size_t i = 0; i < H::n_constraints; i++) {
+      prev_lambda_[i] = nlp_->solution_lambda()[i];
+    }
+    has_prev_x_ = true;
+  }
+  if (database_ && status_ == SolveStatus::kSolved) {
+    database_->Insert(key, std::vector<double>(prev_x_.begin() + H::delta_start, prev_x_.end()));
+  }
+  if (track_cache_ && status_ == SolveStatus::kSolved) {
+    track_cache_->Insert(track_position_, state[3], prev_x_.data() + H::delta_start);
+  }
 
+  if (effort_ && effort_->Record(std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start).count())) {
+    ApplyEffort();
+  }
 
   // Cost
-  auto cost = solution.obj_value;
-  std::cout << "Cost " << cost << std::endl;
-
-  ///Return the first actuator values. The variables can be accessed with
-  // `solution.x[i]`.
-  //
-  // {...} is shorthand for creating a vector, so auto x1 = {1.0,2.0}
-  // creates a 2 element double vector.
-
-  vector<double> result;
-
-  result.push_back(solution.x[delta_start]);
-  result.push_back(solution.x[a_start]);
-
-  for (size_t i = 0; i < N-1; i++)
-  {
-    result.push_back(solution.x[x_start + i + 1]);
-    result.push_back(solution.x[y_start + i + 1]);
+  cost_ = nlp_->obj_value();
+  Log(LogLevel::kInfo, "Cost {}", cost_);
+  Log(LogLevel::kDebug,
+      "Ipopt: status {}, {} iterations, {} f, {} grad f, {} g, {} jac g, {} h evaluations, {} "
+      "forward sweeps saved, {} restorations",
+      statistics.solver_status, statistics.iterations, statistics.cost_evaluations,
+      statistics.gradient_evaluations, statistics.constraint_evaluations,
+      statistics.jacobian_evaluations, statistics.hessian_evaluations,
+      statistics.forward_sweeps_saved, statistics.restorations);
+
+  // The plan, straight from the solution in the layout of vars
+  MPCSolution plan;
+  plan.stages = N;
+  plan.status = status_;
+  plan.cost = cost_;
+  plan.statistics = statistics;
+  plan.set_times<H>();
+  for (size_t t = 0; t < N; t++) {
+    plan.x[t] = prev_x_[H::x_start + t];
+    plan.y[t] = prev_x_[H::y_start + t];
+    plan.psi[t] = prev_x_[H::psi_start + t];
+    plan.v[t] = prev_x_[H::v_start + t];
+    plan.cte[t] = prev_x_[H::cte_start + t];
+    plan.epsi[t] = prev_x_[H::epsi_start + t];
+  }
+  for (size_t t = 0; t < N - 1; t++) {
+    plan.delta[t] = prev_x_[H::delta_start + H::block(t)];
+    plan.a[t] = prev_x_[H::a_start + H::block(t)];
+  }
+  return plan;
+}
+
+template class MPC<10>;
+template class MPC<15>;
+template class MPC<25>;
+template class MPC<40>;
+template class MPC<15, std::ratio<3, 20> >;
+template class MPC<10, std::ratio<1, 10>, Blocks10>;
+template class MPC<15, std::ratio<1, 10>, Blocks15>;
+template class MPC<25, std::ratio<1, 10>, Blocks25>;
+template class MPC<8, std::ratio<1, 5>, NoBlocking, Integrator::kRK4>;
+template class MPC<11, GradedSteps>;
+template class MPC<15, std::ratio<1, 10>, NoBlocking, Integrator::kEuler, DynamicBicycle>;
+
+std::unique_ptr<MPCBase> MakeMPC(size_t n, Derivatives derivatives, bool move_blocking,
+                                 HessianApproximation hessian, VehicleModel vehicle) {
+  typedef std::ratio<1, 10> Dt;
+  if (vehicle == VehicleModel::kDynamic) {
+    if (n != 15 || move_blocking) {
+      return std::unique_ptr<MPCBase>();
+    }
+    return std::unique_ptr<MPCBase>(
+        new MPC<15, Dt, NoBlocking, Integrator::kEuler, DynamicBicycle>(derivatives, hessian));
+  }
+  switch (n) {
+    case 10:
+      if (move_blocking) {
+        return std::unique_ptr<MPCBase>(new MPC<10, Dt, Blocks10>(derivatives, hessian));
+      }
+      return std::unique_ptr<MPCBase>(new MPC<10>(derivatives, hessian));
+    case 15:
+      if (move_blocking) {
+        return std::unique_ptr<MPCBase>(new MPC<15, Dt, Blocks15>(derivatives, hessian));
+      }
+      return std::unique_ptr<MPCBase>(new MPC<15>(derivatives, hessian));
+    case 25:
+      if (move_blocking) {
+        return std::unique_ptr<MPCBase>(new MPC<25, Dt, Blocks25>(derivatives, hessian));
+      }
+      return std::unique_ptr<MPCBase>(new MPC<25>(derivatives, hessian));
+    case 40:
+      if (move_blocking) {
+        return std::unique_ptr<MPCBase>();
+      }
+      return std::unique_ptr<MPCBase>(new MPC<40>(derivatives, hessian));
+    case 8:
+      if (move_blocking) {
+        return std::unique_ptr<MPCBase>();
+      }
+      return std::unique_ptr<MPCBase>(
+          new MPC<8, std::ratio<1, 5>, NoBlocking, Integrator::kRK4>(derivatives, hessian));
+    case 11:
+      if (move_blocking) {
+        return std::unique_ptr<MPCBase>();
+      }
+      return std::unique_ptr<MPCBase>(new MPC<11, GradedSteps>(derivatives, hessian));
+    default:
+      return std::unique_ptr<MPCBase>();
   }
-  return result;
-}
\ No newline at end of file
+}
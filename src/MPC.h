@@ -1,22 +1,561 @@
 #ifndef MPC_H
 #define MPC_H
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <ratio>
+#include <string>
 #include <vector>
+#include <coin/IpSmartPtr.hpp>
 #include "Eigen-3.3/Eigen/Core"
+#include "CostWeights.h"
+#include "EffortController.h"
+#include "Horizon.h"
+#include "Instrumentation.h"
+#include "KinematicModel.h"
+#include "MPCSolution.h"
+#include "SolutionDatabase.h"
+#include "SolverFootprint.h"
+#include "TrackSolutionCache.h"
+#include "VehicleModel.h"
 
 using namespace std;
 
-class MPC {
+class FrenetReference;
+class KKTDump;
+class LinearizationTable;
+class ReferenceTable;
+template <class H> class MPC_NLP;
+namespace Ipopt {
+class IpoptApplication;
+}
+
+// Where the Ipopt MPC gets the derivatives of the model from
+enum class Derivatives {
+  // The CppAD tape
+  kTape,
+  // Closed form (ModelDerivatives), for the Jacobian and the Hessian
+  kAnalytic,
+  // Forward mode AutoDiffScalar per stage (AutoDiffDerivatives), for the
+  // Jacobian and the Hessian
+  kAutoDiff,
+  // Code generated from the model, compiled and cached on disk
+  // (CompiledModel), for the function values and all the derivatives
+  kCompiled,
+  // CppAD tapes of chunks of the horizon swept concurrently, one per core
+  // (ChunkedTapes), for the Jacobian and the Hessian
+  kChunked
+};
+
+// Lagrangian Hessian the Ipopt MPC hands to Ipopt
+enum class HessianApproximation {
+  // Cost and constraint curvature, from the same source as the derivatives
+  kExact,
+  // Gauss-Newton: the cost alone, in closed form (see
+  // ModelDerivatives::CostHessian)
+  kGaussNewton
+};
+
+// Options of Ipopt that change its speed more than its plans, which one is
+// the fastest depending on the host (see IpoptTuning.h). An empty string
+// leaves the option as it is, Ipopt's default unless set before.
+struct IpoptOptions {
+  // The sparse linear solver of the KKT systems: "mumps", one of HSL's,
+  // "ma27", "ma57", "ma86" or "ma97", or "pardiso", where Ipopt was built
+  // with them or finds libhsl or libpardiso at runtime; Ipopt's default is
+  // the first it was built with
+  std::string linear_solver;
+  // OpenMP threads of the factorizations on the thread of every Solve (see
+  // SetLinearSolverThreads), for the solvers that have them: MA86, MA97,
+  // Pardiso, and MUMPS and the BLAS built with OpenMP; 0 leaves OpenMP's
+  // default, a thread per core for every solver thread
+  size_t linear_solver_threads = 0;
+  // The update of the barrier parameter, "monotone" (the default) or
+  // "adaptive"
+  std::string mu_strategy;
+  // Ipopt's hessian_approximation: "exact" (the default), the Hessian of the
+  // derivatives of the MPC (see HessianApproximation), or "limited-memory",
+  // L-BFGS from the gradients, which spares the Hessian sweeps
+  std::string hessian;
+  // Threads of the chunked derivatives (Derivatives::kChunked), 0 for one
+  // per core; the other derivatives ignore it
+  size_t threads = 0;
+  // How the tape (Derivatives::kTape) evaluates the sparse Jacobian,
+  // "forward" (the default) or "reverse", and colours it, "cppad" (the
+  // default) or "colpack", and the Hessian, "cppad.symmetric" (the
+  // default), "cppad.general", "colpack.symmetric" or "colpack.general"
+  // (see MPC_NLP::SetTapeSparsity); the other derivatives ignore them
+  std::string jacobian;
+  std::string coloring;
+  std::string hessian_coloring;
+};
+
+// The clock of a Solve that times its phases (see SolvePhases): every Lap is the seconds
+// since the one before, or since the clock was made, its hardware events added to events;
+// 0 and no events with the instrumentation off (see Instrumentation.h)
+class PhaseClock {
+ public:
+  PhaseClock() : lap_(InstrumentNow()), lap_events_(ReadPerfCounters()) {}
+  double Lap(PerfCounts &events) {
+    const std::chrono::steady_clock::time_point now = InstrumentNow();
+    const PerfCounts now_events = ReadPerfCounters();
+    const double seconds = std::chrono::duration<double>(now - lap_).count();
+    events += now_events - lap_events_;
+    lap_ = now;
+    lap_events_ = now_events;
+    return seconds;
+  }
+
+ private:
+  std::chrono::steady_clock::time_point lap_;
+  PerfCounts lap_events_;
+};
+
+// Interface shared by every horizon instantiation of MPC, so the horizon can
+// be picked at runtime (see MakeMPC).
+class MPCBase {
 public:
   double prev_a = 0;
 
-  MPC();
+  // Wall-clock time allowed to each Solve, in seconds
+  double max_solve_time = 0.05;
 
-  virtual ~MPC();
+  // A flag that, once set, stops the Solve under way as its deadline would,
+  // e.g. a refinement in idle time that telemetry came in during (see
+  // RefiningMPC); null for none. Not owned.
+  const std::atomic<bool> *preempt = nullptr;
+
+  // Cost weights of each Solve, at the speed of its initial state. They can
+  // change between ticks at no extra cost.
+  CostSchedule cost_schedule;
+
+  // Model Jacobians of the backends that linearize along their plan (SQP,
+  // RTI, ADMM) from this table instead of closed form, null for closed form.
+  // Read only, so any number of MPCs can share it.
+  std::shared_ptr<const LinearizationTable> linearization_table;
+
+  // Reference of the model of the SQP backends, and of the Ipopt MPC with
+  // SampleReference, from this table of the track instead of the polynomial
+  // of each Solve, null for the polynomial. It is in the vehicle frame of
+  // its tick, so it is replaced before every Solve.
+  std::shared_ptr<const ReferenceTable> reference_table;
+
+  // The model of the SQP backends in path coordinates along the curvature
+  // of the track (see FrenetReference), null for the vehicle frame. The
+  // states of Solve and of the plan are then [s, d, mu, v, cte, epsi] from
+  // the vehicle's projection, and the polynomial is unused. Replaced before
+  // every Solve, like reference_table, which it takes the place of.
+  std::shared_ptr<const FrenetReference> frenet_reference;
+
+  virtual ~MPCBase() = default;
 
   // Solve the model given an initial state and polynomial coefficients.
-  // Return the first actuatotions.
-  vector<double> Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs);
+  // Return the plan, the first actuations are delta[0] and a[0].
+  virtual MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) = 0;
+
+  // Work that doesn't need the next measurement. Called once the actuations
+  // of the last Solve are sent, before the next telemetry arrives.
+  virtual void Prepare() {}
+
+  // Forget the plan of the last Solve, so that the next one starts cold.
+  // For an MPC taken back into use after other ticks were solved elsewhere.
+  virtual void Reset() = 0;
+
+  // Number of timesteps of the horizon, and the length of the first in
+  // seconds, that of all of them on a uniform grid
+  virtual size_t horizon_length() const = 0;
+  virtual double timestep() const = 0;
+  // Time of stage t (< horizon_length) from the initial state, in seconds
+  virtual double stage_time(size_t t) const = 0;
+
+  // State at stage t (< horizon_length) and actuations at stage t (<
+  // horizon_length - 1) of the plan of the last Solve, in the vehicle frame of
+  // that Solve
+  virtual MPCState planned_state(size_t t) const = 0;
+  virtual void planned_actuations(size_t t, double &delta, double &a) const = 0;
+
+  // Start the next Solve from the actuations delta, a held over the horizon
+  // and the model rolled out under them, instead of the last plan. Only the
+  // Ipopt MPC takes a starting point, the other backends ignore it.
+  virtual void Seed(double delta, double a) {}
+
+  // Keep the plans of up to capacity past solves, and start a Solve from the
+  // nearest of them (see SolutionDatabase) instead of cold or from the last
+  // plan when the state jumped away from that plan, e.g. after a reset; 0
+  // to keep none again. Only the Ipopt MPC keeps them, the other backends
+  // ignore it.
+  virtual void KeepSolutions(size_t capacity) {}
+
+  // Keep the plans of up to capacity bins of a closed track, by the
+  // progress of SetTrackPosition and the speed (see TrackSolutionCache),
+  // and start a Solve from that of the bin of the car, before the nearest
+  // of KeepSolutions, when the last plan is a poor start: the state jumped
+  // away from it, it failed, or there is none; 0 to keep none again. Only
+  // the Ipopt MPC keeps them, the other backends ignore it.
+  virtual void KeepTrackSolutions(size_t capacity) {}
+  // Progress of the car along the track in m for the next Solve, negative
+  // off any track (see KeepTrackSolutions)
+  virtual void SetTrackPosition(double progress) {}
+
+  // Start the next Solve from the plan of the last one as it is, instead of
+  // shifted by one step: the last Solve was for this same tick, e.g. for a
+  // predicted state (see SpeculativeMPC, RefiningMPC). The Ipopt MPC, SQP,
+  // RTI and iLQR take it, the other backends ignore it.
+  virtual void RepeatTick() {}
+
+  // Adjust the effort of every Solve from the solve times measured so far,
+  // to hold their percentile under the target of policy (see
+  // EffortController). Only the Ipopt MPC has the knobs, the other backends
+  // ignore it.
+  virtual void ControlEffort(const EffortPolicy &policy) {}
+  // The controller, null without ControlEffort
+  virtual const EffortController *effort() const { return nullptr; }
+
+  // Solve with options from now on, in place of those of Ipopt the MPC is
+  // made with; the next Solve sets Ipopt up again. Only the Ipopt MPC has
+  // them, the other backends ignore it.
+  virtual void SetIpoptOptions(const IpoptOptions &options) {}
+
+  // Relax the model constraints with slacks at a cost of penalty per unit,
+  // so that every problem is feasible (see MPC_NLP::SetSoftConstraints); 0
+  // makes them hard again. Only the Ipopt MPC has them, the other backends
+  // ignore it.
+  virtual void SoftenConstraints(double penalty) {}
+  // Solves so far whose plan needed the slacks, a violation of the model
+  // above the feasibility tolerance
+  virtual size_t slack_activations() const { return 0; }
+
+  // Sample the reference at the stages of the starting point of every
+  // Solve and hand the model its linearization about each sample (see
+  // LinearReference) as parameters, instead of evaluating the polynomial
+  // and the atan of its slope inside the model. Only the Ipopt MPC has it,
+  // on the CppAD tape; the other backends ignore it.
+  virtual void SampleReference(bool sampled) {}
+
+  // Take the reference of the next solves as a polynomial of order 1 to 3,
+  // the coefficients above it zero (see ReferenceFitCache::SetAdaptiveOrder),
+  // for the model to leave out their terms. The Ipopt MPC switches to a
+  // tape recorded for the order, once for each order it meets, kept after;
+  // its tape only, so not with the closed form, AutoDiff, chunked or
+  // compiled derivatives or a sampled reference. The other backends ignore
+  // it, and take the coefficients as they are.
+  virtual void SetReferenceOrder(size_t order) {}
+
+  // Record the step of a stage of the model once, as a CppAD checkpoint
+  // function the tape calls for every stage, instead of the operations of
+  // every stage on the tape (see StageCheckpoints): a tape about N times
+  // smaller, recorded and analyzed for its sparsity that much faster, for
+  // the long horizons, its sweeps through the calls a little slower. Only
+  // the Ipopt MPC has a tape; the other backends ignore it.
+  virtual void CheckpointStages(bool checkpoint) {}
+
+  // Write the KKT system of every iteration of the next solves to dump, for
+  // benchmark_kkt to factor (see KKTDump.h); null to stop. Only the Ipopt
+  // MPC factors such a system; the other backends ignore it.
+  virtual void DumpKKT(KKTDump *dump) {}
+
+  // Stop every Solve within tolerance, in the terms of the backend (Ipopt's
+  // tol, the step of the SQP, the IPM and the iLQR, the residuals of the
+  // ADMM), or after max_iterations; either at 0 as it is. The RTI, which
+  // takes one step, and the other backends ignore it, and so does Ipopt
+  // under ControlEffort after its next step of effort.
+  virtual void SetTolerances(double tolerance, int max_iterations) {}
+
+  // What the last Solve started from beyond its arguments, the starting
+  // point, multipliers or working set of the backend and its options, as
+  // numbers in start, for the same Solve to be repeated elsewhere (see
+  // ProblemCapture.h); and the next Solve started from such numbers instead
+  // of the last plan, false if they aren't of this backend and horizon.
+  // Only the Ipopt MPC and the SQP save theirs: the other backends save
+  // none, and repeat a Solve from cold.
+  virtual void SaveStart(std::vector<double> &start) const { start.clear(); }
+  virtual bool RestoreStart(const std::vector<double> &start) {
+    Reset();
+    return start.empty();
+  }
+
+  // The past solutions of KeepSolutions and KeepTrackSolutions as numbers
+  // in caches, for a snapshot of the server (see SolverSnapshot.h); and
+  // such numbers inserted into the stores this MPC keeps, those of a store
+  // it doesn't keep skipped, false if they aren't of this backend and
+  // horizon. Only the Ipopt MPC keeps them, the other backends save none.
+  virtual void SaveCaches(std::vector<double> &caches) const { caches.clear(); }
+  virtual bool RestoreCaches(const std::vector<double> &caches) { return caches.empty(); }
+
+  // The size in memory of the problem as the last Solve left it, see
+  // SolverFootprint.h. Only the Ipopt MPC and the SQP report theirs, the
+  // other backends all zeros.
+  virtual SolverFootprint Footprint() const { return SolverFootprint(); }
+
+  // A new MPC solving the same problem, with the settings of this one (prev_a,
+  // max_solve_time and cost_schedule) but no plan, so that the next Solve of
+  // the copy starts cold. Made without recording or analysing the model
+  // again where possible. Null for MPCs that can't be copied.
+  virtual std::unique_ptr<MPCBase> Clone() const { return std::unique_ptr<MPCBase>(); }
+
+  SolveStatus status() const { return status_; }
+
+  // Iterations of the last Solve (Ipopt iterations, SQP or Newton steps), 0
+  // for backends that don't count them
+  int iterations() const { return iterations_; }
+
+  // Objective value of the plan of the last Solve
+  double cost() const { return cost_; }
+
+  // The plan of the last Solve, from planned_state and planned_actuations,
+  // with its status and cost
+  MPCSolution PlannedSolution() const;
+
+  // The plan of the last Solve from stage k on, moved rigidly so that stage
+  // k sits at the pose of state
+  MPCSolution PlannedSolution(size_t k, const MPCState &state) const;
+
+  // The problem of the next tick as the plan of the last Solve, for the
+  // polynomial coeffs, predicts it: its second stage in the vehicle frame
+  // of its first, which is about where the next telemetry finds the car,
+  // and the polynomial moved into that frame. Only the translation is
+  // applied to the polynomial; the rotation between two ticks is a few
+  // hundredths of a radian.
+  void PredictNextTick(const MPCCoeffs &coeffs, MPCState &state, MPCCoeffs &next_coeffs) const;
+
+protected:
+  // Copy prev_a, max_solve_time, cost_schedule and linearization_table from
+  // other
+  void CopySettings(const MPCBase &other) {
+    prev_a = other.prev_a;
+    max_solve_time = other.max_solve_time;
+    cost_schedule = other.cost_schedule;
+    linearization_table = other.linearization_table;
+  }
+
+  // Whether preempt is set, checked with the deadline
+  bool preempted() const { return preempt != nullptr && preempt->load(std::memory_order_relaxed); }
+
+  SolveStatus status_ = SolveStatus::kSolved;
+  double cost_ = 0;
+  int iterations_ = 0;
+};
+
+// MPC over N timesteps of Dt seconds (a std::ratio), with the actuations
+// held over Blocks (NoBlocking or a MoveBlocks) and the model Vehicle (see
+// KinematicModel.h) integrated by I. Every offset and buffer is sized at
+// compile time from Horizon<N, Dt, Blocks, I, Vehicle>.
+template <size_t N, class Dt = std::ratio<1, 10>, class Blocks = NoBlocking,
+          Integrator I = Integrator::kEuler, class Vehicle = KinematicBicycle>
+class MPC : public MPCBase {
+public:
+  typedef Horizon<N, Dt, Blocks, I, Vehicle> H;
+
+  // Records the model tape and sets up Ipopt once, both are reused by every
+  // Solve. Closed form or compiled derivatives are only used once checked
+  // against the tape; the tape stays in use otherwise.
+  explicit MPC(Derivatives derivatives = Derivatives::kTape,
+               HessianApproximation hessian = HessianApproximation::kExact);
+
+  ~MPC() override;
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  void Reset() override { has_prev_x_ = false; }
+
+  void Seed(double delta, double a) override {
+    seeded_ = true;
+    seed_delta_ = delta;
+    seed_a_ = a;
+  }
+
+  // A database of past solutions from now on, see MPCBase. The state jumped
+  // when it is further than jump from the second stage of the last plan, in
+  // the units of SolutionDatabase::StateDistance.
+  void KeepSolutions(size_t capacity) override { KeepSolutions(capacity, 1.0); }
+
+  void RepeatTick() override { repeat_ = true; }
+  void KeepSolutions(size_t capacity, double jump);
+
+  // In bins of 5 m and 5 mph, see MPCBase
+  void KeepTrackSolutions(size_t capacity) override;
+  void SetTrackPosition(double progress) override { track_position_ = progress; }
+
+  // Steps through IpoptEffortLevels: tol, acceptable_tol and max_iter
+  void ControlEffort(const EffortPolicy &policy) override;
+  const EffortController *effort() const override { return effort_.get(); }
+  // Ipopt's tol and max_iter
+  void SetTolerances(double tolerance, int max_iterations) override;
+
+  // Copied by Clone, with the threads of the chunked derivatives
+  void SetIpoptOptions(const IpoptOptions &options) override;
+  const IpoptOptions &ipopt_options() const { return options_; }
+
+  void SoftenConstraints(double penalty) override;
+  size_t slack_activations() const override { return slack_activations_; }
+
+  // Records the sampled model on a tape of its own. The closed form,
+  // AutoDiff, chunked and compiled derivatives are those of the polynomial,
+  // so they give way to the tape; the soft constraints and the Gauss-Newton
+  // Hessian are kept.
+  void SampleReference(bool sampled) override;
+  // Each switch optimizes a new problem structure, so Ipopt analyzes the
+  // KKT system again; the starting point and the multipliers carry over
+  void SetReferenceOrder(size_t order) override;
+  // Records the tape again, the derivative modes and options kept; the
+  // tapes of the other reference orders are dropped, and recorded again as
+  // they are met. In parallel mode the functions must have been made before
+  // (see StageCheckpoints::Get), or the stages stay on the tape.
+  void CheckpointStages(bool checkpoint) override;
+  // Whichever problem of the reference orders solves; not copied by Clone
+  void DumpKKT(KKTDump *dump) override { kkt_dump_ = dump; }
+  // The starting point and the multipliers of the last solve, whether it
+  // was warm or cold, and the tolerances and iteration limit of the effort
+  // controller it ran at
+  void SaveStart(std::vector<double> &start) const override;
+  bool RestoreStart(const std::vector<double> &start) override;
+  // The entries of the database then those of the track cache, each store
+  // as its count then its entries
+  void SaveCaches(std::vector<double> &caches) const override;
+  bool RestoreCaches(const std::vector<double> &caches) override;
+  // Solves so far that went through Ipopt's restoration phase
+  size_t restorations() const { return restorations_; }
+
+  // Copies the tape, its sparsity patterns and the derivative mode, and sets
+  // up an Ipopt instance of its own. The solution database and the effort
+  // controller are copied too.
+  std::unique_ptr<MPCBase> Clone() const override;
+  // The tape and the patterns handed to Ipopt, see MPC_NLP::Footprint
+  SolverFootprint Footprint() const override;
+
+  size_t horizon_length() const override { return N; }
+  double timestep() const override { return H::dt; }
+  double stage_time(size_t t) const override { return H::time(t); }
+
+  MPCState planned_state(size_t t) const override {
+    MPCState z;
+    for (size_t k = 0; k < 6; k++) {
+      z[k] = prev_x_[k * N + t];
+    }
+    return z;
+  }
+
+  void planned_actuations(size_t t, double &delta, double &a) const override {
+    delta = prev_x_[H::delta_start + H::block(t)];
+    a = prev_x_[H::a_start + H::block(t)];
+  }
+
+private:
+  typedef std::array<double, H::n_vars> VarArray;
+  typedef std::array<double, H::n_constraints> ConstraintArray;
+
+  // Copy of the problem of prototype, see Clone
+  explicit MPC(const MPC &prototype);
+
+  // Set the Ipopt options and load the linear solver.
+  void SetupIpopt();
+
+  // Set the Ipopt options of the setpoint of effort_
+  void ApplyEffort();
+
+  // Set those of options_ that aren't empty
+  void ApplyOptions();
+
+  // Switch nlp_ to ModelDerivatives, AutoDiffDerivatives or CompiledModel if
+  // they match the tape at a test point.
+  void UseDerivatives(Derivatives derivatives);
+
+  // Build the starting point of the next solve in vars: the rollout of the
+  // seed when there is one, else the rollout of the recalled actuations when
+  // there are some, else the previous plan shifted by one step (or not, see
+  // RepeatTick) when there is one, else the initial state and zeros.
+  void WarmStart(const MPCState &state, const MPCCoeffs &coeffs,
+                 VarArray &vars) const;
+
+  // Shift the multipliers of the last solve by one step, like the plan, or
+  // take them as they are after RepeatTick.
+  void WarmStartMultipliers();
+
+  // Look the actuations of the bin of the track at speed v, or else of the
+  // nearest past solution, up into recalled_ if the last plan is a poor
+  // start (see KeepTrackSolutions). Return whether it did.
+  bool Recall(const SolutionDatabase::Key &key, double v);
+
+  // Linearize the reference, reference_table or else coeffs, into
+  // reference_ at the abscissae of the stages of start_x_, or of the
+  // initial state rolled out at its speed and heading when start_x_ is cold
+  void LinearizeReferenceAlong(const MPCState &state, const MPCCoeffs &coeffs, bool cold);
+
+  // The MPC problem with its persistent tape
+  Ipopt::SmartPtr<MPC_NLP<H> > nlp_;
+  // The problems of the reference orders 1 to 3 met so far, nlp_ among
+  // them; a clone starts without
+  Ipopt::SmartPtr<MPC_NLP<H> > order_nlps_[3];
+  // Ipopt instance owned for the life of the MPC. After the first solve it
+  // re-optimizes the same problem structure, which keeps the symbolic
+  // factorization of the KKT system.
+  Ipopt::SmartPtr<Ipopt::IpoptApplication> app_;
+  bool app_optimized_ = false;
+  // See SetIpoptOptions
+  IpoptOptions options_;
+  // Value of Ipopt's warm_start_init_point, "no" by default
+  bool warm_start_option_ = false;
+
+  // Last solution (solution.x) and whether it can seed the next solve
+  VarArray prev_x_;
+  bool has_prev_x_ = false;
+  // The next solve is for the tick of the last one, see RepeatTick
+  bool repeat_ = false;
+  // Actuations the next solve starts from, see Seed
+  bool seeded_ = false;
+  double seed_delta_ = 0;
+  double seed_a_ = 0;
+  // Past solutions, see KeepSolutions, and the actuations the next solve
+  // starts from when recalled: the delta of each block, then the a
+  std::unique_ptr<SolutionDatabase> database_;
+  double jump_ = 1.0;
+  std::vector<double> recalled_;
+  bool recall_ = false;
+  // Past solutions by bin of the track, see KeepTrackSolutions
+  std::unique_ptr<TrackSolutionCache> track_cache_;
+  double track_position_ = -1;
+  // Solve effort from the measured solve times, see ControlEffort
+  std::unique_ptr<EffortController> effort_;
+  // See slack_activations and restorations
+  size_t slack_activations_ = 0;
+  size_t restorations_ = 0;
+  // See DumpKKT
+  KKTDump *kkt_dump_ = nullptr;
+  // Last bound multipliers (solution.zl, solution.zu) and constraint
+  // multipliers (solution.lambda)
+  VarArray prev_z_l_;
+  VarArray prev_z_u_;
+  ConstraintArray prev_lambda_;
+  // The next solve starts from start_x_ and the starting multipliers as
+  // they are, see RestoreStart
+  bool restored_ = false;
+  // The last solve started cold, or warm from multipliers; the effort it
+  // ran at, zeros without ControlEffort
+  bool start_cold_ = true;
+  bool start_warm_ = false;
+  EffortLevel start_level_ = {0, 0, 0};
+  // Starting point handed to Ipopt
+  VarArray start_x_;
+  VarArray start_z_l_;
+  VarArray start_z_u_;
+  ConstraintArray start_lambda_;
+  // The sampled reference of the stages, see SampleReference
+  std::array<LinearReference<double>, N - 1> reference_;
 };
 
-#endif /* MPC_H */
\ No newline at end of file
+// Make the MPC for a horizon of n timesteps of 0.1 s. The horizons compiled
+// into the binary are 10, 15, 25 and 40 (see Horizon.h), and 8 for 8 timesteps
+// of 0.2 s integrated by RK4 (Horizon8RK4), and 11 for the steps of
+// GradedSteps growing from 0.05 s to 0.3 s (Horizon11Graded); any other n
+// yields null. With move_blocking the actuations are held over Blocks10,
+// Blocks15 or Blocks25, none for 8, 11 or 40. The vehicle is the kinematic
+// model but for 15 without blocking, compiled for the dynamic one too
+// (Horizon15Dynamic).
+std::unique_ptr<MPCBase> MakeMPC(size_t n, Derivatives derivatives = Derivatives::kTape,
+                                 bool move_blocking = false,
+                                 HessianApproximation hessian = HessianApproximation::kExact,
+                                 VehicleModel vehicle = VehicleModel::kKinematic);
+
+#endif /* MPC_H */
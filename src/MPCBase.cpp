@@ -0,0 +1,66 @@
+#include "MPC.h"
+#include <cmath>
+
+MPCSolution MPCBase::PlannedSolution() const {
+  MPCSolution plan;
+  plan.stages = horizon_length();
+  plan.status = status_;
+  plan.cost = cost_;
+  for (size_t t = 0; t < plan.stages; t++) {
+    plan.time[t] = stage_time(t);
+    plan.set_state(t, planned_state(t));
+    if (t + 1 < plan.stages) {
+      planned_actuations(t, plan.delta[t], plan.a[t]);
+    }
+  }
+  return plan;
+}
+
+void MPCBase::PredictNextTick(const MPCCoeffs &coeffs, MPCState &state,
+                              MPCCoeffs &next_coeffs) const {
+  const MPCState origin = planned_state(0);
+  const double ox = origin[0];
+  const double oy = origin[1];
+  const double c = cos(origin[2]);
+  const double s = sin(origin[2]);
+
+  state = planned_state(1);
+  const double dx = state[0] - ox;
+  const double dy = state[1] - oy;
+  state[0] = c * dx + s * dy;
+  state[1] = -s * dx + c * dy;
+  state[2] -= origin[2];
+
+  // f(x + ox) - oy
+  const MPCCoeffs &p = coeffs;
+  next_coeffs[0] = p[0] + p[1] * ox + p[2] * ox * ox + p[3] * ox * ox * ox - oy;
+  next_coeffs[1] = p[1] + 2 * p[2] * ox + 3 * p[3] * ox * ox;
+  next_coeffs[2] = p[2] + 3 * p[3] * ox;
+  next_coeffs[3] = p[3];
+}
+
+MPCSolution MPCBase::PlannedSolution(size_t k, const MPCState &state) const {
+  MPCSolution plan;
+  plan.stages = horizon_length() - k;
+  plan.status = status_;
+  plan.cost = cost_;
+
+  const MPCState origin = planned_state(k);
+  const double dpsi = state[2] - origin[2];
+  const double c = cos(dpsi);
+  const double s = sin(dpsi);
+  for (size_t t = 0; t < plan.stages; t++) {
+    MPCState z = planned_state(k + t);
+    const double px = z[0] - origin[0];
+    const double py = z[1] - origin[1];
+    z[0] = state[0] + c * px - s * py;
+    z[1] = state[1] + s * px + c * py;
+    z[2] += dpsi;
+    plan.time[t] = stage_time(k + t) - stage_time(k);
+    plan.set_state(t, z);
+    if (t + 1 < plan.stages) {
+      planned_actuations(k + t, plan.delta[t], plan.a[t]);
+    }
+  }
+  return plan;
+}
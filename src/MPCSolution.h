@@ -0,0 +1,136 @@
+#ifndef MPC_SOLUTION_H
+#define MPC_SOLUTION_H
+
+#include <array>
+#include <cstddef>
+#include "Horizon.h"
+#include "PerfCounters.h"
+
+// Outcome of the last MPCBase::Solve
+enum class SolveStatus {
+  // Converged, or took its full step for the RTI
+  kSolved,
+  // Stopped at the deadline, or at the iteration limit of the effort
+  // controller; the best feasible iterate so far is returned
+  kDeadline,
+  // No usable iterate; the previous plan shifted by one step is returned
+  kFailed
+};
+
+// What a Solve started from
+enum class SolveStart {
+  // Nothing of a past solve
+  kCold,
+  // The plan of the last solve, shifted by one step or repeated (see
+  // MPCBase::RepeatTick), with its multipliers or working set
+  kWarm,
+  // A past solution near the state (see MPCBase::KeepSolutions)
+  kRecalled,
+  // The actuations of MPCBase::Seed
+  kSeeded,
+  // A start restored as it was saved (see MPCBase::RestoreStart)
+  kRestored
+};
+
+// Seconds of a Solve spent evaluating the model (its cost and constraints),
+// its derivatives, and in the linear algebra of the steps, for the backends
+// that break their solve out (Ipopt, SQP, RTI); zero for the others. With
+// the hardware counters of the solving thread open, the events of each too
+// (see PerfCounters.h)
+struct SolvePhases {
+  double model = 0;
+  double derivatives = 0;
+  double linear_solve = 0;
+  PerfCounts model_events;
+  PerfCounts derivative_events;
+  PerfCounts linear_solve_events;
+};
+
+// The work of a Solve, as far as its backend counts it, zero beyond that
+struct SolveStatistics {
+  // Iterations (Ipopt iterations, SQP or Newton steps)
+  int iterations = 0;
+  // Evaluations of the cost, its gradient, the constraints, their Jacobian
+  // and the Lagrangian Hessian; the linearizations of the model count as
+  // Jacobians
+  int cost_evaluations = 0;
+  int gradient_evaluations = 0;
+  int constraint_evaluations = 0;
+  int jacobian_evaluations = 0;
+  int hessian_evaluations = 0;
+  // Forward sweeps of the model not made since an evaluation reused the one
+  // of another at the same iterate (Ipopt)
+  int forward_sweeps_saved = 0;
+  // Times Ipopt entered its restoration phase
+  int restorations = 0;
+  // The backend's own outcome, Ipopt's SolverReturn (0 for SUCCESS)
+  int solver_status = 0;
+  SolveStart start = SolveStart::kCold;
+  SolvePhases phases;
+};
+
+// Result of MPCBase::Solve: the plan in the vehicle frame of its initial
+// state, every predicted state and actuation, with the status and the cost.
+//
+// Each state and actuator has an array of its own over the stages, so that
+// e.g. the x and y to display are contiguous. The arrays have the capacity
+// of the longest horizon, so a solution is returned by value without
+// touching the heap.
+struct MPCSolution {
+  static constexpr size_t max_stages = kMaxHorizon;
+  typedef std::array<double, max_stages> StageArray;
+
+  // Stage t state [x,y,psi,v,cte,epsi] (t < stages)
+  MPCState state(size_t t) const {
+    MPCState z;
+    z << x[t], y[t], psi[t], v[t], cte[t], epsi[t];
+    return z;
+  }
+  void set_state(size_t t, const MPCState &z) {
+    x[t] = z[0];
+    y[t] = z[1];
+    psi[t] = z[2];
+    v[t] = z[3];
+    cte[t] = z[4];
+    epsi[t] = z[5];
+  }
+
+  // Every stage from the trajectory z, a state per column
+  template <class Trajectory>
+  void set_states(const Eigen::MatrixBase<Trajectory> &z) {
+    stages = z.cols();
+    for (size_t t = 0; t < stages; t++) {
+      set_state(t, z.col(t));
+    }
+  }
+
+  // Time of every stage from Horizon H (see Horizon::time)
+  template <class H>
+  void set_times() {
+    for (size_t t = 0; t < stages; t++) {
+      time[t] = H::time(t);
+    }
+  }
+
+  // Stages of the plan, the first is the initial state
+  size_t stages = 0;
+  // Time of each stage from the initial state, in seconds; the steps grow
+  // along the horizon with a StepSchedule
+  StageArray time;
+  StageArray x;
+  StageArray y;
+  StageArray psi;
+  StageArray v;
+  StageArray cte;
+  StageArray epsi;
+  // Actuations of the stages but the last (t < stages - 1); the first ones
+  // are those to send
+  StageArray delta;
+  StageArray a;
+
+  SolveStatus status = SolveStatus::kSolved;
+  double cost = 0;
+  SolveStatistics statistics;
+};
+
+#endif /* MPC_SOLUTION_H */
@@ -0,0 +1,354 @@
+#include "MPC_ADMM.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include "LinearizationTable.h"
+#include "Log.h"
+
+// Step size of the box rows, of the order of the cost weights (there is no
+// scaling of the problem), that of the equality rows (larger, as in OSQP),
+// the regularization of P and the over-relaxation
+static const double kRho = 1e3;
+static const double kRhoEquality = 1e3 * kRho;
+static const double kSigma = 1e-6;
+static const double kAlpha = 1.6;
+// Iterations between two residual checks
+static const int kCheckInterval = 5;
+// Refinement steps of a solve with an older factorization, and the relative
+// residual they must reach
+static const int kRefinementSteps = 5;
+static const double kRefinementTolerance = 1e-10;
+
+template <size_t N, class Dt>
+MPC_ADMM<N, Dt>::MPC_ADMM(int max_iterations, double tolerance, double refactor_tolerance)
+    : max_iterations_(max_iterations), tolerance_(tolerance),
+      refactor_tolerance_(refactor_tolerance), p_(n_x, n_x), a_(n_rows, n_x),
+      kkt_(n_x + n_rows, n_x + n_rows) {
+  lb_ << -max_delta, -max_a;
+  ub_ << max_delta, max_a;
+  rho_.head(n_eq).setConstant(kRhoEquality);
+  rho_.tail(n_rows - n_eq).setConstant(kRho);
+  x_.setZero();
+  z_.setZero();
+  y_.setZero();
+  z_bar_.setZero();
+  u_bar_.setZero();
+  SetWeights(CostWeights());
+}
+
+template <size_t N, class Dt>
+void MPC_ADMM<N, Dt>::SetWeights(const CostWeights &weights) {
+  q_ << 0, 0, 0, weights.v, weights.cte, weights.epsi;
+  ref_ << 0, 0, 0, weights.v_ref, ref_cte, ref_epsi;
+  r_current_ << weights.current_delta, weights.current_a;
+  r_diff_ << weights.diff_delta, weights.diff_a;
+}
+
+template <size_t N, class Dt>
+double MPC_ADMM<N, Dt>::Rollout(const MPCState &state, const ActuationTrajectory &u,
+                                const MPCCoeffs &coeffs, StateTrajectory &z) const {
+  double cost = 0;
+  z.col(0) = state;
+  for (size_t t = 0; t < N; t++) {
+    const MPCState e = z.col(t) - ref_;
+    cost += e.dot(q_.cwiseProduct(e));
+    if (t + 1 < N) {
+      z.col(t + 1) = ModelStep(z.col(t), u(0, t), u(1, t), coeffs, H::step(t));
+      cost += u.col(t).dot(r_current_.cwiseProduct(u.col(t)));
+    }
+    if (t + 2 < N) {
+      const Eigen::Vector2d d = u.col(t + 1) - u.col(t);
+      cost += d.dot(r_diff_.cwiseProduct(d));
+    }
+  }
+  return cost;
+}
+
+template <size_t N, class Dt>
+void MPC_ADMM<N, Dt>::BuildQP(const MPCState &state, const MPCCoeffs &coeffs) {
+  typedef Eigen::Triplet<double> Entry;
+
+  // Cost: the state terms per stage, the actuator magnitudes and their
+  // sequential differences. Every entry is set, zero or not, so the pattern
+  // stays the same from tick to tick.
+  std::vector<Entry> p;
+  for (size_t t = 0; t < N; t++) {
+    for (size_t k = 0; k < 6; k++) {
+      p.push_back(Entry(6 * t + k, 6 * t + k, 2 * q_[k]));
+    }
+    q_vec_.template segment<6>(6 * t) = -2 * q_.cwiseProduct(ref_);
+  }
+  for (size_t t = 0; t + 1 < N; t++) {
+    for (size_t k = 0; k < 2; k++) {
+      const size_t i = n_z + 2 * t + k;
+      double diagonal = 2 * r_current_[k];
+      if (t > 0) {
+        diagonal += 2 * r_diff_[k];
+      }
+      if (t + 2 < N) {
+        diagonal += 2 * r_diff_[k];
+        p.push_back(Entry(i, i + 2, -2 * r_diff_[k]));
+        p.push_back(Entry(i + 2, i, -2 * r_diff_[k]));
+      }
+      p.push_back(Entry(i, i, diagonal));
+    }
+  }
+  q_vec_.tail(n_x - n_z).setZero();
+  p_.setFromTriplets(p.begin(), p.end());
+
+  // Constraints: z[0] = state, z[t+1] - A z[t] - B u[t] = c, lb <= u <= ub
+  std::vector<Entry> a;
+  for (size_t k = 0; k < 6; k++) {
+    a.push_back(Entry(k, k, 1.0));
+  }
+  l_.template head<6>() = state;
+  StageTerms<int(N - 1)> terms;
+  EvaluateStageTerms(z_bar_, coeffs, terms);
+  StateJacobian jac_z;
+  ActuationJacobian jac_u;
+  for (size_t t = 0; t + 1 < N; t++) {
+    const MPCState z = z_bar_.col(t);
+    const Eigen::Vector2d u = u_bar_.col(t);
+    if (linearization_table) {
+      linearization_table->ModelJacobian(terms, t, z[3], z[2], u[0], H::step(t), jac_z, jac_u);
+    } else {
+      ModelJacobian(terms, t, z[3], u[0], H::step(t), jac_z, jac_u);
+    }
+    const size_t row = 6 + 6 * t;
+    for (size_t i = 0; i < 6; i++) {
+      a.push_back(Entry(row + i, 6 * (t + 1) + i, 1.0));
+      for (size_t j = 0; j < 6; j++) {
+        a.push_back(Entry(row + i, 6 * t + j, -jac_z(i, j)));
+      }
+      for (size_t j = 0; j < 2; j++) {
+        a.push_back(Entry(row + i, n_z + 2 * t + j, -jac_u(i, j)));
+      }
+    }
+    l_.template segment<6>(row) =
+        ModelStep(z, u[0], u[1], coeffs, H::step(t)) - jac_z * z - jac_u * u;
+
+    for (size_t k = 0; k < 2; k++) {
+      a.push_back(Entry(n_eq + 2 * t + k, n_z + 2 * t + k, 1.0));
+      l_[n_eq + 2 * t + k] = lb_[k];
+      u_[n_eq + 2 * t + k] = ub_[k];
+    }
+  }
+  u_.head(n_eq) = l_.head(n_eq);
+  a_.setFromTriplets(a.begin(), a.end());
+
+  // KKT system [P + sigma I, A'; A, -diag(1 / rho)], both triangles
+  std::vector<Entry> kkt;
+  for (int c = 0; c < p_.outerSize(); c++) {
+    for (SparseMatrix::InnerIterator it(p_, c); it; ++it) {
+      kkt.push_back(Entry(it.row(), it.col(), it.value()));
+    }
+  }
+  for (size_t i = 0; i < n_x; i++) {
+    kkt.push_back(Entry(i, i, kSigma));
+  }
+  for (int c = 0; c < a_.outerSize(); c++) {
+    for (SparseMatrix::InnerIterator it(a_, c); it; ++it) {
+      kkt.push_back(Entry(n_x + it.row(), it.col(), it.value()));
+      kkt.push_back(Entry(it.col(), n_x + it.row(), it.value()));
+    }
+  }
+  for (size_t i = 0; i < n_rows; i++) {
+    kkt.push_back(Entry(n_x + i, n_x + i, -1 / rho_[i]));
+  }
+  kkt_.setFromTriplets(kkt.begin(), kkt.end());
+}
+
+template <size_t N, class Dt>
+bool MPC_ADMM<N, Dt>::Factorize() {
+  if (has_factorization_) {
+    // The values of both in the same order, the pattern is fixed
+    const Eigen::Map<const Eigen::VectorXd> now(kkt_.valuePtr(), kkt_.nonZeros());
+    const Eigen::Map<const Eigen::VectorXd> then(factorized_kkt_.valuePtr(),
+                                                 factorized_kkt_.nonZeros());
+    const double scale = then.template lpNorm<Eigen::Infinity>();
+    if ((now - then).template lpNorm<Eigen::Infinity>() <= refactor_tolerance_ * scale) {
+      stale_ = now != then;
+      return true;
+    }
+  }
+  if (!analyzed_) {
+    ldlt_.analyzePattern(kkt_);
+    analyzed_ = true;
+  }
+  ldlt_.factorize(kkt_);
+  factorizations_++;
+  has_factorization_ = ldlt_.info() == Eigen::Success;
+  factorized_kkt_ = kkt_;
+  stale_ = false;
+  return has_factorization_;
+}
+
+template <size_t N, class Dt>
+bool MPC_ADMM<N, Dt>::SolveKKT(const KKTVector &rhs, KKTVector &sol) {
+  sol = ldlt_.solve(rhs);
+  if (!stale_) {
+    return true;
+  }
+  const double scale = std::max(1.0, rhs.template lpNorm<Eigen::Infinity>());
+  for (int step = 0; step < kRefinementSteps; step++) {
+    residual_ = rhs;
+    residual_.noalias() -= kkt_ * sol;
+    if (residual_.template lpNorm<Eigen::Infinity>() <= kRefinementTolerance * scale) {
+      return true;
+    }
+    step_ = ldlt_.solve(residual_);
+    sol += step_;
+  }
+  residual_ = rhs;
+  residual_.noalias() -= kkt_ * sol;
+  return residual_.template lpNorm<Eigen::Infinity>() <= kRefinementTolerance * scale;
+}
+
+template <size_t N, class Dt>
+MPCSolution MPC_ADMM<N, Dt>::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
+  const SolveStart start = has_plan_ ? SolveStart::kWarm : SolveStart::kCold;
+  const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(max_solve_time));
+
+  SetWeights(cost_schedule.At(state[3]));
+
+  // Linearize along the last actuations shifted by one stage, rolled out
+  // from the measured state
+  for (size_t t = 0; t + 1 < N; t++) {
+    if (has_plan_) {
+      u_bar_.col(t) = plan_u_.col(std::min(t + 1, N - 2));
+    } else {
+      u_bar_.col(t).setZero();
+    }
+  }
+  Rollout(state, u_bar_, coeffs, z_bar_);
+  BuildQP(state, coeffs);
+
+  // Start from the linearization point, with the multipliers of the last
+  // solve shifted by one stage
+  for (size_t t = 0; t < N; t++) {
+    x_.template segment<6>(6 * t) = z_bar_.col(t);
+  }
+  for (size_t t = 0; t + 1 < N; t++) {
+    x_.template segment<2>(n_z + 2 * t) = u_bar_.col(t);
+  }
+  if (has_plan_) {
+    for (size_t t = 0; t + 2 < N; t++) {
+      y_.template segment<6>(6 + 6 * t) = y_.template segment<6>(12 + 6 * t);
+      y_.template segment<2>(n_eq + 2 * t) = y_.template segment<2>(n_eq + 2 * t + 2);
+    }
+  } else {
+    y_.setZero();
+  }
+  ax_.noalias() = a_ * x_;
+  z_ = ax_.cwiseMax(l_).cwiseMin(u_);
+
+  bool ok = false;
+  bool failed = !Factorize();
+  bool expired = false;
+  if (failed) {
+    std::cerr << "ADMM: KKT factorization failed" << std::endl;
+  }
+  iterations_ = 0;
+  while (!failed && iterations_ < max_iterations_) {
+    iterations_++;
+    rhs_.head(n_x) = kSigma * x_ - q_vec_;
+    rhs_.tail(n_rows) = z_ - y_.cwiseQuotient(rho_);
+    if (!SolveKKT(rhs_, sol_)) {
+      // The factorization is too far off, make a new one
+      has_factorization_ = false;
+      if (!Factorize() || !SolveKKT(rhs_, sol_)) {
+        std::cerr << "ADMM: KKT factorization failed" << std::endl;
+        failed = iterations_ == 1;
+        break;
+      }
+    }
+
+    // z~ = z + (v - y) / rho, then the relaxed updates, into the scratch
+    // of the iterate so that the iterations allocate nothing
+    x_ = kAlpha * sol_.head(n_x) + (1 - kAlpha) * x_;
+    z_relaxed_ = kAlpha * (z_ + (sol_.tail(n_rows) - y_).cwiseQuotient(rho_)) + (1 - kAlpha) * z_;
+    z_next_ = (z_relaxed_ + y_.cwiseQuotient(rho_)).cwiseMax(l_).cwiseMin(u_);
+    y_ += rho_.cwiseProduct(z_relaxed_ - z_next_);
+    z_.swap(z_next_);
+
+    if (iterations_ % kCheckInterval == 0) {
+      ax_.noalias() = a_ * x_;
+      px_.noalias() = p_ * x_;
+      aty_.noalias() = a_.transpose() * y_;
+      const double primal = (ax_ - z_).template lpNorm<Eigen::Infinity>();
+      const double dual = (px_ + q_vec_ + aty_).template lpNorm<Eigen::Infinity>();
+      const double primal_scale = std::max(ax_.template lpNorm<Eigen::Infinity>(),
+                                           z_.template lpNorm<Eigen::Infinity>());
+      const double dual_scale = std::max(std::max(px_.template lpNorm<Eigen::Infinity>(),
+                                                  aty_.template lpNorm<Eigen::Infinity>()),
+                                         q_vec_.template lpNorm<Eigen::Infinity>());
+      if (primal <= tolerance_ * (1 + primal_scale) && dual <= tolerance_ * (1 + dual_scale)) {
+        ok = true;
+        break;
+      }
+    }
+    if (std::chrono::steady_clock::now() >= deadline || preempted()) {
+      expired = true;
+      break;
+    }
+  }
+
+  // The actuations of the iterate within their bounds; the plan is their
+  // rollout through the nonlinear model
+  if (!failed) {
+    for (size_t t = 0; t + 1 < N; t++) {
+      plan_u_.col(t) = x_.template segment<2>(n_z + 2 * t).cwiseMax(lb_).cwiseMin(ub_);
+    }
+  } else {
+    plan_u_ = u_bar_;
+  }
+  has_plan_ = true;
+  if (failed) {
+    status_ = SolveStatus::kFailed;
+  } else if (expired) {
+    status_ = SolveStatus::kDeadline;
+  } else {
+    status_ = SolveStatus::kSolved;
+    if (!ok) {
+      std::cerr << "ADMM: no convergence in " << max_iterations_ << " iterations" << std::endl;
+    }
+  }
+  const double cost = Rollout(state, plan_u_, coeffs, plan_z_);
+
+  // Cost
+  cost_ = cost;
+  Log(LogLevel::kInfo, "Cost {}", cost);
+
+  MPCSolution plan;
+  plan.set_states(plan_z_);
+  plan.set_times<H>();
+  for (size_t t = 0; t < N - 1; t++) {
+    plan.delta[t] = plan_u_(0, t);
+    plan.a[t] = plan_u_(1, t);
+  }
+  plan.status = status_;
+  plan.cost = cost_;
+  plan.statistics.iterations = iterations_;
+  plan.statistics.start = start;
+  return plan;
+}
+
+template class MPC_ADMM<10>;
+template class MPC_ADMM<15>;
+template class MPC_ADMM<25>;
+
+std::unique_ptr<MPCBase> MakeMPC_ADMM(size_t n) {
+  switch (n) {
+    case 10:
+      return std::unique_ptr<MPCBase>(new MPC_ADMM<10>());
+    case 15:
+      return std::unique_ptr<MPCBase>(new MPC_ADMM<15>());
+    case 25:
+      return std::unique_ptr<MPCBase>(new MPC_ADMM<25>());
+    default:
+      return std::unique_ptr<MPCBase>();
+  }
+}
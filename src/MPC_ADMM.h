@@ -0,0 +1,190 @@
+#ifndef MPC_ADMM_H
+#define MPC_ADMM_H
+
+#include <memory>
+#include <ratio>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/SparseCore"
+#include "Eigen-3.3/Eigen/SparseCholesky"
+#include "Horizon.h"
+#include "KinematicModel.h"
+#include "MPC.h"
+
+// Linear time-varying MPC solved by ADMM, the way OSQP solves QPs.
+//
+// Every tick linearizes the model (KinematicModel.h) along the last plan
+// shifted by one stage and rolled out from the measured state, which gives
+// the sparse QP in all the states and actuations
+//
+//   min 0.5 x'Px + q'x   s.t.   l <= Ax <= u
+//
+// with the initial state and the linearized dynamics as equality rows and
+// the actuator bounds as box rows. Each ADMM iteration solves the
+// quasi-definite KKT system
+//
+//   [P + sigma I   A'         ] [x]
+//   [A             -diag(1/rho)] [v]
+//
+// with a SimplicialLDLT and projects onto the bounds. The pattern of the
+// system never changes, so it is analysed once. Its values change with the
+// linearization and the weights: while they stay within refactor_tolerance
+// (relative) of the factorized ones the factorization is kept, and each
+// solve is corrected by iterative refinement against the current system.
+// On these horizons a factorization costs less than the few refinement
+// steps every iteration then needs, so by default (0) it is only kept while
+// the system is unchanged.
+//
+// The primal and dual iterates of the last tick, shifted by one stage, warm
+// start the next one. The iterations stop at tolerance (absolute and
+// relative, checked every few iterations), at max_iterations or at the
+// deadline, whichever comes first, which trades accuracy for latency.
+//
+// One actuation per stage: there is no move blocking variant.
+template <size_t N, class Dt = std::ratio<1, 10> >
+class MPC_ADMM : public MPCBase {
+public:
+  typedef Horizon<N, Dt> H;
+
+  // Variables: the states of every stage, then the actuations
+  static constexpr size_t n_z = 6 * N;
+  static constexpr size_t n_x = n_z + 2 * (N - 1);
+  // Rows: the initial state and the dynamics, then the actuator bounds
+  static constexpr size_t n_eq = 6 * N;
+  static constexpr size_t n_rows = n_eq + 2 * (N - 1);
+
+  // The vectors of the QP and of the iterations, sized by the horizon, in
+  // the object rather than on the heap
+  typedef Eigen::Matrix<double, int(n_x), 1> VariableVector;
+  typedef Eigen::Matrix<double, int(n_rows), 1> RowVector;
+  typedef Eigen::Matrix<double, int(n_x + n_rows), 1> KKTVector;
+
+  explicit MPC_ADMM(int max_iterations = 4000, double tolerance = 1e-4,
+                    double refactor_tolerance = 0);
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  void Reset() override { has_plan_ = false; }
+
+  std::unique_ptr<MPCBase> Clone() const override {
+    MPC_ADMM *mpc = new MPC_ADMM(max_iterations_, tolerance_, refactor_tolerance_);
+    mpc->CopySettings(*this);
+    return std::unique_ptr<MPCBase>(mpc);
+  }
+
+  void SetTolerances(double tolerance, int max_iterations) override {
+    if (tolerance > 0) {
+      tolerance_ = tolerance;
+    }
+    if (max_iterations > 0) {
+      max_iterations_ = max_iterations;
+    }
+  }
+
+  size_t horizon_length() const override { return N; }
+  double timestep() const override { return H::dt; }
+  double stage_time(size_t t) const override { return H::time(t); }
+
+  MPCState planned_state(size_t t) const override { return plan_z_.col(t); }
+
+  void planned_actuations(size_t t, double &delta, double &a) const override {
+    delta = plan_u_(0, t);
+    a = plan_u_(1, t);
+  }
+
+  // Numeric factorizations of the KKT system so far
+  size_t factorizations() const { return factorizations_; }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  // One state per column, row major so that each state over the horizon is
+  // contiguous for EvaluateStageTerms
+  typedef Eigen::Matrix<double, 6, int(N), Eigen::RowMajor> StateTrajectory;
+  typedef Eigen::Matrix<double, 2, int(N - 1)> ActuationTrajectory;
+  typedef Eigen::SparseMatrix<double> SparseMatrix;
+
+
+  // Use weights in the cost from now on
+  void SetWeights(const CostWeights &weights);
+
+  // Fill P, q, A, l, u and the KKT system for the linearization along z_bar,
+  // u_bar from state
+  void BuildQP(const MPCState &state, const MPCCoeffs &coeffs);
+
+  // Factorize the KKT system unless the factorization is close enough.
+  // False if the factorization fails.
+  bool Factorize();
+
+  // Solve the KKT system for rhs into sol, refining against the current
+  // system when the factorization is older. False if that doesn't converge.
+  bool SolveKKT(const KKTVector &rhs, KKTVector &sol);
+
+  // Roll the model out from state along the actuations u into z. Return the
+  // cost of FG_eval.
+  double Rollout(const MPCState &state, const ActuationTrajectory &u, const MPCCoeffs &coeffs,
+                 StateTrajectory &z) const;
+
+  int max_iterations_;
+  double tolerance_;
+  double refactor_tolerance_;
+
+  // State cost weights (diagonal) and reference, actuator bounds and cost
+  MPCState q_;
+  MPCState ref_;
+  Eigen::Vector2d lb_;
+  Eigen::Vector2d ub_;
+  Eigen::Vector2d r_current_;
+  Eigen::Vector2d r_diff_;
+
+  // The QP of this tick, and the step size of each row
+  SparseMatrix p_;
+  VariableVector q_vec_;
+  SparseMatrix a_;
+  RowVector l_;
+  RowVector u_;
+  RowVector rho_;
+
+  // KKT system of this tick and the one factorized
+  SparseMatrix kkt_;
+  SparseMatrix factorized_kkt_;
+  Eigen::SimplicialLDLT<SparseMatrix> ldlt_;
+  bool analyzed_ = false;
+  bool has_factorization_ = false;
+  bool stale_ = false;
+  size_t factorizations_ = 0;
+
+  // ADMM iterate and scratch
+  VariableVector x_;
+  RowVector z_;
+  RowVector y_;
+  KKTVector rhs_;
+  KKTVector sol_;
+  KKTVector residual_;
+  KKTVector step_;
+  RowVector z_relaxed_;
+  RowVector z_next_;
+  RowVector ax_;
+  VariableVector px_;
+  VariableVector aty_;
+
+  // Linearization point
+  StateTrajectory z_bar_;
+  ActuationTrajectory u_bar_;
+
+  // Actuations of the last solve, their rollout, and whether they and the
+  // iterate can seed the next solve
+  ActuationTrajectory plan_u_ = ActuationTrajectory::Zero();
+  StateTrajectory plan_z_ = StateTrajectory::Zero();
+  bool has_plan_ = false;
+};
+
+template <size_t N, class Dt> constexpr size_t MPC_ADMM<N, Dt>::n_z;
+template <size_t N, class Dt> constexpr size_t MPC_ADMM<N, Dt>::n_x;
+template <size_t N, class Dt> constexpr size_t MPC_ADMM<N, Dt>::n_eq;
+template <size_t N, class Dt> constexpr size_t MPC_ADMM<N, Dt>::n_rows;
+
+// Make the ADMM MPC for a horizon of n timesteps of 0.1 s, like MakeMPC.
+std::unique_ptr<MPCBase> MakeMPC_ADMM(size_t n);
+
+#endif /* MPC_ADMM_H */
@@ -0,0 +1,231 @@
+#include "MPC_Decoupled.h"
+#include <chrono>
+#include <iostream>
+#include "FrenetReference.h"
+#include "Instrumentation.h"
+#include "Log.h"
+#include "ReferenceTable.h"
+
+template <size_t N, class Dt, class Blocks>
+MPC_Decoupled<N, Dt, Blocks>::MPC_Decoupled(int max_iterations, double tolerance)
+    : max_iterations_(max_iterations), tolerance_(tolerance) {
+  // v[t] = v0 + the steps of the stages before t, each times its throttle
+  speed_.setZero();
+  for (size_t t = 1; t < N; t++) {
+    speed_.row(t) = speed_.row(t - 1);
+    speed_(t, H::block(t - 1)) += H::step(t - 1);
+  }
+}
+
+template <size_t N, class Dt, class Blocks>
+MPCSolution MPC_Decoupled<N, Dt, Blocks>::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
+  if (frenet_reference) {
+    return SolveAlong(state, *frenet_reference);
+  }
+  if (reference_table) {
+    return SolveAlong(state, *reference_table);
+  }
+  return SolveAlong(state, coeffs);
+}
+
+template <size_t N, class Dt, class Blocks>
+void MPC_Decoupled<N, Dt, Blocks>::SolveLongitudinal(double v0, const CostWeights &weights) {
+  // The throttle terms of FG_eval: every actuated stage, and the gaps
+  // between the blocks
+  throttle_cost_.setZero();
+  for (size_t t = 0; t < N - 1; t++) {
+    throttle_cost_(H::block(t), H::block(t)) += weights.current_a;
+  }
+  for (size_t i = 0; i + 1 < H::n_blocks; i++) {
+    throttle_cost_(i, i) += weights.diff_a;
+    throttle_cost_(i + 1, i + 1) += weights.diff_a;
+    throttle_cost_(i, i + 1) -= weights.diff_a;
+    throttle_cost_(i + 1, i) -= weights.diff_a;
+  }
+  // The speed terms, with that of the last stage
+  Eigen::Matrix<double, int(N), 1> speed_weights;
+  speed_weights.setConstant(weights.v);
+  speed_weights[N - 1] += weights.terminal_v;
+
+  block_hessian_.noalias() = 2 * speed_.transpose() * speed_weights.asDiagonal() * speed_;
+  block_hessian_ += 2 * throttle_cost_;
+  block_gradient_.noalias() =
+      2 * (v0 - weights.v_ref) * speed_.transpose() * speed_weights;
+  block_lower_.setConstant(-max_a);
+  block_upper_.setConstant(max_a);
+  block_step_ = u_.template tail<int(H::n_blocks)>();
+  if (longitudinal_.Solve(block_hessian_, block_gradient_, block_lower_, block_upper_,
+                          block_step_) < 0) {
+    std::cerr << "Decoupled: throttle QP Hessian is not positive definite" << std::endl;
+    longitudinal_.working_set().setZero();
+    return;
+  }
+  u_.template tail<int(H::n_blocks)>() = block_step_;
+}
+
+template <size_t N, class Dt, class Blocks>
+template <class Reference>
+MPCSolution MPC_Decoupled<N, Dt, Blocks>::SolveAlong(const MPCState &state,
+                                                     const Reference &reference) {
+  const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(max_solve_time));
+
+  const CostWeights &weights = cost_schedule.At(state[3]);
+  qp_.SetWeights(weights);
+
+  // Start from the shifted previous plan, and both working sets with it
+  const SolveStart start = has_plan_ ? SolveStart::kWarm : SolveStart::kCold;
+  if (has_plan_) {
+    QP::ShiftActuations(plan_u_, u_);
+    typename BlockQP::WorkingSet working_set = lateral_.working_set();
+    for (size_t b = 0; b < H::n_blocks; b++) {
+      lateral_.working_set()[b] = working_set[H::shifted_block(b)];
+    }
+    working_set = longitudinal_.working_set();
+    for (size_t b = 0; b < H::n_blocks; b++) {
+      longitudinal_.working_set()[b] = working_set[H::shifted_block(b)];
+    }
+  } else {
+    u_.setZero();
+    lateral_.working_set().setZero();
+    longitudinal_.working_set().setZero();
+  }
+
+  PhaseClock clock;
+  SolveStatistics statistics;
+  SolvePhases &phases = statistics.phases;
+  // The speed profile, which the steering doesn't change
+  SolveLongitudinal(state[3], weights);
+  phases.linear_solve += clock.Lap(phases.linear_solve_events);
+
+  // The steering over it, every iterate feasible as in MPC_SQP
+  bool ok = false;
+  bool failed = false;
+  bool expired = false;
+  double cost = qp_.Cost(state, u_, reference);
+  statistics.cost_evaluations++;
+  phases.model += clock.Lap(phases.model_events);
+  iterations_ = 0;
+  for (int iter = 0; iter < max_iterations_; iter++) {
+    MPC_TRACE_SCOPE("decoupled iteration");
+    iterations_ = iter + 1;
+    qp_.Linearize(state, u_, reference, linearization_table.get());
+    qp_.Feedback(state, reference);
+    statistics.jacobian_evaluations++;
+    // The throttles held, the steering block is the whole QP
+    block_hessian_ = qp_.hessian().template topLeftCorner<int(H::n_blocks), int(H::n_blocks)>();
+    block_gradient_ = qp_.gradient().template head<int(H::n_blocks)>();
+    block_lower_ = qp_.lower().template head<int(H::n_blocks)>();
+    block_upper_ = qp_.upper().template head<int(H::n_blocks)>();
+    phases.derivatives += clock.Lap(phases.derivative_events);
+    block_step_.setZero();
+    const int solved = lateral_.Solve(block_hessian_, block_gradient_, block_lower_,
+                                      block_upper_, block_step_);
+    phases.linear_solve += clock.Lap(phases.linear_solve_events);
+    if (solved < 0) {
+      std::cerr << "Decoupled: steering QP Hessian is not positive definite" << std::endl;
+      lateral_.working_set().setZero();
+      failed = iter == 0;
+      break;
+    }
+    du_.setZero();
+    du_.template head<int(H::n_blocks)>() = block_step_;
+
+    // Backtrack until the nonlinear cost decreases
+    double alpha = 1.0;
+    double trial_cost = cost;
+    for (; alpha > 1e-3; alpha *= 0.5) {
+      trial_ = u_ + alpha * du_;
+      trial_cost = qp_.Cost(state, trial_, reference);
+      statistics.cost_evaluations++;
+      if (trial_cost < cost) {
+        break;
+      }
+    }
+    phases.model += clock.Lap(phases.model_events);
+    if (trial_cost >= cost) {
+      ok = true;
+      break;
+    }
+    u_ = trial_;
+    cost = trial_cost;
+
+    if (alpha * block_step_.template lpNorm<Eigen::Infinity>() < tolerance_) {
+      ok = true;
+      break;
+    }
+    if (std::chrono::steady_clock::now() >= deadline || preempted()) {
+      expired = true;
+      break;
+    }
+  }
+
+  plan_u_ = u_;
+  has_plan_ = true;
+  if (failed) {
+    status_ = SolveStatus::kFailed;
+  } else if (expired) {
+    status_ = SolveStatus::kDeadline;
+  } else {
+    status_ = SolveStatus::kSolved;
+    if (!ok && max_iterations_ > 1) {
+      std::cerr << "Decoupled: no convergence in " << max_iterations_ << " iterations"
+                << std::endl;
+    }
+  }
+
+  cost_ = cost;
+  Log(LogLevel::kInfo, "Cost {}", cost);
+
+  plan_z_.col(0) = state;
+  for (size_t i = 0; i < N - 1; i++) {
+    const double delta = u_[H::block(i)];
+    const double a = u_[H::n_blocks + H::block(i)];
+    plan_z_.col(i + 1) = ModelStep(plan_z_.col(i), delta, a, reference, H::step(i));
+  }
+
+  MPCSolution plan;
+  plan.set_states(plan_z_);
+  plan.set_times<H>();
+  for (size_t t = 0; t < N - 1; t++) {
+    plan.delta[t] = u_[H::block(t)];
+    plan.a[t] = u_[H::n_blocks + H::block(t)];
+  }
+  plan.status = status_;
+  plan.cost = cost_;
+  plan.statistics = statistics;
+  plan.statistics.iterations = iterations_;
+  plan.statistics.start = start;
+  return plan;
+}
+
+template class MPC_Decoupled<10>;
+template class MPC_Decoupled<15>;
+template class MPC_Decoupled<25>;
+template class MPC_Decoupled<10, std::ratio<1, 10>, Blocks10>;
+template class MPC_Decoupled<15, std::ratio<1, 10>, Blocks15>;
+template class MPC_Decoupled<25, std::ratio<1, 10>, Blocks25>;
+
+std::unique_ptr<MPCBase> MakeMPC_Decoupled(size_t n, bool move_blocking) {
+  typedef std::ratio<1, 10> Dt;
+  switch (n) {
+    case 10:
+      if (move_blocking) {
+        return std::unique_ptr<MPCBase>(new MPC_Decoupled<10, Dt, Blocks10>());
+      }
+      return std::unique_ptr<MPCBase>(new MPC_Decoupled<10>());
+    case 15:
+      if (move_blocking) {
+        return std::unique_ptr<MPCBase>(new MPC_Decoupled<15, Dt, Blocks15>());
+      }
+      return std::unique_ptr<MPCBase>(new MPC_Decoupled<15>());
+    case 25:
+      if (move_blocking) {
+        return std::unique_ptr<MPCBase>(new MPC_Decoupled<25, Dt, Blocks25>());
+      }
+      return std::unique_ptr<MPCBase>(new MPC_Decoupled<25>());
+    default:
+      return std::unique_ptr<MPCBase>();
+  }
+}
@@ -0,0 +1,132 @@
+#ifndef MPC_DECOUPLED_H
+#define MPC_DECOUPLED_H
+
+#include <memory>
+#include <ratio>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "ActiveSetQP.h"
+#include "CondensedQP.h"
+#include "Horizon.h"
+#include "MPC.h"
+
+// MPC split into a longitudinal and a lateral problem instead of the joint
+// one of FG_eval.
+//
+// The throttle only moves the speed, v[t+1] = v[t] + a dt, and the speed
+// only enters the cost through its distance from the reference speed, so
+// the speed profile is found first on its own: the speed terms of the cost
+// and the throttle terms, a QP in the H::n_blocks throttles that is exact,
+// solved once by the active-set solver. The steering then follows over
+// that fixed profile by SQP like MPC_SQP, each QP the steering block of the
+// condensed QP (CondensedQP), the throttles held: H::n_blocks variables
+// instead of 2*H::n_blocks. What is lost is how the speed would give way to
+// the steering, the lateral errors growing with it, which is weak at
+// moderate speeds; the cost reported is that of the joint problem.
+//
+// The steering QP of the first iteration is the linear QP of the plan of
+// the last tick; SetTolerances(0, 1) stops there.
+template <size_t N, class Dt = std::ratio<1, 10>, class Blocks = NoBlocking>
+class MPC_Decoupled : public MPCBase {
+public:
+  typedef Horizon<N, Dt, Blocks> H;
+
+  explicit MPC_Decoupled(int max_iterations = 10, double tolerance = 1e-6);
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  void Reset() override {
+    has_plan_ = false;
+    lateral_.working_set().setZero();
+    longitudinal_.working_set().setZero();
+  }
+
+  std::unique_ptr<MPCBase> Clone() const override {
+    MPC_Decoupled *mpc = new MPC_Decoupled(max_iterations_, tolerance_);
+    mpc->CopySettings(*this);
+    return std::unique_ptr<MPCBase>(mpc);
+  }
+
+  size_t horizon_length() const override { return N; }
+  double timestep() const override { return H::dt; }
+  double stage_time(size_t t) const override { return H::time(t); }
+
+  MPCState planned_state(size_t t) const override { return plan_z_.col(t); }
+
+  void planned_actuations(size_t t, double &delta, double &a) const override {
+    delta = plan_u_[H::block(t)];
+    a = plan_u_[H::n_blocks + H::block(t)];
+  }
+
+  // Those of the steering SQP
+  void SetTolerances(double tolerance, int max_iterations) override {
+    if (tolerance > 0) {
+      tolerance_ = tolerance;
+    }
+    if (max_iterations > 0) {
+      max_iterations_ = max_iterations;
+    }
+  }
+
+  // No tape: the stage Jacobians and the condensed Hessian of CondensedQP,
+  // of which the steering block is factored, and the throttle QP
+  SolverFootprint Footprint() const override {
+    SolverFootprint footprint;
+    footprint.jacobian_nonzeros = (N - 1) * 6 * (6 + 2);
+    footprint.hessian_nonzeros = QP::n_u * (QP::n_u + 1) / 2;
+    footprint.kkt_nonzeros = 2 * Block::RowsAtCompileTime * (Block::RowsAtCompileTime + 1) / 2;
+    footprint.factor_nonzeros = footprint.kkt_nonzeros;
+    footprint.workspace_bytes = sizeof(*this);
+    return footprint;
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  typedef CondensedQP<H> QP;
+  typedef ActiveSetQP<int(H::n_blocks)> BlockQP;
+  typedef typename BlockQP::Matrix Block;
+  typedef typename BlockQP::Vector BlockVector;
+
+  // The throttles of the speed profile from the speed v0, into the tail of
+  // u_
+  void SolveLongitudinal(double v0, const CostWeights &weights);
+
+  // Solve with the model following reference, see CondensedQP
+  template <class Reference>
+  MPCSolution SolveAlong(const MPCState &state, const Reference &reference);
+
+  int max_iterations_;
+  double tolerance_;
+
+  QP qp_;
+  BlockQP lateral_;
+  BlockQP longitudinal_;
+
+  // The speed of every stage from the throttles, v = v0 + speed_ a, and
+  // the throttle terms of the cost (see CondensedQP::SetWeights)
+  Eigen::Matrix<double, int(N), int(H::n_blocks)> speed_;
+  Block throttle_cost_;
+
+  // Actuations of the last solve, their rollout, and whether they can seed
+  // the next solve
+  typename QP::Vector plan_u_ = QP::Vector::Zero();
+  typename QP::StateTrajectory plan_z_ = QP::StateTrajectory::Zero();
+  bool has_plan_ = false;
+
+  // Scratch
+  typename QP::Vector u_;
+  typename QP::Vector du_;
+  typename QP::Vector trial_;
+  Block block_hessian_;
+  BlockVector block_gradient_;
+  BlockVector block_lower_;
+  BlockVector block_upper_;
+  BlockVector block_step_;
+};
+
+// Make the decoupled MPC for a horizon of n timesteps of 0.1 s, like
+// MakeMPC_SQP.
+std::unique_ptr<MPCBase> MakeMPC_Decoupled(size_t n, bool move_blocking = false);
+
+#endif /* MPC_DECOUPLED_H */
@@ -0,0 +1,324 @@
+#include "MPC_ILQR.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include "Eigen-3.3/Eigen/LU"
+#include "Log.h"
+
+// Regularization of the actuator Hessians: the smallest, the factor it
+// grows or shrinks by, and the largest before the iteration gives up
+static const double kMinLambda = 1e-6;
+static const double kLambdaFactor = 10;
+static const double kMaxLambda = 1e10;
+// Line search: steps tried, the factor between them, and the fraction of
+// the expected reduction a step must achieve
+static const int kLineSearchSteps = 10;
+static const double kStepReduction = 0.5;
+static const double kSufficientReduction = 1e-4;
+
+namespace {
+
+// Minimize 0.5 x'hx + g'x over lo <= x <= hi into x, with free[i] whether
+// x[i] ends strictly inside its bounds. False if h isn't positive definite.
+// In two dimensions the minimizer is either the unconstrained one or lies
+// on one of the four edges of the box.
+bool MinimizeInBox(const Eigen::Matrix2d &h, const Eigen::Vector2d &g, const Eigen::Vector2d &lo,
+                   const Eigen::Vector2d &hi, Eigen::Vector2d &x, bool free[2]) {
+  const double det = h(0, 0) * h(1, 1) - h(0, 1) * h(1, 0);
+  if (h(0, 0) <= 0 || det <= 0) {
+    return false;
+  }
+  x << (-h(1, 1) * g[0] + h(0, 1) * g[1]) / det, (h(1, 0) * g[0] - h(0, 0) * g[1]) / det;
+  if ((x.array() >= lo.array()).all() && (x.array() <= hi.array()).all()) {
+    free[0] = free[1] = true;
+    return true;
+  }
+
+  double best = std::numeric_limits<double>::infinity();
+  for (int i = 0; i < 2; i++) {
+    const int j = 1 - i;
+    for (double bound : {lo[i], hi[i]}) {
+      Eigen::Vector2d edge;
+      edge[i] = bound;
+      edge[j] = std::min(hi[j], std::max(lo[j], -(g[j] + h(j, i) * bound) / h(j, j)));
+      const double value = 0.5 * edge.dot(h * edge) + g.dot(edge);
+      if (value < best) {
+        best = value;
+        x = edge;
+        free[i] = false;
+        free[j] = lo[j] < edge[j] && edge[j] < hi[j];
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+template <size_t N, class Dt>
+MPC_ILQR<N, Dt>::MPC_ILQR(int max_iterations, double tolerance)
+    : max_iterations_(max_iterations), tolerance_(tolerance) {
+  lb_ << -max_delta, -max_a;
+  ub_ << max_delta, max_a;
+  SetWeights(CostWeights());
+}
+
+template <size_t N, class Dt>
+void MPC_ILQR<N, Dt>::SetWeights(const CostWeights &weights) {
+  q_ << 0, 0, 0, weights.v, weights.cte, weights.epsi;
+  ref_ << 0, 0, 0, weights.v_ref, ref_cte, ref_epsi;
+  r_current_ << weights.current_delta, weights.current_a;
+  r_diff_ << weights.diff_delta, weights.diff_a;
+}
+
+template <size_t N, class Dt>
+double MPC_ILQR<N, Dt>::Rollout(const MPCState &state, const ActuationTrajectory &u,
+                                const MPCCoeffs &coeffs, StateTrajectory &z) const {
+  double cost = 0;
+  z.col(0) = state;
+  for (size_t t = 0; t < N; t++) {
+    const MPCState e = z.col(t) - ref_;
+    cost += e.dot(q_.cwiseProduct(e));
+    if (t + 1 < N) {
+      z.col(t + 1) = ModelStep(z.col(t), u(0, t), u(1, t), coeffs, H::step(t));
+      cost += u.col(t).dot(r_current_.cwiseProduct(u.col(t)));
+    }
+    if (t + 2 < N) {
+      const Eigen::Vector2d d = u.col(t + 1) - u.col(t);
+      cost += d.dot(r_diff_.cwiseProduct(d));
+    }
+  }
+  return cost;
+}
+
+template <size_t N, class Dt>
+bool MPC_ILQR<N, Dt>::BackwardPass(const MPCCoeffs &coeffs, double lambda,
+                                   double &expected_linear, double &expected_quadratic) {
+  // Cost-to-go of the last state, only its model part has a cost
+  StateVector v_x = StateVector::Zero();
+  StateMatrix v_xx = StateMatrix::Zero();
+  v_x.template head<6>() = 2 * q_.cwiseProduct(z_.col(N - 1) - ref_);
+  v_xx.template topLeftCorner<6, 6>() = (2 * q_).asDiagonal();
+  expected_linear = 0;
+  expected_quadratic = 0;
+
+  StageTerms<int(N - 1)> terms;
+  EvaluateStageTerms(z_, coeffs, terms);
+  StateJacobian a;
+  ActuationJacobian b;
+  StateMatrix f_x = StateMatrix::Zero();
+  Eigen::Matrix<double, 8, 2> f_u;
+  f_u.template bottomRows<2>().setIdentity();
+  for (size_t t = N - 1; t-- > 0;) {
+    const MPCState z = z_.col(t);
+    const Eigen::Vector2d u = u_.col(t);
+    ModelJacobian(terms, t, z[3], u[0], H::step(t), a, b);
+    f_x.template topLeftCorner<6, 6>() = a;
+    f_u.template topRows<6>() = b;
+
+    // Derivatives of the stage cost. The difference with the previous
+    // actuations, the tail of the state, starts at the second stage.
+    StateVector l_x = StateVector::Zero();
+    StateMatrix l_xx = StateMatrix::Zero();
+    Eigen::Vector2d l_u = 2 * r_current_.cwiseProduct(u);
+    Eigen::Matrix2d l_uu = (2 * r_current_).asDiagonal();
+    GainMatrix l_ux = GainMatrix::Zero();
+    l_x.template head<6>() = 2 * q_.cwiseProduct(z - ref_);
+    l_xx.template topLeftCorner<6, 6>() = (2 * q_).asDiagonal();
+    if (t > 0) {
+      const Eigen::Vector2d d = u - u_.col(t - 1);
+      l_x.template tail<2>() = -2 * r_diff_.cwiseProduct(d);
+      l_xx.template bottomRightCorner<2, 2>() = (2 * r_diff_).asDiagonal();
+      l_u += 2 * r_diff_.cwiseProduct(d);
+      l_uu += (2 * r_diff_).asDiagonal();
+      l_ux.template rightCols<2>() = (-2 * r_diff_).asDiagonal();
+    }
+
+    const StateVector q_x = l_x + f_x.transpose() * v_x;
+    const Eigen::Vector2d q_u = l_u + f_u.transpose() * v_x;
+    const StateMatrix q_xx = l_xx + f_x.transpose() * v_xx * f_x;
+    const Eigen::Matrix2d q_uu = l_uu + f_u.transpose() * v_xx * f_u;
+    const GainMatrix q_ux = l_ux + f_u.transpose() * v_xx * f_x;
+
+    // Step within the bounds, and the gains of the actuations it leaves free
+    const Eigen::Matrix2d q_uu_reg = q_uu + lambda * Eigen::Matrix2d::Identity();
+    Eigen::Vector2d k;
+    bool free[2];
+    if (!MinimizeInBox(q_uu_reg, q_u, lb_ - u, ub_ - u, k, free)) {
+      return false;
+    }
+    GainMatrix gain = GainMatrix::Zero();
+    if (free[0] && free[1]) {
+      gain = -q_uu_reg.inverse() * q_ux;
+    } else {
+      for (int i = 0; i < 2; i++) {
+        if (free[i]) {
+          gain.row(i) = -q_ux.row(i) / q_uu_reg(i, i);
+        }
+      }
+    }
+    k_.col(t) = k;
+    gains_[t] = gain;
+
+    expected_linear += k.dot(q_u);
+    expected_quadratic += 0.5 * k.dot(q_uu * k);
+    v_x = q_x + gain.transpose() * (q_uu * k + q_u) + q_ux.transpose() * k;
+    v_xx = q_xx + gain.transpose() * q_uu * gain + gain.transpose() * q_ux +
+           q_ux.transpose() * gain;
+    v_xx = 0.5 * (v_xx + v_xx.transpose()).eval();
+  }
+  return true;
+}
+
+template <size_t N, class Dt>
+double MPC_ILQR<N, Dt>::ForwardPass(const MPCState &state, const MPCCoeffs &coeffs,
+                                    double alpha, StateTrajectory &z,
+                                    ActuationTrajectory &u) const {
+  z.col(0) = state;
+  for (size_t t = 0; t + 1 < N; t++) {
+    StateVector dx = StateVector::Zero();
+    dx.template head<6>() = z.col(t) - z_.col(t);
+    if (t > 0) {
+      dx.template tail<2>() = u.col(t - 1) - u_.col(t - 1);
+    }
+    u.col(t) = (u_.col(t) + alpha * k_.col(t) + gains_[t] * dx).cwiseMax(lb_).cwiseMin(ub_);
+    z.col(t + 1) = ModelStep(z.col(t), u(0, t), u(1, t), coeffs, H::step(t));
+  }
+  return Rollout(state, u, coeffs, z);
+}
+
+template <size_t N, class Dt>
+MPCSolution MPC_ILQR<N, Dt>::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
+  const SolveStart start = has_plan_ ? SolveStart::kWarm : SolveStart::kCold;
+  const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(max_solve_time));
+
+  SetWeights(cost_schedule.At(state[3]));
+
+  // Start from the last actuations shifted by one stage, or as they are
+  // after RepeatTick, and their rollout
+  const size_t shift = repeat_ ? 0 : 1;
+  for (size_t t = 0; t + 1 < N; t++) {
+    if (has_plan_) {
+      u_.col(t) = plan_u_.col(std::min(t + shift, N - 2));
+    } else {
+      u_.col(t).setZero();
+    }
+  }
+  repeat_ = false;
+  cost_now_ = Rollout(state, u_, coeffs, z_);
+
+  // Every iterate is a rollout within the bounds, so it can be returned at
+  // the deadline
+  bool ok = false;
+  bool failed = false;
+  bool expired = false;
+  double lambda = kMinLambda;
+  StateTrajectory z_next;
+  ActuationTrajectory u_next;
+  for (iterations_ = 0; iterations_ < max_iterations_;) {
+    iterations_++;
+    double expected_linear;
+    double expected_quadratic;
+    bool backward = BackwardPass(coeffs, lambda, expected_linear, expected_quadratic);
+    while (!backward && lambda < kMaxLambda) {
+      lambda *= kLambdaFactor;
+      backward = BackwardPass(coeffs, lambda, expected_linear, expected_quadratic);
+    }
+    if (!backward) {
+      std::cerr << "iLQR: actuator Hessian is not positive definite" << std::endl;
+      failed = iterations_ == 1;
+      break;
+    }
+    if (-(expected_linear + expected_quadratic) <= tolerance_ * (1 + cost_now_)) {
+      ok = true;
+      break;
+    }
+
+    double alpha = 1;
+    bool accepted = false;
+    double cost_next = cost_now_;
+    for (int step = 0; step < kLineSearchSteps; step++, alpha *= kStepReduction) {
+      cost_next = ForwardPass(state, coeffs, alpha, z_next, u_next);
+      const double expected = -alpha * (expected_linear + alpha * expected_quadratic);
+      if (cost_now_ - cost_next >= kSufficientReduction * expected) {
+        accepted = true;
+        break;
+      }
+    }
+
+    if (accepted) {
+      const double reduction = cost_now_ - cost_next;
+      z_ = z_next;
+      u_ = u_next;
+      cost_now_ = cost_next;
+      lambda = std::max(kMinLambda, lambda / kLambdaFactor);
+      if (reduction <= tolerance_ * (1 + cost_now_)) {
+        ok = true;
+        break;
+      }
+    } else {
+      // The quadratic model is off this far from the iterate, take shorter
+      // steps closer to gradient descent
+      lambda *= kLambdaFactor;
+      if (lambda > kMaxLambda) {
+        break;
+      }
+    }
+    if (std::chrono::steady_clock::now() >= deadline || preempted()) {
+      expired = true;
+      break;
+    }
+  }
+
+  plan_u_ = u_;
+  plan_z_ = z_;
+  has_plan_ = true;
+  if (failed) {
+    status_ = SolveStatus::kFailed;
+  } else if (expired) {
+    status_ = SolveStatus::kDeadline;
+  } else {
+    status_ = SolveStatus::kSolved;
+    if (!ok) {
+      std::cerr << "iLQR: no convergence in " << iterations_ << " iterations" << std::endl;
+    }
+  }
+
+  // Cost
+  cost_ = cost_now_;
+  Log(LogLevel::kInfo, "Cost {}", cost_now_);
+
+  MPCSolution plan;
+  plan.set_states(plan_z_);
+  plan.set_times<H>();
+  for (size_t t = 0; t < N - 1; t++) {
+    plan.delta[t] = plan_u_(0, t);
+    plan.a[t] = plan_u_(1, t);
+  }
+  plan.status = status_;
+  plan.cost = cost_;
+  plan.statistics.iterations = iterations_;
+  plan.statistics.start = start;
+  return plan;
+}
+
+template class MPC_ILQR<10>;
+template class MPC_ILQR<15>;
+template class MPC_ILQR<25>;
+
+std::unique_ptr<MPCBase> MakeMPC_ILQR(size_t n) {
+  switch (n) {
+    case 10:
+      return std::unique_ptr<MPCBase>(new MPC_ILQR<10>());
+    case 15:
+      return std::unique_ptr<MPCBase>(new MPC_ILQR<15>());
+    case 25:
+      return std::unique_ptr<MPCBase>(new MPC_ILQR<25>());
+    default:
+      return std::unique_ptr<MPCBase>();
+  }
+}
@@ -0,0 +1,135 @@
+#ifndef MPC_ILQR_H
+#define MPC_ILQR_H
+
+#include <array>
+#include <memory>
+#include <ratio>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Horizon.h"
+#include "KinematicModel.h"
+#include "MPC.h"
+
+// MPC solved by iterative LQR with box constrained actuations, single
+// shooting: the iterate is the actuation sequence, the states are always its
+// rollout through the model.
+//
+// Each iteration runs a backward pass over the stages with the closed form
+// Jacobians of the model (KinematicModel.h) and the exact Hessian of the
+// cost, which is that of FG_eval. The actuation step of each stage is the
+// minimizer of its quadratic model within the bounds; the feedback gains act
+// only on the actuations it leaves off their bounds. A forward pass then
+// rolls out the gains with a backtracking line search on the nonlinear cost.
+// The sequential actuator differences couple neighbouring stages, so the
+// state of the recursion is the model state with the previous actuations
+// appended, as in MPC_IPM. An iteration costs O(N) in 8 x 8 blocks and
+// needs no sparse linear algebra.
+//
+// Warm started from the last actuations shifted by one stage, it usually
+// stops after a few iterations, once the relative cost reduction falls
+// below tolerance.
+//
+// One actuation per stage: there is no move blocking variant.
+template <size_t N, class Dt = std::ratio<1, 10> >
+class MPC_ILQR : public MPCBase {
+public:
+  typedef Horizon<N, Dt> H;
+
+  explicit MPC_ILQR(int max_iterations = 50, double tolerance = 1e-6);
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  void Reset() override { has_plan_ = false; }
+
+  void RepeatTick() override { repeat_ = true; }
+
+  std::unique_ptr<MPCBase> Clone() const override {
+    MPC_ILQR *mpc = new MPC_ILQR(max_iterations_, tolerance_);
+    mpc->CopySettings(*this);
+    return std::unique_ptr<MPCBase>(mpc);
+  }
+
+  void SetTolerances(double tolerance, int max_iterations) override {
+    if (tolerance > 0) {
+      tolerance_ = tolerance;
+    }
+    if (max_iterations > 0) {
+      max_iterations_ = max_iterations;
+    }
+  }
+
+  size_t horizon_length() const override { return N; }
+  double timestep() const override { return H::dt; }
+  double stage_time(size_t t) const override { return H::time(t); }
+
+  MPCState planned_state(size_t t) const override { return plan_z_.col(t); }
+
+  void planned_actuations(size_t t, double &delta, double &a) const override {
+    delta = plan_u_(0, t);
+    a = plan_u_(1, t);
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  // One state per column, row major so that each state over the horizon is
+  // contiguous for EvaluateStageTerms
+  typedef Eigen::Matrix<double, 6, int(N), Eigen::RowMajor> StateTrajectory;
+  typedef Eigen::Matrix<double, 2, int(N - 1)> ActuationTrajectory;
+  // Model state and the actuations of the previous stage
+  typedef Eigen::Matrix<double, 8, 1> StateVector;
+  typedef Eigen::Matrix<double, 8, 8> StateMatrix;
+  typedef Eigen::Matrix<double, 2, 8> GainMatrix;
+
+  // Use weights in the cost from now on
+  void SetWeights(const CostWeights &weights);
+
+  // Backward pass along z_, u_ with regularization lambda on the actuator
+  // Hessians into k_, gains_ and the expected reduction of a full step and
+  // its quadratic term. False if a free actuator Hessian isn't positive
+  // definite.
+  bool BackwardPass(const MPCCoeffs &coeffs, double lambda, double &expected_linear,
+                    double &expected_quadratic);
+
+  // Roll the gains out from state with step alpha into z, u. Return the cost
+  // of FG_eval.
+  double ForwardPass(const MPCState &state, const MPCCoeffs &coeffs, double alpha,
+                     StateTrajectory &z, ActuationTrajectory &u) const;
+
+  // Roll the model out from state along the actuations u into z. Return the
+  // cost of FG_eval.
+  double Rollout(const MPCState &state, const ActuationTrajectory &u, const MPCCoeffs &coeffs,
+                 StateTrajectory &z) const;
+
+  int max_iterations_;
+  double tolerance_;
+
+  // State cost weights (diagonal) and reference, actuator bounds and cost
+  MPCState q_;
+  MPCState ref_;
+  Eigen::Vector2d lb_;
+  Eigen::Vector2d ub_;
+  Eigen::Vector2d r_current_;
+  Eigen::Vector2d r_diff_;
+
+  // Iterate, its cost, and the feedforward steps and feedback gains of the
+  // backward pass
+  StateTrajectory z_;
+  ActuationTrajectory u_;
+  double cost_now_ = 0;
+  ActuationTrajectory k_;
+  std::array<GainMatrix, N - 1> gains_;
+
+  // Actuations of the last solve, their rollout, and whether they can seed
+  // the next solve
+  ActuationTrajectory plan_u_ = ActuationTrajectory::Zero();
+  StateTrajectory plan_z_ = StateTrajectory::Zero();
+  bool has_plan_ = false;
+  // The next solve is for the tick of the last one, see RepeatTick
+  bool repeat_ = false;
+};
+
+// Make the iLQR MPC for a horizon of n timesteps of 0.1 s, like MakeMPC.
+std::unique_ptr<MPCBase> MakeMPC_ILQR(size_t n);
+
+#endif /* MPC_ILQR_H */
@@ -0,0 +1,267 @@
+#include "MPC_IPM.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include "Log.h"
+
+// Barrier parameter of the first iteration, fraction of the distance to the
+// bounds a step may take, and the fastest reduction of the barrier per
+// iteration
+static const double kInitialMu = 1.0;
+static const double kFractionToBoundary = 0.995;
+static const double kMuReduction = 0.1;
+
+template <size_t N, class Dt>
+MPC_IPM<N, Dt>::MPC_IPM(int max_iterations, double tolerance)
+    : max_iterations_(max_iterations), tolerance_(tolerance) {
+  lb_ << -max_delta, -max_a;
+  ub_ << max_delta, max_a;
+  lq_.terminal_hessian().setZero();
+  lq_.terminal_gradient().setZero();
+  SetWeights(CostWeights());
+}
+
+template <size_t N, class Dt>
+void MPC_IPM<N, Dt>::SetWeights(const CostWeights &weights) {
+  q_ << 0, 0, 0, weights.v, weights.cte, weights.epsi;
+  ref_ << 0, 0, 0, weights.v_ref, ref_cte, ref_epsi;
+  r_current_ << weights.current_delta, weights.current_a;
+  r_diff_ << weights.diff_delta, weights.diff_a;
+
+  // Only the model part of the last state has a cost
+  lq_.terminal_hessian().template topLeftCorner<6, 6>() = (2 * q_).asDiagonal();
+}
+
+template <size_t N, class Dt>
+double MPC_IPM<N, Dt>::Rollout(const MPCState &state, const ActuationTrajectory &u,
+                               const MPCCoeffs &coeffs, StateTrajectory &z) const {
+  double cost = 0;
+  z.col(0) = state;
+  for (size_t t = 0; t < N; t++) {
+    const MPCState e = z.col(t) - ref_;
+    cost += e.dot(q_.cwiseProduct(e));
+    if (t + 1 < N) {
+      z.col(t + 1) = ModelStep(z.col(t), u(0, t), u(1, t), coeffs, H::step(t));
+      cost += u.col(t).dot(r_current_.cwiseProduct(u.col(t)));
+    }
+    if (t + 2 < N) {
+      const Eigen::Vector2d d = u.col(t + 1) - u.col(t);
+      cost += d.dot(r_diff_.cwiseProduct(d));
+    }
+  }
+  return cost;
+}
+
+template <size_t N, class Dt>
+void MPC_IPM<N, Dt>::BuildNewtonStep(const MPCCoeffs &coeffs, double mu) {
+  StageTerms<int(N - 1)> terms;
+  EvaluateStageTerms(z_, coeffs, terms);
+  StateJacobian a;
+  ActuationJacobian b;
+  for (size_t t = 0; t + 1 < N; t++) {
+    typename LQ::Stage &s = lq_.stage(t);
+    const MPCState z = z_.col(t);
+    const Eigen::Vector2d u = u_.col(t);
+
+    // dz[t+1] = A dz[t] + B du[t] + defect, and the previous actuations
+    // carried along
+    ModelJacobian(terms, t, z[3], u[0], H::step(t), a, b);
+    s.A.setZero();
+    s.A.template topLeftCorner<6, 6>() = a;
+    s.B.template topRows<6>() = b;
+    s.B.template bottomRows<2>().setIdentity();
+    s.c.template head<6>() = ModelStep(z, u[0], u[1], coeffs, H::step(t)) - z_.col(t + 1);
+    s.c.template tail<2>().setZero();
+
+    // State cost
+    s.Q.setZero();
+    s.Q.template topLeftCorner<6, 6>() = (2 * q_).asDiagonal();
+    s.q.template head<6>() = 2 * q_.cwiseProduct(z - ref_);
+    s.q.template tail<2>().setZero();
+
+    // Actuator cost and the barrier of its bounds, with the multipliers
+    // eliminated
+    const Eigen::Vector2d s_l = u - lb_;
+    const Eigen::Vector2d s_u = ub_ - u;
+    s.R = (2 * r_current_ + lambda_l_.col(t).cwiseQuotient(s_l) +
+           lambda_u_.col(t).cwiseQuotient(s_u)).asDiagonal();
+    s.r = 2 * r_current_.cwiseProduct(u);
+    s.r.array() += -mu / s_l.array() + mu / s_u.array();
+    s.S.setZero();
+
+    // Difference with the previous actuations, which are the tail of the
+    // Riccati state. The first stage has none.
+    if (t > 0) {
+      const Eigen::Vector2d d = u - u_.col(t - 1);
+      s.Q.template bottomRightCorner<2, 2>() = (2 * r_diff_).asDiagonal();
+      s.S.template rightCols<2>() = (-2 * r_diff_).asDiagonal();
+      s.R += (2 * r_diff_).asDiagonal();
+      s.r += 2 * r_diff_.cwiseProduct(d);
+      s.q.template tail<2>() = -2 * r_diff_.cwiseProduct(d);
+    }
+  }
+
+  lq_.terminal_gradient().template head<6>() = 2 * q_.cwiseProduct(z_.col(N - 1) - ref_);
+}
+
+template <size_t N, class Dt>
+MPCSolution MPC_IPM<N, Dt>::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
+  const SolveStart start = has_plan_ ? SolveStart::kWarm : SolveStart::kCold;
+  const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(max_solve_time));
+
+  SetWeights(cost_schedule.At(state[3]));
+
+  // Start from the last actuations shifted by one stage, strictly inside the
+  // bounds, and their rollout
+  const Eigen::Vector2d margin = 1e-3 * (ub_ - lb_);
+  for (size_t t = 0; t + 1 < N; t++) {
+    if (has_plan_) {
+      u_.col(t) = plan_u_.col(std::min(t + 1, N - 2));
+    } else {
+      u_.col(t).setZero();
+    }
+    u_.col(t) = u_.col(t).cwiseMax(lb_ + margin).cwiseMin(ub_ - margin);
+  }
+  Rollout(state, u_, coeffs, z_);
+
+  // Multipliers on the central path of the first barrier parameter
+  double mu = kInitialMu;
+  for (size_t t = 0; t + 1 < N; t++) {
+    lambda_l_.col(t) = mu * (u_.col(t) - lb_).cwiseInverse();
+    lambda_u_.col(t) = mu * (ub_ - u_.col(t)).cwiseInverse();
+  }
+
+  // The actuations stay inside the bounds, so the rollout of any iterate is
+  // feasible and can be returned at the deadline
+  bool ok = false;
+  bool failed = false;
+  bool expired = false;
+  ActuationTrajectory dlambda_l;
+  ActuationTrajectory dlambda_u;
+  iterations_ = 0;
+  for (int iter = 0; iter < max_iterations_; iter++) {
+    iterations_ = iter + 1;
+    BuildNewtonStep(coeffs, mu);
+    typename LQ::StateVector dx0;
+    dx0 << state - z_.col(0), 0, 0;
+    if (!lq_.Solve(dx0, dx_, du_)) {
+      std::cerr << "IPM: Newton step is not a descent direction" << std::endl;
+      failed = iter == 0;
+      break;
+    }
+
+    // Multiplier steps, and the longest steps that keep the actuations and
+    // the multipliers strictly positive distances from their bounds
+    double alpha_p = 1.0;
+    double alpha_d = 1.0;
+    for (size_t t = 0; t + 1 < N; t++) {
+      for (int i = 0; i < 2; i++) {
+        const double s_l = u_(i, t) - lb_[i];
+        const double s_u = ub_[i] - u_(i, t);
+        const double l_l = lambda_l_(i, t);
+        const double l_u = lambda_u_(i, t);
+        const double du = du_[t][i];
+        dlambda_l(i, t) = (mu - s_l * l_l - l_l * du) / s_l;
+        dlambda_u(i, t) = (mu - s_u * l_u + l_u * du) / s_u;
+
+        if (du < 0) {
+          alpha_p = std::min(alpha_p, -kFractionToBoundary * s_l / du);
+        } else if (du > 0) {
+          alpha_p = std::min(alpha_p, kFractionToBoundary * s_u / du);
+        }
+        if (dlambda_l(i, t) < 0) {
+          alpha_d = std::min(alpha_d, -kFractionToBoundary * l_l / dlambda_l(i, t));
+        }
+        if (dlambda_u(i, t) < 0) {
+          alpha_d = std::min(alpha_d, -kFractionToBoundary * l_u / dlambda_u(i, t));
+        }
+      }
+    }
+
+    double step = 0;
+    for (size_t t = 0; t < N; t++) {
+      z_.col(t) += alpha_p * dx_[t].template head<6>();
+      step = std::max(step, dx_[t].template head<6>().template lpNorm<Eigen::Infinity>());
+      if (t + 1 < N) {
+        u_.col(t) += alpha_p * du_[t];
+        step = std::max(step, du_[t].template lpNorm<Eigen::Infinity>());
+      }
+    }
+    lambda_l_ += alpha_d * dlambda_l;
+    lambda_u_ += alpha_d * dlambda_u;
+
+    // Average complementarity, the barrier parameter actually reached
+    double gap = 0;
+    for (size_t t = 0; t + 1 < N; t++) {
+      gap += (u_.col(t) - lb_).dot(lambda_l_.col(t)) + (ub_ - u_.col(t)).dot(lambda_u_.col(t));
+    }
+    gap /= 4 * (N - 1);
+
+    if (alpha_p * step < tolerance_ && gap < tolerance_) {
+      ok = true;
+      break;
+    }
+    // Short steps mean the iterate is far from the central path, keep most
+    // of the barrier then
+    const double alpha = std::min(alpha_p, alpha_d);
+    mu = std::max(kMuReduction, (1 - alpha) * (1 - alpha)) * gap;
+    if (std::chrono::steady_clock::now() >= deadline || preempted()) {
+      expired = true;
+      break;
+    }
+  }
+
+  plan_u_ = u_;
+  has_plan_ = true;
+  if (failed) {
+    status_ = SolveStatus::kFailed;
+  } else if (expired) {
+    status_ = SolveStatus::kDeadline;
+  } else {
+    status_ = SolveStatus::kSolved;
+    if (!ok) {
+      std::cerr << "IPM: no convergence in " << max_iterations_ << " iterations" << std::endl;
+    }
+  }
+
+  // The plan is the rollout of the actuations, the shooting states of the
+  // iterate only agree with it up to the remaining defects
+  const double cost = Rollout(state, plan_u_, coeffs, plan_z_);
+
+  // Cost
+  cost_ = cost;
+  Log(LogLevel::kInfo, "Cost {}", cost);
+
+  MPCSolution plan;
+  plan.set_states(plan_z_);
+  plan.set_times<H>();
+  for (size_t t = 0; t < N - 1; t++) {
+    plan.delta[t] = plan_u_(0, t);
+    plan.a[t] = plan_u_(1, t);
+  }
+  plan.status = status_;
+  plan.cost = cost_;
+  plan.statistics.iterations = iterations_;
+  plan.statistics.start = start;
+  return plan;
+}
+
+template class MPC_IPM<10>;
+template class MPC_IPM<15>;
+template class MPC_IPM<25>;
+
+std::unique_ptr<MPCBase> MakeMPC_IPM(size_t n) {
+  switch (n) {
+    case 10:
+      return std::unique_ptr<MPCBase>(new MPC_IPM<10>());
+    case 15:
+      return std::unique_ptr<MPCBase>(new MPC_IPM<15>());
+    case 25:
+      return std::unique_ptr<MPCBase>(new MPC_IPM<25>());
+    default:
+      return std::unique_ptr<MPCBase>();
+  }
+}
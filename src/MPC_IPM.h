@@ -0,0 +1,118 @@
+#ifndef MPC_IPM_H
+#define MPC_IPM_H
+
+#include <memory>
+#include <ratio>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Horizon.h"
+#include "KinematicModel.h"
+#include "MPC.h"
+#include "RiccatiLQ.h"
+
+// MPC solved by a primal-dual interior-point method that keeps the stage
+// structure of the problem instead of handing the whole KKT system to a
+// sparse factorization.
+//
+// The iterate holds every state and actuation, multiple shooting style, and
+// the multipliers of the actuator bounds. Each Newton step linearizes the
+// model at every stage (KinematicModel.h), adds the barrier terms of the
+// bounds to the actuator Hessians and solves the resulting LQ problem with
+// RiccatiLQ, so an iteration costs O(N). The sequential actuator differences
+// of the cost couple neighbouring stages, so the Riccati state is the model
+// state with the previous actuations appended (8 states, 2 inputs). The
+// Hessian is Gauss-Newton, i.e. the exact Hessian of the cost.
+//
+// One actuation per stage: there is no move blocking variant.
+template <size_t N, class Dt = std::ratio<1, 10> >
+class MPC_IPM : public MPCBase {
+public:
+  typedef Horizon<N, Dt> H;
+
+  explicit MPC_IPM(int max_iterations = 30, double tolerance = 1e-6);
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  void Reset() override { has_plan_ = false; }
+
+  std::unique_ptr<MPCBase> Clone() const override {
+    MPC_IPM *mpc = new MPC_IPM(max_iterations_, tolerance_);
+    mpc->CopySettings(*this);
+    return std::unique_ptr<MPCBase>(mpc);
+  }
+
+  void SetTolerances(double tolerance, int max_iterations) override {
+    if (tolerance > 0) {
+      tolerance_ = tolerance;
+    }
+    if (max_iterations > 0) {
+      max_iterations_ = max_iterations;
+    }
+  }
+
+  size_t horizon_length() const override { return N; }
+  double timestep() const override { return H::dt; }
+  double stage_time(size_t t) const override { return H::time(t); }
+
+  MPCState planned_state(size_t t) const override { return plan_z_.col(t); }
+
+  void planned_actuations(size_t t, double &delta, double &a) const override {
+    delta = plan_u_(0, t);
+    a = plan_u_(1, t);
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  // One state per column, row major so that each state over the horizon is
+  // contiguous for EvaluateStageTerms
+  typedef Eigen::Matrix<double, 6, int(N), Eigen::RowMajor> StateTrajectory;
+  typedef Eigen::Matrix<double, 2, int(N - 1)> ActuationTrajectory;
+  // Model state and the actuations of the previous stage
+  typedef RiccatiLQ<8, 2, N - 1> LQ;
+
+  // Use weights in the cost from now on
+  void SetWeights(const CostWeights &weights);
+
+  // Fill the LQ problem of the Newton step at the current iterate for the
+  // barrier parameter mu
+  void BuildNewtonStep(const MPCCoeffs &coeffs, double mu);
+
+  // Roll the model out from state along the actuations u into z. Return the
+  // cost of FG_eval.
+  double Rollout(const MPCState &state, const ActuationTrajectory &u, const MPCCoeffs &coeffs,
+                 StateTrajectory &z) const;
+
+  int max_iterations_;
+  double tolerance_;
+
+  // State cost weights (diagonal) and reference, actuator bounds and cost
+  MPCState q_;
+  MPCState ref_;
+  Eigen::Vector2d lb_;
+  Eigen::Vector2d ub_;
+  Eigen::Vector2d r_current_;
+  Eigen::Vector2d r_diff_;
+
+  LQ lq_;
+  std::array<typename LQ::StateVector, N> dx_;
+  std::array<typename LQ::InputVector, N - 1> du_;
+
+  // Iterate: states, actuations and bound multipliers
+  StateTrajectory z_;
+  ActuationTrajectory u_;
+  ActuationTrajectory lambda_l_;
+  ActuationTrajectory lambda_u_;
+
+  // Actuations of the last solve, their rollout, and whether they can seed
+  // the next solve
+  ActuationTrajectory plan_u_ = ActuationTrajectory::Zero();
+  StateTrajectory plan_z_ = StateTrajectory::Zero();
+  bool has_plan_ = false;
+};
+
+// Make the interior-point MPC for a horizon of n timesteps of 0.1 s, like
+// MakeMPC.
+std::unique_ptr<MPCBase> MakeMPC_IPM(size_t n);
+
+#endif /* MPC_IPM_H */
@@ -0,0 +1,1098 @@
+#include "MPC_NLP.h"
+#include "FG_eval.h"
+#include <coin/IpIpoptData.hpp>
+#include <coin/IpIpoptCalculatedQuantities.hpp>
+#include <coin/IpOrigIpoptNLP.hpp>
+#include <coin/IpTNLPAdapter.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "Instrumentation.h"
+#include "PerfCounters.h"
+
+using Ipopt::Index;
+using Ipopt::Number;
+
+// Constraint violation below which an iterate counts as feasible (the
+// default constr_viol_tol of Ipopt)
+static const double feasible_inf_pr = 1e-4;
+// Bounds beyond which Ipopt takes a variable as unbounded (its
+// nlp_lower_bound_inf and nlp_upper_bound_inf)
+static const double bound_infinity = 1e19;
+
+// The adapter between the TNLP and the internal problem of Ipopt, through
+// which alone the iterates are reachable in the terms of the TNLP; null if
+// the problem isn't a TNLP's
+static Ipopt::TNLPAdapter *Adapter(Ipopt::IpoptCalculatedQuantities *ip_cq) {
+  Ipopt::OrigIpoptNLP *orig_nlp =
+      dynamic_cast<Ipopt::OrigIpoptNLP *>(Ipopt::GetRawPtr(ip_cq->GetIpoptNLP()));
+  if (orig_nlp == nullptr) {
+    return nullptr;
+  }
+  return dynamic_cast<Ipopt::TNLPAdapter *>(Ipopt::GetRawPtr(orig_nlp->nlp()));
+}
+
+template <class H>
+MPC_NLP<H>::MPC_NLP(bool sampled_reference, size_t reference_order, bool checkpoint_stages)
+    : sampled_reference_(sampled_reference),
+      reference_order_(sampled_reference ? 3
+                                         : std::min<size_t>(std::max<size_t>(reference_order, 1), 3)),
+      checkpoint_stages_(false), params_(sampled_reference ? n_sampled_params<H>() : n_params),
+      x_l_(H::n_vars + 2 * H::n_constraints), x_u_(H::n_vars + 2 * H::n_constraints),
+      start_x_(H::n_vars), start_z_l_(H::n_vars), start_z_u_(H::n_vars),
+      start_lambda_(H::n_constraints), x_(H::n_vars), fg_(1 + H::n_constraints),
+      w_(1 + H::n_constraints), best_x_(H::n_vars + 2 * H::n_constraints),
+      solution_x_(H::n_vars), solution_z_l_(H::n_vars), solution_z_u_(H::n_vars),
+      solution_lambda_(H::n_constraints) {
+  typedef typename FG_eval<H>::ADvector ADvector;
+
+  // The stage functions, recorded before the tape that calls them
+  const StageCheckpoints<H> *checkpoints =
+      checkpoint_stages ? StageCheckpoints<H>::Get(sampled_reference_, reference_order_) : nullptr;
+  checkpoint_stages_ = checkpoints != nullptr;
+
+  // Record the model once. The values used while taping don't matter since
+  // the model has no data dependent branches.
+  ADvector avars(H::n_vars);
+  for (size_t i = 0; i < H::n_vars; i++) {
+    avars[i] = 0.0;
+  }
+  ADvector aparams(params_.size());
+  for (size_t i = 0; i < params_.size(); i++) {
+    params_[i] = 0.0;
+  }
+  CostWeights().Store(&params_[weights_start]);
+  for (size_t i = 0; i < params_.size(); i++) {
+    aparams[i] = params_[i];
+  }
+  CppAD::Independent(avars, 0, false, aparams);
+
+  ADvector afg(1 + H::n_constraints);
+  if (sampled_reference_) {
+    FG_eval<H, double, true> fg_eval(aparams);
+    fg_eval.checkpoints = checkpoints;
+    fg_eval(afg, avars);
+  } else {
+    FG_eval<H> fg_eval(aparams, reference_order_);
+    fg_eval.checkpoints = checkpoints;
+    fg_eval(afg, avars);
+  }
+
+  fg_fun_.Dependent(avars, afg);
+  fg_fun_.optimize();
+
+  // The patterns depend only on N and the model structure, compute them
+  // once here together with their colouring.
+  ComputeSparsity();
+  InitBounds();
+  ClearIterates();
+}
+
+template <class H>
+MPC_NLP<H>::MPC_NLP(const MPC_NLP &prototype)
+    : sampled_reference_(prototype.sampled_reference_),
+      reference_order_(prototype.reference_order_),
+      checkpoint_stages_(prototype.checkpoint_stages_), params_(prototype.params_), weights_(prototype.weights_), x_l_(prototype.x_l_),
+      x_u_(prototype.x_u_), start_x_(H::n_vars), start_z_l_(H::n_vars), start_z_u_(H::n_vars),
+      start_lambda_(H::n_constraints), jac_pattern_(prototype.jac_pattern_),
+      cost_cols_(prototype.cost_cols_), hes_pattern_(prototype.hes_pattern_),
+      jac_subset_(prototype.jac_subset_), hes_subset_(prototype.hes_subset_),
+      jac_work_(prototype.jac_work_), hes_work_(prototype.hes_work_),
+      linear_rows_(prototype.linear_rows_), linear_entries_(prototype.linear_entries_),
+      nonlinear_entries_(prototype.nonlinear_entries_),
+      linear_subset_(prototype.linear_subset_), nonlinear_subset_(prototype.nonlinear_subset_),
+      linear_work_(prototype.linear_work_), nonlinear_work_(prototype.nonlinear_work_),
+      nonlinear_sweeps_(prototype.nonlinear_sweeps_), full_sweeps_(prototype.full_sweeps_),
+      reverse_jacobian_(prototype.reverse_jacobian_), jac_coloring_(prototype.jac_coloring_),
+      hes_coloring_(prototype.hes_coloring_), x_(H::n_vars),
+      fg_(1 + H::n_constraints), w_(1 + H::n_constraints),
+      best_x_(H::n_vars + 2 * H::n_constraints), solution_x_(H::n_vars),
+      solution_z_l_(H::n_vars), solution_z_u_(H::n_vars), solution_lambda_(H::n_constraints) {
+  // ADFun has no copy constructor; the copy holds the parameters of the
+  // prototype and its optimized recording
+  fg_fun_ = prototype.fg_fun_;
+  if (prototype.analytic_derivatives()) {
+    SetAnalyticDerivatives(true);
+  }
+  if (prototype.autodiff_derivatives()) {
+    SetAutoDiffDerivatives(true);
+  }
+  if (prototype.chunked_threads() > 0) {
+    SetChunkedDerivatives(prototype.chunked_threads());
+  }
+  if (prototype.compiled_derivatives()) {
+    SetCompiledDerivatives(true);
+  }
+  SetGaussNewtonHessian(prototype.gauss_newton_hessian());
+  soft_penalty_ = prototype.soft_penalty_;
+  ClearIterates();
+}
+
+template <class H>
+void MPC_NLP<H>::ClearIterates() {
+  for (size_t i = 0; i < H::n_vars; i++) {
+    start_x_[i] = 0.0;
+    start_z_l_[i] = 0.0;
+    start_z_u_[i] = 0.0;
+    best_x_[i] = 0.0;
+    solution_x_[i] = 0.0;
+    solution_z_l_[i] = 0.0;
+    solution_z_u_[i] = 0.0;
+  }
+  for (size_t i = 0; i < H::n_constraints; i++) {
+    start_lambda_[i] = 0.0;
+    solution_lambda_[i] = 0.0;
+  }
+}
+
+template <class H>
+void MPC_NLP<H>::SetParameters(const MPCState &state, const MPCCoeffs &coeffs,
+                               const CostWeights &weights,
+                               const LinearReference<double> *reference) {
+  for (size_t i = 0; i < n_coeffs; i++) {
+    params_[coeffs_start + i] = coeffs[i];
+  }
+  for (size_t t = 0; sampled_reference_ && reference != nullptr && t < H::N - 1; t++) {
+    double *p = &params_[reference_start + n_reference_terms * t];
+    p[0] = reference[t].x;
+    p[1] = reference[t].f;
+    p[2] = reference[t].df;
+    p[3] = reference[t].psides;
+    p[4] = reference[t].dpsides;
+  }
+  for (size_t k = 0; k < 6; k++) {
+    x_l_[k * H::N] = state[k];
+    x_u_[k * H::N] = state[k];
+  }
+  weights.Store(&params_[weights_start]);
+  weights_ = weights;
+  fg_fun_.new_dynamic(params_);
+  linear_stale_ = true;
+  fg_valid_ = false;
+}
+
+template <class H>
+void MPC_NLP<H>::SetStartingPoint(const double *x) {
+  for (size_t i = 0; i < H::n_vars; i++) {
+    start_x_[i] = x[i];
+  }
+}
+
+template <class H>
+void MPC_NLP<H>::SetStartingMultipliers(const double *z_l, const double *z_u,
+                                     const double *lambda) {
+  for (size_t i = 0; i < H::n_vars; i++) {
+    start_z_l_[i] = z_l[i];
+    start_z_u_[i] = z_u[i];
+  }
+  for (size_t i = 0; i < H::n_constraints; i++) {
+    start_lambda_[i] = lambda[i];
+  }
+}
+
+template <class H>
+void MPC_NLP<H>::SetDeadline(std::chrono::steady_clock::time_point deadline) {
+  deadline_ = deadline;
+  deadline_expired_ = false;
+  has_best_ = false;
+  restored_ = false;
+  iterations_ = 0;
+  statistics_ = SolveStatistics();
+  in_restoration_ = false;
+  fg_valid_ = false;
+#if MPC_INSTRUMENTATION >= MPC_INSTRUMENTATION_FULL
+  iteration_started_ = std::chrono::steady_clock::now();
+#endif
+}
+
+template <class H>
+void MPC_NLP<H>::SetSoftConstraints(double penalty) {
+  soft_penalty_ = penalty;
+  max_slack_ = 0;
+}
+
+template <class H>
+void MPC_NLP<H>::PatternLists(std::vector<size_t> &jac_rows, std::vector<size_t> &jac_cols,
+                              std::vector<size_t> &hes_rows,
+                              std::vector<size_t> &hes_cols) const {
+  // Constraint rows without the cost row, like eval_jac_g
+  jac_rows.resize(jac_pattern_.nnz());
+  jac_cols.resize(jac_pattern_.nnz());
+  for (size_t k = 0; k < jac_pattern_.nnz(); k++) {
+    jac_rows[k] = jac_pattern_.row()[k] - 1;
+    jac_cols[k] = jac_pattern_.col()[k];
+  }
+  hes_rows.resize(hes_pattern_.nnz());
+  hes_cols.resize(hes_pattern_.nnz());
+  for (size_t k = 0; k < hes_pattern_.nnz(); k++) {
+    hes_rows[k] = hes_pattern_.row()[k];
+    hes_cols[k] = hes_pattern_.col()[k];
+  }
+}
+
+template <class H>
+std::unique_ptr<ModelDerivatives<H> > MPC_NLP<H>::MakeModelDerivatives() const {
+  std::vector<size_t> jac_rows, jac_cols, hes_rows, hes_cols;
+  PatternLists(jac_rows, jac_cols, hes_rows, hes_cols);
+  return std::unique_ptr<ModelDerivatives<H> >(
+      new ModelDerivatives<H>(jac_rows, jac_cols, hes_rows, hes_cols));
+}
+
+template <class H>
+void MPC_NLP<H>::SetAnalyticDerivatives(bool analytic) {
+  if (!analytic) {
+    analytic_.reset();
+    return;
+  }
+  compiled_.reset();
+  autodiff_.reset();
+  chunked_.reset();
+  analytic_ = MakeModelDerivatives();
+}
+
+template <class H>
+void MPC_NLP<H>::SetAutoDiffDerivatives(bool autodiff) {
+  if (!autodiff) {
+    autodiff_.reset();
+    return;
+  }
+  compiled_.reset();
+  analytic_.reset();
+  chunked_.reset();
+  std::vector<size_t> jac_rows, jac_cols, hes_rows, hes_cols;
+  PatternLists(jac_rows, jac_cols, hes_rows, hes_cols);
+  autodiff_.reset(new AutoDiffDerivatives<H>(jac_rows, jac_cols, hes_rows, hes_cols));
+}
+
+template <class H>
+void MPC_NLP<H>::SetChunkedDerivatives(size_t threads) {
+  chunked_.reset();
+  if (threads == 0) {
+    return;
+  }
+  compiled_.reset();
+  analytic_.reset();
+  autodiff_.reset();
+  std::vector<size_t> jac_rows, jac_cols, hes_rows, hes_cols;
+  PatternLists(jac_rows, jac_cols, hes_rows, hes_cols);
+  chunked_.reset(new ChunkedTapes<H>(jac_rows, jac_cols, hes_rows, hes_cols, threads));
+}
+
+template <class H>
+void MPC_NLP<H>::SetGaussNewtonHessian(bool gauss_newton) {
+  if (gauss_newton) {
+    gauss_newton_ = MakeModelDerivatives();
+  } else {
+    gauss_newton_.reset();
+  }
+}
+
+template <class H>
+void MPC_NLP<H>::TakeSettings(const MPC_NLP &other) {
+  SetTapeSparsity(other.reverse_jacobian_, other.jac_coloring_, other.hes_coloring_);
+  if (other.gauss_newton_hessian() != gauss_newton_hessian()) {
+    SetGaussNewtonHessian(other.gauss_newton_hessian());
+  }
+  if (other.soft_penalty_ != soft_penalty_) {
+    SetSoftConstraints(other.soft_penalty_);
+  }
+}
+
+template <class H>
+bool MPC_NLP<H>::SetCompiledDerivatives(bool compiled) {
+  compiled_.reset();
+  if (!compiled) {
+    return true;
+  }
+  analytic_.reset();
+  autodiff_.reset();
+  chunked_.reset();
+  // The cost row first, then the constraint rows of fg
+  std::vector<size_t> jac_rows(cost_cols_.size(), 0);
+  std::vector<size_t> jac_cols(cost_cols_);
+  for (size_t k = 0; k < jac_pattern_.nnz(); k++) {
+    jac_rows.push_back(jac_pattern_.row()[k]);
+    jac_cols.push_back(jac_pattern_.col()[k]);
+  }
+  std::vector<size_t> hes_rows(hes_pattern_.nnz()), hes_cols(hes_pattern_.nnz());
+  for (size_t k = 0; k < hes_pattern_.nnz(); k++) {
+    hes_rows[k] = hes_pattern_.row()[k];
+    hes_cols[k] = hes_pattern_.col()[k];
+  }
+  compiled_ = CompiledModel<H>::Load(CompiledModel<H>::DefaultDirectory(), jac_rows, jac_cols,
+                                     hes_rows, hes_cols);
+  compiled_jac_.resize(jac_rows.size());
+  return compiled_ != nullptr;
+}
+
+// First n values of v
+template <class Vector>
+static std::vector<double> Values(const Vector &v, size_t n) {
+  std::vector<double> values(n);
+  for (size_t k = 0; k < n; k++) {
+    values[k] = v[k];
+  }
+  return values;
+}
+
+// Largest difference of values from reference, relative to
+// max(1, |reference|)
+static double MaxError(const std::vector<double> &values, const std::vector<double> &reference) {
+  double error = 0;
+  for (size_t k = 0; k < reference.size(); k++) {
+    error = std::max(error, std::fabs(values[k] - reference[k]) /
+                                std::max(1.0, std::fabs(reference[k])));
+  }
+  return error;
+}
+
+template <class H>
+double MPC_NLP<H>::CheckDerivatives(const Number *x, Number obj_factor, const Number *lambda) {
+  if (!analytic_ && !autodiff_ && !chunked_ && !compiled_) {
+    return 0;
+  }
+  const Index n = static_cast<Index>(H::n_vars);
+  const Index m = static_cast<Index>(H::n_constraints);
+
+  // The tape first, the evaluations below overwrite its scratch vectors
+  for (size_t i = 0; i < H::n_vars; i++) {
+    x_[i] = x[i];
+  }
+  const std::vector<double> f_tape = Values(fg_fun_.Forward(0, x_), 1 + H::n_constraints);
+  for (size_t i = 0; i < w_.size(); i++) {
+    w_[i] = 0.0;
+  }
+  w_[0] = 1.0;
+  const std::vector<double> grad_tape = Values(fg_fun_.Reverse(1, w_), H::n_vars);
+
+  TapeJacobian(jac_subset_, jac_work_);
+  const std::vector<double> jac_tape = Values(jac_subset_.val(), jac_pattern_.nnz());
+
+  w_[0] = obj_factor;
+  for (size_t i = 0; i < H::n_constraints; i++) {
+    w_[1 + i] = lambda[i];
+  }
+  TapeHessian();
+  const std::vector<double> hes_tape = Values(hes_subset_.val(), hes_pattern_.nnz());
+
+  // The same through the evaluation callbacks, which use the closed form or
+  // compiled model
+  std::vector<double> values(1 + H::n_constraints);
+  double error = 0;
+  eval_f(n, x, true, values[0]);
+  eval_g(n, x, false, m, &values[1]);
+  error = std::max(error, MaxError(values, f_tape));
+
+  values.resize(H::n_vars);
+  eval_grad_f(n, x, false, values.data());
+  error = std::max(error, MaxError(values, grad_tape));
+
+  values.resize(jac_tape.size());
+  eval_jac_g(n, x, false, m, static_cast<Index>(values.size()), nullptr, nullptr, values.data());
+  error = std::max(error, MaxError(values, jac_tape));
+
+  values.resize(hes_tape.size());
+  eval_h(n, x, false, obj_factor, m, lambda, true, static_cast<Index>(values.size()), nullptr,
+         nullptr, values.data());
+  error = std::max(error, MaxError(values, hes_tape));
+
+  if ((analytic_ && analytic_->dropped() > 0) || (autodiff_ && autodiff_->dropped() > 0) ||
+      (chunked_ && chunked_->dropped() > 0)) {
+    return std::numeric_limits<double>::infinity();
+  }
+  return error;
+}
+
+template <class H>
+void MPC_NLP<H>::ComputeSparsity() {
+  // Forward mode Jacobian sparsity (was 'Sparse true forward')
+  CppAD::sparse_rc<Svector> identity(H::n_vars, H::n_vars, H::n_vars);
+  for (size_t i = 0; i < H::n_vars; i++) {
+    identity.set(i, i, i);
+  }
+  CppAD::sparse_rc<Svector> fg_jac;
+  fg_fun_.for_jac_sparsity(identity, false, false, false, fg_jac);
+
+  // Only the constraint rows go to Ipopt, the cost row comes from eval_grad_f
+  size_t nnz = 0;
+  cost_cols_.clear();
+  for (size_t k = 0; k < fg_jac.nnz(); k++) {
+    if (fg_jac.row()[k] > 0) {
+      nnz++;
+    } else {
+      cost_cols_.push_back(fg_jac.col()[k]);
+    }
+  }
+  jac_pattern_.resize(1 + H::n_constraints, H::n_vars, nnz);
+  nnz = 0;
+  for (size_t k = 0; k < fg_jac.nnz(); k++) {
+    if (fg_jac.row()[k] > 0) {
+      jac_pattern_.set(nnz++, fg_jac.row()[k], fg_jac.col()[k]);
+    }
+  }
+  jac_subset_ = CppAD::sparse_rcv<Svector, Dvector>(jac_pattern_);
+  jac_work_.clear();
+
+  // Reverse mode Hessian sparsity of the Lagrangian (was 'Sparse true reverse')
+  CPPAD_TESTVECTOR(bool) select_range(1 + H::n_constraints);
+  for (size_t i = 0; i < select_range.size(); i++) {
+    select_range[i] = true;
+  }
+  CppAD::sparse_rc<Svector> lag_hes;
+  fg_fun_.rev_hes_sparsity(select_range, false, false, lag_hes);
+
+  // Ipopt wants the lower triangle only
+  nnz = 0;
+  for (size_t k = 0; k < lag_hes.nnz(); k++) {
+    if (lag_hes.row()[k] >= lag_hes.col()[k]) nnz++;
+  }
+  hes_pattern_.resize(H::n_vars, H::n_vars, nnz);
+  nnz = 0;
+  for (size_t k = 0; k < lag_hes.nnz(); k++) {
+    if (lag_hes.row()[k] >= lag_hes.col()[k]) {
+      hes_pattern_.set(nnz++, lag_hes.row()[k], lag_hes.col()[k]);
+    }
+  }
+  hes_subset_ = CppAD::sparse_rcv<Svector, Dvector>(hes_pattern_);
+  hes_work_.clear();
+
+  // The constraints linear in the variables, those with no second
+  // derivatives: the initial state rows and those of the dynamics that are
+  // sums, like v1 - (v0 + a0 dt), a reverse sparsity sweep of each row
+  linear_rows_.assign(H::n_constraints, false);
+  for (size_t i = 0; i < H::n_constraints; i++) {
+    for (size_t r = 0; r < select_range.size(); r++) {
+      select_range[r] = r == 1 + i;
+    }
+    CppAD::sparse_rc<Svector> row_hes;
+    fg_fun_.rev_hes_sparsity(select_range, false, false, row_hes);
+    linear_rows_[i] = row_hes.nnz() == 0;
+  }
+  linear_entries_.clear();
+  nonlinear_entries_.clear();
+  for (size_t k = 0; k < jac_pattern_.nnz(); k++) {
+    (linear_rows_[jac_pattern_.row()[k] - 1] ? linear_entries_ : nonlinear_entries_).push_back(k);
+  }
+  const std::pair<const std::vector<size_t> *, CppAD::sparse_rcv<Svector, Dvector> *> parts[] = {
+      {&linear_entries_, &linear_subset_}, {&nonlinear_entries_, &nonlinear_subset_}};
+  for (const auto &part : parts) {
+    CppAD::sparse_rc<Svector> entries(1 + H::n_constraints, H::n_vars, part.first->size());
+    for (size_t e = 0; e < part.first->size(); e++) {
+      const size_t k = (*part.first)[e];
+      entries.set(e, jac_pattern_.row()[k], jac_pattern_.col()[k]);
+    }
+    *part.second = CppAD::sparse_rcv<Svector, Dvector>(entries);
+  }
+  linear_work_.clear();
+  nonlinear_work_.clear();
+
+  // The first sparse evaluation colours the patterns and stores the result
+  // in the work objects. Do it now, at a dummy point, so no solve pays for it.
+  for (size_t i = 0; i < H::n_vars; i++) {
+    x_[i] = 0.0;
+  }
+  for (size_t i = 0; i < w_.size(); i++) {
+    w_[i] = 1.0;
+  }
+  full_sweeps_ = TapeJacobian(jac_subset_, jac_work_);
+  TapeHessian();
+  linear_stale_ = true;
+  TapeConstraintJacobian();
+}
+
+template <class H>
+size_t MPC_NLP<H>::TapeJacobian(CppAD::sparse_rcv<Svector, Dvector> &subset,
+                                CppAD::sparse_jac_work &work) {
+  if (subset.nnz() == 0) {
+    return 0;
+  }
+  if (reverse_jacobian_) {
+    return fg_fun_.sparse_jac_rev(x_, subset, jac_pattern_, jac_coloring_, work);
+  }
+  return fg_fun_.sparse_jac_for(H::n_vars, x_, subset, jac_pattern_, jac_coloring_, work);
+}
+
+template <class H>
+void MPC_NLP<H>::TapeConstraintJacobian() {
+  if (linear_stale_) {
+    TapeJacobian(linear_subset_, linear_work_);
+    const Dvector &linear = linear_subset_.val();
+    for (size_t e = 0; e < linear_entries_.size(); e++) {
+      jac_subset_.set(linear_entries_[e], linear[e]);
+    }
+    linear_stale_ = false;
+  }
+  nonlinear_sweeps_ = TapeJacobian(nonlinear_subset_, nonlinear_work_);
+  const Dvector &nonlinear = nonlinear_subset_.val();
+  for (size_t e = 0; e < nonlinear_entries_.size(); e++) {
+    jac_subset_.set(nonlinear_entries_[e], nonlinear[e]);
+  }
+}
+
+template <class H>
+void MPC_NLP<H>::TapeHessian() {
+  fg_fun_.sparse_hes(x_, w_, hes_subset_, hes_pattern_, hes_coloring_, hes_work_);
+}
+
+template <class H>
+void MPC_NLP<H>::SetTapeSparsity(bool reverse_jacobian, const std::string &coloring,
+                                 const std::string &hessian_coloring) {
+  if (reverse_jacobian == reverse_jacobian_ && coloring == jac_coloring_ &&
+      hessian_coloring == hes_coloring_) {
+    return;
+  }
+  reverse_jacobian_ = reverse_jacobian;
+  jac_coloring_ = coloring;
+  hes_coloring_ = hessian_coloring;
+  // The colouring of forward sweeps is of the columns, of reverse ones of
+  // the rows; the work objects hold one
+  jac_work_.clear();
+  linear_work_.clear();
+  nonlinear_work_.clear();
+  hes_work_.clear();
+  for (size_t i = 0; i < H::n_vars; i++) {
+    x_[i] = 0.0;
+  }
+  for (size_t i = 0; i < w_.size(); i++) {
+    w_[i] = 1.0;
+  }
+  full_sweeps_ = TapeJacobian(jac_subset_, jac_work_);
+  TapeHessian();
+  linear_stale_ = true;
+  TapeConstraintJacobian();
+}
+
+template <class H>
+void MPC_NLP<H>::Forward(const Number *x, bool new_x) {
+  if (new_x) {
+    fg_valid_ = false;
+  }
+  if (fg_valid_) {
+    statistics_.forward_sweeps_saved++;
+    return;
+  }
+  fg_valid_ = true;
+  if (compiled_) {
+    compiled_->Forward(x, &params_[0], &fg_[0]);
+    return;
+  }
+  for (size_t i = 0; i < H::n_vars; i++) {
+    x_[i] = x[i];
+  }
+  fg_ = fg_fun_.Forward(0, x_);
+}
+
+template <class H>
+bool MPC_NLP<H>::get_nlp_info(Index &n, Index &m, Index &nnz_jac_g,
+                           Index &nnz_h_lag, IndexStyleEnum &index_style) {
+  n = static_cast<Index>(H::n_vars + n_slacks());
+  m = static_cast<Index>(H::n_constraints);
+  // Each slack enters its row with a constant coefficient
+  nnz_jac_g = static_cast<Index>(jac_pattern_.nnz() + n_slacks());
+  nnz_h_lag = static_cast<Index>(hes_pattern_.nnz());
+  index_style = C_STYLE;
+  return true;
+}
+
+template <class H>
+void MPC_NLP<H>::Footprint(SolverFootprint &footprint) const {
+  footprint.tape_operations = fg_fun_.size_op();
+  footprint.tape_variables = fg_fun_.size_var();
+  // The coefficients of one direction per order kept from the last sweep
+  footprint.tape_bytes =
+      fg_fun_.size_op_seq() + fg_fun_.size_var() * fg_fun_.size_order() * sizeof(double);
+  // As handed out by get_nlp_info
+  const size_t n = H::n_vars + n_slacks();
+  const size_t m = H::n_constraints;
+  footprint.jacobian_nonzeros = jac_pattern_.nnz() + n_slacks();
+  footprint.hessian_nonzeros = hes_pattern_.nnz();
+  footprint.kkt_nonzeros = footprint.hessian_nonzeros + footprint.jacobian_nonzeros + n + m;
+  footprint.linear_constraints =
+      static_cast<uint64_t>(std::count(linear_rows_.begin(), linear_rows_.end(), true));
+  footprint.constant_jacobian_nonzeros = linear_entries_.size();
+  footprint.jacobian_sweeps = nonlinear_sweeps_;
+  footprint.full_jacobian_sweeps = full_sweeps_;
+  const Dvector *vectors[] = {&params_,       &x_l_,          &x_u_,          &start_x_,
+                              &start_z_l_,    &start_z_u_,    &start_lambda_, &x_,
+                              &fg_,           &w_,            &best_x_,       &solution_x_,
+                              &solution_z_l_, &solution_z_u_, &solution_lambda_};
+  size_t bytes = sizeof(*this) + compiled_jac_.size() * sizeof(double) +
+                 cost_cols_.size() * sizeof(size_t);
+  for (const Dvector *vector : vectors) {
+    bytes += vector->size() * sizeof(double);
+  }
+  // Rows and columns, and the values of the subsets
+  bytes += 2 * (jac_pattern_.nnz() + hes_pattern_.nnz()) * sizeof(size_t);
+  bytes += (jac_subset_.nnz() + hes_subset_.nnz()) * (2 * sizeof(size_t) + sizeof(double));
+  // The linear and the nonlinear subsets of the Jacobian, and their
+  // positions in it
+  bytes += jac_subset_.nnz() * (3 * sizeof(size_t) + sizeof(double));
+  footprint.workspace_bytes += bytes;
+}
+
+template <class H>
+void MPC_NLP<H>::InitBounds() {
+  ///Setting the lower and upper limits for variables
+  for (size_t i = 0; i < H::delta_start; i++) {
+    x_u_[i] = 1.0e19;
+    x_l_[i] = -1.0e19;
+  }
+
+  // The first stage is the measured state, see SetParameters
+  for (size_t k = 0; k < 6; k++) {
+    x_l_[k * H::N] = 0;
+    x_u_[k * H::N] = 0;
+  }
+
+  // Steering angle (deltas)
+  for (size_t i = H::delta_start; i < H::a_start; i++) {
+    x_u_[i] = max_delta;
+    x_l_[i] = -max_delta;
+  }
+
+  // Acceleration
+  for (size_t i = H::a_start; i < H::n_vars; i++) {
+    x_u_[i] = max_a;
+    x_l_[i] = -max_a;
+  }
+
+  // Slacks
+  for (size_t i = H::n_vars; i < x_l_.size(); i++) {
+    x_l_[i] = 0;
+    x_u_[i] = 1.0e19;
+  }
+}
+
+template <class H>
+bool MPC_NLP<H>::get_bounds_info(Index n, Number *x_l, Number *x_u,
+                              Index m, Number *g_l, Number *g_u) {
+  for (size_t i = 0; i < static_cast<size_t>(n); i++) {
+    x_l[i] = x_l_[i];
+    x_u[i] = x_u_[i];
+  }
+
+  // All constraints are equalities
+  for (size_t i = 0; i < H::n_constraints; i++) {
+    g_l[i] = 0;
+    g_u[i] = 0;
+  }
+  return true;
+}
+
+template <class H>
+bool MPC_NLP<H>::get_constraints_linearity(Index m, LinearityType *const_types) {
+  for (size_t i = 0; i < H::n_constraints; i++) {
+    const_types[i] = linear_rows_[i] ? Ipopt::TNLP::LINEAR : Ipopt::TNLP::NON_LINEAR;
+  }
+  return true;
+}
+
+template <class H>
+bool MPC_NLP<H>::get_starting_point(Index n, bool init_x, Number *x,
+                                 bool init_z, Number *z_L, Number *z_U,
+                                 Index m, bool init_lambda, Number *lambda) {
+  // Initial value of the independent variables, see MPC::WarmStart
+  if (init_x) {
+    for (size_t i = 0; i < H::n_vars; i++) {
+      x[i] = start_x_[i];
+    }
+    for (size_t i = H::n_vars; i < static_cast<size_t>(n); i++) {
+      x[i] = 0.0;
+    }
+  }
+  // Only asked for with warm_start_init_point, see MPC::WarmStartMultipliers
+  if (init_z) {
+    for (size_t i = 0; i < H::n_vars; i++) {
+      z_L[i] = start_z_l_[i];
+      z_U[i] = start_z_u_[i];
+    }
+    // The slacks at zero are stationary for penalty - lambda - z_p = 0 and
+    // penalty + lambda - z_n = 0
+    for (size_t i = 0; i < Slacks(n) / 2; i++) {
+      z_L[H::n_vars + 2 * i] = std::max(soft_penalty_ - start_lambda_[i], 1e-6);
+      z_L[H::n_vars + 2 * i + 1] = std::max(soft_penalty_ + start_lambda_[i], 1e-6);
+      z_U[H::n_vars + 2 * i] = 0.0;
+      z_U[H::n_vars + 2 * i + 1] = 0.0;
+    }
+  }
+  if (init_lambda) {
+    for (size_t i = 0; i < H::n_constraints; i++) {
+      lambda[i] = start_lambda_[i];
+    }
+  }
+  return true;
+}
+
+template <class H>
+bool MPC_NLP<H>::eval_f(Index n, const Number *x, bool new_x, Number &obj_value) {
+  MPC_SCOPED_PHASE(statistics_.phases.model, statistics_.phases.model_events);
+  statistics_.cost_evaluations++;
+  Forward(x, new_x);
+  obj_value = fg_[0];
+  for (size_t i = H::n_vars; i < static_cast<size_t>(n); i++) {
+    obj_value += soft_penalty_ * x[i];
+  }
+  return true;
+}
+
+template <class H>
+bool MPC_NLP<H>::eval_grad_f(Index n, const Number *x, bool new_x, Number *grad_f) {
+  MPC_SCOPED_PHASE(statistics_.phases.derivatives, statistics_.phases.derivative_events);
+  fg_valid_ = fg_valid_ && !new_x;
+  statistics_.gradient_evaluations++;
+  for (size_t i = H::n_vars; i < static_cast<size_t>(n); i++) {
+    grad_f[i] = soft_penalty_;
+  }
+  if (compiled_) {
+    compiled_->Jacobian(x, &params_[0], compiled_jac_.data());
+    for (size_t i = 0; i < H::n_vars; i++) {
+      grad_f[i] = 0.0;
+    }
+    for (size_t k = 0; k < cost_cols_.size(); k++) {
+      grad_f[cost_cols_[k]] = compiled_jac_[k];
+    }
+    return true;
+  }
+
+  // The cost alone gives the gradient, in closed form from its terms (see
+  // CostTerms.h), with no reverse sweep of the tape through the constraints
+  for (size_t i = 0; i < H::n_vars; i++) {
+    grad_f[i] = 0.0;
+  }
+  MPCCost::Gradient<H>(x, weights_, grad_f);
+  return true;
+}
+
+template <class H>
+bool MPC_NLP<H>::eval_g(Index n, const Number *x, bool new_x, Index m, Number *g) {
+  MPC_SCOPED_PHASE(statistics_.phases.model, statistics_.phases.model_events);
+  statistics_.constraint_evaluations++;
+  Forward(x, new_x);
+  for (size_t i = 0; i < H::n_constraints; i++) {
+    g[i] = fg_[1 + i];
+  }
+  // g(x) - p + n
+  for (size_t i = 0; i < Slacks(n) / 2; i++) {
+    g[i] += x[H::n_vars + 2 * i + 1] - x[H::n_vars + 2 * i];
+  }
+  return true;
+}
+
+template <class H>
+bool MPC_NLP<H>::eval_jac_g(Index n, const Number *x, bool new_x,
+                         Index m, Index nele_jac, Index *iRow,
+                         Index *jCol, Number *values) {
+  MPC_SCOPED_PHASE(statistics_.phases.derivatives, statistics_.phases.derivative_events);
+  fg_valid_ = fg_valid_ && !new_x;
+  // The slacks after the pattern of the model, -1 for p and +1 for n
+  const size_t nnz = jac_pattern_.nnz();
+  for (size_t k = 0; k < Slacks(n); k++) {
+    if (values == nullptr) {
+      iRow[nnz + k] = static_cast<Index>(k / 2);
+      jCol[nnz + k] = static_cast<Index>(H::n_vars + k);
+    } else {
+      values[nnz + k] = k % 2 == 0 ? -1.0 : 1.0;
+    }
+  }
+  if (values == nullptr) {
+    // Structure only, shifted by one since the cost row is not a constraint
+    for (size_t k = 0; k < nnz; k++) {
+      iRow[k] = static_cast<Index>(jac_pattern_.row()[k] - 1);
+      jCol[k] = static_cast<Index>(jac_pattern_.col()[k]);
+    }
+    return true;
+  }
+  statistics_.jacobian_evaluations++;
+
+  if (analytic_) {
+    analytic_->Jacobian(x, &params_[coeffs_start], values);
+    return true;
+  }
+  if (autodiff_) {
+    autodiff_->Jacobian(x, &params_[coeffs_start], values);
+    return true;
+  }
+  if (chunked_) {
+    chunked_->Jacobian(x, &params_[coeffs_start], values);
+    return true;
+  }
+
+  if (compiled_) {
+    compiled_->Jacobian(x, &params_[0], compiled_jac_.data());
+    for (size_t k = 0; k < jac_pattern_.nnz(); k++) {
+      values[k] = compiled_jac_[cost_cols_.size() + k];
+    }
+    return true;
+  }
+
+  for (size_t i = 0; i < H::n_vars; i++) {
+    x_[i] = x[i];
+  }
+  TapeConstraintJacobian();
+  const Dvector &val = jac_subset_.val();
+  for (size_t k = 0; k < jac_pattern_.nnz(); k++) {
+    values[k] = val[k];
+  }
+  return true;
+}
+
+template <class H>
+bool MPC_NLP<H>::eval_h(Index n, const Number *x, bool new_x,
+                     Number obj_factor, Index m, const Number *lambda,
+                     bool new_lambda, Index nele_hess, Index *iRow,
+                     Index *jCol, Number *values) {
+  MPC_SCOPED_PHASE(statistics_.phases.derivatives, statistics_.phases.derivative_events);
+  fg_valid_ = fg_valid_ && !new_x;
+  if (values == nullptr) {
+    for (size_t k = 0; k < hes_pattern_.nnz(); k++) {
+      iRow[k] = static_cast<Index>(hes_pattern_.row()[k]);
+      jCol[k] = static_cast<Index>(hes_pattern_.col()[k]);
+    }
+    return true;
+  }
+  statistics_.hessian_evaluations++;
+
+  if (gauss_newton_) {
+    gauss_newton_->CostHessian(weights_, obj_factor, values);
+    return true;
+  }
+  if (analytic_) {
+    analytic_->Hessian(x, &params_[coeffs_start], weights_, obj_factor, lambda, values);
+    return true;
+  }
+  if (autodiff_) {
+    autodiff_->Hessian(x, &params_[coeffs_start], weights_, obj_factor, lambda, values);
+    return true;
+  }
+  if (chunked_) {
+    chunked_->Hessian(x, &params_[coeffs_start], weights_, obj_factor, lambda, values);
+    return true;
+  }
+
+  // Weights of the Lagrangian: obj_factor * cost + lambda' * constraints
+  w_[0] = obj_factor;
+  for (size_t i = 0; i < H::n_constraints; i++) {
+    w_[1 + i] = lambda[i];
+  }
+  if (compiled_) {
+    compiled_->Hessian(x, &params_[0], &w_[0], values);
+    return true;
+  }
+
+  for (size_t i = 0; i < H::n_vars; i++) {
+    x_[i] = x[i];
+  }
+  TapeHessian();
+  const Dvector &val = hes_subset_.val();
+  for (size_t k = 0; k < hes_pattern_.nnz(); k++) {
+    values[k] = val[k];
+  }
+  return true;
+}
+
+template <class H>
+void MPC_NLP<H>::finalize_solution(Ipopt::SolverReturn status, Index n,
+                                const Number *x, const Number *z_L,
+                                const Number *z_U, Index m,
+                                const Number *g, const Number *lambda,
+                                Number obj_value, const Ipopt::IpoptData *ip_data,
+                                Ipopt::IpoptCalculatedQuantities *ip_cq) {
+  for (size_t i = 0; i < H::n_vars; i++) {
+    solution_x_[i] = x[i];
+    solution_z_l_[i] = z_L[i];
+    solution_z_u_[i] = z_U[i];
+  }
+  for (size_t i = 0; i < H::n_constraints; i++) {
+    solution_lambda_[i] = lambda[i];
+  }
+  obj_value_ = obj_value;
+  status_ = status;
+  max_slack_ = 0;
+  for (size_t i = H::n_vars; i < static_cast<size_t>(n); i++) {
+    max_slack_ = std::max(max_slack_, x[i]);
+  }
+
+  // Stopped at the deadline or the iteration limit: the last iterate may be
+  // worse than, or not as feasible as, the best one
+  const bool stopped = (status == Ipopt::USER_REQUESTED_STOP && deadline_expired_) ||
+                       status == Ipopt::MAXITER_EXCEEDED;
+  if (stopped && has_best_) {
+    for (size_t i = 0; i < H::n_vars; i++) {
+      solution_x_[i] = best_x_[i];
+    }
+    obj_value_ = best_obj_;
+  }
+}
+
+template <class H>
+bool MPC_NLP<H>::intermediate_callback(Ipopt::AlgorithmMode mode, Index iter,
+                                       Number obj_value, Number inf_pr,
+                                       Number inf_du, Number mu, Number d_norm,
+                                       Number regularization_size, Number alpha_du,
+                                       Number alpha_pr, Index ls_trials,
+                                       const Ipopt::IpoptData *ip_data,
+                                       Ipopt::IpoptCalculatedQuantities *ip_cq) {
+  iterations_ = iter;
+  const bool restoring = mode == Ipopt::RestorationPhaseMode;
+  restored_ |= restoring;
+  // Counted as it enters, however many iterations it stays
+  if (restoring && !in_restoration_) {
+    statistics_.restorations++;
+  }
+  in_restoration_ = restoring;
+#if MPC_INSTRUMENTATION >= MPC_INSTRUMENTATION_FULL
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  MPC_TRACE_SPAN(restoring ? "ipopt restoration iteration" : "ipopt iteration",
+                 iteration_started_, now);
+  iteration_started_ = now;
+#endif
+
+  // Iterates of the restoration phase live in another space, skip them
+  if (mode == Ipopt::RegularMode && inf_pr <= feasible_inf_pr &&
+      (!has_best_ || obj_value < best_obj_)) {
+    Ipopt::TNLPAdapter *adapter = Adapter(ip_cq);
+    if (adapter != nullptr) {
+      adapter->ResortX(*ip_data->curr()->x(), &best_x_[0]);
+      best_obj_ = obj_value;
+      has_best_ = true;
+    }
+  }
+
+  if (kkt_dump_ != nullptr && mode == Ipopt::RegularMode && !kkt_dump_->full()) {
+    DumpKKT(iter, mu, regularization_size, ip_data, ip_cq);
+  }
+
+  if (std::chrono::steady_clock::now() >= deadline_ ||
+      (preempt_ != nullptr && preempt_->load(std::memory_order_relaxed))) {
+    deadline_expired_ = true;
+    return false;
+  }
+  return true;
+}
+
+template <class H>
+void MPC_NLP<H>::SetKKTDump(KKTDump *dump) {
+  kkt_dump_ = dump;
+  if (dump != nullptr) {
+    kkt_solve_ = dump->BeginSolve();
+  }
+}
+
+template <class H>
+void MPC_NLP<H>::DumpKKT(Index iter, Number mu, Number regularization,
+                         const Ipopt::IpoptData *ip_data,
+                         Ipopt::IpoptCalculatedQuantities *ip_cq) {
+  Ipopt::TNLPAdapter *adapter = Adapter(ip_cq);
+  if (adapter == nullptr) {
+    return;
+  }
+  Index n;
+  Index m;
+  Index nnz_jac;
+  Index nnz_hes;
+  IndexStyleEnum index_style;
+  get_nlp_info(n, m, nnz_jac, nnz_hes, index_style);
+  std::vector<Number> x(n), z_l(n), z_u(n), x_l(n), x_u(n), grad(n);
+  std::vector<Number> lambda(m), g(m), g_l(m), g_u(m);
+  const Ipopt::IteratesVector &curr = *ip_data->curr();
+  adapter->ResortX(*curr.x(), &x[0]);
+  adapter->ResortBnds(*curr.z_L(), &z_l[0], *curr.z_U(), &z_u[0]);
+  adapter->ResortG(*curr.y_c(), *curr.y_d(), &lambda[0]);
+  get_bounds_info(n, &x_l[0], &x_u[0], m, &g_l[0], &g_u[0]);
+
+  // At the iterate Ipopt evaluated last, so its next callbacks find what
+  // they expect; the statistics are those of the solve alone
+  const SolveStatistics statistics = statistics_;
+  std::vector<Index> jac_rows(nnz_jac), jac_cols(nnz_jac), hes_rows(nnz_hes), hes_cols(nnz_hes);
+  std::vector<Number> jac(nnz_jac), hes(nnz_hes);
+  const bool evaluated =
+      eval_grad_f(n, &x[0], true, &grad[0]) && eval_g(n, &x[0], false, m, &g[0]) &&
+      eval_jac_g(n, nullptr, false, m, nnz_jac, &jac_rows[0], &jac_cols[0], nullptr) &&
+      eval_jac_g(n, &x[0], false, m, nnz_jac, nullptr, nullptr, &jac[0]) &&
+      eval_h(n, nullptr, false, 1, m, nullptr, false, nnz_hes, &hes_rows[0], &hes_cols[0],
+             nullptr) &&
+      eval_h(n, &x[0], false, 1, m, &lambda[0], true, nnz_hes, nullptr, nullptr, &hes[0]);
+  statistics_ = statistics;
+  if (!evaluated) {
+    return;
+  }
+
+  // The variables Ipopt keeps, the fixed ones out, then the constraints
+  KKTSystem system;
+  std::vector<int> row(n, -1);
+  for (Index i = 0; i < n; i++) {
+    if (x_l[i] == x_u[i]) {
+      continue;
+    }
+    row[i] = static_cast<int>(system.n++);
+    const size_t k = static_cast<size_t>(i);
+    if (k < H::delta_start) {
+      system.stages.push_back(static_cast<int>(2 * (k % H::N)));
+    } else if (k < H::n_vars) {
+      system.stages.push_back(
+          static_cast<int>(2 * H::first_stage((k - H::delta_start) % H::n_blocks)));
+    } else {
+      // A slack, with the constraint of its pair
+      system.stages.push_back(static_cast<int>(2 * (((k - H::n_vars) / 2) % (H::N - 1)) + 1));
+    }
+  }
+  const size_t n_free = system.n;
+  for (Index j = 0; j < m; j++) {
+    system.stages.push_back(static_cast<int>(2 * (static_cast<size_t>(j) % (H::N - 1)) + 1));
+  }
+  system.n += static_cast<size_t>(m);
+  system.rhs.assign(system.n, 0.0);
+  const auto add = [&system](int r, int c, double value) {
+    system.rows.push_back(std::max(r, c));
+    system.cols.push_back(std::min(r, c));
+    system.values.push_back(value);
+  };
+
+  for (Index k = 0; k < nnz_hes; k++) {
+    if (row[hes_rows[k]] >= 0 && row[hes_cols[k]] >= 0) {
+      add(row[hes_rows[k]], row[hes_cols[k]], hes[k]);
+    }
+  }
+  // The diagonal of the bounds, and the gradient of the barrier function
+  for (Index i = 0; i < n; i++) {
+    if (row[i] < 0) {
+      continue;
+    }
+    double sigma = regularization;
+    double gradient = grad[i];
+    if (x_l[i] > -bound_infinity && x[i] > x_l[i]) {
+      sigma += z_l[i] / (x[i] - x_l[i]);
+      gradient -= mu / (x[i] - x_l[i]);
+    }
+    if (x_u[i] < bound_infinity && x[i] < x_u[i]) {
+      sigma += z_u[i] / (x_u[i] - x[i]);
+      gradient += mu / (x_u[i] - x[i]);
+    }
+    add(row[i], row[i], sigma);
+    system.rhs[row[i]] -= gradient;
+  }
+  for (Index k = 0; k < nnz_jac; k++) {
+    const int constraint = static_cast<int>(n_free) + jac_rows[k];
+    if (row[jac_cols[k]] >= 0) {
+      add(constraint, row[jac_cols[k]], jac[k]);
+      system.rhs[row[jac_cols[k]]] -= jac[k] * lambda[jac_rows[k]];
+    }
+  }
+  for (Index j = 0; j < m; j++) {
+    system.rhs[n_free + j] = -(g[j] - g_l[j]);
+  }
+  kkt_dump_->Write(kkt_solve_, iter, system);
+}
+
+template class MPC_NLP<Horizon10>;
+template class MPC_NLP<Horizon15>;
+template class MPC_NLP<Horizon25>;
+template class MPC_NLP<Horizon40>;
+template class MPC_NLP<Horizon15Coarse>;
+template class MPC_NLP<Horizon8RK4>;
+template class MPC_NLP<Horizon11Graded>;
+template class MPC_NLP<Horizon10Blocked>;
+template class MPC_NLP<Horizon15Blocked>;
+template class MPC_NLP<Horizon25Blocked>;
+template class MPC_NLP<Horizon15Dynamic>;
@@ -0,0 +1,399 @@
+#ifndef MPC_NLP_H
+#define MPC_NLP_H
+
+#include <cppad/cppad.hpp>
+#include <coin/IpTNLP.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include "AutoDiffDerivatives.h"
+#include "ChunkedTapes.h"
+#include "CompiledModel.h"
+#include "Horizon.h"
+#include "Instrumentation.h"
+#include "KKTDump.h"
+#include "MPCSolution.h"
+#include "ModelDerivatives.h"
+#include "SolverFootprint.h"
+
+// Ipopt view of the MPC problem.
+//
+// The FG_eval model is recorded into a CppAD tape once, when the object is
+// built. The polynomial coefficients and the cost weights are dynamic
+// parameters of that tape, so a control tick only swaps the parameters and
+// re-evaluates the recorded function. The variables of the first stage are
+// fixed to the measured state by equal bounds; Ipopt treats fixed variables
+// as parameters (fixed_variable_treatment make_parameter), so they and the
+// rows pinning them never reach the KKT system.
+//
+// With a sampled reference the tape follows a LinearReference per stage in
+// place of the polynomial (see FG_eval). The closed form, AutoDiff, chunked
+// and compiled derivatives are those of the polynomial model, so only the
+// tape, and the Gauss-Newton Hessian, go with it.
+//
+// With checkpointed stages the tape holds a call of the step of each stage
+// rather than its operations (see StageCheckpoints); the other derivatives
+// take the stages as they did.
+//
+// H is the horizon layout (see Horizon.h). The instantiations are listed at
+// the end of MPC_NLP.cpp.
+template <class H>
+class MPC_NLP : public Ipopt::TNLP {
+public:
+  typedef CPPAD_TESTVECTOR(double) Dvector;
+  typedef CPPAD_TESTVECTOR(size_t) Svector;
+
+  // With reference_order 1 or 2 the tape steps the model along a line or
+  // a parabola, the coefficients above the order left out (see FG_eval);
+  // a sampled reference has no polynomial to truncate. With
+  // checkpoint_stages the tape calls the step of a stage as a checkpoint
+  // function (see StageCheckpoints) instead of recording every stage; it
+  // records the stages still when the functions can't be made, in parallel
+  // mode before any were.
+  explicit MPC_NLP(bool sampled_reference = false, size_t reference_order = 3,
+                   bool checkpoint_stages = false);
+
+  // A problem of its own with the tape, sparsity patterns, colouring and
+  // derivative mode of prototype, recorded and computed once for all the
+  // copies. Neither the starting point nor the last solution are copied.
+  explicit MPC_NLP(const MPC_NLP &prototype);
+
+  ~MPC_NLP() override = default;
+
+  // Set the initial state, polynomial coefficients and cost weights of the
+  // next solve, and with a sampled reference the reference of each stage
+  // but the last (H::N - 1 values). Only the parameter values of the tape
+  // change, its recording and sparsity patterns are kept.
+  void SetParameters(const MPCState &state, const MPCCoeffs &coeffs,
+                     const CostWeights &weights,
+                     const LinearReference<double> *reference = nullptr);
+  bool sampled_reference() const { return sampled_reference_; }
+  size_t reference_order() const { return reference_order_; }
+  bool checkpoint_stages() const { return checkpoint_stages_; }
+
+  // Set the primal starting point of the next solve (H::n_vars values).
+  void SetStartingPoint(const double *x);
+
+  // Set the bound multipliers (H::n_vars values each) and the constraint
+  // multipliers (H::n_constraints values) used when Ipopt warm starts.
+  void SetStartingMultipliers(const double *z_l, const double *z_u, const double *lambda);
+
+  // Stop the next solve once the wall clock passes deadline (see
+  // intermediate_callback). The solution is then the best feasible iterate
+  // met before, if any.
+  void SetDeadline(std::chrono::steady_clock::time_point deadline);
+  // Stop it too, the same way, once preempt is set (see MPCBase::preempt)
+  void SetPreempt(const std::atomic<bool> *preempt) { preempt_ = preempt; }
+  bool deadline_expired() const { return deadline_expired_; }
+  bool has_feasible_iterate() const { return has_best_; }
+
+  // Write the KKT system of every iteration of the next solve to dump, as a
+  // solve of its own (see KKTDump.h), until it is full; null for none. The
+  // evaluations that put it together aren't counted in the statistics.
+  void SetKKTDump(KKTDump *dump);
+
+  // Relax every dynamics row g(x) = 0 to g(x) = p - n with slacks p, n >= 0
+  // appended to the variables, at a cost of penalty * (p + n); 0 restores
+  // the hard constraints. The relaxed problem is feasible from any start,
+  // which keeps Ipopt out of its restoration phase, and with a penalty
+  // above the largest constraint multiplier (an exact l1 penalty) its
+  // solution is that of the hard problem whenever there is one. It changes
+  // the size of the problem, so Ipopt must optimize it anew after.
+  void SetSoftConstraints(double penalty);
+  double soft_penalty() const { return soft_penalty_; }
+  // Number of slack variables, 0 with hard constraints
+  size_t n_slacks() const { return soft_penalty_ > 0 ? 2 * H::n_constraints : 0; }
+  // Largest slack of the last solve, the worst violation of the model it
+  // allowed
+  double max_slack() const { return max_slack_; }
+  // Whether the last solve went through the restoration phase
+  bool restored() const { return restored_; }
+
+  // Evaluate the constraint Jacobian and the Lagrangian Hessian in closed
+  // form (ModelDerivatives) instead of from the tape. The function values and
+  // the cost gradient still come from the tape.
+  void SetAnalyticDerivatives(bool analytic);
+  bool analytic_derivatives() const { return analytic_ != nullptr; }
+
+  // Evaluate the constraint Jacobian and the Lagrangian Hessian stage by
+  // stage with AutoDiffScalar (AutoDiffDerivatives) instead of from the tape,
+  // the rest like SetAnalyticDerivatives.
+  void SetAutoDiffDerivatives(bool autodiff);
+  bool autodiff_derivatives() const { return autodiff_ != nullptr; }
+
+  // Evaluate the constraint Jacobian and the Lagrangian Hessian from tapes
+  // of chunks of the horizon on up to threads threads (ChunkedTapes) instead
+  // of the whole tape, the rest like SetAnalyticDerivatives; 0 for the whole
+  // tape.
+  void SetChunkedDerivatives(size_t threads);
+  size_t chunked_threads() const { return chunked_ ? chunked_->threads() : 0; }
+
+  // Evaluate the function values and all the derivatives with the generated
+  // and compiled model (CompiledModel) instead of the tape. False, keeping
+  // the tape, when there is no compiled model.
+  bool SetCompiledDerivatives(bool compiled);
+  bool compiled_derivatives() const { return compiled_ != nullptr; }
+
+  // How the tape evaluates its sparse derivatives: the Jacobian by forward
+  // sweeps, a direction per colour of its columns, or with reverse_jacobian
+  // by reverse sweeps, one per colour of its rows; coloring the colouring of
+  // the Jacobian, "cppad" or "colpack" (where CppAD was built with ColPack),
+  // and hessian_coloring that of the Hessian, "cppad.symmetric",
+  // "cppad.general", "colpack.symmetric" (ColPack's star colouring) or
+  // "colpack.general". Forward, "cppad" and "cppad.symmetric" by default.
+  // The patterns are coloured again at once, at a dummy point, as the
+  // constructor does, so no solve pays for it. The closed form, compiled
+  // and chunked derivatives ignore them.
+  void SetTapeSparsity(bool reverse_jacobian, const std::string &coloring,
+                       const std::string &hessian_coloring);
+
+  // Hand Ipopt the Gauss-Newton Hessian, the closed form Hessian of the cost
+  // alone (ModelDerivatives::CostHessian), whatever the source of the other
+  // derivatives. The curvature of the constraints is dropped, which saves
+  // the second order sweep of the tape.
+  void SetGaussNewtonHessian(bool gauss_newton);
+  bool gauss_newton_hessian() const { return gauss_newton_ != nullptr; }
+
+  // The Gauss-Newton Hessian, soft constraints and tape sparsity of other,
+  // for a problem of another tape to take over from it; each only where it
+  // differs, so taking them again costs nothing
+  void TakeSettings(const MPC_NLP &other);
+
+  // Largest difference, relative to max(1, |value|), between the closed form
+  // or compiled evaluations and the tape at vars x with the Lagrangian
+  // weights obj_factor and lambda, under the current parameters. Infinite if
+  // the closed form has entries outside the tape sparsity patterns. Compares
+  // exact Hessians, so call it before SetGaussNewtonHessian.
+  double CheckDerivatives(const Ipopt::Number *x, Ipopt::Number obj_factor,
+                          const Ipopt::Number *lambda);
+
+  // Result of the last solve.
+  const Dvector &solution() const { return solution_x_; }
+  const Dvector &solution_z_l() const { return solution_z_l_; }
+  const Dvector &solution_z_u() const { return solution_z_u_; }
+  const Dvector &solution_lambda() const { return solution_lambda_; }
+  double obj_value() const { return obj_value_; }
+  Ipopt::SolverReturn status() const { return status_; }
+  int iterations() const { return iterations_; }
+  // The evaluations of the last solve, counted and timed in the callbacks
+  // (phases.model for eval_f and eval_g, phases.derivatives for the rest),
+  // its iterations and the entries into the restoration phase. The rest of
+  // its time is Ipopt's own, left for the caller to put in linear_solve,
+  // and so is solver_status.
+  const SolveStatistics &statistics() const { return statistics_; }
+  // Add the tape, the patterns handed to Ipopt and the bytes of this
+  // problem to footprint (see SolverFootprint.h). The KKT matrix is the one
+  // Ipopt factors, of the Hessian, the Jacobian and the diagonals; its fill-in
+  // is the linear solver's, not known here.
+  void Footprint(SolverFootprint &footprint) const;
+
+  //
+  // Ipopt::TNLP interface
+  //
+  bool get_nlp_info(Ipopt::Index &n, Ipopt::Index &m, Ipopt::Index &nnz_jac_g,
+                    Ipopt::Index &nnz_h_lag, IndexStyleEnum &index_style) override;
+
+  bool get_bounds_info(Ipopt::Index n, Ipopt::Number *x_l, Ipopt::Number *x_u,
+                       Ipopt::Index m, Ipopt::Number *g_l, Ipopt::Number *g_u) override;
+
+  // The constraints linear in the variables declared LINEAR, the rest
+  // NON_LINEAR (see ComputeSparsity)
+  bool get_constraints_linearity(Ipopt::Index m, LinearityType *const_types) override;
+
+  bool get_starting_point(Ipopt::Index n, bool init_x, Ipopt::Number *x,
+                          bool init_z, Ipopt::Number *z_L, Ipopt::Number *z_U,
+                          Ipopt::Index m, bool init_lambda, Ipopt::Number *lambda) override;
+
+  bool eval_f(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+              Ipopt::Number &obj_value) override;
+
+  bool eval_grad_f(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+                   Ipopt::Number *grad_f) override;
+
+  bool eval_g(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+              Ipopt::Index m, Ipopt::Number *g) override;
+
+  bool eval_jac_g(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+                  Ipopt::Index m, Ipopt::Index nele_jac, Ipopt::Index *iRow,
+                  Ipopt::Index *jCol, Ipopt::Number *values) override;
+
+  bool eval_h(Ipopt::Index n, const Ipopt::Number *x, bool new_x,
+              Ipopt::Number obj_factor, Ipopt::Index m, const Ipopt::Number *lambda,
+              bool new_lambda, Ipopt::Index nele_hess, Ipopt::Index *iRow,
+              Ipopt::Index *jCol, Ipopt::Number *values) override;
+
+  void finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n,
+                         const Ipopt::Number *x, const Ipopt::Number *z_L,
+                         const Ipopt::Number *z_U, Ipopt::Index m,
+                         const Ipopt::Number *g, const Ipopt::Number *lambda,
+                         Ipopt::Number obj_value, const Ipopt::IpoptData *ip_data,
+                         Ipopt::IpoptCalculatedQuantities *ip_cq) override;
+
+  // Called by Ipopt after every iteration: keeps the best feasible iterate,
+  // dumps the KKT system and stops the solve at the deadline.
+  bool intermediate_callback(Ipopt::AlgorithmMode mode, Ipopt::Index iter,
+                             Ipopt::Number obj_value, Ipopt::Number inf_pr,
+                             Ipopt::Number inf_du, Ipopt::Number mu, Ipopt::Number d_norm,
+                             Ipopt::Number regularization_size, Ipopt::Number alpha_du,
+                             Ipopt::Number alpha_pr, Ipopt::Index ls_trials,
+                             const Ipopt::IpoptData *ip_data,
+                             Ipopt::IpoptCalculatedQuantities *ip_cq) override;
+
+private:
+  // Compute the sparsity patterns of the constraint Jacobian and the
+  // Lagrangian Hessian of the recorded tape. Called once by the constructor.
+  void ComputeSparsity();
+
+  // Zero the starting point, the best iterate and the solution.
+  void ClearIterates();
+
+  // The entries of subset of the sparse Jacobian of the constraints, and
+  // the Hessian of the Lagrangian into hes_subset_, from the tape at x_ (and
+  // the weights w_), as SetTapeSparsity chose; the first of each after a
+  // new choice colours the patterns into the work objects. The sweeps the
+  // Jacobian took.
+  size_t TapeJacobian(CppAD::sparse_rcv<Svector, Dvector> &subset,
+                      CppAD::sparse_jac_work &work);
+  void TapeHessian();
+  // The Jacobian of every constraint, the linear ones once a solve and the
+  // others every time, into jac_subset_
+  void TapeConstraintJacobian();
+
+  // Closed form derivatives writing into the tape sparsity patterns
+  std::unique_ptr<ModelDerivatives<H> > MakeModelDerivatives() const;
+
+  // The patterns as (row, col) lists: the constraint rows of the Jacobian
+  // without the cost row, and the lower triangle of the Hessian
+  void PatternLists(std::vector<size_t> &jac_rows, std::vector<size_t> &jac_cols,
+                    std::vector<size_t> &hes_rows, std::vector<size_t> &hes_cols) const;
+
+  // Fill x_l_ and x_u_, the first stage at 0
+  void InitBounds();
+
+  // The KKT system of the iterate of ip_data, of iteration iter with the
+  // barrier parameter mu and the regularization of the Hessian, into
+  // kkt_dump_
+  void DumpKKT(Ipopt::Index iter, Ipopt::Number mu, Ipopt::Number regularization,
+               const Ipopt::IpoptData *ip_data, Ipopt::IpoptCalculatedQuantities *ip_cq);
+
+  // Zero order forward sweep of the tape at x, result in fg_; none when
+  // fg_ is of x already, i.e. Ipopt says x is not new (new_x false) since
+  // the last sweep, as when eval_g follows eval_f at an iterate.
+  void Forward(const Ipopt::Number *x, bool new_x);
+
+  // Slack variables of n variables handed by Ipopt: none but while the soft
+  // constraints are on (CheckDerivatives evaluates the model alone)
+  static size_t Slacks(Ipopt::Index n) { return static_cast<size_t>(n) - H::n_vars; }
+
+  // Recorded cost and constraints: fg = [cost, constraints...]
+  CppAD::ADFun<double> fg_fun_;
+  bool sampled_reference_;
+  size_t reference_order_;
+  bool checkpoint_stages_;
+
+  // Current dynamic parameters (see n_params in FG_eval.h), and the weights
+  // among them for the closed form Hessian
+  Dvector params_;
+  CostWeights weights_;
+  // Variable bounds handed to Ipopt, the slacks' included. Only the first
+  // stage, fixed to the measured state, changes between solves; the rest is
+  // set once by InitBounds.
+  Dvector x_l_;
+  Dvector x_u_;
+  // Primal and dual starting point
+  Dvector start_x_;
+  Dvector start_z_l_;
+  Dvector start_z_u_;
+  Dvector start_lambda_;
+
+  // Sparsity of the constraint Jacobian (rows of fg without the cost) and of
+  // the lower triangle of the Lagrangian Hessian. The work objects hold the
+  // graph colouring; they must persist across solves for it to be reused.
+  CppAD::sparse_rc<Svector> jac_pattern_;
+  // Variables the cost depends on, the cost row of the fg Jacobian
+  std::vector<size_t> cost_cols_;
+  CppAD::sparse_rc<Svector> hes_pattern_;
+  CppAD::sparse_rcv<Svector, Dvector> jac_subset_;
+  CppAD::sparse_rcv<Svector, Dvector> hes_subset_;
+  CppAD::sparse_jac_work jac_work_;
+  CppAD::sparse_hes_work hes_work_;
+  // The constraints linear in the variables, whose rows of the Hessian of
+  // the Lagrangian are empty and whose Jacobian changes only with the
+  // parameters (the coefficients of a row linear in the variables may be
+  // parameters): the tape evaluates their entries of the Jacobian, the
+  // positions of linear_entries_ in jac_subset_, once a solve, as
+  // SetParameters marks them stale, and those of the other rows,
+  // nonlinear_entries_, every time; each subset coloured apart, so the
+  // sweeps are those the nonlinear rows alone need.
+  std::vector<bool> linear_rows_;
+  std::vector<size_t> linear_entries_;
+  std::vector<size_t> nonlinear_entries_;
+  CppAD::sparse_rcv<Svector, Dvector> linear_subset_;
+  CppAD::sparse_rcv<Svector, Dvector> nonlinear_subset_;
+  CppAD::sparse_jac_work linear_work_;
+  CppAD::sparse_jac_work nonlinear_work_;
+  bool linear_stale_ = true;
+  // The sweeps of an evaluation of the nonlinear rows and of every row
+  size_t nonlinear_sweeps_ = 0;
+  size_t full_sweeps_ = 0;
+  // See SetTapeSparsity
+  bool reverse_jacobian_ = false;
+  std::string jac_coloring_ = "cppad";
+  std::string hes_coloring_ = "cppad.symmetric";
+
+  // Closed form derivatives, null when the tape is used
+  std::unique_ptr<ModelDerivatives<H> > analytic_;
+  // Stage AutoDiff derivatives, null when the tape is used
+  std::unique_ptr<AutoDiffDerivatives<H> > autodiff_;
+  // Chunked tapes, null when the whole tape is used
+  std::unique_ptr<ChunkedTapes<H> > chunked_;
+  // Closed form cost Hessian, null for the exact Hessian
+  std::unique_ptr<ModelDerivatives<H> > gauss_newton_;
+  // Compiled model, null when the tape is used, and its Jacobian: the cost
+  // row (cost_cols_) and then the constraint rows (jac_pattern_)
+  std::unique_ptr<CompiledModel<H> > compiled_;
+  std::vector<double> compiled_jac_;
+
+  // Scratch vectors for the evaluation callbacks
+  Dvector x_;
+  Dvector fg_;
+  Dvector w_;
+  // Whether fg_ is of the current iterate and parameters; cleared by every
+  // callback given a new x
+  bool fg_valid_ = false;
+
+  // Deadline of the current solve and the best feasible iterate so far
+  std::chrono::steady_clock::time_point deadline_ = std::chrono::steady_clock::time_point::max();
+  bool deadline_expired_ = false;
+  const std::atomic<bool> *preempt_ = nullptr;
+  Dvector best_x_;
+  double best_obj_ = 0;
+  bool has_best_ = false;
+  bool restored_ = false;
+  // See SetKKTDump, and the number of the solve in it
+  KKTDump *kkt_dump_ = nullptr;
+  uint64_t kkt_solve_ = 0;
+
+  // Penalty of the slacks, 0 for hard constraints (see SetSoftConstraints)
+  double soft_penalty_ = 0;
+  double max_slack_ = 0;
+
+  // Result of the last solve
+  Dvector solution_x_;
+  Dvector solution_z_l_;
+  Dvector solution_z_u_;
+  Dvector solution_lambda_;
+  double obj_value_ = 0;
+  Ipopt::SolverReturn status_ = Ipopt::UNASSIGNED;
+  int iterations_ = 0;
+  SolveStatistics statistics_;
+  bool in_restoration_ = false;
+#if MPC_INSTRUMENTATION >= MPC_INSTRUMENTATION_FULL
+  // The end of the last iteration, for the span of the next in the trace
+  std::chrono::steady_clock::time_point iteration_started_;
+#endif
+};
+
+#endif /* MPC_NLP_H */
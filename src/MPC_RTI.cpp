@@ -0,0 +1,122 @@
+#include "MPC_RTI.h"
+#include <iostream>
+#include "Log.h"
+
+template <size_t N, class Dt, class Blocks>
+void MPC_RTI<N, Dt, Blocks>::Prepare() {
+  if (!has_plan_) {
+    return;
+  }
+
+  // The next measurement is predicted one step ahead of the vehicle frame at
+  // the next telemetry, which is close to the frame of the first stage of the
+  // last plan; the feedback phase evaluates the defects with the new
+  // polynomial anyway
+  MPCState z0;
+  MPCCoeffs coeffs;
+  PredictNextTick(plan_coeffs_, z0, coeffs);
+
+  // Shift the actuations and the working set one step, holding the last one
+  typename QP::Vector u_bar;
+  QP::ShiftActuations(plan_u_, u_bar);
+  const typename ActiveSetQP<QP::n_u>::WorkingSet working_set = solver_.working_set();
+  QP::ShiftActuations(working_set, solver_.working_set());
+
+  // The weights too are scheduled on the predicted speed, the Hessian is
+  // built here
+  qp_.SetWeights(cost_schedule.At(z0[3]));
+  qp_.Linearize(z0, u_bar, coeffs, linearization_table.get());
+  prepared_ = true;
+}
+
+template <size_t N, class Dt, class Blocks>
+MPCSolution MPC_RTI<N, Dt, Blocks>::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
+  // Without a preparation (first tick, or Prepare wasn't called) linearize
+  // around the shifted last actuations from the measured state, or the last
+  // actuations as they are after RepeatTick.
+  PhaseClock clock;
+  SolveStatistics statistics;
+  statistics.start = has_plan_ ? SolveStart::kWarm : SolveStart::kCold;
+  SolvePhases &phases = statistics.phases;
+  if (!prepared_) {
+    typename QP::Vector u_bar = plan_u_;
+    if (has_plan_ && !repeat_) {
+      QP::ShiftActuations(plan_u_, u_bar);
+    }
+    qp_.SetWeights(cost_schedule.At(state[3]));
+    qp_.Linearize(state, u_bar, coeffs, linearization_table.get());
+  }
+
+  // One QP in the actuation step
+  qp_.Feedback(state, coeffs);
+  // Linearized here or by Prepare, once either way
+  statistics.jacobian_evaluations = 1;
+  phases.derivatives = clock.Lap(phases.derivative_events);
+  du_.setZero();
+  status_ = SolveStatus::kSolved;
+  const int solved = solver_.Solve(qp_.hessian(), qp_.gradient(), qp_.lower(), qp_.upper(), du_);
+  statistics.iterations = 1;
+  phases.linear_solve = clock.Lap(phases.linear_solve_events);
+  if (solved < 0) {
+    // Keep the linearization point, i.e. the shifted last plan
+    std::cerr << "RTI: QP Hessian is not positive definite" << std::endl;
+    du_.setZero();
+    solver_.working_set().setZero();
+    status_ = SolveStatus::kFailed;
+  }
+
+  // New plan from the linear prediction
+  const double cost = qp_.Predict(du_, plan_u_, plan_z_);
+  statistics.cost_evaluations = 1;
+  phases.model = clock.Lap(phases.model_events);
+  plan_coeffs_ = coeffs;
+  has_plan_ = true;
+  prepared_ = false;
+  repeat_ = false;
+
+  // Cost
+  cost_ = cost;
+  Log(LogLevel::kInfo, "Cost {}", cost);
+
+  MPCSolution plan;
+  plan.set_states(plan_z_);
+  plan.set_times<H>();
+  for (size_t t = 0; t < N - 1; t++) {
+    plan.delta[t] = plan_u_[H::block(t)];
+    plan.a[t] = plan_u_[H::n_blocks + H::block(t)];
+  }
+  plan.status = status_;
+  plan.cost = cost_;
+  plan.statistics = statistics;
+  return plan;
+}
+
+template class MPC_RTI<10>;
+template class MPC_RTI<15>;
+template class MPC_RTI<25>;
+template class MPC_RTI<10, std::ratio<1, 10>, Blocks10>;
+template class MPC_RTI<15, std::ratio<1, 10>, Blocks15>;
+template class MPC_RTI<25, std::ratio<1, 10>, Blocks25>;
+
+std::unique_ptr<MPCBase> MakeMPC_RTI(size_t n, bool move_blocking) {
+  typedef std::ratio<1, 10> Dt;
+  switch (n) {
+    case 10:
+      if (move_blocking) {
+        return std::unique_ptr<MPCBase>(new MPC_RTI<10, Dt, Blocks10>());
+      }
+      return std::unique_ptr<MPCBase>(new MPC_RTI<10>());
+    case 15:
+      if (move_blocking) {
+        return std::unique_ptr<MPCBase>(new MPC_RTI<15, Dt, Blocks15>());
+      }
+      return std::unique_ptr<MPCBase>(new MPC_RTI<15>());
+    case 25:
+      if (move_blocking) {
+        return std::unique_ptr<MPCBase>(new MPC_RTI<25, Dt, Blocks25>());
+      }
+      return std::unique_ptr<MPCBase>(new MPC_RTI<25>());
+    default:
+      return std::unique_ptr<MPCBase>();
+  }
+}
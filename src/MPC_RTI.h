@@ -0,0 +1,88 @@
+#ifndef MPC_RTI_H
+#define MPC_RTI_H
+
+#include <memory>
+#include <ratio>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "ActiveSetQP.h"
+#include "CondensedQP.h"
+#include "Horizon.h"
+#include "MPC.h"
+
+// Real-time iteration (RTI) variant of the MPC.
+//
+// Instead of solving the NLP to convergence every tick, a single SQP step is
+// taken per tick. The work is split in two:
+//
+// - Prepare (between ticks): shift the last plan by one step, roll the model
+//   out along the shifted actuations, linearize it in closed form
+//   (KinematicModel.h) and condense the states away (CondensedQP).
+// - Solve (feedback, once telemetry arrives): insert the measured state and
+//   the new polynomial into the affine terms of the QP and solve it with the
+//   active-set solver, warm started from the working set of the last tick.
+template <size_t N, class Dt = std::ratio<1, 10>, class Blocks = NoBlocking>
+class MPC_RTI : public MPCBase {
+public:
+  typedef Horizon<N, Dt, Blocks> H;
+
+  void Prepare() override;
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  void Reset() override {
+    has_plan_ = false;
+    prepared_ = false;
+    plan_u_.setZero();
+    solver_.working_set().setZero();
+  }
+
+  // The preparation, if any, was for the shifted plan: linearize around the
+  // plan as it is instead
+  void RepeatTick() override {
+    repeat_ = true;
+    prepared_ = false;
+  }
+
+  std::unique_ptr<MPCBase> Clone() const override {
+    MPC_RTI *mpc = new MPC_RTI();
+    mpc->CopySettings(*this);
+    return std::unique_ptr<MPCBase>(mpc);
+  }
+
+  size_t horizon_length() const override { return N; }
+  double timestep() const override { return H::dt; }
+  double stage_time(size_t t) const override { return H::time(t); }
+
+  MPCState planned_state(size_t t) const override { return plan_z_.col(t); }
+
+  void planned_actuations(size_t t, double &delta, double &a) const override {
+    delta = plan_u_[H::block(t)];
+    a = plan_u_[H::n_blocks + H::block(t)];
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  typedef CondensedQP<H> QP;
+
+  QP qp_;
+  ActiveSetQP<QP::n_u> solver_;
+  bool prepared_ = false;
+
+  // Last plan and the polynomial it was computed with
+  typename QP::StateTrajectory plan_z_ = QP::StateTrajectory::Zero();
+  typename QP::Vector plan_u_ = QP::Vector::Zero();
+  MPCCoeffs plan_coeffs_ = MPCCoeffs::Zero();
+  bool has_plan_ = false;
+  // The next solve is for the tick of the last one, see RepeatTick
+  bool repeat_ = false;
+
+  // Step of the actuations of the last QP
+  typename QP::Vector du_;
+};
+
+// Make the RTI MPC for a horizon of n timesteps of 0.1 s, like MakeMPC.
+std::unique_ptr<MPCBase> MakeMPC_RTI(size_t n, bool move_blocking = false);
+
+#endif /* MPC_RTI_H */
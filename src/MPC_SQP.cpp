@@ -0,0 +1,219 @@
+#include "MPC_SQP.h"
+#include <chrono>
+#include <iostream>
+#include "FrenetReference.h"
+#include "Instrumentation.h"
+#include "Log.h"
+#include "ReferenceTable.h"
+
+template <size_t N, class Dt, class Blocks, class Scalar>
+MPCSolution MPC_SQP<N, Dt, Blocks, Scalar>::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
+  if (frenet_reference) {
+    return SolveAlong(state, *frenet_reference);
+  }
+  if (reference_table) {
+    return SolveAlong(state, *reference_table);
+  }
+  return SolveAlong(state, coeffs);
+}
+
+template <size_t N, class Dt, class Blocks, class Scalar>
+template <class Reference>
+MPCSolution MPC_SQP<N, Dt, Blocks, Scalar>::SolveAlong(const MPCState &state,
+                                                       const Reference &reference) {
+  const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(max_solve_time));
+
+  qp_.SetWeights(cost_schedule.At(state[3]));
+
+  // Start from the shifted previous plan, the previous plan as it is after
+  // RepeatTick, or a start restored as it is
+  const SolveStart start = restored_   ? SolveStart::kRestored
+                           : has_plan_ ? SolveStart::kWarm
+                                       : SolveStart::kCold;
+  if (restored_) {
+    u_ = start_u_;
+    solver_.working_set() = start_working_set_;
+    restored_ = false;
+  } else if (has_plan_ && repeat_) {
+    u_ = plan_u_;
+  } else if (has_plan_) {
+    QP::ShiftActuations(plan_u_, u_);
+    const typename QPSolver::WorkingSet working_set = solver_.working_set();
+    QP::ShiftActuations(working_set, solver_.working_set());
+  } else {
+    u_.setZero();
+    solver_.working_set().setZero();
+  }
+  repeat_ = false;
+  start_u_ = u_;
+  start_working_set_ = solver_.working_set();
+
+  // Every iterate is feasible (single shooting, box constraints), so any of
+  // them can be returned at the deadline
+  bool ok = false;
+  bool failed = false;
+  bool expired = false;
+  PhaseClock clock;
+  SolveStatistics statistics;
+  SolvePhases &phases = statistics.phases;
+  double cost = qp_.Cost(state, u_, reference);
+  statistics.cost_evaluations++;
+  phases.model += clock.Lap(phases.model_events);
+  iterations_ = 0;
+  for (int iter = 0; iter < max_iterations_; iter++) {
+    MPC_TRACE_SCOPE("sqp iteration");
+    iterations_ = iter + 1;
+    qp_.Linearize(state, u_, reference, linearization_table.get());
+    qp_.Feedback(state, reference);
+    statistics.jacobian_evaluations++;
+    phases.derivatives += clock.Lap(phases.derivative_events);
+    du_.setZero();
+    const int solved =
+        solver_.Solve(qp_.hessian(), qp_.gradient(), qp_.lower(), qp_.upper(), du_);
+    phases.linear_solve += clock.Lap(phases.linear_solve_events);
+    if (solved < 0) {
+      std::cerr << "SQP: QP Hessian is not positive definite" << std::endl;
+      solver_.working_set().setZero();
+      failed = iter == 0;
+      break;
+    }
+
+    // Backtrack until the nonlinear cost decreases
+    double alpha = 1.0;
+    double trial_cost = cost;
+    for (; alpha > 1e-3; alpha *= 0.5) {
+      trial_ = u_ + alpha * du_;
+      trial_cost = qp_.Cost(state, trial_, reference);
+      statistics.cost_evaluations++;
+      if (trial_cost < cost) {
+        break;
+      }
+    }
+    phases.model += clock.Lap(phases.model_events);
+    if (trial_cost >= cost) {
+      // No decrease along the step: stationary up to the model accuracy
+      ok = true;
+      break;
+    }
+    u_ = trial_;
+    cost = trial_cost;
+
+    if (alpha * du_.template lpNorm<Eigen::Infinity>() < tolerance_) {
+      ok = true;
+      break;
+    }
+    if (std::chrono::steady_clock::now() >= deadline || preempted()) {
+      expired = true;
+      break;
+    }
+  }
+
+  // A plan that hit the iteration limit is still a good seed, it only
+  // decreased the cost
+  plan_u_ = u_;
+  has_plan_ = true;
+  if (failed) {
+    status_ = SolveStatus::kFailed;
+  } else if (expired) {
+    status_ = SolveStatus::kDeadline;
+  } else {
+    status_ = SolveStatus::kSolved;
+    if (!ok) {
+      std::cerr << "SQP: no convergence in " << max_iterations_ << " iterations" << std::endl;
+    }
+  }
+
+  // Cost
+  cost_ = cost;
+  Log(LogLevel::kInfo, "Cost {}", cost);
+
+  plan_z_.col(0) = state;
+  for (size_t i = 0; i < N-1; i++)
+  {
+    const double delta = u_[H::block(i)];
+    const double a = u_[H::n_blocks + H::block(i)];
+    plan_z_.col(i + 1) = ModelStep(plan_z_.col(i), delta, a, reference, H::step(i));
+  }
+
+  MPCSolution plan;
+  plan.set_states(plan_z_);
+  plan.set_times<H>();
+  for (size_t t = 0; t < N - 1; t++) {
+    plan.delta[t] = u_[H::block(t)];
+    plan.a[t] = u_[H::n_blocks + H::block(t)];
+  }
+  plan.status = status_;
+  plan.cost = cost_;
+  plan.statistics = statistics;
+  plan.statistics.iterations = iterations_;
+  plan.statistics.start = start;
+  return plan;
+}
+
+template <size_t N, class Dt, class Blocks, class Scalar>
+void MPC_SQP<N, Dt, Blocks, Scalar>::SaveStart(std::vector<double> &start) const {
+  start.assign(start_u_.data(), start_u_.data() + QP::n_u);
+  for (int k = 0; k < QP::n_u; k++) {
+    start.push_back(start_working_set_[k]);
+  }
+}
+
+template <size_t N, class Dt, class Blocks, class Scalar>
+bool MPC_SQP<N, Dt, Blocks, Scalar>::RestoreStart(const std::vector<double> &start) {
+  if (start.size() != 2 * QP::n_u) {
+    return false;
+  }
+  for (int k = 0; k < QP::n_u; k++) {
+    start_u_[k] = start[k];
+    start_working_set_[k] = static_cast<int>(start[QP::n_u + k]);
+  }
+  restored_ = true;
+  return true;
+}
+
+template class MPC_SQP<10>;
+template class MPC_SQP<15>;
+template class MPC_SQP<25>;
+template class MPC_SQP<10, std::ratio<1, 10>, Blocks10>;
+template class MPC_SQP<15, std::ratio<1, 10>, Blocks15>;
+template class MPC_SQP<25, std::ratio<1, 10>, Blocks25>;
+template class MPC_SQP<10, std::ratio<1, 10>, NoBlocking, float>;
+template class MPC_SQP<15, std::ratio<1, 10>, NoBlocking, float>;
+template class MPC_SQP<25, std::ratio<1, 10>, NoBlocking, float>;
+template class MPC_SQP<10, std::ratio<1, 10>, Blocks10, float>;
+template class MPC_SQP<15, std::ratio<1, 10>, Blocks15, float>;
+template class MPC_SQP<25, std::ratio<1, 10>, Blocks25, float>;
+
+namespace {
+
+template <class Scalar>
+std::unique_ptr<MPCBase> MakeSQP(size_t n, bool move_blocking) {
+  typedef std::ratio<1, 10> Dt;
+  switch (n) {
+    case 10:
+      if (move_blocking) {
+        return std::unique_ptr<MPCBase>(new MPC_SQP<10, Dt, Blocks10, Scalar>());
+      }
+      return std::unique_ptr<MPCBase>(new MPC_SQP<10, Dt, NoBlocking, Scalar>());
+    case 15:
+      if (move_blocking) {
+        return std::unique_ptr<MPCBase>(new MPC_SQP<15, Dt, Blocks15, Scalar>());
+      }
+      return std::unique_ptr<MPCBase>(new MPC_SQP<15, Dt, NoBlocking, Scalar>());
+    case 25:
+      if (move_blocking) {
+        return std::unique_ptr<MPCBase>(new MPC_SQP<25, Dt, Blocks25, Scalar>());
+      }
+      return std::unique_ptr<MPCBase>(new MPC_SQP<25, Dt, NoBlocking, Scalar>());
+    default:
+      return std::unique_ptr<MPCBase>();
+  }
+}
+
+}  // namespace
+
+std::unique_ptr<MPCBase> MakeMPC_SQP(size_t n, bool move_blocking, bool single_precision) {
+  return single_precision ? MakeSQP<float>(n, move_blocking) : MakeSQP<double>(n, move_blocking);
+}
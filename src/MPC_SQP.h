@@ -0,0 +1,126 @@
+#ifndef MPC_SQP_H
+#define MPC_SQP_H
+
+#include <memory>
+#include <ratio>
+#include <type_traits>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "ActiveSetQP.h"
+#include "CondensedQP.h"
+#include "Horizon.h"
+#include "MPC.h"
+#include "MixedPrecisionQP.h"
+
+// MPC solved to convergence by SQP on the condensed QP instead of Ipopt.
+//
+// Every iteration linearizes the model around the rollout of the current
+// actuations, solves the 2*H::n_blocks variable box constrained QP of CondensedQP
+// with the active-set solver and takes the step with a backtracking line
+// search on the cost of the nonlinear rollout. The actuations and the
+// working set of the last tick, shifted by one step, are the starting point.
+//
+// With Scalar float the QPs are solved in single precision by
+// MixedPrecisionQP, refined in double; everything else stays in double.
+template <size_t N, class Dt = std::ratio<1, 10>, class Blocks = NoBlocking,
+          class Scalar = double>
+class MPC_SQP : public MPCBase {
+public:
+  typedef Horizon<N, Dt, Blocks> H;
+
+  explicit MPC_SQP(int max_iterations = 10, double tolerance = 1e-6)
+      : max_iterations_(max_iterations), tolerance_(tolerance) {}
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  void Reset() override { has_plan_ = false; }
+
+  void RepeatTick() override { repeat_ = true; }
+
+  std::unique_ptr<MPCBase> Clone() const override {
+    MPC_SQP *mpc = new MPC_SQP(max_iterations_, tolerance_);
+    mpc->CopySettings(*this);
+    return std::unique_ptr<MPCBase>(mpc);
+  }
+
+  size_t horizon_length() const override { return N; }
+  double timestep() const override { return H::dt; }
+  double stage_time(size_t t) const override { return H::time(t); }
+
+  MPCState planned_state(size_t t) const override { return plan_z_.col(t); }
+
+  void planned_actuations(size_t t, double &delta, double &a) const override {
+    delta = plan_u_[H::block(t)];
+    a = plan_u_[H::n_blocks + H::block(t)];
+  }
+
+  void SetTolerances(double tolerance, int max_iterations) override {
+    if (tolerance > 0) {
+      tolerance_ = tolerance;
+    }
+    if (max_iterations > 0) {
+      max_iterations_ = max_iterations;
+    }
+  }
+
+  // The actuations and the working set the last solve started from
+  void SaveStart(std::vector<double> &start) const override;
+  bool RestoreStart(const std::vector<double> &start) override;
+
+  // No tape: the stage Jacobians of the linearization, the dense condensed
+  // Hessian, box constrained so that it is the whole KKT matrix, and its
+  // dense Cholesky factor at most, all arrays of the object
+  SolverFootprint Footprint() const override {
+    SolverFootprint footprint;
+    footprint.jacobian_nonzeros = (N - 1) * 6 * (6 + 2);
+    footprint.hessian_nonzeros = QP::n_u * (QP::n_u + 1) / 2;
+    footprint.kkt_nonzeros = footprint.hessian_nonzeros;
+    footprint.factor_nonzeros = footprint.hessian_nonzeros;
+    footprint.workspace_bytes = sizeof(*this);
+    return footprint;
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  typedef CondensedQP<H> QP;
+
+  // Solve with the model following reference, see CondensedQP
+  template <class Reference>
+  MPCSolution SolveAlong(const MPCState &state, const Reference &reference);
+
+  int max_iterations_;
+  double tolerance_;
+
+  typedef typename std::conditional<std::is_same<Scalar, float>::value,
+                                    MixedPrecisionQP<QP::n_u>, ActiveSetQP<QP::n_u> >::type
+      QPSolver;
+
+  QP qp_;
+  QPSolver solver_;
+
+  // Actuations of the last solve, their rollout, and whether they can seed
+  // the next solve
+  typename QP::Vector plan_u_ = QP::Vector::Zero();
+  typename QP::StateTrajectory plan_z_ = QP::StateTrajectory::Zero();
+  bool has_plan_ = false;
+  // The next solve is for the tick of the last one, see RepeatTick
+  bool repeat_ = false;
+  // What the last solve started from, and whether the next starts from it
+  // as it is, see RestoreStart
+  typename QP::Vector start_u_ = QP::Vector::Zero();
+  typename QPSolver::WorkingSet start_working_set_ = QPSolver::WorkingSet::Zero();
+  bool restored_ = false;
+
+  // Scratch
+  typename QP::Vector u_;
+  typename QP::Vector du_;
+  typename QP::Vector trial_;
+};
+
+// Make the SQP MPC for a horizon of n timesteps of 0.1 s, like MakeMPC,
+// with the mixed precision QPs if single_precision.
+std::unique_ptr<MPCBase> MakeMPC_SQP(size_t n, bool move_blocking = false,
+                                     bool single_precision = false);
+
+#endif /* MPC_SQP_H */
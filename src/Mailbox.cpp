@@ -0,0 +1,92 @@
+#include "Mailbox.h"
+#include <thread>
+
+void PollBackoff::Idle() {
+  empty_++;
+  if (empty_ <= policy_.spins) {
+    return;
+  }
+  if (empty_ <= policy_.spins + policy_.pauses || policy_.sleep.count() == 0) {
+    // Easier on the core and on its sibling than a bare spin
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+    return;
+  }
+  if (empty_ <= policy_.spins + policy_.pauses + policy_.yields) {
+    std::this_thread::yield();
+    return;
+  }
+  std::this_thread::sleep_for(policy_.sleep);
+}
+
+void Doorbell::Ring() {
+  rung_at_.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rings_.fetch_add(1, std::memory_order_release);
+  }
+  alarm_.store(true);
+  rung_.notify_one();
+}
+
+bool Doorbell::Wait(uint64_t &rung) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  rung_.wait(lock, [this, rung] {
+    return rings_.load(std::memory_order_relaxed) != rung ||
+           closed_.load(std::memory_order_relaxed);
+  });
+  rung = rings_.load(std::memory_order_relaxed);
+  return !closed_.load(std::memory_order_relaxed);
+}
+
+bool Doorbell::Spin(uint64_t &rung, PollBackoff &backoff) {
+  while (!Poll(rung)) {
+    if (closed_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    backoff.Idle();
+  }
+  backoff.Reset();
+  return !closed_.load(std::memory_order_acquire);
+}
+
+void Doorbell::Close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_.store(true, std::memory_order_release);
+  }
+  rung_.notify_all();
+}
+
+Mailbox::Mailbox(Doorbell *doorbell)
+    : middle_(1), back_(0), posted_(0), skipped_(0), doorbell_(doorbell), front_(2) {}
+
+void Mailbox::Post(const MessageView &message, Clock::time_point arrival) {
+  Mail &mail = buffers_[back_].mail;
+  mail.message.assign(message.data, message.size());
+  mail.arrival = arrival;
+  mail.sequence = ++posted_;
+  const unsigned previous = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel);
+  back_ = previous & kIndex;
+  if (previous & kFresh) {
+    skipped_.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (doorbell_ != nullptr) {
+    doorbell_->Ring();
+  }
+}
+
+bool Mailbox::Take(Mail &mail) {
+  if (!(middle_.load(std::memory_order_relaxed) & kFresh)) {
+    return false;
+  }
+  front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndex;
+  Mail &taken = buffers_[front_].mail;
+  mail.message.swap(taken.message);
+  mail.arrival = taken.arrival;
+  mail.sequence = taken.sequence;
+  return true;
+}
@@ -0,0 +1,206 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include "CacheLine.h"
+#include "MessageView.h"
+
+// How a thread that polls instead of sleeping, with busypoll, waits
+// between the polls that find nothing: spinning through the first of them,
+// then pausing the core between them, then yielding it and at last sleeping
+// a little between them, so that a server with nothing to do gives its
+// cores back while a busy one answers in the time of a poll rather than
+// that of a wakeup. Without a sleep it never gets past pausing, the core
+// held for good.
+struct BusyPollPolicy {
+  // The empty polls spun through, and then paused between
+  uint32_t spins = 1000;
+  uint32_t pauses = 20000;
+  // Then yielded between, and after those slept between for sleep
+  uint32_t yields = 1000;
+  std::chrono::microseconds sleep{50};
+};
+
+// The back-off of BusyPollPolicy over the empty polls of one thread
+class PollBackoff {
+ public:
+  explicit PollBackoff(const BusyPollPolicy &policy) : policy_(policy), empty_(0) {}
+
+  // After a poll that found something
+  void Reset() { empty_ = 0; }
+  // After one that didn't, the wait the empty polls so far call for
+  void Idle();
+
+ private:
+  BusyPollPolicy policy_;
+  uint64_t empty_;
+};
+
+// Wakes the thread that reads any number of mailboxes when one of them is
+// posted to, with no wakeup lost between its reads and its wait: Wait
+// returns at once if there has been a ring since the last it saw. The rings
+// are counted in an atomic as well, for a thread to poll them with Spin
+// instead of sleeping on the condition, and the last is stamped, for the
+// latency of the wakeup it led to.
+class Doorbell {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  Doorbell() : rings_(0), rung_at_(0), closed_(false), alarm_(false) {}
+
+  // From any thread
+  void Ring();
+  // Wait for a ring after rung, then set rung to the last; false once
+  // closed
+  bool Wait(uint64_t &rung);
+  // The same, polling the rings with backoff between them instead of
+  // sleeping until one
+  bool Spin(uint64_t &rung, PollBackoff &backoff);
+  // Whether there has been a ring after rung, then set rung to the last,
+  // without waiting
+  bool Poll(uint64_t &rung) {
+    const uint64_t rings = rings_.load(std::memory_order_acquire);
+    if (rings == rung) {
+      return false;
+    }
+    rung = rings;
+    return true;
+  }
+  // Wake Wait up for good, from any thread
+  void Close();
+
+  // A flag every ring sets, for work of the reader's to stop at the next
+  // ring (see MPCBase::preempt). Cleared by Disarm, which then polls like
+  // Poll, so a ring before it is seen by the one or set in the other.
+  const std::atomic<bool> &alarm() const { return alarm_; }
+  bool Disarm(uint64_t &rung) {
+    alarm_.store(false);
+    const uint64_t rings = rings_.load();
+    if (rings == rung) {
+      return false;
+    }
+    rung = rings;
+    return true;
+  }
+
+  // When the last ring was
+  Clock::time_point rung_at() const {
+    return Clock::time_point(Clock::duration(rung_at_.load(std::memory_order_relaxed)));
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable rung_;
+  std::atomic<uint64_t> rings_;
+  std::atomic<Clock::rep> rung_at_;
+  std::atomic<bool> closed_;
+  std::atomic<bool> alarm_;
+};
+
+// The latest of the messages one thread posts for another: each post
+// replaces the one before if it wasn't taken yet, so the reader always gets
+// the freshest message and never works through a backlog of stale ones,
+// which are only counted. Every post is numbered in the order of posting,
+// so the reader can tell how many came between two it took.
+//
+// The slot is a triple buffer: the writer fills a buffer of its own and
+// swaps it with the middle one by an atomic exchange, the reader swaps its
+// own with the middle one when it holds a post, so neither side ever waits
+// for the other or copies under a lock, and the buffers are reused. The
+// reader learns of posts by the doorbell the mailbox rings, if any, or by
+// polling Take. The buffers, the middle index and the fields of each side
+// are on cache lines of their own (see CacheLine.h), as the writer fills
+// its buffer while the reader reads another.
+class Mailbox {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Mail {
+    std::string message;
+    // When the message came in, for the latency of what it leads to and
+    // the age of the message, and its number among the posts, from 1
+    Clock::time_point arrival;
+    uint64_t sequence = 0;
+  };
+
+  explicit Mailbox(Doorbell *doorbell = nullptr);
+
+  // Copy message into the slot, from one thread
+  void Post(const MessageView &message, Clock::time_point arrival);
+  // Exchange mail for the freshest post, false if there has been none since
+  // the last; from one other thread
+  bool Take(Mail &mail);
+  // Whether there is a post Take would get, from any thread; only a hint to
+  // anyone but the reader, as the post may be taken meanwhile
+  bool pending() const { return (middle_.load(std::memory_order_acquire) & kFresh) != 0; }
+
+  // Posts so far, the sequence of the last; of the writer
+  uint64_t posted() const { return posted_; }
+
+  // Posts replaced before they were taken
+  uint64_t skipped() const { return skipped_.load(std::memory_order_relaxed); }
+
+ private:
+  // The index of the middle buffer, with kFresh while it holds a post
+  static const unsigned kFresh = 4;
+  static const unsigned kIndex = 3;
+
+  struct alignas(kCacheLine) Buffer {
+    Mail mail;
+  };
+
+  Buffer buffers_[3];
+  alignas(kCacheLine) std::atomic<unsigned> middle_;
+  // Of the writer
+  alignas(kCacheLine) unsigned back_;
+  uint64_t posted_;
+  std::atomic<uint64_t> skipped_;
+  Doorbell *doorbell_;
+  // Of the reader
+  alignas(kCacheLine) unsigned front_;
+};
+
+// The triple buffer of Mailbox for a value of T rather than a message: the
+// writer fills Back() and publishes it, the reader takes the latest value
+// published into Front(), neither waiting for the other nor copying, e.g.
+// the plans of TrackPlanner. The reader starts with a value of T().
+template <class T>
+class LatestValue {
+ public:
+  // Of the writer: its buffer, then made the latest
+  T &Back() { return buffers_[back_].value; }
+  void Publish() {
+    back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) & kIndex;
+  }
+
+  // Of the reader: the latest value into Front(), false if none was
+  // published since the last
+  bool Update() {
+    if (!(middle_.load(std::memory_order_relaxed) & kFresh)) {
+      return false;
+    }
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndex;
+    return true;
+  }
+  const T &Front() const { return buffers_[front_].value; }
+
+ private:
+  static const unsigned kFresh = 4;
+  static const unsigned kIndex = 3;
+
+  struct alignas(kCacheLine) Buffer {
+    T value{};
+  };
+
+  Buffer buffers_[3];
+  alignas(kCacheLine) std::atomic<unsigned> middle_{1};
+  alignas(kCacheLine) unsigned back_ = 0;
+  alignas(kCacheLine) unsigned front_ = 2;
+};
+
+#endif /* MAILBOX_H */
@@ -0,0 +1,396 @@
+#include "MessagePack.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+const char kMessagePackSubprotocol[] = "msgpack";
+const char kSharedMemorySubprotocol[] = "shm";
+const char kProblemsSubprotocol[] = "mpc-problems";
+
+namespace {
+
+const size_t npos = MessageView::npos;
+
+// Containers nested deeper than this in a field that is skipped make the
+// message malformed, rather than the stack deep
+const int kMaxDepth = 16;
+
+// The fields of a Telemetry, the bits of those that must be there, as in
+// ParseTelemetry
+const unsigned kPtsx = 1;
+const unsigned kPtsy = 2;
+const unsigned kRequired = 127;
+const struct {
+  const char *name;
+  double Telemetry::*field;
+  unsigned bit;
+} kNumbers[] = {{"x", &Telemetry::x, 4},
+                {"y", &Telemetry::y, 8},
+                {"psi", &Telemetry::psi, 16},
+                {"speed", &Telemetry::speed, 32},
+                {"steering_angle", &Telemetry::steering_angle, 64},
+                {"psi_unity", &Telemetry::psi_unity, 0},
+                {"throttle", &Telemetry::throttle, 0}};
+
+// The bytes big-endian unsigned integer at i, the caller having checked
+// they are there
+uint64_t LoadBigEndian(const MessageView &m, size_t i, int bytes) {
+  uint64_t value = 0;
+  for (int k = 0; k < bytes; k++) {
+    value = value << 8 | static_cast<unsigned char>(m[i + k]);
+  }
+  return value;
+}
+
+// The type byte at i
+unsigned Type(const MessageView &m, size_t i) { return static_cast<unsigned char>(m[i]); }
+
+// Past the length of bytes of a size of its own at i, the length in
+// length; npos if it runs off the message
+size_t ReadLength(const MessageView &m, size_t i, int bytes, size_t &length) {
+  if (i == npos || m.size() - i < static_cast<size_t>(bytes)) {
+    return npos;
+  }
+  length = static_cast<size_t>(LoadBigEndian(m, i, bytes));
+  return i + bytes;
+}
+
+// Past the header of the map at i, its number of pairs in n; npos if there
+// is no map
+size_t ReadMap(const MessageView &m, size_t i, size_t &n) {
+  if (i >= m.size()) {
+    return npos;
+  }
+  const unsigned type = Type(m, i);
+  if (type >= 0x80 && type <= 0x8f) {
+    n = type & 0x0f;
+    return i + 1;
+  }
+  if (type == 0xde || type == 0xdf) {
+    return ReadLength(m, i + 1, type == 0xde ? 2 : 4, n);
+  }
+  return npos;
+}
+
+// Past the header of the array at i, its number of elements in n; npos if
+// there is no array
+size_t ReadArray(const MessageView &m, size_t i, size_t &n) {
+  if (i >= m.size()) {
+    return npos;
+  }
+  const unsigned type = Type(m, i);
+  if (type >= 0x90 && type <= 0x9f) {
+    n = type & 0x0f;
+    return i + 1;
+  }
+  if (type == 0xdc || type == 0xdd) {
+    return ReadLength(m, i + 1, type == 0xdc ? 2 : 4, n);
+  }
+  return npos;
+}
+
+// Past the string at i, its bytes in text; npos if there is no string
+size_t ReadString(const MessageView &m, size_t i, MessageView &text) {
+  if (i >= m.size()) {
+    return npos;
+  }
+  const unsigned type = Type(m, i);
+  size_t length = 0;
+  if (type >= 0xa0 && type <= 0xbf) {
+    length = type & 0x1f;
+    i++;
+  } else if (type >= 0xd9 && type <= 0xdb) {
+    i = ReadLength(m, i + 1, 1 << (type - 0xd9), length);
+  } else {
+    return npos;
+  }
+  if (i == npos || m.size() - i < length) {
+    return npos;
+  }
+  text = m.substr(i, length);
+  return i + length;
+}
+
+// Past the number at i, an integer or a float of any width, in value; npos
+// if there is no number
+size_t ReadNumber(const MessageView &m, size_t i, double &value) {
+  if (i >= m.size()) {
+    return npos;
+  }
+  const unsigned type = Type(m, i);
+  if (type <= 0x7f) {
+    value = type;
+    return i + 1;
+  }
+  if (type >= 0xe0) {
+    value = static_cast<int>(type) - 256;
+    return i + 1;
+  }
+  // Then the bytes of the value follow the type
+  int bytes = 0;
+  if (type == 0xca) {
+    bytes = 4;
+  } else if (type == 0xcb) {
+    bytes = 8;
+  } else if (type >= 0xcc && type <= 0xcf) {
+    bytes = 1 << (type - 0xcc);
+  } else if (type >= 0xd0 && type <= 0xd3) {
+    bytes = 1 << (type - 0xd0);
+  } else {
+    return npos;
+  }
+  if (m.size() - i - 1 < static_cast<size_t>(bytes)) {
+    return npos;
+  }
+  const uint64_t bits = LoadBigEndian(m, i + 1, bytes);
+  if (type == 0xca) {
+    const uint32_t bits32 = static_cast<uint32_t>(bits);
+    float f;
+    std::memcpy(&f, &bits32, sizeof(f));
+    value = f;
+  } else if (type == 0xcb) {
+    std::memcpy(&value, &bits, sizeof(value));
+  } else if (type <= 0xcf) {
+    value = static_cast<double>(bits);
+  } else {
+    // Sign extended from its width
+    const int shift = 64 - 8 * bytes;
+    value = static_cast<double>(static_cast<int64_t>(bits << shift) >> shift);
+  }
+  return i + 1 + bytes;
+}
+
+// Past the array of numbers at i, in values, up to kMaxWaypoints of them;
+// npos if it is malformed or longer
+size_t ReadNumbers(const MessageView &m, size_t i, Telemetry::Waypoints &values) {
+  values.clear();
+  size_t n = 0;
+  i = ReadArray(m, i, n);
+  if (i == npos || n > Telemetry::kMaxWaypoints) {
+    return npos;
+  }
+  for (size_t k = 0; k < n && i != npos; k++) {
+    double value = 0;
+    i = ReadNumber(m, i, value);
+    values.push_back(value);
+  }
+  return i;
+}
+
+// Past the value of any type at i; npos if it is malformed or nested
+// deeper than depth
+size_t Skip(const MessageView &m, size_t i, int depth) {
+  if (i >= m.size() || depth == 0) {
+    return npos;
+  }
+  const unsigned type = Type(m, i);
+  if (type == 0xc0 || type == 0xc2 || type == 0xc3) {
+    // nil, false, true
+    return i + 1;
+  }
+  double number;
+  MessageView text;
+  size_t end = ReadNumber(m, i, number);
+  if (end == npos) {
+    end = ReadString(m, i, text);
+  }
+  if (end != npos) {
+    return end;
+  }
+  size_t n = 0;
+  if (type >= 0xc4 && type <= 0xc6) {
+    // bin
+    i = ReadLength(m, i + 1, 1 << (type - 0xc4), n);
+    return i != npos && m.size() - i >= n ? i + n : npos;
+  }
+  if (type >= 0xd4 && type <= 0xd8) {
+    // fixext, a type and 1 to 16 bytes
+    const size_t length = 2 + (size_t(1) << (type - 0xd4));
+    return m.size() - i >= length ? i + length : npos;
+  }
+  if (type >= 0xc7 && type <= 0xc9) {
+    // ext, a type after the size
+    i = ReadLength(m, i + 1, 1 << (type - 0xc7), n);
+    return i != npos && m.size() - i > n ? i + 1 + n : npos;
+  }
+  end = ReadArray(m, i, n);
+  if (end == npos) {
+    end = ReadMap(m, i, n);
+    // A key and a value each
+    n *= 2;
+  }
+  for (size_t k = 0; k < n && end != npos; k++) {
+    end = Skip(m, end, depth - 1);
+  }
+  return end;
+}
+
+// Whether name is among the comma separated subprotocols
+bool Offers(const MessageView &subprotocols, const char *name) {
+  const size_t length = std::strlen(name);
+  for (size_t begin = 0; begin < subprotocols.size();) {
+    size_t end = subprotocols.find(',', begin);
+    end = end == npos ? subprotocols.size() : end;
+    // Trimmed of the spaces around it
+    size_t first = begin;
+    size_t last = end;
+    while (first < last && subprotocols[first] == ' ') {
+      first++;
+    }
+    while (last > first && subprotocols[last - 1] == ' ') {
+      last--;
+    }
+    if (last - first == length && std::memcmp(subprotocols.data + first, name, length) == 0) {
+      return true;
+    }
+    begin = end + 1;
+  }
+  return false;
+}
+
+}  // namespace
+
+WireFormat NegotiateWireFormat(const MessageView &subprotocols) {
+  if (Offers(subprotocols, kProblemsSubprotocol)) {
+    return WireFormat::kProblems;
+  }
+  if (Offers(subprotocols, kSharedMemorySubprotocol)) {
+    return WireFormat::kSharedMemory;
+  }
+  if (Offers(subprotocols, kMessagePackSubprotocol)) {
+    return WireFormat::kMessagePack;
+  }
+  return WireFormat::kJson;
+}
+
+bool UnpackTelemetry(const MessageView &message, Telemetry &telemetry) {
+  const MessageView &m = message;
+  telemetry.ptsx.clear();
+  telemetry.ptsy.clear();
+  unsigned found = 0;
+  size_t n = 0;
+  size_t i = ReadMap(m, 0, n);
+  for (size_t k = 0; k < n && i != npos; k++) {
+    MessageView key;
+    i = ReadString(m, i, key);
+    if (i == npos) {
+      return false;
+    }
+    if (key.equals("ptsx")) {
+      i = ReadNumbers(m, i, telemetry.ptsx);
+      found |= kPtsx;
+    } else if (key.equals("ptsy")) {
+      i = ReadNumbers(m, i, telemetry.ptsy);
+      found |= kPtsy;
+    } else {
+      bool number = false;
+      for (const auto &field : kNumbers) {
+        if (key.equals(field.name)) {
+          i = ReadNumber(m, i, telemetry.*field.field);
+          found |= field.bit;
+          number = true;
+          break;
+        }
+      }
+      if (!number) {
+        i = Skip(m, i, kMaxDepth);
+      }
+    }
+  }
+  return i == m.size() && found == kRequired;
+}
+
+bool UnpackSteer(const MessageView &message, double &steering_angle, double &throttle) {
+  const MessageView &m = message;
+  unsigned found = 0;
+  size_t n = 0;
+  size_t i = ReadMap(m, 0, n);
+  for (size_t k = 0; k < n && i != npos; k++) {
+    MessageView key;
+    i = ReadString(m, i, key);
+    if (i == npos) {
+      return false;
+    }
+    double *value = key.equals("steering_angle") ? &steering_angle
+                    : key.equals("throttle")     ? &throttle
+                                                 : nullptr;
+    if (value == nullptr) {
+      i = Skip(m, i, kMaxDepth);
+    } else if (i < m.size() && Type(m, i) == 0xc0) {
+      *value = std::numeric_limits<double>::quiet_NaN();
+      i++;
+    } else {
+      i = ReadNumber(m, i, *value);
+    }
+    found |= value == &steering_angle ? 1 : value == &throttle ? 2 : 0;
+  }
+  return i == m.size() && found == 3;
+}
+
+SteerPack::SteerPack() { buffer_.reserve(512); }
+
+const std::string &SteerPack::Write(double steering_angle, double throttle, const double *mpc_x,
+                                    const double *mpc_y, size_t mpc_n, const double *next_x,
+                                    const double *next_y, size_t next_n) {
+  buffer_.clear();
+  // A map of 6 pairs
+  buffer_.push_back(static_cast<char>(0x86));
+  AppendArray("mpc_x", mpc_x, mpc_n);
+  AppendArray("mpc_y", mpc_y, mpc_n);
+  AppendArray("next_x", next_x, next_n);
+  AppendArray("next_y", next_y, next_n);
+  AppendKey("steering_angle");
+  AppendDouble(steering_angle);
+  AppendKey("throttle");
+  AppendDouble(throttle);
+  return buffer_;
+}
+
+// The keys are all shorter than the 32 bytes of a fixstr
+void SteerPack::AppendKey(const char *key) {
+  const size_t length = std::strlen(key);
+  buffer_.push_back(static_cast<char>(0xa0 | length));
+  buffer_.append(key, length);
+}
+
+void SteerPack::AppendArray(const char *key, const double *values, size_t n) {
+  AppendKey(key);
+  if (n < 16) {
+    buffer_.push_back(static_cast<char>(0x90 | n));
+  } else {
+    buffer_.push_back(static_cast<char>(0xdc));
+    AppendBigEndian(n, 2);
+  }
+  for (size_t i = 0; i < n; i++) {
+    AppendFloat(static_cast<float>(values[i]));
+  }
+}
+
+void SteerPack::AppendDouble(double value) {
+  if (!std::isfinite(value)) {
+    buffer_.push_back(static_cast<char>(0xc0));
+    return;
+  }
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  buffer_.push_back(static_cast<char>(0xcb));
+  AppendBigEndian(bits, 8);
+}
+
+void SteerPack::AppendFloat(float value) {
+  if (!std::isfinite(value)) {
+    buffer_.push_back(static_cast<char>(0xc0));
+    return;
+  }
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  buffer_.push_back(static_cast<char>(0xca));
+  AppendBigEndian(bits, 4);
+}
+
+void SteerPack::AppendBigEndian(unsigned long long value, int bytes) {
+  for (int k = bytes - 1; k >= 0; k--) {
+    buffer_.push_back(static_cast<char>(value >> (8 * k)));
+  }
+}
@@ -0,0 +1,70 @@
+#ifndef MESSAGE_PACK_H
+#define MESSAGE_PACK_H
+
+#include <cstddef>
+#include <string>
+#include "MessageView.h"
+#include "Telemetry.h"
+
+// What a connection speaks: the socket.io text frames of the simulator, JSON
+// inside, or binary websocket messages of MessagePack (msgpack.org) that
+// carry the same fields, for clients that would rather not format and parse
+// the waypoints and lines as decimal text every tick, or records of fixed
+// size in memory shared with a client on the same host (see
+// SharedChannel.h); or, for a client of the solver as a service, batches
+// of problems and their plans (see ProblemService.h). See DATA.md.
+enum class WireFormat { kJson, kMessagePack, kSharedMemory, kProblems };
+
+// The subprotocols a client offers in its handshake for MessagePack, for
+// shared memory and for the problem service
+extern const char kMessagePackSubprotocol[];
+extern const char kSharedMemorySubprotocol[];
+extern const char kProblemsSubprotocol[];
+
+// The format for the comma separated subprotocols of a client's
+// Sec-WebSocket-Protocol header: kProblems if kProblemsSubprotocol is among
+// them, else kSharedMemory if kSharedMemorySubprotocol is, else kMessagePack
+// if kMessagePackSubprotocol is, kJson otherwise, as for the stock
+// simulator, which offers none
+WireFormat NegotiateWireFormat(const MessageView &subprotocols);
+
+// Unpack a MessagePack telemetry message, a map with the fields of DATA.md,
+// into telemetry. The numbers may be of any MessagePack integer or float
+// type, and fields of other names are skipped. False if the message is
+// malformed or not a map, misses ptsx, ptsy, x, y, psi, speed or
+// steering_angle, or has more than kMaxWaypoints waypoints.
+bool UnpackTelemetry(const MessageView &message, Telemetry &telemetry);
+
+// The actuations of a steer reply of SteerPack, for replays to compare
+// with; a nil is NaN. False if the message is malformed or misses either.
+bool UnpackSteer(const MessageView &message, double &steering_angle, double &throttle);
+
+// The steer reply in MessagePack, the map of the fields of the JSON one,
+// written into a buffer that is kept from one message to the next like
+// SteerMessage:
+//
+//   {"mpc_x": [..], "mpc_y": [..], "next_x": [..], "next_y": [..],
+//    "steering_angle": .., "throttle": ..}
+//
+// The actuations are float 64, the lines to display, which the simulator
+// only draws, float 32. A number that isn't finite is written as nil.
+class SteerPack {
+ public:
+  SteerPack();
+
+  // The message, valid until the next Write
+  const std::string &Write(double steering_angle, double throttle, const double *mpc_x,
+                           const double *mpc_y, size_t mpc_n, const double *next_x,
+                           const double *next_y, size_t next_n);
+
+ private:
+  void AppendKey(const char *key);
+  void AppendArray(const char *key, const double *values, size_t n);
+  void AppendDouble(double value);
+  void AppendFloat(float value);
+  void AppendBigEndian(unsigned long long value, int bytes);
+
+  std::string buffer_;
+};
+
+#endif /* MESSAGE_PACK_H */
@@ -0,0 +1,76 @@
+#ifndef MESSAGE_VIEW_H
+#define MESSAGE_VIEW_H
+
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <string>
+
+// A view of length bytes at data owned by someone else, such as the buffer
+// of a websocket message, which needn't end with a null byte. Nothing is
+// copied until str() is asked for.
+struct MessageView {
+  static const size_t npos = static_cast<size_t>(-1);
+
+  const char *data = nullptr;
+  size_t length = 0;
+
+  MessageView() = default;
+  MessageView(const char *data, size_t length) : data(data), length(length) {}
+
+  const char *begin() const { return data; }
+  const char *end() const { return data + length; }
+  size_t size() const { return length; }
+  bool empty() const { return length == 0; }
+  char operator[](size_t i) const { return data[i]; }
+
+  // The count bytes from pos, or up to the end
+  MessageView substr(size_t pos, size_t count = npos) const {
+    pos = pos < length ? pos : length;
+    return MessageView(data + pos, count < length - pos ? count : length - pos);
+  }
+
+  // Position of the first match of the n bytes at s from pos, of c, and the
+  // last match of s; npos if there is none
+  size_t find(const char *s, size_t n, size_t pos = 0) const {
+    for (; n <= length && pos <= length - n; pos++) {
+      if (std::memcmp(data + pos, s, n) == 0) {
+        return pos;
+      }
+    }
+    return npos;
+  }
+  size_t find(const char *s, size_t pos = 0) const { return find(s, std::strlen(s), pos); }
+  size_t find(char c, size_t pos = 0) const {
+    const void *p = pos < length ? std::memchr(data + pos, c, length - pos) : nullptr;
+    return p != nullptr ? static_cast<const char *>(p) - data : npos;
+  }
+  size_t rfind(const char *s) const {
+    const size_t n = std::strlen(s);
+    if (n > length) {
+      return npos;
+    }
+    for (size_t pos = length - n + 1; pos-- > 0;) {
+      if (std::memcmp(data + pos, s, n) == 0) {
+        return pos;
+      }
+    }
+    return npos;
+  }
+
+  bool equals(const char *s) const {
+    return std::strlen(s) == length && std::memcmp(data, s, length) == 0;
+  }
+  bool starts_with(const char *s) const {
+    const size_t n = std::strlen(s);
+    return n <= length && std::memcmp(data, s, n) == 0;
+  }
+
+  std::string str() const { return std::string(data, length); }
+};
+
+inline std::ostream &operator<<(std::ostream &out, const MessageView &view) {
+  return out.write(view.data, static_cast<std::streamsize>(view.length));
+}
+
+#endif /* MESSAGE_VIEW_H */
@@ -0,0 +1,556 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// Bounds of the histograms of seconds: 10 us up to 1 s, three a decade
+const std::vector<double> kSecondBounds = {1e-5, 2e-5, 5e-5, 1e-4, 2e-4, 5e-4, 1e-3, 2e-3,
+                                           5e-3, 1e-2, 2e-2, 5e-2, 0.1,  0.2,  0.5,  1};
+// Of the jitter of the commands, 100 us up to half a period
+const std::vector<double> kJitterBounds = {1e-4, 2e-4, 5e-4, 1e-3, 2e-3, 5e-3, 1e-2, 2e-2, 5e-2};
+// Of the command latency, around the 100 ms of the actuators
+const std::vector<double> kLatencyBounds = {0.1, 0.102, 0.105, 0.11, 0.12, 0.15, 0.2, 0.5, 1};
+// Of the time left to the deadline of a tick as it starts, the late ones in
+// the first bucket, up to a control period
+const std::vector<double> kSlackBounds = {0, 1e-3, 2e-3, 5e-3, 1e-2, 2e-2, 5e-2, 0.1};
+const std::vector<double> kIterationBounds = {1, 2, 3, 5, 10, 20, 50, 100, 200, 500};
+const std::vector<double> kAllocationBounds = {0, 1, 2, 5, 10, 20, 50, 100, 1000, 10000};
+const std::vector<double> kAllocationByteBounds = {0, 64, 256, 1024, 4096, 16384, 65536, 262144,
+                                                   1048576};
+
+double FromBits(uint64_t bits) {
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+uint64_t ToBits(double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+void AppendNumber(double value, std::string &out) {
+  char text[32];
+  std::snprintf(text, sizeof(text), "%.17g", value);
+  out.append(text);
+}
+
+void AppendHeader(const char *name, const char *type, const char *help, std::string &out) {
+  out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+  out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void AppendSample(const char *name, double value, std::string &out) {
+  out.append(name).append(" ");
+  AppendNumber(value, out);
+  out.append("\n");
+}
+
+// The index of the highest bit set of value, which isn't 0
+int HighestBit(uint64_t value) {
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll(value);
+#else
+  int bit = 0;
+  while (value >>= 1) {
+    bit++;
+  }
+  return bit;
+#endif
+}
+
+// The quantiles of the summaries of the stages, and their labels
+const double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+const char *const kQuantileLabels[] = {"0.5", "0.9", "0.99", "0.999"};
+
+const char *const kStageNames[kTickStages] = {"wait",        "decode",       "parse",
+                                              "fit",         "predict",      "solve",
+                                              "model",       "derivatives",  "linear_solve",
+                                              "serialize",   "send"};
+
+void AppendCounter(const char *name, const char *help, const MetricCounter &counter,
+                   std::string &out) {
+  AppendHeader(name, "counter", help, out);
+  AppendSample(name, static_cast<double>(counter.value()), out);
+}
+
+}  // namespace
+
+void MetricGauge::Set(double value) { bits_.store(ToBits(value), std::memory_order_relaxed); }
+
+void MetricGauge::Add(double delta) {
+  uint64_t bits = bits_.load(std::memory_order_relaxed);
+  while (!bits_.compare_exchange_weak(bits, ToBits(FromBits(bits) + delta),
+                                      std::memory_order_relaxed)) {
+  }
+}
+
+double MetricGauge::value() const { return FromBits(bits_.load(std::memory_order_relaxed)); }
+
+MetricHistogram::MetricHistogram(const std::vector<double> &bounds)
+    : bounds_(bounds), buckets_(new std::atomic<uint64_t>[bounds.size() + 1]) {
+  for (size_t k = 0; k <= bounds_.size(); k++) {
+    buckets_[k].store(0, std::memory_order_relaxed);
+  }
+}
+
+void MetricHistogram::Observe(double value) {
+  size_t k = 0;
+  while (k < bounds_.size() && value > bounds_[k]) {
+    k++;
+  }
+  buckets_[k].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.Add(value);
+}
+
+void MetricHistogram::Render(const char *name, const char *labels, std::string &out) const {
+  const std::string separator = labels != nullptr && labels[0] != '\0' ? "," : "";
+  const std::string prefix = labels != nullptr ? labels : "";
+  // The buckets of Prometheus count every value up to their bound
+  uint64_t cumulative = 0;
+  for (size_t k = 0; k <= bounds_.size(); k++) {
+    cumulative += buckets_[k].load(std::memory_order_relaxed);
+    out.append(name).append("_bucket{").append(prefix).append(separator).append("le=\"");
+    if (k < bounds_.size()) {
+      AppendNumber(bounds_[k], out);
+    } else {
+      out.append("+Inf");
+    }
+    out.append("\"} ");
+    AppendNumber(static_cast<double>(cumulative), out);
+    out.append("\n");
+  }
+  const std::string braces = prefix.empty() ? "" : "{" + prefix + "}";
+  out.append(name).append("_sum").append(braces).append(" ");
+  AppendNumber(sum_.value(), out);
+  out.append("\n");
+  out.append(name).append("_count").append(braces).append(" ");
+  AppendNumber(static_cast<double>(count_.load(std::memory_order_relaxed)), out);
+  out.append("\n");
+}
+
+const size_t LatencyHistogram::kBuckets;
+
+LatencyHistogram::LatencyHistogram() : buckets_(new std::atomic<uint64_t>[kBuckets]) {
+  for (size_t k = 0; k < kBuckets; k++) {
+    buckets_[k].store(0, std::memory_order_relaxed);
+  }
+}
+
+size_t LatencyHistogram::Bucket(uint64_t nanoseconds) {
+  if (nanoseconds < (uint64_t(1) << kSubBits)) {
+    return static_cast<size_t>(nanoseconds);
+  }
+  const int exponent = HighestBit(nanoseconds);
+  if (exponent >= kMaxExponent) {
+    return kBuckets - 1;
+  }
+  // The kSubBits - 1 bits under the highest, in the buckets of its power
+  const int shift = exponent - kSubBits + 1;
+  const size_t half = size_t(1) << (kSubBits - 1);
+  return (size_t(1) << kSubBits) + (exponent - kSubBits) * half +
+         static_cast<size_t>((nanoseconds >> shift) - half);
+}
+
+uint64_t LatencyHistogram::UpperBound(size_t k) {
+  const size_t exact = size_t(1) << kSubBits;
+  if (k < exact) {
+    return k;
+  }
+  const size_t half = exact / 2;
+  const int shift = static_cast<int>((k - exact) / half) + 1;
+  const uint64_t mantissa = half + (k - exact) % half;
+  return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(double seconds) {
+  const uint64_t nanoseconds =
+      seconds > 0 ? static_cast<uint64_t>(std::min(seconds * 1e9, 1e18)) : 0;
+  buckets_[Bucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(nanoseconds, std::memory_order_relaxed);
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (nanoseconds > max &&
+         !max_.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {
+  }
+}
+
+double LatencyHistogram::sum() const { return sum_.load(std::memory_order_relaxed) * 1e-9; }
+
+double LatencyHistogram::max() const { return max_.load(std::memory_order_relaxed) * 1e-9; }
+
+double LatencyHistogram::Quantile(double q) const {
+  const uint64_t n = count();
+  if (n == 0) {
+    return 0;
+  }
+  const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * n)));
+  uint64_t seen = 0;
+  for (size_t k = 0; k < kBuckets; k++) {
+    seen += buckets_[k].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      // No quantile is above the largest duration recorded, which the last
+      // bucket holds every longer one up to
+      const uint64_t max = max_.load(std::memory_order_relaxed);
+      return (k + 1 < kBuckets ? std::min(UpperBound(k), max) : max) * 1e-9;
+    }
+  }
+  return max();
+}
+
+void LatencyHistogram::Render(const char *name, const std::string &labels,
+                              std::string &out) const {
+  const std::string separator = labels.empty() ? "" : ",";
+  for (size_t k = 0; k < sizeof(kQuantiles) / sizeof(kQuantiles[0]); k++) {
+    out.append(name).append("{").append(labels).append(separator).append("quantile=\"");
+    out.append(kQuantileLabels[k]).append("\"} ");
+    AppendNumber(Quantile(kQuantiles[k]), out);
+    out.append("\n");
+  }
+  const std::string braces = labels.empty() ? "" : "{" + labels + "}";
+  out.append(name).append("_sum").append(braces).append(" ");
+  AppendNumber(sum(), out);
+  out.append("\n");
+  out.append(name).append("_count").append(braces).append(" ");
+  AppendNumber(static_cast<double>(count()), out);
+  out.append("\n");
+}
+
+const char *TickStageName(TickStage stage) { return kStageNames[static_cast<size_t>(stage)]; }
+
+void StageHistograms::Render(uint64_t session, std::string &out) const {
+  const std::string prefix = "session=\"" + std::to_string(session) + "\",stage=\"";
+  for (size_t k = 0; k < kTickStages; k++) {
+    if (histograms_[k].count() > 0) {
+      histograms_[k].Render("mpc_session_stage_seconds", prefix + kStageNames[k] + "\"", out);
+    }
+  }
+}
+
+std::string StageHistograms::Summary() const {
+  std::string out;
+  char text[96];
+  for (size_t k = 0; k < kTickStages; k++) {
+    const LatencyHistogram &histogram = histograms_[k];
+    if (histogram.count() == 0) {
+      continue;
+    }
+    std::snprintf(text, sizeof(text), "%s%s %.3f/%.3f/%.3f", out.empty() ? "" : ", ",
+                  kStageNames[k], histogram.Quantile(0.5) * 1e3, histogram.Quantile(0.99) * 1e3,
+                  histogram.max() * 1e3);
+    out.append(text);
+  }
+  return out;
+}
+
+void RenderStageHeader(std::string &out) {
+  AppendHeader("mpc_session_stage_seconds", "summary",
+               "Seconds of each stage of the ticks of a session, to within 3%", out);
+}
+
+const char *const kDeadlineMissNames[kDeadlineMissCauses] = {
+    "queueing", "parse", "iteration_cap", "restoration", "solve", "reply"};
+
+const char *DeadlineMissName(DeadlineMiss cause) {
+  return kDeadlineMissNames[static_cast<size_t>(cause)];
+}
+
+SLOCompliance::SLOCompliance() { compliance_.Set(1); }
+
+void SLOCompliance::Record(bool met) {
+  if (ticks_ == kWindow) {
+    misses_ -= !met_[next_];
+  } else {
+    ticks_++;
+  }
+  met_[next_] = met;
+  misses_ += !met;
+  next_ = (next_ + 1) % kWindow;
+  compliance_.Set(1 - static_cast<double>(misses_) / ticks_);
+}
+
+void SLOCompliance::Render(uint64_t session, std::string &out) const {
+  out.append("mpc_session_slo_compliance{session=\"").append(std::to_string(session));
+  out.append("\"} ");
+  AppendNumber(compliance(), out);
+  out.append("\n");
+}
+
+void RenderSLOHeader(std::string &out) {
+  AppendHeader("mpc_session_slo_compliance", "gauge",
+               "Fraction of the last 1000 ticks of a session that met the control period",
+               out);
+}
+
+const char *const kCacheNames[kCaches] = {"fit", "warm_start", "solution_database",
+                                          "linearization_table", "speculation",
+                                          "shared_solve"};
+
+const char *CacheName(Cache cache) { return kCacheNames[static_cast<size_t>(cache)]; }
+
+void CacheCounters::Record(bool hit, double seconds, int iterations) {
+  (hit ? hits_ : misses_).Add();
+  (hit ? hit_seconds_ : miss_seconds_).Add(seconds);
+  (hit ? hit_iterations_ : miss_iterations_).Add(static_cast<uint64_t>(std::max(0, iterations)));
+}
+
+void CacheCounters::RecordSaving(double seconds, double iterations) {
+  baselines_.Add();
+  saved_seconds_.Add(seconds);
+  saved_iterations_.Add(iterations);
+}
+
+ServerMetrics::ServerMetrics()
+    : wait(kSecondBounds),
+      parse(kSecondBounds),
+      fit(kSecondBounds),
+      solve(kSecondBounds),
+      reply(kSecondBounds),
+      iterations(kIterationBounds),
+      allocations(kAllocationBounds),
+      allocation_bytes(kAllocationByteBounds),
+      command_latency(kLatencyBounds),
+      loop_lag(kSecondBounds),
+      socket_queue(kSecondBounds),
+      wakeup(kSecondBounds),
+      prefit(kSecondBounds),
+      command_jitter(kJitterBounds),
+      edf_slack(kSlackBounds) {}
+
+ServerMetrics &Metrics() {
+  static ServerMetrics metrics;
+  return metrics;
+}
+
+std::string RenderMetrics() {
+  const ServerMetrics &metrics = Metrics();
+  std::string out;
+  out.reserve(8192);
+  AppendHeader("mpc_tick_stage_seconds", "histogram",
+               "Seconds of each stage of a tick, from the telemetry to the reply", out);
+  const struct {
+    const char *labels;
+    const MetricHistogram &histogram;
+  } stages[] = {{"stage=\"wait\"", metrics.wait},
+                {"stage=\"parse\"", metrics.parse},
+                {"stage=\"fit\"", metrics.fit},
+                {"stage=\"solve\"", metrics.solve},
+                {"stage=\"reply\"", metrics.reply}};
+  for (const auto &stage : stages) {
+    stage.histogram.Render("mpc_tick_stage_seconds", stage.labels, out);
+  }
+  AppendHeader("mpc_command_latency_seconds", "histogram",
+               "Seconds from the arrival of the telemetry to the command sent", out);
+  metrics.command_latency.Render("mpc_command_latency_seconds", nullptr, out);
+  AppendHeader("mpc_solve_iterations", "histogram", "Iterations of each solve", out);
+  metrics.iterations.Render("mpc_solve_iterations", nullptr, out);
+  AppendHeader("mpc_tick_allocations", "histogram",
+               "Heap allocations of the solver thread over each tick", out);
+  metrics.allocations.Render("mpc_tick_allocations", nullptr, out);
+  AppendHeader("mpc_tick_allocation_bytes", "histogram",
+               "Bytes the heap allocations of the solver thread asked for over each tick", out);
+  metrics.allocation_bytes.Render("mpc_tick_allocation_bytes", nullptr, out);
+  AppendHeader("mpc_loop_lag_seconds", "histogram",
+               "Lateness of the heartbeat timers of the event loops", out);
+  metrics.loop_lag.Render("mpc_loop_lag_seconds", nullptr, out);
+  AppendHeader("mpc_socket_queue_seconds", "histogram",
+               "Seconds from the receipt of a frame by the kernel to its message handler", out);
+  metrics.socket_queue.Render("mpc_socket_queue_seconds", nullptr, out);
+  AppendHeader("mpc_wakeup_seconds", "histogram",
+               "Seconds from the ring of a waiting solver thread to its wakeup", out);
+  metrics.wakeup.Render("mpc_wakeup_seconds", nullptr, out);
+  AppendHeader("mpc_prefit_seconds", "histogram",
+               "Seconds the event loops took to parse and fit a frame ahead of its tick", out);
+  metrics.prefit.Render("mpc_prefit_seconds", nullptr, out);
+  AppendHeader("mpc_command_jitter_seconds", "histogram",
+               "Difference of the interval between the commands of a session from that "
+               "between their telemetry",
+               out);
+  metrics.command_jitter.Render("mpc_command_jitter_seconds", nullptr, out);
+  AppendCounter("mpc_ticks_total", "Telemetry messages solved", metrics.ticks, out);
+  AppendCounter("mpc_deadline_misses_total",
+                "Solves stopped at their deadline or iteration limit", metrics.deadline_misses,
+                out);
+  AppendCounter("mpc_failed_solves_total", "Solves without a usable plan",
+                metrics.failed_solves, out);
+  AppendCounter("mpc_allocation_free_violations_total",
+                "Ticks that allocated in a stage configured not to",
+                metrics.allocation_free_violations, out);
+  AppendCounter("mpc_slo_ticks_total", "Ticks judged against the control period",
+                metrics.slo_ticks, out);
+  AppendHeader("mpc_slo_misses_total", "counter",
+               "Ticks that missed the control period, by their cause", out);
+  for (size_t k = 0; k < kDeadlineMissCauses; k++) {
+    out.append("mpc_slo_misses_total{cause=\"").append(kDeadlineMissNames[k]).append("\"} ");
+    AppendNumber(static_cast<double>(metrics.slo_misses[k].value()), out);
+    out.append("\n");
+  }
+  AppendHeader("mpc_solver_evaluations_total", "counter",
+               "Evaluations of the solves, of each kind", out);
+  const struct {
+    const char *name;
+    const MetricCounter &counter;
+  } evaluations[] = {
+      {"mpc_solver_evaluations_total{kind=\"cost\"}", metrics.cost_evaluations},
+      {"mpc_solver_evaluations_total{kind=\"gradient\"}", metrics.gradient_evaluations},
+      {"mpc_solver_evaluations_total{kind=\"constraints\"}", metrics.constraint_evaluations},
+      {"mpc_solver_evaluations_total{kind=\"jacobian\"}", metrics.jacobian_evaluations},
+      {"mpc_solver_evaluations_total{kind=\"hessian\"}", metrics.hessian_evaluations}};
+  for (const auto &evaluation : evaluations) {
+    AppendSample(evaluation.name, static_cast<double>(evaluation.counter.value()), out);
+  }
+  AppendCounter("mpc_solver_forward_sweeps_saved_total",
+                "Forward sweeps of the model an evaluation took from another at the same iterate",
+                metrics.forward_sweeps_saved, out);
+  AppendCounter("mpc_solver_restorations_total", "Entries into the restoration phase of Ipopt",
+                metrics.restorations, out);
+  AppendHeader("mpc_solver_phase_seconds_total", "counter",
+               "Seconds of the solves evaluating the model, its derivatives, and in linear algebra",
+               out);
+  AppendSample("mpc_solver_phase_seconds_total{phase=\"model\"}", metrics.model_seconds.value(),
+               out);
+  AppendSample("mpc_solver_phase_seconds_total{phase=\"derivatives\"}",
+               metrics.derivative_seconds.value(), out);
+  AppendSample("mpc_solver_phase_seconds_total{phase=\"linear_solve\"}",
+               metrics.linear_solve_seconds.value(), out);
+  AppendCounter("mpc_fit_hits_total", "Reference fits reused as they were", metrics.fit_hits,
+                out);
+  AppendCounter("mpc_fit_refits_total", "Reference fits of the same waypoints redone",
+                metrics.fit_refits, out);
+  AppendCounter("mpc_fit_misses_total", "Reference fits of new waypoints", metrics.fit_misses,
+                out);
+  AppendCounter("mpc_frames_skipped_total", "Telemetry replaced before it was solved",
+                metrics.frames_skipped, out);
+  AppendCounter("mpc_frames_expired_total", "Telemetry older than the maximum age once taken",
+                metrics.frames_expired, out);
+  AppendCounter("mpc_frames_prepared_total", "Telemetry parsed and fitted before its tick",
+                metrics.frames_prepared, out);
+  AppendCounter("mpc_commands_dropped_total", "Commands dropped for clients behind",
+                metrics.commands_dropped, out);
+  AppendCounter("mpc_corked_frames_total", "Frames held by the event loops to send together",
+                metrics.corked_frames, out);
+  AppendCounter("mpc_corked_writes_total", "Writes of the frames held, one a socket a flush",
+                metrics.corked_writes, out);
+  AppendCounter("mpc_flight_records_total", "Records of the flight recorder",
+                metrics.flight_records, out);
+  AppendCounter("mpc_flight_dropped_total", "Records dropped with no segment ready",
+                metrics.flight_dropped, out);
+  AppendCounter("mpc_problems_captured_total", "Problems of slow solves written to files",
+                metrics.problems_captured, out);
+  AppendCounter("mpc_problems_dropped_total", "Problems of slow solves not written",
+                metrics.problems_dropped, out);
+  AppendCounter("mpc_tick_dumps_total", "Rings of the last ticks written to files",
+                metrics.tick_dumps, out);
+  AppendCounter("mpc_tick_dumps_dropped_total", "Rings of the last ticks not written",
+                metrics.tick_dumps_dropped, out);
+  AppendCounter("mpc_observer_ticks_total", "Ticks streamed to the observers",
+                metrics.observer_ticks, out);
+  AppendCounter("mpc_observer_overwritten_total",
+                "Ticks overwritten before the observer thread read them",
+                metrics.observer_overwritten, out);
+  AppendCounter("mpc_observer_lines_dropped_total", "Lines dropped for observers behind",
+                metrics.observer_lines_dropped, out);
+  AppendCounter("mpc_refinements_total", "Plans refined in the idle time of their ticks",
+                metrics.refinements, out);
+  AppendCounter("mpc_refinement_sweeps_total", "Solves of the plans refined in idle time",
+                metrics.refinement_sweeps, out);
+  AppendCounter("mpc_refinements_preempted_total",
+                "Refinements in idle time stopped by telemetry", metrics.refinements_preempted,
+                out);
+  AppendCounter("mpc_solvers_reused_total", "Solvers of closed sessions taken by new ones",
+                metrics.solvers_reused, out);
+  AppendCounter("mpc_solvers_made_total", "Solvers made for new sessions, none pooled",
+                metrics.solvers_made, out);
+  AppendCounter("mpc_solves_stolen_total", "Ticks solved by the solver of another worker",
+                metrics.solves_stolen, out);
+  AppendHeader("mpc_edf_slack_seconds", "histogram",
+               "Seconds left to the deadline of each tick as edf started it", out);
+  metrics.edf_slack.Render("mpc_edf_slack_seconds", nullptr, out);
+  AppendCounter("mpc_edf_demoted_total", "Ticks solved on the fast path to make their deadline",
+                metrics.edf_demoted, out);
+  AppendCounter("mpc_edf_late_total", "Ticks started past their deadline",
+                metrics.edf_late, out);
+  AppendCounter("mpc_quota_degraded_total",
+                "Ticks solved on the fast path as their session was over its CPU quota",
+                metrics.quota_degraded, out);
+  AppendCounter("mpc_sessions_refused_total", "Sessions refused with the workers at capacity",
+                metrics.sessions_refused, out);
+  AppendCounter("mpc_shed_degraded_total",
+                "Ticks solved on the fast path as their session was shed at capacity",
+                metrics.shed_degraded, out);
+  AppendCounter("mpc_service_problems_total", "Problems of the problem service solved",
+                metrics.service_problems, out);
+  AppendCounter("mpc_service_refused_total",
+                "Problems of the problem service refused over the limits of their client",
+                metrics.service_refused, out);
+  AppendCounter("mpc_commands_sampled_total",
+                "Commands sent from the plan of the last tick between its replies",
+                metrics.commands_sampled, out);
+  AppendCounter("mpc_proximity_pairs_total",
+                "Pairs of stages of the plans of two cars of a batch that came close",
+                metrics.proximity_pairs, out);
+  AppendHeader("mpc_sessions", "gauge", "Simulators connected", out);
+  AppendSample("mpc_sessions", metrics.sessions.value(), out);
+  AppendHeader("mpc_sessions_shed", "gauge", "Sessions shed to their fast path at capacity",
+               out);
+  AppendSample("mpc_sessions_shed", metrics.sessions_shed.value(), out);
+  AppendHeader("mpc_observers", "gauge", "Observers connected", out);
+  AppendSample("mpc_observers", metrics.observer_subscribers.value(), out);
+  AppendHeader("mpc_cppad_pool_bytes", "gauge",
+               "Bytes of the CppAD pools of the solver threads, in use and held", out);
+  AppendSample("mpc_cppad_pool_bytes{state=\"inuse\"}", metrics.cppad_inuse_bytes.value(), out);
+  AppendSample("mpc_cppad_pool_bytes{state=\"available\"}", metrics.cppad_available_bytes.value(),
+               out);
+  // Each family whole, its samples of every cache and outcome after its
+  // header
+  const struct {
+    const char *name;
+    const char *type;
+    const char *help;
+    bool outcomes;
+  } families[] = {
+      {"mpc_cache_lookups_total", "counter", "Hits and misses of each cache of the control path",
+       true},
+      {"mpc_cache_seconds_total", "counter",
+       "Seconds of the stage a cache serves on its hits and misses", true},
+      {"mpc_cache_iterations_total", "counter",
+       "Iterations of the solves on the hits and misses of a cache", true},
+      {"mpc_cache_baselines_total", "counter",
+       "Hits of a cache measured against the tick done again without it", false},
+      {"mpc_cache_saved_seconds_total", "gauge",
+       "Seconds the measured hits of a cache saved, negative if they cost", false},
+      {"mpc_cache_saved_iterations_total", "gauge",
+       "Iterations the measured hits of a cache saved, negative if they cost", false}};
+  for (size_t f = 0; f < sizeof(families) / sizeof(families[0]); f++) {
+    AppendHeader(families[f].name, families[f].type, families[f].help, out);
+    for (size_t k = 0; k < kCaches; k++) {
+      const CacheCounters &cache = metrics.caches[k];
+      const double values[][2] = {
+          {static_cast<double>(cache.hits()), static_cast<double>(cache.misses())},
+          {cache.hit_seconds(), cache.miss_seconds()},
+          {static_cast<double>(cache.hit_iterations()),
+           static_cast<double>(cache.miss_iterations())},
+          {static_cast<double>(cache.baselines()), 0},
+          {cache.saved_seconds(), 0},
+          {cache.saved_iterations(), 0}};
+      for (size_t o = 0; o < (families[f].outcomes ? 2 : 1); o++) {
+        out.append(families[f].name).append("{cache=\"").append(kCacheNames[k]).append("\"");
+        if (families[f].outcomes) {
+          out.append(",outcome=\"").append(o == 0 ? "hit" : "miss").append("\"");
+        }
+        out.append("} ");
+        AppendNumber(values[f][o], out);
+        out.append("\n");
+      }
+    }
+  }
+  AppendHeader("mpc_config_version", "gauge",
+               "Version of the runtime configuration the solvers take", out);
+  AppendSample("mpc_config_version", metrics.config_version.value(), out);
+  return out;
+}
@@ -0,0 +1,391 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "CacheLine.h"
+
+// Counters of the server for Prometheus to scrape. Every update is a relaxed
+// atomic add or compare-and-swap of its own, so the solver and the event
+// loops count from any thread without a lock, and rendering reads the
+// counters as they are: a scrape never makes the control loop wait, at the
+// cost of a histogram's buckets, count and sum being read at slightly
+// different moments.
+
+// A count that only goes up
+class MetricCounter {
+ public:
+  void Add(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint64_t> value_{0};
+};
+
+// A value that goes up and down
+class MetricGauge {
+ public:
+  void Set(double value);
+  void Add(double delta);
+  double value() const;
+
+ private:
+  // The bits of the double
+  std::atomic<uint64_t> bits_{0};
+};
+
+// The distribution of the values observed, counted in the buckets of the
+// upper bounds given, in increasing order, and one above them all
+class MetricHistogram {
+ public:
+  explicit MetricHistogram(const std::vector<double> &bounds);
+
+  void Observe(double value);
+
+  // Append the bucket, sum and count lines of the histogram name, with the
+  // labels given ("stage=\"solve\"") if any, to out
+  void Render(const char *name, const char *labels, std::string &out) const;
+
+ private:
+  std::vector<double> bounds_;
+  std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+  std::atomic<uint64_t> count_{0};
+  MetricGauge sum_;
+};
+
+// The distribution of durations in the manner of an HDR histogram: counted
+// in buckets of a fixed relative width, 64 exact ones of a nanosecond and
+// then 32 to each power of two up to 2^36 ns (69 s), so any quantile is
+// read back to within 3% in 8 KiB, and recording is a count of leading
+// zeros, a shift and an add. Like MetricHistogram every add is a relaxed
+// atomic, for one thread to record while another renders.
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+
+  void Record(double seconds);
+
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  double sum() const;
+  double max() const;
+  // The smallest duration that at least a fraction q (0 to 1) of those
+  // recorded don't exceed, to the width of its bucket; 0 while empty
+  double Quantile(double q) const;
+
+  // Append the quantile, sum and count lines of the summary name, with the
+  // labels given, to out
+  void Render(const char *name, const std::string &labels, std::string &out) const;
+
+ private:
+  static const int kSubBits = 6;
+  static const int kMaxExponent = 36;
+  static const size_t kBuckets =
+      (size_t(1) << kSubBits) + (kMaxExponent - kSubBits) * (size_t(1) << (kSubBits - 1));
+
+  static size_t Bucket(uint64_t nanoseconds);
+  // The largest duration of bucket k, in nanoseconds
+  static uint64_t UpperBound(size_t k);
+
+  std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<uint64_t> max_{0};
+};
+
+// The stages of a tick a session times, in the order they run: the
+// telemetry waiting in its mailbox, the socket.io frame decoded, the fields
+// parsed, the reference fitted (the transform into the vehicle frame and
+// the polyfit, one pass), the state predicted over the latency, the
+// solve, and of it the evaluations of the model, of its derivatives and
+// the linear algebra of the steps (see SolvePhases), the reply written and
+// sent
+enum class TickStage {
+  kWait,
+  kDecode,
+  kParse,
+  kFit,
+  kPredict,
+  kSolve,
+  kModel,
+  kDerivatives,
+  kLinearSolve,
+  kSerialize,
+  kSend
+};
+const size_t kTickStages = 11;
+
+// The label of stage, "solve" for kSolve
+const char *TickStageName(TickStage stage);
+
+// The durations of every stage of the ticks of one session, each stage
+// recorded by one thread (the solver's, or the event loop's for kSend)
+class StageHistograms {
+ public:
+  void Record(TickStage stage, double seconds) {
+    histograms_[static_cast<size_t>(stage)].Record(seconds);
+  }
+  const LatencyHistogram &operator[](TickStage stage) const {
+    return histograms_[static_cast<size_t>(stage)];
+  }
+
+  // Append the summaries of the stages recorded so far, labelled with the
+  // session, to out, under the header of RenderStageHeader
+  void Render(uint64_t session, std::string &out) const;
+  // The median, 99th percentile and maximum of each stage recorded, in ms,
+  // for a log line
+  std::string Summary() const;
+
+ private:
+  std::array<LatencyHistogram, kTickStages> histograms_;
+};
+
+// The header of the summaries of StageHistograms::Render
+void RenderStageHeader(std::string &out);
+
+// Why a tick missed the control period (see ControlSLO.h): the telemetry
+// waited in its mailbox, decoding and parsing it was slow, the solve
+// stopped at its iteration limit or deadline, went through Ipopt's
+// restoration phase or was slow otherwise, or writing the reply was
+enum class DeadlineMiss { kQueueing, kParse, kIterationCap, kRestoration, kSolve, kReply };
+const size_t kDeadlineMissCauses = 6;
+
+// The label of cause, "iteration_cap" for kIterationCap
+const char *DeadlineMissName(DeadlineMiss cause);
+
+// The fraction of the last ticks of one session that met the control
+// period, recorded by its solver thread and read by Render on any other
+class SLOCompliance {
+ public:
+  static const size_t kWindow = 1000;
+
+  SLOCompliance();
+
+  void Record(bool met);
+  // Of the last kWindow ticks, or of those so far; 1 before the first
+  double compliance() const { return compliance_.value(); }
+
+  // Append the gauge of the session, under the header of RenderSLOHeader,
+  // to out
+  void Render(uint64_t session, std::string &out) const;
+
+ private:
+  std::array<bool, kWindow> met_;
+  size_t next_ = 0;
+  size_t ticks_ = 0;
+  size_t misses_ = 0;
+  MetricGauge compliance_;
+};
+
+// The header of the gauges of SLOCompliance::Render
+void RenderSLOHeader(std::string &out);
+
+// The caches of the control path: the reference fits reused (see
+// ReferenceFitCache), the starts from the plan of the last solve, the past
+// solutions recalled after a jump of the state (see SolutionDatabase), the
+// model Jacobians of the linearization table (see LinearizationTable), the
+// speculative plans taken (see SpeculativeMPC) and the solutions shared by
+// the sessions (see SolveCache)
+enum class Cache {
+  kFit,
+  kWarmStart,
+  kSolutionDatabase,
+  kLinearizationTable,
+  kSpeculation,
+  kSharedSolve
+};
+const size_t kCaches = 6;
+
+// The label of cache, "warm_start" for kWarmStart
+const char *CacheName(Cache cache);
+
+// What one cache did for the ticks: its hits and misses, with the seconds
+// and iterations of the stage it serves (the fit, or the solve) on each, and
+// for the hits measured against a baseline without the cache (see
+// CacheBaseline.h) the seconds and iterations the baseline took beyond
+// them, what the cache saved; negative when it cost instead. Like the other
+// metrics every update is a relaxed atomic.
+class CacheCounters {
+ public:
+  void Record(bool hit, double seconds, int iterations);
+  void RecordSaving(double seconds, double iterations);
+
+  uint64_t hits() const { return hits_.value(); }
+  uint64_t misses() const { return misses_.value(); }
+  double hit_seconds() const { return hit_seconds_.value(); }
+  double miss_seconds() const { return miss_seconds_.value(); }
+  uint64_t hit_iterations() const { return hit_iterations_.value(); }
+  uint64_t miss_iterations() const { return miss_iterations_.value(); }
+  uint64_t baselines() const { return baselines_.value(); }
+  double saved_seconds() const { return saved_seconds_.value(); }
+  double saved_iterations() const { return saved_iterations_.value(); }
+
+ private:
+  MetricCounter hits_;
+  MetricCounter misses_;
+  MetricGauge hit_seconds_;
+  MetricGauge miss_seconds_;
+  MetricCounter hit_iterations_;
+  MetricCounter miss_iterations_;
+  MetricCounter baselines_;
+  MetricGauge saved_seconds_;
+  MetricGauge saved_iterations_;
+};
+
+// The metrics of the server, one set per process. Laid out by the threads
+// that write them (see CacheLine.h): those of every tick of the solver
+// threads, those of the event loops, then those that hardly change, each
+// group on cache lines of its own.
+struct ServerMetrics {
+  ServerMetrics();
+
+  // Seconds of each stage of a tick: the telemetry waiting in its mailbox,
+  // decoding it, fitting the reference, solving and writing the reply
+  alignas(kCacheLine) MetricHistogram wait;
+  MetricHistogram parse;
+  MetricHistogram fit;
+  MetricHistogram solve;
+  MetricHistogram reply;
+  // Iterations of each solve, and heap allocations of the solver thread
+  // over each tick and the bytes they asked for (see Allocations.h)
+  MetricHistogram iterations;
+  MetricHistogram allocations;
+  MetricHistogram allocation_bytes;
+
+  MetricCounter ticks;
+  // Solves stopped at their deadline or iteration limit, and failed ones
+  MetricCounter deadline_misses;
+  MetricCounter failed_solves;
+  // Ticks that allocated in a stage configured not to
+  MetricCounter allocation_free_violations;
+  // Ticks judged against the control period, and those that missed it by
+  // their cause
+  MetricCounter slo_ticks;
+  std::array<MetricCounter, kDeadlineMissCauses> slo_misses;
+  // The work of the solves as their backends count it (see
+  // SolveStatistics): the evaluations of each kind, the forward sweeps of
+  // the model they shared, the entries into the restoration phase of Ipopt,
+  // and the seconds of each phase
+  MetricCounter cost_evaluations;
+  MetricCounter gradient_evaluations;
+  MetricCounter constraint_evaluations;
+  MetricCounter jacobian_evaluations;
+  MetricCounter hessian_evaluations;
+  MetricCounter forward_sweeps_saved;
+  MetricCounter restorations;
+  MetricGauge model_seconds;
+  MetricGauge derivative_seconds;
+  MetricGauge linear_solve_seconds;
+  // Reference fits reused as they were, redone for the same waypoints from
+  // a pose that moved, and of new waypoints (see ReferenceFitCache)
+  MetricCounter fit_hits;
+  MetricCounter fit_refits;
+  MetricCounter fit_misses;
+  // The hits, misses and savings of each cache
+  std::array<CacheCounters, kCaches> caches;
+  // Telemetry replaced before it was solved, too old to solve once taken,
+  // and commands dropped for clients that fell behind
+  MetricCounter frames_skipped;
+  MetricCounter frames_expired;
+  // Telemetry whose tick took it parsed and fitted ahead, with prefit
+  MetricCounter frames_prepared;
+  MetricCounter commands_dropped;
+  // With cork, the frames the event loops held and sent, and the writes
+  // they took, one a socket a flush (see CorkedSends)
+  MetricCounter corked_frames;
+  MetricCounter corked_writes;
+
+  // Of the event loops: seconds from the arrival of the telemetry until its
+  // command is sent, the actuator latency included
+  alignas(kCacheLine) MetricHistogram command_latency;
+  // Lateness of the heartbeat timers of the event loops, in seconds
+  MetricHistogram loop_lag;
+  // With rxtimestamps, seconds from the receipt of a frame by the kernel
+  // to its message handler, the wait in the socket's buffer
+  MetricHistogram socket_queue;
+  // Seconds from the ring of the doorbell of a waiting solver thread to its
+  // wakeup, on the condition or, with busypoll, polling
+  MetricHistogram wakeup;
+  // With prefit, seconds the event loops took to parse and fit a frame
+  // ahead of its tick
+  MetricHistogram prefit;
+  // How much the interval between the commands of a session strayed from
+  // the interval between their telemetry, in seconds
+  MetricHistogram command_jitter;
+  // Records of the flight recorder, and those it dropped with no segment
+  // ready (see FlightRecorder)
+  MetricCounter flight_records;
+  MetricCounter flight_dropped;
+  MetricGauge sessions;
+
+  // Problems of slow solves written to files, and those dropped, one being
+  // written already or the limit reached (see ProblemCapture)
+  alignas(kCacheLine) MetricCounter problems_captured;
+  MetricCounter problems_dropped;
+  // Dumps of the rings of the tick recorders written, and those dropped,
+  // one being written already (see TickRecorder)
+  MetricCounter tick_dumps;
+  MetricCounter tick_dumps_dropped;
+  // With observe, the ticks streamed to the observers, those overwritten
+  // in the rings before the observer thread read them, the lines dropped
+  // for subscribers behind, and the subscribers (see ObserverFeed)
+  MetricCounter observer_ticks;
+  MetricCounter observer_overwritten;
+  MetricCounter observer_lines_dropped;
+  MetricGauge observer_subscribers;
+  // With refine, the plans refined in idle time, the sweeps of the solvers
+  // that took, and the refinements telemetry preempted (see RefiningMPC)
+  MetricCounter refinements;
+  MetricCounter refinement_sweeps;
+  MetricCounter refinements_preempted;
+  // The bytes of the CppAD pools of the solver threads, in use and held for
+  // their next tapes and sweeps, as of their last ticks (see CppADThreads.h)
+  MetricGauge cppad_inuse_bytes;
+  MetricGauge cppad_available_bytes;
+  // Solvers of closed sessions taken by new ones, and those made for new
+  // sessions with none in the pool of their worker
+  MetricCounter solvers_reused;
+  MetricCounter solvers_made;
+  // Ticks solved by the solver thread of another worker than the session's,
+  // which had run dry, with steal
+  MetricCounter solves_stolen;
+  // With edf, the seconds left to the deadline of every tick as it starts,
+  // the ticks solved on the fast path as their own solver would have missed
+  // it, and those started past it
+  MetricHistogram edf_slack;
+  MetricCounter edf_demoted;
+  MetricCounter edf_late;
+  // Ticks solved on the fast path as their session was over its CPU quota
+  // (see CpuQuota.h)
+  MetricCounter quota_degraded;
+  // With admission, the sessions refused at capacity, the ticks solved on
+  // the fast path as their session was shed for the others, and the
+  // sessions shed (see Admission.h)
+  MetricCounter sessions_refused;
+  MetricCounter shed_degraded;
+  MetricGauge sessions_shed;
+  // Problems of clients of the problem service solved, and those refused
+  // over the limits of their client (see ProblemService.h)
+  MetricCounter service_problems;
+  MetricCounter service_refused;
+  // With commandrate, the commands sampled from the plans between replies
+  MetricCounter commands_sampled;
+  // Pairs of stages of the plans of two cars of a batch that came close,
+  // see "proximity"
+  MetricCounter proximity_pairs;
+  // The version of the last runtime configuration published, 0 for that of
+  // the command line (see RuntimeConfig.h)
+  MetricGauge config_version;
+};
+
+// The metrics of this process
+ServerMetrics &Metrics();
+
+// All of Metrics() in the Prometheus text exposition format, for /metrics
+std::string RenderMetrics();
+
+#endif /* METRICS_H */
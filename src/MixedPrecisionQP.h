@@ -0,0 +1,122 @@
+#ifndef MIXED_PRECISION_QP_H
+#define MIXED_PRECISION_QP_H
+
+#include <algorithm>
+#include <cmath>
+#include "Eigen-3.3/Eigen/Core"
+#include "ActiveSetQP.h"
+
+// The box constrained QP of ActiveSetQP, in double at the interface, solved
+// in single precision with double precision iterative refinement.
+//
+// The weights of the cost span several orders of magnitude (3000 on the
+// steering rate, 1 on the speed), so the QP is first scaled to a unit
+// diagonal, x = D y with D = diag(H)^-1/2, which brings the condition of the
+// free blocks within reach of float. The scaled QP is solved by
+// ActiveSetQP<M, float>, where Eigen's float packets are twice as wide as
+// the double ones (4 lanes on NEON and SSE, 8 on AVX) for the products and
+// the Cholesky factorizations. Then each refinement computes the gradient
+// H x + g in double and corrects the free variables by the Newton step for
+// it, solved in float with the factorization the active-set method ended
+// on (ActiveSetQP::FreeStep), the gradient rescaled to unit size first so
+// it doesn't drown in the float rounding; two of them recover the double
+// solution to far below the tolerances of the SQP.
+//
+// The working set lives in the float solver and carries over between solves
+// like that of ActiveSetQP.
+template <int M>
+class MixedPrecisionQP {
+public:
+  typedef Eigen::Matrix<double, M, M> Matrix;
+  typedef Eigen::Matrix<double, M, 1> Vector;
+  typedef typename ActiveSetQP<M, float>::WorkingSet WorkingSet;
+
+  explicit MixedPrecisionQP(int refinements = 2, int max_iterations = 4 * M,
+                            float tolerance = 1e-5f)
+      : refinements_(refinements), solver_(max_iterations, tolerance) {}
+
+  // As ActiveSetQP::Solve
+  int Solve(const Matrix &H, const Vector &g, const Vector &lb, const Vector &ub,
+            Vector &x) {
+    for (int i = 0; i < M; i++) {
+      d_[i] = H(i, i) > 0 ? 1 / std::sqrt(H(i, i)) : 1.0;
+    }
+    h_ = (d_.asDiagonal() * H * d_.asDiagonal()).template cast<float>();
+
+    // Solve in the scaled variables y = x / d
+    g_ = d_.cwiseProduct(g).template cast<float>();
+    lb_ = lb.cwiseQuotient(d_).template cast<float>();
+    ub_ = ub.cwiseQuotient(d_).template cast<float>();
+    y_ = x.cwiseQuotient(d_).template cast<float>();
+    int iterations = solver_.Solve(h_, g_, lb_, ub_, y_);
+    if (iterations < 0) {
+      return -1;
+    }
+    x = d_.cwiseProduct(y_.template cast<double>());
+    Snap(lb, ub, x);
+
+    // Refine on the working set of the float solve: the free variables
+    // take the Newton step for the residual gradient r = H x + g computed in
+    // double, scaled by its size, through the float factorization
+    for (int k = 0; k < refinements_; k++) {
+      residual_.noalias() = H * x;
+      residual_ += g;
+      residual_ = d_.cwiseProduct(residual_);
+      double scale = 0;
+      for (int i = 0; i < M; i++) {
+        // The gradient of a variable held at a bound is its multiplier,
+        // only the free ones have to vanish
+        if (solver_.working_set()[i] == 0) {
+          scale = std::max(scale, std::abs(residual_[i]));
+        }
+      }
+      if (scale < 1e-12) {
+        break;
+      }
+      g_ = (residual_ / scale).template cast<float>();
+      if (!solver_.FreeStep(g_, y_)) {
+        break;
+      }
+      x += scale * d_.cwiseProduct(y_.template cast<double>());
+      Snap(lb, ub, x);
+    }
+    return iterations;
+  }
+
+  WorkingSet &working_set() { return solver_.working_set(); }
+  const WorkingSet &working_set() const { return solver_.working_set(); }
+
+  static double Objective(const Matrix &H, const Vector &g, const Vector &x) {
+    return ActiveSetQP<M>::Objective(H, g, x);
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  // Put the variables of the working set exactly on their bounds, which
+  // the round trip through float misses by its rounding
+  void Snap(const Vector &lb, const Vector &ub, Vector &x) const {
+    x = x.cwiseMax(lb).cwiseMin(ub);
+    for (int i = 0; i < M; i++) {
+      if (solver_.working_set()[i] < 0) {
+        x[i] = lb[i];
+      } else if (solver_.working_set()[i] > 0) {
+        x[i] = ub[i];
+      }
+    }
+  }
+
+  int refinements_;
+  ActiveSetQP<M, float> solver_;
+
+  // Scaling and scratch
+  Vector d_;
+  Vector residual_;
+  typename ActiveSetQP<M, float>::Matrix h_;
+  typename ActiveSetQP<M, float>::Vector g_;
+  typename ActiveSetQP<M, float>::Vector lb_;
+  typename ActiveSetQP<M, float>::Vector ub_;
+  typename ActiveSetQP<M, float>::Vector y_;
+};
+
+#endif /* MIXED_PRECISION_QP_H */
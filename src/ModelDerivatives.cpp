@@ -0,0 +1,166 @@
+#include "ModelDerivatives.h"
+#include <cmath>
+#include "CostTerms.h"
+#include "KinematicModel.h"
+
+template <class H>
+ModelDerivatives<H>::ModelDerivatives(const std::vector<size_t> &jac_rows,
+                                      const std::vector<size_t> &jac_cols,
+                                      const std::vector<size_t> &hes_rows,
+                                      const std::vector<size_t> &hes_cols)
+    : jac_index_(H::n_constraints * H::n_vars, -1), hes_index_(H::n_vars * H::n_vars, -1),
+      jac_nnz_(jac_rows.size()), hes_nnz_(hes_rows.size()) {
+  for (size_t k = 0; k < jac_nnz_; k++) {
+    jac_index_[jac_rows[k] * H::n_vars + jac_cols[k]] = static_cast<int>(k);
+  }
+  for (size_t k = 0; k < hes_nnz_; k++) {
+    hes_index_[hes_rows[k] * H::n_vars + hes_cols[k]] = static_cast<int>(k);
+  }
+}
+
+template <class H>
+void ModelDerivatives<H>::AddJacobian(size_t row, size_t col, double value, double *values) {
+  const int k = jac_index_[row * H::n_vars + col];
+  if (k >= 0) {
+    values[k] += value;
+  } else if (value != 0) {
+    dropped_++;
+  }
+}
+
+template <class H>
+void ModelDerivatives<H>::AddHessian(size_t row, size_t col, double value, double *values) {
+  // Lower triangle only
+  const int k = row >= col ? hes_index_[row * H::n_vars + col] : hes_index_[col * H::n_vars + row];
+  if (k >= 0) {
+    values[k] += value;
+  } else if (value != 0) {
+    dropped_++;
+  }
+}
+
+template <class H>
+void ModelDerivatives<H>::Jacobian(const double *x, const double *coeffs, double *values) {
+  constexpr size_t N = H::N;
+  constexpr int S = int(N - 1);
+  typedef Eigen::Map<const Eigen::Array<double, S, 1> > Row;
+  const MPCCoeffs c = Eigen::Map<const MPCCoeffs>(coeffs);
+
+  for (size_t k = 0; k < jac_nnz_; k++) {
+    values[k] = 0;
+  }
+
+  // Dynamics rows: z[t+1] - F(z[t], u[t]). The variables hold each state
+  // over the horizon contiguously, so the stage terms come from whole rows.
+  StageTerms<S> terms;
+  EvaluateStageTerms(Row(x + H::x_start), Row(x + H::psi_start), Row(x + H::epsi_start), c, terms);
+  StateJacobian A;
+  ActuationJacobian B;
+  for (size_t t = 0; t < N - 1; t++) {
+    const size_t delta = H::delta_start + H::block(t);
+    const size_t a = H::a_start + H::block(t);
+    ModelJacobian(terms, t, x[H::v_start + t], x[delta], H::step(t), A, B);
+
+    for (size_t k = 0; k < 6; k++) {
+      const size_t row = H::constraint_row(k, t);
+      AddJacobian(row, k * N + t + 1, 1, values);
+      for (size_t j = 0; j < 6; j++) {
+        AddJacobian(row, j * N + t, -A(k, j), values);
+      }
+      AddJacobian(row, delta, -B(k, 0), values);
+      AddJacobian(row, a, -B(k, 1), values);
+    }
+  }
+}
+
+template <class H>
+void ModelDerivatives<H>::CostHessian(const CostWeights &weights, double obj_factor,
+                                      double *values) {
+  for (size_t k = 0; k < hes_nnz_; k++) {
+    values[k] = 0;
+  }
+
+  // Cost, see FG_eval: squared terms are diagonal, the sequential actuator
+  // differences couple neighbouring blocks and the terminal cost the last
+  // state and actuation
+  auto add = [this, obj_factor, values](size_t row, size_t col, double value) {
+    AddHessian(row, col, value * obj_factor, values);
+  };
+  MPCCost::GaussNewton<H>(weights, add);
+}
+
+template <class H>
+void ModelDerivatives<H>::Hessian(const double *x, const double *coeffs,
+                                  const CostWeights &weights, double obj_factor,
+                                  const double *lambda, double *values) {
+  constexpr size_t N = H::N;
+  constexpr int S = int(N - 1);
+  typedef Eigen::Array<double, S, 1> Row;
+  typedef Eigen::Map<const Row> RowMap;
+  Row dt;
+  for (int t = 0; t < S; t++) {
+    dt[t] = H::step(t);
+  }
+
+  CostHessian(weights, obj_factor, values);
+
+  // Dynamics rows z[t+1] - F(z[t], u[t]): minus lambda times the second
+  // derivatives of F. The values of all stages are evaluated at once on the
+  // contiguous rows of the variables and multipliers, then scattered.
+  const RowMap x0(x + H::x_start);
+  const RowMap psi0(x + H::psi_start);
+  const RowMap v0(x + H::v_start);
+  const RowMap epsi0(x + H::epsi_start);
+  const Row lx = -RowMap(lambda + H::constraint_row(0, 0));
+  const Row ly = -RowMap(lambda + H::constraint_row(1, 0));
+  const Row lpsi = -RowMap(lambda + H::constraint_row(2, 0));
+  const Row lcte = -RowMap(lambda + H::constraint_row(4, 0));
+  const Row lepsi = -RowMap(lambda + H::constraint_row(5, 0));
+
+  StageTerms<S> terms;
+  EvaluateStageTerms(x0, psi0, epsi0, Eigen::Map<const MPCCoeffs>(coeffs), terms);
+
+  // x + v cos(psi) dt and y + v sin(psi) dt
+  const Row psi_psi = -(lx * terms.cos_psi + ly * terms.sin_psi) * v0 * dt;
+  const Row v_psi = (-lx * terms.sin_psi + ly * terms.cos_psi) * dt;
+
+  // psi - v delta / Lf dt, and the same term of epsi
+  const Row delta_v = -(lpsi + lepsi) * (dt / Lf);
+
+  // f(x) - y + v sin(epsi) dt
+  const Row epsi_v = lcte * terms.cos_epsi * dt;
+  const Row epsi_epsi = -lcte * v0 * terms.sin_epsi * dt;
+
+  // psi - atan(f'(x)): d2/dx2 atan(f') = (f''' (1 + f'^2) - 2 f' f''^2) / (1 + f'^2)^2
+  const double dddf = 6 * coeffs[3];
+  const Row s = 1 + terms.df.square();
+  const Row datan = (dddf * s - 2 * terms.df * terms.ddf.square()) / s.square();
+  const Row x_x = lcte * terms.ddf - lepsi * datan;
+
+  for (size_t t = 0; t < N - 1; t++) {
+    const size_t ix = H::x_start + t;
+    const size_t ipsi = H::psi_start + t;
+    const size_t iv = H::v_start + t;
+    const size_t iepsi = H::epsi_start + t;
+    const size_t idelta = H::delta_start + H::block(t);
+
+    AddHessian(ipsi, ipsi, psi_psi[t], values);
+    AddHessian(iv, ipsi, v_psi[t], values);
+    AddHessian(idelta, iv, delta_v[t], values);
+    AddHessian(iepsi, iv, epsi_v[t], values);
+    AddHessian(iepsi, iepsi, epsi_epsi[t], values);
+    AddHessian(ix, ix, x_x[t], values);
+  }
+}
+
+template class ModelDerivatives<Horizon10>;
+template class ModelDerivatives<Horizon15>;
+template class ModelDerivatives<Horizon25>;
+template class ModelDerivatives<Horizon40>;
+template class ModelDerivatives<Horizon15Coarse>;
+template class ModelDerivatives<Horizon8RK4>;
+template class ModelDerivatives<Horizon11Graded>;
+template class ModelDerivatives<Horizon10Blocked>;
+template class ModelDerivatives<Horizon15Blocked>;
+template class ModelDerivatives<Horizon25Blocked>;
+template class ModelDerivatives<Horizon15Dynamic>;
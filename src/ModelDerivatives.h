@@ -0,0 +1,57 @@
+#ifndef MODEL_DERIVATIVES_H
+#define MODEL_DERIVATIVES_H
+
+#include <cstddef>
+#include <vector>
+#include "CostWeights.h"
+#include "Horizon.h"
+
+// Closed form constraint Jacobian and Lagrangian Hessian of FG_eval, as an
+// alternative to evaluating the recorded CppAD tape. They are those of the
+// Euler step of the kinematic model; CostHessian holds for every model.
+//
+// The values are written in the order of the sparsity patterns MPC_NLP hands
+// to Ipopt, given once to the constructor as (row, col) lists. Entries the
+// model produces outside those patterns are counted in dropped(), which must
+// stay zero (see MPC_NLP::CheckDerivatives).
+//
+// H is the horizon layout (see Horizon.h). The instantiations are listed at
+// the end of ModelDerivatives.cpp.
+template <class H>
+class ModelDerivatives {
+public:
+  // jac_rows are constraint indices (rows of fg minus one), hes_rows and
+  // hes_cols the lower triangle of the Hessian.
+  ModelDerivatives(const std::vector<size_t> &jac_rows, const std::vector<size_t> &jac_cols,
+                   const std::vector<size_t> &hes_rows, const std::vector<size_t> &hes_cols);
+
+  // Constraint Jacobian at vars x with the polynomial coeffs (4 values)
+  void Jacobian(const double *x, const double *coeffs, double *values);
+
+  // Hessian of obj_factor * cost + lambda' * constraints, the cost with
+  // weights
+  void Hessian(const double *x, const double *coeffs, const CostWeights &weights,
+               double obj_factor, const double *lambda, double *values);
+
+  // Hessian of obj_factor * cost alone. Every term of the cost is a weighted
+  // square of a residual affine in the variables, so this is the Gauss-Newton
+  // Hessian J'WJ of the residuals, and constant for given weights.
+  void CostHessian(const CostWeights &weights, double obj_factor, double *values);
+
+  // Number of nonzero values that had no entry in the patterns
+  size_t dropped() const { return dropped_; }
+
+private:
+  void AddJacobian(size_t row, size_t col, double value, double *values);
+  void AddHessian(size_t row, size_t col, double value, double *values);
+
+  // Position of (row, col) in the pattern, -1 when it isn't in it. Dense
+  // tables, built once.
+  std::vector<int> jac_index_;
+  std::vector<int> hes_index_;
+  size_t jac_nnz_;
+  size_t hes_nnz_;
+  size_t dropped_ = 0;
+};
+
+#endif /* MODEL_DERIVATIVES_H */
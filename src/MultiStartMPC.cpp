@@ -0,0 +1,117 @@
+#include "MultiStartMPC.h"
+#include "KinematicModel.h"
+
+MultiStartMPC::MultiStartMPC(std::vector<std::unique_ptr<MPCBase> > candidates,
+                             const std::vector<StartSeed> &seeds)
+    : candidates_(std::move(candidates)), seeds_(seeds), results_(candidates_.size()) {
+  for (size_t k = 1; k < candidates_.size(); k++) {
+    workers_.push_back(std::thread(&MultiStartMPC::Work, this, k));
+  }
+}
+
+MultiStartMPC::~MultiStartMPC() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+}
+
+void MultiStartMPC::Work(size_t k) {
+  size_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_.wait(lock, [this, seen] { return stop_ || tick_ != seen; });
+      if (stop_) {
+        return;
+      }
+      seen = tick_;
+    }
+    SolveCandidate(k);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--running_ == 0) {
+        done_.notify_one();
+      }
+    }
+  }
+}
+
+void MultiStartMPC::SolveCandidate(size_t k) {
+  MPCBase &mpc = *candidates_[k];
+  mpc.prev_a = prev_a;
+  mpc.max_solve_time = max_solve_time;
+  mpc.cost_schedule = cost_schedule;
+  if (k > 0) {
+    mpc.Seed(seeds_[k - 1].delta, seeds_[k - 1].a);
+  }
+  results_[k] = mpc.Solve(*state_, *coeffs_);
+}
+
+MPCSolution MultiStartMPC::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_ = &state;
+    coeffs_ = &coeffs;
+    running_ = workers_.size();
+    tick_++;
+  }
+  start_.notify_all();
+
+  SolveCandidate(0);
+
+  // The workers stop at the same deadline as the first candidate
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return running_ == 0; });
+  }
+
+  best_ = 0;
+  for (size_t k = 1; k < candidates_.size(); k++) {
+    const MPCBase &mpc = *candidates_[k];
+    if (mpc.status() == SolveStatus::kFailed) {
+      continue;
+    }
+    if (candidates_[best_]->status() == SolveStatus::kFailed ||
+        mpc.cost() < candidates_[best_]->cost()) {
+      best_ = k;
+    }
+  }
+  if (best_ > 0) {
+    seed_wins_++;
+  }
+  status_ = candidates_[best_]->status();
+  cost_ = candidates_[best_]->cost();
+  return results_[best_];
+}
+
+void MultiStartMPC::Reset() {
+  for (std::unique_ptr<MPCBase> &mpc : candidates_) {
+    mpc->Reset();
+  }
+}
+
+std::unique_ptr<MultiStartMPC> MakeMultiStartMPC(size_t n, size_t count,
+                                                 Derivatives derivatives) {
+  const StartSeed kSeeds[] = {
+      {0, 0}, {max_delta, 0}, {-max_delta, 0}, {0, max_a}, {0, -max_a}};
+  const size_t n_seeds = sizeof(kSeeds) / sizeof(kSeeds[0]);
+
+  std::vector<std::unique_ptr<MPCBase> > candidates;
+  std::vector<StartSeed> seeds;
+  for (size_t k = 0; k < count && k <= n_seeds; k++) {
+    std::unique_ptr<MPCBase> mpc = MakeMPC(n, derivatives);
+    if (!mpc) {
+      return std::unique_ptr<MultiStartMPC>();
+    }
+    candidates.push_back(std::move(mpc));
+    if (k > 0) {
+      seeds.push_back(kSeeds[k - 1]);
+    }
+  }
+  return std::unique_ptr<MultiStartMPC>(new MultiStartMPC(std::move(candidates), seeds));
+}
@@ -0,0 +1,126 @@
+#ifndef MULTI_START_MPC_H
+#define MULTI_START_MPC_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "MPC.h"
+
+// Constant actuations a candidate of MultiStartMPC starts from
+struct StartSeed {
+  double delta;
+  double a;
+};
+
+// MPC solving the same problem from several starting points at once and
+// keeping the plan with the lowest cost.
+//
+// Every candidate is an MPC of its own, with its own tape and solver, so they
+// share nothing while they solve. The first candidate is solved on the
+// calling thread and warm started from its last plan like a single MPC. Each
+// other one has a worker thread, made once, and is seeded with its StartSeed
+// every tick. All of them get the same deadline, so the tick takes no longer
+// than a single solve, given a core per candidate.
+//
+// The winner is the lowest cost among the candidates that didn't fail; it
+// provides the result, the status and the plan. When all of them fail the
+// first one does.
+//
+// Separate Ipopt instances can solve concurrently only if the linear solver
+// Ipopt is built with is thread-safe, which MUMPS builds often aren't.
+class MultiStartMPC : public MPCBase {
+public:
+  // seeds[k] starts candidates[k + 1]
+  MultiStartMPC(std::vector<std::unique_ptr<MPCBase> > candidates,
+                const std::vector<StartSeed> &seeds);
+
+  // Stops and joins the workers
+  ~MultiStartMPC() override;
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  void Reset() override;
+
+  // Every candidate controls its own effort; the first one, the warm start,
+  // reports it
+  void ControlEffort(const EffortPolicy &policy) override {
+    for (const std::unique_ptr<MPCBase> &candidate : candidates_) {
+      candidate->ControlEffort(policy);
+    }
+  }
+  const EffortController *effort() const override { return candidates_[0]->effort(); }
+
+  void SoftenConstraints(double penalty) override {
+    for (const std::unique_ptr<MPCBase> &candidate : candidates_) {
+      candidate->SoftenConstraints(penalty);
+    }
+  }
+  // Of the first candidate
+  size_t slack_activations() const override { return candidates_[0]->slack_activations(); }
+
+  void SampleReference(bool sampled) override {
+    for (const std::unique_ptr<MPCBase> &candidate : candidates_) {
+      candidate->SampleReference(sampled);
+    }
+  }
+
+  void SetReferenceOrder(size_t order) override {
+    for (const std::unique_ptr<MPCBase> &candidate : candidates_) {
+      candidate->SetReferenceOrder(order);
+    }
+  }
+
+  size_t horizon_length() const override { return candidates_[best_]->horizon_length(); }
+  double timestep() const override { return candidates_[best_]->timestep(); }
+  double stage_time(size_t t) const override { return candidates_[best_]->stage_time(t); }
+
+  MPCState planned_state(size_t t) const override {
+    return candidates_[best_]->planned_state(t);
+  }
+
+  void planned_actuations(size_t t, double &delta, double &a) const override {
+    candidates_[best_]->planned_actuations(t, delta, a);
+  }
+
+  // Candidate of the last Solve, and the ticks a seeded one won so far
+  size_t best() const { return best_; }
+  size_t seed_wins() const { return seed_wins_; }
+
+private:
+  // Loop of the worker solving candidate k
+  void Work(size_t k);
+
+  // Solve candidate k on this tick's problem
+  void SolveCandidate(size_t k);
+
+  std::vector<std::unique_ptr<MPCBase> > candidates_;
+  std::vector<StartSeed> seeds_;
+  std::vector<MPCSolution> results_;
+  std::vector<std::thread> workers_;
+
+  // The problem of this tick, set before the workers are woken
+  const MPCState *state_ = nullptr;
+  const MPCCoeffs *coeffs_ = nullptr;
+
+  // Ticks handed to the workers, the workers still solving, and whether they
+  // are to stop
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  size_t tick_ = 0;
+  size_t running_ = 0;
+  bool stop_ = false;
+
+  size_t best_ = 0;
+  size_t seed_wins_ = 0;
+};
+
+// The Ipopt MPC over n timesteps (see MakeMPC) with up to count candidates:
+// the warm start, then straight ahead, full steering either way, full
+// throttle and full brake. Null if n isn't compiled in.
+std::unique_ptr<MultiStartMPC> MakeMultiStartMPC(size_t n, size_t count,
+                                                 Derivatives derivatives = Derivatives::kTape);
+
+#endif /* MULTI_START_MPC_H */
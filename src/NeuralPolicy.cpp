@@ -0,0 +1,377 @@
+#include "NeuralPolicy.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include "KinematicModel.h"
+
+constexpr int NeuralPolicy::n_inputs;
+constexpr int NeuralPolicy::n_features;
+constexpr int NeuralPolicy::n_hidden;
+
+// First line of a policy file, with the format version
+static const char *const kPolicyHeader = "neural_policy";
+static const int kPolicyVersion = 1;
+
+bool SavePolicySamples(const std::string &path, const PolicySamples &samples) {
+  std::ofstream out(path.c_str(), std::ios::app);
+  out.precision(9);
+  for (const PolicySample &sample : samples) {
+    for (int i = 0; i < sample.state.size(); i++) {
+      out << sample.state[i] << " ";
+    }
+    for (int i = 0; i < sample.coeffs.size(); i++) {
+      out << sample.coeffs[i] << " ";
+    }
+    out << sample.delta << " " << sample.a << "\n";
+  }
+  return static_cast<bool>(out);
+}
+
+bool LoadPolicySamples(const std::string &path, PolicySamples &samples) {
+  std::ifstream in(path.c_str());
+  if (!in) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    std::istringstream numbers(line);
+    PolicySample sample;
+    for (int i = 0; i < sample.state.size(); i++) {
+      numbers >> sample.state[i];
+    }
+    for (int i = 0; i < sample.coeffs.size(); i++) {
+      numbers >> sample.coeffs[i];
+    }
+    numbers >> sample.delta >> sample.a;
+    if (!numbers) {
+      return false;
+    }
+    samples.push_back(sample);
+  }
+  return true;
+}
+
+namespace {
+
+// A matrix of the network in training, with the moments of Adam
+struct AdamParameter {
+  Eigen::MatrixXd value;
+  Eigen::MatrixXd m;
+  Eigen::MatrixXd v;
+
+  // Normal with standard deviation scale, zero for a scale of zero
+  void Init(Eigen::Index rows, Eigen::Index cols, double scale, std::mt19937_64 &random) {
+    value = Eigen::MatrixXd::Zero(rows, cols);
+    if (scale > 0) {
+      std::normal_distribution<double> normal(0, scale);
+      value = Eigen::MatrixXd::NullaryExpr(rows, cols, [&]() { return normal(random); });
+    }
+    m = Eigen::MatrixXd::Zero(rows, cols);
+    v = Eigen::MatrixXd::Zero(rows, cols);
+  }
+
+  void Step(const Eigen::MatrixXd &gradient, double learning_rate, size_t t) {
+    const double beta1 = 0.9;
+    const double beta2 = 0.999;
+    m = beta1 * m + (1 - beta1) * gradient;
+    v = beta2 * v + (1 - beta2) * gradient.cwiseAbs2();
+    const double step = learning_rate * std::sqrt(1 - std::pow(beta2, double(t))) /
+                        (1 - std::pow(beta1, double(t)));
+    value.array() -= step * m.array() / (v.array().sqrt() + 1e-8);
+  }
+};
+
+}  // namespace
+
+NeuralPolicy::NeuralPolicy() {
+  mean_.setZero();
+  inverse_scale_.setOnes();
+  min_.setZero();
+  max_.setZero();
+  w1_.setZero();
+  b1_.setZero();
+  w2_.setZero();
+  b2_.setZero();
+  w3_.setZero();
+  b3_.setZero();
+}
+
+NeuralPolicy::Features NeuralPolicy::Reduce(const MPCState &state, const MPCCoeffs &coeffs) {
+  Features input;
+  input << float(state[3]), float(state[4]), float(state[5]),
+      float(2 * coeffs[2] + 6 * coeffs[3] * state[0]), float(6 * coeffs[3]), 0, 0, 0;
+  return input;
+}
+
+void NeuralPolicy::Train(const PolicySamples &samples, const PolicySamples &validation,
+                         const PolicyTraining &training, double &delta_rms, double &a_rms) {
+  // Inputs and targets, a sample a column, the steering scaled to the
+  // range of the throttle
+  const Eigen::Index n = static_cast<Eigen::Index>(samples.size());
+  Eigen::MatrixXd x(n_features, n);
+  Eigen::MatrixXd y(2, n);
+  for (Eigen::Index i = 0; i < n; i++) {
+    x.col(i) = Reduce(samples[i].state, samples[i].coeffs).cast<double>();
+    y(0, i) = samples[i].delta / max_delta;
+    y(1, i) = samples[i].a / max_a;
+  }
+  const Eigen::VectorXd mean = x.rowwise().mean();
+  const Eigen::VectorXd deviation =
+      (x.colwise() - mean).array().square().rowwise().mean().sqrt().matrix();
+  const Eigen::VectorXd inverse_scale =
+      deviation.unaryExpr([](double d) { return d > 1e-9 ? 1 / d : 1.0; });
+  mean_ = mean.cast<float>();
+  inverse_scale_ = inverse_scale.cast<float>();
+  min_ = x.rowwise().minCoeff().cast<float>();
+  max_ = x.rowwise().maxCoeff().cast<float>();
+  x = ((x.colwise() - mean).array().colwise() * inverse_scale.array()).matrix();
+
+  std::mt19937_64 random(training.seed);
+  AdamParameter w1, b1, w2, b2, w3, b3;
+  w1.Init(n_hidden, n_features, std::sqrt(1.0 / n_inputs), random);
+  b1.Init(n_hidden, 1, 0, random);
+  w2.Init(n_hidden, n_hidden, std::sqrt(1.0 / n_hidden), random);
+  b2.Init(n_hidden, 1, 0, random);
+  w3.Init(2, n_hidden, std::sqrt(1.0 / n_hidden), random);
+  b3.Init(2, 1, 0, random);
+  // The padding stays out of the network
+  w1.value.rightCols(n_features - n_inputs).setZero();
+
+  std::vector<Eigen::Index> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  const Eigen::Index batch = std::max<Eigen::Index>(1, training.batch);
+  Eigen::MatrixXd xb, yb, a1, a2, error, d2, d1;
+  size_t t = 0;
+  for (size_t epoch = 0; epoch < training.epochs; epoch++) {
+    std::shuffle(order.begin(), order.end(), random);
+    for (Eigen::Index start = 0; start < n; start += batch) {
+      const Eigen::Index count = std::min(batch, n - start);
+      xb.resize(n_features, count);
+      yb.resize(2, count);
+      for (Eigen::Index k = 0; k < count; k++) {
+        xb.col(k) = x.col(order[start + k]);
+        yb.col(k) = y.col(order[start + k]);
+      }
+      // Forward, then the gradients of the mean square error back
+      a1 = ((w1.value * xb).colwise() + b1.value.col(0)).array().tanh().matrix();
+      a2 = ((w2.value * a1).colwise() + b2.value.col(0)).array().tanh().matrix();
+      error = ((w3.value * a2).colwise() + b3.value.col(0) - yb) / double(count);
+      d2 = ((w3.value.transpose() * error).array() * (1 - a2.array().square())).matrix();
+      d1 = ((w2.value.transpose() * d2).array() * (1 - a1.array().square())).matrix();
+      t++;
+      w3.Step(error * a2.transpose(), training.learning_rate, t);
+      b3.Step(error.rowwise().sum(), training.learning_rate, t);
+      w2.Step(d2 * a1.transpose(), training.learning_rate, t);
+      b2.Step(d2.rowwise().sum(), training.learning_rate, t);
+      Eigen::MatrixXd g1 = d1 * xb.transpose();
+      g1.rightCols(n_features - n_inputs).setZero();
+      w1.Step(g1, training.learning_rate, t);
+      b1.Step(d1.rowwise().sum(), training.learning_rate, t);
+    }
+  }
+  w1_ = w1.value.cast<float>();
+  b1_ = b1.value.cast<float>();
+  w2_ = w2.value.cast<float>();
+  b2_ = b2.value.cast<float>();
+  w3_ = w3.value.cast<float>();
+  b3_ = b3.value.cast<float>();
+
+  // The errors of the network as it runs, in single precision, the range
+  // not in the way
+  double delta_squares = 0;
+  double a_squares = 0;
+  const Features min = min_;
+  const Features max = max_;
+  min_.setConstant(-std::numeric_limits<float>::infinity());
+  max_.setConstant(std::numeric_limits<float>::infinity());
+  for (const PolicySample &sample : validation) {
+    double delta;
+    double a;
+    Evaluate(sample.state, sample.coeffs, delta, a);
+    delta_squares += (delta - sample.delta) * (delta - sample.delta);
+    a_squares += (a - sample.a) * (a - sample.a);
+  }
+  min_ = min;
+  max_ = max;
+  const double count = std::max<double>(1, validation.size());
+  delta_rms = std::sqrt(delta_squares / count);
+  a_rms = std::sqrt(a_squares / count);
+}
+
+bool NeuralPolicy::Evaluate(const MPCState &state, const MPCCoeffs &coeffs, double &delta,
+                            double &a) const {
+  const Features input = Reduce(state, coeffs);
+  if ((input.array() < min_.array()).any() || (input.array() > max_.array()).any()) {
+    return false;
+  }
+  const Features x = (input - mean_).cwiseProduct(inverse_scale_);
+  Eigen::Matrix<float, n_hidden, 1> h1;
+  h1.noalias() = w1_ * x;
+  h1 = (h1 + b1_).array().tanh().matrix();
+  Eigen::Matrix<float, n_hidden, 1> h2;
+  h2.noalias() = w2_ * h1;
+  h2 = (h2 + b2_).array().tanh().matrix();
+  Eigen::Matrix<float, 2, 1> out;
+  out.noalias() = w3_ * h2;
+  out += b3_;
+  delta = std::max(-max_delta, std::min(max_delta, out[0] * max_delta));
+  a = std::max(-max_a, std::min(max_a, out[1] * max_a));
+  return true;
+}
+
+namespace {
+
+template <class M>
+void WriteMatrix(std::ostream &out, const M &m) {
+  for (Eigen::Index i = 0; i < m.rows(); i++) {
+    for (Eigen::Index j = 0; j < m.cols(); j++) {
+      out << m(i, j) << (j + 1 < m.cols() ? " " : "\n");
+    }
+  }
+}
+
+template <class M>
+bool ReadMatrix(std::istream &in, M &m) {
+  for (Eigen::Index i = 0; i < m.rows(); i++) {
+    for (Eigen::Index j = 0; j < m.cols(); j++) {
+      in >> m(i, j);
+    }
+  }
+  return static_cast<bool>(in) && m.allFinite();
+}
+
+}  // namespace
+
+bool NeuralPolicy::Save(const std::string &path) const {
+  std::ofstream out(path.c_str());
+  out << kPolicyHeader << " " << kPolicyVersion << "\n";
+  out << n_features << " " << n_hidden << "\n";
+  out.precision(9);
+  WriteMatrix(out, mean_.transpose());
+  WriteMatrix(out, inverse_scale_.transpose());
+  WriteMatrix(out, min_.transpose());
+  WriteMatrix(out, max_.transpose());
+  WriteMatrix(out, w1_);
+  WriteMatrix(out, b1_.transpose());
+  WriteMatrix(out, w2_);
+  WriteMatrix(out, b2_.transpose());
+  WriteMatrix(out, w3_);
+  WriteMatrix(out, b3_.transpose());
+  return static_cast<bool>(out);
+}
+
+std::unique_ptr<NeuralPolicy> NeuralPolicy::Load(const std::string &path) {
+  std::ifstream in(path.c_str());
+  std::string header;
+  int version = 0;
+  int features = 0;
+  int hidden = 0;
+  in >> header >> version >> features >> hidden;
+  if (!in || header != kPolicyHeader || version != kPolicyVersion || features != n_features ||
+      hidden != n_hidden) {
+    return std::unique_ptr<NeuralPolicy>();
+  }
+  std::unique_ptr<NeuralPolicy> policy(new NeuralPolicy());
+  Eigen::Matrix<float, 1, n_features> mean, inverse_scale, min, max;
+  Eigen::Matrix<float, 1, n_hidden> b1, b2;
+  Eigen::Matrix<float, 1, 2> b3;
+  if (!ReadMatrix(in, mean) || !ReadMatrix(in, inverse_scale) || !ReadMatrix(in, min) ||
+      !ReadMatrix(in, max) || !ReadMatrix(in, policy->w1_) || !ReadMatrix(in, b1) ||
+      !ReadMatrix(in, policy->w2_) || !ReadMatrix(in, b2) || !ReadMatrix(in, policy->w3_) ||
+      !ReadMatrix(in, b3)) {
+    return std::unique_ptr<NeuralPolicy>();
+  }
+  policy->mean_ = mean.transpose();
+  policy->inverse_scale_ = inverse_scale.transpose();
+  policy->min_ = min.transpose();
+  policy->max_ = max.transpose();
+  policy->b1_ = b1.transpose();
+  policy->b2_ = b2.transpose();
+  policy->b3_ = b3.transpose();
+  return policy;
+}
+
+NeuralMPC::NeuralMPC(std::unique_ptr<MPCBase> mpc, std::shared_ptr<const NeuralPolicy> policy,
+                     PolicyMode mode, const PolicyLimits &limits)
+    : mpc_(std::move(mpc)), policy_(std::move(policy)), mode_(mode), limits_(limits),
+      plan_z_(mpc_->horizon_length()), plan_delta_(mpc_->horizon_length() - 1),
+      plan_a_(mpc_->horizon_length() - 1) {}
+
+bool NeuralMPC::Rollout(const MPCState &state, const MPCCoeffs &coeffs) {
+  const size_t n = mpc_->horizon_length();
+  plan_z_[0] = state;
+  for (size_t t = 0; t + 1 < n; t++) {
+    if (!policy_->Evaluate(plan_z_[t], coeffs, plan_delta_[t], plan_a_[t])) {
+      return false;
+    }
+    plan_z_[t + 1] = ModelStep(plan_z_[t], plan_delta_[t], plan_a_[t], coeffs,
+                               mpc_->stage_time(t + 1) - mpc_->stage_time(t));
+    if (std::fabs(plan_z_[t + 1][4]) > limits_.max_cte ||
+        std::fabs(plan_z_[t + 1][5]) > limits_.max_epsi) {
+      return false;
+    }
+  }
+  return true;
+}
+
+MPCSolution NeuralMPC::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
+  if (mode_ == PolicyMode::kChecked) {
+    if (Rollout(state, coeffs)) {
+      used_policy_ = true;
+      inner_stale_ = true;
+      policy_ticks_++;
+      status_ = SolveStatus::kSolved;
+      return PlannedSolution();
+    }
+    fallbacks_++;
+  }
+
+  if (inner_stale_) {
+    mpc_->Reset();
+    inner_stale_ = false;
+  }
+  double delta;
+  double a;
+  if (mode_ == PolicyMode::kRefined) {
+    if (policy_->Evaluate(state, coeffs, delta, a)) {
+      mpc_->Seed(delta, a);
+      policy_ticks_++;
+    } else {
+      fallbacks_++;
+    }
+  }
+  mpc_->prev_a = prev_a;
+  mpc_->max_solve_time = max_solve_time;
+  mpc_->cost_schedule = cost_schedule;
+  const MPCSolution result = mpc_->Solve(state, coeffs);
+  status_ = mpc_->status();
+  cost_ = mpc_->cost();
+  used_policy_ = false;
+  return result;
+}
+
+void NeuralMPC::Prepare() {
+  if (!used_policy_) {
+    mpc_->Prepare();
+  }
+}
+
+MPCState NeuralMPC::planned_state(size_t t) const {
+  return used_policy_ ? plan_z_[t] : mpc_->planned_state(t);
+}
+
+void NeuralMPC::planned_actuations(size_t t, double &delta, double &a) const {
+  if (used_policy_) {
+    delta = plan_delta_[t];
+    a = plan_a_[t];
+  } else {
+    mpc_->planned_actuations(t, delta, a);
+  }
+}
@@ -0,0 +1,176 @@
+#ifndef NEURAL_POLICY_H
+#define NEURAL_POLICY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/StdVector"
+#include "MPC.h"
+
+// One solve of the full MPC for the policy to learn: the problem handed to
+// MPCBase::Solve and the first actuations of its plan
+struct PolicySample {
+  MPCState state;
+  MPCCoeffs coeffs;
+  double delta;
+  double a;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+typedef std::vector<PolicySample, Eigen::aligned_allocator<PolicySample> > PolicySamples;
+
+// samples as text, one a line, appended to path; and the samples of such a
+// file appended to samples, false if it can't be read or isn't one
+bool SavePolicySamples(const std::string &path, const PolicySamples &samples);
+bool LoadPolicySamples(const std::string &path, PolicySamples &samples);
+
+// How NeuralPolicy::Train fits the network
+struct PolicyTraining {
+  size_t epochs = 200;
+  size_t batch = 128;
+  double learning_rate = 1e-3;
+  uint64_t seed = 1;
+};
+
+// A distilled policy: a small multilayer perceptron mapping the problem of a
+// tick to the first actuations the full MPC solves for it, trained offline
+// on the solves of mpc_sim (see train_policy.cpp).
+//
+// The inputs are n_inputs numbers of the state and polynomial reduced like
+// those of ExplicitMPC (see Reduce): v, cte and epsi, the curvature of the
+// reference at the car and its rate of change along x, each scaled to unit
+// variance over the training set. They leave out the pose, so the policy
+// also holds at the later stages of a plan. Two layers of n_hidden tanh
+// units follow, then the steering and the throttle. The network is
+// evaluated in single precision with every size fixed at compile time, the
+// inputs padded with zeros to n_features, n_features and n_hidden multiples
+// of the widest packet of floats, so each layer is a few vectorized
+// products with no loop the compiler has to guess at, and no heap, no
+// external runtime: a microsecond or so.
+//
+// The policy is only trusted where it has seen data: every input of a tick
+// must lie within the range of the training set (see Evaluate). Weights
+// apart from those it was trained with aren't inputs, so a policy is for the
+// cost weights of its samples.
+class NeuralPolicy {
+public:
+  static constexpr int n_inputs = 5;
+  static constexpr int n_features = 8;
+  static constexpr int n_hidden = 32;
+  typedef Eigen::Matrix<float, n_features, 1> Features;
+
+  NeuralPolicy();
+
+  // The inputs of a state and polynomial handed to MPCBase::Solve, unscaled
+  // and padded
+  static Features Reduce(const MPCState &state, const MPCCoeffs &coeffs);
+
+  // Fit the network to samples, the inputs scaled and the range taken from
+  // them. Return the root mean square errors of the steering and the
+  // throttle over validation after the last epoch.
+  void Train(const PolicySamples &samples, const PolicySamples &validation,
+             const PolicyTraining &training, double &delta_rms, double &a_rms);
+
+  // The actuations of the network for state and coeffs. False outside the
+  // range of the training set, where the network has no say.
+  bool Evaluate(const MPCState &state, const MPCCoeffs &coeffs, double &delta, double &a) const;
+
+  bool Save(const std::string &path) const;
+  // Null if path can't be read or isn't a policy
+  static std::unique_ptr<NeuralPolicy> Load(const std::string &path);
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  // The scaling and range of the inputs
+  Features mean_;
+  Features inverse_scale_;
+  Features min_;
+  Features max_;
+  Eigen::Matrix<float, n_hidden, n_features> w1_;
+  Eigen::Matrix<float, n_hidden, 1> b1_;
+  Eigen::Matrix<float, n_hidden, n_hidden> w2_;
+  Eigen::Matrix<float, n_hidden, 1> b2_;
+  Eigen::Matrix<float, 2, n_hidden> w3_;
+  Eigen::Matrix<float, 2, 1> b3_;
+};
+
+// How NeuralMPC uses its policy
+enum class PolicyMode {
+  // The policy, checked over the horizon; the MPC when the check fails
+  kChecked,
+  // The MPC every tick, started from the actuations of the policy
+  kRefined
+};
+
+// Bounds on the plan of a policy tick: the cross-track (m) and orientation
+// (rad) errors of every stage of the model driven by the policy over the
+// horizon
+struct PolicyLimits {
+  double max_cte = 1.5;
+  double max_epsi = 0.3;
+};
+
+// MPC with a NeuralPolicy fast path over any MPCBase, the MPC its safety
+// check or refiner.
+//
+// kChecked drives the model by the policy over the horizon of the inner
+// MPC, the policy evaluated at every stage, and takes its first
+// actuations if every stage is within the range of the policy and the
+// limits; that closed loop is the plan. Otherwise the inner MPC solves the
+// tick, a fallback. kRefined solves every tick, started from the policy's
+// actuations held over the horizon (see MPCBase::Seed), which only the
+// Ipopt MPC takes.
+class NeuralMPC : public MPCBase {
+public:
+  NeuralMPC(std::unique_ptr<MPCBase> mpc, std::shared_ptr<const NeuralPolicy> policy,
+            PolicyMode mode, const PolicyLimits &limits = PolicyLimits());
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  // The inner MPC only prepares from a plan of its own
+  void Prepare() override;
+
+  void Reset() override { mpc_->Reset(); }
+
+  size_t horizon_length() const override { return mpc_->horizon_length(); }
+  double timestep() const override { return mpc_->timestep(); }
+  double stage_time(size_t t) const override { return mpc_->stage_time(t); }
+  const EffortController *effort() const override { return mpc_->effort(); }
+  size_t slack_activations() const override { return mpc_->slack_activations(); }
+
+  MPCState planned_state(size_t t) const override;
+  void planned_actuations(size_t t, double &delta, double &a) const override;
+
+  // Whether the last Solve took the policy, the ticks that did and those
+  // that fell back to the MPC so far
+  bool used_policy() const { return used_policy_; }
+  size_t policy_ticks() const { return policy_ticks_; }
+  size_t fallbacks() const { return fallbacks_; }
+
+private:
+  // Drive the model by the policy over the horizon into the plan, false if
+  // it leaves the range of the policy or the limits
+  bool Rollout(const MPCState &state, const MPCCoeffs &coeffs);
+
+  std::unique_ptr<MPCBase> mpc_;
+  std::shared_ptr<const NeuralPolicy> policy_;
+  PolicyMode mode_;
+  PolicyLimits limits_;
+
+  bool used_policy_ = false;
+  size_t policy_ticks_ = 0;
+  size_t fallbacks_ = 0;
+  // The inner MPC's plan predates the policy ticks since it last solved
+  bool inner_stale_ = false;
+  // Plan of the last policy tick
+  std::vector<MPCState, Eigen::aligned_allocator<MPCState> > plan_z_;
+  std::vector<double> plan_delta_;
+  std::vector<double> plan_a_;
+};
+
+#endif /* NEURAL_POLICY_H */
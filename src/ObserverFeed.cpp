@@ -0,0 +1,288 @@
+#include "ObserverFeed.h"
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include "Log.h"
+#include "Metrics.h"
+#include "RealTime.h"
+
+namespace {
+
+// How long the thread sleeps in poll between drains of the rings
+const int kDrainMilliseconds = 10;
+
+size_t RoundUpToPowerOfTwo(size_t n) {
+  size_t power = 1;
+  while (power < n) {
+    power <<= 1;
+  }
+  return power;
+}
+
+void AppendNumber(double value, std::string &out) {
+  char buffer[32];
+  const int n = std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+  out.append(buffer, static_cast<size_t>(n));
+}
+
+void AppendField(const char *name, double value, std::string &out) {
+  out += "\"";
+  out += name;
+  out += "\":";
+  AppendNumber(value, out);
+  out += ",";
+}
+
+}  // namespace
+
+ObserverRing::ObserverRing(size_t capacity)
+    : mask_(RoundUpToPowerOfTwo(capacity < 2 ? 2 : capacity) - 1), slots_(new Slot[mask_ + 1]) {
+  // Faulted in now, not on the first ticks
+  for (size_t i = 0; i <= mask_; i++) {
+    std::memset(&slots_[i].tick, 0, sizeof(ObservedTick));
+  }
+}
+
+ObservedTick &ObserverRing::Begin() {
+  const uint64_t sequence = head_.load(std::memory_order_relaxed);
+  Slot &slot = slots_[sequence & mask_];
+  slot.mark.store(2 * sequence + 1, std::memory_order_relaxed);
+  // The odd mark before any byte of the tick
+  std::atomic_thread_fence(std::memory_order_release);
+  return slot.tick;
+}
+
+void ObserverRing::Publish() {
+  const uint64_t sequence = head_.load(std::memory_order_relaxed);
+  slots_[sequence & mask_].mark.store(2 * sequence + 2, std::memory_order_release);
+  head_.store(sequence + 1, std::memory_order_release);
+}
+
+bool ObserverRing::Read(uint64_t sequence, ObservedTick &tick, uint64_t &next) const {
+  const uint64_t head = head_.load(std::memory_order_acquire);
+  if (sequence >= head) {
+    next = sequence;
+    return false;
+  }
+  const uint64_t oldest = head > mask_ + 1 ? head - (mask_ + 1) : 0;
+  if (sequence < oldest) {
+    next = oldest;
+    return false;
+  }
+  const Slot &slot = slots_[sequence & mask_];
+  const uint64_t mark = slot.mark.load(std::memory_order_acquire);
+  std::memcpy(&tick, &slot.tick, sizeof(ObservedTick));
+  // The copy before the mark is read again
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (mark != 2 * sequence + 2 || slot.mark.load(std::memory_order_relaxed) != mark) {
+    // Lapped while it was read
+    next = sequence + 1;
+    return false;
+  }
+  next = sequence + 1;
+  return true;
+}
+
+ObserverFeed::ObserverFeed(std::vector<const ObserverRing *> rings)
+    : rings_(std::move(rings)), read_(rings_.size(), 0) {}
+
+ObserverFeed::~ObserverFeed() {
+  if (thread_.joinable()) {
+    stop_.store(true, std::memory_order_relaxed);
+    const char wake = 0;
+    if (write(wake_[1], &wake, 1) < 0) {
+      // The thread still sees stop_ at its next poll timeout
+    }
+    thread_.join();
+  }
+  for (Subscriber &subscriber : subscribers_) {
+    close(subscriber.fd);
+  }
+  for (int fd : {listener_, wake_[0], wake_[1]}) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+bool ObserverFeed::Start(uint16_t port) {
+  listener_ = socket(AF_INET6, SOCK_STREAM, 0);
+  if (listener_ < 0) {
+    return false;
+  }
+  const int on = 1;
+  const int off = 0;
+  setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  // IPv4 too
+  setsockopt(listener_, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+  sockaddr_in6 address = {};
+  address.sin6_family = AF_INET6;
+  address.sin6_addr = in6addr_any;
+  address.sin6_port = htons(port);
+  if (bind(listener_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+      listen(listener_, 16) < 0 || pipe(wake_) < 0) {
+    return false;
+  }
+  fcntl(listener_, F_SETFL, fcntl(listener_, F_GETFL) | O_NONBLOCK);
+  // The ticks from now on
+  for (size_t k = 0; k < rings_.size(); k++) {
+    read_[k] = rings_[k]->head();
+  }
+  thread_ = std::thread([this] { Run(); });
+  return true;
+}
+
+void ObserverFeed::Run() {
+  if (!SetIdlePriority()) {
+    Log(LogLevel::kWarning, "Observers: not at the idle priority, on the normal one");
+  }
+  std::vector<pollfd> polled;
+  while (!stop_.load(std::memory_order_relaxed)) {
+    polled.clear();
+    polled.push_back({wake_[0], POLLIN, 0});
+    polled.push_back({listener_, POLLIN, 0});
+    for (const Subscriber &subscriber : subscribers_) {
+      polled.push_back(
+          {subscriber.fd, static_cast<short>(POLLIN | (subscriber.out.empty() ? 0 : POLLOUT)), 0});
+    }
+    poll(polled.data(), polled.size(), kDrainMilliseconds);
+    if (polled[1].revents & POLLIN) {
+      Accept();
+    }
+    Drain();
+    // Those that hung up, or whose sockets fail, are let go
+    size_t kept = 0;
+    for (size_t i = 0; i < subscribers_.size(); i++) {
+      const short events = i + 2 < polled.size() ? polled[i + 2].revents : 0;
+      bool alive = !(events & (POLLERR | POLLNVAL));
+      if (alive && (events & (POLLIN | POLLHUP))) {
+        char ignored[4096];
+        const ssize_t n = recv(subscribers_[i].fd, ignored, sizeof(ignored), 0);
+        alive = n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+      }
+      alive = alive && Flush(subscribers_[i]);
+      if (alive) {
+        if (kept != i) {
+          subscribers_[kept] = std::move(subscribers_[i]);
+        }
+        kept++;
+      } else {
+        close(subscribers_[i].fd);
+        Metrics().observer_subscribers.Add(-1);
+        Log(LogLevel::kInfo, "Observer disconnected, {} left", kept + subscribers_.size() - i - 1);
+      }
+    }
+    subscribers_.resize(kept);
+  }
+}
+
+void ObserverFeed::Accept() {
+  for (;;) {
+    const int fd = accept(listener_, nullptr, nullptr);
+    if (fd < 0) {
+      return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    const int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    Subscriber subscriber;
+    subscriber.fd = fd;
+    subscribers_.push_back(std::move(subscriber));
+    Metrics().observer_subscribers.Add(1);
+    Log(LogLevel::kInfo, "Observer connected, {} in all", subscribers_.size());
+  }
+}
+
+void ObserverFeed::Drain() {
+  ObservedTick tick;
+  for (size_t k = 0; k < rings_.size(); k++) {
+    const ObserverRing &ring = *rings_[k];
+    uint64_t &sequence = read_[k];
+    for (;;) {
+      uint64_t next;
+      const bool read = ring.Read(sequence, tick, next);
+      if (next == sequence) {
+        break;
+      }
+      if (!read || next > sequence + 1) {
+        Metrics().observer_overwritten.Add(next - sequence);
+      }
+      sequence = next;
+      if (!read) {
+        continue;
+      }
+      Metrics().observer_ticks.Add();
+      if (subscribers_.empty()) {
+        continue;
+      }
+      line_.clear();
+      AppendObservedTick(tick, line_);
+      for (Subscriber &subscriber : subscribers_) {
+        if (subscriber.out.size() + line_.size() > kMaxBacklog) {
+          Metrics().observer_lines_dropped.Add();
+        } else {
+          subscriber.out += line_;
+        }
+      }
+    }
+  }
+}
+
+bool ObserverFeed::Flush(Subscriber &subscriber) {
+  size_t sent = 0;
+  while (sent < subscriber.out.size()) {
+    const ssize_t n =
+        send(subscriber.fd, subscriber.out.data() + sent, subscriber.out.size() - sent,
+             MSG_NOSIGNAL);
+    if (n > 0) {
+      sent += static_cast<size_t>(n);
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+      break;
+    }
+    return false;
+  }
+  subscriber.out.erase(0, sent);
+  return true;
+}
+
+void AppendObservedTick(const ObservedTick &tick, std::string &out) {
+  out += "{";
+  AppendField("session", static_cast<double>(tick.session), out);
+  AppendField("arrival_ns", static_cast<double>(tick.arrival_ns), out);
+  AppendField("x", tick.x, out);
+  AppendField("y", tick.y, out);
+  AppendField("psi", tick.psi, out);
+  AppendField("speed", tick.speed, out);
+  AppendField("steering_angle", tick.steering_angle, out);
+  AppendField("throttle", tick.throttle, out);
+  out += "\"state\":[";
+  for (size_t i = 0; i < 6; i++) {
+    AppendNumber(tick.state[i], out);
+    out += i + 1 < 6 ? "," : "],";
+  }
+  AppendField("status", tick.status, out);
+  AppendField("iterations", tick.iterations, out);
+  AppendField("cost", tick.cost, out);
+  AppendField("solve_seconds", tick.solve_seconds, out);
+  AppendField("steer_value", tick.steer_value, out);
+  AppendField("throttle_value", tick.throttle_value, out);
+  out += "\"plan\":[";
+  const size_t points = tick.plan_points < kObservedPlanPoints ? tick.plan_points
+                                                               : kObservedPlanPoints;
+  for (size_t i = 0; i < points; i++) {
+    out += i > 0 ? ",[" : "[";
+    AppendNumber(tick.plan_x[i], out);
+    out += ",";
+    AppendNumber(tick.plan_y[i], out);
+    out += "]";
+  }
+  out += "]}\n";
+}
@@ -0,0 +1,138 @@
+#ifndef OBSERVER_FEED_H
+#define OBSERVER_FEED_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// The points of a plan an observer sees, the first of the horizon
+const size_t kObservedPlanPoints = 32;
+
+// One tick of a session as the observers see it: the telemetry in the map
+// frame, the state handed to Solve, how the solve went, the command and the
+// plan in the vehicle frame
+struct ObservedTick {
+  uint64_t session;
+  // On the steady clock, in ns, like the flight records
+  uint64_t arrival_ns;
+  double x;
+  double y;
+  double psi;
+  double speed;
+  double steering_angle;
+  double throttle;
+  double state[6];
+  // Its SolveStatus, iterations, cost and seconds
+  int32_t status;
+  int32_t iterations;
+  double cost;
+  double solve_seconds;
+  double steer_value;
+  double throttle_value;
+  uint32_t plan_points;
+  uint32_t reserved;
+  double plan_x[kObservedPlanPoints];
+  double plan_y[kObservedPlanPoints];
+};
+
+static_assert(std::is_trivially_copyable<ObservedTick>::value, "The ticks are copied as bytes");
+
+// A broadcast ring of the ticks of one solver thread, its only producer,
+// for the observer thread to read behind it.
+//
+// The producer never waits: each slot is a seqlock, marked odd while the
+// tick is written in place and even with its sequence once published, and
+// a producer that laps a slow reader overwrites what it hadn't read. The
+// reader copies a slot and checks the mark after, so a tick overwritten
+// under it is dropped rather than read torn.
+class ObserverRing {
+ public:
+  // capacity rounded up to a power of two
+  explicit ObserverRing(size_t capacity);
+
+  // The slot of the next tick, to fill in place and Publish, on the
+  // producer's thread only
+  ObservedTick &Begin();
+  void Publish();
+
+  // The tick of sequence into tick, true if it was published and not since
+  // overwritten. next is where to read on: sequence + 1, the oldest tick
+  // still in the ring if sequence was overwritten, or sequence itself if
+  // it isn't published yet.
+  bool Read(uint64_t sequence, ObservedTick &tick, uint64_t &next) const;
+
+  // The sequence of the next tick to publish
+  uint64_t head() const { return head_.load(std::memory_order_acquire); }
+
+ private:
+  struct Slot {
+    std::atomic<uint64_t> mark{0};
+    ObservedTick tick;
+  };
+
+  const size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic<uint64_t> head_{0};
+};
+
+// The side channel of the observers: a TCP port that streams the ticks of
+// every solver thread to whoever connects, as a line of JSON a tick.
+//
+// The solver threads only write their rings (see ObserverRing); a thread
+// of its own, at the lowest priority of the host (SCHED_IDLE on Linux),
+// reads them, formats the lines and sends them, so a dashboard costs the
+// control path a copy of a few hundred bytes a tick whatever it does. The
+// sockets are nonblocking: a subscriber that reads slower than the ticks
+// come has its lines dropped once kMaxBacklog bytes wait for it, and the
+// thread dropping behind the solvers loses the ticks overwritten in the
+// rings; both are counted in /metrics. What subscribers send is read and
+// ignored.
+class ObserverFeed {
+ public:
+  // Bytes queued for a subscriber, beyond which its lines are dropped
+  static const size_t kMaxBacklog = 1 << 20;
+
+  // The feed of rings, which outlive it
+  explicit ObserverFeed(std::vector<const ObserverRing *> rings);
+  ~ObserverFeed();
+  ObserverFeed(const ObserverFeed &) = delete;
+  ObserverFeed &operator=(const ObserverFeed &) = delete;
+
+  // Listen on port and start the thread, false if the port can't be bound
+  bool Start(uint16_t port);
+
+ private:
+  struct Subscriber {
+    int fd;
+    // The lines waiting for its socket to take them
+    std::string out;
+  };
+
+  void Run();
+  // The ticks published since the last drain as lines for the subscribers
+  void Drain();
+  void Accept();
+  // Send what is queued for subscriber, false if it hung up
+  bool Flush(Subscriber &subscriber);
+
+  std::vector<const ObserverRing *> rings_;
+  // The next sequence to read of each ring
+  std::vector<uint64_t> read_;
+  int listener_ = -1;
+  // A pipe the destructor writes to wake the thread from poll
+  int wake_[2] = {-1, -1};
+  std::vector<Subscriber> subscribers_;
+  std::string line_;
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+// The JSON line of tick, appended to out
+void AppendObservedTick(const ObservedTick &tick, std::string &out);
+
+#endif /* OBSERVER_FEED_H */
@@ -0,0 +1,149 @@
+#include "PerfCounters.h"
+#include <cstdio>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Without the instrumentation the counters are never opened (see
+// PerfCounters.h)
+#if MPC_INSTRUMENTATION >= MPC_INSTRUMENTATION_COUNTERS
+
+namespace {
+
+// The group of the calling thread, its leader counting the cycles, -1
+// until it is opened
+thread_local int group = -1;
+
+#ifdef __linux__
+const uint64_t kEvents[] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+const size_t kEventCount = sizeof(kEvents) / sizeof(kEvents[0]);
+
+// An event of the calling thread on any cpu, in user space, into leader's
+// group or the leader itself with -1
+int OpenEvent(uint64_t config, int leader) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = leader == -1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+}
+#endif
+
+}  // namespace
+
+bool OpenPerfCounters() {
+#ifdef __linux__
+  if (group != -1) {
+    return true;
+  }
+  int fds[kEventCount];
+  for (size_t k = 0; k < kEventCount; k++) {
+    fds[k] = OpenEvent(kEvents[k], k == 0 ? -1 : fds[0]);
+    if (fds[k] == -1) {
+      while (k-- > 0) {
+        close(fds[k]);
+      }
+      return false;
+    }
+  }
+  // The members stay open with the leader, which is all that is read
+  ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  group = fds[0];
+  return true;
+#else
+  return false;
+#endif
+}
+
+PerfCounts ReadPerfCounters() {
+  PerfCounts counts;
+#ifdef __linux__
+  if (group == -1) {
+    return counts;
+  }
+  // The number of events, then their values in the order they were opened
+  uint64_t values[1 + kEventCount];
+  if (read(group, values, sizeof(values)) != static_cast<ssize_t>(sizeof(values))) {
+    return counts;
+  }
+  counts.cycles = values[1];
+  counts.instructions = values[2];
+  counts.cache_misses = values[3];
+  counts.branch_misses = values[4];
+#endif
+  return counts;
+}
+#endif
+
+void StageEvents::Add(TickStage stage, const PerfCounts &counts) {
+  Totals &totals = totals_[static_cast<size_t>(stage)];
+  totals.ticks.fetch_add(1, std::memory_order_relaxed);
+  totals.cycles.fetch_add(counts.cycles, std::memory_order_relaxed);
+  totals.instructions.fetch_add(counts.instructions, std::memory_order_relaxed);
+  totals.cache_misses.fetch_add(counts.cache_misses, std::memory_order_relaxed);
+  totals.branch_misses.fetch_add(counts.branch_misses, std::memory_order_relaxed);
+}
+
+void StageEvents::Render(uint64_t session, std::string &out) const {
+  const std::string prefix =
+      "mpc_session_stage_events_total{session=\"" + std::to_string(session) + "\",stage=\"";
+  for (size_t k = 0; k < kTickStages; k++) {
+    const Totals &totals = totals_[k];
+    if (totals.ticks.load(std::memory_order_relaxed) == 0) {
+      continue;
+    }
+    const struct {
+      const char *name;
+      const std::atomic<uint64_t> &count;
+    } events[] = {{"cycles", totals.cycles},
+                  {"instructions", totals.instructions},
+                  {"cache_misses", totals.cache_misses},
+                  {"branch_misses", totals.branch_misses}};
+    for (const auto &event : events) {
+      out.append(prefix).append(TickStageName(static_cast<TickStage>(k)));
+      out.append("\",event=\"").append(event.name).append("\"} ");
+      out.append(std::to_string(event.count.load(std::memory_order_relaxed))).append("\n");
+    }
+  }
+}
+
+std::string StageEvents::Summary() const {
+  std::string out;
+  char text[128];
+  for (size_t k = 0; k < kTickStages; k++) {
+    const Totals &totals = totals_[k];
+    const uint64_t ticks = totals.ticks.load(std::memory_order_relaxed);
+    if (ticks == 0) {
+      continue;
+    }
+    const double cycles = static_cast<double>(totals.cycles.load(std::memory_order_relaxed));
+    const double instructions =
+        static_cast<double>(totals.instructions.load(std::memory_order_relaxed));
+    std::snprintf(text, sizeof(text), "%s%s %.2f/%.0f/%.0f", out.empty() ? "" : ", ",
+                  TickStageName(static_cast<TickStage>(k)),
+                  cycles > 0 ? instructions / cycles : 0.0,
+                  static_cast<double>(totals.cache_misses.load(std::memory_order_relaxed)) / ticks,
+                  static_cast<double>(totals.branch_misses.load(std::memory_order_relaxed)) /
+                      ticks);
+    out.append(text);
+  }
+  return out;
+}
+
+void RenderEventHeader(std::string &out) {
+  out.append("# HELP mpc_session_stage_events_total Hardware events of each stage of the ticks "
+             "of a session, in user space\n");
+  out.append("# TYPE mpc_session_stage_events_total counter\n");
+}
@@ -0,0 +1,127 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "Instrumentation.h"
+#include "Metrics.h"
+
+// The hardware counters of the CPU around the stages of the ticks and the
+// phases of the solves, for profiling on a host of our own which of the
+// layouts and vectorizations cut the cycles or the cache misses, where the
+// latency histograms only show the time. A thread opens its counters with
+// OpenPerfCounters, a group of perf_event_open(2) read with one read(2),
+// counting the events of that thread alone in user space; the kernel lets
+// an unprivileged process do so with kernel.perf_event_paranoid at 2 or
+// below. On a thread that didn't open them, and outside Linux, every read
+// is a thread-local test that returns zeros; with the instrumentation off
+// (see Instrumentation.h) they can't be opened and a read is no code.
+
+// The events of the calling thread over a stretch of it
+struct PerfCounts {
+  uint64_t cycles = 0;
+  uint64_t instructions = 0;
+  uint64_t cache_misses = 0;
+  uint64_t branch_misses = 0;
+
+  PerfCounts &operator+=(const PerfCounts &other) {
+    cycles += other.cycles;
+    instructions += other.instructions;
+    cache_misses += other.cache_misses;
+    branch_misses += other.branch_misses;
+    return *this;
+  }
+  PerfCounts &operator-=(const PerfCounts &other) {
+    cycles -= other.cycles;
+    instructions -= other.instructions;
+    cache_misses -= other.cache_misses;
+    branch_misses -= other.branch_misses;
+    return *this;
+  }
+};
+
+inline PerfCounts operator-(PerfCounts a, const PerfCounts &b) { return a -= b; }
+
+#if MPC_INSTRUMENTATION >= MPC_INSTRUMENTATION_COUNTERS
+// Count the events of the calling thread from now on; false if the kernel
+// refused, e.g. for its perf_event_paranoid or a virtual machine without a
+// PMU, or outside Linux
+bool OpenPerfCounters();
+// The events of the calling thread since it opened its counters, zeros if
+// it didn't
+PerfCounts ReadPerfCounters();
+#else
+inline bool OpenPerfCounters() { return false; }
+inline PerfCounts ReadPerfCounters() { return PerfCounts(); }
+#endif
+
+#if MPC_INSTRUMENTATION >= MPC_INSTRUMENTATION_COUNTERS
+
+// Adds the seconds of its scope to seconds, and its hardware events to
+// events
+class ScopedPhase {
+ public:
+  ScopedPhase(double &seconds, PerfCounts &events)
+      : seconds_(seconds),
+        events_(events),
+        start_(std::chrono::steady_clock::now()),
+        start_events_(ReadPerfCounters()) {}
+  ~ScopedPhase() {
+    seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    events_ += ReadPerfCounters() - start_events_;
+  }
+  ScopedPhase(const ScopedPhase &) = delete;
+  ScopedPhase &operator=(const ScopedPhase &) = delete;
+
+ private:
+  double &seconds_;
+  PerfCounts &events_;
+  const std::chrono::steady_clock::time_point start_;
+  const PerfCounts start_events_;
+};
+
+#define MPC_SCOPED_PHASE_CONCAT_(a, b) a##b
+#define MPC_SCOPED_PHASE_CONCAT(a, b) MPC_SCOPED_PHASE_CONCAT_(a, b)
+// The seconds and the events of the enclosing scope added to seconds and
+// events, e.g. to those of a phase of SolvePhases
+#define MPC_SCOPED_PHASE(seconds, events) \
+  ScopedPhase MPC_SCOPED_PHASE_CONCAT(scoped_phase_, __LINE__)(seconds, events)
+
+#else
+
+#define MPC_SCOPED_PHASE(seconds, events) ((void)0)
+
+#endif
+
+// The events of every stage of the ticks of one session, added by its
+// solver thread and rendered from any other, like StageHistograms
+class StageEvents {
+ public:
+  void Add(TickStage stage, const PerfCounts &counts);
+
+  // Append the counters of the stages that counted anything, labelled with
+  // the session, to out, under the header of RenderEventHeader
+  void Render(uint64_t session, std::string &out) const;
+  // The instructions a cycle and the cache and branch misses a tick of
+  // every stage so far, for the log
+  std::string Summary() const;
+
+ private:
+  struct Totals {
+    std::atomic<uint64_t> ticks{0};
+    std::atomic<uint64_t> cycles{0};
+    std::atomic<uint64_t> instructions{0};
+    std::atomic<uint64_t> cache_misses{0};
+    std::atomic<uint64_t> branch_misses{0};
+  };
+  std::array<Totals, kTickStages> totals_;
+};
+
+// The header of the counters of StageEvents::Render
+void RenderEventHeader(std::string &out);
+
+#endif /* PERF_COUNTERS_H */
@@ -0,0 +1,256 @@
+#ifndef POLYNOMIAL_H
+#define POLYNOMIAL_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/QR"
+#include "SimdKernels.h"
+
+// Evaluate a polynomial, coefficients from the constant one up, by Horner's
+// scheme.
+template <class Derived>
+inline double polyeval(const Eigen::MatrixBase<Derived> &coeffs, double x) {
+  double result = 0.0;
+  for (Eigen::Index i = coeffs.size() - 1; i >= 0; i--) {
+    result = result * x + coeffs[i];
+  }
+  return result;
+}
+
+// The coefficients of the polynomials evaluated over arrays, at most
+const size_t kMaxPolyCoeffs = 16;
+
+// Evaluate a polynomial and its derivative at the n points xs into values
+// and slopes (null to skip them), by Horner's scheme on the whole arrays at
+// once, so that every step runs over SIMD lanes of points, as wide as the
+// host has (see SimdKernels.h).
+template <class Derived>
+inline void polyeval(const Eigen::MatrixBase<Derived> &coeffs, const double *xs, size_t n,
+                     double *values, double *slopes = nullptr) {
+  assert(static_cast<size_t>(coeffs.size()) <= kMaxPolyCoeffs);
+  double c[kMaxPolyCoeffs];
+  for (Eigen::Index i = 0; i < coeffs.size(); i++) {
+    c[i] = coeffs[i];
+  }
+  PolyevalPoints(c, static_cast<size_t>(coeffs.size()), xs, n, values, slopes);
+}
+
+// Fit a polynomial of order to (xvals, yvals), its coefficients from the
+// constant one up into coeffs, resized to order + 1 only if it isn't. The
+// points are taken by reference, a Map of the telemetry's buffers as much
+// as a vector, so only the QR allocates; polyfit<Order> below allocates
+// nothing.
+// Adapted from
+// https://github.com/JuliaMath/Polynomials.jl/blob/master/src/Polynomials.jl#L676-L716
+inline void polyfit(const Eigen::Ref<const Eigen::VectorXd> &xvals,
+                    const Eigen::Ref<const Eigen::VectorXd> &yvals, int order,
+                    Eigen::VectorXd &coeffs) {
+  assert(xvals.size() == yvals.size());
+  assert(order >= 1 && order <= xvals.size() - 1);
+  Eigen::MatrixXd A(xvals.size(), order + 1);
+
+  for (int i = 0; i < xvals.size(); i++) {
+    A(i, 0) = 1.0;
+  }
+
+  for (int j = 0; j < xvals.size(); j++) {
+    for (int i = 0; i < order; i++) {
+      A(j, i + 1) = A(j, i) * xvals(j);
+    }
+  }
+
+  coeffs.resize(order + 1);
+  coeffs = A.householderQr().solve(yvals);
+}
+
+// The same, returning the coefficients
+inline Eigen::VectorXd polyfit(const Eigen::Ref<const Eigen::VectorXd> &xvals,
+                               const Eigen::Ref<const Eigen::VectorXd> &yvals, int order) {
+  Eigen::VectorXd coeffs(order + 1);
+  polyfit(xvals, yvals, order, coeffs);
+  return coeffs;
+}
+
+// The coefficients in powers of x of the polynomial with coeffs in powers
+// of t = (x - center) / scale: the scaling undone, then the centering by
+// synthetic division.
+template <class Derived>
+inline void FromNormalizedAbscissa(double center, double scale,
+                                   Eigen::MatrixBase<Derived> &coeffs) {
+  const Eigen::Index order = coeffs.size() - 1;
+  double power = 1;
+  for (Eigen::Index i = 1; i <= order; i++) {
+    power *= scale;
+    coeffs(i) /= power;
+  }
+  for (Eigen::Index k = 0; k < order; k++) {
+    for (Eigen::Index i = order - 1; i >= k; i--) {
+      coeffs(i) -= center * coeffs(i + 1);
+    }
+  }
+}
+
+// Normal equations of the least squares fit of a polynomial of order Order
+// to points added one at a time, in the abscissa t = (x - center) / scale:
+// the power sums of t and those weighted by y. With center and scale about
+// the middle and the half width of the abscissae, the matrix stays well
+// conditioned for points tens of meters ahead; they needn't be exact.
+template <int Order>
+class PolyfitNormalEquations {
+public:
+  typedef Eigen::Matrix<double, Order + 1, 1> Coefficients;
+
+  PolyfitNormalEquations(double center, double scale) : center_(center), scale_(scale) {}
+
+  void Add(double x, double y) {
+    const double t = (x - center_) / scale_;
+    double power = 1;
+    for (int k = 0; k <= 2 * Order; k++) {
+      sums_[k] += power;
+      if (k <= Order) {
+        rhs_(k) += power * y;
+      }
+      power *= t;
+    }
+  }
+
+  // The coefficients in powers of x, from the constant one up, by Cholesky
+  // on the stack; needs more than Order distinct abscissae
+  Coefficients Solve() const {
+    Eigen::Matrix<double, Order + 1, Order + 1> normal;
+    for (int r = 0; r <= Order; r++) {
+      for (int c = 0; c <= Order; c++) {
+        normal(r, c) = sums_[r + c];
+      }
+    }
+    Coefficients result = normal.llt().solve(rhs_);
+    FromNormalizedAbscissa(center_, scale_, result);
+    return result;
+  }
+
+private:
+  double center_;
+  double scale_;
+  // Sums of t^k for k up to 2 Order, and of y t^k
+  double sums_[2 * Order + 1] = {};
+  Coefficients rhs_ = Coefficients::Zero();
+};
+
+// Fit a polynomial of order Order to the n > Order points (xs, ys), like
+// polyfit but without a heap allocation or a QR factorization: by the
+// normal equations (see PolyfitNormalEquations), with the abscissae
+// centered and scaled to [-1, 1]. The fit agrees with polyfit to about
+// 1e-10 on the waypoints.
+template <int Order>
+inline Eigen::Matrix<double, Order + 1, 1> polyfit(const double *xs, const double *ys, int n) {
+  assert(n > Order);
+
+  double lo = xs[0];
+  double hi = xs[0];
+  for (int j = 1; j < n; j++) {
+    lo = std::min(lo, xs[j]);
+    hi = std::max(hi, xs[j]);
+  }
+  PolyfitNormalEquations<Order> normal(0.5 * (lo + hi), hi > lo ? 0.5 * (hi - lo) : 1.0);
+  for (int j = 0; j < n; j++) {
+    normal.Add(xs[j], ys[j]);
+  }
+  return normal.Solve();
+}
+
+// A polynomial of order Order as a Chebyshev series c_0 T_0(t) + ... +
+// c_Order T_Order(t) in t = (x - center) / scale, computed in Scalar.
+//
+// Fit maps the abscissae onto t in [-1, 1], where the Chebyshev
+// polynomials are nearly orthogonal over points spread along the interval:
+// the normal matrix of a cubic over 6 waypoints has a condition number of
+// about 2, where that of the powers of t has about 50, so the fit and
+// Evaluate lose nothing to it in float, over twice the SIMD lanes of
+// double; their error, about 2e-5 m, is that of the coordinates in float. The series converts to the coefficients in powers of x that
+// FG_eval takes in double, where the shift of the center needs it.
+template <int Order, class Scalar = double>
+struct ChebyshevSeries {
+  typedef Eigen::Matrix<Scalar, Order + 1, 1> Coefficients;
+
+  Coefficients c;
+  double center;
+  double scale;
+
+  // Least squares fit to the n > Order points (xs, ys)
+  static ChebyshevSeries Fit(const Scalar *xs, const Scalar *ys, int n) {
+    assert(n > Order);
+    ChebyshevSeries series;
+    Scalar lo = xs[0];
+    Scalar hi = xs[0];
+    for (int j = 1; j < n; j++) {
+      lo = std::min(lo, xs[j]);
+      hi = std::max(hi, xs[j]);
+    }
+    series.center = 0.5 * (static_cast<double>(lo) + hi);
+    series.scale = hi > lo ? 0.5 * (static_cast<double>(hi) - lo) : 1.0;
+
+    const Scalar center = static_cast<Scalar>(series.center);
+    const Scalar inverse_scale = static_cast<Scalar>(1 / series.scale);
+    Eigen::Matrix<Scalar, Order + 1, Order + 1> normal =
+        Eigen::Matrix<Scalar, Order + 1, Order + 1>::Zero();
+    Coefficients rhs = Coefficients::Zero();
+    for (int j = 0; j < n; j++) {
+      const Scalar t = (xs[j] - center) * inverse_scale;
+      Coefficients T;
+      T(0) = 1;
+      if (Order > 0) {
+        T(1) = t;
+      }
+      for (int k = 2; k <= Order; k++) {
+        T(k) = 2 * t * T(k - 1) - T(k - 2);
+      }
+      normal.template selfadjointView<Eigen::Lower>().rankUpdate(T);
+      rhs += ys[j] * T;
+    }
+    series.c = normal.template selfadjointView<Eigen::Lower>().llt().solve(rhs);
+    return series;
+  }
+
+  // Values at the n points xs into values, by Clenshaw's recurrence on the
+  // whole arrays at once
+  void Evaluate(const Scalar *xs, size_t n, Scalar *values) const {
+    typedef Eigen::Array<Scalar, Eigen::Dynamic, 1> Array;
+    const Eigen::Map<const Array> x(xs, n);
+    Eigen::Map<Array> value(values, n);
+    const Array t = (x - static_cast<Scalar>(center)) * static_cast<Scalar>(1 / scale);
+    // b_k = c_k + 2 t b_{k+1} - b_{k+2}, the value c_0 + t b_1 - b_2
+    Array b1 = Array::Zero(n);
+    Array b2 = Array::Zero(n);
+    for (int k = Order; k >= 1; k--) {
+      const Array b = c(k) + 2 * t * b1 - b2;
+      b2 = b1;
+      b1 = b;
+    }
+    value = c(0) + t * b1 - b2;
+  }
+
+  // The coefficients in powers of x, from the constant one up
+  Eigen::Matrix<double, Order + 1, 1> Monomial() const {
+    // Powers of t of T_k by T_{k+1} = 2 t T_k - T_{k-1}
+    Eigen::Matrix<double, Order + 1, Order + 1> T =
+        Eigen::Matrix<double, Order + 1, Order + 1>::Zero();
+    T(0, 0) = 1;
+    if (Order > 0) {
+      T(1, 1) = 1;
+    }
+    for (int k = 2; k <= Order; k++) {
+      T(0, k) = -T(0, k - 2);
+      for (int i = 1; i <= k; i++) {
+        T(i, k) = 2 * T(i - 1, k - 1) - T(i, k - 2);
+      }
+    }
+    Eigen::Matrix<double, Order + 1, 1> coeffs = T * c.template cast<double>();
+    FromNormalizedAbscissa(center, scale, coeffs);
+    return coeffs;
+  }
+};
+
+#endif /* POLYNOMIAL_H */
@@ -0,0 +1,152 @@
+#include "ProblemCapture.h"
+#include <unistd.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <utility>
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+void WriteArray(std::ostream &out, const char *name, const double *values, size_t n) {
+  out << " \"" << name << "\": [";
+  for (size_t k = 0; k < n; k++) {
+    out << (k > 0 ? ", " : "") << values[k];
+  }
+  out << "],\n";
+}
+
+}  // namespace
+
+bool WriteProblem(const std::string &path, const CapturedProblem &problem) {
+  double weights[CostWeights::size];
+  problem.weights.Store(weights);
+  // By hand rather than through json::dump, which keeps 15 digits: every
+  // double with the 17 that read back to its bits, for the solve to start
+  // from the same numbers
+  std::ofstream out(path);
+  out << std::setprecision(17) << std::boolalpha << "{\n"
+      << " \"backend\": \"" << problem.backend << "\",\n"
+      << " \"horizon\": " << problem.horizon << ",\n"
+      << " \"move_blocking\": " << problem.move_blocking << ",\n"
+      << " \"sampled\": " << problem.sampled << ",\n"
+      << " \"linearization_table\": " << problem.linearization_table << ",\n"
+      << " \"soft_penalty\": " << problem.soft_penalty << ",\n";
+  WriteArray(out, "state", problem.state.data(), 6);
+  WriteArray(out, "coeffs", problem.coeffs.data(), 4);
+  out << " \"prev_a\": " << problem.prev_a << ",\n"
+      << " \"max_solve_time\": " << problem.max_solve_time << ",\n";
+  WriteArray(out, "weights", weights, CostWeights::size);
+  WriteArray(out, "start", problem.start.data(), problem.start.size());
+  out << " \"session\": " << problem.session << ",\n"
+      << " \"arrival_ns\": " << problem.arrival_ns << ",\n"
+      << " \"seconds\": " << problem.seconds << ",\n"
+      << " \"iterations\": " << problem.iterations << ",\n"
+      << " \"status\": " << problem.status << ",\n"
+      << " \"restorations\": " << problem.restorations << ",\n"
+      << " \"cost\": " << problem.cost << "\n"
+      << "}\n";
+  return static_cast<bool>(out);
+}
+
+bool ReadProblem(const std::string &path, CapturedProblem &problem, std::string &error) {
+  std::ifstream in(path);
+  if (!in) {
+    error = "could not open " + path;
+    return false;
+  }
+  try {
+    const json file = json::parse(in);
+    problem.backend = file.at("backend").get<std::string>();
+    problem.horizon = file.at("horizon").get<size_t>();
+    problem.move_blocking = file.at("move_blocking").get<bool>();
+    problem.sampled = file.at("sampled").get<bool>();
+    problem.linearization_table = file.at("linearization_table").get<bool>();
+    problem.soft_penalty = file.at("soft_penalty").get<double>();
+    const std::vector<double> state = file.at("state").get<std::vector<double>>();
+    const std::vector<double> coeffs = file.at("coeffs").get<std::vector<double>>();
+    const std::vector<double> weights = file.at("weights").get<std::vector<double>>();
+    if (state.size() != 6 || coeffs.size() != 4 || weights.size() != CostWeights::size) {
+      error = path + ": the state, coeffs or weights have the wrong size";
+      return false;
+    }
+    for (size_t k = 0; k < 6; k++) {
+      problem.state[k] = state[k];
+    }
+    for (size_t k = 0; k < 4; k++) {
+      problem.coeffs[k] = coeffs[k];
+    }
+    problem.weights.Load(weights.data());
+    problem.prev_a = file.at("prev_a").get<double>();
+    problem.max_solve_time = file.at("max_solve_time").get<double>();
+    problem.start = file.at("start").get<std::vector<double>>();
+    problem.session = file.at("session").get<uint64_t>();
+    problem.arrival_ns = file.at("arrival_ns").get<uint64_t>();
+    problem.seconds = file.at("seconds").get<double>();
+    problem.iterations = file.at("iterations").get<int>();
+    problem.status = file.at("status").get<int>();
+    problem.restorations = file.at("restorations").get<int>();
+    problem.cost = file.at("cost").get<double>();
+  } catch (const std::exception &e) {
+    error = path + ": " + e.what();
+    return false;
+  }
+  return true;
+}
+
+ProblemCapture::ProblemCapture(const std::string &directory, double threshold, size_t keep)
+    : directory_(directory), threshold_(threshold), keep_(keep) {
+  ok_ = access(directory_.c_str(), W_OK) == 0;
+  if (ok_) {
+    writer_ = std::thread(&ProblemCapture::Write, this);
+  }
+}
+
+ProblemCapture::~ProblemCapture() {
+  if (writer_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+  }
+}
+
+bool ProblemCapture::Capture(CapturedProblem &problem) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!ok_ || has_pending_ || written_ >= keep_) {
+      return false;
+    }
+    std::swap(pending_, problem);
+    has_pending_ = true;
+    written_++;
+  }
+  wake_.notify_one();
+  return true;
+}
+
+void ProblemCapture::Write() {
+  CapturedProblem writing;
+  size_t n = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    wake_.wait(lock, [this] { return has_pending_ || stop_; });
+    // What is waiting is written before stopping
+    if (!has_pending_) {
+      return;
+    }
+    std::swap(writing, pending_);
+    has_pending_ = false;
+    lock.unlock();
+    const std::string path = directory_ + "/problem-" + std::to_string(writing.session) + "-" +
+                             std::to_string(n++) + ".json";
+    if (!WriteProblem(path, writing)) {
+      std::cerr << "Could not write the problem to " << path << std::endl;
+    }
+    lock.lock();
+  }
+}
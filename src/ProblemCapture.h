@@ -0,0 +1,98 @@
+#ifndef PROBLEM_CAPTURE_H
+#define PROBLEM_CAPTURE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CostWeights.h"
+#include "KinematicModel.h"
+
+// The problems of the solves slower than a threshold, each written to a
+// file of its own for mpc_replay problem=<file> to solve again offline,
+// under a profiler or a debugger, where the flight recorder only has the
+// telemetry and replaying up to the slow tick isn't the same solve: the
+// solver made, the state and the reference handed to Solve, the prev_a,
+// budget and weights it solved with, and what it started from (see
+// MPCBase::SaveStart), with how the solve went. The bounds are those of
+// the backend and horizon, which are compiled in.
+//
+// Only the Ipopt MPC and the SQP save their start, so a problem of another
+// backend is solved again from cold; nor are the wrappers of main.cpp
+// (event, speculative, table) or the tables of the track (tracktable,
+// frenet) captured, whose solves aren't a plain Solve of the polynomial.
+
+// One Solve as it was called and as it went
+struct CapturedProblem {
+  // The solver, as on the command line, and the options that change its
+  // problem (see main.cpp): the penalty of soft, 0 for hard constraints
+  std::string backend;
+  size_t horizon = 15;
+  bool move_blocking = false;
+  bool sampled = false;
+  bool linearization_table = false;
+  double soft_penalty = 0;
+  // The arguments of Solve and the settings it read
+  MPCState state;
+  MPCCoeffs coeffs;
+  double prev_a = 0;
+  double max_solve_time = 0;
+  CostWeights weights;
+  std::vector<double> start;
+  // Where it came from: the session, and the arrival of its telemetry in
+  // ns of the steady clock, like the flight records
+  uint64_t session = 0;
+  uint64_t arrival_ns = 0;
+  // How it went
+  double seconds = 0;
+  int iterations = 0;
+  int status = 0;
+  int restorations = 0;
+  double cost = 0;
+};
+
+// Write problem to path as JSON, false if it can't be written
+bool WriteProblem(const std::string &path, const CapturedProblem &problem);
+// The problem of a file of WriteProblem, false with the reason in error
+bool ReadProblem(const std::string &path, CapturedProblem &problem, std::string &error);
+
+// Writes the problems it is handed into directory, as problem-<session>-
+// <n>.json, on a thread of its own so that the solver threads never wait
+// on the disk, up to keep of them: a slow host would otherwise fill the
+// disk with its every tick. One problem waits while another is written,
+// and any more handed over meanwhile are dropped.
+class ProblemCapture {
+ public:
+  // Capture the solves of more than threshold seconds; false from ok() if
+  // directory can't be written
+  ProblemCapture(const std::string &directory, double threshold, size_t keep);
+  ~ProblemCapture();
+
+  bool ok() const { return ok_; }
+  double threshold() const { return threshold_; }
+
+  // Hand problem over to be written, from any thread; false if it is
+  // dropped, with one waiting already or keep written. problem is left
+  // with the buffers of one handed over before, to fill again.
+  bool Capture(CapturedProblem &problem);
+
+ private:
+  void Write();
+
+  const std::string directory_;
+  const double threshold_;
+  const size_t keep_;
+  bool ok_ = false;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  CapturedProblem pending_;
+  bool has_pending_ = false;
+  bool stop_ = false;
+  size_t written_ = 0;
+  std::thread writer_;
+};
+
+#endif /* PROBLEM_CAPTURE_H */
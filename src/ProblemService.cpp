@@ -0,0 +1,159 @@
+#include "ProblemService.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include "Polynomial.h"
+#include "Telemetry.h"
+#include "VehicleFrame.h"
+
+namespace {
+
+// The waypoints of the problem at data, and the bytes of it whole, or 0 if
+// it doesn't fit in the n bytes at data or has a bad count of waypoints
+size_t ProblemBytes(const char *data, size_t n, uint32_t &waypoints) {
+  if (n < sizeof(ProblemRecord)) {
+    return 0;
+  }
+  std::memcpy(&waypoints, data + offsetof(ProblemRecord, waypoints), sizeof(waypoints));
+  if ((waypoints > 0 && waypoints < 4) || waypoints > Telemetry::kMaxWaypoints) {
+    return 0;
+  }
+  const size_t bytes = sizeof(ProblemRecord) + 2 * waypoints * sizeof(double);
+  return bytes <= n ? bytes : 0;
+}
+
+void AppendBytes(const void *data, size_t n, std::string &out) {
+  out.append(static_cast<const char *>(data), n);
+}
+
+}  // namespace
+
+size_t CountProblems(const MessageView &batch) {
+  size_t problems = 0;
+  for (size_t at = 0; at < batch.size();) {
+    uint32_t waypoints = 0;
+    const size_t bytes = ProblemBytes(batch.data + at, batch.size() - at, waypoints);
+    if (bytes == 0) {
+      return 0;
+    }
+    at += bytes;
+    problems++;
+  }
+  return problems;
+}
+
+bool ReadProblems(const MessageView &batch, ServiceBatch &problems) {
+  problems.clear();
+  double xs[Telemetry::kMaxWaypoints];
+  double ys[Telemetry::kMaxWaypoints];
+  for (size_t at = 0; at < batch.size();) {
+    uint32_t waypoints = 0;
+    const size_t bytes = ProblemBytes(batch.data + at, batch.size() - at, waypoints);
+    if (bytes == 0) {
+      return false;
+    }
+    // Copied out, the records of a websocket message aren't aligned
+    ProblemRecord record;
+    std::memcpy(&record, batch.data + at, sizeof(record));
+    ServiceProblem problem;
+    problem.id = record.id;
+    problem.prev_a = record.prev_a;
+    problem.weights.Load(record.weights);
+    for (size_t j = 0; j < 6; j++) {
+      problem.state[j] = record.state[j];
+    }
+    for (size_t j = 0; j < 4; j++) {
+      problem.coeffs[j] = record.coeffs[j];
+    }
+    if (waypoints > 0) {
+      const char *points = batch.data + at + sizeof(ProblemRecord);
+      std::memcpy(xs, points, waypoints * sizeof(double));
+      std::memcpy(ys, points + waypoints * sizeof(double), waypoints * sizeof(double));
+      problem.coeffs = FitInVehicleFrame<3>(record.state[0], record.state[1], record.state[2],
+                                            xs, ys, static_cast<int>(waypoints), xs, ys);
+      // The car at the origin of its frame, heading along x
+      problem.state << 0, 0, 0, record.state[3], polyeval(problem.coeffs, 0),
+          -std::atan(problem.coeffs[1]);
+    }
+    problems.push_back(problem);
+    at += bytes;
+  }
+  return true;
+}
+
+void AppendResult(uint32_t id, const MPCSolution &solution, double seconds, std::string &out) {
+  ProblemResultRecord record;
+  record.id = id;
+  record.status = static_cast<uint32_t>(solution.status);
+  record.stages = static_cast<uint32_t>(solution.stages);
+  record.iterations = static_cast<uint32_t>(std::max(0, solution.statistics.iterations));
+  record.cost = solution.cost;
+  record.seconds = seconds;
+  AppendBytes(&record, sizeof(record), out);
+  const size_t stages = solution.stages;
+  const size_t actuations = stages > 0 ? stages - 1 : 0;
+  const MPCSolution::StageArray *const states[] = {&solution.x,   &solution.y,   &solution.psi,
+                                                   &solution.v,   &solution.cte, &solution.epsi};
+  for (const MPCSolution::StageArray *values : states) {
+    AppendBytes(values->data(), stages * sizeof(double), out);
+  }
+  AppendBytes(solution.delta.data(), actuations * sizeof(double), out);
+  AppendBytes(solution.a.data(), actuations * sizeof(double), out);
+}
+
+bool ProblemQueue::Post(const MessageView &batch) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (batches_.size() >= max_batches_) {
+    return false;
+  }
+  batches_.push_back(std::string(batch.data, batch.size()));
+  return true;
+}
+
+bool ProblemQueue::Take(std::string &batch) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (batches_.empty()) {
+    return false;
+  }
+  batch.swap(batches_.front());
+  batches_.pop_front();
+  return true;
+}
+
+bool ProblemQueue::pending() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return !batches_.empty();
+}
+
+void ProblemQueue::Reply(std::string message) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  replies_.push_back(std::move(message));
+}
+
+void ProblemQueue::TakeReplies(std::vector<std::string> &messages) {
+  messages.clear();
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (std::string &message : replies_) {
+    messages.push_back(std::move(message));
+  }
+  replies_.clear();
+}
+
+ProblemRateLimit::ProblemRateLimit(double per_second)
+    : per_second_(per_second), credit_(per_second), refilled_(Clock::now()) {}
+
+bool ProblemRateLimit::Admit(size_t problems, Clock::time_point now) {
+  if (per_second_ <= 0) {
+    return true;
+  }
+  const double elapsed = std::chrono::duration<double>(now - refilled_).count();
+  credit_ = std::min(per_second_, credit_ + elapsed * per_second_);
+  refilled_ = now;
+  if (credit_ < std::min(static_cast<double>(problems), per_second_)) {
+    return false;
+  }
+  credit_ -= static_cast<double>(problems);
+  return true;
+}
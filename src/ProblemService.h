@@ -0,0 +1,129 @@
+#ifndef PROBLEM_SERVICE_H
+#define PROBLEM_SERVICE_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "CostWeights.h"
+#include "Horizon.h"
+#include "MPCSolution.h"
+#include "MessageView.h"
+
+// The solver as a service, for the tools that want plans without posing as
+// a simulator: a client that offers the kProblemsSubprotocol subprotocol
+// (see MessagePack.h) sends batches of problems as binary websocket
+// messages and gets their plans back as binary messages, a chunk of the
+// batch at a time as the chunks are solved, on copies of the solver of the
+// server (see BatchMPC.h). See DATA.md.
+//
+// A batch is one or more problems back to back, each a ProblemRecord in the
+// byte order of the host, then the waypoints it counts: their x, then their
+// y. Without waypoints the state and coefficients are those MPCBase::Solve
+// takes, in the vehicle frame; with them the x, y and psi of the state are
+// the pose of the car in the frame of the waypoints, which are fitted by a
+// cubic in the vehicle frame as the server fits those of the telemetry,
+// and cte and epsi are those of the fit. Every problem is solved cold, with
+// its own weights and last throttle.
+//
+// The plans of a chunk go back in one message, each a ProblemResultRecord
+// then its stages: the x, y, psi, v, cte and epsi of every stage, then the
+// steering and throttle of every stage but the last, each a double.
+
+struct ProblemRecord {
+  // The client's, returned with the plan
+  uint32_t id;
+  // Of the waypoints that follow, 0 for the coefficients
+  uint32_t waypoints;
+  double state[6];
+  double coeffs[4];
+  double prev_a;
+  // In the order of CostWeights::Store
+  double weights[CostWeights::size];
+};
+
+struct ProblemResultRecord {
+  uint32_t id;
+  // SolveStatus: 0 solved, 1 stopped at the deadline, 2 failed
+  uint32_t status;
+  uint32_t stages;
+  uint32_t iterations;
+  double cost;
+  // Seconds of the solve
+  double seconds;
+};
+
+// A problem of a batch as the solver takes it
+struct ServiceProblem {
+  uint32_t id = 0;
+  MPCState state = MPCState::Zero();
+  MPCCoeffs coeffs = MPCCoeffs::Zero();
+  double prev_a = 0;
+  CostWeights weights;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+typedef std::vector<ServiceProblem, Eigen::aligned_allocator<ServiceProblem>> ServiceBatch;
+
+// The problems of a batch, without reading them; 0 if it is malformed: it
+// ends inside a problem, or a problem has 1 to 3 waypoints or more than
+// Telemetry::kMaxWaypoints
+size_t CountProblems(const MessageView &batch);
+
+// The problems of a batch into problems, waypoints fitted; false if it is
+// malformed (see CountProblems)
+bool ReadProblems(const MessageView &batch, ServiceBatch &problems);
+
+// The plan of problem id, solved in seconds, appended to out
+void AppendResult(uint32_t id, const MPCSolution &solution, double seconds, std::string &out);
+
+// The batches of a client, from its event loop to the solver thread, and
+// the messages of plans back, each kept whole, in order and none dropped.
+// At most max_batches wait for the solver; the client gets a refusal for
+// the next until it falls behind less.
+class ProblemQueue {
+ public:
+  explicit ProblemQueue(size_t max_batches) : max_batches_(max_batches) {}
+
+  // Event loop: queue a copy of batch, false if max_batches are waiting
+  bool Post(const MessageView &batch);
+  // Solver: the oldest batch into batch, false if there is none
+  bool Take(std::string &batch);
+  bool pending() const;
+
+  // Solver: queue message for the client
+  void Reply(std::string message);
+  // Event loop: the messages queued, oldest first, into messages
+  void TakeReplies(std::vector<std::string> &messages);
+
+ private:
+  const size_t max_batches_;
+  mutable std::mutex mutex_;
+  std::deque<std::string> batches_;
+  std::deque<std::string> replies_;
+};
+
+// At most per_second problems a second from a client on average, in bursts
+// of up to a second of them, on its event loop: a batch is admitted while
+// the client has credit left, and its problems are charged against it even
+// past zero, so that a batch larger than a burst goes through once the
+// credit is whole and the next wait for its problems. No limit for a
+// per_second of 0.
+class ProblemRateLimit {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  explicit ProblemRateLimit(double per_second);
+
+  bool Admit(size_t problems, Clock::time_point now);
+
+ private:
+  const double per_second_;
+  double credit_;
+  Clock::time_point refilled_;
+};
+
+#endif /* PROBLEM_SERVICE_H */
@@ -0,0 +1,146 @@
+#include "ProximityGrid.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+ProximityGrid::ProximityGrid(double cell, size_t max_stages)
+    : cell_(cell > 0 ? cell : 1), max_stages_(std::max<size_t>(max_stages, 1)) {}
+
+uint64_t ProximityGrid::Key(int64_t cx, int64_t cy) {
+  return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) |
+         static_cast<uint32_t>(cy);
+}
+
+uint64_t ProximityGrid::CellOf(double x, double y) const {
+  return Key(static_cast<int64_t>(std::floor(x / cell_)),
+             static_cast<int64_t>(std::floor(y / cell_)));
+}
+
+void ProximityGrid::Remove(uint32_t id) {
+  std::vector<uint32_t> &ids = cells_[points_[id].cell];
+  const uint32_t slot = points_[id].slot;
+  ids[slot] = ids.back();
+  points_[ids[slot]].slot = slot;
+  ids.pop_back();
+  stages_--;
+}
+
+void ProximityGrid::Insert(uint32_t id, uint64_t cell) {
+  std::vector<uint32_t> &ids = cells_[cell];
+  points_[id].cell = cell;
+  points_[id].slot = static_cast<uint32_t>(ids.size());
+  ids.push_back(id);
+  stages_++;
+}
+
+void ProximityGrid::Update(size_t vehicle, const double *xs, const double *ys, size_t n) {
+  n = std::min(n, max_stages_);
+  if (vehicle >= counts_.size()) {
+    counts_.resize(vehicle + 1, 0);
+    points_.resize(counts_.size() * max_stages_);
+  }
+  const size_t held = counts_[vehicle];
+  const size_t base = vehicle * max_stages_;
+  for (size_t t = 0; t < n; t++) {
+    const uint32_t id = static_cast<uint32_t>(base + t);
+    const uint64_t cell = CellOf(xs[t], ys[t]);
+    if (t >= held) {
+      Insert(id, cell);
+    } else if (cell != points_[id].cell) {
+      Remove(id);
+      Insert(id, cell);
+    }
+    points_[id].x = xs[t];
+    points_[id].y = ys[t];
+  }
+  for (size_t t = n; t < held; t++) {
+    Remove(static_cast<uint32_t>(base + t));
+  }
+  counts_[vehicle] = n;
+
+  if (cells_.size() > 4 * stages_ + 64) {
+    for (auto it = cells_.begin(); it != cells_.end();) {
+      it = it->second.empty() ? cells_.erase(it) : std::next(it);
+    }
+  }
+}
+
+void ProximityGrid::Resize(size_t count) {
+  for (size_t k = count; k < counts_.size(); k++) {
+    Update(k, nullptr, nullptr, 0);
+  }
+  if (count < counts_.size()) {
+    counts_.resize(count);
+    points_.resize(count * max_stages_);
+  }
+}
+
+void ProximityGrid::NearPairs(double radius, size_t window,
+                              std::vector<ProximityPair> &pairs) const {
+  pairs.clear();
+  radius = std::min(radius, cell_);
+  const double radius2 = radius * radius;
+  for (size_t a = 0; a < counts_.size(); a++) {
+    for (size_t t = 0; t < counts_[a]; t++) {
+      const Stage &p = points_[a * max_stages_ + t];
+      const int64_t cx = static_cast<int64_t>(std::floor(p.x / cell_));
+      const int64_t cy = static_cast<int64_t>(std::floor(p.y / cell_));
+      for (int64_t dx = -1; dx <= 1; dx++) {
+        for (int64_t dy = -1; dy <= 1; dy++) {
+          const auto found = cells_.find(Key(cx + dx, cy + dy));
+          if (found == cells_.end()) {
+            continue;
+          }
+          for (uint32_t id : found->second) {
+            // Each pair once, from the vehicle of the lower index
+            const size_t b = id / max_stages_;
+            const size_t u = id % max_stages_;
+            if (b <= a || (t > u ? t - u : u - t) > window) {
+              continue;
+            }
+            const Stage &q = points_[id];
+            const double d2 = (p.x - q.x) * (p.x - q.x) + (p.y - q.y) * (p.y - q.y);
+            if (d2 <= radius2) {
+              ProximityPair pair;
+              pair.vehicle_a = static_cast<uint32_t>(a);
+              pair.stage_a = static_cast<uint32_t>(t);
+              pair.vehicle_b = static_cast<uint32_t>(b);
+              pair.stage_b = static_cast<uint32_t>(u);
+              pair.distance = std::sqrt(d2);
+              pairs.push_back(pair);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+double ProximityGrid::PathLength(size_t vehicle, size_t stage) const {
+  const size_t base = vehicle * max_stages_;
+  const size_t end = std::min(stage, counts_[vehicle] > 0 ? counts_[vehicle] - 1 : 0);
+  double length = 0;
+  for (size_t t = 0; t < end; t++) {
+    const Stage &p = points_[base + t];
+    const Stage &q = points_[base + t + 1];
+    length += std::hypot(q.x - p.x, q.y - p.y);
+  }
+  return length;
+}
+
+void YieldSpeeds(const ProximityGrid &grid, const std::vector<ProximityPair> &pairs,
+                 const double *times, double radius, std::vector<double> &speeds) {
+  speeds.assign(grid.vehicles(), std::numeric_limits<double>::infinity());
+  for (const ProximityPair &pair : pairs) {
+    const double path_a = grid.PathLength(pair.vehicle_a, pair.stage_a);
+    const double path_b = grid.PathLength(pair.vehicle_b, pair.stage_b);
+    const bool a_yields = pair.stage_a != pair.stage_b ? pair.stage_a > pair.stage_b
+                                                       : path_a > path_b;
+    const size_t vehicle = a_yields ? pair.vehicle_a : pair.vehicle_b;
+    const size_t stage = a_yields ? pair.stage_a : pair.stage_b;
+    const double path = a_yields ? path_a : path_b;
+    const double speed = times[stage] > 0 ? std::max(0.0, path - radius) / times[stage] : 0;
+    speeds[vehicle] = std::min(speeds[vehicle], speed);
+  }
+}
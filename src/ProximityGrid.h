@@ -0,0 +1,96 @@
+#ifndef PROXIMITY_GRID_H
+#define PROXIMITY_GRID_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Two stages of the predicted trajectories of two vehicles close to each
+// other, vehicle_a < vehicle_b
+struct ProximityPair {
+  uint32_t vehicle_a;
+  uint32_t stage_a;
+  uint32_t vehicle_b;
+  uint32_t stage_b;
+  double distance;
+};
+
+// A spatial hash over the predicted trajectories of the vehicles of a
+// fleet, for the pairs of their stages that come close without comparing
+// every stage of every vehicle with every other, V² N² distances for V
+// vehicles of N stages.
+//
+// The plane is cut into square cells of cell meters, each holding the
+// stages that lie in it; a stage is only compared with those of its own
+// cell and the eight around it, so finding the pairs within cell of each
+// other costs about the stages times their neighbours in those cells.
+//
+// The grid is kept from tick to tick: Update moves a stage to another cell
+// only if it left its own, and the cells are kept once made, so a fleet
+// driving the same stretch of track reuses the memory of the ticks before
+// and a tick mostly moves a few stages. Empty cells are dropped once they
+// outnumber the stages four to one.
+class ProximityGrid {
+public:
+  // Cells of cell meters on a side, for trajectories of up to max_stages
+  ProximityGrid(double cell, size_t max_stages);
+
+  // The predicted trajectory of vehicle is now the n stages of xs and ys,
+  // in the frame all the vehicles share; the stages of its last trajectory
+  // past n are dropped
+  void Update(size_t vehicle, const double *xs, const double *ys, size_t n);
+  // Drop the vehicles from count on
+  void Resize(size_t count);
+
+  // The pairs of stages of two vehicles at most radius apart, radius no
+  // more than cell, and at most window stages apart in time, into pairs
+  void NearPairs(double radius, size_t window, std::vector<ProximityPair> &pairs) const;
+
+  // Length of the trajectory of vehicle from its first stage to stage
+  double PathLength(size_t vehicle, size_t stage) const;
+
+  double cell() const { return cell_; }
+  size_t vehicles() const { return counts_.size(); }
+  // The stages held, and the cells made for them
+  size_t stages() const { return stages_; }
+  size_t cells() const { return cells_.size(); }
+
+private:
+  struct Stage {
+    double x = 0;
+    double y = 0;
+    uint64_t cell = 0;
+    // Of this stage in the list of its cell
+    uint32_t slot = 0;
+  };
+
+  uint64_t CellOf(double x, double y) const;
+  static uint64_t Key(int64_t cx, int64_t cy);
+  // Take stage id out of its cell
+  void Remove(uint32_t id);
+  void Insert(uint32_t id, uint64_t cell);
+
+  const double cell_;
+  const size_t max_stages_;
+  // Stage t of vehicle k at k * max_stages_ + t
+  std::vector<Stage> points_;
+  // Stages of every vehicle
+  std::vector<size_t> counts_;
+  size_t stages_ = 0;
+  // The ids of the stages in each cell
+  std::unordered_map<uint64_t, std::vector<uint32_t> > cells_;
+};
+
+// The proximity pairs of grid turned into limits the vehicles can be held
+// to: the MPC has no constraints between vehicles, but each can be given a
+// reference speed. Of every pair the vehicle that gets there later yields,
+// the one at the later stage or, at the same stage, the one farther along
+// its trajectory from its first stage, and is held to the mean speed that
+// brings it to radius short of that stage by its time. Into speeds, a speed
+// in m/s for each vehicle of grid, infinite for those that need not yield;
+// times holds the time in seconds of every stage, as MPCBase::stage_time.
+void YieldSpeeds(const ProximityGrid &grid, const std::vector<ProximityPair> &pairs,
+                 const double *times, double radius, std::vector<double> &speeds);
+
+#endif /* PROXIMITY_GRID_H */
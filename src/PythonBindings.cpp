@@ -0,0 +1,245 @@
+// The Python module "mpc", built with the MPC_PYTHON CMake option: the fit,
+// the transform and the prediction of a tick, and the solvers of the server
+// in batches, for evaluating the controller offline from NumPy without a
+// websocket in between.
+//
+// The arrays go in without copies: float64 arrays, C contiguous, are read
+// and written where NumPy keeps them (any other is converted by pybind11,
+// once), and a batch of states and coefficients is handed to
+// BatchMPC::SolveBatch as it lies when it is aligned as Eigen wants, copied
+// only if it isn't. The plans come back in arrays made for them, the one
+// copy out of MPCSolution. Solves run without the GIL, the vehicles of a
+// batch spread over the threads of their BatchMPC, so other Python threads
+// run meanwhile and a batch of V vehicles on T threads takes V / T solves.
+//
+// CppAD knows the threads that tape and sweep by number (see
+// CppADThreads.h), so a Controller is to be made, solved and dropped by one
+// Python thread, the one that imported the module.
+//
+//   import mpc, numpy as np
+//   c = mpc.Controller("ipopt", horizon=15, vehicles=64, threads=8)
+//   coeffs = np.stack([mpc.polyfit(x, y, 3) for x, y in waypoints])
+//   plans = c.solve(states, coeffs)  # a dict of arrays, a row per vehicle
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "BatchMPC.h"
+#include "CppADThreads.h"
+#include "KinematicModel.h"
+#include "MPC.h"
+#include "Polynomial.h"
+#include "SolverBackend.h"
+#include "VehicleFrame.h"
+
+namespace py = pybind11;
+
+namespace {
+
+typedef py::array_t<double, py::array::c_style | py::array::forcecast> DoubleArray;
+
+// The number of rows of array, which must be 2-D with columns columns
+size_t Rows(const DoubleArray &array, py::ssize_t columns, const char *name) {
+  if (array.ndim() != 2 || array.shape(1) != columns) {
+    throw std::invalid_argument(std::string(name) + " must be an array of shape (n, " +
+                                std::to_string(columns) + ")");
+  }
+  return static_cast<size_t>(array.shape(0));
+}
+
+// The rows of array as the Eigen vectors T, where they are if they are
+// aligned for T, else copied into copy
+template <class T, class Allocator>
+const T *AsRows(const DoubleArray &array, std::vector<T, Allocator> &copy) {
+  const double *data = array.data();
+  if (reinterpret_cast<std::uintptr_t>(data) % alignof(T) == 0) {
+    return reinterpret_cast<const T *>(data);
+  }
+  const size_t n = static_cast<size_t>(array.shape(0));
+  copy.resize(n);
+  for (size_t k = 0; k < n; k++) {
+    copy[k] = Eigen::Map<const T>(data + k * T::RowsAtCompileTime);
+  }
+  return copy.data();
+}
+
+static_assert(sizeof(MPCState) == 6 * sizeof(double), "MPCState is the 6 doubles of a row");
+static_assert(sizeof(MPCCoeffs) == 4 * sizeof(double), "MPCCoeffs is the 4 doubles of a row");
+
+// The solvers of the server for a batch of vehicles, each warm starting from
+// its own last plan, like the cars of a telemetry_batch session
+class Controller {
+public:
+  Controller(const std::string &backend, size_t horizon, size_t vehicles, size_t threads,
+             bool move_blocking, double max_solve_time) {
+    SolverBackend parsed;
+    if (!ParseSolverBackend(backend, parsed)) {
+      throw std::invalid_argument("no solver " + backend);
+    }
+    if (vehicles == 0) {
+      throw std::invalid_argument("a batch needs a vehicle at least");
+    }
+    MPCProblem problem;
+    problem.horizon = horizon;
+    problem.move_blocking = move_blocking;
+    problem.max_solve_time = max_solve_time;
+    std::unique_ptr<MPCBase> prototype = MakeSolver(parsed, problem);
+    if (!prototype) {
+      throw std::invalid_argument("no " + backend + " MPC compiled for a horizon of " +
+                                  std::to_string(horizon));
+    }
+    batch_ = MakeBatchMPC(*prototype, vehicles, threads);
+    if (!batch_) {
+      throw std::invalid_argument("the " + backend + " MPC can't be copied for a batch");
+    }
+    results_.resize(vehicles);
+  }
+
+  size_t vehicles() const { return batch_->size(); }
+  size_t threads() const { return batch_->threads(); }
+
+  // Solve vehicle k from row k of states [x, y, psi, v, cte, epsi] and of
+  // coeffs, the cubic of its reference in its frame
+  py::dict Solve(const DoubleArray &states, const DoubleArray &coeffs) {
+    const size_t n = batch_->size();
+    if (Rows(states, 6, "states") != n || Rows(coeffs, 4, "coeffs") != n) {
+      throw std::invalid_argument("states and coeffs need a row per vehicle, " +
+                                  std::to_string(n));
+    }
+    const MPCState *state_rows = AsRows(states, state_copy_);
+    const MPCCoeffs *coeff_rows = AsRows(coeffs, coeff_copy_);
+    {
+      py::gil_scoped_release release;
+      batch_->SolveBatch(state_rows, coeff_rows, results_.data());
+    }
+    size_t stages = 0;
+    for (const MPCSolution &result : results_) {
+      stages = std::max(stages, result.stages);
+    }
+    DoubleArray steering(n), throttle(n), cost(n), x({n, stages}), y({n, stages});
+    py::array_t<int> status(n);
+    for (size_t k = 0; k < n; k++) {
+      const MPCSolution &result = results_[k];
+      // The commands of the simulator, as the server sends them
+      steering.mutable_at(k) = SteerCommand(result.delta[0]);
+      throttle.mutable_at(k) = result.a[0];
+      cost.mutable_at(k) = result.cost;
+      status.mutable_at(k) = static_cast<int>(result.status);
+      for (size_t t = 0; t < stages; t++) {
+        x.mutable_at(k, t) = t < result.stages ? result.x[t] : result.x[result.stages - 1];
+        y.mutable_at(k, t) = t < result.stages ? result.y[t] : result.y[result.stages - 1];
+      }
+      // The throttle the next solve of the vehicle starts from
+      batch_->vehicle(k).prev_a = result.a[0];
+    }
+    py::dict plans;
+    plans["steering"] = steering;
+    plans["throttle"] = throttle;
+    plans["cost"] = cost;
+    plans["status"] = status;
+    plans["x"] = x;
+    plans["y"] = y;
+    return plans;
+  }
+
+  // Forget the plans, for the next solve of every vehicle to start cold
+  void Reset() {
+    for (size_t k = 0; k < batch_->size(); k++) {
+      batch_->vehicle(k).Reset();
+      batch_->vehicle(k).prev_a = 0;
+    }
+  }
+
+private:
+  std::unique_ptr<BatchMPC> batch_;
+  std::vector<MPCSolution> results_;
+  std::vector<MPCState, Eigen::aligned_allocator<MPCState> > state_copy_;
+  std::vector<MPCCoeffs, Eigen::aligned_allocator<MPCCoeffs> > coeff_copy_;
+};
+
+}  // namespace
+
+PYBIND11_MODULE(mpc, m) {
+  m.doc() = "The fit, transform, prediction and batched solvers of the MPC server";
+
+  m.def("polyfit",
+        [](const DoubleArray &x, const DoubleArray &y, int order) {
+          if (x.ndim() != 1 || y.ndim() != 1 || x.size() != y.size()) {
+            throw std::invalid_argument("x and y must be 1-D arrays of the same size");
+          }
+          if (order < 1 || order > x.size() - 1) {
+            throw std::invalid_argument("the order must be 1 to the points less one");
+          }
+          // Read where NumPy keeps them
+          const Eigen::Map<const Eigen::VectorXd> xs(x.data(), x.size());
+          const Eigen::Map<const Eigen::VectorXd> ys(y.data(), y.size());
+          DoubleArray coeffs(order + 1);
+          Eigen::Map<Eigen::VectorXd> out(coeffs.mutable_data(), order + 1);
+          Eigen::VectorXd fitted;
+          polyfit(xs, ys, order, fitted);
+          out = fitted;
+          return coeffs;
+        },
+        py::arg("x"), py::arg("y"), py::arg("order") = 3,
+        "The coefficients of the polynomial of order fitted to (x, y), the constant first");
+
+  m.def("to_vehicle_frame",
+        [](double px, double py, double psi, const DoubleArray &x, const DoubleArray &y) {
+          if (x.ndim() != 1 || y.ndim() != 1 || x.size() != y.size()) {
+            throw std::invalid_argument("x and y must be 1-D arrays of the same size");
+          }
+          const size_t n = static_cast<size_t>(x.size());
+          DoubleArray out_x(n), out_y(n);
+          ToVehicleFrame(px, py, psi, x.data(), y.data(), n, out_x.mutable_data(),
+                         out_y.mutable_data());
+          return py::make_tuple(out_x, out_y);
+        },
+        py::arg("px"), py::arg("py"), py::arg("psi"), py::arg("x"), py::arg("y"),
+        "The points (x, y) of the map in the frame of a vehicle at (px, py) heading psi");
+
+  m.def("predict_states",
+        [](const DoubleArray &v, const DoubleArray &delta, const DoubleArray &prev_a,
+           const DoubleArray &cte, const DoubleArray &epsi, double dt) {
+          const py::ssize_t n = v.size();
+          if (delta.size() != n || prev_a.size() != n || cte.size() != n || epsi.size() != n) {
+            throw std::invalid_argument("the arrays must all have the same size");
+          }
+          DoubleArray states({static_cast<size_t>(n), static_cast<size_t>(6)});
+          const double *vs = v.data();
+          const double *deltas = delta.data();
+          const double *as = prev_a.data();
+          const double *ctes = cte.data();
+          const double *epsis = epsi.data();
+          double *out = states.mutable_data();
+          {
+            py::gil_scoped_release release;
+            for (py::ssize_t k = 0; k < n; k++) {
+              Eigen::Map<MPCState>(out + 6 * k) =
+                  PredictState(vs[k], deltas[k], as[k], ctes[k], epsis[k], dt);
+            }
+          }
+          return states;
+        },
+        py::arg("v"), py::arg("delta"), py::arg("prev_a"), py::arg("cte"), py::arg("epsi"),
+        py::arg("dt"),
+        "The states a tick solves for, a row per vehicle, dt past its telemetry (see "
+        "PredictState)");
+
+  py::class_<Controller>(m, "Controller")
+      .def(py::init<const std::string &, size_t, size_t, size_t, bool, double>(),
+           py::arg("backend") = "ipopt", py::arg("horizon") = 15, py::arg("vehicles") = 1,
+           py::arg("threads") = 1, py::arg("move_blocking") = false,
+           py::arg("max_solve_time") = 0.05)
+      .def_property_readonly("vehicles", &Controller::vehicles)
+      .def_property_readonly("threads", &Controller::threads)
+      .def("solve", &Controller::Solve, py::arg("states"), py::arg("coeffs"),
+           "Solve every vehicle, a row of states and of coeffs each; a dict of the steering, "
+           "throttle, cost and status of each, and the x and y of its plan")
+      .def("reset", &Controller::Reset);
+}
@@ -0,0 +1,161 @@
+#include "RealTime.h"
+#include <alloca.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace {
+
+size_t PageSize() {
+  const long size = sysconf(_SC_PAGESIZE);
+  return size > 0 ? static_cast<size_t>(size) : 4096;
+}
+
+// The numbers of a list of the kernel such as "0-3,8-11", false if it
+// isn't one
+bool ParseCpuList(const std::string &list, std::vector<int> &numbers) {
+  numbers.clear();
+  size_t at = 0;
+  while (at < list.size() && list[at] != '\n') {
+    char *end = nullptr;
+    const long first = std::strtol(list.c_str() + at, &end, 10);
+    if (end == list.c_str() + at || first < 0) {
+      return false;
+    }
+    long last = first;
+    at = end - list.c_str();
+    if (at < list.size() && list[at] == '-') {
+      last = std::strtol(list.c_str() + at + 1, &end, 10);
+      if (end == list.c_str() + at + 1 || last < first) {
+        return false;
+      }
+      at = end - list.c_str();
+    }
+    for (long n = first; n <= last; n++) {
+      numbers.push_back(static_cast<int>(n));
+    }
+    if (at < list.size() && list[at] == ',') {
+      at++;
+    }
+  }
+  return true;
+}
+
+// The first line of the file at path, empty if it can't be read
+std::string ReadLine(const std::string &path) {
+  std::ifstream in(path);
+  std::string line;
+  std::getline(in, line);
+  return line;
+}
+
+}  // namespace
+
+bool PinThread(int cpu) {
+#ifdef __linux__
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+  return false;
+#endif
+}
+
+bool PinThread(const std::vector<int> &cpus) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  return !cpus.empty() && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+std::vector<std::vector<int>> NumaNodeCpus() {
+  std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+  const std::string root = "/sys/devices/system/node/";
+  std::vector<int> online;
+  if (!ParseCpuList(ReadLine(root + "online"), online)) {
+    return nodes;
+  }
+  for (int node : online) {
+    std::vector<int> cpus;
+    const std::string path = root + "node" + std::to_string(node) + "/cpulist";
+    // A node of memory alone has no cpus to run a worker on
+    if (ParseCpuList(ReadLine(path), cpus) && !cpus.empty()) {
+      nodes.push_back(cpus);
+    }
+  }
+#endif
+  return nodes;
+}
+
+bool SetRealTimePriority(int priority) {
+#ifdef __linux__
+  sched_param param;
+  param.sched_priority = priority;
+  return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#else
+  return false;
+#endif
+}
+
+bool SetIdlePriority() {
+#ifdef __linux__
+  sched_param param;
+  param.sched_priority = 0;
+  return pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) == 0;
+#else
+  return false;
+#endif
+}
+
+bool LockMemory() {
+#ifdef __linux__
+  return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+#else
+  return false;
+#endif
+}
+
+bool RetainHeap() {
+#ifdef __GLIBC__
+  return mallopt(M_TRIM_THRESHOLD, -1) == 1 && mallopt(M_MMAP_MAX, 0) == 1;
+#else
+  return false;
+#endif
+}
+
+void PrefaultStack(size_t bytes) {
+  // Below this frame, where the calls of the thread will go
+  volatile char *stack = static_cast<volatile char *>(alloca(bytes));
+  const size_t page = PageSize();
+  for (size_t k = 0; k < bytes; k += page) {
+    stack[k] = 0;
+  }
+}
+
+bool PrefaultHeap(size_t bytes) {
+  volatile char *block = static_cast<volatile char *>(std::malloc(bytes));
+  if (block == nullptr) {
+    return false;
+  }
+  const size_t page = PageSize();
+  for (size_t k = 0; k < bytes; k += page) {
+    block[k] = 0;
+  }
+  std::free(const_cast<char *>(block));
+  return true;
+}
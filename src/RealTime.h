@@ -0,0 +1,56 @@
+#ifndef REAL_TIME_H
+#define REAL_TIME_H
+
+#include <cstddef>
+#include <vector>
+
+// The steps that keep the control path of a busy host from being preempted
+// or stalled by page faults: threads pinned to cores of their own and run
+// under SCHED_FIFO, above every ordinary process, the memory of the process
+// locked, malloc kept from handing its pool back to the system, and the
+// stacks and heaps of the threads faulted in before the first tick. Each
+// step returns whether it worked, for the server to report at startup;
+// most need privileges (CAP_SYS_NICE or an rtprio limit, CAP_IPC_LOCK or a
+// memlock limit) and do nothing outside Linux.
+//
+// On a host of several NUMA nodes the threads of a worker are kept on the
+// cpus of one node, where the memory they touch first is then allocated,
+// so that the solver doesn't reach across the interconnect for its tapes,
+// workspaces and buffers.
+
+// Memory each real-time thread faults in before it serves: its stack, and
+// a block of its malloc arena that stays in the pool once freed
+const size_t kPrefaultStack = 256 * 1024;
+const size_t kPrefaultHeap = 16 * 1024 * 1024;
+
+// Keep the calling thread on cpu
+bool PinThread(int cpu);
+// Keep the calling thread on any of cpus
+bool PinThread(const std::vector<int> &cpus);
+
+// The cpus of each online NUMA node of the host, the nodes in order, from
+// sysfs; empty where it can't be read, outside Linux
+std::vector<std::vector<int>> NumaNodeCpus();
+
+// Run the calling thread under SCHED_FIFO at priority, 1 to 99
+bool SetRealTimePriority(int priority);
+
+// Run the calling thread under SCHED_IDLE, only on cpus nothing else of
+// the host wants, for the work that must never take time from the control
+// path; needs no privileges
+bool SetIdlePriority();
+
+// Lock every page of the process in memory, those mapped now and those
+// mapped later, faulting each in as it is mapped
+bool LockMemory();
+
+// Keep what malloc frees in its pool rather than trimming it or unmapping
+// the blocks it mapped, so a pool once faulted in stays so (glibc)
+bool RetainHeap();
+
+// Touch bytes of the stack of the calling thread below its frame, and a
+// block of bytes of its malloc arena, a page at a time
+void PrefaultStack(size_t bytes);
+bool PrefaultHeap(size_t bytes);
+
+#endif /* REAL_TIME_H */
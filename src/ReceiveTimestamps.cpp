@@ -0,0 +1,91 @@
+// The recv below replaces libc's, which a fortified build would inline
+#undef _FORTIFY_SOURCE
+#include "ReceiveTimestamps.h"
+#include <linux/net_tstamp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+namespace {
+
+std::atomic<bool> enabled{false};
+
+// The control message of SO_TIMESTAMPING: the software stamp, then two the
+// hardware fills in
+struct Timestamps {
+  timespec stamps[3];
+};
+
+// The last read of this thread: its socket, -1 if it had no stamp, and
+// the stamp
+thread_local int stamped_fd = -1;
+thread_local timespec stamp;
+
+const double kMaxAge = 10;
+
+}  // namespace
+
+bool EnableReceiveTimestamps(int fd) {
+  const int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+  if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) != 0) {
+    return false;
+  }
+  enabled.store(true, std::memory_order_relaxed);
+  return true;
+}
+
+bool ReceiveTimestamp(int fd, Mailbox::Clock::time_point &arrival) {
+  if (fd < 0 || fd != stamped_fd) {
+    return false;
+  }
+  timespec wall;
+  clock_gettime(CLOCK_REALTIME, &wall);
+  const Mailbox::Clock::time_point now = Mailbox::Clock::now();
+  const double age =
+      static_cast<double>(wall.tv_sec - stamp.tv_sec) + (wall.tv_nsec - stamp.tv_nsec) * 1e-9;
+  if (age < 0 || age > kMaxAge) {
+    return false;
+  }
+  arrival = now - std::chrono::duration_cast<Mailbox::Clock::duration>(
+                      std::chrono::duration<double>(age));
+  return true;
+}
+
+// recv(2) as libc has it, but for the sockets with timestamps a recvmsg
+// that keeps the stamp of what it read
+extern "C" ssize_t recv(int fd, void *buffer, size_t length, int flags) {
+  if (!enabled.load(std::memory_order_relaxed)) {
+    return recvfrom(fd, buffer, length, flags, nullptr, nullptr);
+  }
+  iovec io;
+  io.iov_base = buffer;
+  io.iov_len = length;
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(Timestamps))];
+  msghdr message;
+  std::memset(&message, 0, sizeof(message));
+  message.msg_iov = &io;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  const ssize_t read = recvmsg(fd, &message, flags);
+  if (read <= 0) {
+    return read;
+  }
+  stamped_fd = -1;
+  for (cmsghdr *header = CMSG_FIRSTHDR(&message); header != nullptr;
+       header = CMSG_NXTHDR(&message, header)) {
+    if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_TIMESTAMPING) {
+      Timestamps timestamps;
+      std::memcpy(&timestamps, CMSG_DATA(header), sizeof(timestamps));
+      if (timestamps.stamps[0].tv_sec != 0 || timestamps.stamps[0].tv_nsec != 0) {
+        stamped_fd = fd;
+        stamp = timestamps.stamps[0];
+      }
+    }
+  }
+  return read;
+}
@@ -0,0 +1,37 @@
+#ifndef RECEIVE_TIMESTAMPS_H
+#define RECEIVE_TIMESTAMPS_H
+
+#include "Mailbox.h"
+
+// The times the kernel received the data of the websockets, for the
+// arrival of a frame to be when it came off the network rather than when
+// the event loop got round to its message handler.
+//
+// A frame that comes while the loop is busy (a timer, the replies of the
+// solver, the frames of the other sessions of the worker) waits in the
+// socket's receive buffer, and the clock read in the handler misses that
+// wait; the latency of the commands and the age of the telemetry are too
+// short by it. With the timestamps on, each socket of a simulator has
+// SO_TIMESTAMPING's software receive timestamps, and the recv of this file
+// is in front of libc's, the one uWS reads the sockets with: the same read
+// done by recvmsg, the timestamp of its control message kept for the
+// thread, so that the handlers of the messages of that read take it as
+// their arrival. Only the programs that link this file in replace recv,
+// and until EnableReceiveTimestamps is called it is libc's recvfrom. The
+// reads of TLS go through OpenSSL's read rather than recv and have no
+// timestamps; their frames arrive when handled, as without.
+//
+// The kernel stamps on CLOCK_REALTIME, the mailboxes on the steady clock:
+// the stamp is taken as that long before now on the steady clock, which a
+// step of the wall clock in between would throw off, so a stamp from the
+// future or over 10 s old is dropped.
+
+// Turn the timestamps on for the socket fd, and their reading for the
+// process; false if the kernel refuses them
+bool EnableReceiveTimestamps(int fd);
+
+// The time the kernel received the data of the last read of this thread on
+// the steady clock, into arrival, if that read was of fd and had a stamp
+bool ReceiveTimestamp(int fd, Mailbox::Clock::time_point &arrival);
+
+#endif /* RECEIVE_TIMESTAMPS_H */
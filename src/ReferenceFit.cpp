@@ -0,0 +1,153 @@
+#include "ReferenceFit.h"
+#include <cmath>
+#include <cstring>
+#include "Polynomial.h"
+#include "SimdKernels.h"
+#include "VehicleFrame.h"
+
+ReferenceFitCache::ReferenceFitCache(const ReferenceFitTolerance &tolerance,
+                                     bool single_precision)
+    : tolerance_(tolerance), single_precision_(single_precision) {
+  coeffs_.setZero();
+}
+
+uint64_t ReferenceFitCache::Hash(const Telemetry::Waypoints &ptsx,
+                                 const Telemetry::Waypoints &ptsy) {
+  uint64_t hash = 14695981039346656037ull;
+  for (const Telemetry::Waypoints *pts : {&ptsx, &ptsy}) {
+    for (double p : *pts) {
+      uint64_t bits;
+      std::memcpy(&bits, &p, sizeof(bits));
+      for (int b = 0; b < 8; b++) {
+        hash = (hash ^ ((bits >> (8 * b)) & 0xff)) * 1099511628211ull;
+      }
+    }
+  }
+  return hash;
+}
+
+const MPCCoeffs &ReferenceFitCache::Fit(const Telemetry::Waypoints &ptsx,
+                                        const Telemetry::Waypoints &ptsy, double px, double py,
+                                        double psi) {
+  const uint64_t hash = Hash(ptsx, ptsy);
+  const bool same = valid_ && hash == hash_ && ptsx == ptsx_ && ptsy == ptsy_;
+  if (same && std::hypot(px - px_, py - py_) <= tolerance_.position &&
+      std::fabs(psi - psi_) <= tolerance_.heading) {
+    hits_++;
+    return coeffs_;
+  }
+  if (same) {
+    refits_++;
+  } else {
+    misses_++;
+    hash_ = hash;
+    ptsx_ = ptsx;
+    ptsy_ = ptsy;
+  }
+  valid_ = true;
+  px_ = px;
+  py_ = py;
+  psi_ = psi;
+  xs_.resize(ptsx.size());
+  ys_.resize(ptsy.size());
+  if (single_precision_) {
+    ToVehicleFrame(px, py, psi, ptsx.data(), ptsy.data(), ptsx.size(), xs_.data(), ys_.data());
+    float_xs_.assign(xs_.begin(), xs_.end());
+    float_ys_.assign(ys_.begin(), ys_.end());
+    coeffs_ = ChebyshevSeries<3, float>::Fit(float_xs_.data(), float_ys_.data(),
+                                             static_cast<int>(float_xs_.size()))
+                  .Monomial();
+  } else {
+    coeffs_ = FitInVehicleFrame<3>(px, py, psi, ptsx.data(), ptsy.data(),
+                                   static_cast<int>(ptsx.size()), xs_.data(), ys_.data());
+  }
+  SelectOrder();
+  return coeffs_;
+}
+
+// Root mean square of the residuals of the polynomial coeffs over the n
+// points (xs, ys)
+template <class Coeffs>
+static double RootMeanSquareResidual(const Coeffs &coeffs, const double *xs, const double *ys,
+                                     size_t n) {
+  double sum = 0;
+  for (size_t j = 0; j < n; j++) {
+    const double residual = polyeval(coeffs, xs[j]) - ys[j];
+    sum += residual * residual;
+  }
+  return std::sqrt(sum / n);
+}
+
+void ReferenceFitCache::SelectOrder() {
+  const size_t n = xs_.size();
+  if (order_tolerance_ <= 0 || n < 4) {
+    order_ = 3;
+    return;
+  }
+  const int points = static_cast<int>(n);
+  const Eigen::Vector2d line = polyfit<1>(xs_.data(), ys_.data(), points);
+  if (RootMeanSquareResidual(line, xs_.data(), ys_.data(), n) <=
+      (order_ > 1 ? 0.5 : 1.0) * order_tolerance_) {
+    coeffs_ << line, 0, 0;
+    order_ = 1;
+    return;
+  }
+  const Eigen::Vector3d parabola = polyfit<2>(xs_.data(), ys_.data(), points);
+  if (RootMeanSquareResidual(parabola, xs_.data(), ys_.data(), n) <=
+      (order_ > 2 ? 0.5 : 1.0) * order_tolerance_) {
+    coeffs_ << parabola, 0;
+    order_ = 2;
+    return;
+  }
+  order_ = 3;
+}
+
+bool FleetReferenceFit::Fit(const Telemetry *cars, size_t n, MPCCoeffs *coeffs) {
+  const size_t points = n > 0 ? cars[0].ptsx.size() : 0;
+  if (points < 4) {
+    return false;
+  }
+  for (size_t k = 0; k < n; k++) {
+    if (cars[k].ptsx.size() != points || cars[k].ptsy.size() != points) {
+      return false;
+    }
+  }
+  cars_ = n;
+  points_ = points;
+  px_.resize(n);
+  py_.resize(n);
+  cos_.resize(n);
+  sin_.resize(n);
+  xs_.resize(n * points);
+  ys_.resize(n * points);
+  coeffs_.resize(4 * n);
+  for (size_t k = 0; k < n; k++) {
+    const Telemetry &car = cars[k];
+    px_[k] = car.x;
+    py_[k] = car.y;
+    cos_[k] = std::cos(car.psi);
+    sin_[k] = std::sin(car.psi);
+    for (size_t j = 0; j < points; j++) {
+      xs_[j * n + k] = car.ptsx[j];
+      ys_[j * n + k] = car.ptsy[j];
+    }
+  }
+  FitCubicLanes(px_.data(), py_.data(), cos_.data(), sin_.data(), xs_.data(), ys_.data(), points,
+                n, coeffs_.data());
+  for (size_t k = 0; k < n; k++) {
+    for (size_t i = 0; i < 4; i++) {
+      coeffs[k][i] = coeffs_[i * n + k];
+    }
+  }
+  return true;
+}
+
+void FleetReferenceFit::Waypoints(size_t k, Telemetry::Waypoints &xs,
+                                  Telemetry::Waypoints &ys) const {
+  xs.resize(points_);
+  ys.resize(points_);
+  for (size_t j = 0; j < points_; j++) {
+    xs[j] = xs_[j * cars_ + k];
+    ys[j] = ys_[j * cars_ + k];
+  }
+}
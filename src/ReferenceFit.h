@@ -0,0 +1,129 @@
+#ifndef REFERENCE_FIT_H
+#define REFERENCE_FIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Horizon.h"
+#include "Telemetry.h"
+
+// Tolerances of the pose within which a fit of the same waypoints is
+// reused as it is
+struct ReferenceFitTolerance {
+  double position = 1e-3;
+  double heading = 1e-4;
+};
+
+// The cubic fitted to the waypoints of a telemetry message in the vehicle
+// frame, remembered between messages.
+//
+// The simulator sends the same waypoints for many messages in a row. They
+// are recognized by a hash of their coordinates (then compared, so that a
+// collision never reuses a wrong fit). When the pose has also moved less
+// than the tolerance the last fit is returned as it is, a hit. A cubic in
+// the vehicle frame doesn't stay a cubic when the frame turns, so after a
+// larger move the same waypoints are transformed and refitted (a refit),
+// as are new waypoints (a miss).
+//
+// With single_precision the waypoints are transformed in double, then
+// fitted as a Chebyshev series in float (see ChebyshevSeries) and converted
+// to powers of x in double.
+//
+// With an adaptive order (see SetAdaptiveOrder) the fit is of the lowest
+// order that follows the waypoints within a tolerance, a line on the
+// straights and a parabola on the gentle bends, the coefficients above it
+// zero, for the solver to step its model along the cheaper polynomial (see
+// MPCBase::SetReferenceOrder).
+class ReferenceFitCache {
+public:
+  explicit ReferenceFitCache(const ReferenceFitTolerance &tolerance = ReferenceFitTolerance(),
+                             bool single_precision = false);
+
+  // Fit of the map waypoints (ptsx, ptsy) for the vehicle at (px, py)
+  // heading psi
+  const MPCCoeffs &Fit(const Telemetry::Waypoints &ptsx, const Telemetry::Waypoints &ptsy,
+                       double px, double py, double psi);
+
+  // The waypoints of the last fit in the vehicle frame it was made in
+  const Telemetry::Waypoints &xs() const { return xs_; }
+  const Telemetry::Waypoints &ys() const { return ys_; }
+
+  // Fit a line or a parabola instead of the cubic when the root mean square
+  // of its residuals over the waypoints is within tolerance meters, about
+  // the noise of the waypoints; 0, the default, always fits the cubic. The
+  // order is lowered only when the lower fit is within half the tolerance,
+  // and raised as soon as the fit of the order held is out of it, so that
+  // waypoints about the tolerance don't flip it, and the tape of the
+  // solver, every tick.
+  void SetAdaptiveOrder(double tolerance) { order_tolerance_ = tolerance; }
+  // The order of the last fit, 3 without an adaptive order
+  size_t order() const { return order_; }
+
+  size_t hits() const { return hits_; }
+  size_t refits() const { return refits_; }
+  size_t misses() const { return misses_; }
+
+private:
+  // FNV-1a over the bytes of the coordinates
+  static uint64_t Hash(const Telemetry::Waypoints &ptsx, const Telemetry::Waypoints &ptsy);
+
+  // Lower coeffs_, the cubic of xs_ and ys_, to the order of the adaptive
+  // order, see SetAdaptiveOrder
+  void SelectOrder();
+
+  ReferenceFitTolerance tolerance_;
+  bool single_precision_;
+  double order_tolerance_ = 0;
+  size_t order_ = 3;
+  bool valid_ = false;
+  uint64_t hash_ = 0;
+  Telemetry::Waypoints ptsx_;
+  Telemetry::Waypoints ptsy_;
+  double px_ = 0;
+  double py_ = 0;
+  double psi_ = 0;
+  MPCCoeffs coeffs_;
+  Telemetry::Waypoints xs_;
+  Telemetry::Waypoints ys_;
+  // The same in float, for the single precision fit
+  FixedVector<float, Telemetry::kMaxWaypoints> float_xs_;
+  FixedVector<float, Telemetry::kMaxWaypoints> float_ys_;
+  size_t hits_ = 0;
+  size_t refits_ = 0;
+  size_t misses_ = 0;
+};
+
+// The cubics of the cars of a telemetry_batch fitted together rather than
+// each by a ReferenceFitCache of its own: the waypoints of every car laid
+// out a point of each car after another, so the transforms and the normal
+// equations of the cars fill the SIMD lanes of FitCubicLanes (see
+// SimdKernels.h), each car a lane. The cars of a simulator move every tick,
+// so their caches refit nearly every time anyway; together a batch of many
+// cars takes a fraction of the time of their fits one by one. The fits are
+// those of FitInVehicleFrame<3>, in double; a batch whose cars have
+// different numbers of waypoints isn't fitted together.
+class FleetReferenceFit {
+public:
+  // The cubics of the n cars into coeffs, false (and nothing fitted) if
+  // their numbers of waypoints differ or are under 4
+  bool Fit(const Telemetry *cars, size_t n, MPCCoeffs *coeffs);
+
+  // The waypoints of car k of the last fit in its vehicle frame
+  void Waypoints(size_t k, Telemetry::Waypoints &xs, Telemetry::Waypoints &ys) const;
+
+private:
+  size_t cars_ = 0;
+  size_t points_ = 0;
+  // The pose of each car, then its waypoints, point j of car k at j *
+  // cars_ + k, and the coefficients of all, coefficient i of car k at i *
+  // cars_ + k; grown to the largest batch
+  std::vector<double> px_;
+  std::vector<double> py_;
+  std::vector<double> cos_;
+  std::vector<double> sin_;
+  std::vector<double> xs_;
+  std::vector<double> ys_;
+  std::vector<double> coeffs_;
+};
+
+#endif /* REFERENCE_FIT_H */
@@ -0,0 +1,105 @@
+#include "ReferenceTable.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Distance along the track behind the vehicle where the table starts, in m
+const double kBehind = 10;
+
+}  // namespace
+
+ReferenceTable::ReferenceTable(const TrackSpline &track, double px, double py, double psi,
+                               double s, double look_ahead, double spacing) {
+  Build(track, px, py, psi, s, look_ahead, spacing);
+}
+
+void ReferenceTable::Build(const TrackSpline &track, double px, double py, double psi, double s,
+                           double look_ahead, double spacing) {
+  xs_.clear();
+  f_.clear();
+  df_.clear();
+  psides_.clear();
+  dpsides_.clear();
+  const double c = std::cos(psi);
+  const double sn = std::sin(psi);
+  double last_psides = 0;
+  for (double d = -kBehind; d <= look_ahead; d += spacing) {
+    const TrackPoint p = track.At(s + d);
+    const double x = (p.x - px) * c + (p.y - py) * sn;
+    const double y = (p.y - py) * c - (p.x - px) * sn;
+    if (!xs_.empty() && x <= xs_.back()) {
+      if (xs_.size() >= 2) {
+        break;
+      }
+      // Behind the vehicle the track may still run backwards, start over
+      xs_.clear();
+      f_.clear();
+      df_.clear();
+      psides_.clear();
+      dpsides_.clear();
+    }
+
+    // Heading of the tangent relative to the vehicle, continued from the
+    // last sample, and its rate by x: the curvature over dx / ds
+    const double tx = p.dx * c + p.dy * sn;
+    const double ty = p.dy * c - p.dx * sn;
+    double psides = std::atan2(ty, tx);
+    if (!psides_.empty()) {
+      psides = last_psides + std::remainder(psides - last_psides, 2 * M_PI);
+    }
+    last_psides = psides;
+    const double speed = std::hypot(p.dx, p.dy);
+    const double curvature = (p.dx * p.ddy - p.dy * p.ddx) / (speed * speed * speed);
+
+    xs_.push_back(x);
+    f_.push_back(y);
+    df_.push_back(ty / tx);
+    psides_.push_back(psides);
+    dpsides_.push_back(curvature * speed / tx);
+  }
+}
+
+void ReferenceTable::At(double x, double &f, double &psides, double &df,
+                        double &dpsides) const {
+  const size_t n = xs_.size();
+  if (x <= xs_.front() || x >= xs_.back()) {
+    const size_t k = x <= xs_.front() ? 0 : n - 1;
+    const double dx = x - xs_[k];
+    f = f_[k] + df_[k] * dx;
+    df = df_[k];
+    psides = psides_[k] + dpsides_[k] * dx;
+    dpsides = dpsides_[k];
+    return;
+  }
+  const size_t k = std::upper_bound(xs_.begin(), xs_.end(), x) - xs_.begin() - 1;
+  const double h = xs_[k + 1] - xs_[k];
+  const double t = (x - xs_[k]) / h;
+  const double t2 = t * t;
+  const double t3 = t2 * t;
+  // Hermite basis and its derivative by t
+  const double h00 = 2 * t3 - 3 * t2 + 1;
+  const double h10 = t3 - 2 * t2 + t;
+  const double h01 = 3 * t2 - 2 * t3;
+  const double h11 = t3 - t2;
+  const double d00 = 6 * t2 - 6 * t;
+  const double d10 = 3 * t2 - 4 * t + 1;
+  const double d11 = 3 * t2 - 2 * t;
+  f = h00 * f_[k] + h10 * h * df_[k] + h01 * f_[k + 1] + h11 * h * df_[k + 1];
+  df = (d00 * (f_[k] - f_[k + 1])) / h + d10 * df_[k] + d11 * df_[k + 1];
+  psides = h00 * psides_[k] + h10 * h * dpsides_[k] + h01 * psides_[k + 1] +
+           h11 * h * dpsides_[k + 1];
+  dpsides = (d00 * (psides_[k] - psides_[k + 1])) / h + d10 * dpsides_[k] + d11 * dpsides_[k + 1];
+}
+
+double ReferenceTable::Offset(double x) const {
+  double f, psides, df, dpsides;
+  At(x, f, psides, df, dpsides);
+  return f;
+}
+
+double ReferenceTable::Heading(double x) const {
+  double f, psides, df, dpsides;
+  At(x, f, psides, df, dpsides);
+  return psides;
+}
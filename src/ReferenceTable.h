@@ -0,0 +1,103 @@
+#ifndef REFERENCE_TABLE_H
+#define REFERENCE_TABLE_H
+
+#include <cstddef>
+#include <vector>
+#include "KinematicModel.h"
+#include "TrackSpline.h"
+
+// The reference of the model (see ModelStep) tabulated from the track
+// instead of the cubic of the tick: the lateral offset f(x) of the track
+// and its heading psides(x) in the vehicle frame, and their rates df / dx
+// and dpsides / dx, sampled along the track every spacing meters from a
+// little behind the vehicle to look_ahead ahead of it.
+//
+// Between samples both are cubic Hermite interpolants of the values and
+// rates at the samples, so the rates the linearization takes (the slope
+// for A(4, 0), the rate of the heading for A(5, 0), see ModelJacobian) are
+// their exact derivatives. The heading comes from the tangents of the
+// track once per sample when the table is built and is only interpolated
+// in the model, so a step of the model needs no polynomial and no
+// transcendental function for its reference. Past the last sample both
+// continue along their last rate.
+//
+// The table holds as far ahead as the track runs forward in the vehicle
+// frame: it stops at a sample whose x doesn't grow, where y is no longer a
+// function of x (a hairpin). One is built per tick, for the pose of its
+// telemetry, see MPCBase::reference_table, or rebuilt in place by Build,
+// which keeps the capacity of the samples and so allocates nothing once
+// the table has been as long.
+class ReferenceTable {
+public:
+  // The track from s along it, the distance of the vehicle at (px, py)
+  // heading psi (see TrackSpline::Project), in its frame
+  ReferenceTable(const TrackSpline &track, double px, double py, double psi, double s,
+                 double look_ahead = 100, double spacing = 1);
+
+  // The table of the constructor, in place of this one
+  void Build(const TrackSpline &track, double px, double py, double psi, double s,
+             double look_ahead = 100, double spacing = 1);
+
+  // Offset and heading of the reference at x, and their rates by x
+  void At(double x, double &f, double &psides, double &df, double &dpsides) const;
+
+  double Offset(double x) const;
+  double Heading(double x) const;
+
+  // x of the first and the last sample
+  double front() const { return xs_.front(); }
+  double back() const { return xs_.back(); }
+
+private:
+  std::vector<double> xs_;
+  std::vector<double> f_;
+  std::vector<double> df_;
+  std::vector<double> psides_;
+  std::vector<double> dpsides_;
+};
+
+// The reference of ModelStep from the table rather than a polynomial
+inline double ReferenceOffset(const ReferenceTable &reference, double x) {
+  return reference.Offset(x);
+}
+
+inline double ReferenceHeading(const ReferenceTable &reference, double x) {
+  return reference.Heading(x);
+}
+
+// The table linearized about x (see LinearReference)
+inline LinearReference<double> LinearizeReference(const ReferenceTable &reference, double x) {
+  LinearReference<double> linear;
+  linear.x = x;
+  reference.At(x, linear.f, linear.psides, linear.df, linear.dpsides);
+  return linear;
+}
+
+// EvaluateStageTerms from the table: the curvature term ddf is the one the
+// polynomial would have, (1 + df^2) dpsides / dx, see ModelJacobian
+template <int S, class X, class Psi, class Epsi>
+inline void EvaluateStageTerms(const Eigen::ArrayBase<X> &x, const Eigen::ArrayBase<Psi> &psi,
+                               const Eigen::ArrayBase<Epsi> &epsi,
+                               const ReferenceTable &reference, StageTerms<S> &terms) {
+  terms.cos_psi = psi.cos();
+  terms.sin_psi = psi.sin();
+  terms.cos_epsi = epsi.cos();
+  terms.sin_epsi = epsi.sin();
+  for (int t = 0; t < S; t++) {
+    double f;
+    double psides;
+    double dpsides;
+    reference.At(x[t], f, psides, terms.df[t], dpsides);
+    terms.ddf[t] = (1 + terms.df[t] * terms.df[t]) * dpsides;
+  }
+}
+
+template <int S, class Trajectory>
+inline void EvaluateStageTerms(const Eigen::MatrixBase<Trajectory> &z,
+                               const ReferenceTable &reference, StageTerms<S> &terms) {
+  EvaluateStageTerms(z.row(0).template head<S>().transpose().array(),
+                     z.row(2).template head<S>().transpose().array(),
+                     z.row(5).template head<S>().transpose().array(), reference, terms);
+}
+
+#endif /* REFERENCE_TABLE_H */
@@ -0,0 +1,87 @@
+#include "RefiningMPC.h"
+#include <chrono>
+#include <cmath>
+
+RefiningMPC::RefiningMPC(std::unique_ptr<MPCBase> mpc, const RefinementPolicy &policy)
+    : mpc_(std::move(mpc)), policy_(policy) {}
+
+MPCSolution RefiningMPC::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
+  mpc_->prev_a = prev_a;
+  mpc_->max_solve_time = max_solve_time;
+  mpc_->cost_schedule = cost_schedule;
+  mpc_->preempt = preempt;
+  if (repeat_) {
+    mpc_->RepeatTick();
+  }
+  const MPCSolution result = mpc_->Solve(state, coeffs);
+  repeat_ = false;
+  pending_ = false;
+  last_coeffs_ = coeffs;
+  has_last_ = true;
+  status_ = mpc_->status();
+  cost_ = mpc_->cost();
+  iterations_ = mpc_->iterations();
+  return result;
+}
+
+void RefiningMPC::Prepare() {
+  mpc_->Prepare();
+  pending_ = has_last_ && mpc_->status() != SolveStatus::kFailed;
+}
+
+bool RefiningMPC::Refine(const std::atomic<bool> &preempt) {
+  if (!pending_) {
+    return false;
+  }
+  pending_ = false;
+  refinements_++;
+
+  MPCState state;
+  MPCCoeffs coeffs;
+  mpc_->PredictNextTick(last_coeffs_, state, coeffs);
+  mpc_->prev_a = prev_a;
+  mpc_->cost_schedule = cost_schedule;
+  mpc_->preempt = &preempt;
+  const std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(policy_.budget));
+  sweeps_ = 0;
+  for (; sweeps_ < policy_.max_sweeps; sweeps_++) {
+    const double left =
+        std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+    if (left <= 0 || preempt.load(std::memory_order_relaxed)) {
+      break;
+    }
+    // The first sweep from the plan of the last tick shifted, as a Solve
+    // of the next tick would, the others from the sweep before
+    if (sweeps_ > 0) {
+      mpc_->RepeatTick();
+    }
+    mpc_->max_solve_time = left;
+    mpc_->Solve(state, coeffs);
+    // Even a failed sweep leaves a plan for the next tick, the shifted one
+    repeat_ = true;
+    if (sweeps_ == 0) {
+      first_cost_ = mpc_->cost();
+    }
+    const double last_cost = refined_cost_;
+    refined_cost_ = mpc_->cost();
+    if (mpc_->status() != SolveStatus::kSolved ||
+        (sweeps_ > 0 && last_cost - refined_cost_ < policy_.tolerance * fabs(last_cost))) {
+      sweeps_++;
+      break;
+    }
+  }
+  mpc_->preempt = MPCBase::preempt;
+  interrupted_ = preempt.load(std::memory_order_relaxed);
+  preemptions_ += interrupted_;
+  return true;
+}
+
+void RefiningMPC::Reset() {
+  mpc_->Reset();
+  has_last_ = false;
+  pending_ = false;
+  repeat_ = false;
+}
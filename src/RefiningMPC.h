@@ -0,0 +1,104 @@
+#ifndef REFINING_MPC_H
+#define REFINING_MPC_H
+
+#include <atomic>
+#include <memory>
+#include "MPC.h"
+
+// How far the plan is refined in the idle time of a tick
+struct RefinementPolicy {
+  // Wall-clock time of a refinement, all of its sweeps, in seconds
+  double budget = 0.1;
+  // Solves of the inner MPC a refinement makes at most, each started from
+  // the plan of the one before; it stops early once a sweep lowers the cost
+  // by less than tolerance of it
+  size_t max_sweeps = 8;
+  double tolerance = 1e-4;
+};
+
+// MPC over any MPCBase that keeps improving its plan while the solver
+// thread would idle, between the reply of a tick and the telemetry of the
+// next.
+//
+// Prepare, called once the actuations are sent, only marks the plan for
+// refinement. Refine, called by the worker when it has nothing else to do,
+// then solves the inner MPC again for the next tick as the plan predicts
+// it (see MPCBase::PredictNextTick), sweep after sweep: more Ipopt, SQP or
+// iLQR iterations from a converged start, or further RTI steps, each
+// linearized along the plan of the last. The next Solve starts from the
+// refined plan as it is (see MPCBase::RepeatTick) rather than from the
+// plan of the last tick shifted by one step, so the solve on the deadline
+// starts close to the optimum, often at it.
+//
+// Unlike SpeculativeMPC the refined plan is never the reply, the measured
+// state is always solved for; and it runs on the solver thread itself,
+// stopped between two iterations the moment preempt is set, i.e. telemetry
+// came in (see MPCBase::preempt). A preempted refinement still leaves the
+// best iterate it got to as the start.
+class RefiningMPC : public MPCBase {
+public:
+  RefiningMPC(std::unique_ptr<MPCBase> mpc, const RefinementPolicy &policy);
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  void Prepare() override;
+
+  void Reset() override;
+
+  // From an outer wrapper, for the next Solve
+  void Seed(double delta, double a) override { mpc_->Seed(delta, a); }
+  void RepeatTick() override { repeat_ = true; }
+
+  size_t horizon_length() const override { return mpc_->horizon_length(); }
+  double timestep() const override { return mpc_->timestep(); }
+  double stage_time(size_t t) const override { return mpc_->stage_time(t); }
+  const EffortController *effort() const override { return mpc_->effort(); }
+  size_t slack_activations() const override { return mpc_->slack_activations(); }
+
+  MPCState planned_state(size_t t) const override { return mpc_->planned_state(t); }
+
+  void planned_actuations(size_t t, double &delta, double &a) const override {
+    mpc_->planned_actuations(t, delta, a);
+  }
+
+  // Refine the plan of the last Solve until preempt is set, the budget is
+  // spent or the sweeps converge. False if there was nothing to refine: no
+  // Prepare since the last Refine or Solve, or a failed last Solve.
+  bool Refine(const std::atomic<bool> &preempt);
+
+  // Of the last Refine: the sweeps it made, whether preempt stopped it, and
+  // the costs of its first sweep and of its last
+  size_t sweeps() const { return sweeps_; }
+  bool interrupted() const { return interrupted_; }
+  double first_cost() const { return first_cost_; }
+  double refined_cost() const { return refined_cost_; }
+
+  // Refinements and those preempted so far
+  size_t refinements() const { return refinements_; }
+  size_t preemptions() const { return preemptions_; }
+
+  // The inner MPC
+  const MPCBase &inner() const { return *mpc_; }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  std::unique_ptr<MPCBase> mpc_;
+  RefinementPolicy policy_;
+
+  // Polynomial of the last Solve, whether it can be refined, and whether
+  // the next Solve is for the tick the plan is for
+  MPCCoeffs last_coeffs_;
+  bool has_last_ = false;
+  bool pending_ = false;
+  bool repeat_ = false;
+
+  size_t sweeps_ = 0;
+  bool interrupted_ = false;
+  double first_cost_ = 0;
+  double refined_cost_ = 0;
+  size_t refinements_ = 0;
+  size_t preemptions_ = 0;
+};
+
+#endif /* REFINING_MPC_H */
@@ -0,0 +1,120 @@
+#include "RegimeMPC.h"
+#include <algorithm>
+#include <cmath>
+#include <ratio>
+
+const char *RoadRegimeName(RoadRegime regime) {
+  switch (regime) {
+    case RoadRegime::kStraight:
+      return "straight";
+    case RoadRegime::kCurve:
+      return "curve";
+    case RoadRegime::kHairpin:
+      return "hairpin";
+  }
+  return "unknown";
+}
+
+double ReferenceCurvature(const MPCCoeffs &coeffs, double distance) {
+  double curvature = 0;
+  for (int k = 0; k < 4; k++) {
+    const double x = distance * k / 3;
+    const double slope = coeffs[1] + 2 * coeffs[2] * x + 3 * coeffs[3] * x * x;
+    const double second = 2 * coeffs[2] + 6 * coeffs[3] * x;
+    const double stretch = 1 + slope * slope;
+    curvature = std::max(curvature, std::fabs(second) / (stretch * std::sqrt(stretch)));
+  }
+  return curvature;
+}
+
+RoadRegime ClassifyRoad(const MPCCoeffs &coeffs, double v, const RegimePolicy &policy,
+                        RoadRegime last) {
+  const double distance = std::max(policy.min_distance, std::fabs(v) * policy.look_ahead);
+  const double curvature = ReferenceCurvature(coeffs, distance);
+  // The thresholds moved away from the regime held, so it takes a clear
+  // change of the road to leave it
+  const double up = 1 + policy.hysteresis;
+  const double down = 1 - policy.hysteresis;
+  const double curve = policy.curve_curvature * (last == RoadRegime::kStraight ? up : down);
+  const double hairpin = policy.hairpin_curvature * (last == RoadRegime::kHairpin ? down : up);
+  return curvature >= hairpin ? RoadRegime::kHairpin
+         : curvature >= curve ? RoadRegime::kCurve
+                              : RoadRegime::kStraight;
+}
+
+RegimeMPC::RegimeMPC(const RegimePolicy &policy) : policy_(policy) {}
+
+void RegimeMPC::SetVariant(RoadRegime regime, std::unique_ptr<MPCBase> mpc,
+                           const CostSchedule &weights) {
+  variants_[static_cast<size_t>(regime)] = std::move(mpc);
+  weights_[static_cast<size_t>(regime)] = weights;
+}
+
+void RegimeMPC::ControlEffort(const EffortPolicy &policy) {
+  for (const std::unique_ptr<MPCBase> &variant : variants_) {
+    variant->ControlEffort(policy);
+  }
+}
+
+void RegimeMPC::SoftenConstraints(double penalty) {
+  for (const std::unique_ptr<MPCBase> &variant : variants_) {
+    variant->SoftenConstraints(penalty);
+  }
+}
+
+void RegimeMPC::SampleReference(bool sampled) {
+  for (const std::unique_ptr<MPCBase> &variant : variants_) {
+    variant->SampleReference(sampled);
+  }
+}
+
+void RegimeMPC::SetReferenceOrder(size_t order) {
+  for (const std::unique_ptr<MPCBase> &variant : variants_) {
+    variant->SetReferenceOrder(order);
+  }
+}
+
+size_t RegimeMPC::slack_activations() const {
+  size_t count = 0;
+  for (const std::unique_ptr<MPCBase> &variant : variants_) {
+    count += variant->slack_activations();
+  }
+  return count;
+}
+
+MPCSolution RegimeMPC::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
+  const RoadRegime next = ClassifyRoad(coeffs, state[3], policy_, regime_);
+  if (next != regime_) {
+    regime_ = next;
+    variant().Reset();
+    switches_++;
+  }
+  solves_[static_cast<size_t>(regime_)]++;
+
+  MPCBase &mpc = variant();
+  const CostSchedule &weights = weights_[static_cast<size_t>(regime_)];
+  mpc.prev_a = prev_a;
+  mpc.max_solve_time = max_solve_time;
+  mpc.cost_schedule = weights.empty() ? cost_schedule : weights;
+  const MPCSolution result = mpc.Solve(state, coeffs);
+  status_ = mpc.status();
+  cost_ = mpc.cost();
+  return result;
+}
+
+std::unique_ptr<RegimeMPC> MakeRegimeMPC(const RegimePolicy &policy, Derivatives derivatives) {
+  std::unique_ptr<RegimeMPC> mpc(new RegimeMPC(policy));
+  mpc->SetVariant(RoadRegime::kStraight,
+                  std::unique_ptr<MPCBase>(
+                      new MPC<8, std::ratio<1, 5>, NoBlocking, Integrator::kRK4>(derivatives)));
+  mpc->SetVariant(RoadRegime::kCurve, std::unique_ptr<MPCBase>(new MPC<15>(derivatives)));
+  CostWeights hairpin;
+  hairpin.v_ref *= 0.6;
+  hairpin.cte *= 2;
+  hairpin.epsi *= 2;
+  CostSchedule hairpin_weights;
+  hairpin_weights.AddPoint(0, hairpin);
+  mpc->SetVariant(RoadRegime::kHairpin, std::unique_ptr<MPCBase>(new MPC<15>(derivatives)),
+                  hairpin_weights);
+  return mpc;
+}
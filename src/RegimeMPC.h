@@ -0,0 +1,110 @@
+#ifndef REGIME_MPC_H
+#define REGIME_MPC_H
+
+#include <cstddef>
+#include <memory>
+#include "CostWeights.h"
+#include "MPC.h"
+
+// The road ahead of the car as RegimeMPC tells it from the reference
+enum class RoadRegime { kStraight, kCurve, kHairpin };
+const size_t kRoadRegimes = 3;
+
+const char *RoadRegimeName(RoadRegime regime);
+
+// Where RegimeMPC moves between its variants
+struct RegimePolicy {
+  // Curvature (1/m) of the reference from which the road is a curve, a
+  // radius under 100 m, and a hairpin, under 25 m
+  double curve_curvature = 0.01;
+  double hairpin_curvature = 0.04;
+  // Fraction of a threshold the curvature must pass it by to switch, so a
+  // bend at a threshold doesn't switch every tick
+  double hysteresis = 0.2;
+  // The curvature is taken over the distance the car covers in look_ahead
+  // seconds at its speed, and over min_distance at least
+  double look_ahead = 1.5;
+  double min_distance = 10;
+};
+
+// The largest curvature of the cubic coeffs over [0, distance], from the
+// curvatures at its ends and at the two points between: four evaluations of
+// the slope and the second derivative, nothing a tick notices
+double ReferenceCurvature(const MPCCoeffs &coeffs, double distance);
+
+// The regime of the reference coeffs for a car at speed v (the units of the
+// state), held at last unless the curvature passes a threshold of policy by
+// its hysteresis
+RoadRegime ClassifyRoad(const MPCCoeffs &coeffs, double v, const RegimePolicy &policy,
+                        RoadRegime last);
+
+// MPC picking its variant every tick from the road ahead: a small family of
+// MPCs, one for each RoadRegime, each with the horizon and the cost weights
+// the regime needs and so a tape of its own, prerecorded and optimized when
+// it is made. A straight needs few stages over a long look ahead, a hairpin
+// fine steps and a slower reference speed; each variant is as small as its
+// regime allows instead of all of them being sized for the worst.
+//
+// Like AdaptiveHorizonMPC the variants are made up front and switching only
+// changes which one is called; a variant taken into use is Reset, its last
+// plan is from an older tick.
+class RegimeMPC : public MPCBase {
+public:
+  explicit RegimeMPC(const RegimePolicy &policy);
+
+  // The variant of regime, solving with weights, or with the cost schedule
+  // of this MPC when it has no points. Every regime needs one.
+  void SetVariant(RoadRegime regime, std::unique_ptr<MPCBase> mpc,
+                  const CostSchedule &weights = CostSchedule());
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  void Prepare() override { variant().Prepare(); }
+
+  void Reset() override { variant().Reset(); }
+
+  void ControlEffort(const EffortPolicy &policy) override;
+  const EffortController *effort() const override { return variant().effort(); }
+
+  void SoftenConstraints(double penalty) override;
+  size_t slack_activations() const override;
+
+  void SampleReference(bool sampled) override;
+  void SetReferenceOrder(size_t order) override;
+
+  size_t horizon_length() const override { return variant().horizon_length(); }
+  double timestep() const override { return variant().timestep(); }
+  double stage_time(size_t t) const override { return variant().stage_time(t); }
+
+  MPCState planned_state(size_t t) const override { return variant().planned_state(t); }
+
+  void planned_actuations(size_t t, double &delta, double &a) const override {
+    variant().planned_actuations(t, delta, a);
+  }
+
+  // Regime of the last Solve, the number of switches so far and the solves
+  // of each regime
+  RoadRegime regime() const { return regime_; }
+  size_t switches() const { return switches_; }
+  size_t solves(RoadRegime regime) const { return solves_[static_cast<size_t>(regime)]; }
+
+private:
+  MPCBase &variant() const { return *variants_[static_cast<size_t>(regime_)]; }
+
+  RegimePolicy policy_;
+  std::unique_ptr<MPCBase> variants_[kRoadRegimes];
+  CostSchedule weights_[kRoadRegimes];
+
+  RoadRegime regime_ = RoadRegime::kCurve;
+  size_t switches_ = 0;
+  size_t solves_[kRoadRegimes] = {};
+};
+
+// The Ipopt MPC over 8 steps of 0.2 s integrated by RK4 on straights, 1.6 s
+// ahead in half the stages, 15 steps of 0.1 s (the tuned default) in curves,
+// and 15 steps of 0.1 s with the reference speed cut to 60 % and the errors
+// weighed twice in hairpins.
+std::unique_ptr<RegimeMPC> MakeRegimeMPC(const RegimePolicy &policy,
+                                         Derivatives derivatives = Derivatives::kTape);
+
+#endif /* REGIME_MPC_H */
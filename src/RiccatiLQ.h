@@ -0,0 +1,122 @@
+#ifndef RICCATI_LQ_H
+#define RICCATI_LQ_H
+
+#include <array>
+#include <cstddef>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/Cholesky"
+
+// Equality constrained LQ problem over K stages
+//
+//   min sum_t 0.5 [x;u]' [Q S'; S R] [x;u] + q'x + r'u  +  0.5 x' Qf x + qf'x
+//   s.t. x[t+1] = A x[t] + B u[t] + c,   x[0] given
+//
+// with NX states and NU inputs per stage, solved by a backward Riccati
+// recursion and a forward rollout of the affine feedback. The work is O(K)
+// in small fixed-size blocks, the only factorization per stage is the LLT
+// of the NU x NU reduced input Hessian. Nothing is allocated by Solve.
+template <int NX, int NU, size_t K>
+class RiccatiLQ {
+public:
+  typedef Eigen::Matrix<double, NX, NX> StateMatrix;
+  typedef Eigen::Matrix<double, NX, NU> InputMatrix;
+  typedef Eigen::Matrix<double, NU, NX> CrossMatrix;
+  typedef Eigen::Matrix<double, NU, NU> InputHessian;
+  typedef Eigen::Matrix<double, NX, 1> StateVector;
+  typedef Eigen::Matrix<double, NU, 1> InputVector;
+
+  // Dynamics and cost of stage t (< K), filled by the caller
+  struct Stage {
+    StateMatrix A;
+    InputMatrix B;
+    StateVector c;
+    StateMatrix Q;
+    CrossMatrix S;
+    InputHessian R;
+    StateVector q;
+    InputVector r;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  Stage &stage(size_t t) { return stages_[t]; }
+  // Cost of the last state x[K]
+  StateMatrix &terminal_hessian() { return qf_; }
+  StateVector &terminal_gradient() { return qf_gradient_; }
+
+  // Solve from x0 into x (K + 1 states) and u (K inputs). Return false if a
+  // reduced input Hessian isn't positive definite.
+  bool Solve(const StateVector &x0, std::array<StateVector, K + 1> &x,
+             std::array<InputVector, K> &u) {
+    // Backward: the cost-to-go of x[t] is 0.5 x'Px + p'x
+    StateMatrix p_mat = qf_;
+    StateVector p_vec = qf_gradient_;
+    for (size_t i = K; i-- > 0;) {
+      const Stage &s = stages_[i];
+      pa_.noalias() = p_mat * s.A;
+      pb_.noalias() = p_mat * s.B;
+      h_.noalias() = p_mat * s.c;
+      h_ += p_vec;
+
+      quu_ = s.R;
+      quu_.noalias() += s.B.transpose() * pb_;
+      qux_ = s.S;
+      qux_.noalias() += s.B.transpose() * pa_;
+      qxx_ = s.Q;
+      qxx_.noalias() += s.A.transpose() * pa_;
+      qu_ = s.r;
+      qu_.noalias() += s.B.transpose() * h_;
+      qx_ = s.q;
+      qx_.noalias() += s.A.transpose() * h_;
+
+      llt_.compute(quu_);
+      if (llt_.info() != Eigen::Success) {
+        return false;
+      }
+      gain_[i] = -llt_.solve(qux_);
+      feedforward_[i] = -llt_.solve(qu_);
+
+      p_mat = qxx_;
+      p_mat.noalias() += qux_.transpose() * gain_[i];
+      p_mat = 0.5 * (p_mat + p_mat.transpose()).eval();
+      p_vec = qx_;
+      p_vec.noalias() += qux_.transpose() * feedforward_[i];
+    }
+
+    // Forward
+    x[0] = x0;
+    for (size_t i = 0; i < K; i++) {
+      const Stage &s = stages_[i];
+      u[i] = feedforward_[i];
+      u[i].noalias() += gain_[i] * x[i];
+      x[i + 1] = s.c;
+      x[i + 1].noalias() += s.A * x[i];
+      x[i + 1].noalias() += s.B * u[i];
+    }
+    return true;
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  std::array<Stage, K> stages_;
+  StateMatrix qf_ = StateMatrix::Zero();
+  StateVector qf_gradient_ = StateVector::Zero();
+
+  // Affine feedback u = gain x + feedforward of every stage
+  std::array<CrossMatrix, K> gain_;
+  std::array<InputVector, K> feedforward_;
+
+  // Scratch
+  StateMatrix pa_;
+  InputMatrix pb_;
+  StateVector h_;
+  InputHessian quu_;
+  CrossMatrix qux_;
+  StateMatrix qxx_;
+  InputVector qu_;
+  StateVector qx_;
+  Eigen::LLT<InputHessian> llt_;
+};
+
+#endif /* RICCATI_LQ_H */
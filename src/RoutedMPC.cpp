@@ -0,0 +1,203 @@
+#include "RoutedMPC.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+const char *RouteName(Route route) {
+  switch (route) {
+    case Route::kNLP:
+      return "nlp";
+    case Route::kQP:
+      return "qp";
+    case Route::kTable:
+      return "table";
+  }
+  return "unknown";
+}
+
+const char *RouteReasonName(RouteReason reason) {
+  switch (reason) {
+    case RouteReason::kRoad:
+      return "road";
+    case RouteReason::kTracking:
+      return "tracking";
+    case RouteReason::kFailure:
+      return "failure";
+    case RouteReason::kOverload:
+      return "overload";
+  }
+  return "unknown";
+}
+
+Route ChooseRoute(const RouteFeatures &features, const RoutePolicy &policy,
+                  const bool available[kRoutes], RouteReason &reason) {
+  Route route = Route::kNLP;
+  reason = RouteReason::kRoad;
+  if (std::fabs(features.cte) > policy.cte_limit ||
+      std::fabs(features.epsi) > policy.epsi_limit) {
+    reason = RouteReason::kTracking;
+  } else if (features.road == RoadRegime::kStraight) {
+    if (features.qp_failed) {
+      reason = RouteReason::kFailure;
+    } else {
+      route = Route::kQP;
+    }
+  }
+
+  // A route not solved yet is taken to fit
+  const auto fits = [&features, &policy](size_t r) {
+    return features.seconds[r] * policy.margin <= features.budget;
+  };
+  if (fits(static_cast<size_t>(route))) {
+    return route;
+  }
+  // The first cheaper route that fits, or the cheapest at hand
+  size_t cheaper = static_cast<size_t>(route);
+  for (size_t r = cheaper + 1; r < kRoutes; r++) {
+    if (available[r]) {
+      cheaper = r;
+      if (fits(r)) {
+        break;
+      }
+    }
+  }
+  if (cheaper != static_cast<size_t>(route)) {
+    reason = RouteReason::kOverload;
+  }
+  return static_cast<Route>(cheaper);
+}
+
+RoutedMPC::RoutedMPC(const RoutePolicy &policy) : policy_(policy) {}
+
+void RoutedMPC::SetRoute(Route route, std::unique_ptr<MPCBase> mpc) {
+  routes_[static_cast<size_t>(route)] = std::move(mpc);
+}
+
+void RoutedMPC::SoftenConstraints(double penalty) {
+  for (const std::unique_ptr<MPCBase> &route : routes_) {
+    if (route) {
+      route->SoftenConstraints(penalty);
+    }
+  }
+}
+
+void RoutedMPC::SampleReference(bool sampled) {
+  for (const std::unique_ptr<MPCBase> &route : routes_) {
+    if (route) {
+      route->SampleReference(sampled);
+    }
+  }
+}
+
+void RoutedMPC::SetReferenceOrder(size_t order) {
+  for (const std::unique_ptr<MPCBase> &route : routes_) {
+    if (route) {
+      route->SetReferenceOrder(order);
+    }
+  }
+}
+
+size_t RoutedMPC::slack_activations() const {
+  size_t count = 0;
+  for (const std::unique_ptr<MPCBase> &route : routes_) {
+    if (route) {
+      count += route->slack_activations();
+    }
+  }
+  return count;
+}
+
+MPCSolution RoutedMPC::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
+  RouteFeatures features;
+  const double distance =
+      std::max(policy_.road.min_distance, std::fabs(state[3]) * policy_.road.look_ahead);
+  features.curvature = ReferenceCurvature(coeffs, distance);
+  features.road = ClassifyRoad(coeffs, state[3], policy_.road, decision_.features.road);
+  features.v = state[3];
+  features.cte = state[4];
+  features.epsi = state[5];
+  features.budget = max_solve_time;
+  std::copy(seconds_, seconds_ + kRoutes, features.seconds);
+  features.qp_failed = qp_failed_;
+  bool available[kRoutes];
+  for (size_t r = 0; r < kRoutes; r++) {
+    available[r] = routes_[r] != nullptr;
+  }
+  RouteReason reason;
+  const Route next = ChooseRoute(features, policy_, available, reason);
+  if (next != decision_.route) {
+    decision_.route = next;
+    backend().Reset();
+    switches_++;
+  }
+  const size_t r = static_cast<size_t>(next);
+  solves_[r]++;
+
+  MPCBase &mpc = backend();
+  mpc.prev_a = prev_a;
+  mpc.max_solve_time = max_solve_time;
+  mpc.cost_schedule = cost_schedule;
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  const MPCSolution result = mpc.Solve(state, coeffs);
+  const double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  status_ = mpc.status();
+  cost_ = mpc.cost();
+  iterations_ = mpc.iterations();
+
+  seconds_[r] = seconds_[r] > 0 ? (1 - policy_.smoothing) * seconds_[r] +
+                                      policy_.smoothing * seconds
+                                : seconds;
+  if (next == Route::kQP) {
+    qp_failed_ = status_ == SolveStatus::kFailed;
+  }
+  decision_.features = features;
+  decision_.reason = reason;
+  decision_.seconds = seconds;
+  decision_.status = status_;
+  decision_.iterations = iterations_;
+  decision_.cost = cost_;
+  return result;
+}
+
+std::unique_ptr<RoutedMPC> MakeRoutedMPC(const RoutePolicy &policy, SolverBackend backend,
+                                         size_t horizon,
+                                         const std::shared_ptr<const ExplicitMPC> &table) {
+  MPCProblem problem;
+  problem.horizon = horizon;
+  std::unique_ptr<MPCBase> nlp = MakeSolver(backend, problem);
+  std::unique_ptr<MPCBase> qp = MakeSolver(SolverBackend::kRTI, problem);
+  if (!nlp || !qp) {
+    return std::unique_ptr<RoutedMPC>();
+  }
+  std::unique_ptr<RoutedMPC> mpc(new RoutedMPC(policy));
+  mpc->SetRoute(Route::kNLP, std::move(nlp));
+  mpc->SetRoute(Route::kQP, std::move(qp));
+  if (table) {
+    mpc->SetRoute(Route::kTable,
+                  std::unique_ptr<MPCBase>(new TableMPC(MakeSolver(SolverBackend::kRTI, problem),
+                                                        table, TableMode::kTableFirst)));
+  }
+  return mpc;
+}
+
+RouteLog::RouteLog(const std::string &path) : csv_(path) {
+  ok_ = csv_.good();
+  csv_ << "session,curvature,road,v,cte,epsi,budget,nlp_seconds,qp_seconds,table_seconds,"
+          "qp_failed,route,reason,seconds,status,iterations,cost\n";
+}
+
+void RouteLog::Write(uint64_t session, const RouteDecision &decision) {
+  static const char *const kStatuses[] = {"solved", "deadline", "failed"};
+  const RouteFeatures &features = decision.features;
+  std::lock_guard<std::mutex> lock(mutex_);
+  csv_ << session << ',' << features.curvature << ',' << RoadRegimeName(features.road) << ','
+       << features.v << ',' << features.cte << ',' << features.epsi << ',' << features.budget;
+  for (double seconds : features.seconds) {
+    csv_ << ',' << seconds;
+  }
+  csv_ << ',' << features.qp_failed << ',' << RouteName(decision.route) << ','
+       << RouteReasonName(decision.reason) << ',' << decision.seconds << ','
+       << kStatuses[static_cast<size_t>(decision.status)] << ',' << decision.iterations << ','
+       << decision.cost << '\n';
+}
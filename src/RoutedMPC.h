@@ -0,0 +1,181 @@
+#ifndef ROUTED_MPC_H
+#define ROUTED_MPC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "ExplicitMPC.h"
+#include "MPC.h"
+#include "RegimeMPC.h"
+#include "SolverBackend.h"
+
+// The backends RoutedMPC routes a tick to, cheapest last
+enum class Route {
+  // Ipopt on the full nonlinear problem
+  kNLP,
+  // One QP on the model linearized along the last plan (the RTI)
+  kQP,
+  // The explicit MPC table inside its region, the QP outside
+  kTable
+};
+const size_t kRoutes = 3;
+
+const char *RouteName(Route route);
+
+// Why RoutedMPC took the route of a tick
+enum class RouteReason {
+  // The road ahead: the QP on straights, the NLP in curves and hairpins
+  kRoad,
+  // The car off its reference by more than the QP linearizes well
+  kTracking,
+  // The QP failed at the last tick
+  kFailure,
+  // The route of the reason before wouldn't solve in the time left, a
+  // cheaper one does
+  kOverload
+};
+
+const char *RouteReasonName(RouteReason reason);
+
+// Where RoutedMPC sends the ticks
+struct RoutePolicy {
+  // The regimes of the road, as RegimeMPC tells them
+  RegimePolicy road;
+  // Cross track (m) and orientation (rad) errors from which the NLP takes
+  // the tick whatever the road
+  double cte_limit = 1.0;
+  double epsi_limit = 0.2;
+  // A route is overloaded when the mean of its last solves times margin is
+  // over the time of the tick, max_solve_time
+  double margin = 1.5;
+  // Weight of a solve in the mean of its route
+  double smoothing = 0.2;
+};
+
+// What a tick is routed on, all of it at hand before the solve
+struct RouteFeatures {
+  // The largest curvature of the reference ahead (1/m, see
+  // ReferenceCurvature) and the regime it makes
+  double curvature = 0;
+  RoadRegime road = RoadRegime::kCurve;
+  // The speed and the errors of the state solved from
+  double v = 0;
+  double cte = 0;
+  double epsi = 0;
+  // The time of the solve, max_solve_time, and the mean seconds of the last
+  // solves of each route, 0 for one not solved yet
+  double budget = 0;
+  double seconds[kRoutes] = {};
+  // Whether the QP failed at its last solve
+  bool qp_failed = false;
+};
+
+// The route of a tick with features, on the routes at hand (the table
+// route need not be), and why
+Route ChooseRoute(const RouteFeatures &features, const RoutePolicy &policy,
+                  const bool available[kRoutes], RouteReason &reason);
+
+// A tick as RoutedMPC routed it, and how it went
+struct RouteDecision {
+  RouteFeatures features;
+  Route route = Route::kNLP;
+  RouteReason reason = RouteReason::kRoad;
+  // The solve of the route: its seconds, status, iterations and cost
+  double seconds = 0;
+  SolveStatus status = SolveStatus::kSolved;
+  int iterations = 0;
+  double cost = 0;
+};
+
+// MPC routing every tick to one of a few backends from cheap features of
+// it: the curvature of the reference ahead, the speed, the tracking
+// errors, the time of the solve and how the routes did lately. The QP of
+// the RTI on straights, where the model is nearly linear along the plan,
+// Ipopt in curves and hairpins or with the car off its line, and the table
+// when even the QP wouldn't finish in time (ChooseRoute).
+//
+// Like RegimeMPC the routes are made up front and switching only changes
+// which one is called; a route taken into use is Reset, its last plan is
+// from an older tick. The decision of every tick is kept for a RouteLog,
+// to tune the policy offline on what the routes did.
+class RoutedMPC : public MPCBase {
+public:
+  explicit RoutedMPC(const RoutePolicy &policy);
+
+  // The backend of route; the NLP and the QP are needed, the table is not
+  void SetRoute(Route route, std::unique_ptr<MPCBase> mpc);
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  void Prepare() override { backend().Prepare(); }
+
+  void Reset() override { backend().Reset(); }
+
+  void SoftenConstraints(double penalty) override;
+  size_t slack_activations() const override;
+
+  void SampleReference(bool sampled) override;
+  void SetReferenceOrder(size_t order) override;
+
+  size_t horizon_length() const override { return backend().horizon_length(); }
+  double timestep() const override { return backend().timestep(); }
+  double stage_time(size_t t) const override { return backend().stage_time(t); }
+
+  MPCState planned_state(size_t t) const override { return backend().planned_state(t); }
+
+  void planned_actuations(size_t t, double &delta, double &a) const override {
+    backend().planned_actuations(t, delta, a);
+  }
+
+  // The route of the last Solve and how it went, the switches so far and
+  // the solves of each route
+  const RouteDecision &decision() const { return decision_; }
+  Route route() const { return decision_.route; }
+  size_t switches() const { return switches_; }
+  size_t solves(Route route) const { return solves_[static_cast<size_t>(route)]; }
+
+private:
+  MPCBase &backend() const { return *routes_[static_cast<size_t>(decision_.route)]; }
+
+  RoutePolicy policy_;
+  std::unique_ptr<MPCBase> routes_[kRoutes];
+
+  RouteDecision decision_;
+  // The mean seconds of each route, and whether the QP failed last
+  double seconds_[kRoutes] = {};
+  bool qp_failed_ = false;
+  size_t switches_ = 0;
+  size_t solves_[kRoutes] = {};
+};
+
+// The Ipopt MPC of backend as the NLP, the RTI as the QP, and with a table
+// the RTI under a TableMPC, all over horizon steps; null if one of them
+// isn't compiled for it
+std::unique_ptr<RoutedMPC> MakeRoutedMPC(const RoutePolicy &policy, SolverBackend backend,
+                                         size_t horizon,
+                                         const std::shared_ptr<const ExplicitMPC> &table);
+
+// The decisions of the RoutedMPCs of a server, a CSV line each with the
+// session it was of, written as they are made by any thread: the features,
+// the route and its reason, and the seconds, status, iterations and cost of
+// the solve. The tracking errors of the next line of the session are the
+// outcome of the plan.
+class RouteLog {
+public:
+  // false from ok() if path can't be written
+  explicit RouteLog(const std::string &path);
+
+  bool ok() const { return ok_; }
+
+  void Write(uint64_t session, const RouteDecision &decision);
+
+private:
+  std::mutex mutex_;
+  std::ofstream csv_;
+  bool ok_ = false;
+};
+
+#endif /* ROUTED_MPC_H */
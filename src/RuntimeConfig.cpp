@@ -0,0 +1,202 @@
+#include "RuntimeConfig.h"
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+const size_t npos = MessageView::npos;
+
+// The finite number that is all of text, false if there is none
+bool ParseNumber(const MessageView &text, double &value) {
+  // As a string of its own, the url isn't null terminated
+  char digits[32];
+  if (text.empty() || text.size() >= sizeof(digits)) {
+    return false;
+  }
+  for (size_t k = 0; k < text.size(); k++) {
+    digits[k] = text[k];
+  }
+  digits[text.size()] = '\0';
+  char *end = nullptr;
+  value = std::strtod(digits, &end);
+  return *end == '\0' && std::isfinite(value);
+}
+
+// The weights under their names in the query
+struct WeightName {
+  const char *name;
+  double CostWeights::*weight;
+};
+const WeightName kWeightNames[] = {{"cte", &CostWeights::cte},
+                                   {"epsi", &CostWeights::epsi},
+                                   {"v", &CostWeights::v},
+                                   {"current_delta", &CostWeights::current_delta},
+                                   {"current_a", &CostWeights::current_a},
+                                   {"diff_delta", &CostWeights::diff_delta},
+                                   {"diff_a", &CostWeights::diff_a},
+                                   {"ref_v", &CostWeights::v_ref}};
+
+// The names of the query besides those of the weights
+const char *const kSettingNames[] = {"horizon", "solver", "budget", "tol", "max_iter",
+                                     "cpu_quota"};
+
+// text without the blanks around it
+std::string Trim(const std::string &text) {
+  const size_t begin = text.find_first_not_of(" \t\r");
+  if (begin == std::string::npos) {
+    return std::string();
+  }
+  return text.substr(begin, text.find_last_not_of(" \t\r") + 1 - begin);
+}
+
+bool IsQueryName(const std::string &name) {
+  for (const WeightName &weight : kWeightNames) {
+    if (name == weight.name) {
+      return true;
+    }
+  }
+  for (const char *setting : kSettingNames) {
+    if (name == setting) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+bool ParseConfigQuery(const MessageView &url, RuntimeConfig &config, std::string &error) {
+  RuntimeConfig parsed = config;
+  const size_t query = url.find('?');
+  for (size_t begin = query == npos ? url.size() : query + 1; begin < url.size();) {
+    size_t end = url.find('&', begin);
+    end = end == npos ? url.size() : end;
+    const MessageView parameter = url.substr(begin, end - begin);
+    const size_t equals = parameter.find('=');
+    const MessageView key = parameter.substr(0, equals);
+    const MessageView value = equals == npos ? MessageView() : parameter.substr(equals + 1);
+    begin = end + 1;
+    if (key.empty()) {
+      continue;
+    }
+    if (key.equals("solver")) {
+      if (!ParseSolverBackend(std::string(value.data, value.size()), parsed.solver)) {
+        error = "unknown solver " + std::string(value.data, value.size());
+        return false;
+      }
+      continue;
+    }
+    double number = 0;
+    if (!ParseNumber(value, number) || number < 0) {
+      error = std::string(key.data, key.size()) + " needs a number of 0 or more";
+      return false;
+    }
+    bool weight = false;
+    for (const WeightName &name : kWeightNames) {
+      if (key.equals(name.name)) {
+        parsed.weights.*name.weight = number;
+        weight = true;
+      }
+    }
+    if (weight) {
+      continue;
+    }
+    if (key.equals("horizon") && number >= 1) {
+      parsed.horizon = static_cast<size_t>(number);
+    } else if (key.equals("budget") && number > 0) {
+      parsed.max_solve_time = number * 1e-3;
+    } else if (key.equals("tol") && number > 0) {
+      parsed.tolerance = number;
+    } else if (key.equals("max_iter") && number >= 1) {
+      parsed.max_iterations = static_cast<int>(number);
+    } else if (key.equals("cpu_quota")) {
+      parsed.cpu_quota = number;
+    } else if (key.equals("horizon") || key.equals("budget") || key.equals("tol") ||
+               key.equals("max_iter")) {
+      error = std::string(key.data, key.size()) + " needs a number over 0";
+      return false;
+    } else {
+      error = "unknown parameter " + std::string(key.data, key.size());
+      return false;
+    }
+  }
+  config = parsed;
+  return true;
+}
+
+bool LoadConfigFile(const std::string &path, RuntimeConfig &config,
+                    std::vector<std::string> &flags, std::string &error) {
+  std::ifstream in(path);
+  if (!in) {
+    error = "can't open " + path;
+    return false;
+  }
+  RuntimeConfig parsed = config;
+  std::vector<std::string> file_flags;
+  std::string line;
+  for (size_t number = 1; std::getline(in, line); number++) {
+    line = Trim(line.substr(0, line.find('#')));
+    if (line.empty()) {
+      continue;
+    }
+    const size_t equals = line.find('=');
+    const std::string name = Trim(line.substr(0, equals));
+    const std::string value = equals == std::string::npos ? "" : Trim(line.substr(equals + 1));
+    const std::string setting = equals == std::string::npos ? name : name + "=" + value;
+    std::string reason;
+    if (name.empty()) {
+      reason = "a setting needs a name";
+    } else if (!IsQueryName(name)) {
+      file_flags.push_back(setting);
+    } else if (equals == std::string::npos) {
+      reason = name + " needs a value";
+    } else {
+      const std::string query = "?" + setting;
+      ParseConfigQuery(MessageView(query.data(), query.size()), parsed, reason);
+    }
+    if (!reason.empty()) {
+      error = path + ":" + std::to_string(number) + ": " + reason;
+      return false;
+    }
+  }
+  config = parsed;
+  flags.insert(flags.end(), file_flags.begin(), file_flags.end());
+  return true;
+}
+
+std::string ConfigJSON(const RuntimeConfig &config) {
+  std::ostringstream out;
+  out.precision(10);
+  out << "{\"version\":" << config.version << ",\"horizon\":" << config.horizon
+      << ",\"solver\":\"" << SolverBackendName(config.solver) << "\"";
+  for (const WeightName &name : kWeightNames) {
+    out << ",\"" << name.name << "\":" << config.weights.*name.weight;
+  }
+  out << ",\"budget\":" << config.max_solve_time * 1e3 << ",\"tol\":" << config.tolerance
+      << ",\"max_iter\":" << config.max_iterations << ",\"cpu_quota\":" << config.cpu_quota
+      << "}";
+  return out.str();
+}
+
+std::string ConfigFile(const RuntimeConfig &config) {
+  std::ostringstream out;
+  out.precision(10);
+  out << "horizon = " << config.horizon << "\nsolver = " << SolverBackendName(config.solver)
+      << "\n";
+  for (const WeightName &name : kWeightNames) {
+    out << name.name << " = " << config.weights.*name.weight << "\n";
+  }
+  out << "budget = " << config.max_solve_time * 1e3 << "\n";
+  if (config.tolerance > 0) {
+    out << "tol = " << config.tolerance << "\n";
+  }
+  if (config.max_iterations > 0) {
+    out << "max_iter = " << config.max_iterations << "\n";
+  }
+  if (config.cpu_quota > 0) {
+    out << "cpu_quota = " << config.cpu_quota << "\n";
+  }
+  return out.str();
+}
@@ -0,0 +1,108 @@
+#ifndef RUNTIME_CONFIG_H
+#define RUNTIME_CONFIG_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "CostWeights.h"
+#include "MessageView.h"
+#include "SolverBackend.h"
+
+// What can be tuned on a running server: the weights of the cost and the
+// reference speed, the horizon and the backend, the time allowed to each
+// solve, and the tolerance and iteration limit of the backends that have
+// them (see MPCBase::SetTolerances). Starts as the command line has it,
+// version 0, and every change published is the next version.
+struct RuntimeConfig {
+  uint64_t version = 0;
+  size_t horizon = 15;
+  SolverBackend solver = SolverBackend::kIpopt;
+  // v_ref is the reference speed
+  CostWeights weights;
+  // In seconds
+  double max_solve_time = 0.05;
+  // 0 for those the solver was made with
+  double tolerance = 0;
+  int max_iterations = 0;
+  // Cores each session may use on average, 0 for no quota (see CpuQuota.h)
+  double cpu_quota = 0;
+};
+
+// Set the fields of config given by the query of url, e.g.
+// "/config?ref_v=60&cte=2000" or "/config?horizon=10&solver=sqp": cte,
+// epsi, v, current_delta, current_a, diff_delta and diff_a for the weights,
+// ref_v, horizon, solver by its name on the command line, budget for the
+// time of a solve in ms, tol, max_iter and cpu_quota in cores. False, with
+// config as it was and the reason in error, for any other parameter, a
+// solver that doesn't exist or a value that isn't a number of 0 or more (of
+// more for the horizon, budget, tol and max_iter).
+bool ParseConfigQuery(const MessageView &url, RuntimeConfig &config, std::string &error);
+
+// The settings of the file at path, a "name = value" or a bare "name" a
+// line, "#" starting a comment: those of ParseConfigQuery, by the names of
+// the query, set in config and checked as the query is, e.g.
+// "horizon = 10", "solver = sqp" or "cte = 2000", and the others appended
+// to flags as the flags of the command line they are, e.g. "workers = 4"
+// as "workers=4" and "blocked" as "blocked", for the server to parse with
+// its own. False, with config as it was and the path, line and reason in
+// error, if the file can't be read or a setting of the query is wrong.
+bool LoadConfigFile(const std::string &path, RuntimeConfig &config,
+                    std::vector<std::string> &flags, std::string &error);
+
+// config as a JSON object, under the names of the query and its version
+std::string ConfigJSON(const RuntimeConfig &config);
+
+// config as a file LoadConfigFile reads back, a "name = value" line for each
+// of the settings of the query, the tolerance and iteration limit left out
+// at 0
+std::string ConfigFile(const RuntimeConfig &config);
+
+// The current configuration, for the solver threads to read at every tick
+// without a lock: each version is a snapshot that never changes once
+// published, and publishing it is the store of one pointer, which the
+// readers load. A reader keeps using the snapshot it loaded until it loads
+// again, at the next tick, so a change takes effect between ticks and never
+// halfway through one.
+//
+// The writers, the admin requests on the event loops, take turns on a
+// mutex of their own, which the readers never touch. Every snapshot is
+// kept until the store goes, so that one a reader still holds is never
+// freed under it; at a few hundred bytes each, changes by hand never add
+// up to much.
+class RuntimeConfigStore {
+public:
+  explicit RuntimeConfigStore(const RuntimeConfig &initial) {
+    snapshots_.emplace_back(new RuntimeConfig(initial));
+    current_.store(snapshots_.back().get(), std::memory_order_release);
+  }
+
+  // The latest snapshot, valid for the life of the store
+  const RuntimeConfig &Current() const { return *current_.load(std::memory_order_acquire); }
+
+  // Publish a copy of the current snapshot with change(copy) applied, as
+  // the next version. change returns false to leave it unpublished, and so
+  // does Update.
+  template <class Change>
+  bool Update(Change change) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    std::unique_ptr<RuntimeConfig> next(new RuntimeConfig(Current()));
+    if (!change(*next)) {
+      return false;
+    }
+    next->version++;
+    snapshots_.emplace_back(std::move(next));
+    current_.store(snapshots_.back().get(), std::memory_order_release);
+    return true;
+  }
+
+private:
+  std::mutex writer_mutex_;
+  std::vector<std::unique_ptr<const RuntimeConfig>> snapshots_;
+  std::atomic<const RuntimeConfig *> current_{nullptr};
+};
+
+#endif /* RUNTIME_CONFIG_H */
@@ -0,0 +1,297 @@
+#include "SensitivityMPC.h"
+#include <algorithm>
+#include <cmath>
+#include "ActiveSetQP.h"
+#include "CondensedQP.h"
+#include "Horizon.h"
+#include "Log.h"
+
+const char *SensitivityReasonName(SensitivityReason reason) {
+  switch (reason) {
+    case SensitivityReason::kUpdated:
+      return "updated";
+    case SensitivityReason::kNoFactorization:
+      return "no factorization";
+    case SensitivityReason::kMaxUpdates:
+      return "max updates";
+    case SensitivityReason::kWeights:
+      return "weights changed";
+    case SensitivityReason::kActiveSet:
+      return "active set changed";
+    case SensitivityReason::kStep:
+      return "step too long";
+    case SensitivityReason::kModelError:
+      return "model off the linearization";
+  }
+  return "";
+}
+
+// The linearization and factorization of SensitivityMPC at one horizon
+class SensitivityModel {
+public:
+  virtual ~SensitivityModel() = default;
+
+  // Linearize at the plan of mpc, solved for state and coeffs with
+  // weights, and factor its KKT matrix. False if it can't be factored.
+  virtual bool Factor(const MPCState &state, const MPCCoeffs &coeffs, const CostWeights &weights,
+                      const MPCBase &mpc) = 0;
+
+  // The update of the factored solution for state and coeffs into plan,
+  // kUpdated if it is within policy
+  virtual SensitivityReason Update(const MPCState &state, const MPCCoeffs &coeffs,
+                                   const SensitivityPolicy &policy, MPCSolution &plan) = 0;
+
+  // The plan of the last update taken
+  virtual MPCState planned_state(size_t t) const = 0;
+  virtual void planned_actuations(size_t t, double &delta, double &a) const = 0;
+};
+
+namespace {
+
+// Distance from a bound under which an actuation of the solution is at it
+const double kActiveTolerance = 1e-6;
+
+template <class H>
+class SensitivityUpdate : public SensitivityModel {
+public:
+  bool Factor(const MPCState &state, const MPCCoeffs &coeffs, const CostWeights &weights,
+              const MPCBase &mpc) override {
+    for (size_t b = 0; b < H::n_blocks; b++) {
+      mpc.planned_actuations(H::first_stage(b), u_star_[b], u_star_[H::n_blocks + b]);
+    }
+    qp_.SetWeights(weights);
+    qp_.Linearize(state, u_star_, coeffs, mpc.linearization_table.get());
+    qp_.Feedback(state, coeffs);
+
+    // The bounds the solution is at, then the QP at it from there: it only
+    // moves as far as the linearization is off the NLP, and leaves the
+    // factorization of the free block at its optimum
+    const typename QP::Vector &lower = qp_.lower();
+    const typename QP::Vector &upper = qp_.upper();
+    for (int i = 0; i < QP::n_u; i++) {
+      kkt_.working_set()[i] =
+          lower[i] > -kActiveTolerance ? -1 : upper[i] < kActiveTolerance ? 1 : 0;
+    }
+    du_.setZero();
+    if (kkt_.Solve(qp_.hessian(), qp_.gradient(), lower, upper, du_) < 0 ||
+        !kkt_.FreeStep(qp_.gradient(), du_)) {
+      return false;
+    }
+    // The held actuations at their bounds
+    for (int i = 0; i < QP::n_u; i++) {
+      const int side = kkt_.working_set()[i];
+      held_[i] = side < 0 ? lower[i] : side > 0 ? upper[i] : 0;
+    }
+    return true;
+  }
+
+  SensitivityReason Update(const MPCState &state, const MPCCoeffs &coeffs,
+                           const SensitivityPolicy &policy, MPCSolution &plan) override {
+    // The gradient at u* for the new parameters, from the same
+    // linearization, and the step of the factorization
+    qp_.Feedback(state, coeffs);
+    gradient_.noalias() = qp_.hessian() * held_;
+    gradient_ += qp_.gradient();
+    kkt_.FreeStep(gradient_, du_);
+    du_ += held_;
+
+    // The active set holds: the free actuations within their bounds, the
+    // held ones pressed against them
+    multipliers_.noalias() = qp_.hessian() * du_;
+    multipliers_ += qp_.gradient();
+    const double tolerance =
+        1e-6 * std::max(1.0, qp_.gradient().template lpNorm<Eigen::Infinity>());
+    const typename QP::Vector &lower = qp_.lower();
+    const typename QP::Vector &upper = qp_.upper();
+    for (int i = 0; i < QP::n_u; i++) {
+      const int side = kkt_.working_set()[i];
+      if ((side == 0 && (du_[i] < lower[i] - kActiveTolerance ||
+                         du_[i] > upper[i] + kActiveTolerance)) ||
+          (side < 0 && multipliers_[i] < -tolerance) ||
+          (side > 0 && multipliers_[i] > tolerance)) {
+        return SensitivityReason::kActiveSet;
+      }
+    }
+    if (du_.template lpNorm<Eigen::Infinity>() > policy.max_step) {
+      return SensitivityReason::kStep;
+    }
+
+    // The error of the first order: the cost the linearization predicts
+    // against that of the model
+    const double predicted = qp_.Predict(du_, u_, z_);
+    const double cost = qp_.Cost(state, u_, coeffs);
+    if (std::fabs(cost - predicted) > policy.max_model_error * std::max(1.0, std::fabs(cost))) {
+      return SensitivityReason::kModelError;
+    }
+
+    plan_u_ = u_;
+    plan_z_.col(0) = state;
+    for (size_t t = 0; t < H::N - 1; t++) {
+      const double delta = u_[H::block(t)];
+      const double a = u_[H::n_blocks + H::block(t)];
+      plan_z_.col(t + 1) = ModelStep(plan_z_.col(t), delta, a, coeffs, H::step(t));
+    }
+    plan = MPCSolution();
+    plan.set_states(plan_z_);
+    plan.set_times<H>();
+    for (size_t t = 0; t < H::N - 1; t++) {
+      plan.delta[t] = u_[H::block(t)];
+      plan.a[t] = u_[H::n_blocks + H::block(t)];
+    }
+    plan.status = SolveStatus::kSolved;
+    plan.cost = cost;
+    plan.statistics.cost_evaluations = 1;
+    plan.statistics.start = SolveStart::kWarm;
+    return SensitivityReason::kUpdated;
+  }
+
+  MPCState planned_state(size_t t) const override { return plan_z_.col(t); }
+
+  void planned_actuations(size_t t, double &delta, double &a) const override {
+    delta = plan_u_[H::block(t)];
+    a = plan_u_[H::n_blocks + H::block(t)];
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  typedef CondensedQP<H> QP;
+
+  QP qp_;
+  // The working set of the factorization and the factorization itself
+  ActiveSetQP<QP::n_u> kkt_;
+  // The converged solution and the steps of its held actuations to their
+  // bounds
+  typename QP::Vector u_star_ = QP::Vector::Zero();
+  typename QP::Vector held_ = QP::Vector::Zero();
+
+  typename QP::Vector plan_u_ = QP::Vector::Zero();
+  typename QP::StateTrajectory plan_z_ = QP::StateTrajectory::Zero();
+
+  // Scratch
+  typename QP::Vector gradient_;
+  typename QP::Vector multipliers_;
+  typename QP::Vector du_;
+  typename QP::Vector u_;
+  typename QP::StateTrajectory z_;
+};
+
+template <class H>
+std::unique_ptr<SensitivityModel> MakeModel() {
+  return std::unique_ptr<SensitivityModel>(new SensitivityUpdate<H>());
+}
+
+}  // namespace
+
+SensitivityMPC::SensitivityMPC(std::unique_ptr<MPCBase> mpc,
+                               std::unique_ptr<SensitivityModel> model,
+                               const SensitivityPolicy &policy)
+    : mpc_(std::move(mpc)), model_(std::move(model)), policy_(policy) {
+  CopySettings(*mpc_);
+}
+
+SensitivityMPC::~SensitivityMPC() = default;
+
+void SensitivityMPC::Factor() {
+  if (!pending_) {
+    return;
+  }
+  pending_ = false;
+  factored_ = model_->Factor(solved_state_, solved_coeffs_, solved_weights_, *mpc_);
+  if (!factored_) {
+    Log(LogLevel::kWarning, "Sensitivity: the KKT matrix of the solution can't be factored");
+  }
+}
+
+MPCSolution SensitivityMPC::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
+  Factor();
+  const CostWeights &weights = cost_schedule.At(state[3]);
+  if (!factored_) {
+    reason_ = SensitivityReason::kNoFactorization;
+  } else if (run_ >= policy_.max_updates) {
+    reason_ = SensitivityReason::kMaxUpdates;
+  } else if (!(weights == solved_weights_)) {
+    reason_ = SensitivityReason::kWeights;
+  } else {
+    MPCSolution plan;
+    reason_ = model_->Update(state, coeffs, policy_, plan);
+    if (reason_ == SensitivityReason::kUpdated) {
+      updated_ = true;
+      run_++;
+      updates_++;
+      status_ = SolveStatus::kSolved;
+      cost_ = plan.cost;
+      iterations_ = 0;
+      return plan;
+    }
+  }
+
+  mpc_->prev_a = prev_a;
+  mpc_->max_solve_time = max_solve_time;
+  mpc_->cost_schedule = cost_schedule;
+  const MPCSolution result = mpc_->Solve(state, coeffs);
+  status_ = mpc_->status();
+  cost_ = mpc_->cost();
+  iterations_ = mpc_->iterations();
+  solves_++;
+  updated_ = false;
+  run_ = 0;
+  // Only a converged solution has the sensitivities of the optimum
+  factored_ = false;
+  pending_ = status_ == SolveStatus::kSolved;
+  solved_state_ = state;
+  solved_coeffs_ = coeffs;
+  solved_weights_ = weights;
+  return result;
+}
+
+void SensitivityMPC::Prepare() {
+  if (!updated_) {
+    mpc_->Prepare();
+  }
+  Factor();
+}
+
+void SensitivityMPC::Reset() {
+  mpc_->Reset();
+  pending_ = false;
+  factored_ = false;
+  updated_ = false;
+  run_ = 0;
+}
+
+MPCState SensitivityMPC::planned_state(size_t t) const {
+  return updated_ ? model_->planned_state(t) : mpc_->planned_state(t);
+}
+
+void SensitivityMPC::planned_actuations(size_t t, double &delta, double &a) const {
+  if (updated_) {
+    model_->planned_actuations(t, delta, a);
+  } else {
+    mpc_->planned_actuations(t, delta, a);
+  }
+}
+
+std::unique_ptr<SensitivityMPC> MakeSensitivityMPC(std::unique_ptr<MPCBase> mpc,
+                                                   bool move_blocking,
+                                                   const SensitivityPolicy &policy) {
+  std::unique_ptr<SensitivityModel> model;
+  if (!mpc || std::fabs(mpc->timestep() - 0.1) > 1e-9) {
+    return std::unique_ptr<SensitivityMPC>();
+  }
+  switch (mpc->horizon_length()) {
+    case 10:
+      model = move_blocking ? MakeModel<Horizon10Blocked>() : MakeModel<Horizon10>();
+      break;
+    case 15:
+      model = move_blocking ? MakeModel<Horizon15Blocked>() : MakeModel<Horizon15>();
+      break;
+    case 25:
+      model = move_blocking ? MakeModel<Horizon25Blocked>() : MakeModel<Horizon25>();
+      break;
+    default:
+      return std::unique_ptr<SensitivityMPC>();
+  }
+  return std::unique_ptr<SensitivityMPC>(
+      new SensitivityMPC(std::move(mpc), std::move(model), policy));
+}
@@ -0,0 +1,125 @@
+#ifndef SENSITIVITY_MPC_H
+#define SENSITIVITY_MPC_H
+
+#include <cstddef>
+#include <memory>
+#include "MPC.h"
+
+// When SensitivityMPC takes the update of its factorization for a tick
+// instead of solving again
+struct SensitivityPolicy {
+  // Largest change of an actuation from the converged solution, radians or
+  // throttle: the error of a first order update grows with its square
+  double max_step = 0.05;
+  // Largest gap between the cost the linearization predicts for the update
+  // and that of the model rolled out under it, relative to the latter (1 at
+  // least)
+  double max_model_error = 0.05;
+  // Longest run of ticks served from one factorization
+  size_t max_updates = 5;
+};
+
+// Why the last Solve solved again, or didn't
+enum class SensitivityReason {
+  kUpdated,  // the update of the factorization was taken
+  kNoFactorization,
+  kMaxUpdates,
+  kWeights,
+  kActiveSet,
+  kStep,
+  kModelError
+};
+
+const char *SensitivityReasonName(SensitivityReason reason);
+
+class SensitivityModel;
+
+// MPC over any MPCBase that follows its converged solutions by their
+// parametric sensitivity, in the spirit of sIPOPT, instead of solving every
+// tick.
+//
+// From tick to tick the problem only differs in its parameters: the
+// initial state, the polynomial and the weights. Once the inner MPC has
+// converged for a tick, its solution u* is linearized and condensed (see
+// CondensedQP) and the KKT matrix of its active bounds, the free block of
+// the Gauss-Newton Hessian, factored once (see ActiveSetQP::FreeStep). For
+// the parameters of a later tick the gradient at u* is evaluated from that
+// same linearization, and the first order update of the solution,
+//
+//   du = -H_ff^-1 grad_f(u*, p),   the actuations at their bounds held,
+//
+// is two triangular solves. It is taken at once unless its predicted error
+// is too large: it would move the active set (a free actuation past its
+// bound, or the multiplier of a held one changing sign), it is longer than
+// max_step, or the cost predicted by the linearization is off that of the
+// model rolled out under it by more than max_model_error. The inner MPC
+// then solves again, warm from its last solve, and the factorization
+// follows the new solution. A change of the weights also solves again: the
+// Hessian is theirs.
+//
+// The parameters are those of the vehicle frame of each tick, which steady
+// driving keeps close from one tick to the next; u* is not shifted. The
+// linearization is that of the kinematic model under Euler steps on the
+// polynomial, so the inner MPC must solve that model, with the horizon and
+// move blocking of the factorization. Factoring after a solve waits for
+// Prepare, once the actuations are sent, or for the next Solve without it.
+class SensitivityMPC : public MPCBase {
+public:
+  SensitivityMPC(std::unique_ptr<MPCBase> mpc, std::unique_ptr<SensitivityModel> model,
+                 const SensitivityPolicy &policy);
+  ~SensitivityMPC();
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  void Prepare() override;
+
+  void Reset() override;
+
+  size_t horizon_length() const override { return mpc_->horizon_length(); }
+  double timestep() const override { return mpc_->timestep(); }
+  double stage_time(size_t t) const override { return mpc_->stage_time(t); }
+  const EffortController *effort() const override { return mpc_->effort(); }
+  size_t slack_activations() const override { return mpc_->slack_activations(); }
+
+  MPCState planned_state(size_t t) const override;
+  void planned_actuations(size_t t, double &delta, double &a) const override;
+
+  SensitivityReason reason() const { return reason_; }
+  size_t solves() const { return solves_; }
+  size_t updates() const { return updates_; }
+
+  // The inner MPC
+  const MPCBase &inner() const { return *mpc_; }
+
+private:
+  // Factor at the solution of the last solve of the inner MPC if it
+  // converged and isn't factored yet
+  void Factor();
+
+  std::unique_ptr<MPCBase> mpc_;
+  std::unique_ptr<SensitivityModel> model_;
+  SensitivityPolicy policy_;
+
+  // Problem of the last solve of the inner MPC, waiting to be factored
+  bool pending_ = false;
+  MPCState solved_state_;
+  MPCCoeffs solved_coeffs_;
+  CostWeights solved_weights_;
+
+  bool factored_ = false;
+  // Whether the plan is the update of the last Solve, and the ticks served
+  // from the factorization since it was made
+  bool updated_ = false;
+  size_t run_ = 0;
+  SensitivityReason reason_ = SensitivityReason::kNoFactorization;
+  size_t solves_ = 0;
+  size_t updates_ = 0;
+};
+
+// The sensitivity MPC over mpc, whose horizon of 10, 15 or 25 steps of 0.1
+// s, with move blocking or not, it linearizes; null for another horizon.
+std::unique_ptr<SensitivityMPC> MakeSensitivityMPC(std::unique_ptr<MPCBase> mpc,
+                                                   bool move_blocking,
+                                                   const SensitivityPolicy &policy);
+
+#endif /* SENSITIVITY_MPC_H */
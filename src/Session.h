@@ -0,0 +1,406 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AdaptiveHorizonMPC.h"
+#include "Admission.h"
+#include "BatchMPC.h"
+#include "CacheBaseline.h"
+#include "CacheLine.h"
+#include "CommandPlan.h"
+#include "ControlSLO.h"
+#include "CorkedSends.h"
+#include "CpuQuota.h"
+#include "CppADThreads.h"
+#include "DelayQueue.h"
+#include "EventTriggeredMPC.h"
+#include "ExplicitMPC.h"
+#include "FlightRecorder.h"
+#include "FrenetReference.h"
+#include "Instrumentation.h"
+#include "LatencyEstimator.h"
+#include "LinesPolicy.h"
+#include "Log.h"
+#include "MPC.h"
+#include "Mailbox.h"
+#include "MessagePack.h"
+#include "Metrics.h"
+#include "MultiStartMPC.h"
+#include "NeuralPolicy.h"
+#include "ObserverFeed.h"
+#include "PerfCounters.h"
+#include "ProblemCapture.h"
+#include "ProblemService.h"
+#include "ProximityGrid.h"
+#include "ReferenceFit.h"
+#include "ReferenceTable.h"
+#include "RefiningMPC.h"
+#include "RegimeMPC.h"
+#include "RoutedMPC.h"
+#include "SensitivityMPC.h"
+#include "SharedChannel.h"
+#include "SolveCache.h"
+#include "SolverBackend.h"
+#include "SolverFootprint.h"
+#include "SolverSnapshot.h"
+#include "SpeculativeMPC.h"
+#include "SteerMessage.h"
+#include "Telemetry.h"
+#include "TickRecorder.h"
+#include "TrackIndex.h"
+#include "TrackMap.h"
+#include "TrackPlanner.h"
+#include "WaypointHistory.h"
+
+struct Worker;
+
+// A telemetry frame of a session made ready for its tick on the event loop
+// with prefit, as it comes in while the solver thread solves the last one:
+// the frame parsed, and the waypoints transformed and fitted by the event
+// loop's own ReferenceFitCache, the same fit the tick would make. The tick
+// that takes the frame numbered sequence from the mailbox takes these with
+// it and goes straight to the prediction, so decoding, parsing and
+// fitting are off the path from the solver freeing up to the next command.
+struct PreparedFrame {
+  uint64_t sequence = 0;
+  Telemetry telemetry;
+  MPCCoeffs coeffs = MPCCoeffs::Zero();
+  size_t order = 3;
+  // The waypoints in the vehicle frame, for the yellow line
+  Telemetry::Waypoints xs;
+  Telemetry::Waypoints ys;
+  // How the fit went, for the counters of the reference fit
+  bool fit_hit = false;
+  bool fit_refit = false;
+  bool fit_miss = false;
+};
+
+// The solver of a session with the wrappers asked for around it, each of
+// those null unless it was
+struct SessionSolver {
+  std::unique_ptr<MPCBase> mpc;
+  // The solver itself, under the wrappers, to hand the track table or the
+  // path coordinates to
+  MPCBase *reference_mpc = nullptr;
+  MPCBase *frenet_mpc = nullptr;
+  AdaptiveHorizonMPC *adaptive_mpc = nullptr;
+  RegimeMPC *regime_mpc = nullptr;
+  RoutedMPC *routed_mpc = nullptr;
+  MultiStartMPC *multistart_mpc = nullptr;
+  RefiningMPC *refining_mpc = nullptr;
+  SensitivityMPC *sensitivity_mpc = nullptr;
+  NeuralMPC *neural_mpc = nullptr;
+  SpeculativeMPC *speculative_mpc = nullptr;
+  TableMPC *table_mpc = nullptr;
+  EventTriggeredMPC *event_mpc = nullptr;
+  SharedSolveMPC *shared_mpc = nullptr;
+  // The solver under the wrappers, for its tolerances, how it was made, and
+  // the version of the runtime configuration it follows (see
+  // RuntimeConfig.h)
+  MPCBase *core = nullptr;
+  SolverBackend backend = SolverBackend::kIpopt;
+  size_t horizon = 0;
+  uint64_t config_version = 0;
+  // Whether the solver thread of another worker may solve it: nothing under
+  // it on a CppAD tape (see UsesCppAD) or on threads of its own
+  bool portable = false;
+};
+
+// Everything a simulator connected to the server has to itself, so that
+// several of them are served at once, each with the warm starts, fits and
+// latency of its own car.
+//
+// Made when the simulator connects and attached to its socket. The event
+// loop posts its telemetry into frames, the solver thread answers in
+// replies, and the event loop sends those through commands. The solver is
+// made, solved and destroyed on the solver thread (see CppADThreads.h), so
+// the event loop only marks a session it is done with closed, drops its
+// commands and leaves the rest for the solver thread to release.
+//
+// With steal, the solver thread of another worker that ran dry may take a
+// frame of a portable solver (see SessionSolver::portable) while the one of
+// the session's own worker is busy. Whichever thread solves the session
+// claims it for the tick, and the solver is only ever made, remade and
+// released on its own worker, where its tapes and workspaces stay warm.
+//
+// A client on the same host that asked for shared memory trades records
+// through a SharedChannel instead: a thread of the session posts its
+// telemetry into frames, and the solver thread writes the commands straight
+// into the channel, without the event loop or the delay queue.
+//
+// The fields are grouped by the thread that writes them, each group that
+// another thread reads on cache lines of its own (see CacheLine.h), so the
+// event loop queueing commands doesn't take the lines of the solver's tick
+// from its core; made by std::allocate_shared with a CacheLineAllocator.
+struct Session {
+  // latency is the estimate of the delay to actuation the first tick
+  // predicts over, in seconds
+  Session(Doorbell *doorbell, uint64_t id, WireFormat format, bool float_fit, bool history,
+          std::shared_ptr<const TrackMap> track_map, double latency)
+      : id(id),
+        format(format),
+        float_fit(float_fit),
+        reference_fit(ReferenceFitTolerance(), float_fit),
+        waypoint_history(history ? new WaypointHistory() : nullptr),
+        track_map(track_map),
+        solve_warnings(1, 5),
+        stages_logged(Mailbox::Clock::now()),
+        latency(latency),
+        frames(doorbell),
+        prefit_fit(ReferenceFitTolerance(), float_fit),
+        closed(false) {}
+  // The reader of the channel stops once it is closed
+  ~Session() {
+    if (shared) {
+      shared->Close();
+    }
+    if (shared_reader.joinable()) {
+      shared_reader.join();
+    }
+  }
+
+  // Numbered by the connections of the process, for its metrics and logs
+  const uint64_t id;
+  // Negotiated in the handshake, for the session's lifetime
+  const WireFormat format;
+  // Whether the reference fits are in single precision, for those of the
+  // cars of a batch
+  const bool float_fit;
+
+  // On the solver thread
+  SessionSolver solver;
+  // With edf, the RTI its ticks fall back on when the solver wouldn't make
+  // their deadline, or while the session is over its CPU quota, made the
+  // first time, and the seconds of its ticks on
+  // the solver, an exponential average
+  SessionSolver fast_solver;
+  double tick_seconds = 0;
+  // The CPU time of its ticks on the solver threads, against the quota
+  SessionCpu cpu;
+  // With admission, the priority the client asked for, and whether the
+  // session is shed to its RTI for the others of the worker, with the cores
+  // it used before (see Admission.h)
+  int priority = 0;
+  bool shed = false;
+  double shed_cores = 0;
+  // The telemetry taken for its next tick
+  Mailbox::Mail frame;
+  // The waypoints of consecutive messages are mostly the same
+  ReferenceFitCache reference_fit;
+  // Or the waypoints so far, until they make the track
+  std::unique_ptr<WaypointHistory> waypoint_history;
+  // Or the whole track, its index, and where the car was on it at the last
+  // message
+  std::shared_ptr<const TrackMap> track_map;
+  TrackMatch track_match = {0, 0, -1};
+  double track_progress = -1;
+  // The references of the track handed to the solver, rebuilt in place
+  // every tick unless something besides the session still holds them, and
+  // the track the Frenet reference is along
+  std::shared_ptr<ReferenceTable> reference_table;
+  std::shared_ptr<FrenetReference> frenet_reference;
+  // With plan, the planner of the track ahead of the car, on a thread of
+  // its own
+  std::unique_ptr<TrackPlanner> planner;
+  const TrackMap *frenet_track = nullptr;
+  // The fields of the last telemetry, parsed into the same buffers every tick
+  Telemetry telemetry;
+  // Or, for the telemetry_batch events of a multi-vehicle simulator, the
+  // fields and reference fit of each car (the fits of all together in
+  // fleet_fit, or each in its cache of car_fits with floatfit or cars of
+  // different numbers of waypoints), the solvers of the cars, copies of
+  // the session's made for the size of the batch, and its problems and
+  // plans. Also released on the solver thread.
+  std::vector<Telemetry> cars;
+  FleetReferenceFit fleet_fit;
+  bool fleet_fitted = false;
+  std::vector<ReferenceFitCache, Eigen::aligned_allocator<ReferenceFitCache>> car_fits;
+  std::unique_ptr<BatchMPC> batch;
+  std::vector<MPCState, Eigen::aligned_allocator<MPCState>> batch_states;
+  std::vector<MPCCoeffs, Eigen::aligned_allocator<MPCCoeffs>> batch_coeffs;
+  std::vector<MPCSolution> batch_results;
+  // With proximity, the plans of the cars of the last tick in the frame of
+  // the simulator, the pairs of their stages that come close and the speeds
+  // the cars that yield are held to
+  std::unique_ptr<ProximityGrid> proximity;
+  std::vector<ProximityPair> proximity_pairs;
+  std::vector<double> yield_speeds;
+  // Or, for a client of the problem service, the problems of the batch
+  // being solved and the first of them not solved yet, a chunk a tick
+  ServiceBatch service_batch;
+  size_t service_next = 0;
+  std::vector<double> service_seconds;
+  // The reply, written into the same buffer every tick, in the format of
+  // the session
+  SteerMessage steer_message;
+  SteerPack steer_pack;
+  SteerRecord steer_record;
+  // Which of the replies carry the lines to draw, set at connection, and
+  // the replies so far
+  LinesPolicy lines;
+  uint64_t ticks = 0;
+  // Failed solves repeat tick after tick, a few a second are enough
+  LogRateLimit solve_warnings;
+  // Frames skipped and commands dropped so far, as last logged
+  uint64_t skipped = 0;
+  size_t dropped_logged = 0;
+
+  // The durations of the stages of its ticks, for /metrics, and when they
+  // were last logged
+  StageHistograms stages;
+  Mailbox::Clock::time_point stages_logged;
+  // And their hardware events, with perf
+  StageEvents events;
+  // The problem of the last slow solve handed to the capture, its buffers
+  // reused by the next (see ProblemCapture.h)
+  CapturedProblem captured;
+  // Its last ticks against the control period
+  SLOCompliance slo;
+  // The size of the problem of its solver (see MPCBase::Footprint)
+  FootprintGauges footprint;
+  // Its ticks done again without the caches, every few, with baseline
+  std::unique_ptr<CacheBaseline> baseline;
+  // An average of the seconds of its solves, for the snapshot; with
+  // snapshot, whether its first tick looked for one of the last process,
+  // and if it took one, when, what its solves took then, and the ticks
+  // since and those of them in a row that solved warm that quickly, until
+  // it is steady again
+  double solve_seconds = 0;
+  bool snapshot_checked = false;
+  bool settling = false;
+  Mailbox::Clock::time_point restored;
+  double restored_seconds = 0;
+  uint64_t restored_ticks = 0;
+  size_t settled_ticks = 0;
+
+  // Delay from telemetry to actuation, measured on the event loop as the
+  // commands go out and read by the solver
+  alignas(kCacheLine) LatencyEstimator latency;
+  std::mutex latency_mutex;
+
+  // The telemetry for the solver, and its commands back, the latest of each
+  Mailbox frames;
+  Mailbox replies;
+  // With commandrate, the actuations of the plan of the last tick, for the
+  // event loop to send commands from until the next reply
+  LatestValue<CommandPlan> command_plans;
+  // With prefit, the frames parsed and fitted on the event loop, each
+  // published just before it is posted to frames (see PreparedFrame)
+  LatestValue<PreparedFrame> prepared;
+
+  // On the event loop: the last reply taken, the commands waiting out the
+  // actuator latency, and the jitter of the commands, timed where they are
+  // sent (on the solver thread for shared memory)
+  alignas(kCacheLine) Mailbox::Mail reply;
+  std::unique_ptr<DelayQueue> commands;
+  CommandJitter jitter;
+  // With commandrate, when the plan of the last reply went into the queue,
+  // and the commands sampled from it, written in the format of the session
+  Mailbox::Clock::time_point command_sent;
+  SteerMessage sampled_message;
+  SteerPack sampled_pack;
+  // With prefit, whether the frames are prepared, which takes a reference
+  // fitted to the waypoints of each (no track or history), and the fit of
+  // the event loop that prepares them
+  bool prefit = false;
+  ReferenceFitCache prefit_fit;
+  // Published by the event loop with every command it queues, for the
+  // solver: the commands waiting, those dropped under backpressure, and
+  // whether the client is behind, when the lines are left out
+  alignas(kCacheLine) std::atomic<size_t> pending{0};
+  std::atomic<size_t> dropped{0};
+  std::atomic<bool> congested{false};
+  // Set once the simulator is gone
+  std::atomic<bool> closed;
+  // The worker that accepted it, whose event loop sends its commands, and
+  // whether a solver thread holds it for a tick; a thread takes the solver
+  // fields and frames only while it does
+  Worker *home = nullptr;
+  alignas(kCacheLine) std::atomic<bool> claimed{false};
+  // Or the memory shared with a client on the same host, and the thread
+  // that waits for its telemetry
+  alignas(kCacheLine) std::unique_ptr<SharedChannel> shared;
+  std::thread shared_reader;
+  // Or, for a client of the problem service, its batches and plans, and on
+  // the event loop its socket and the limit of its problems a second
+  alignas(kCacheLine) std::unique_ptr<ProblemQueue> problems;
+  std::unique_ptr<uWS::WebSocket<uWS::SERVER>> socket;
+  std::unique_ptr<ProblemRateLimit> problem_limit;
+
+  // The flight recorder of the server, null unless it records, and a record
+  // of message into it in the format of the session, a command with the
+  // arrival of its telemetry
+  FlightRecorder *recorder = nullptr;
+  void Record(FlightRecordType type, Mailbox::Clock::time_point time, const MessageView &message,
+              Mailbox::Clock::time_point arrival = Mailbox::Clock::time_point()) {
+    if (recorder != nullptr) {
+      if (recorder->Record(type, format, id, time, message, arrival)) {
+        MPC_COUNT(Metrics().flight_records.Add());
+      } else {
+        MPC_COUNT(Metrics().flight_dropped.Add());
+      }
+    }
+  }
+};
+
+// One of the workers the server spreads the simulators over: an event loop
+// on a thread of its own, which accepts connections on the port the workers
+// share, and the solver thread that serves the sessions of those
+// connections for as long as they last. Laid out by thread like Session.
+struct Worker {
+  MPC_CACHE_LINE_OPERATOR_NEW
+
+  uWS::Hub hub;
+  // Wakes the event loop for the commands of the solver thread
+  uS::Async *reply_ready = nullptr;
+  // The last beat of the heartbeat timer of the event loop, on the loop,
+  // and how late it was, for /healthz
+  std::chrono::steady_clock::time_point beat;
+  MetricGauge loop_lag;
+  // The frames and replies the loop handled, for busypoll to tell the polls
+  // that found something
+  uint64_t loop_events = 0;
+  // With commandrate, the seconds between the commands sampled from the
+  // plans of its sessions, 0 without
+  double command_period = 0;
+  // The plans of a client of the problem service as the loop sends them,
+  // kept for their capacity
+  std::vector<std::string> problem_replies;
+  // With cork, the frames the loop sends, held until it flushes them
+  std::unique_ptr<CorkedSends> cork;
+  // Added and marked closed by the event loop, removed by the solver thread
+  alignas(kCacheLine) std::mutex sessions_mutex;
+  std::vector<std::shared_ptr<Session>> sessions;
+  // Rung by the telemetry of every session, for the solver thread, and
+  // whether that thread waits for it, for the busy ones to wake it with
+  // steal
+  alignas(kCacheLine) Doorbell telemetry_posted;
+  std::atomic<bool> idle{false};
+  // With numa, the node its threads and memory are on, -1 without
+  int node = -1;
+  // The CppAD pool of its solver thread as of its last tick, in /metrics
+  alignas(kCacheLine) CppADPool cppad_pool = {0, 0};
+  // The last ticks of its solver thread, with blackbox
+  std::unique_ptr<TickRecorder> tick_recorder;
+  // The ticks of its solver thread for the observers, with observe
+  std::unique_ptr<ObserverRing> observer_ring;
+  // With snapshot, the writer of the snapshots of its sessions, when its
+  // solver thread last took one, and the snapshots as they are taken, kept
+  // for their capacity
+  std::unique_ptr<SnapshotWriter> snapshot_writer;
+  std::chrono::steady_clock::time_point snapshot_taken;
+  std::vector<SessionSnapshot> snapshots;
+  // With shed, when its solver thread last looked at the load of its
+  // sessions, and their entries, kept for their capacity
+  std::chrono::steady_clock::time_point shed_checked;
+  std::vector<SheddingEntry> shedding;
+};
+
+#endif /* SESSION_H */
@@ -0,0 +1,194 @@
+#include "SessionPipeline.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "CommandPlan.h"
+#include "Log.h"
+#include "Mailbox.h"
+#include "MessagePack.h"
+#include "MessageView.h"
+#include "Metrics.h"
+#include "ProblemService.h"
+#include "ReceiveTimestamps.h"
+#include "ReferenceFit.h"
+#include "SocketIOFrame.h"
+#include "Telemetry.h"
+#include "Trace.h"
+
+namespace {
+
+// The actuator latency the simulator's commands are held back by, see the
+// note of the solver of main.cpp
+const std::chrono::milliseconds kActuatorLatency(100);
+
+// With prefit, the telemetry in data (the data of the event, or the
+// MessagePack message with packed) parsed and fitted into the prepared
+// frame of session for the frame about to be posted, and published; left
+// for the tick to parse if it isn't telemetry of the form the parsers take
+void PrepareFrame(Session &session, const MessageView &data, bool packed) {
+  const Mailbox::Clock::time_point start = Mailbox::Clock::now();
+  PreparedFrame &prepared = session.prepared.Back();
+  Telemetry &telemetry = prepared.telemetry;
+  if (!(packed ? UnpackTelemetry(data, telemetry) : ParseTelemetry(data, telemetry))) {
+    return;
+  }
+  ReferenceFitCache &fit = session.prefit_fit;
+  const size_t hits = fit.hits();
+  const size_t refits = fit.refits();
+  const size_t misses = fit.misses();
+  prepared.coeffs =
+      fit.Fit(telemetry.ptsx, telemetry.ptsy, telemetry.x, telemetry.y, telemetry.psi);
+  prepared.order = fit.order();
+  prepared.xs = fit.xs();
+  prepared.ys = fit.ys();
+  prepared.fit_hit = fit.hits() > hits;
+  prepared.fit_refit = fit.refits() > refits;
+  prepared.fit_miss = fit.misses() > misses;
+  prepared.sequence = session.frames.posted() + 1;
+  session.prepared.Publish();
+  MPC_COUNT(Metrics().prefit.Observe(
+      std::chrono::duration<double>(Mailbox::Clock::now() - start).count()));
+}
+
+}  // namespace
+
+void ReceiveMessage(uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
+                    uWS::OpCode op_code) {
+  Mailbox::Clock::time_point arrival = Mailbox::Clock::now();
+  Mailbox::Clock::time_point received;
+  if (ReceiveTimestamp(ws.getFd(), received)) {
+    // Off the network that long before the loop handled it
+    MPC_COUNT(Metrics().socket_queue.Observe(
+        std::chrono::duration<double>(arrival - received).count()));
+    arrival = received;
+  }
+  MPC_TRACE_SCOPE("message");
+  Session *session = static_cast<Session *>(ws.getUserData());
+  if (session != nullptr) {
+    session->home->loop_events++;
+  }
+  if (session != nullptr && session->format == WireFormat::kProblems) {
+    // A batch for the solver thread, or a refusal the client can retry
+    const MessageView batch(data, length);
+    const size_t n = op_code == uWS::OpCode::BINARY ? CountProblems(batch) : 0;
+    std::string refusal;
+    if (n == 0) {
+      refusal = "{\"error\":\"malformed batch\"}";
+    } else if (!session->problem_limit->Admit(n, arrival)) {
+      refusal = "{\"error\":\"over the problems a second of the server\"}";
+    } else if (!session->problems->Post(batch)) {
+      refusal = "{\"error\":\"too many batches waiting\"}";
+    }
+    if (refusal.empty()) {
+      session->home->telemetry_posted.Ring();
+    } else {
+      MPC_COUNT(Metrics().service_refused.Add(n));
+      Log(LogLevel::kWarning, "Problems: a batch of {} refused, {}", n, refusal);
+      ws.send(refusal.data(), refusal.size(), uWS::OpCode::TEXT);
+    }
+    return;
+  }
+  if (session != nullptr && session->format != WireFormat::kJson) {
+    // Binary messages are telemetry and nothing else, no socket.io; over
+    // shared memory, the socket carries none
+    if (session->format == WireFormat::kMessagePack && op_code == uWS::OpCode::BINARY) {
+      Log(LogLevel::kDebug, "Telemetry: {} bytes", length);
+      session->Record(FlightRecordType::kTelemetry, arrival, MessageView(data, length));
+      if (session->prefit) {
+        PrepareFrame(*session, MessageView(data, length), true);
+      }
+      session->frames.Post(MessageView(data, length), arrival);
+    }
+    return;
+  }
+  // "42" at the start of the message means there's a websocket message event.
+  // The 4 signifies a websocket message
+  // The 2 signifies a websocket event
+  // A view of the buffer of uWS, which isn't null terminated
+  const MessageView sdata(data, length);
+  Log(LogLevel::kDebug, "{}", sdata);
+  SocketIOFrame frame;
+  DecodeFrame(sdata, frame);
+  if (frame.packet == FramePacket::kPing) {
+    // Engine.io keeps the connection alive by pings, answered by pongs
+    ws.send("3", 1, uWS::OpCode::TEXT);
+  } else if (frame.packet == FramePacket::kEvent) {
+    // An event without data, or with null data, is the simulator in
+    // manual mode
+    if (frame.has_data()) {
+      // The solver takes the telemetry of the session from here, the
+      // freshest of it if more came in during a solve, of one car or
+      // of the cars of a multi-vehicle simulator
+      if ((frame.event.equals("telemetry") || frame.event.equals("telemetry_batch")) &&
+          session != nullptr) {
+        session->Record(FlightRecordType::kTelemetry, arrival, sdata);
+        if (session->prefit && frame.event.equals("telemetry")) {
+          PrepareFrame(*session, frame.data, false);
+        }
+        session->frames.Post(sdata, arrival);
+      }
+    } else {
+      // Manual driving, the same frame every time
+      static const char manual[] = "42[\"manual\",{}]";
+      ws.send(manual, sizeof(manual) - 1, uWS::OpCode::TEXT);
+    }
+  }
+}
+
+void DeliverReplies(Worker &worker) {
+  MPC_TRACE_SCOPE("queue replies");
+  worker.loop_events++;
+  std::lock_guard<std::mutex> lock(worker.sessions_mutex);
+  for (const std::shared_ptr<Session> &session : worker.sessions) {
+    // The actuator latency, see the note of the solver
+    if (session->commands && session->replies.Take(session->reply)) {
+      session->commands->Send(session->reply.message, kActuatorLatency, session->reply.arrival);
+      // The plan of the reply, or a later one, to sample from now on
+      if (worker.command_period > 0) {
+        session->command_plans.Update();
+        session->command_sent = Mailbox::Clock::now();
+      }
+      session->pending.store(session->commands->pending(), std::memory_order_relaxed);
+      session->dropped.store(session->commands->dropped(), std::memory_order_relaxed);
+      session->congested.store(session->commands->congested(), std::memory_order_relaxed);
+    }
+    // The plans of the problem service, every message of them in order
+    if (session->socket) {
+      session->problems->TakeReplies(worker.problem_replies);
+      for (const std::string &reply : worker.problem_replies) {
+        if (worker.cork) {
+          worker.cork->Send(*session->socket, reply.data(), reply.size(), uWS::OpCode::BINARY);
+        } else {
+          session->socket->send(reply.data(), reply.size(), uWS::OpCode::BINARY);
+        }
+      }
+    }
+  }
+}
+
+void SampleCommands(Worker &worker) {
+  const Mailbox::Clock::time_point now = Mailbox::Clock::now();
+  std::lock_guard<std::mutex> lock(worker.sessions_mutex);
+  for (const std::shared_ptr<Session> &session : worker.sessions) {
+    // Half a period after the reply at least, which the command of
+    // the first stage went out with
+    const double t = std::chrono::duration<double>(now - session->command_sent).count();
+    double steering = 0;
+    double throttle = 0;
+    if (!session->commands || t < 0.5 * worker.command_period ||
+        !SampleCommand(session->command_plans.Front(), t, steering, throttle)) {
+      continue;
+    }
+    const std::string &message =
+        session->format == WireFormat::kMessagePack
+            ? session->sampled_pack.Write(steering, throttle, nullptr, nullptr, 0,
+                                          nullptr, nullptr, 0)
+            : session->sampled_message.Write(steering, throttle, nullptr, nullptr, 0,
+                                             nullptr, nullptr, 0);
+    // The latency of the replies, which they are held back with
+    session->commands->Send(message, kActuatorLatency, Mailbox::Clock::time_point());
+    MPC_COUNT(Metrics().commands_sampled.Add());
+  }
+}
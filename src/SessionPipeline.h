@@ -0,0 +1,44 @@
+#ifndef SESSION_PIPELINE_H
+#define SESSION_PIPELINE_H
+
+#include <uWS/uWS.h>
+#include <cstddef>
+#include "Session.h"
+
+// The stages of the tick of a session that run on the event loop of its
+// worker, in the order a tick goes through them:
+//
+//   1. ReceiveMessage, from the socket's message handler: the frame, which
+//      arrived when the kernel received it with rxtimestamps (see
+//      ReceiveTimestamps.h), is decoded as far as telling telemetry from
+//      pings and manual mode, and
+//      the telemetry posted into frames for the solver thread, which parses,
+//      fits, solves and writes the reply (see the solve of main.cpp).
+//   2. DeliverReplies, from the reply_ready async the solver thread rings:
+//      every reply taken from replies and queued into the DelayQueue of its
+//      session, whose timer sends it once the actuator latency is over or
+//      drops it under backpressure.
+//   3. SampleCommands, from the sampler timer with commandrate: between
+//      replies, commands sampled from the plan of the last one into the same
+//      queue.
+//
+// Each stage runs to the end of what there is to do and returns to the
+// loop, so waiting for the solver or a timer is the loop's, never a
+// blocked thread's or a callback chain's; the state a tick carries from
+// one stage to the next is the fields of its Session, the mailboxes and
+// queues reused from tick to tick, so none of the hand-offs allocates once
+// the buffers have grown.
+
+// A websocket message of the session of ws, if it has one
+void ReceiveMessage(uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
+                    uWS::OpCode op_code);
+
+// The replies of the solver thread to the sessions of worker, and the plans
+// of the problem service
+void DeliverReplies(Worker &worker);
+
+// A command sampled from the last plan of every session of worker that
+// waits for its next reply, at least half a command period after the last
+void SampleCommands(Worker &worker);
+
+#endif /* SESSION_PIPELINE_H */
@@ -0,0 +1,111 @@
+#include "SharedArtifact.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+// Every directory of path, as mkdir -p
+bool MakeDirectories(const std::string &path) {
+  for (size_t end = path.find('/', 1);; end = path.find('/', end + 1)) {
+    const std::string prefix = path.substr(0, end);
+    if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+      return false;
+    }
+    if (end == std::string::npos) {
+      return true;
+    }
+  }
+}
+
+}  // namespace
+
+std::unique_ptr<MappedFile> MappedFile::Map(const std::string &path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return std::unique_ptr<MappedFile>();
+  }
+  struct stat status;
+  if (fstat(fd, &status) != 0 || status.st_size <= 0) {
+    close(fd);
+    return std::unique_ptr<MappedFile>();
+  }
+  const size_t size = static_cast<size_t>(status.st_size);
+  void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping holds the file open
+  close(fd);
+  if (data == MAP_FAILED) {
+    return std::unique_ptr<MappedFile>();
+  }
+  return std::unique_ptr<MappedFile>(new MappedFile(data, size));
+}
+
+MappedFile::~MappedFile() { munmap(data_, size_); }
+
+std::string DefaultArtifactDirectory() {
+  const char *artifacts = std::getenv("MPC_ARTIFACTS");
+  if (artifacts != nullptr && *artifacts != '\0') {
+    return artifacts;
+  }
+  struct stat status;
+  if (stat("/dev/shm", &status) == 0 && S_ISDIR(status.st_mode)) {
+    return "/dev/shm/mpc-" + std::to_string(getuid());
+  }
+  const char *xdg = std::getenv("XDG_CACHE_HOME");
+  if (xdg != nullptr && *xdg != '\0') {
+    return std::string(xdg) + "/mpc/artifacts";
+  }
+  const char *home = std::getenv("HOME");
+  if (home != nullptr && *home != '\0') {
+    return std::string(home) + "/.cache/mpc/artifacts";
+  }
+  return "mpc-artifacts";
+}
+
+std::string ArtifactKey(const std::string &text) {
+  const uint32_t order = 0x01020304;
+  std::string keyed(reinterpret_cast<const char *>(&order), sizeof(order));
+  keyed += text;
+  // 64 bit FNV-1a
+  uint64_t hash = 14695981039346656037ull;
+  for (char c : keyed) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+  std::ostringstream key;
+  key << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return key.str();
+}
+
+bool ShareArtifact(const std::string &directory, const std::string &name,
+                   const std::function<bool(const std::string &path)> &build, std::string &path,
+                   std::string &error) {
+  path = directory + "/" + name;
+  if (access(path.c_str(), R_OK) == 0) {
+    return true;
+  }
+  if (!MakeDirectories(directory)) {
+    error = "cannot create " + directory;
+    return false;
+  }
+  // Of this process, moved into place once whole
+  const std::string partial = path + "." + std::to_string(getpid());
+  if (!build(partial)) {
+    std::remove(partial.c_str());
+    error = "cannot build " + path;
+    return false;
+  }
+  if (std::rename(partial.c_str(), path.c_str()) != 0) {
+    std::remove(partial.c_str());
+    error = "cannot move " + partial + " to " + path;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,71 @@
+#ifndef SHARED_ARTIFACT_H
+#define SHARED_ARTIFACT_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+// The read-only artifacts a server builds at startup, built once for every
+// server process of a host and mapped by each instead: the linearization
+// table (see LinearizationTable::Share), the explicit MPC table (see
+// ExplicitMPC::Share) and the map of a track given as waypoints (see
+// TrackMap::Share). They are kept as files of a directory the processes
+// share, under /dev/shm by default, which is memory rather than disk; the
+// first process that needs one builds it into a file of its own and renames
+// it into place whole, and every process maps it read only, so its pages
+// are in memory once for all of them and a process starts with a map
+// instead of a build.
+//
+// The name of an artifact carries the version of its format and a key of
+// what it is built from, so a process never maps one built from something
+// else. A file is never changed once in place; a process that has one
+// mapped keeps what it mapped if another replaces it, and two processes
+// building the same artifact at once write the same bytes. Artifacts are
+// not removed: a directory under /dev/shm goes with a reboot, and an
+// artifact of an older build is a file of its own that nothing maps.
+//
+// The maps of tracks made by convert_track (see TrackMap) and the libraries
+// of the compiled models (see CompiledModel.h) are files mapped from the
+// start, so they are shared as they are.
+
+// A file mapped read only, unmapped with the object
+class MappedFile {
+public:
+  // Null if path can't be opened or mapped, or is empty
+  static std::unique_ptr<MappedFile> Map(const std::string &path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const char *data() const { return static_cast<const char *>(data_); }
+  size_t size() const { return size_; }
+
+private:
+  MappedFile(void *data, size_t size) : data_(data), size_(size) {}
+
+  void *data_;
+  size_t size_;
+};
+
+// The directory of the artifacts: $MPC_ARTIFACTS, else mpc-<uid> under
+// /dev/shm where there is one, else mpc/artifacts under $XDG_CACHE_HOME or
+// ~/.cache
+std::string DefaultArtifactDirectory();
+
+// A key of text for the name of an artifact, 16 hex digits of the 64 bit
+// FNV-1a hash of it and of the byte order of the host, e.g. of the
+// parameters it is built with: the artifacts hold numbers as they are in
+// memory
+std::string ArtifactKey(const std::string &text);
+
+// In path, the file of the artifact name in directory, built first by build
+// into the file it is given if no process has yet, the directory made if
+// need be. False with the reason in error if the directory can't be made or
+// build fails.
+bool ShareArtifact(const std::string &directory, const std::string &name,
+                   const std::function<bool(const std::string &path)> &build, std::string &path,
+                   std::string &error);
+
+#endif /* SHARED_ARTIFACT_H */
@@ -0,0 +1,274 @@
+#include "SharedChannel.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <new>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+// The rings are shared between processes, their atomics must be too
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "The shared rings need lock-free atomics");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "A futex is the 32 bits of the atomic");
+
+const size_t SharedCommand::kMaxPoints;
+
+struct SharedChannel::Segment {
+  // Of the layout, checked when the client opens it
+  uint32_t magic;
+  uint32_t version;
+  std::atomic<uint32_t> closed;
+  // From the client to the server, and back
+  SharedRing telemetry;
+  SharedRing commands;
+};
+
+namespace {
+
+const uint32_t kMagic = 0x3143504d;  // "MPC1"
+const uint32_t kVersion = 1;
+
+#ifdef __linux__
+
+// Sleep while word is expected, for 100 ms at most, to look at closed again.
+// Not FUTEX_PRIVATE: the word is in memory of another process.
+void FutexWait(std::atomic<uint32_t> &word, uint32_t expected) {
+  const timespec timeout = {0, 100000000};
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, expected, &timeout,
+          nullptr, 0);
+}
+
+void FutexWake(std::atomic<uint32_t> &word) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, INT_MAX, nullptr,
+          nullptr, 0);
+}
+
+#else
+
+void FutexWait(std::atomic<uint32_t> &word, uint32_t expected) {
+  if (word.load() == expected) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+}
+
+void FutexWake(std::atomic<uint32_t> &) {}
+
+#endif
+
+}  // namespace
+
+bool SharedRing::Push(const void *record, size_t n) {
+  const uint32_t at = head.load(std::memory_order_relaxed);
+  if (n > kSlotBytes || at - tail.load(std::memory_order_acquire) == kSlots) {
+    return false;
+  }
+  std::memcpy(slots[at % kSlots], record, n);
+  sizes[at % kSlots] = static_cast<uint32_t>(n);
+  head.store(at + 1, std::memory_order_release);
+  return true;
+}
+
+bool SharedRing::Pop(void *record, size_t capacity, size_t &n) {
+  const uint32_t at = tail.load(std::memory_order_relaxed);
+  if (at == head.load(std::memory_order_acquire)) {
+    return false;
+  }
+  n = sizes[at % kSlots];
+  const bool fits = n <= capacity;
+  if (fits) {
+    std::memcpy(record, slots[at % kSlots], n);
+  }
+  // One that doesn't fit is dropped, it would block the ring otherwise
+  tail.store(at + 1, std::memory_order_release);
+  return fits;
+}
+
+std::unique_ptr<SharedChannel> SharedChannel::Create(const std::string &name) {
+  const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    return nullptr;
+  }
+  void *memory = MAP_FAILED;
+  if (ftruncate(fd, sizeof(Segment)) == 0) {
+    memory = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (memory == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    return nullptr;
+  }
+  // Zeroed by ftruncate, the rings empty
+  Segment *segment = new (memory) Segment();
+  segment->magic = kMagic;
+  segment->version = kVersion;
+  return std::unique_ptr<SharedChannel>(new SharedChannel(name, segment, true));
+}
+
+std::unique_ptr<SharedChannel> SharedChannel::Open(const std::string &name) {
+  const int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat status;
+  void *memory = MAP_FAILED;
+  if (fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(Segment)) {
+    memory = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (memory == MAP_FAILED) {
+    return nullptr;
+  }
+  Segment *segment = static_cast<Segment *>(memory);
+  if (segment->magic != kMagic || segment->version != kVersion) {
+    munmap(memory, sizeof(Segment));
+    return nullptr;
+  }
+  return std::unique_ptr<SharedChannel>(new SharedChannel(name, segment, false));
+}
+
+SharedChannel::SharedChannel(const std::string &name, Segment *segment, bool owner)
+    : name_(name), segment_(segment), owner_(owner) {}
+
+SharedChannel::~SharedChannel() {
+  munmap(segment_, sizeof(Segment));
+  if (owner_) {
+    shm_unlink(name_.c_str());
+  }
+}
+
+bool SharedChannel::WaitTelemetry(std::string &record) {
+  // Sized once, then taken as it is
+  record.resize(SharedRing::kSlotBytes);
+  size_t n = 0;
+  if (!Wait(segment_->telemetry, &record[0], record.size(), n)) {
+    return false;
+  }
+  record.resize(n);
+  return true;
+}
+
+bool SharedChannel::SendCommand(const MessageView &record) {
+  if (!segment_->commands.Push(record.data, record.size())) {
+    return false;
+  }
+  Wake(segment_->commands);
+  return true;
+}
+
+bool SharedChannel::SendTelemetry(const SharedTelemetry &record) {
+  if (!segment_->telemetry.Push(&record, sizeof(record))) {
+    return false;
+  }
+  Wake(segment_->telemetry);
+  return true;
+}
+
+bool SharedChannel::WaitCommand(SharedCommand &command) {
+  size_t n = 0;
+  while (Wait(segment_->commands, &command, sizeof(command), n)) {
+    if (n == sizeof(command)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void SharedChannel::Close() {
+  segment_->closed.store(1);
+  Wake(segment_->telemetry);
+  Wake(segment_->commands);
+}
+
+bool SharedChannel::closed() const { return segment_->closed.load() != 0; }
+
+bool SharedChannel::Wait(SharedRing &ring, void *record, size_t capacity, size_t &n) {
+  for (;;) {
+    if (ring.Pop(record, capacity, n)) {
+      return true;
+    }
+    if (closed()) {
+      return false;
+    }
+    // A push after this bumps signal, and the futex doesn't sleep on a
+    // signal that moved, so none is missed between the look at the ring and
+    // the sleep
+    const uint32_t signal = ring.signal.load();
+    if (ring.Pop(record, capacity, n)) {
+      return true;
+    }
+    if (closed()) {
+      return false;
+    }
+    ring.sleeping.store(1);
+    FutexWait(ring.signal, signal);
+    ring.sleeping.store(0);
+  }
+}
+
+void SharedChannel::Wake(SharedRing &ring) {
+  ring.signal.fetch_add(1);
+  // The system call only for a side asleep
+  if (ring.sleeping.load() != 0) {
+    FutexWake(ring.signal);
+  }
+}
+
+bool ReadSharedTelemetry(const MessageView &record, Telemetry &telemetry) {
+  SharedTelemetry shared;
+  if (record.size() != sizeof(shared)) {
+    return false;
+  }
+  std::memcpy(&shared, record.data, sizeof(shared));
+  if (shared.waypoints > SharedTelemetry::kMaxWaypoints) {
+    return false;
+  }
+  telemetry.ptsx.assign(shared.ptsx, shared.ptsx + shared.waypoints);
+  telemetry.ptsy.assign(shared.ptsy, shared.ptsy + shared.waypoints);
+  telemetry.x = shared.x;
+  telemetry.y = shared.y;
+  telemetry.psi = shared.psi;
+  telemetry.psi_unity = shared.psi_unity;
+  telemetry.speed = shared.speed;
+  telemetry.steering_angle = shared.steering_angle;
+  telemetry.throttle = shared.throttle;
+  return true;
+}
+
+bool ReadSharedCommand(const MessageView &record, SharedCommand &command) {
+  if (record.size() != sizeof(command)) {
+    return false;
+  }
+  std::memcpy(&command, record.data, sizeof(command));
+  return true;
+}
+
+SteerRecord::SteerRecord() { buffer_.reserve(sizeof(SharedCommand)); }
+
+const std::string &SteerRecord::Write(double steering_angle, double throttle,
+                                      const double *mpc_x, const double *mpc_y, size_t mpc_n,
+                                      const double *next_x, const double *next_y,
+                                      size_t next_n) {
+  SharedCommand command = {};
+  command.steering_angle = steering_angle;
+  command.throttle = throttle;
+  mpc_n = std::min(mpc_n, SharedCommand::kMaxPoints);
+  next_n = std::min(next_n, SharedCommand::kMaxPoints);
+  command.mpc_n = static_cast<uint32_t>(mpc_n);
+  command.next_n = static_cast<uint32_t>(next_n);
+  std::copy(mpc_x, mpc_x + mpc_n, command.mpc_x);
+  std::copy(mpc_y, mpc_y + mpc_n, command.mpc_y);
+  std::copy(next_x, next_x + next_n, command.next_x);
+  std::copy(next_y, next_y + next_n, command.next_y);
+  buffer_.assign(reinterpret_cast<const char *>(&command), sizeof(command));
+  return buffer_;
+}
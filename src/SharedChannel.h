@@ -0,0 +1,140 @@
+#ifndef SHARED_CHANNEL_H
+#define SHARED_CHANNEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "MessageView.h"
+#include "Telemetry.h"
+
+// The telemetry of DATA.md as a record of fixed size, in the byte order of
+// the host, for the shared memory channel
+struct SharedTelemetry {
+  static const size_t kMaxWaypoints = Telemetry::kMaxWaypoints;
+
+  uint32_t waypoints;
+  uint32_t reserved;
+  double ptsx[kMaxWaypoints];
+  double ptsy[kMaxWaypoints];
+  double x;
+  double y;
+  double psi;
+  double psi_unity;
+  double speed;
+  double steering_angle;
+  double throttle;
+};
+
+// The steer reply as a record of fixed size, the lines cut to kMaxPoints
+struct SharedCommand {
+  static const size_t kMaxPoints = 32;
+
+  double steering_angle;
+  double throttle;
+  uint32_t mpc_n;
+  uint32_t next_n;
+  double mpc_x[kMaxPoints];
+  double mpc_y[kMaxPoints];
+  double next_x[kMaxPoints];
+  double next_y[kMaxPoints];
+};
+
+// A single producer, single consumer ring of records between two processes,
+// in memory they both map. The producer fills the slot at head and
+// publishes it by a release store of head, the consumer empties the one at
+// tail and frees it the same way, so neither ever waits for the other. A
+// consumer with nothing to read sleeps on a futex on signal, which every
+// push bumps, and is only woken by a system call if it said it sleeps.
+struct SharedRing {
+  static const uint32_t kSlots = 8;
+  static const size_t kSlotBytes =
+      sizeof(SharedTelemetry) > sizeof(SharedCommand) ? sizeof(SharedTelemetry)
+                                                      : sizeof(SharedCommand);
+
+  // Copy the n bytes at record into the ring, false if it is full or they
+  // don't fit in a slot
+  bool Push(const void *record, size_t n);
+  // Take the oldest record into the capacity bytes at record, its size into
+  // n; false if there is none or it doesn't fit
+  bool Pop(void *record, size_t capacity, size_t &n);
+
+  alignas(64) std::atomic<uint32_t> head;
+  alignas(64) std::atomic<uint32_t> tail;
+  alignas(64) std::atomic<uint32_t> signal;
+  std::atomic<uint32_t> sleeping;
+  uint32_t sizes[kSlots];
+  alignas(64) unsigned char slots[kSlots][kSlotBytes];
+};
+
+// The memory a server and a client on the same host share for one session:
+// a ring of telemetry from the client and one of commands back. Made by the
+// server under a name it tells the client over the websocket, opened by
+// the client, and unmapped by each when it is done; the server removes the
+// name. Wakeups are futexes on Linux, elsewhere a waiting side polls every
+// 100 us.
+class SharedChannel {
+ public:
+  // A new channel named name ("/mpc-..."), for the server; null if the
+  // shared memory can't be made
+  static std::unique_ptr<SharedChannel> Create(const std::string &name);
+  // The channel a server made under name, for the client; null if there is
+  // none or it is of another version
+  static std::unique_ptr<SharedChannel> Open(const std::string &name);
+
+  ~SharedChannel();
+  SharedChannel(const SharedChannel &) = delete;
+  SharedChannel &operator=(const SharedChannel &) = delete;
+
+  const std::string &name() const { return name_; }
+
+  // The server's side: wait for the next telemetry record, false once the
+  // channel is closed; then reply with a command record, false if the ring
+  // is full
+  bool WaitTelemetry(std::string &record);
+  bool SendCommand(const MessageView &record);
+  // The client's side, the other way around
+  bool SendTelemetry(const SharedTelemetry &record);
+  bool WaitCommand(SharedCommand &command);
+
+  // Wake both sides for good, from either process
+  void Close();
+  bool closed() const;
+
+ private:
+  struct Segment;
+
+  SharedChannel(const std::string &name, Segment *segment, bool owner);
+  // Pop from ring as Pop does, sleeping while it's empty; false once closed
+  bool Wait(SharedRing &ring, void *record, size_t capacity, size_t &n);
+  void Wake(SharedRing &ring);
+
+  std::string name_;
+  Segment *segment_;
+  bool owner_;
+};
+
+// Read a telemetry record, as a mailbox holds it, into telemetry; false if
+// it is of another size or has more than kMaxWaypoints waypoints
+bool ReadSharedTelemetry(const MessageView &record, Telemetry &telemetry);
+
+// Read a command record into command; false if it is of another size
+bool ReadSharedCommand(const MessageView &record, SharedCommand &command);
+
+// The steer reply as a SharedCommand, written into a buffer that is kept
+// from one message to the next like SteerMessage
+class SteerRecord {
+ public:
+  SteerRecord();
+
+  // The record, valid until the next Write
+  const std::string &Write(double steering_angle, double throttle, const double *mpc_x,
+                           const double *mpc_y, size_t mpc_n, const double *next_x,
+                           const double *next_y, size_t next_n);
+
+ private:
+  std::string buffer_;
+};
+
+#endif /* SHARED_CHANNEL_H */
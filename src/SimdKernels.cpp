@@ -0,0 +1,309 @@
+#include "SimdKernels.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(MPC_SIMD_DISPATCH) && defined(__x86_64__) && defined(__ELF__) && \
+    ((defined(__clang__) && __clang_major__ >= 14) ||                        \
+     (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 6))
+#define MPC_TARGET_CLONES \
+  __attribute__((target_clones("avx512f", "avx2", "sse4.2", "default")))
+#define MPC_HAS_TARGET_CLONES 1
+#else
+#define MPC_TARGET_CLONES
+#define MPC_HAS_TARGET_CLONES 0
+#endif
+
+// AArch64 has the double lanes of NEON and its fused multiply-add in every
+// build, written out rather than left to the vectorizer, which keeps the
+// blocks and the checks of overlap the x86-64 loops need
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MPC_NEON_KERNELS 1
+#else
+#define MPC_NEON_KERNELS 0
+#endif
+
+#if MPC_NEON_KERNELS
+
+namespace {
+
+// PolyevalPoints over pairs of points, Horner's scheme run over all of the
+// coefficients in the registers of a pair before the next; with Slopes its
+// derivative too
+template <bool Slopes>
+void PolyevalPairs(const double *coeffs, size_t count, const double *xs, size_t n,
+                   double *values, double *slopes) {
+  const double last = coeffs[count - 1];
+  size_t j = 0;
+  for (; j + 2 <= n; j += 2) {
+    const float64x2_t x = vld1q_f64(xs + j);
+    float64x2_t value = vdupq_n_f64(last);
+    float64x2_t slope = vdupq_n_f64(0.0);
+    for (size_t i = count - 1; i-- > 0;) {
+      if (Slopes) {
+        slope = vfmaq_f64(value, slope, x);
+      }
+      value = vfmaq_f64(vdupq_n_f64(coeffs[i]), value, x);
+    }
+    vst1q_f64(values + j, value);
+    if (Slopes) {
+      vst1q_f64(slopes + j, slope);
+    }
+  }
+  for (; j < n; j++) {
+    double value = last;
+    double slope = 0;
+    for (size_t i = count - 1; i-- > 0;) {
+      slope = slope * xs[j] + value;
+      value = value * xs[j] + coeffs[i];
+    }
+    values[j] = value;
+    if (Slopes) {
+      slopes[j] = slope;
+    }
+  }
+}
+
+}  // namespace
+
+void RotatePoints(double px, double py, double c, double s, const double *xs, const double *ys,
+                  size_t n, double *out_x, double *out_y) {
+  const float64x2_t p_x = vdupq_n_f64(px);
+  const float64x2_t p_y = vdupq_n_f64(py);
+  const float64x2_t cosine = vdupq_n_f64(c);
+  const float64x2_t sine = vdupq_n_f64(s);
+  // A pair is read whole before it is written, so the outputs may be the
+  // inputs without the blocks of the loops below
+  size_t j = 0;
+  for (; j + 2 <= n; j += 2) {
+    const float64x2_t dx = vsubq_f64(vld1q_f64(xs + j), p_x);
+    const float64x2_t dy = vsubq_f64(vld1q_f64(ys + j), p_y);
+    vst1q_f64(out_x + j, vfmaq_f64(vmulq_f64(dy, sine), dx, cosine));
+    vst1q_f64(out_y + j, vfmsq_f64(vmulq_f64(dy, cosine), dx, sine));
+  }
+  for (; j < n; j++) {
+    const double dx = xs[j] - px;
+    const double dy = ys[j] - py;
+    out_x[j] = dx * c + dy * s;
+    out_y[j] = dy * c - dx * s;
+  }
+}
+
+void PolyevalPoints(const double *coeffs, size_t count, const double *__restrict xs, size_t n,
+                    double *__restrict values, double *__restrict slopes) {
+  if (count == 0) {
+    std::fill(values, values + n, 0.0);
+    if (slopes) {
+      std::fill(slopes, slopes + n, 0.0);
+    }
+    return;
+  }
+  if (slopes) {
+    PolyevalPairs<true>(coeffs, count, xs, n, values, slopes);
+  } else {
+    PolyevalPairs<false>(coeffs, count, xs, n, values, slopes);
+  }
+}
+
+#else
+
+namespace {
+
+// Points translated at a time into arrays of the stack, so that the
+// rotation reads them apart from the outputs, which may be the inputs
+const size_t kBlock = 64;
+
+}  // namespace
+
+MPC_TARGET_CLONES
+void RotatePoints(double px, double py, double c, double s, const double *xs, const double *ys,
+                  size_t n, double *out_x, double *out_y) {
+  double dx[kBlock];
+  double dy[kBlock];
+  while (n > 0) {
+    const size_t m = std::min(n, kBlock);
+    for (size_t j = 0; j < m; j++) {
+      dx[j] = xs[j] - px;
+      dy[j] = ys[j] - py;
+    }
+    double *__restrict x = out_x;
+    double *__restrict y = out_y;
+    for (size_t j = 0; j < m; j++) {
+      x[j] = dx[j] * c + dy[j] * s;
+      y[j] = dy[j] * c - dx[j] * s;
+    }
+    xs += m;
+    ys += m;
+    out_x += m;
+    out_y += m;
+    n -= m;
+  }
+}
+
+MPC_TARGET_CLONES
+void PolyevalPoints(const double *coeffs, size_t count, const double *__restrict xs, size_t n,
+                    double *__restrict values, double *__restrict slopes) {
+  if (count == 0) {
+    std::fill(values, values + n, 0.0);
+    if (slopes) {
+      std::fill(slopes, slopes + n, 0.0);
+    }
+    return;
+  }
+  // Each step of Horner's scheme over all of the points, the loop the
+  // lanes run along
+  std::fill(values, values + n, coeffs[count - 1]);
+  if (slopes) {
+    std::fill(slopes, slopes + n, 0.0);
+  }
+  for (size_t i = count - 1; i-- > 0;) {
+    const double coeff = coeffs[i];
+    if (slopes) {
+      for (size_t j = 0; j < n; j++) {
+        slopes[j] = slopes[j] * xs[j] + values[j];
+      }
+    }
+    for (size_t j = 0; j < n; j++) {
+      values[j] = values[j] * xs[j] + coeff;
+    }
+  }
+}
+
+#endif  // MPC_NEON_KERNELS
+
+namespace {
+
+// Vehicles fitted at a time, their sums in arrays of the stack
+const size_t kLanes = 64;
+
+}  // namespace
+
+// Plain loops on AArch64 too: the lanes are vehicles, a loop of the same
+// arithmetic for each, which the vectorizer maps onto NEON as well as
+// written out
+MPC_TARGET_CLONES
+void FitCubicLanes(const double *px, const double *py, const double *c, const double *s,
+                   double *xs, double *ys, size_t n, size_t lanes, double *coeffs) {
+  for (size_t k0 = 0; k0 < lanes; k0 += kLanes) {
+    const size_t m = std::min(lanes - k0, kLanes);
+    const double *__restrict p_x = px + k0;
+    const double *__restrict p_y = py + k0;
+    const double *__restrict cosine = c + k0;
+    const double *__restrict sine = s + k0;
+    for (size_t j = 0; j < n; j++) {
+      double *__restrict x = xs + j * lanes + k0;
+      double *__restrict y = ys + j * lanes + k0;
+      for (size_t k = 0; k < m; k++) {
+        const double dx = x[k] - p_x[k];
+        const double dy = y[k] - p_y[k];
+        x[k] = dx * cosine[k] + dy * sine[k];
+        y[k] = dy * cosine[k] - dx * sine[k];
+      }
+    }
+
+    // The abscissa t = (x - center) / scale of each vehicle, from its first
+    // and last waypoints like FitInVehicleFrame
+    double center[kLanes];
+    double scale[kLanes];
+    double inverse[kLanes];
+    const double *__restrict first = xs + k0;
+    const double *__restrict last = xs + (n - 1) * lanes + k0;
+    for (size_t k = 0; k < m; k++) {
+      const double half_width = 0.5 * std::fabs(last[k] - first[k]);
+      center[k] = 0.5 * (first[k] + last[k]);
+      scale[k] = half_width > 1e-6 ? half_width : 1.0;
+      inverse[k] = 1 / scale[k];
+    }
+
+    // The power sums of t up to t^6 and those weighted by y, a point of
+    // every vehicle at a time
+    double sums[7][kLanes];
+    double rhs[4][kLanes];
+    std::fill(&sums[0][0], &sums[0][0] + 7 * kLanes, 0.0);
+    std::fill(&rhs[0][0], &rhs[0][0] + 4 * kLanes, 0.0);
+    for (size_t j = 0; j < n; j++) {
+      const double *__restrict x = xs + j * lanes + k0;
+      const double *__restrict y = ys + j * lanes + k0;
+      for (size_t k = 0; k < m; k++) {
+        const double t = (x[k] - center[k]) * inverse[k];
+        const double t2 = t * t;
+        const double t3 = t2 * t;
+        sums[0][k] += 1;
+        sums[1][k] += t;
+        sums[2][k] += t2;
+        sums[3][k] += t3;
+        sums[4][k] += t2 * t2;
+        sums[5][k] += t2 * t3;
+        sums[6][k] += t3 * t3;
+        rhs[0][k] += y[k];
+        rhs[1][k] += y[k] * t;
+        rhs[2][k] += y[k] * t2;
+        rhs[3][k] += y[k] * t3;
+      }
+    }
+
+    // The 4 x 4 normal equations of each vehicle by LDL^T, unrolled and
+    // without square roots, then the coefficients in powers of x like
+    // FromNormalizedAbscissa
+    for (size_t k = 0; k < m; k++) {
+      const double d0 = sums[0][k];
+      const double l10 = sums[1][k] / d0;
+      const double l20 = sums[2][k] / d0;
+      const double l30 = sums[3][k] / d0;
+      const double d1 = sums[2][k] - l10 * l10 * d0;
+      const double l21 = (sums[3][k] - l20 * l10 * d0) / d1;
+      const double l31 = (sums[4][k] - l30 * l10 * d0) / d1;
+      const double d2 = sums[4][k] - l20 * l20 * d0 - l21 * l21 * d1;
+      const double l32 = (sums[5][k] - l30 * l20 * d0 - l31 * l21 * d1) / d2;
+      const double d3 = sums[6][k] - l30 * l30 * d0 - l31 * l31 * d1 - l32 * l32 * d2;
+
+      const double z0 = rhs[0][k];
+      const double z1 = rhs[1][k] - l10 * z0;
+      const double z2 = rhs[2][k] - l20 * z0 - l21 * z1;
+      const double z3 = rhs[3][k] - l30 * z0 - l31 * z1 - l32 * z2;
+      double a3 = z3 / d3;
+      double a2 = z2 / d2 - l32 * a3;
+      double a1 = z1 / d1 - l21 * a2 - l31 * a3;
+      double a0 = z0 / d0 - l10 * a1 - l20 * a2 - l30 * a3;
+
+      const double u = inverse[k];
+      a1 *= u;
+      a2 *= u * u;
+      a3 *= u * u * u;
+      const double x0 = center[k];
+      a2 -= x0 * a3;
+      a1 -= x0 * a2;
+      a0 -= x0 * a1;
+      a2 -= x0 * a3;
+      a1 -= x0 * a2;
+      a2 -= x0 * a3;
+      coeffs[k0 + k] = a0;
+      coeffs[lanes + k0 + k] = a1;
+      coeffs[2 * lanes + k0 + k] = a2;
+      coeffs[3 * lanes + k0 + k] = a3;
+    }
+  }
+}
+
+const char *SimdKernelTarget() {
+#if MPC_HAS_TARGET_CLONES
+  // In the order the resolver of the clones tries them
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return "avx512f";
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return "avx2";
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return "sse4.2";
+  }
+  return "sse2";
+#elif defined(__x86_64__)
+  return "sse2";
+#elif defined(__aarch64__)
+  return "neon";
+#else
+  return "baseline";
+#endif
+}
@@ -0,0 +1,55 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <cstddef>
+
+// The loops over the arrays of points of a tick, built for several
+// instruction sets in one binary: the transform of the waypoints and of
+// the plan between the map and the vehicle frames, and the evaluation of
+// the reference polynomial along them. The build is for the baseline of
+// the architecture (-O3 with no -march, SSE2 on x86-64), so that it runs on
+// any host; with MPC_SIMD_DISPATCH (on by default) these few kernels are
+// compiled again by GCC's target_clones for SSE4.2, AVX2 and AVX-512, and
+// the dynamic loader picks the widest the CPU has, from CPUID, once as the
+// program starts (a GNU ifunc), so that a call is the indirect call of a
+// shared library and nothing is checked per call. They are plain loops the
+// compiler vectorizes for each target, rather than Eigen, whose packets
+// are chosen by the preprocessor for the whole build.
+//
+// The x86-64 builds of GCC 6 or newer and Clang 14 or newer on ELF have
+// the clones; the others get the one variant. On AArch64, whose baseline
+// has NEON already, that variant is written in its intrinsics, a pair of
+// doubles at a time with fused multiply-adds (see the cross build of
+// cmake/aarch64-linux-gnu.cmake). SimdKernelTarget names the one running.
+
+// Of the n points (xs, ys), translated by (-px, -py) then rotated by
+// (c, s), the cosine and sine of the heading: out_x = dx c + dy s, out_y =
+// dy c - dx s. out_x and out_y may be xs and ys.
+void RotatePoints(double px, double py, double c, double s, const double *xs, const double *ys,
+                  size_t n, double *out_x, double *out_y);
+
+// The polynomial of the count coefficients coeffs, from the constant one
+// up, at the n points xs into values and its derivative into slopes (null
+// to skip it), by Horner's scheme over the points at once; values and
+// slopes are apart from xs and from each other.
+void PolyevalPoints(const double *coeffs, size_t count, const double *xs, size_t n,
+                    double *values, double *slopes);
+
+// The cubics of lanes vehicles at once, a vehicle to a SIMD lane: the n >
+// 3 waypoints of vehicle k in the map frame at xs[j * lanes + k] and ys[j *
+// lanes + k], point j of every vehicle together, are transformed in place
+// into the frame of the vehicle at (px[k], py[k]) with the cosine and sine
+// of its heading c[k] and s[k], as RotatePoints, and fitted as
+// FitInVehicleFrame<3> fits them, the coefficient i of vehicle k into
+// coeffs[i * lanes + k]. The normal equations of a cubic are 4 x 4, too
+// small to vectorize one at a time; solved side by side by the same
+// unrolled factorization, they fill the lanes.
+void FitCubicLanes(const double *px, const double *py, const double *c, const double *s,
+                   double *xs, double *ys, size_t n, size_t lanes, double *coeffs);
+
+// The instruction set the kernels were dispatched to on this host:
+// "avx512f", "avx2", "sse4.2" or "sse2" on x86-64, "neon" on AArch64,
+// "baseline" elsewhere
+const char *SimdKernelTarget();
+
+#endif /* SIMD_KERNELS_H */
@@ -0,0 +1,329 @@
+#include "Soak.h"
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace {
+
+// The median of values, 0 for none
+double Median(std::vector<double> values) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+void AppendGauge(const char *name, const char *help, const char *sample, double value,
+                 std::string &out) {
+  if (name != nullptr) {
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(name).append(" gauge\n");
+  }
+  char number[32];
+  std::snprintf(number, sizeof(number), "%.17g", value);
+  out.append(sample).append(" ").append(number).append("\n");
+}
+
+}  // namespace
+
+double ProcessMemory::fragmentation() const {
+  const double held = heap_inuse + heap_free;
+  return held > 0 ? heap_free / held : 0;
+}
+
+bool ReadProcessMemory(ProcessMemory &memory) {
+  memory = ProcessMemory();
+#ifdef __linux__
+  // Its second field is the resident pages
+  FILE *statm = std::fopen("/proc/self/statm", "r");
+  if (statm == nullptr) {
+    return false;
+  }
+  unsigned long size = 0;
+  unsigned long resident = 0;
+  const bool read = std::fscanf(statm, "%lu %lu", &size, &resident) == 2;
+  std::fclose(statm);
+  if (!read) {
+    return false;
+  }
+  memory.resident = static_cast<double>(resident) * static_cast<double>(sysconf(_SC_PAGESIZE));
+#ifdef __GLIBC__
+#if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33)
+  const struct mallinfo2 heap = mallinfo2();
+#else
+  // Its counts wrap at 4 GiB
+  const struct mallinfo heap = mallinfo();
+#endif
+  // The blocks of the arenas and those mapped on their own, in use; the
+  // free blocks of the arenas
+  memory.heap_inuse = static_cast<double>(heap.uordblks) + static_cast<double>(heap.hblkhd);
+  memory.heap_free = static_cast<double>(heap.fordblks);
+#endif
+  return true;
+#else
+  return false;
+#endif
+}
+
+void RenderProcessMemory(std::string &out) {
+  ProcessMemory memory;
+  if (!ReadProcessMemory(memory)) {
+    return;
+  }
+  AppendGauge("mpc_process_resident_bytes", "Resident set of the server",
+              "mpc_process_resident_bytes", memory.resident, out);
+  AppendGauge("mpc_heap_bytes", "Bytes of the heap of malloc, in use and free in its arenas",
+              "mpc_heap_bytes{state=\"inuse\"}", memory.heap_inuse, out);
+  AppendGauge(nullptr, nullptr, "mpc_heap_bytes{state=\"free\"}", memory.heap_free, out);
+  AppendGauge("mpc_heap_fragmentation_ratio", "Free share of the heap malloc holds",
+              "mpc_heap_fragmentation_ratio", memory.fragmentation(), out);
+}
+
+bool HttpGet(const std::string &url, std::string &body, std::string &error, double timeout) {
+  body.clear();
+  const std::string scheme = "http://";
+  if (url.compare(0, scheme.size(), scheme) != 0) {
+    error = "not an http:// url: " + url;
+    return false;
+  }
+  const size_t slash = url.find('/', scheme.size());
+  const std::string authority = url.substr(scheme.size(), slash - scheme.size());
+  const std::string path = slash == std::string::npos ? "/" : url.substr(slash);
+  const size_t colon = authority.rfind(':');
+  std::string host = colon == std::string::npos ? authority : authority.substr(0, colon);
+  const std::string port = colon == std::string::npos ? "80" : authority.substr(colon + 1);
+  if (host.size() > 1 && host.front() == '[' && host.back() == ']') {
+    host = host.substr(1, host.size() - 2);
+  }
+
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *addresses = nullptr;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+    error = "could not resolve " + authority;
+    return false;
+  }
+  timeval wait;
+  wait.tv_sec = static_cast<time_t>(timeout);
+  wait.tv_usec = static_cast<suseconds_t>((timeout - std::floor(timeout)) * 1e6);
+  int fd = -1;
+  for (addrinfo *address = addresses; address != nullptr && fd < 0; address = address->ai_next) {
+    fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &wait, sizeof(wait));
+    if (connect(fd, address->ai_addr, address->ai_addrlen) < 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (fd < 0) {
+    error = "could not connect to " + authority;
+    return false;
+  }
+
+  const std::string request =
+      "GET " + path + " HTTP/1.1\r\nHost: " + authority + "\r\nConnection: close\r\n\r\n";
+  size_t sent = 0;
+  while (sent < request.size()) {
+    const ssize_t n = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      close(fd);
+      error = "could not send the request to " + authority;
+      return false;
+    }
+    sent += static_cast<size_t>(n);
+  }
+
+  // Up to the end of the body its Content-Length gives, or of the
+  // connection without one
+  std::string response;
+  size_t header_end = std::string::npos;
+  size_t length = std::string::npos;
+  char buffer[16384];
+  while (header_end == std::string::npos || length == std::string::npos ||
+         response.size() < header_end + length) {
+    const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    response.append(buffer, static_cast<size_t>(n));
+    if (header_end == std::string::npos) {
+      const size_t end = response.find("\r\n\r\n");
+      if (end != std::string::npos) {
+        header_end = end + 4;
+        std::string headers = response.substr(0, header_end);
+        std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+        const size_t field = headers.find("content-length:");
+        if (field != std::string::npos) {
+          length = std::strtoul(headers.c_str() + field + 15, nullptr, 10);
+        }
+      }
+    }
+  }
+  close(fd);
+  if (header_end == std::string::npos) {
+    error = "no response from " + authority;
+    return false;
+  }
+  const size_t space = response.find(' ');
+  if (space == std::string::npos || response.compare(space + 1, 3, "200") != 0) {
+    error = "GET " + url + ": " + response.substr(0, response.find("\r\n"));
+    return false;
+  }
+  body = response.substr(header_end, length);
+  return true;
+}
+
+double MetricSample(const std::string &metrics, const std::string &name) {
+  size_t at = 0;
+  while ((at = metrics.find(name, at)) != std::string::npos) {
+    const size_t end = at + name.size();
+    // At the start of a line, and followed by its value
+    if ((at == 0 || metrics[at - 1] == '\n') && end < metrics.size() && metrics[end] == ' ') {
+      return std::strtod(metrics.c_str() + end + 1, nullptr);
+    }
+    at = end;
+  }
+  return 0;
+}
+
+SoakLog::SoakLog(const std::string &path) {
+  if (path.empty()) {
+    return;
+  }
+  csv_.open(path);
+  ok_ = csv_.good();
+  csv_ << "elapsed_s,resident_bytes,heap_inuse_bytes,heap_free_bytes,fragmentation,"
+          "cppad_inuse_bytes,cppad_available_bytes,sessions,churned,ticks,p50_s,p99_s,p999_s"
+       << std::endl;
+}
+
+void SoakLog::Add(const SoakSample &sample) {
+  if (samples_.empty()) {
+    std::cout << std::setw(9) << "elapsed s" << std::setw(10) << "rss MiB" << std::setw(10)
+              << "heap MiB" << std::setw(8) << "frag %" << std::setw(10) << "cppad MiB"
+              << std::setw(10) << "sessions" << std::setw(9) << "churned" << std::setw(9)
+              << "ticks" << std::setw(9) << "p50 ms" << std::setw(9) << "p99 ms" << std::setw(10)
+              << "p999 ms" << std::endl;
+  }
+  samples_.push_back(sample);
+  const double mib = 1.0 / (1 << 20);
+  std::cout << std::fixed << std::setprecision(0) << std::setw(9) << sample.elapsed
+            << std::setprecision(1) << std::setw(10) << sample.memory.resident * mib
+            << std::setw(10) << sample.memory.heap_inuse * mib << std::setw(8)
+            << sample.memory.fragmentation() * 100 << std::setw(10)
+            << (sample.cppad_inuse + sample.cppad_available) * mib << std::setprecision(0)
+            << std::setw(10) << sample.sessions << std::setw(9) << sample.churned
+            << std::setw(9) << sample.ticks << std::setprecision(3) << std::setw(9)
+            << sample.p50 * 1e3 << std::setw(9) << sample.p99 * 1e3 << std::setw(10)
+            << sample.p999 * 1e3 << std::endl;
+  if (csv_.is_open()) {
+    csv_ << std::setprecision(17) << sample.elapsed << "," << sample.memory.resident << ","
+         << sample.memory.heap_inuse << "," << sample.memory.heap_free << ","
+         << sample.memory.fragmentation() << "," << sample.cppad_inuse << ","
+         << sample.cppad_available << "," << sample.sessions << "," << sample.churned << ","
+         << sample.ticks << "," << sample.p50 << "," << sample.p99 << "," << sample.p999
+         << std::endl;
+    ok_ &= csv_.good();
+  }
+}
+
+std::vector<std::string> SoakLog::Drifts(const SoakPolicy &policy) const {
+  std::vector<std::string> drifts;
+  if (samples_.empty()) {
+    return drifts;
+  }
+  const double settled = policy.settle * samples_.back().elapsed;
+  std::vector<const SoakSample *> trend;
+  for (const SoakSample &sample : samples_) {
+    if (sample.elapsed >= settled) {
+      trend.push_back(&sample);
+    }
+  }
+  // Too few for a line and quarters
+  if (trend.size() < 4) {
+    return drifts;
+  }
+
+  const struct {
+    const char *name;
+    double (*value)(const SoakSample &);
+    // Growth allowed, relative or absolute, and the unit it is printed in
+    double limit;
+    bool relative;
+    double scale;
+    const char *unit;
+  } quantities[] = {
+      {"resident set", [](const SoakSample &s) { return s.memory.resident; },
+       policy.memory_growth, true, 1.0 / (1 << 20), "MiB"},
+      {"heap in use", [](const SoakSample &s) { return s.memory.heap_inuse; },
+       policy.memory_growth, true, 1.0 / (1 << 20), "MiB"},
+      {"CppAD pools", [](const SoakSample &s) { return s.cppad_inuse + s.cppad_available; },
+       policy.memory_growth, true, 1.0 / (1 << 20), "MiB"},
+      {"heap fragmentation", [](const SoakSample &s) { return s.memory.fragmentation(); },
+       policy.fragmentation_growth, false, 100, "%"},
+      {"p99 latency", [](const SoakSample &s) { return s.p99; }, policy.latency_growth, true,
+       1e3, "ms"},
+  };
+  for (const auto &quantity : quantities) {
+    // Least squares line of the value over the elapsed time
+    const double n = static_cast<double>(trend.size());
+    double t_mean = 0;
+    double y_mean = 0;
+    std::vector<double> values;
+    for (const SoakSample *sample : trend) {
+      t_mean += sample->elapsed / n;
+      y_mean += quantity.value(*sample) / n;
+      values.push_back(quantity.value(*sample));
+    }
+    double covariance = 0;
+    double variance = 0;
+    for (const SoakSample *sample : trend) {
+      covariance += (sample->elapsed - t_mean) * (quantity.value(*sample) - y_mean);
+      variance += (sample->elapsed - t_mean) * (sample->elapsed - t_mean);
+    }
+    const double slope = variance > 0 ? covariance / variance : 0;
+    const double start = y_mean + slope * (trend.front()->elapsed - t_mean);
+    const double end = y_mean + slope * (trend.back()->elapsed - t_mean);
+    const double growth =
+        quantity.relative ? (start > 0 ? (end - start) / start : 0) : end - start;
+
+    const size_t quarter = values.size() / 4;
+    const double first = Median(std::vector<double>(values.begin(), values.begin() + quarter));
+    const double last = Median(std::vector<double>(values.end() - quarter, values.end()));
+    if (growth > quantity.limit && last > first) {
+      std::ostringstream line;
+      line << std::fixed << std::setprecision(2) << quantity.name << " grew from "
+           << start * quantity.scale << " to " << end * quantity.scale << " " << quantity.unit
+           << " (+" << growth * 100 << (quantity.relative ? "%" : " points") << ") over "
+           << std::setprecision(0) << trend.back()->elapsed - trend.front()->elapsed << " s";
+      drifts.push_back(line.str());
+    }
+  }
+  return drifts;
+}
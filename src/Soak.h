@@ -0,0 +1,108 @@
+#ifndef SOAK_H
+#define SOAK_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Soak runs of mpc_loadgen and mpc_sim: hours of load with sessions made
+// and dropped all along, sampled every interval, for the slow growth of
+// memory and of the tail latency that only shows after days of uptime, to
+// be caught before a build goes out.
+
+// The memory of the calling process
+struct ProcessMemory {
+  // Resident set, in bytes
+  double resident = 0;
+  // Bytes of glibc's heap in use by allocations, and free but held in its
+  // arenas; none elsewhere
+  double heap_inuse = 0;
+  double heap_free = 0;
+
+  // The free share of the heap held, how fragmented it is: what it can't
+  // hand back for the allocations in use between
+  double fragmentation() const;
+};
+
+// The memory of the calling process from /proc/self/statm and mallinfo2,
+// false where there are neither (not Linux)
+bool ReadProcessMemory(ProcessMemory &memory);
+
+// Append the gauges of the memory of this process to out:
+// mpc_process_resident_bytes, mpc_heap_bytes{state="inuse"|"free"} and
+// mpc_heap_fragmentation_ratio
+void RenderProcessMemory(std::string &out);
+
+// The body of the response to a GET of url, "http://host[:port]/path",
+// false with the reason in error if there is none with status 200. Blocks,
+// for up to timeout seconds.
+bool HttpGet(const std::string &url, std::string &body, std::string &error,
+             double timeout = 5);
+
+// The value of the sample name (with its labels, e.g.
+// mpc_heap_bytes{state="inuse"}) in the Prometheus text of metrics, 0 if
+// there is none
+double MetricSample(const std::string &metrics, const std::string &name);
+
+// A sample of a soak: the memory of the process under load, and the ticks
+// of the interval before it and their latency
+struct SoakSample {
+  // Seconds since the soak started
+  double elapsed = 0;
+  ProcessMemory memory;
+  // Bytes of the CppAD pools, in use and held
+  double cppad_inuse = 0;
+  double cppad_available = 0;
+  // Sessions open, and made so far
+  double sessions = 0;
+  uint64_t churned = 0;
+  // Ticks of the interval, and the median, 99th and 99.9th percentiles of
+  // their latency, in s
+  uint64_t ticks = 0;
+  double p50 = 0;
+  double p99 = 0;
+  double p999 = 0;
+};
+
+// What counts as drift over a soak
+struct SoakPolicy {
+  // Share of the run at the start left out, while the caches, pools and
+  // arenas fill
+  double settle = 0.25;
+  // Growth over the rest of the run, relative to where it starts, of the
+  // resident set, the heap in use and the CppAD pools; of the 99th
+  // percentile of the latency; and of the fragmentation, absolute
+  double memory_growth = 0.05;
+  double latency_growth = 0.25;
+  double fragmentation_growth = 0.1;
+};
+
+// The samples of a soak, printed as they come, a line each, and written to
+// a CSV file; then the drifts of the run.
+//
+// A quantity drifts when the least squares line through its samples after
+// the settling grows by more than the policy allows from the first of them
+// to the last, and the median of its last quarter is above that of its
+// first: a trend, not a spike, which a drift of the line alone could be.
+class SoakLog {
+ public:
+  // Written to path as well, unless it is empty; false from ok() if it
+  // can't be
+  explicit SoakLog(const std::string &path);
+
+  bool ok() const { return ok_; }
+  const std::vector<SoakSample> &samples() const { return samples_; }
+
+  void Add(const SoakSample &sample);
+
+  // A line for each quantity that drifts, its start, end and growth
+  std::vector<std::string> Drifts(const SoakPolicy &policy) const;
+
+ private:
+  std::ofstream csv_;
+  bool ok_ = true;
+  std::vector<SoakSample> samples_;
+};
+
+#endif /* SOAK_H */
@@ -0,0 +1,148 @@
+#include "SocketIOFrame.h"
+
+namespace {
+
+const size_t npos = MessageView::npos;
+
+bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+size_t SkipSpace(const MessageView &m, size_t i) {
+  while (i < m.size() && IsSpace(m[i])) {
+    i++;
+  }
+  return i;
+}
+
+// Past the closing quote of the JSON string whose opening quote is at i,
+// npos if it isn't closed
+size_t SkipString(const MessageView &m, size_t i) {
+  for (i++; i < m.size(); i++) {
+    if (m[i] == '\\') {
+      i++;
+    } else if (m[i] == '"') {
+      return i + 1;
+    }
+  }
+  return npos;
+}
+
+bool Invalid(SocketIOFrame &frame) {
+  frame = SocketIOFrame();
+  return false;
+}
+
+}  // namespace
+
+size_t SkipJSONValue(const MessageView &m, size_t i) {
+  if (i >= m.size()) {
+    return npos;
+  }
+  if (m[i] == '"') {
+    return SkipString(m, i);
+  }
+  if (m[i] == '[' || m[i] == '{') {
+    size_t depth = 0;
+    while (i < m.size()) {
+      const char c = m[i];
+      if (c == '"') {
+        i = SkipString(m, i);
+        if (i == npos) {
+          return npos;
+        }
+        continue;
+      }
+      if (c == '[' || c == '{') {
+        depth++;
+      } else if ((c == ']' || c == '}') && --depth == 0) {
+        return i + 1;
+      }
+      i++;
+    }
+    return npos;
+  }
+  const size_t start = i;
+  while (i < m.size() && !IsSpace(m[i]) && m[i] != ',' && m[i] != ']' && m[i] != '}') {
+    i++;
+  }
+  return i > start ? i : npos;
+}
+
+bool DecodeFrame(const MessageView &message, SocketIOFrame &frame) {
+  frame = SocketIOFrame();
+  const MessageView &m = message;
+  const size_t n = m.size();
+  if (n == 0) {
+    return false;
+  }
+  switch (m[0]) {
+    case '0':
+      frame.packet = FramePacket::kOpen;
+      return true;
+    case '1':
+      frame.packet = FramePacket::kClose;
+      return true;
+    case '2':
+      frame.packet = FramePacket::kPing;
+      return true;
+    case '3':
+      frame.packet = FramePacket::kPong;
+      return true;
+    case '4':
+      break;
+    default:
+      frame.packet = FramePacket::kOther;
+      return true;
+  }
+  if (n < 2 || m[1] != '2') {
+    frame.packet = FramePacket::kOther;
+    return true;
+  }
+
+  // Namespace and ack id, if any
+  size_t i = 2;
+  if (i < n && m[i] == '/') {
+    i = m.find(',', i);
+    if (i == npos) {
+      return Invalid(frame);
+    }
+    i++;
+  }
+  while (i < n && m[i] >= '0' && m[i] <= '9') {
+    i++;
+  }
+
+  // [name, data, ...]
+  i = SkipSpace(m, i);
+  if (i >= n || m[i] != '[') {
+    return Invalid(frame);
+  }
+  const size_t open = i;
+  i = SkipSpace(m, i + 1);
+  if (i >= n || m[i] != '"') {
+    return Invalid(frame);
+  }
+  size_t end = SkipString(m, i);
+  if (end == npos) {
+    return Invalid(frame);
+  }
+  frame.event = m.substr(i + 1, end - i - 2);
+  i = SkipSpace(m, end);
+  for (bool first = true; i < n && m[i] == ',';) {
+    const size_t start = SkipSpace(m, i + 1);
+    end = SkipJSONValue(m, start);
+    if (end == npos) {
+      return Invalid(frame);
+    }
+    if (first) {
+      frame.data = m.substr(start, end - start);
+      first = false;
+    }
+    i = SkipSpace(m, end);
+  }
+  if (i >= n || m[i] != ']') {
+    return Invalid(frame);
+  }
+  frame.payload = m.substr(open, i + 1 - open);
+  frame.packet = FramePacket::kEvent;
+  return true;
+}
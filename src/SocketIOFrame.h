@@ -0,0 +1,51 @@
+#ifndef SOCKET_IO_FRAME_H
+#define SOCKET_IO_FRAME_H
+
+#include "MessageView.h"
+
+// Engine.io packet types, the first byte of a websocket message, with the
+// socket.io packet inside a message
+enum class FramePacket {
+  kOpen,
+  kClose,
+  kPing,
+  kPong,
+  // A socket.io event, "42[name,data]"
+  kEvent,
+  // Any other message, upgrade or noop
+  kOther,
+  kInvalid,
+};
+
+// A websocket message of the simulator decoded by DecodeFrame, its parts
+// views into the message.
+struct SocketIOFrame {
+  FramePacket packet = FramePacket::kInvalid;
+  // Of an event: the JSON array, its first element, the name of the event
+  // without the quotes and as sent (escapes and all), and its second
+  // element, the data, empty if there is none
+  MessageView payload;
+  MessageView event;
+  MessageView data;
+
+  // An event whose data is neither missing nor null
+  bool has_data() const {
+    return packet == FramePacket::kEvent && !data.empty() &&
+           !(data.size() == 4 && data.starts_with("null"));
+  }
+};
+
+// Classify message and find the parts of an event in one forward pass over
+// it, copying nothing: the packet types of engine.io and socket.io, an
+// optional namespace and ack id, then the array of the event, whose data
+// is skipped by its brackets, braces and strings up to the end of the
+// array. False, with packet kInvalid, for an event whose array is cut short
+// or malformed; the data itself is only delimited, not validated.
+bool DecodeFrame(const MessageView &message, SocketIOFrame &frame);
+
+// Past the JSON value at i of message: a string, an array or an object up
+// to its matching close, anything else up to the next separator; npos if
+// it is cut short or empty
+size_t SkipJSONValue(const MessageView &message, size_t i);
+
+#endif /* SOCKET_IO_FRAME_H */
@@ -0,0 +1,107 @@
+#include "SolutionDatabase.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Typical magnitudes of v, cte, epsi and the curvature, see MakeKey
+static const double kKeyScales[SolutionDatabase::n_keys] = {10.0, 0.5, 0.1, 0.005};
+
+SolutionDatabase::SolutionDatabase(size_t capacity) : capacity_(std::max<size_t>(capacity, 1)) {
+  keys_.reserve(capacity_);
+  actuations_.reserve(capacity_);
+}
+
+SolutionDatabase::Key SolutionDatabase::MakeKey(const MPCState &state, const MPCCoeffs &coeffs) {
+  Key key;
+  key[0] = state[3] / kKeyScales[0];
+  key[1] = state[4] / kKeyScales[1];
+  key[2] = state[5] / kKeyScales[2];
+  key[3] = (2 * coeffs[2] + 6 * coeffs[3] * state[0]) / kKeyScales[3];
+  return key;
+}
+
+static double SquaredDistance(const SolutionDatabase::Key &a, const SolutionDatabase::Key &b,
+                              size_t n) {
+  double d = 0;
+  for (size_t k = 0; k < n; k++) {
+    d += (a[k] - b[k]) * (a[k] - b[k]);
+  }
+  return d;
+}
+
+double SolutionDatabase::StateDistance(const Key &a, const Key &b) {
+  return std::sqrt(SquaredDistance(a, b, 3));
+}
+
+void SolutionDatabase::Insert(const Key &key, const std::vector<double> &actuations) {
+  if (keys_.size() < capacity_) {
+    keys_.push_back(key);
+    actuations_.push_back(actuations);
+  } else {
+    keys_[next_] = key;
+    actuations_[next_] = actuations;
+    next_ = (next_ + 1) % capacity_;
+  }
+  stale_ = true;
+}
+
+void SolutionDatabase::Build(size_t lo, size_t hi, size_t axis) {
+  if (hi - lo < 2) {
+    return;
+  }
+  const size_t mid = lo + (hi - lo) / 2;
+  std::nth_element(order_.begin() + lo, order_.begin() + mid, order_.begin() + hi,
+                   [this, axis](size_t a, size_t b) { return keys_[a][axis] < keys_[b][axis]; });
+  const size_t next = (axis + 1) % n_keys;
+  Build(lo, mid, next);
+  Build(mid + 1, hi, next);
+}
+
+void SolutionDatabase::Search(size_t lo, size_t hi, size_t axis, const Key &key, size_t &best,
+                              double &best_distance) const {
+  if (lo >= hi) {
+    return;
+  }
+  const size_t mid = lo + (hi - lo) / 2;
+  const size_t entry = order_[mid];
+  const double d = SquaredDistance(key, keys_[entry], n_keys);
+  if (d < best_distance) {
+    best_distance = d;
+    best = entry;
+  }
+
+  // The side of the split holding key first, the other only if the
+  // splitting plane is closer than the best so far
+  const double offset = key[axis] - keys_[entry][axis];
+  const size_t next = (axis + 1) % n_keys;
+  if (offset < 0) {
+    Search(lo, mid, next, key, best, best_distance);
+    if (offset * offset < best_distance) {
+      Search(mid + 1, hi, next, key, best, best_distance);
+    }
+  } else {
+    Search(mid + 1, hi, next, key, best, best_distance);
+    if (offset * offset < best_distance) {
+      Search(lo, mid, next, key, best, best_distance);
+    }
+  }
+}
+
+const std::vector<double> *SolutionDatabase::Nearest(const Key &key) {
+  if (keys_.empty()) {
+    return nullptr;
+  }
+  if (stale_) {
+    order_.resize(keys_.size());
+    for (size_t i = 0; i < order_.size(); i++) {
+      order_[i] = i;
+    }
+    Build(0, order_.size(), 0);
+    stale_ = false;
+  }
+
+  size_t best = order_[0];
+  double best_distance = std::numeric_limits<double>::infinity();
+  Search(0, order_.size(), 0, key, best, best_distance);
+  return &actuations_[best];
+}
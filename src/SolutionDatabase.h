@@ -0,0 +1,68 @@
+#ifndef SOLUTION_DATABASE_H
+#define SOLUTION_DATABASE_H
+
+#include <array>
+#include <cstddef>
+#include <vector>
+#include "Horizon.h"
+
+// Bounded store of past solutions for warm starting: the actuations of a
+// plan under a key reduced from the problem it solved, looked up by nearest
+// neighbour.
+//
+// The key is the reduced input of ExplicitMPC, p = [v, cte, epsi,
+// curvature], each divided by a typical magnitude so that distances weigh
+// them alike. The actuations are frame free, an MPC rolls them out from its
+// own state (see MPC::Solve).
+//
+// Once full, the oldest entry is replaced. Lookups go through a k-d tree
+// over the keys, rebuilt on the first lookup after an insertion: entries
+// come every tick but lookups only after discontinuities.
+class SolutionDatabase {
+public:
+  static constexpr size_t n_keys = 4;
+  typedef std::array<double, n_keys> Key;
+
+  explicit SolutionDatabase(size_t capacity);
+
+  // Scaled key of a state and polynomial handed to MPCBase::Solve
+  static Key MakeKey(const MPCState &state, const MPCCoeffs &coeffs);
+
+  // Distance between keys of the state alone, [v, cte, epsi], in the
+  // scaled units of the keys
+  static double StateDistance(const Key &a, const Key &b);
+
+  void Insert(const Key &key, const std::vector<double> &actuations);
+
+  // Actuations stored under the key nearest to key, null when there are
+  // none. Valid until the next Insert.
+  const std::vector<double> *Nearest(const Key &key);
+
+  size_t size() const { return keys_.size(); }
+  size_t capacity() const { return capacity_; }
+
+  // Entry k (< size), the oldest first, for a snapshot: inserted again in
+  // that order they make the same database
+  const Key &key(size_t k) const { return keys_[Slot(k)]; }
+  const std::vector<double> &actuations(size_t k) const { return actuations_[Slot(k)]; }
+
+private:
+  size_t Slot(size_t k) const { return keys_.size() < capacity_ ? k : (next_ + k) % capacity_; }
+  // Make the subtree of order_[lo, hi) split on axis, and search it
+  void Build(size_t lo, size_t hi, size_t axis);
+  void Search(size_t lo, size_t hi, size_t axis, const Key &key, size_t &best,
+              double &best_distance) const;
+
+  size_t capacity_;
+  std::vector<Key> keys_;
+  std::vector<std::vector<double> > actuations_;
+  // Entry replaced by the next Insert once full
+  size_t next_ = 0;
+
+  // Implicit k-d tree: the median of each range of order_ splits it, on the
+  // axis of its depth
+  std::vector<size_t> order_;
+  bool stale_ = false;
+};
+
+#endif /* SOLUTION_DATABASE_H */
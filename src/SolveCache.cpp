@@ -0,0 +1,135 @@
+#include "SolveCache.h"
+#include <algorithm>
+#include <cstring>
+
+static_assert(std::is_trivially_copyable<MPCSolution>::value, "The solutions are copied as bytes");
+
+namespace {
+
+uint64_t Fnv1a(const unsigned char *bytes, size_t n) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t k = 0; k < n; k++) {
+    hash = (hash ^ bytes[k]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+size_t PowerOfTwo(size_t n) {
+  size_t power = 1;
+  while (power < n) {
+    power <<= 1;
+  }
+  return power;
+}
+
+}  // namespace
+
+uint64_t HashSolveInputs(const SolveInputs &inputs) {
+  return Fnv1a(reinterpret_cast<const unsigned char *>(&inputs), sizeof(inputs));
+}
+
+SolveCache::SolveCache(size_t capacity)
+    : mask_(PowerOfTwo(std::max<size_t>(capacity, 1)) - 1), slots_(new Slot[mask_ + 1]) {}
+
+bool SolveCache::Find(uint64_t key, const SolveInputs &inputs, MPCSolution &solution) const {
+  const Slot &slot = slots_[key & mask_];
+  const uint64_t mark = slot.mark.load(std::memory_order_acquire);
+  if (mark == 0 || (mark & 1) != 0 || slot.key.load(std::memory_order_relaxed) != key) {
+    return false;
+  }
+  SolveInputs stored;
+  std::memcpy(&stored, &slot.inputs, sizeof(SolveInputs));
+  std::memcpy(&solution, &slot.solution, sizeof(MPCSolution));
+  // The copies before the mark is read again
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot.mark.load(std::memory_order_relaxed) == mark &&
+         std::memcmp(&stored, &inputs, sizeof(SolveInputs)) == 0;
+}
+
+bool SolveCache::Insert(uint64_t key, const SolveInputs &inputs, const MPCSolution &solution) {
+  Slot &slot = slots_[key & mask_];
+  uint64_t mark = slot.mark.load(std::memory_order_relaxed);
+  if ((mark & 1) != 0 ||
+      !slot.mark.compare_exchange_strong(mark, mark + 1, std::memory_order_relaxed)) {
+    return false;
+  }
+  // The odd mark before any of the writes
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.key.store(key, std::memory_order_relaxed);
+  std::memcpy(&slot.inputs, &inputs, sizeof(SolveInputs));
+  std::memcpy(&slot.solution, &solution, sizeof(MPCSolution));
+  slot.mark.store(mark + 2, std::memory_order_release);
+  return true;
+}
+
+SharedSolveMPC::SharedSolveMPC(std::unique_ptr<MPCBase> mpc, std::shared_ptr<SolveCache> cache)
+    : mpc_(std::move(mpc)), cache_(std::move(cache)) {
+  CopySettings(*mpc_);
+}
+
+void SharedSolveMPC::SetProblem(const std::string &problem) {
+  problem_ = Fnv1a(reinterpret_cast<const unsigned char *>(problem.data()), problem.size());
+}
+
+MPCSolution SharedSolveMPC::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
+  SolveInputs inputs;
+  inputs.problem = problem_;
+  inputs.reference_order = reference_order_;
+  std::copy(state.data(), state.data() + 6, inputs.state);
+  std::copy(coeffs.data(), coeffs.data() + 4, inputs.coeffs);
+  inputs.prev_a = prev_a;
+  inputs.max_solve_time = max_solve_time;
+  cost_schedule.At(state[3]).Store(inputs.weights);
+  const uint64_t key = HashSolveInputs(inputs);
+  hit_ = cache_->Find(key, inputs, cached_);
+  if (hit_) {
+    status_ = cached_.status;
+    cost_ = cached_.cost;
+    iterations_ = 0;
+    // No solve was made for the tick
+    MPCSolution result = cached_;
+    result.statistics = SolveStatistics();
+    return result;
+  }
+
+  mpc_->prev_a = prev_a;
+  mpc_->max_solve_time = max_solve_time;
+  mpc_->cost_schedule = cost_schedule;
+  const MPCSolution result = mpc_->Solve(state, coeffs);
+  status_ = mpc_->status();
+  cost_ = mpc_->cost();
+  iterations_ = mpc_->iterations();
+  if (result.status == SolveStatus::kSolved) {
+    cache_->Insert(key, inputs, result);
+  }
+  return result;
+}
+
+void SharedSolveMPC::Prepare() {
+  if (!hit_) {
+    mpc_->Prepare();
+  }
+}
+
+void SharedSolveMPC::Reset() {
+  mpc_->Reset();
+  hit_ = false;
+}
+
+MPCState SharedSolveMPC::planned_state(size_t t) const {
+  return hit_ ? cached_.state(t) : mpc_->planned_state(t);
+}
+
+void SharedSolveMPC::planned_actuations(size_t t, double &delta, double &a) const {
+  if (hit_) {
+    delta = cached_.delta[t];
+    a = cached_.a[t];
+  } else {
+    mpc_->planned_actuations(t, delta, a);
+  }
+}
+
+void SharedSolveMPC::SetReferenceOrder(size_t order) {
+  mpc_->SetReferenceOrder(order);
+  reference_order_ = order;
+}
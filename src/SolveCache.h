@@ -0,0 +1,151 @@
+#ifndef SOLVE_CACHE_H
+#define SOLVE_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include "CostWeights.h"
+#include "MPC.h"
+
+// The problem of a Solve of an MPC, bit for bit: what Solve is handed and
+// the settings of the MPC it reads. The start of the solver isn't in it, a
+// converged solve of the problem is its optimum whatever it started from,
+// to the tolerance of the solver.
+struct SolveInputs {
+  // Hash of the backend, horizon and configuration (see
+  // SharedSolveMPC::SetProblem)
+  uint64_t problem = 0;
+  uint64_t reference_order = 0;
+  double state[6] = {};
+  double coeffs[4] = {};
+  double prev_a = 0;
+  double max_solve_time = 0;
+  // The weights of the speed of state
+  double weights[CostWeights::size] = {};
+};
+
+static_assert(std::is_trivially_copyable<SolveInputs>::value, "The inputs are compared as bytes");
+static_assert(sizeof(SolveInputs) % sizeof(uint64_t) == 0, "The inputs have no padding");
+
+// FNV-1a over the bytes of inputs, the key of their solve
+uint64_t HashSolveInputs(const SolveInputs &inputs);
+
+// The solutions of solves by their inputs, shared by the solvers of every
+// session of a server, for those that are handed problems bit for bit the
+// same, e.g. deterministic episodes of a farm that start from the same
+// conditions, to solve each once.
+//
+// A slot per key modulo the capacity, the last solution stored under one
+// replacing what was there. Lock-free over every thread: each slot is a
+// seqlock like those of ObserverRing, marked odd while a solution is
+// written in place. A writer that finds the slot being written gives up
+// rather than wait, and a reader copies the slot out and checks the mark
+// after, so a slot written under it is a miss rather than torn. The inputs
+// are compared whole, a collision of the hashes is a miss too.
+class SolveCache {
+public:
+  // capacity rounded up to a power of two
+  explicit SolveCache(size_t capacity);
+
+  // The solution stored for inputs, whose hash is key, into solution;
+  // false if there is none
+  bool Find(uint64_t key, const SolveInputs &inputs, MPCSolution &solution) const;
+
+  // Store solution for inputs; false if another thread was storing into
+  // its slot
+  bool Insert(uint64_t key, const SolveInputs &inputs, const MPCSolution &solution);
+
+  size_t capacity() const { return mask_ + 1; }
+
+private:
+  struct Slot {
+    std::atomic<uint64_t> mark{0};
+    std::atomic<uint64_t> key{0};
+    SolveInputs inputs;
+    MPCSolution solution;
+  };
+
+  const size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+};
+
+// MPC answering the ticks whose problem a solver of any session solved
+// before from a SolveCache, and solving the others on the inner MPC, its
+// solutions stored for the next sessions to meet them. A session served
+// from the cache sends the commands of the session that solved the tick,
+// so a simulator as deterministic as the one before it sends the same
+// telemetry next, and hits again.
+//
+// Only converged solves are stored: a solve stopped at its deadline
+// depends on the time it had. The inner MPC doesn't see the ticks the
+// cache answers, so its first solve after a run of hits starts from an
+// older plan, like after the skips of EventTriggeredMPC.
+class SharedSolveMPC : public MPCBase {
+public:
+  SharedSolveMPC(std::unique_ptr<MPCBase> mpc, std::shared_ptr<SolveCache> cache);
+
+  // The backend, horizon and configuration the inner MPC solves with, in
+  // the key of every solve: set whenever they change
+  void SetProblem(const std::string &problem);
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  // The inner MPC only prepares from a plan of its own
+  void Prepare() override;
+
+  void Reset() override;
+
+  size_t horizon_length() const override { return mpc_->horizon_length(); }
+  double timestep() const override { return mpc_->timestep(); }
+  double stage_time(size_t t) const override { return mpc_->stage_time(t); }
+  size_t slack_activations() const override { return mpc_->slack_activations(); }
+
+  MPCState planned_state(size_t t) const override;
+  void planned_actuations(size_t t, double &delta, double &a) const override;
+
+  void Seed(double delta, double a) override { mpc_->Seed(delta, a); }
+  void KeepSolutions(size_t capacity) override { mpc_->KeepSolutions(capacity); }
+  void KeepTrackSolutions(size_t capacity) override { mpc_->KeepTrackSolutions(capacity); }
+  void SetTrackPosition(double progress) override { mpc_->SetTrackPosition(progress); }
+  void RepeatTick() override { mpc_->RepeatTick(); }
+  void SoftenConstraints(double penalty) override { mpc_->SoftenConstraints(penalty); }
+  void SampleReference(bool sampled) override { mpc_->SampleReference(sampled); }
+  void SetReferenceOrder(size_t order) override;
+  void CheckpointStages(bool checkpoint) override { mpc_->CheckpointStages(checkpoint); }
+  void DumpKKT(KKTDump *dump) override { mpc_->DumpKKT(dump); }
+  void SetTolerances(double tolerance, int max_iterations) override {
+    mpc_->SetTolerances(tolerance, max_iterations);
+  }
+  void SaveStart(std::vector<double> &start) const override { mpc_->SaveStart(start); }
+  bool RestoreStart(const std::vector<double> &start) override {
+    return mpc_->RestoreStart(start);
+  }
+  void SaveCaches(std::vector<double> &caches) const override { mpc_->SaveCaches(caches); }
+  bool RestoreCaches(const std::vector<double> &caches) override {
+    return mpc_->RestoreCaches(caches);
+  }
+  SolverFootprint Footprint() const override { return mpc_->Footprint(); }
+
+  // A copy of the inner MPC, which doesn't share
+  std::unique_ptr<MPCBase> Clone() const override { return mpc_->Clone(); }
+
+  const MPCBase &inner() const { return *mpc_; }
+
+  // Whether the last Solve found its solution in the cache
+  bool hit() const { return hit_; }
+
+private:
+  std::unique_ptr<MPCBase> mpc_;
+  std::shared_ptr<SolveCache> cache_;
+
+  uint64_t problem_ = 0;
+  uint64_t reference_order_ = 3;
+  bool hit_ = false;
+  // The plan of the last hit
+  MPCSolution cached_;
+};
+
+#endif /* SOLVE_CACHE_H */
@@ -0,0 +1,146 @@
+#include "SolverBackend.h"
+#include "MPC_ADMM.h"
+#include "MPC_Decoupled.h"
+#include "MPC_ILQR.h"
+#include "MPC_IPM.h"
+#include "MPC_RTI.h"
+#include "MPC_SQP.h"
+
+const char *SolverBackendName(SolverBackend backend) {
+  switch (backend) {
+    case SolverBackend::kIpopt:
+      return "ipopt";
+    case SolverBackend::kIpoptAnalytic:
+      return "analytic";
+    case SolverBackend::kIpoptAutoDiff:
+      return "autodiff";
+    case SolverBackend::kIpoptCompiled:
+      return "compiled";
+    case SolverBackend::kIpoptChunked:
+      return "chunked";
+    case SolverBackend::kIpoptGaussNewton:
+      return "gauss-newton";
+    case SolverBackend::kSQP:
+      return "sqp";
+    case SolverBackend::kSQPFloat:
+      return "sqp-float";
+    case SolverBackend::kRTI:
+      return "rti";
+    case SolverBackend::kIPM:
+      return "ipm";
+    case SolverBackend::kADMM:
+      return "admm";
+    case SolverBackend::kILQR:
+      return "ilqr";
+    case SolverBackend::kDecoupled:
+      return "decoupled";
+  }
+  return "";
+}
+
+bool ParseSolverBackend(const std::string &name, SolverBackend &backend) {
+  for (SolverBackend b : kSolverBackends) {
+    if (name == SolverBackendName(b)) {
+      backend = b;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::unique_ptr<MPCBase> MakeSolver(SolverBackend backend, const MPCProblem &problem) {
+  std::unique_ptr<MPCBase> mpc;
+  if (problem.vehicle != VehicleModel::kKinematic) {
+    // The QP backends are built on the closed form kinematic model
+    switch (backend) {
+      case SolverBackend::kIpopt:
+      case SolverBackend::kIpoptAnalytic:
+      case SolverBackend::kIpoptAutoDiff:
+      case SolverBackend::kIpoptCompiled:
+      case SolverBackend::kIpoptChunked:
+      case SolverBackend::kIpoptGaussNewton:
+        break;
+      default:
+        return mpc;
+    }
+  }
+  switch (backend) {
+    case SolverBackend::kIpopt:
+    case SolverBackend::kIpoptAnalytic:
+    case SolverBackend::kIpoptAutoDiff:
+    case SolverBackend::kIpoptCompiled:
+    case SolverBackend::kIpoptChunked:
+    case SolverBackend::kIpoptGaussNewton:
+      mpc = MakeMPC(problem.horizon, IpoptDerivatives(backend), problem.move_blocking,
+                    IpoptHessian(backend), problem.vehicle);
+      break;
+    case SolverBackend::kSQP:
+      mpc = MakeMPC_SQP(problem.horizon, problem.move_blocking);
+      break;
+    case SolverBackend::kSQPFloat:
+      mpc = MakeMPC_SQP(problem.horizon, problem.move_blocking, true);
+      break;
+    case SolverBackend::kRTI:
+      mpc = MakeMPC_RTI(problem.horizon, problem.move_blocking);
+      break;
+    case SolverBackend::kIPM:
+      if (!problem.move_blocking) {
+        mpc = MakeMPC_IPM(problem.horizon);
+      }
+      break;
+    case SolverBackend::kADMM:
+      if (!problem.move_blocking) {
+        mpc = MakeMPC_ADMM(problem.horizon);
+      }
+      break;
+    case SolverBackend::kILQR:
+      if (!problem.move_blocking) {
+        mpc = MakeMPC_ILQR(problem.horizon);
+      }
+      break;
+    case SolverBackend::kDecoupled:
+      mpc = MakeMPC_Decoupled(problem.horizon, problem.move_blocking);
+      break;
+  }
+  if (mpc) {
+    mpc->cost_schedule = problem.cost_schedule;
+    mpc->max_solve_time = problem.max_solve_time;
+    mpc->linearization_table = problem.linearization_table;
+  }
+  return mpc;
+}
+
+Derivatives IpoptDerivatives(SolverBackend backend) {
+  switch (backend) {
+    case SolverBackend::kIpoptAnalytic:
+      return Derivatives::kAnalytic;
+    case SolverBackend::kIpoptAutoDiff:
+      return Derivatives::kAutoDiff;
+    case SolverBackend::kIpoptCompiled:
+      return Derivatives::kCompiled;
+    case SolverBackend::kIpoptChunked:
+      return Derivatives::kChunked;
+    default:
+      return Derivatives::kTape;
+  }
+}
+
+HessianApproximation IpoptHessian(SolverBackend backend) {
+  return backend == SolverBackend::kIpoptGaussNewton ? HessianApproximation::kGaussNewton
+                                                     : HessianApproximation::kExact;
+}
+
+bool UsesCppAD(SolverBackend backend) {
+  switch (backend) {
+    case SolverBackend::kSQP:
+    case SolverBackend::kSQPFloat:
+    case SolverBackend::kRTI:
+    case SolverBackend::kIPM:
+    case SolverBackend::kADMM:
+    case SolverBackend::kILQR:
+    case SolverBackend::kDecoupled:
+      return false;
+    default:
+      return true;
+  }
+}
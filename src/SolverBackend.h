@@ -0,0 +1,94 @@
+#ifndef SOLVER_BACKEND_H
+#define SOLVER_BACKEND_H
+
+#include <memory>
+#include <string>
+#include "CostWeights.h"
+#include "MPC.h"
+#include "VehicleModel.h"
+
+// Solvers of the MPC problem, all behind MPCBase. Ipopt on the CppAD tape is
+// the reference the others are compared with (see benchmark_solvers.cpp).
+enum class SolverBackend {
+  // Ipopt, derivatives from the CppAD tape
+  kIpopt,
+  // Ipopt, closed form derivatives (ModelDerivatives)
+  kIpoptAnalytic,
+  // Ipopt, stage AutoDiffScalar derivatives (AutoDiffDerivatives)
+  kIpoptAutoDiff,
+  // Ipopt, compiled model and derivatives (CompiledModel), in builds with
+  // MPC_CODEGEN
+  kIpoptCompiled,
+  // Ipopt, derivatives from tapes of chunks of the horizon swept
+  // concurrently (ChunkedTapes)
+  kIpoptChunked,
+  // Ipopt, derivatives from the CppAD tape but the Gauss-Newton Hessian
+  kIpoptGaussNewton,
+  // SQP on the condensed QP (MPC_SQP)
+  kSQP,
+  // The same SQP with the QPs solved in float and refined in double
+  // (MixedPrecisionQP)
+  kSQPFloat,
+  // One SQP step per tick (MPC_RTI)
+  kRTI,
+  // Interior-point method with Riccati Newton steps (MPC_IPM)
+  kIPM,
+  // ADMM on the linearized QP (MPC_ADMM)
+  kADMM,
+  // Iterative LQR with box constrained actuations (MPC_ILQR)
+  kILQR,
+  // The speed profile, then SQP on the steering over it (MPC_Decoupled)
+  kDecoupled
+};
+
+// Every backend, in the order above
+const SolverBackend kSolverBackends[] = {SolverBackend::kIpopt, SolverBackend::kIpoptAnalytic,
+                                         SolverBackend::kIpoptAutoDiff,
+                                         SolverBackend::kIpoptCompiled,
+                                         SolverBackend::kIpoptChunked,
+                                         SolverBackend::kIpoptGaussNewton, SolverBackend::kSQP,
+                                         SolverBackend::kSQPFloat, SolverBackend::kRTI, SolverBackend::kIPM,
+                                         SolverBackend::kADMM, SolverBackend::kILQR,
+                                         SolverBackend::kDecoupled};
+
+// Name on the command line: "ipopt", "analytic", "autodiff", "compiled",
+// "chunked", "gauss-newton", "sqp", "sqp-float", "rti", "ipm", "admm", "ilqr"
+// or "decoupled"
+const char *SolverBackendName(SolverBackend backend);
+// False if name is none of them
+bool ParseSolverBackend(const std::string &name, SolverBackend &backend);
+
+// The problem every backend solves. The model, the actuator bounds and the
+// terms of the cost are those of FG_eval and KinematicModel.h; this is what
+// can change between runs.
+struct MPCProblem {
+  // Number of timesteps of 0.1 s, one of the compiled horizons (see MakeMPC)
+  size_t horizon = 15;
+  // The model the stages follow, the dynamic one for the Ipopt backends
+  // only (see MakeMPC)
+  VehicleModel vehicle = VehicleModel::kKinematic;
+  // Hold the actuations over blocks of stages (see Horizon.h)
+  bool move_blocking = false;
+  CostSchedule cost_schedule;
+  // Wall-clock time allowed to each Solve, in seconds
+  double max_solve_time = 0.05;
+  // See MPCBase::linearization_table
+  std::shared_ptr<const LinearizationTable> linearization_table;
+};
+
+// Backend for problem, null if it isn't compiled for it (another horizon,
+// move blocking with the IPM, ADMM or iLQR, or another vehicle model)
+std::unique_ptr<MPCBase> MakeSolver(SolverBackend backend, const MPCProblem &problem);
+
+// Derivatives and Hessian of the Ipopt MPC of backend, kTape and kExact for
+// the other backends
+Derivatives IpoptDerivatives(SolverBackend backend);
+HessianApproximation IpoptHessian(SolverBackend backend);
+
+// Whether the solver of backend keeps CppAD tapes or sweeps, which hold the
+// memory of the thread that made them and must stay on it (see
+// CppADThreads.h): the Ipopt backends. The others can be solved by any
+// thread, one at a time.
+bool UsesCppAD(SolverBackend backend);
+
+#endif /* SOLVER_BACKEND_H */
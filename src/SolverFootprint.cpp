@@ -0,0 +1,43 @@
+#include "SolverFootprint.h"
+
+void FootprintGauges::Set(const SolverFootprint &footprint) {
+  tape_operations_.store(footprint.tape_operations, std::memory_order_relaxed);
+  tape_variables_.store(footprint.tape_variables, std::memory_order_relaxed);
+  tape_bytes_.store(footprint.tape_bytes, std::memory_order_relaxed);
+  jacobian_nonzeros_.store(footprint.jacobian_nonzeros, std::memory_order_relaxed);
+  hessian_nonzeros_.store(footprint.hessian_nonzeros, std::memory_order_relaxed);
+  kkt_nonzeros_.store(footprint.kkt_nonzeros, std::memory_order_relaxed);
+  factor_nonzeros_.store(footprint.factor_nonzeros, std::memory_order_relaxed);
+  workspace_bytes_.store(footprint.workspace_bytes, std::memory_order_relaxed);
+  known_.store(true, std::memory_order_relaxed);
+}
+
+void FootprintGauges::Render(uint64_t session, std::string &out) const {
+  if (!known()) {
+    return;
+  }
+  const std::string prefix =
+      "mpc_session_solver_footprint{session=\"" + std::to_string(session) + "\",quantity=\"";
+  const struct {
+    const char *name;
+    const std::atomic<uint64_t> &value;
+  } quantities[] = {{"tape_operations", tape_operations_},
+                    {"tape_variables", tape_variables_},
+                    {"tape_bytes", tape_bytes_},
+                    {"jacobian_nonzeros", jacobian_nonzeros_},
+                    {"hessian_nonzeros", hessian_nonzeros_},
+                    {"kkt_nonzeros", kkt_nonzeros_},
+                    {"factor_nonzeros", factor_nonzeros_},
+                    {"workspace_bytes", workspace_bytes_}};
+  for (const auto &quantity : quantities) {
+    out.append(prefix).append(quantity.name).append("\"} ");
+    out.append(std::to_string(quantity.value.load(std::memory_order_relaxed))).append("\n");
+  }
+}
+
+void RenderFootprintHeader(std::string &out) {
+  out.append("# HELP mpc_session_solver_footprint Size of the problem of the solver of a "
+             "session: its tape, the non-zeros of its derivatives and KKT system, and its "
+             "bytes; 0 where the backend doesn't know it\n");
+  out.append("# TYPE mpc_session_solver_footprint gauge\n");
+}
@@ -0,0 +1,74 @@
+#ifndef SOLVER_FOOTPRINT_H
+#define SOLVER_FOOTPRINT_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// How big the problem of a solver is in memory, as MPCBase::Footprint
+// reports it: the size of the tape of the model, the non-zeros of its
+// derivatives and of the KKT system they make, of the factor of that
+// system, and the bytes the solver holds. A solve that outgrows the caches
+// gets slower without being any worse, so these are kept next to its
+// times, in /metrics and the results of mpc_bench.
+//
+// 0 is what the backend doesn't know: there is no tape but the Ipopt MPC's,
+// and Ipopt keeps the fill-in of its factorization to its linear solver.
+struct SolverFootprint {
+  // The recorded model, see CppAD::ADFun: its operations, its variables,
+  // and the bytes of the operation sequence and of the Taylor coefficients
+  // of the last sweep
+  uint64_t tape_operations = 0;
+  uint64_t tape_variables = 0;
+  uint64_t tape_bytes = 0;
+  // Of the constraint Jacobian and of the lower triangle of the Hessian of
+  // the Lagrangian, as handed to the solver
+  uint64_t jacobian_nonzeros = 0;
+  uint64_t hessian_nonzeros = 0;
+  // Of the lower triangle of the KKT matrix, the Hessian, the Jacobian and
+  // the diagonal of the variables and the constraints
+  uint64_t kkt_nonzeros = 0;
+  // Of the factor of the KKT matrix, with its fill-in
+  uint64_t factor_nonzeros = 0;
+  // The constraints linear in the variables and their non-zeros of the
+  // Jacobian, which the tape evaluates once a solve rather than every
+  // iteration, and the sweeps of the tape an evaluation of the Jacobian
+  // takes for the other rows against those it takes for every row
+  uint64_t linear_constraints = 0;
+  uint64_t constant_jacobian_nonzeros = 0;
+  uint64_t jacobian_sweeps = 0;
+  uint64_t full_jacobian_sweeps = 0;
+  // The bytes of the solver and of the buffers it owns
+  uint64_t workspace_bytes = 0;
+};
+
+// The footprint of the solver of one session, set by its solver thread
+// and read by Render on any other
+class FootprintGauges {
+ public:
+  void Set(const SolverFootprint &footprint);
+  // Set at least once
+  bool known() const { return known_.load(std::memory_order_relaxed); }
+  // Unknown again, for a solver made anew, until the next Set
+  void Reset() { known_.store(false, std::memory_order_relaxed); }
+
+  // Append the gauges of the session, under the header of
+  // RenderFootprintHeader, to out; nothing before the first Set
+  void Render(uint64_t session, std::string &out) const;
+
+ private:
+  std::atomic<bool> known_{false};
+  std::atomic<uint64_t> tape_operations_{0};
+  std::atomic<uint64_t> tape_variables_{0};
+  std::atomic<uint64_t> tape_bytes_{0};
+  std::atomic<uint64_t> jacobian_nonzeros_{0};
+  std::atomic<uint64_t> hessian_nonzeros_{0};
+  std::atomic<uint64_t> kkt_nonzeros_{0};
+  std::atomic<uint64_t> factor_nonzeros_{0};
+  std::atomic<uint64_t> workspace_bytes_{0};
+};
+
+// The header of the gauges of FootprintGauges::Render
+void RenderFootprintHeader(std::string &out);
+
+#endif /* SOLVER_FOOTPRINT_H */
@@ -0,0 +1,141 @@
+#include "SolverSnapshot.h"
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include "Log.h"
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+std::string SnapshotPath(const std::string &directory, size_t worker) {
+  return directory + "/worker-" + std::to_string(worker) + ".json";
+}
+
+bool LoadSnapshot(const std::string &path, const std::string &host, const std::string &problem,
+                  std::vector<SessionSnapshot> &sessions, std::string &error) {
+  sessions.clear();
+  std::ifstream in(path);
+  if (!in) {
+    return true;
+  }
+  try {
+    const json file = json::parse(in);
+    if (file.at("host").get<std::string>() != host ||
+        file.at("problem").get<std::string>() != problem) {
+      return true;
+    }
+    for (const json &entry : file.at("sessions")) {
+      SessionSnapshot session;
+      session.session = entry.at("session").get<uint64_t>();
+      session.ticks = entry.at("ticks").get<uint64_t>();
+      session.prev_a = entry.at("prev_a").get<double>();
+      session.solve_seconds = entry.at("solve_seconds").get<double>();
+      session.start = entry.at("start").get<std::vector<double> >();
+      session.caches = entry.at("caches").get<std::vector<double> >();
+      sessions.push_back(std::move(session));
+    }
+  } catch (const std::exception &e) {
+    sessions.clear();
+    error = path + ": " + e.what();
+    return false;
+  }
+  return true;
+}
+
+bool SaveSnapshot(const std::string &path, const std::string &host, const std::string &problem,
+                  const std::vector<SessionSnapshot> &sessions, std::string &error) {
+  json entries = json::array();
+  for (const SessionSnapshot &session : sessions) {
+    entries.push_back({{"session", session.session},
+                       {"ticks", session.ticks},
+                       {"prev_a", session.prev_a},
+                       {"solve_seconds", session.solve_seconds},
+                       {"start", session.start},
+                       {"caches", session.caches}});
+  }
+  const json file = {{"host", host}, {"problem", problem}, {"sessions", entries}};
+  const std::string partial = path + "." + std::to_string(getpid());
+  {
+    std::ofstream out(partial);
+    out << file << "\n";
+    if (!out) {
+      error = "cannot write " + partial;
+      return false;
+    }
+  }
+  if (std::rename(partial.c_str(), path.c_str()) != 0) {
+    std::remove(partial.c_str());
+    error = "cannot move " + partial + " to " + path;
+    return false;
+  }
+  return true;
+}
+
+bool SnapshotRestore::Load(const std::string &directory, const std::string &host,
+                           const std::string &problem, std::string &error) {
+  std::vector<SessionSnapshot> all;
+  for (size_t k = 0;; k++) {
+    const std::string path = SnapshotPath(directory, k);
+    if (access(path.c_str(), F_OK) != 0) {
+      break;
+    }
+    std::vector<SessionSnapshot> sessions;
+    if (!LoadSnapshot(path, host, problem, sessions, error)) {
+      return false;
+    }
+    for (SessionSnapshot &session : sessions) {
+      all.push_back(std::move(session));
+    }
+  }
+  // Taken from the back, so the most ticks last
+  std::sort(all.begin(), all.end(), [](const SessionSnapshot &a, const SessionSnapshot &b) {
+    return a.ticks < b.ticks;
+  });
+  std::lock_guard<std::mutex> lock(mutex_);
+  sessions_ = std::move(all);
+  return true;
+}
+
+bool SnapshotRestore::Take(SessionSnapshot &session) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (sessions_.empty()) {
+    return false;
+  }
+  session = std::move(sessions_.back());
+  sessions_.pop_back();
+  return true;
+}
+
+size_t SnapshotRestore::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return sessions_.size();
+}
+
+SnapshotWriter::~SnapshotWriter() {
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+bool SnapshotWriter::Write(std::vector<SessionSnapshot> &sessions) {
+  if (busy_.load(std::memory_order_acquire)) {
+    return false;
+  }
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  sessions_.swap(sessions);
+  busy_.store(true, std::memory_order_relaxed);
+  thread_ = std::thread([this] {
+    std::string error;
+    if (SaveSnapshot(path_, host_, problem_, sessions_, error)) {
+      written_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      failed_.fetch_add(1, std::memory_order_relaxed);
+      Log(LogLevel::kWarning, "Snapshot: {}", error);
+    }
+    busy_.store(false, std::memory_order_release);
+  });
+  return true;
+}
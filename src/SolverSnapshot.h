@@ -0,0 +1,106 @@
+#ifndef SOLVER_SNAPSHOT_H
+#define SOLVER_SNAPSHOT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What a session has learned that a restart of the server would otherwise
+// lose: the start of its last solve (see MPCBase::SaveStart), the past
+// solutions of its caches (see MPCBase::SaveCaches), its last throttle, and
+// how many ticks it took and how long its solves took, for a new process to
+// hand to a session of its own.
+struct SessionSnapshot {
+  uint64_t session = 0;
+  uint64_t ticks = 0;
+  double prev_a = 0;
+  double solve_seconds = 0;
+  std::vector<double> start;
+  std::vector<double> caches;
+};
+
+// The snapshots of the sessions of the workers of a server, a JSON file
+// for each worker in a directory, for a new process to start its sessions
+// from instead of cold after a restart for a configuration change or an
+// upgrade.
+//
+// A file is only good for the host and problem it was written for: the
+// host fingerprint holds the cpu and the hash of the model source (see
+// HostFingerprint), so a binary with another model doesn't take the starts
+// and caches of the old one, and the problem the backend and horizon (see
+// the tuning of main.cpp), whose starts are sized for them. The tapes are
+// recorded and the solvers warmed up again at start either way, the
+// compiled models have their own cache (see CompiledModel.h), and the
+// Ipopt options their tuning file (see IpoptTuning.h).
+//
+// The solver thread of a worker takes the snapshot of its sessions between
+// ticks, copies of a few kilobytes each, and a thread of the writer puts it
+// in the file, so no tick waits on the disk.
+
+// The snapshot file of worker in directory
+std::string SnapshotPath(const std::string &directory, size_t worker);
+
+// The sessions of the snapshot at path into sessions, none if there is no
+// file or it is of another host or problem; false with the reason in error
+// if it can't be read
+bool LoadSnapshot(const std::string &path, const std::string &host, const std::string &problem,
+                  std::vector<SessionSnapshot> &sessions, std::string &error);
+
+// Write sessions to path through a temporary file renamed over it, so a
+// reader never sees half a snapshot; false with the reason in error
+bool SaveSnapshot(const std::string &path, const std::string &host, const std::string &problem,
+                  const std::vector<SessionSnapshot> &sessions, std::string &error);
+
+// The snapshots of the last process, for the sessions of the new one to
+// take as they make their first tick, those that had ticked the most
+// first: their caches hold the most
+class SnapshotRestore {
+public:
+  // Those of the files of every worker in directory, up to the first
+  // missing; false with the reason in error if one can't be read
+  bool Load(const std::string &directory, const std::string &host, const std::string &problem,
+            std::string &error);
+
+  // The next snapshot into session, false once there are none left
+  bool Take(SessionSnapshot &session);
+
+  size_t size() const;
+
+private:
+  mutable std::mutex mutex_;
+  std::vector<SessionSnapshot> sessions_;
+};
+
+// Writes the snapshots of a worker to its file on a thread of its own
+class SnapshotWriter {
+public:
+  SnapshotWriter(const std::string &path, const std::string &host, const std::string &problem)
+      : path_(path), host_(host), problem_(problem) {}
+  // Waits for the last write
+  ~SnapshotWriter();
+  SnapshotWriter(const SnapshotWriter &) = delete;
+  SnapshotWriter &operator=(const SnapshotWriter &) = delete;
+
+  // Write sessions, taken, unless the last write is still going; false then
+  bool Write(std::vector<SessionSnapshot> &sessions);
+
+  // Writes done and failed so far
+  size_t written() const { return written_.load(std::memory_order_relaxed); }
+  size_t failed() const { return failed_.load(std::memory_order_relaxed); }
+
+private:
+  const std::string path_;
+  const std::string host_;
+  const std::string problem_;
+  std::vector<SessionSnapshot> sessions_;
+  std::thread thread_;
+  std::atomic<bool> busy_{false};
+  std::atomic<size_t> written_{0};
+  std::atomic<size_t> failed_{0};
+};
+
+#endif /* SOLVER_SNAPSHOT_H */
@@ -0,0 +1,108 @@
+#include "SpeculativeMPC.h"
+#include <cmath>
+
+SpeculativeMPC::SpeculativeMPC(std::unique_ptr<MPCBase> mpc,
+                               const SpeculationTolerance &tolerance)
+    : mpc_(std::move(mpc)), tolerance_(tolerance) {
+  worker_ = std::thread(&SpeculativeMPC::Work, this);
+}
+
+SpeculativeMPC::~SpeculativeMPC() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_one();
+  worker_.join();
+}
+
+void SpeculativeMPC::Work() {
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_.wait(lock, [this] { return stop_ || running_; });
+      if (stop_) {
+        return;
+      }
+    }
+    MPCSolution result = mpc_->Solve(state_, coeffs_);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      result_ = result;
+      running_ = false;
+    }
+    done_.notify_one();
+  }
+}
+
+void SpeculativeMPC::Start(const MPCState &state, const MPCCoeffs &coeffs) {
+  // The worker is idle, so the inner MPC can be set up from here
+  mpc_->prev_a = prev_a;
+  mpc_->max_solve_time = max_solve_time;
+  mpc_->cost_schedule = cost_schedule;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_ = state;
+    coeffs_ = coeffs;
+    running_ = true;
+  }
+  start_.notify_one();
+}
+
+void SpeculativeMPC::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return !running_; });
+}
+
+bool SpeculativeMPC::Accept(const MPCState &state) const {
+  // cte, epsi and v don't depend on the vehicle frame, so the prediction can
+  // be compared in its own frame
+  return mpc_->status() != SolveStatus::kFailed &&
+         fabs(state[4] - predicted_[4]) <= tolerance_.cte_tolerance &&
+         fabs(state[5] - predicted_[5]) <= tolerance_.epsi_tolerance &&
+         fabs(state[3] - predicted_[3]) <= tolerance_.v_tolerance;
+}
+
+MPCSolution SpeculativeMPC::Solve(const MPCState &state, const MPCCoeffs &coeffs) {
+  Wait();
+  hit_ = speculating_ && Accept(state);
+  if (!hit_) {
+    if (speculating_) {
+      mpc_->RepeatTick();
+    }
+    Start(state, coeffs);
+    Wait();
+  }
+  speculating_ = false;
+  last_coeffs_ = coeffs;
+  has_last_ = true;
+  status_ = mpc_->status();
+  cost_ = mpc_->cost();
+  if (!hit_) {
+    return result_;
+  }
+  hits_++;
+
+  // The speculative plan, moved rigidly to the measured pose
+  return mpc_->PlannedSolution(0, state);
+}
+
+void SpeculativeMPC::Prepare() {
+  mpc_->Prepare();
+  if (!has_last_ || mpc_->status() == SolveStatus::kFailed) {
+    return;
+  }
+
+  // The plan just sent puts the car at its second stage by the next tick
+  predicted_ = mpc_->planned_state(1);
+  Start(predicted_, last_coeffs_);
+  speculating_ = true;
+  speculations_++;
+}
+
+void SpeculativeMPC::Reset() {
+  Wait();
+  mpc_->Reset();
+  speculating_ = false;
+  has_last_ = false;
+}
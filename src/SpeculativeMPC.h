@@ -0,0 +1,107 @@
+#ifndef SPECULATIVE_MPC_H
+#define SPECULATIVE_MPC_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "MPC.h"
+
+// Tolerances within which a speculative plan is taken for the measured
+// state. The errors are those of the measured state against the state the
+// plan was made for.
+struct SpeculationTolerance {
+  double cte_tolerance = 0.05;
+  double epsi_tolerance = 0.01;
+  double v_tolerance = 0.5;
+};
+
+// MPC over any MPCBase that solves the next tick ahead of its telemetry.
+//
+// Prepare, called once the actuations are sent, starts solving on a worker
+// thread for the state the plan predicts at the next tick, its second
+// stage, with the same polynomial. The network round trip then hides the
+// solve. When Solve gets the measured state it waits for that solve, and
+// takes its plan if the cross-track error, orientation error and speed
+// match the prediction within the tolerances, moving it rigidly to the
+// measured pose like EventTriggeredMPC. Otherwise the inner MPC solves
+// again for the measured state, started from the speculative plan (see
+// MPCBase::RepeatTick).
+//
+// The inner MPC is only ever solved by the worker, so it is solved on one
+// thread. Solve returns no earlier than a plain Solve would when the
+// speculation misses.
+class SpeculativeMPC : public MPCBase {
+public:
+  SpeculativeMPC(std::unique_ptr<MPCBase> mpc, const SpeculationTolerance &tolerance);
+
+  // Stops and joins the worker
+  ~SpeculativeMPC() override;
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override;
+
+  void Prepare() override;
+
+  void Reset() override;
+
+  size_t horizon_length() const override { return mpc_->horizon_length(); }
+  double timestep() const override { return mpc_->timestep(); }
+  double stage_time(size_t t) const override { return mpc_->stage_time(t); }
+  const EffortController *effort() const override { return mpc_->effort(); }
+  size_t slack_activations() const override { return mpc_->slack_activations(); }
+
+  MPCState planned_state(size_t t) const override { return mpc_->planned_state(t); }
+
+  void planned_actuations(size_t t, double &delta, double &a) const override {
+    mpc_->planned_actuations(t, delta, a);
+  }
+
+  // Whether the last Solve took the speculative plan, and the ticks that did
+  // out of those speculated on so far
+  bool hit() const { return hit_; }
+  size_t hits() const { return hits_; }
+  size_t speculations() const { return speculations_; }
+
+  // The inner MPC, idle between a Solve and the next Prepare only
+  const MPCBase &inner() const { return *mpc_; }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  // Hand a solve of the inner MPC to the worker, and wait for it to finish
+  void Start(const MPCState &state, const MPCCoeffs &coeffs);
+  void Wait();
+
+  void Work();
+
+  // Whether the speculative plan holds for the measured state
+  bool Accept(const MPCState &state) const;
+
+  std::unique_ptr<MPCBase> mpc_;
+  SpeculationTolerance tolerance_;
+
+  std::thread worker_;
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  bool running_ = false;
+  bool stop_ = false;
+  // Problem and result of the solve handed to the worker
+  MPCState state_;
+  MPCCoeffs coeffs_;
+  MPCSolution result_;
+
+  // Polynomial of the last Solve, whether a speculative solve ran since,
+  // and the state it was for
+  MPCCoeffs last_coeffs_;
+  bool has_last_ = false;
+  bool speculating_ = false;
+  MPCState predicted_;
+
+  bool hit_ = false;
+  size_t hits_ = 0;
+  size_t speculations_ = 0;
+};
+
+#endif /* SPECULATIVE_MPC_H */
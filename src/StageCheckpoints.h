@@ -0,0 +1,173 @@
+#ifndef STAGE_CHECKPOINTS_H
+#define STAGE_CHECKPOINTS_H
+
+#include <cppad/cppad.hpp>
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "StageModel.h"
+
+// The step of a stage of StageModel<H> recorded once as a CppAD checkpoint
+// function (chkpoint_two), for the tape of FG_eval to call N - 1 times
+// instead of recording N - 1 copies of the same operations. The tape then
+// holds an operation per stage where it held the whole step, so it is
+// recorded, optimized and analyzed for its sparsity in a fraction of the
+// time and memory, which pays on the long horizons; the patterns of the
+// step, of its Jacobian and of its Hessian, are computed once for the
+// function and propagated through each call as they are.
+//
+// A function takes the 8 inputs of the stage and the terms of its
+// reference, the 4 polynomial coefficients or the 5 of a LinearReference,
+// and gives the next state. The step dt is part of it, so there is one
+// function per distinct step of the horizon: one for a uniform horizon, a
+// few for a graded one (see StepSchedule).
+//
+// CppAD makes its atomic functions in sequential mode only, and a tape
+// refers to those it calls for as long as it lives. So the functions of a
+// horizon are made for every reference at once, by the first Get in
+// sequential mode (on the main thread, before any CppADThread exists),
+// shared by the tapes of every thread after and kept until the process
+// ends; made after SetupCppADThreads, they can be called by as many threads
+// as it set CppAD up for.
+template <class H>
+class StageCheckpoints {
+ public:
+  typedef StageModel<H> Model;
+  typedef CPPAD_TESTVECTOR(CppAD::AD<double>) ADvector;
+
+  // The functions of the horizon H along a sampled reference, or a
+  // polynomial of reference_order; null if they don't exist yet and CppAD
+  // is in parallel mode
+  static const StageCheckpoints *Get(bool sampled_reference, size_t reference_order) {
+    static std::mutex mutex;
+    // Never deleted: CppAD's list of the atomic functions, which their
+    // destructors update, may be gone by the time the statics are
+    static std::array<StageCheckpoints *, 4> made = {};
+    std::lock_guard<std::mutex> lock(mutex);
+    if (made[0] == nullptr) {
+      if (CppAD::thread_alloc::in_parallel()) {
+        return nullptr;
+      }
+      for (size_t kind = 0; kind < made.size(); kind++) {
+        made[kind] = new StageCheckpoints(kind);
+      }
+    }
+    return made[sampled_reference ? 0 : reference_order];
+  }
+
+  // The state after stage t from its inputs, along the polynomial coeffs
+  // (all 4, the function leaves out those above its order) or the
+  // LinearReference of the stage
+  void Step(size_t t, const CppAD::AD<double> *in, const ADvector &coeffs,
+            CppAD::AD<double> *next) const {
+    Call(t, in, &coeffs[0], n_coeffs_terms, next);
+  }
+  void Step(size_t t, const CppAD::AD<double> *in,
+            const LinearReference<CppAD::AD<double> > &reference,
+            CppAD::AD<double> *next) const {
+    const CppAD::AD<double> terms[] = {reference.x, reference.f, reference.df, reference.psides,
+                                       reference.dpsides};
+    Call(t, in, terms, n_sampled_terms, next);
+  }
+
+ private:
+  static constexpr size_t n_coeffs_terms = 4;
+  static constexpr size_t n_sampled_terms = 5;
+
+  // kind 0 for the sampled reference, else the order of the polynomial
+  explicit StageCheckpoints(size_t kind) : stage_function_(Model::n_stages) {
+    const size_t n_terms = kind == 0 ? n_sampled_terms : n_coeffs_terms;
+    std::vector<double> steps;
+    for (size_t t = 0; t < Model::n_stages; t++) {
+      size_t f = 0;
+      while (f < steps.size() && steps[f] != H::step(t)) {
+        f++;
+      }
+      if (f == steps.size()) {
+        steps.push_back(H::step(t));
+        functions_.emplace_back(Record(kind, n_terms, t));
+      }
+      stage_function_[t] = f;
+    }
+  }
+
+  // The step of stage t as a checkpoint function, recorded at zeros: the
+  // model has no data dependent branches
+  static CppAD::chkpoint_two<double> *Record(size_t kind, size_t n_terms, size_t t) {
+    ADvector ax(Model::n_inputs + n_terms);
+    ADvector ay(Model::n_states);
+    for (size_t i = 0; i < ax.size(); i++) {
+      ax[i] = 0.0;
+    }
+    CppAD::Independent(ax);
+    const CppAD::AD<double> *in = &ax[0];
+    const CppAD::AD<double> *terms = &ax[Model::n_inputs];
+    if (kind == 0) {
+      const LinearReference<CppAD::AD<double> > reference{terms[0], terms[1], terms[2], terms[3],
+                                                          terms[4]};
+      Model::Step(t, in, reference, &ay[0]);
+    } else if (kind == 1) {
+      Model::Step(t, in, TruncatedPolynomial<1, const CppAD::AD<double> *>{terms}, &ay[0]);
+    } else if (kind == 2) {
+      Model::Step(t, in, TruncatedPolynomial<2, const CppAD::AD<double> *>{terms}, &ay[0]);
+    } else {
+      Model::Step(t, in, terms, &ay[0]);
+    }
+    CppAD::ADFun<double> fun(ax, ay);
+    fun.optimize();
+    // Boolean sparsity patterns, and the Hessian pattern kept for the
+    // reverse Hessian sparsity of the tape, rather than derived every call
+    const bool internal_bool = true;
+    const bool use_hes_sparsity = true;
+    const bool use_base2ad = false;
+    const bool use_in_parallel = CppAD::thread_alloc::num_threads() > 1;
+    return new CppAD::chkpoint_two<double>(fun, "stage_step", internal_bool, use_hes_sparsity,
+                                           use_base2ad, use_in_parallel);
+  }
+
+  void Call(size_t t, const CppAD::AD<double> *in, const CppAD::AD<double> *terms,
+            size_t n_terms, CppAD::AD<double> *next) const {
+    ADvector ax(Model::n_inputs + n_terms);
+    ADvector ay(Model::n_states);
+    for (size_t i = 0; i < Model::n_inputs; i++) {
+      ax[i] = in[i];
+    }
+    for (size_t i = 0; i < n_terms; i++) {
+      ax[Model::n_inputs + i] = terms[i];
+    }
+    (*functions_[stage_function_[t]])(ax, ay);
+    for (size_t k = 0; k < Model::n_states; k++) {
+      next[k] = ay[k];
+    }
+  }
+
+  std::vector<std::unique_ptr<CppAD::chkpoint_two<double> > > functions_;
+  // The function of each stage
+  std::vector<size_t> stage_function_;
+};
+
+template <class H> constexpr size_t StageCheckpoints<H>::n_coeffs_terms;
+template <class H> constexpr size_t StageCheckpoints<H>::n_sampled_terms;
+
+// StageCheckpoints::Step of stage t with checkpoints, true; false without,
+// and for the scalars of other tapes than CppAD's of double (CompiledModel)
+template <class H, class Reference>
+inline bool CheckpointStep(const StageCheckpoints<H> *checkpoints, size_t t,
+                           const CppAD::AD<double> *in, const Reference &reference,
+                           CppAD::AD<double> *next) {
+  if (checkpoints == nullptr) {
+    return false;
+  }
+  checkpoints->Step(t, in, reference, next);
+  return true;
+}
+
+template <class H, class T, class Reference>
+inline bool CheckpointStep(const StageCheckpoints<H> *, size_t, const T *, const Reference &,
+                           T *) {
+  return false;
+}
+
+#endif /* STAGE_CHECKPOINTS_H */
@@ -0,0 +1,57 @@
+#ifndef STAGE_MODEL_H
+#define STAGE_MODEL_H
+
+#include <cstddef>
+#include "KinematicModel.h"
+
+// The model of the MPC over the horizon H (see Horizon.h) as the backends
+// see it, stage by stage: stage t < N - 1 is a function of its 8 inputs
+// only, the state z[t] and the actuation [delta, a] of its block, into the
+// next state, and gives the 6 constraint rows z[t+1] - F(z[t], u[t]). F is
+// the ModelStep of KinematicModel.h in the integrator and the vehicle model
+// of H, generic over the scalar, so this one definition is what the tape of
+// FG_eval records (and CompiledModel generates code from), what the stage
+// tapes of ChunkedTapes record and what AutoDiffDerivatives differentiates
+// with AutoDiffScalar. The QP backends take the same ModelStep in doubles, and
+// its closed form Jacobians (ModelJacobian, StageTerms).
+template <class H>
+struct StageModel {
+  // Inputs of a stage: its states, then delta and a; and its outputs, the
+  // next state
+  static constexpr size_t n_states = 6;
+  static constexpr size_t n_inputs = n_states + 2;
+  static constexpr size_t n_stages = H::N - 1;
+
+  // Variable of input i of stage t
+  static constexpr size_t Variable(size_t t, size_t i) {
+    return i < n_states ? i * H::N + t
+                        : (i == n_states ? H::delta_start : H::a_start) + H::block(t);
+  }
+  // Variable of state k of the stage after t, which the row of k equates to
+  // the step
+  static constexpr size_t NextVariable(size_t t, size_t k) { return k * H::N + t + 1; }
+  // Constraint row (row of fg minus one) of state k of the stage after t
+  static constexpr size_t Row(size_t t, size_t k) { return H::constraint_row(k, t); }
+
+  // The inputs of stage t from the variables vars
+  template <class Vars, class T>
+  static void Gather(size_t t, const Vars &vars, T *in) {
+    for (size_t i = 0; i < n_inputs; i++) {
+      in[i] = vars[Variable(t, i)];
+    }
+  }
+
+  // The state after stage t from its inputs, along reference (the
+  // polynomial coefficients, or a LinearReference of the stage)
+  template <class T, class Reference>
+  static void Step(size_t t, const T *in, const Reference &reference, T *next) {
+    ModelStep<H::integrator, typename H::Vehicle>(in, in[n_states], in[n_states + 1], reference,
+                                                  H::step(t), next);
+  }
+};
+
+template <class H> constexpr size_t StageModel<H>::n_states;
+template <class H> constexpr size_t StageModel<H>::n_inputs;
+template <class H> constexpr size_t StageModel<H>::n_stages;
+
+#endif /* STAGE_MODEL_H */
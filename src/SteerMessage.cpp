@@ -0,0 +1,152 @@
+#include "SteerMessage.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+// The most decimals of the lines, whose scaled values stay within the
+// integers that are exact in double
+const int kMaxPrecision = 9;
+const unsigned long long kPowersOfTen[] = {1ull,      10ull,      100ull,      1000ull,
+                                           10000ull,  100000ull,  1000000ull,  10000000ull,
+                                           100000000ull, 1000000000ull};
+const double kExactInteger = 9007199254740992.0;
+
+// Longest of the %.17g of a double, "-1.2345678901234567e-308"
+const size_t kMaxShortest = 32;
+
+}  // namespace
+
+SteerMessage::SteerMessage(int precision) : precision_(0) {
+  set_precision(precision);
+  buffer_.reserve(1024);
+}
+
+void SteerMessage::set_precision(int precision) {
+  precision_ = precision < kMaxPrecision ? precision : kMaxPrecision;
+}
+
+const std::string &SteerMessage::Write(double steering_angle, double throttle,
+                                       const double *mpc_x, const double *mpc_y, size_t mpc_n,
+                                       const double *next_x, const double *next_y,
+                                       size_t next_n) {
+  buffer_.clear();
+  buffer_.append("42[\"steer\",");
+  AppendSteer(steering_angle, throttle, mpc_x, mpc_y, mpc_n, next_x, next_y, next_n);
+  buffer_.push_back(']');
+  return buffer_;
+}
+
+void SteerMessage::BeginBatch() {
+  buffer_.clear();
+  buffer_.append("42[\"steer_batch\",[");
+  batched_ = 0;
+}
+
+void SteerMessage::AddToBatch(double steering_angle, double throttle, const double *mpc_x,
+                              const double *mpc_y, size_t mpc_n, const double *next_x,
+                              const double *next_y, size_t next_n) {
+  if (batched_++ > 0) {
+    buffer_.push_back(',');
+  }
+  AppendSteer(steering_angle, throttle, mpc_x, mpc_y, mpc_n, next_x, next_y, next_n);
+}
+
+const std::string &SteerMessage::EndBatch() {
+  buffer_.append("]]");
+  return buffer_;
+}
+
+void SteerMessage::AppendSteer(double steering_angle, double throttle, const double *mpc_x,
+                               const double *mpc_y, size_t mpc_n, const double *next_x,
+                               const double *next_y, size_t next_n) {
+  AppendArray("{\"mpc_x\":[", mpc_x, mpc_n);
+  AppendArray(",\"mpc_y\":[", mpc_y, mpc_n);
+  AppendArray(",\"next_x\":[", next_x, next_n);
+  AppendArray(",\"next_y\":[", next_y, next_n);
+  buffer_.append(",\"steering_angle\":");
+  AppendShortest(steering_angle);
+  buffer_.append(",\"throttle\":");
+  AppendShortest(throttle);
+  buffer_.push_back('}');
+}
+
+void SteerMessage::AppendArray(const char *key, const double *values, size_t n) {
+  buffer_.append(key);
+  for (size_t i = 0; i < n; i++) {
+    if (i > 0) {
+      buffer_.push_back(',');
+    }
+    if (precision_ < 0) {
+      AppendShortest(values[i]);
+    } else {
+      AppendFixed(values[i]);
+    }
+  }
+  buffer_.push_back(']');
+}
+
+// The shortest digits are those of the first of %.15g, %.16g and %.17g
+// that strtod reads back as value: any decimal of up to 15 digits survives
+// a round trip through double, so when the shortest has no more than that
+// %.15g, which drops trailing zeros, gives it, and 17 always suffice.
+void SteerMessage::AppendShortest(double value) {
+  if (!std::isfinite(value)) {
+    buffer_.append("null");
+    return;
+  }
+  char text[kMaxShortest];
+  for (int digits = 15; digits <= 17; digits++) {
+    const int length = std::snprintf(text, sizeof(text), "%.*g", digits, value);
+    if (digits == 17 || std::strtod(text, nullptr) == value) {
+      buffer_.append(text, static_cast<size_t>(length));
+      return;
+    }
+  }
+}
+
+// Rounded to precision_ decimals in integers, trailing zeros dropped. Too
+// large for those to be exact, which the lines of the simulator never are,
+// it is the shortest digits.
+void SteerMessage::AppendFixed(double value) {
+  if (!std::isfinite(value)) {
+    buffer_.append("null");
+    return;
+  }
+  const unsigned long long scale = kPowersOfTen[precision_];
+  const double scaled = std::round(std::fabs(value) * scale);
+  if (scaled >= kExactInteger) {
+    AppendShortest(value);
+    return;
+  }
+  const unsigned long long units = static_cast<unsigned long long>(scaled);
+  if (value < 0 && units != 0) {
+    buffer_.push_back('-');
+  }
+  AppendInteger(units / scale);
+  unsigned long long decimals = units % scale;
+  if (decimals == 0) {
+    return;
+  }
+  int count = precision_;
+  for (; decimals % 10 == 0; decimals /= 10) {
+    count--;
+  }
+  char text[kMaxPrecision];
+  for (int i = count - 1; i >= 0; i--, decimals /= 10) {
+    text[i] = static_cast<char>('0' + decimals % 10);
+  }
+  buffer_.push_back('.');
+  buffer_.append(text, static_cast<size_t>(count));
+}
+
+void SteerMessage::AppendInteger(unsigned long long value) {
+  char text[20];
+  size_t i = sizeof(text);
+  do {
+    text[--i] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  buffer_.append(text + i, sizeof(text) - i);
+}
@@ -0,0 +1,60 @@
+#ifndef STEER_MESSAGE_H
+#define STEER_MESSAGE_H
+
+#include <cstddef>
+#include <string>
+
+// The steer event sent back to the simulator, written straight into a
+// buffer that is kept from one message to the next, so that once it has
+// grown to the size of a message replying allocates nothing:
+//
+//   42["steer",{"mpc_x":[..],"mpc_y":[..],"next_x":[..],"next_y":[..],
+//               "steering_angle":..,"throttle":..}]
+//
+// The keys come in the order json::dump() sorted them. The actuations are
+// written with the fewest digits that read back as the same double; the
+// lines to display, which the simulator only draws, with at most
+// precision decimals, or the same shortest digits if precision is
+// negative. A number that isn't finite is written as null, as
+// json::dump() did.
+class SteerMessage {
+ public:
+  explicit SteerMessage(int precision = 3);
+
+  // The message, valid until the next Write
+  const std::string &Write(double steering_angle, double throttle, const double *mpc_x,
+                           const double *mpc_y, size_t mpc_n, const double *next_x,
+                           const double *next_y, size_t next_n);
+
+  // The steer_batch event of a multi-vehicle simulator, the object of the
+  // steer event for each car in its order, written the same way:
+  //
+  //   42["steer_batch",[{..},{..}]]
+  //
+  // Begun, added to car by car, and done; the message is valid until the
+  // next Write or BeginBatch
+  void BeginBatch();
+  void AddToBatch(double steering_angle, double throttle, const double *mpc_x,
+                  const double *mpc_y, size_t mpc_n, const double *next_x, const double *next_y,
+                  size_t next_n);
+  const std::string &EndBatch();
+
+  int precision() const { return precision_; }
+  void set_precision(int precision);
+
+ private:
+  void AppendSteer(double steering_angle, double throttle, const double *mpc_x,
+                   const double *mpc_y, size_t mpc_n, const double *next_x, const double *next_y,
+                   size_t next_n);
+  void AppendArray(const char *key, const double *values, size_t n);
+  void AppendShortest(double value);
+  void AppendFixed(double value);
+  void AppendInteger(unsigned long long value);
+
+  std::string buffer_;
+  int precision_;
+  // Cars added to the batch
+  size_t batched_ = 0;
+};
+
+#endif /* STEER_MESSAGE_H */
@@ -0,0 +1,295 @@
+#include "Telemetry.h"
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include "SocketIOFrame.h"
+
+namespace {
+
+const size_t npos = MessageView::npos;
+
+// Powers of ten that are exact in double
+const double kPowersOfTen[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                               1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                               1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+// Largest integer below which every integer is exact in double
+const uint64_t kExactMantissa = uint64_t(1) << 53;
+
+// The fields of a Telemetry, the bits of those that must be there
+const unsigned kPtsx = 1;
+const unsigned kPtsy = 2;
+const unsigned kRequired = 127;
+const struct {
+  const char *name;
+  double Telemetry::*field;
+  unsigned bit;
+} kNumbers[] = {{"x", &Telemetry::x, 4},
+                {"y", &Telemetry::y, 8},
+                {"psi", &Telemetry::psi, 16},
+                {"speed", &Telemetry::speed, 32},
+                {"steering_angle", &Telemetry::steering_angle, 64},
+                {"psi_unity", &Telemetry::psi_unity, 0},
+                {"throttle", &Telemetry::throttle, 0}};
+
+bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+size_t SkipSpace(const MessageView &m, size_t i) {
+  while (i < m.size() && (m[i] == ' ' || m[i] == '\t' || m[i] == '\n' || m[i] == '\r')) {
+    i++;
+  }
+  return i;
+}
+
+// Past the JSON number at i, its value in value; npos if there is none.
+//
+// Up to 19 significant digits are gathered into an integer. When it is
+// exact in double and the decimal exponent is within the powers of ten
+// that are, one multiplication or division rounds the value correctly
+// (Clinger's fast path), as it does for the figures of the simulator;
+// anything else goes through strtod.
+size_t ParseNumber(const MessageView &m, size_t i, double &value) {
+  const size_t start = i;
+  const bool negative = i < m.size() && m[i] == '-';
+  if (negative) {
+    i++;
+  }
+  uint64_t mantissa = 0;
+  int exponent = 0;
+  bool exact = true;
+  size_t digits = 0;
+  for (; i < m.size() && IsDigit(m[i]); i++, digits++) {
+    if (mantissa < 1000000000000000000ull) {
+      mantissa = mantissa * 10 + (m[i] - '0');
+    } else {
+      exponent++;
+      exact = false;
+    }
+  }
+  if (i < m.size() && m[i] == '.') {
+    for (i++; i < m.size() && IsDigit(m[i]); i++, digits++) {
+      if (mantissa < 1000000000000000000ull) {
+        mantissa = mantissa * 10 + (m[i] - '0');
+        exponent--;
+      } else {
+        exact = false;
+      }
+    }
+  }
+  if (digits == 0) {
+    return npos;
+  }
+  if (i < m.size() && (m[i] == 'e' || m[i] == 'E')) {
+    i++;
+    const bool negative_exponent = i < m.size() && m[i] == '-';
+    if (i < m.size() && (m[i] == '-' || m[i] == '+')) {
+      i++;
+    }
+    if (i >= m.size() || !IsDigit(m[i])) {
+      return npos;
+    }
+    int e = 0;
+    for (; i < m.size() && IsDigit(m[i]); i++) {
+      e = e < 10000 ? e * 10 + (m[i] - '0') : e;
+    }
+    exponent += negative_exponent ? -e : e;
+  }
+
+  if (exact && mantissa <= kExactMantissa && exponent >= -22 && exponent <= 22) {
+    value = static_cast<double>(mantissa);
+    value = exponent < 0 ? value / kPowersOfTen[-exponent] : value * kPowersOfTen[exponent];
+    value = negative ? -value : value;
+    return i;
+  }
+  // The digits as a string of their own, the message isn't null terminated
+  char text[64];
+  if (i - start >= sizeof(text)) {
+    return npos;
+  }
+  for (size_t k = start; k < i; k++) {
+    text[k - start] = m[k];
+  }
+  text[i - start] = '\0';
+  value = std::strtod(text, nullptr);
+  return i;
+}
+
+// Past the JSON array of numbers at i, appended to values up to
+// kMaxWaypoints of them; npos if it is malformed or longer
+size_t ParseNumbers(const MessageView &m, size_t i, Telemetry::Waypoints &values) {
+  values.clear();
+  if (i >= m.size() || m[i] != '[') {
+    return npos;
+  }
+  i = SkipSpace(m, i + 1);
+  if (i < m.size() && m[i] == ']') {
+    return i + 1;
+  }
+  while (i < m.size()) {
+    double value;
+    i = ParseNumber(m, i, value);
+    if (i == npos || values.size() == Telemetry::kMaxWaypoints) {
+      return npos;
+    }
+    values.push_back(value);
+    i = SkipSpace(m, i);
+    if (i < m.size() && m[i] == ']') {
+      return i + 1;
+    }
+    if (i >= m.size() || m[i] != ',') {
+      return npos;
+    }
+    i = SkipSpace(m, i + 1);
+  }
+  return npos;
+}
+
+}  // namespace
+
+bool ParseTelemetry(const MessageView &data, Telemetry &telemetry) {
+  const MessageView &m = data;
+  telemetry.ptsx.clear();
+  telemetry.ptsy.clear();
+  unsigned found = 0;
+  size_t i = SkipSpace(m, 0);
+  if (i >= m.size() || m[i] != '{') {
+    return false;
+  }
+  i = SkipSpace(m, i + 1);
+  if (i < m.size() && m[i] == '}') {
+    return false;
+  }
+  while (i < m.size()) {
+    // "key": value, keys without escapes
+    if (m[i] != '"') {
+      return false;
+    }
+    const size_t close = m.find('"', i + 1);
+    if (close == npos) {
+      return false;
+    }
+    const MessageView key = m.substr(i + 1, close - i - 1);
+    i = SkipSpace(m, close + 1);
+    if (i >= m.size() || m[i] != ':') {
+      return false;
+    }
+    i = SkipSpace(m, i + 1);
+
+    if (key.equals("ptsx")) {
+      i = ParseNumbers(m, i, telemetry.ptsx);
+      found |= kPtsx;
+    } else if (key.equals("ptsy")) {
+      i = ParseNumbers(m, i, telemetry.ptsy);
+      found |= kPtsy;
+    } else {
+      bool number = false;
+      for (const auto &field : kNumbers) {
+        if (key.equals(field.name)) {
+          i = ParseNumber(m, i, telemetry.*field.field);
+          found |= field.bit;
+          number = true;
+          break;
+        }
+      }
+      if (!number) {
+        i = SkipJSONValue(m, i);
+      }
+    }
+    if (i == npos) {
+      return false;
+    }
+
+    i = SkipSpace(m, i);
+    if (i < m.size() && m[i] == '}') {
+      return found == kRequired;
+    }
+    if (i >= m.size() || m[i] != ',') {
+      return false;
+    }
+    i = SkipSpace(m, i + 1);
+  }
+  return false;
+}
+
+bool ParseTelemetryBatch(const MessageView &data, std::vector<Telemetry> &cars, size_t &n) {
+  const MessageView &m = data;
+  n = 0;
+  size_t i = SkipSpace(m, 0);
+  if (i >= m.size() || m[i] != '[') {
+    return false;
+  }
+  i = SkipSpace(m, i + 1);
+  if (i < m.size() && m[i] == ']') {
+    return true;
+  }
+  while (i < m.size()) {
+    const size_t end = SkipJSONValue(m, i);
+    if (end == npos || n == kMaxTelemetryBatch) {
+      return false;
+    }
+    if (n == cars.size()) {
+      cars.emplace_back();
+    }
+    if (!ParseTelemetry(m.substr(i, end - i), cars[n])) {
+      return false;
+    }
+    n++;
+    i = SkipSpace(m, end);
+    if (i < m.size() && m[i] == ']') {
+      return true;
+    }
+    if (i >= m.size() || m[i] != ',') {
+      return false;
+    }
+    i = SkipSpace(m, i + 1);
+  }
+  return false;
+}
+
+bool ParseSteer(const MessageView &data, double &steering_angle, double &throttle) {
+  const MessageView &m = data;
+  unsigned found = 0;
+  size_t i = SkipSpace(m, 0);
+  if (i >= m.size() || m[i] != '{') {
+    return false;
+  }
+  i = SkipSpace(m, i + 1);
+  while (i < m.size()) {
+    if (m[i] != '"') {
+      return false;
+    }
+    const size_t close = m.find('"', i + 1);
+    if (close == npos) {
+      return false;
+    }
+    const MessageView key = m.substr(i + 1, close - i - 1);
+    i = SkipSpace(m, close + 1);
+    if (i >= m.size() || m[i] != ':') {
+      return false;
+    }
+    i = SkipSpace(m, i + 1);
+    double *value = key.equals("steering_angle") ? &steering_angle
+                    : key.equals("throttle")     ? &throttle
+                                                 : nullptr;
+    if (value == nullptr) {
+      i = SkipJSONValue(m, i);
+    } else if (m.substr(i, 4).equals("null")) {
+      *value = std::numeric_limits<double>::quiet_NaN();
+      i += 4;
+    } else {
+      i = ParseNumber(m, i, *value);
+    }
+    if (i == npos) {
+      return false;
+    }
+    found |= value == &steering_angle ? 1 : value == &throttle ? 2 : 0;
+    i = SkipSpace(m, i);
+    if (i < m.size() && m[i] == '}') {
+      return found == 3;
+    }
+    if (i >= m.size() || m[i] != ',') {
+      return false;
+    }
+    i = SkipSpace(m, i + 1);
+  }
+  return false;
+}
@@ -0,0 +1,57 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <cstddef>
+#include <vector>
+#include "FixedVector.h"
+#include "MessageView.h"
+
+// The data of a telemetry event of the simulator, see DATA.md.
+//
+// The waypoints are held in place, up to kMaxWaypoints of them, for the
+// reference fits to take as they are, so that parsing into the same struct
+// every tick never allocates and a struct on the stack needs no heap.
+struct Telemetry {
+  static const size_t kMaxWaypoints = 64;
+  typedef FixedVector<double, kMaxWaypoints> Waypoints;
+
+  // Waypoints in the map frame
+  Waypoints ptsx;
+  Waypoints ptsy;
+  // Pose, in the map frame, radians counterclockwise from x
+  double x = 0;
+  double y = 0;
+  double psi = 0;
+  double psi_unity = 0;
+  // mph
+  double speed = 0;
+  // Radians, and in [-1, 1]
+  double steering_angle = 0;
+  double throttle = 0;
+};
+
+// Parse the data object of a telemetry event, such as SocketIOFrame::data,
+// into telemetry in one pass and without a DOM: the fields of DATA.md are
+// read as they come, numbers by the exact fast path of their decimal digits
+// where it applies and strtod otherwise, and any other field is skipped.
+// False if the object is malformed, misses ptsx, ptsy, x, y, psi, speed or
+// steering_angle, or has more than kMaxWaypoints waypoints, for the caller
+// to fall back to a JSON library.
+bool ParseTelemetry(const MessageView &data, Telemetry &telemetry);
+
+// The most cars of a telemetry_batch event
+const size_t kMaxTelemetryBatch = 256;
+
+// Parse the data of a telemetry_batch event of a multi-vehicle simulator,
+// a JSON array of the objects of ParseTelemetry, one per car, into the
+// first n of cars, which grows to the largest batch and keeps the buffers
+// of each car from one batch to the next. False if the array is malformed,
+// any of its objects is, or it holds more than kMaxTelemetryBatch cars.
+bool ParseTelemetryBatch(const MessageView &data, std::vector<Telemetry> &cars, size_t &n);
+
+// The actuations of the data object of a steer event, as SteerMessage
+// writes it, for replays to compare with; a null is NaN. False if the
+// object is malformed or misses either.
+bool ParseSteer(const MessageView &data, double &steering_angle, double &throttle);
+
+#endif /* TELEMETRY_H */
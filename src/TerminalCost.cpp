@@ -0,0 +1,54 @@
+#include "TerminalCost.h"
+#include <cmath>
+#include "Eigen-3.3/Eigen/Core"
+
+namespace {
+
+const size_t kMaxIterations = 100000;
+const double kTolerance = 1e-10;
+
+}  // namespace
+
+CostWeights LQRTerminalCost(const CostWeights &weights, double dt) {
+  const double v = weights.v_ref;
+  const double k = v * dt / Lf;
+
+  // Lateral: state (cte, epsi, delta), actuation the change of delta
+  Eigen::Matrix3d A;
+  A << 1, v * dt, 0,  //
+      0, 1, -k,       //
+      0, 0, 1;
+  Eigen::Vector3d B(0, -k, 1);
+  const Eigen::Matrix3d Q =
+      Eigen::Vector3d(weights.cte, weights.epsi, weights.current_delta).asDiagonal();
+  const double R = weights.diff_delta;
+
+  // Value iteration of the Riccati equation from P = Q
+  Eigen::Matrix3d P = Q;
+  for (size_t i = 0; i < kMaxIterations; i++) {
+    const Eigen::Vector3d PB = P * B;
+    const Eigen::Matrix3d next =
+        Q + A.transpose() * (P - PB * PB.transpose() / (R + B.dot(PB))) * A;
+    const double change = (next - P).cwiseAbs().maxCoeff();
+    P = 0.5 * (next + next.transpose());
+    if (change <= kTolerance * P.cwiseAbs().maxCoeff()) {
+      break;
+    }
+  }
+
+  // Longitudinal, scalar: p^2 dt^2 = q (r + p dt^2)
+  const double q = weights.v;
+  const double r = weights.current_a;
+  const double dt2 = dt * dt;
+  const double p = (q * dt2 + std::sqrt(q * q * dt2 * dt2 + 4 * q * r * dt2)) / (2 * dt2);
+
+  CostWeights terminal = weights;
+  terminal.terminal_cte = P(0, 0) - Q(0, 0);
+  terminal.terminal_epsi = P(1, 1) - Q(1, 1);
+  terminal.terminal_delta = P(2, 2) - Q(2, 2);
+  terminal.terminal_cte_epsi = P(0, 1);
+  terminal.terminal_cte_delta = P(0, 2);
+  terminal.terminal_epsi_delta = P(1, 2);
+  terminal.terminal_v = p - q;
+  return terminal;
+}
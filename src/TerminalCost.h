@@ -0,0 +1,23 @@
+#ifndef TERMINAL_COST_H
+#define TERMINAL_COST_H
+
+#include "CostWeights.h"
+
+// weights with the terminal weights of the infinite horizon LQR cost of the
+// model linearized at the reference speed weights.v_ref on a straight road,
+// stages of dt seconds.
+//
+// The lateral error follows cte' = cte + v dt epsi and epsi' = epsi - v dt /
+// Lf delta, with the steering delta = delta_prev + change as a state, so
+// that its change is weighted like diff_delta; the speed error follows v' =
+// v + a dt, weighted by v and current_a (the small diff_a is left out). The
+// solutions P of their Riccati equations weigh the last stage of the horizon
+// as the first of an unbounded one; the horizon already counts the stage
+// weights of that stage, so the terminal weights are P less those.
+//
+// Computed once, at startup: with it a horizon of about half the stages
+// steers much like the long one, see benchmark_solvers. Only the Ipopt
+// backends, which minimize the cost of FG_eval, use the terminal weights.
+CostWeights LQRTerminalCost(const CostWeights &weights, double dt);
+
+#endif /* TERMINAL_COST_H */
@@ -0,0 +1,255 @@
+#include "TickRecorder.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include "Instrumentation.h"
+#include "Log.h"
+
+namespace {
+
+// The recorders a crash writes, in the order they were made
+const size_t kMaxRecorders = 64;
+std::atomic<const TickRecorder *> recorders[kMaxRecorders];
+std::atomic<size_t> recorders_made{0};
+// Set by the first crash, so that a second thread crashing meanwhile
+// doesn't write the files again
+std::atomic<bool> crashing{false};
+
+const int kCrashSignals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+
+const char *const kReasonNames[] = {"deadline_misses", "request", "crash"};
+
+uint64_t ClockNanoseconds(clockid_t clock) {
+  timespec now;
+  clock_gettime(clock, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000u + static_cast<uint64_t>(now.tv_nsec);
+}
+
+TickDumpHeader MakeHeader(TickDumpReason reason, size_t worker, uint64_t records) {
+  TickDumpHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = kTickDumpMagic;
+  header.version = kTickDumpVersion;
+  header.reason = static_cast<uint32_t>(reason);
+  header.worker = static_cast<uint32_t>(worker);
+  header.pid = static_cast<uint64_t>(getpid());
+  header.records = records;
+  header.record_bytes = sizeof(TickRecord);
+  // Async-signal-safe, unlike the clocks of std::chrono in principle
+  header.steady_ns = ClockNanoseconds(CLOCK_MONOTONIC);
+  header.system_ns = ClockNanoseconds(CLOCK_REALTIME);
+  return header;
+}
+
+// All of the bytes written to fd, retrying the short writes
+bool WriteAll(int fd, const void *data, size_t size) {
+  const char *at = static_cast<const char *>(data);
+  while (size > 0) {
+    const ssize_t written = write(fd, at, size);
+    if (written <= 0) {
+      return false;
+    }
+    at += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+}  // namespace
+
+const char *TickDumpReasonName(TickDumpReason reason) {
+  const size_t k = static_cast<size_t>(reason) - 1;
+  return k < sizeof(kReasonNames) / sizeof(kReasonNames[0]) ? kReasonNames[k] : "unknown";
+}
+
+TickRecorder::TickRecorder(const std::string &directory, size_t worker, size_t capacity,
+                           size_t burst, size_t window)
+    : directory_(directory),
+      worker_(worker),
+      capacity_(capacity > 0 ? capacity : 1),
+      burst_(burst),
+      // The record leaving the window is read before its slot is reused
+      window_(std::min(window, capacity_ - 1)) {
+  ok_ = access(directory_.c_str(), W_OK) == 0;
+  if (!ok_) {
+    return;
+  }
+  // Zeroed, so that the pages are faulted in now rather than by the ticks
+  ring_.assign(capacity_, TickRecord());
+  snapshot_.assign(capacity_, TickRecord());
+  std::snprintf(crash_path_, sizeof(crash_path_), "%s/ticks-%d-%zu-crash.bin",
+                directory_.c_str(), static_cast<int>(getpid()), worker_);
+  const size_t k = recorders_made.fetch_add(1);
+  if (k < kMaxRecorders) {
+    recorders[k].store(this);
+  }
+  writer_ = std::thread(&TickRecorder::Write, this);
+}
+
+TickRecorder::~TickRecorder() {
+  for (size_t k = 0; k < kMaxRecorders; k++) {
+    const TickRecorder *self = this;
+    recorders[k].compare_exchange_strong(self, nullptr);
+  }
+  if (writer_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+  }
+}
+
+void TickRecorder::Commit() {
+  const uint64_t committed = committed_.load(std::memory_order_relaxed);
+  window_misses_ += ring_[committed % capacity_].missed != 0;
+  // The tick that leaves the window
+  if (committed >= window_) {
+    window_misses_ -= ring_[(committed - window_) % capacity_].missed != 0;
+  }
+  committed_.store(committed + 1, std::memory_order_release);
+  if (burst_ > 0 && window_misses_ >= burst_ &&
+      (!burst_dumped_once_ || committed + 1 >= burst_dumped_ + capacity_)) {
+    burst_dumped_once_ = true;
+    burst_dumped_ = committed + 1;
+    Dump(TickDumpReason::kDeadlineMisses);
+  }
+  if (requested_.load(std::memory_order_relaxed)) {
+    requested_.store(false, std::memory_order_relaxed);
+    Dump(TickDumpReason::kRequest);
+  }
+}
+
+void TickRecorder::Dump(TickDumpReason reason) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (has_snapshot_) {
+      MPC_COUNT(Metrics().tick_dumps_dropped.Add());
+      return;
+    }
+    // Oldest first
+    const uint64_t committed = committed_.load(std::memory_order_relaxed);
+    const size_t n = static_cast<size_t>(std::min<uint64_t>(committed, capacity_));
+    const size_t oldest = committed >= capacity_ ? committed % capacity_ : 0;
+    const size_t tail = std::min(n, capacity_ - oldest);
+    std::memcpy(snapshot_.data(), ring_.data() + oldest, tail * sizeof(TickRecord));
+    std::memcpy(snapshot_.data() + tail, ring_.data(), (n - tail) * sizeof(TickRecord));
+    snapshot_header_ = MakeHeader(reason, worker_, n);
+    has_snapshot_ = true;
+  }
+  wake_.notify_one();
+}
+
+void TickRecorder::Write() {
+  size_t n = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    wake_.wait(lock, [this] { return has_snapshot_ || stop_; });
+    // What is waiting is written before stopping
+    if (!has_snapshot_) {
+      return;
+    }
+    // The solver thread copies into the snapshot only once it is written
+    const TickDumpHeader header = snapshot_header_;
+    lock.unlock();
+    const std::string path =
+        directory_ + "/ticks-" + std::to_string(header.pid) + "-" + std::to_string(worker_) +
+        "-" + std::to_string(n++) + "-" +
+        TickDumpReasonName(static_cast<TickDumpReason>(header.reason)) + ".bin";
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(snapshot_.data()),
+              static_cast<std::streamsize>(header.records * sizeof(TickRecord)));
+    out.close();
+    if (out) {
+      MPC_COUNT(Metrics().tick_dumps.Add());
+      Log(LogLevel::kWarning, "Dumped the last {} ticks of solver {} to {}, {}", header.records,
+          worker_, path, TickDumpReasonName(static_cast<TickDumpReason>(header.reason)));
+    } else {
+      Log(LogLevel::kError, "Could not dump the last ticks to {}", path);
+    }
+    lock.lock();
+    has_snapshot_ = false;
+  }
+}
+
+void TickRecorder::WriteCrash() const {
+  const int fd = open(crash_path_, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return;
+  }
+  // The thread that crashed may have been filling Next, which isn't
+  // committed; the others go on recording meanwhile, so their newest
+  // records may be torn
+  const uint64_t committed = committed_.load(std::memory_order_acquire);
+  const size_t n = static_cast<size_t>(committed < capacity_ ? committed : capacity_);
+  const size_t oldest = committed >= capacity_ ? committed % capacity_ : 0;
+  const size_t tail = n < capacity_ - oldest ? n : capacity_ - oldest;
+  const TickDumpHeader header = MakeHeader(TickDumpReason::kCrash, worker_, n);
+  if (WriteAll(fd, &header, sizeof(header)) &&
+      WriteAll(fd, ring_.data() + oldest, tail * sizeof(TickRecord))) {
+    WriteAll(fd, ring_.data(), (n - tail) * sizeof(TickRecord));
+  }
+  close(fd);
+}
+
+void TickRecorder::OnCrash(int signal) {
+  if (!crashing.exchange(true)) {
+    for (size_t k = 0; k < kMaxRecorders; k++) {
+      const TickRecorder *recorder = recorders[k].load();
+      if (recorder != nullptr) {
+        recorder->WriteCrash();
+      }
+    }
+  }
+  // The handler was reset to the default as it was entered, which takes
+  // over once it returns: a fault faults again, and abort raises again
+  raise(signal);
+}
+
+void TickRecorder::InstallCrashHandlers() {
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  action.sa_handler = &TickRecorder::OnCrash;
+  action.sa_flags = SA_RESETHAND;
+  sigemptyset(&action.sa_mask);
+  for (int signal : kCrashSignals) {
+    sigaction(signal, &action, nullptr);
+  }
+}
+
+bool ReadTickDump(const std::string &path, TickDumpHeader &header,
+                  std::vector<TickRecord> &records, std::string &error) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    error = "can't open it";
+    return false;
+  }
+  if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      header.magic != kTickDumpMagic) {
+    error = "not a dump of the tick recorder";
+    return false;
+  }
+  if (header.version != kTickDumpVersion || header.record_bytes != sizeof(TickRecord)) {
+    error = "version " + std::to_string(header.version) + " of records of " +
+            std::to_string(header.record_bytes) + " bytes, this build reads version " +
+            std::to_string(kTickDumpVersion) + " of " + std::to_string(sizeof(TickRecord));
+    return false;
+  }
+  records.resize(static_cast<size_t>(header.records));
+  if (!in.read(reinterpret_cast<char *>(records.data()),
+               static_cast<std::streamsize>(records.size() * sizeof(TickRecord)))) {
+    // A crash may have been cut short; the records that made it are kept
+    records.resize(static_cast<size_t>(in.gcount()) / sizeof(TickRecord));
+    error = "cut short";
+    return !records.empty();
+  }
+  return true;
+}
@@ -0,0 +1,177 @@
+#ifndef TICK_RECORDER_H
+#define TICK_RECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "Metrics.h"
+
+// The last ticks of a solver thread in memory, to see what led up to a
+// burst of missed deadlines or a crash, where the flight recorder has only
+// the wire: the telemetry of each tick, the state predicted, the seconds of
+// its stages, how the solve went and the command.
+//
+// The ticks go into a ring of fixed records allocated and faulted in at
+// startup. A tick fills its record in place and commits it with one store,
+// so recording is a few hundred bytes written to memory, with no lock and
+// no system call. Nothing is written out until a dump: of a burst of
+// deadline misses among the last ticks, of a request (from any thread, see
+// RequestDump), or of a crash. The first two copy the ring, in order, into
+// a buffer of the same size on the solver thread and hand it to a thread of
+// their own that writes the file; a dump wanted while the last is still
+// being written is dropped and counted. A crash (SIGSEGV, SIGBUS, SIGFPE,
+// SIGILL or SIGABRT, see InstallCrashHandlers) writes the ring of every
+// recorder straight from the signal handler, with open and write only, to
+// a file named in advance, before the signal takes its default action.
+//
+// A dump is a TickDumpHeader then the records, oldest first, in the byte
+// order of the host; mpc_replay ticks=<file> prints one.
+
+// "MPCT", and the version of the layout
+const uint32_t kTickDumpMagic = 0x5443504d;
+const uint32_t kTickDumpVersion = 1;
+
+// The waypoints of a record, the first of the telemetry
+const size_t kTickWaypoints = 8;
+
+enum class TickDumpReason : uint32_t { kDeadlineMisses = 1, kRequest = 2, kCrash = 3 };
+
+// The name of reason, "deadline_misses" for kDeadlineMisses
+const char *TickDumpReasonName(TickDumpReason reason);
+
+// One tick of a session
+struct TickRecord {
+  uint64_t session;
+  // On the steady clock, in ns, like the flight records
+  uint64_t arrival_ns;
+  // The RuntimeConfig it was solved with
+  uint64_t config_version;
+  // The telemetry: the pose and the waypoints in the map frame, the speed
+  // in mph and the actuations the simulator reports
+  double x;
+  double y;
+  double psi;
+  double speed;
+  double steering_angle;
+  double throttle;
+  uint32_t waypoints;
+  uint32_t reserved;
+  double ptsx[kTickWaypoints];
+  double ptsy[kTickWaypoints];
+  // The latency predicted over, in seconds, and the state handed to Solve
+  double latency;
+  double state[6];
+  // Seconds of each TickStage, 0 for those it didn't have
+  float stage_seconds[kTickStages];
+  float reserved2;
+  // How the solve went (see SolveStatistics): its SolveStatus, SolveStart,
+  // iterations and restorations, and its cost
+  int32_t status;
+  int32_t start;
+  int32_t iterations;
+  int32_t restorations;
+  double cost;
+  // The command sent
+  double steer_value;
+  double throttle_value;
+  // 1 + the DeadlineMiss if the tick missed the control period, else 0
+  uint32_t missed;
+  uint32_t reserved3;
+};
+
+struct TickDumpHeader {
+  uint32_t magic;
+  uint32_t version;
+  // The TickDumpReason, and the solver thread of the recorder
+  uint32_t reason;
+  uint32_t worker;
+  uint64_t pid;
+  // The records that follow, and the bytes of each
+  uint64_t records;
+  uint64_t record_bytes;
+  // The steady and wall clocks at the dump, in ns, to place the records in
+  // time
+  uint64_t steady_ns;
+  uint64_t system_ns;
+  uint64_t reserved;
+};
+
+static_assert(std::is_trivially_copyable<TickRecord>::value, "The records are copied as bytes");
+static_assert(sizeof(TickRecord) % 8 == 0, "The records are aligned to 8 bytes");
+static_assert(sizeof(TickDumpHeader) == 64, "The dump header is a cache line");
+
+class TickRecorder {
+ public:
+  // The last capacity ticks of solver thread worker, dumped into directory
+  // once burst of the last window of them missed their deadline, and at
+  // most once every capacity ticks for that; no bursts with burst 0. False
+  // from ok() if directory can't be written.
+  TickRecorder(const std::string &directory, size_t worker, size_t capacity, size_t burst,
+               size_t window);
+  ~TickRecorder();
+
+  bool ok() const { return ok_; }
+
+  // The record of the next tick, to fill in place and Commit, on the
+  // solver thread only
+  TickRecord &Next() { return ring_[committed_.load(std::memory_order_relaxed) % capacity_]; }
+
+  // Keep the record of Next, and dump the ring if the deadlines missed
+  // make a burst or a dump was requested
+  void Commit();
+
+  // Dump the ring at the next Commit, from any thread
+  void RequestDump() { requested_.store(true, std::memory_order_relaxed); }
+
+  // Write the ring of every recorder made so far on SIGSEGV, SIGBUS,
+  // SIGFPE, SIGILL and SIGABRT, then let the signal take the process down.
+  // Once per process, after the recorders are made.
+  static void InstallCrashHandlers();
+
+ private:
+  // Copy the ring for the writer, or count the dump dropped if it's busy
+  void Dump(TickDumpReason reason);
+  void Write();
+  // The ring as it is, from a signal handler
+  void WriteCrash() const;
+  static void OnCrash(int signal);
+
+  const std::string directory_;
+  const size_t worker_;
+  const size_t capacity_;
+  const size_t burst_;
+  const size_t window_;
+  bool ok_ = false;
+  std::vector<TickRecord> ring_;
+  std::atomic<uint64_t> committed_{0};
+  std::atomic<bool> requested_{false};
+  // The deadlines missed by the last window ticks, and the commits at the
+  // last dump of a burst
+  size_t window_misses_ = 0;
+  uint64_t burst_dumped_ = 0;
+  bool burst_dumped_once_ = false;
+  // The file of a crash, named in advance
+  char crash_path_[512];
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::vector<TickRecord> snapshot_;
+  TickDumpHeader snapshot_header_;
+  bool has_snapshot_ = false;
+  bool stop_ = false;
+  std::thread writer_;
+};
+
+// The header and records of the dump at path, false with the reason in
+// error if it can't be read. A dump cut short, by a crash or a full disk,
+// gives the records it has, with error saying so.
+bool ReadTickDump(const std::string &path, TickDumpHeader &header,
+                  std::vector<TickRecord> &records, std::string &error);
+
+#endif /* TICK_RECORDER_H */
@@ -0,0 +1,199 @@
+#ifdef MPC_TRACE
+
+#include "Trace.h"
+#include <unistd.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Log.h"
+
+namespace {
+
+// Spans a thread holds until the writer takes them
+const size_t kTraceSpans = 1 << 14;
+// How often the writer takes them
+const std::chrono::milliseconds kTraceFlushPeriod(100);
+
+struct Span {
+  const char *name;
+  std::chrono::steady_clock::time_point begin;
+  std::chrono::steady_clock::time_point end;
+};
+
+// The spans of a thread, kept after it exits for the writer to take them
+struct TraceBuffer {
+  unsigned tid = 0;
+  // Under the mutex of TraceState, with whether it is in the file yet
+  std::string name;
+  bool named = false;
+  Span spans[kTraceSpans];
+  // Written by the thread, and by the writer
+  std::atomic<size_t> head{0};
+  std::atomic<size_t> tail{0};
+  std::atomic<uint64_t> dropped{0};
+};
+
+struct TraceState {
+  std::atomic<bool> enabled{false};
+  std::mutex mutex;
+  std::condition_variable stop;
+  bool stopping = false;
+  std::vector<TraceBuffer *> buffers;
+  // Of the writer
+  std::FILE *file = nullptr;
+  bool first = true;
+  std::chrono::steady_clock::time_point start;
+  std::thread writer;
+};
+
+// Never destroyed, for the threads that trace past the end of main
+TraceState &State() {
+  static TraceState *state = new TraceState();
+  return *state;
+}
+
+thread_local TraceBuffer *this_thread_buffer = nullptr;
+
+TraceBuffer &ThisThread() {
+  if (this_thread_buffer == nullptr) {
+    TraceState &state = State();
+    TraceBuffer *buffer = new TraceBuffer();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    buffer->tid = static_cast<unsigned>(state.buffers.size() + 1);
+    state.buffers.push_back(buffer);
+    this_thread_buffer = buffer;
+  }
+  return *this_thread_buffer;
+}
+
+double Microseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+void WriteEvent(TraceState &state, const char *text) {
+  std::fputs(state.first ? "[\n" : ",\n", state.file);
+  std::fputs(text, state.file);
+  state.first = false;
+}
+
+// Append the names of the new threads and the spans recorded since the
+// last time to the file
+void Drain(TraceState &state) {
+  std::vector<TraceBuffer *> buffers;
+  char text[256];
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    buffers = state.buffers;
+    for (TraceBuffer *buffer : buffers) {
+      if (!buffer->named && !buffer->name.empty()) {
+        std::snprintf(text, sizeof(text),
+                      "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%u,"
+                      "\"args\":{\"name\":\"%s\"}}",
+                      static_cast<long>(getpid()), buffer->tid, buffer->name.c_str());
+        WriteEvent(state, text);
+        buffer->named = true;
+      }
+    }
+  }
+  uint64_t dropped = 0;
+  for (TraceBuffer *buffer : buffers) {
+    const size_t head = buffer->head.load(std::memory_order_acquire);
+    size_t tail = buffer->tail.load(std::memory_order_relaxed);
+    for (; tail != head; tail++) {
+      const Span &span = buffer->spans[tail % kTraceSpans];
+      std::snprintf(text, sizeof(text),
+                    "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%u,\"ts\":%.3f,"
+                    "\"dur\":%.3f}",
+                    span.name, static_cast<long>(getpid()), buffer->tid,
+                    Microseconds(span.begin - state.start), Microseconds(span.end - span.begin));
+      WriteEvent(state, text);
+    }
+    buffer->tail.store(tail, std::memory_order_release);
+    dropped += buffer->dropped.exchange(0, std::memory_order_relaxed);
+  }
+  std::fflush(state.file);
+  if (dropped > 0) {
+    Log(LogLevel::kWarning, "Trace: {} spans dropped, the writer fell behind", dropped);
+  }
+}
+
+void Write(TraceState *state) {
+  std::unique_lock<std::mutex> lock(state->mutex);
+  while (!state->stopping) {
+    state->stop.wait_for(lock, kTraceFlushPeriod);
+    lock.unlock();
+    Drain(*state);
+    lock.lock();
+  }
+}
+
+}  // namespace
+
+bool StartTrace(const std::string &path) {
+  TraceState &state = State();
+  if (state.file != nullptr) {
+    return false;
+  }
+  state.file = std::fopen(path.c_str(), "w");
+  if (state.file == nullptr) {
+    return false;
+  }
+  state.first = true;
+  state.stopping = false;
+  state.start = std::chrono::steady_clock::now();
+  state.writer = std::thread(Write, &state);
+  state.enabled.store(true, std::memory_order_relaxed);
+  return true;
+}
+
+void StopTrace() {
+  TraceState &state = State();
+  if (state.file == nullptr) {
+    return;
+  }
+  state.enabled.store(false, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.stopping = true;
+  }
+  state.stop.notify_one();
+  state.writer.join();
+  Drain(state);
+  std::fputs(state.first ? "[]\n" : "\n]\n", state.file);
+  std::fclose(state.file);
+  state.file = nullptr;
+}
+
+bool TraceEnabled() { return State().enabled.load(std::memory_order_relaxed); }
+
+void TraceThread(const char *role, size_t k) {
+  if (!TraceEnabled()) {
+    return;
+  }
+  TraceBuffer &buffer = ThisThread();
+  TraceState &state = State();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  buffer.name = std::string(role) + " " + std::to_string(k);
+  buffer.named = false;
+}
+
+void TraceSpan(const char *name, std::chrono::steady_clock::time_point begin,
+               std::chrono::steady_clock::time_point end) {
+  if (!TraceEnabled()) {
+    return;
+  }
+  TraceBuffer &buffer = ThisThread();
+  const size_t head = buffer.head.load(std::memory_order_relaxed);
+  if (head - buffer.tail.load(std::memory_order_acquire) == kTraceSpans) {
+    buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  buffer.spans[head % kTraceSpans] = {name, begin, end};
+  buffer.head.store(head + 1, std::memory_order_release);
+}
+
+#endif  // MPC_TRACE
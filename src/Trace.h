@@ -0,0 +1,78 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// A timeline of the control loop, for how the event loops, the solver
+// threads and the timers interleave, as the histograms of Metrics.h can't
+// show it. Built at the full level of instrumentation (cmake
+// -DMPC_INSTRUMENTATION=full, which defines MPC_TRACE, see
+// Instrumentation.h) and started with the path to write it to, every
+// thread records the spans of its stages, the iterations of the solves
+// among them, and a background thread appends them to the file in the trace event format of Chrome's about:tracing,
+// which ui.perfetto.dev opens as well.
+//
+// A span goes into a ring of the thread that records it, lock-free with the
+// writer as its only reader, and a span that finds the ring full is dropped
+// and counted. The file is a JSON array that is only closed by StopTrace;
+// the viewers read it without the closing bracket too, so the trace of a
+// server that was killed still opens.
+//
+// Without MPC_TRACE the macros below are empty and nothing of this is
+// compiled in.
+
+#ifdef MPC_TRACE
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+// Trace into the file at path from now on, false if it can't be written
+bool StartTrace(const std::string &path);
+// Write out the spans recorded so far and close the file
+void StopTrace();
+// Whether a trace is being written, a relaxed load
+bool TraceEnabled();
+
+// Name the track of this thread in the trace after its role and the number
+// of its worker, e.g. "solver 0", if a trace is being written
+void TraceThread(const char *role, size_t k);
+
+// A span of this thread named name, which must outlive the program like a
+// literal
+void TraceSpan(const char *name, std::chrono::steady_clock::time_point begin,
+               std::chrono::steady_clock::time_point end);
+
+// The span of a scope
+class TraceScope {
+ public:
+  explicit TraceScope(const char *name)
+      : name_(name),
+        begin_(TraceEnabled() ? std::chrono::steady_clock::now()
+                              : std::chrono::steady_clock::time_point()) {}
+  ~TraceScope() {
+    if (begin_ != std::chrono::steady_clock::time_point()) {
+      TraceSpan(name_, begin_, std::chrono::steady_clock::now());
+    }
+  }
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+ private:
+  const char *name_;
+  const std::chrono::steady_clock::time_point begin_;
+};
+
+#define MPC_TRACE_CONCAT_(a, b) a##b
+#define MPC_TRACE_CONCAT(a, b) MPC_TRACE_CONCAT_(a, b)
+#define MPC_TRACE_SCOPE(name) TraceScope MPC_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define MPC_TRACE_SPAN(name, begin, end) TraceSpan(name, begin, end)
+#define MPC_TRACE_THREAD(role, k) TraceThread(role, k)
+
+#else
+
+#define MPC_TRACE_SCOPE(name) ((void)0)
+#define MPC_TRACE_SPAN(name, begin, end) ((void)0)
+#define MPC_TRACE_THREAD(role, k) ((void)0)
+
+#endif  // MPC_TRACE
+
+#endif /* TRACE_H */
@@ -0,0 +1,136 @@
+#include "TrackIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+TrackIndex::TrackIndex(const TrackSpline &track, double spacing, double cell)
+    : length_(track.length()), cell_(cell) {
+  const size_t n = std::max<size_t>(3, static_cast<size_t>(std::ceil(length_ / spacing)));
+  n_ = n;
+  segment_storage_.resize(7 * n);
+  double *xs = &segment_storage_[0];
+  double *ys = xs + n;
+  double *ss = ys + n;
+  double *dxs = ss + n;
+  double *dys = dxs + n;
+  double *inverse_lengths = dys + n;
+  double *ds = inverse_lengths + n;
+  for (size_t i = 0; i < n; i++) {
+    const double s = length_ * i / n;
+    const TrackPoint p = track.At(s);
+    xs[i] = p.x;
+    ys[i] = p.y;
+    ss[i] = s;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    const size_t j = (i + 1) % n;
+    dxs[i] = xs[j] - xs[i];
+    dys[i] = ys[j] - ys[i];
+    inverse_lengths[i] = 1 / (dxs[i] * dxs[i] + dys[i] * dys[i]);
+    ds[i] = (j == 0 ? length_ : ss[j]) - ss[i];
+  }
+
+  x0_ = *std::min_element(xs, xs + n);
+  y0_ = *std::min_element(ys, ys + n);
+  nx_ = static_cast<long>((*std::max_element(xs, xs + n) - x0_) / cell_) + 1;
+  ny_ = static_cast<long>((*std::max_element(ys, ys + n) - y0_) / cell_) + 1;
+
+  // The segments of every cell, then the cells one after the other
+  std::vector<std::vector<uint32_t> > cells(nx_ * ny_);
+  for (size_t i = 0; i < n; i++) {
+    const size_t j = (i + 1) % n;
+    long cx0, cy0, cx1, cy1;
+    Cell(std::min(xs[i], xs[j]), std::min(ys[i], ys[j]), cx0, cy0);
+    Cell(std::max(xs[i], xs[j]), std::max(ys[i], ys[j]), cx1, cy1);
+    for (long cy = cy0; cy <= cy1; cy++) {
+      for (long cx = cx0; cx <= cx1; cx++) {
+        cells[cy * nx_ + cx].push_back(static_cast<uint32_t>(i));
+      }
+    }
+  }
+  std::vector<uint32_t> cell_segments;
+  grid_storage_.push_back(0);
+  for (const std::vector<uint32_t> &segments : cells) {
+    cell_segments.insert(cell_segments.end(), segments.begin(), segments.end());
+    grid_storage_.push_back(static_cast<uint32_t>(cell_segments.size()));
+  }
+  grid_storage_.insert(grid_storage_.end(), cell_segments.begin(), cell_segments.end());
+  Bind(&segment_storage_[0], &grid_storage_[0]);
+}
+
+void TrackIndex::Bind(const double *segments, const uint32_t *grid) {
+  xs_ = segments;
+  ys_ = xs_ + n_;
+  ss_ = ys_ + n_;
+  dxs_ = ss_ + n_;
+  dys_ = dxs_ + n_;
+  inverse_lengths_ = dys_ + n_;
+  ds_ = inverse_lengths_ + n_;
+  cell_start_ = grid;
+  cell_segments_ = grid + nx_ * ny_ + 1;
+}
+
+void TrackIndex::Cell(double px, double py, long &cx, long &cy) const {
+  cx = std::min(std::max(static_cast<long>(std::floor((px - x0_) / cell_)), 0L), nx_ - 1);
+  cy = std::min(std::max(static_cast<long>(std::floor((py - y0_) / cell_)), 0L), ny_ - 1);
+}
+
+void TrackIndex::Match(size_t i, double px, double py, TrackMatch &match) const {
+  const double ex = px - xs_[i];
+  const double ey = py - ys_[i];
+  const double t =
+      std::min(std::max((ex * dxs_[i] + ey * dys_[i]) * inverse_lengths_[i], 0.0), 1.0);
+  const double fx = ex - t * dxs_[i];
+  const double fy = ey - t * dys_[i];
+  // Squared until the search is done
+  const double distance = fx * fx + fy * fy;
+  if (distance < match.distance) {
+    match.segment = i;
+    match.s = ss_[i] + t * ds_[i];
+    match.distance = distance;
+  }
+}
+
+TrackMatch TrackIndex::Nearest(double px, double py) const {
+  TrackMatch match{0, 0, std::numeric_limits<double>::infinity()};
+  long cx;
+  long cy;
+  Cell(px, py, cx, cy);
+  // A point in the grid is at least (r - 1) cells away from the cells
+  // beyond ring r - 1 of its own; outside, the clamping adds its distance
+  // to the grid, which only makes the bound safer
+  const long rings = std::max(nx_, ny_);
+  for (long r = 0; r <= rings; r++) {
+    for (long y = cy - r; y <= cy + r; y++) {
+      if (y < 0 || y >= ny_) {
+        continue;
+      }
+      const bool edge_row = y == cy - r || y == cy + r;
+      for (long x = cx - r; x <= cx + r; x += edge_row || r == 0 ? 1 : 2 * r) {
+        if (x < 0 || x >= nx_) {
+          continue;
+        }
+        const long c = y * nx_ + x;
+        for (size_t k = cell_start_[c]; k < cell_start_[c + 1]; k++) {
+          Match(cell_segments_[k], px, py, match);
+        }
+      }
+    }
+    if (match.distance <= r * r * cell_ * cell_) {
+      break;
+    }
+  }
+  match.distance = std::sqrt(match.distance);
+  return match;
+}
+
+TrackMatch TrackIndex::Track(double px, double py, const TrackMatch &last, size_t window) const {
+  TrackMatch match{0, 0, std::numeric_limits<double>::infinity()};
+  const size_t n = n_;
+  for (size_t k = 0; k <= 2 * window && k < n; k++) {
+    Match((last.segment + n - window % n + k) % n, px, py, match);
+  }
+  match.distance = std::sqrt(match.distance);
+  return match;
+}
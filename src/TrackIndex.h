@@ -0,0 +1,89 @@
+#ifndef TRACK_INDEX_H
+#define TRACK_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "TrackSpline.h"
+
+// The segment of the track nearest a point, and the distance along the
+// track and the distance from it of the nearest point of that segment
+struct TrackMatch {
+  size_t segment;
+  double s;
+  double distance;
+};
+
+// Nearest-segment queries against a TrackSpline, built once at startup.
+//
+// The track is sampled into straight segments of about spacing meters,
+// and the segments are binned into a uniform grid of cells of cell meters
+// over its bounding box, each segment into every cell its bounding box
+// touches. Nearest searches the cell of the point, then rings of cells
+// around it, until no segment further out can be nearer. Track searches
+// only the segments within window of the last match, which is what a
+// moving car needs between ticks; it is the caller's to fall back to
+// Nearest when that match is too far off, e.g. after the car was reset.
+//
+// The distances along the track are those of the segments' ends: exact at
+// the samples, within about spacing^2 times the curvature between them
+// (see TrackSpline::Project to refine them).
+//
+// Like those of TrackSpline, the arrays are blocks of the index's own or of
+// a file mapped by TrackMap.
+class TrackIndex {
+public:
+  explicit TrackIndex(const TrackSpline &track, double spacing = 1.0, double cell = 5.0);
+
+  // The arrays may be another's
+  TrackIndex(const TrackIndex &) = delete;
+  TrackIndex &operator=(const TrackIndex &) = delete;
+
+  TrackMatch Nearest(double px, double py) const;
+  TrackMatch Track(double px, double py, const TrackMatch &last, size_t window = 8) const;
+
+  size_t segments() const { return n_; }
+
+private:
+  friend class TrackMap;
+
+  TrackIndex() = default;
+
+  // Point the arrays into the blocks at segments, of the 7 arrays of the
+  // segments, and at grid, of cell_start_ then cell_segments_
+  void Bind(const double *segments, const uint32_t *grid);
+
+  // Nearest point of segment i to (px, py), into match if nearer than it,
+  // the distances squared
+  void Match(size_t i, double px, double py, TrackMatch &match) const;
+  // Cell of (px, py), clamped to the grid
+  void Cell(double px, double py, long &cx, long &cy) const;
+
+  double length_;
+  size_t n_;
+  // Start of every segment and the distance along the track there, the
+  // segment i ending at the start of i + 1 (wrapping around)
+  const double *xs_;
+  const double *ys_;
+  const double *ss_;
+  // Their vectors, the inverses of their squared lengths and their
+  // lengths along the track
+  const double *dxs_;
+  const double *dys_;
+  const double *inverse_lengths_;
+  const double *ds_;
+  // The grid: cell (cx, cy) holds the segments cell_segments_[k] for k in
+  // [cell_start_[c], cell_start_[c + 1]), c = cy * nx_ + cx
+  double x0_;
+  double y0_;
+  double cell_;
+  long nx_;
+  long ny_;
+  const uint32_t *cell_start_;
+  const uint32_t *cell_segments_;
+  // The blocks, unless they are another's
+  std::vector<double> segment_storage_;
+  std::vector<uint32_t> grid_storage_;
+};
+
+#endif /* TRACK_INDEX_H */
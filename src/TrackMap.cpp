@@ -0,0 +1,201 @@
+#include "TrackMap.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include "SharedArtifact.h"
+
+namespace {
+
+// Start of a map file, and the format version
+const char kMapMagic[8] = {'M', 'P', 'C', 'T', 'R', 'A', 'C', 'K'};
+const uint32_t kMapVersion = 1;
+// Written as is, read back another way round on a machine of the other
+// byte order
+const uint32_t kByteOrder = 0x01020304;
+// Alignment of the arrays in the file
+const uint64_t kMapAlignment = 64;
+
+struct MapHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  // Waypoints of the spline, segments of the index, cells of its grid and
+  // the segment entries of all the cells
+  uint64_t waypoints;
+  uint64_t segments;
+  uint64_t cell_entries;
+  int64_t nx;
+  int64_t ny;
+  double length;
+  double x0;
+  double y0;
+  double cell;
+  // Offsets from the start of the file of the block of the spline (5
+  // waypoints + 1 doubles), of the segments (7 segments doubles) and of
+  // the grid (nx ny + 1 + cell_entries uint32_t), and the size of the file
+  uint64_t spline_offset;
+  uint64_t segments_offset;
+  uint64_t grid_offset;
+  uint64_t size;
+};
+
+uint64_t Align(uint64_t offset) {
+  return (offset + kMapAlignment - 1) / kMapAlignment * kMapAlignment;
+}
+
+// Whether the array of bytes bytes at offset is aligned and within size
+bool Fits(uint64_t offset, uint64_t bytes, uint64_t size) {
+  return offset % kMapAlignment == 0 && offset <= size && bytes <= size - offset;
+}
+
+}  // namespace
+
+TrackMap::TrackMap(const std::vector<double> &xs, const std::vector<double> &ys,
+                   double spacing, double cell)
+    : spline_(new TrackSpline(xs, ys)), index_(new TrackIndex(*spline_, spacing, cell)) {}
+
+TrackMap::~TrackMap() {
+  // The spline and the index point into the mapping
+  spline_.reset();
+  index_.reset();
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+  }
+}
+
+bool TrackMap::Save(const std::string &path) const {
+  const TrackSpline &spline = *spline_;
+  const TrackIndex &index = *index_;
+  const uint64_t cells = index.nx_ * index.ny_;
+
+  MapHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kMapMagic, sizeof(header.magic));
+  header.version = kMapVersion;
+  header.byte_order = kByteOrder;
+  header.waypoints = spline.n_;
+  header.segments = index.n_;
+  header.cell_entries = index.cell_start_[cells];
+  header.nx = index.nx_;
+  header.ny = index.ny_;
+  header.length = index.length_;
+  header.x0 = index.x0_;
+  header.y0 = index.y0_;
+  header.cell = index.cell_;
+  const uint64_t spline_bytes = TrackSpline::BlockSize(spline.n_) * sizeof(double);
+  const uint64_t segments_bytes = 7 * index.n_ * sizeof(double);
+  const uint64_t grid_bytes = (cells + 1 + header.cell_entries) * sizeof(uint32_t);
+  header.spline_offset = Align(sizeof(header));
+  header.segments_offset = Align(header.spline_offset + spline_bytes);
+  header.grid_offset = Align(header.segments_offset + segments_bytes);
+  header.size = header.grid_offset + grid_bytes;
+
+  std::ofstream out(path.c_str(), std::ios::binary);
+  const char padding[kMapAlignment] = {};
+  uint64_t offset = 0;
+  // Each block after the padding up to its offset
+  const struct {
+    uint64_t offset;
+    const void *data;
+    uint64_t bytes;
+  } blocks[] = {{0, &header, sizeof(header)},
+                {header.spline_offset, spline.xs_, spline_bytes},
+                {header.segments_offset, index.xs_, segments_bytes},
+                {header.grid_offset, index.cell_start_, grid_bytes}};
+  for (const auto &block : blocks) {
+    out.write(padding, block.offset - offset);
+    out.write(static_cast<const char *>(block.data), block.bytes);
+    offset = block.offset + block.bytes;
+  }
+  return static_cast<bool>(out);
+}
+
+std::unique_ptr<TrackMap> TrackMap::Load(const std::string &path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return std::unique_ptr<TrackMap>();
+  }
+  struct stat status;
+  if (fstat(fd, &status) != 0 || static_cast<uint64_t>(status.st_size) < sizeof(MapHeader)) {
+    close(fd);
+    return std::unique_ptr<TrackMap>();
+  }
+  const size_t size = static_cast<size_t>(status.st_size);
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping holds the file open
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return std::unique_ptr<TrackMap>();
+  }
+  std::unique_ptr<TrackMap> map(new TrackMap());
+  map->mapping_ = mapping;
+  map->mapping_size_ = size;
+
+  const char *data = static_cast<const char *>(mapping);
+  MapHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, kMapMagic, sizeof(header.magic)) != 0 ||
+      header.version != kMapVersion || header.byte_order != kByteOrder ||
+      header.size != size || header.waypoints < 4 || header.segments < 3 || header.nx < 1 ||
+      header.ny < 1) {
+    return std::unique_ptr<TrackMap>();
+  }
+  // Every count below is of values of 4 bytes or more, so that none of the
+  // sizes of the arrays overflows
+  if (header.waypoints > size || header.segments > size || header.cell_entries > size ||
+      static_cast<uint64_t>(header.nx) > size || static_cast<uint64_t>(header.ny) > size ||
+      static_cast<uint64_t>(header.nx) * static_cast<uint64_t>(header.ny) > size) {
+    return std::unique_ptr<TrackMap>();
+  }
+  const uint64_t cells = static_cast<uint64_t>(header.nx) * static_cast<uint64_t>(header.ny);
+  if (!Fits(header.spline_offset, TrackSpline::BlockSize(header.waypoints) * sizeof(double),
+            size) ||
+      !Fits(header.segments_offset, 7 * header.segments * sizeof(double), size) ||
+      !Fits(header.grid_offset, (cells + 1 + header.cell_entries) * sizeof(uint32_t), size)) {
+    return std::unique_ptr<TrackMap>();
+  }
+
+  map->spline_.reset(new TrackSpline(
+      header.waypoints, reinterpret_cast<const double *>(data + header.spline_offset)));
+  TrackIndex *index = new TrackIndex();
+  map->index_.reset(index);
+  index->length_ = header.length;
+  index->n_ = header.segments;
+  index->x0_ = header.x0;
+  index->y0_ = header.y0;
+  index->cell_ = header.cell;
+  index->nx_ = header.nx;
+  index->ny_ = header.ny;
+  index->Bind(reinterpret_cast<const double *>(data + header.segments_offset),
+              reinterpret_cast<const uint32_t *>(data + header.grid_offset));
+  return map;
+}
+
+std::shared_ptr<const TrackMap> TrackMap::Share(const std::vector<double> &xs,
+                                                const std::vector<double> &ys,
+                                                const std::string &directory, std::string &error,
+                                                double spacing, double cell) {
+  // Everything the map depends on, as it is in memory
+  std::string source(reinterpret_cast<const char *>(&kMapVersion), sizeof(kMapVersion));
+  source.append(reinterpret_cast<const char *>(&spacing), sizeof(spacing));
+  source.append(reinterpret_cast<const char *>(&cell), sizeof(cell));
+  source.append(reinterpret_cast<const char *>(xs.data()), xs.size() * sizeof(double));
+  source.append(reinterpret_cast<const char *>(ys.data()), ys.size() * sizeof(double));
+  std::string path;
+  if (!ShareArtifact(directory, "track-" + ArtifactKey(source) + ".map",
+                     [&](const std::string &partial) {
+                       return TrackMap(xs, ys, spacing, cell).Save(partial);
+                     },
+                     path, error)) {
+    return std::shared_ptr<const TrackMap>();
+  }
+  std::shared_ptr<const TrackMap> map = Load(path);
+  if (!map) {
+    error = path + " isn't a track map";
+  }
+  return map;
+}
@@ -0,0 +1,65 @@
+#ifndef TRACK_MAP_H
+#define TRACK_MAP_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "TrackIndex.h"
+#include "TrackSpline.h"
+
+// A track with its spline and grid index (see TrackSpline and TrackIndex),
+// built from waypoints or mapped from a binary map file made by Save, e.g.
+// by ./convert_track from a csv of waypoints.
+//
+// The file holds a header, with the format version, the number of waypoints
+// and segments, the grid and the offsets of the arrays, then the arrays of
+// the spline and of the index as they are in memory, structures of arrays
+// aligned to 64 bytes. Load maps the file read only and points the spline
+// and the index into it, so that nothing is interpolated, sampled or copied
+// and the pages are only read as the queries touch them: loading takes the
+// same time for any size of track. Load checks the header and that the
+// arrays fit in the file, not the values in them, and takes files of the
+// byte order of the machine that wrote them only.
+//
+// Share makes the map of waypoints once per host, as an artifact the server
+// processes map (see SharedArtifact.h), for the tracks given as csv.
+class TrackMap {
+public:
+  // The track of the closed polygon xs, ys of at least 4 points, indexed by
+  // segments of spacing meters in cells of cell meters
+  TrackMap(const std::vector<double> &xs, const std::vector<double> &ys,
+           double spacing = 1.0, double cell = 5.0);
+  ~TrackMap();
+
+  TrackMap(const TrackMap &) = delete;
+  TrackMap &operator=(const TrackMap &) = delete;
+
+  bool Save(const std::string &path) const;
+  // Null if path can't be mapped or isn't a track map
+  static std::unique_ptr<TrackMap> Load(const std::string &path);
+  // The map of the track of xs, ys as of the constructor, saved once into
+  // an artifact of directory keyed by the waypoints and the grid, and
+  // mapped; null with the reason in error if it can't be
+  static std::shared_ptr<const TrackMap> Share(const std::vector<double> &xs,
+                                               const std::vector<double> &ys,
+                                               const std::string &directory, std::string &error,
+                                               double spacing = 1.0, double cell = 5.0);
+
+  const TrackSpline &spline() const { return *spline_; }
+  const TrackIndex &index() const { return *index_; }
+
+  // Whether the arrays are those of a mapped file
+  bool mapped() const { return mapping_ != nullptr; }
+
+private:
+  TrackMap() = default;
+
+  std::unique_ptr<TrackSpline> spline_;
+  std::unique_ptr<TrackIndex> index_;
+  // The mapped file, if any
+  void *mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+};
+
+#endif /* TRACK_MAP_H */
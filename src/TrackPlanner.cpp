@@ -0,0 +1,199 @@
+#include "TrackPlanner.h"
+#include <algorithm>
+#include <cmath>
+#include "KinematicModel.h"
+
+namespace {
+
+// Sweeps of projected Gauss-Seidel over the offsets, enough for the band
+// of the bends to settle to a millimeter
+const int kSweeps = 200;
+
+// Distance from start to s ahead along a loop of length, in [0, length)
+double Ahead(double start, double s, double length) {
+  const double d = std::fmod(s - start, length);
+  return d < 0 ? d + length : d;
+}
+
+// values at distance s of the plan, linear between its stations
+double Interpolate(const TrackPlan &plan, const std::array<double, TrackPlan::kStations> &values,
+                   double s, double length) {
+  if (plan.stations == 0) {
+    return 0;
+  }
+  const double at = Ahead(plan.start, s, length) / plan.step;
+  const size_t i = static_cast<size_t>(at);
+  if (i + 1 >= plan.stations) {
+    return values[plan.stations - 1];
+  }
+  const double t = at - i;
+  return values[i] + t * (values[i + 1] - values[i]);
+}
+
+}  // namespace
+
+bool TrackPlan::Covers(double s, double length) const {
+  return stations > 0 && Ahead(start, s, length) <= (stations - 1) * step;
+}
+
+double TrackPlan::OffsetAt(double s, double length) const {
+  return Interpolate(*this, offset, s, length);
+}
+
+double TrackPlan::SpeedAt(double s, double length) const {
+  return Interpolate(*this, speed, s, length);
+}
+
+TrackPlanner::TrackPlanner(std::shared_ptr<const TrackMap> track,
+                           std::chrono::milliseconds period, const PlannerLimits &limits)
+    : track_(std::move(track)), period_(period), limits_(limits) {
+  thread_ = std::thread(&TrackPlanner::Work, this);
+}
+
+TrackPlanner::~TrackPlanner() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  stop_.notify_all();
+  thread_.join();
+}
+
+void TrackPlanner::Request(const PlanRequest &request) {
+  PlanRequest &next = requests_.Back();
+  next = request;
+  next.sequence = ++sequence_;
+  requests_.Publish();
+}
+
+const TrackPlan &TrackPlanner::Latest() {
+  plans_made_.Update();
+  return plans_made_.Front();
+}
+
+void TrackPlanner::Work() {
+  uint64_t version = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (stop_.wait_for(lock, period_, [this] { return stopping_; })) {
+        return;
+      }
+    }
+    // Nothing to plan for until the car moves on
+    if (!requests_.Update()) {
+      continue;
+    }
+    const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    TrackPlan &plan = plans_made_.Back();
+    Plan(track_->spline(), requests_.Front(), limits_, plan);
+    plan.version = ++version;
+    plan.seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    plans_made_.Publish();
+    plans_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void TrackPlanner::Plan(const TrackSpline &spline, const PlanRequest &request,
+                        const PlannerLimits &limits, TrackPlan &plan) {
+  const size_t m = TrackPlan::kStations;
+  plan.start = request.progress;
+  plan.stations = m;
+  // The center line and its unit normal to the left at each station
+  double cx[m], cy[m], nx[m], ny[m];
+  for (size_t i = 0; i < m; i++) {
+    const TrackPoint p = spline.At(plan.start + i * plan.step);
+    const double norm = std::max(std::hypot(p.dx, p.dy), 1e-9);
+    cx[i] = p.x;
+    cy[i] = p.y;
+    nx[i] = -p.dy / norm;
+    ny[i] = p.dx / norm;
+  }
+
+  // The second difference of the line at station i is that of the center
+  // line plus the normals of i - 1, i, i + 1 times 1, -2, 1 times their
+  // offsets: its square summed over the stations is n' H n + 2 g' n plus
+  // a constant, H a band of 2 on either side of the diagonal, held as its
+  // diagonal and the two above it
+  double band[m][3] = {};
+  double g[m] = {};
+  const double weights[3] = {1, -2, 1};
+  for (size_t i = 1; i + 1 < m; i++) {
+    const double dx = cx[i - 1] - 2 * cx[i] + cx[i + 1];
+    const double dy = cy[i - 1] - 2 * cy[i] + cy[i + 1];
+    for (size_t a = 0; a < 3; a++) {
+      const size_t j = i - 1 + a;
+      const double ax = weights[a] * nx[j];
+      const double ay = weights[a] * ny[j];
+      g[j] += ax * dx + ay * dy;
+      for (size_t b = a; b < 3; b++) {
+        const size_t k = i - 1 + b;
+        band[j][k - j] += ax * weights[b] * nx[k] + ay * weights[b] * ny[k];
+      }
+    }
+  }
+  for (size_t j = 0; j < m; j++) {
+    band[j][0] += limits.offset_weight;
+  }
+
+  // Minimized over the box by projected Gauss-Seidel, from the car's offset
+  // held at the first station and the center line past it
+  const double w = limits.half_width;
+  std::array<double, TrackPlan::kStations> &n = plan.offset;
+  n.fill(0);
+  n[0] = std::max(-w, std::min(w, request.offset));
+  for (int sweep = 0; sweep < kSweeps; sweep++) {
+    for (size_t j = 1; j < m; j++) {
+      double sum = g[j];
+      for (size_t k = j >= 2 ? j - 2 : 0; k < j; k++) {
+        sum += band[k][j - k] * n[k];
+      }
+      for (size_t k = j + 1; k < std::min(m, j + 3); k++) {
+        sum += band[j][k - j] * n[k];
+      }
+      n[j] = std::max(-w, std::min(w, -sum / band[j][0]));
+    }
+  }
+
+  // The line, the length of its pieces, and its curvature at each station
+  // through the circle of it and its neighbours
+  double px[m], py[m], pieces[m], curvature[m];
+  for (size_t i = 0; i < m; i++) {
+    px[i] = cx[i] + n[i] * nx[i];
+    py[i] = cy[i] + n[i] * ny[i];
+  }
+  for (size_t i = 0; i + 1 < m; i++) {
+    pieces[i] = std::hypot(px[i + 1] - px[i], py[i + 1] - py[i]);
+  }
+  for (size_t i = 1; i + 1 < m; i++) {
+    const double ax = px[i] - px[i - 1];
+    const double ay = py[i] - py[i - 1];
+    const double bx = px[i + 1] - px[i];
+    const double by = py[i + 1] - py[i];
+    const double chord = std::hypot(px[i + 1] - px[i - 1], py[i + 1] - py[i - 1]);
+    const double denominator = pieces[i - 1] * pieces[i] * chord;
+    curvature[i] = denominator > 1e-12 ? 2 * std::fabs(ax * by - ay * bx) / denominator : 0;
+  }
+  curvature[0] = curvature[1];
+  curvature[m - 1] = curvature[m - 2];
+
+  // The speeds in m/s: the corners' and the top speed, then the forward
+  // pass of the acceleration and the backward pass of the braking. The
+  // first station isn't held to the car's speed, so that the MPC of a car
+  // standing still is still asked to move off.
+  std::array<double, TrackPlan::kStations> &v = plan.speed;
+  const double top = std::max(request.top_speed, 0.0) * kMphToMs;
+  for (size_t i = 0; i < m; i++) {
+    v[i] = curvature[i] > 1e-9 ? std::min(top, std::sqrt(limits.lateral / curvature[i])) : top;
+  }
+  for (size_t i = 0; i + 1 < m; i++) {
+    v[i + 1] = std::min(v[i + 1], std::sqrt(v[i] * v[i] + 2 * limits.accelerate * pieces[i]));
+  }
+  for (size_t i = m - 1; i > 0; i--) {
+    v[i - 1] = std::min(v[i - 1], std::sqrt(v[i] * v[i] + 2 * limits.brake * pieces[i - 1]));
+  }
+  for (size_t i = 0; i < m; i++) {
+    v[i] /= kMphToMs;
+  }
+}
@@ -0,0 +1,133 @@
+#ifndef TRACK_PLANNER_H
+#define TRACK_PLANNER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "CacheLine.h"
+#include "Mailbox.h"
+#include "TrackMap.h"
+
+// The upper level of a two-level controller: a plan of the track far ahead
+// of the car, a racing line and the speed along it, made at a low rate on a
+// thread of its own, for the MPC of every tick to track over its short
+// horizon (see TrackPlanner).
+struct TrackPlan {
+  // Stations every step meters along the track from start, the car's
+  // progress when the plan was made
+  static const size_t kStations = 64;
+
+  double start = 0;
+  double step = 5;
+  size_t stations = 0;
+  // Left of the center line in m, and the speed there in mph, like the
+  // state of the MPC
+  std::array<double, kStations> offset{};
+  std::array<double, kStations> speed{};
+  // From 1 for the first plan, 0 for none yet
+  uint64_t version = 0;
+  // How long it took to make, in seconds
+  double seconds = 0;
+
+  // Whether the distance s along a track of length covers the stations
+  bool Covers(double s, double length) const;
+  // The offset and the speed at distance s, linear between the stations
+  // and held past the last
+  double OffsetAt(double s, double length) const;
+  double SpeedAt(double s, double length) const;
+};
+
+// Where the car is for the next plan, from the fast loop
+struct PlanRequest {
+  double progress = 0;
+  // Left of the center line, in m
+  double offset = 0;
+  // The top speed, in mph: the reference speed of the cost
+  double top_speed = 0;
+  uint64_t sequence = 0;
+};
+
+// The limits the plan keeps to, of the kinematic model as a point mass
+struct PlannerLimits {
+  // Of the line from the center line either way, in m
+  double half_width = 2;
+  // Of the accelerations, in m/s^2: sideways in a corner, speeding up and
+  // braking
+  double lateral = 4;
+  double accelerate = 3;
+  double brake = 6;
+  // Weight of the offset against the bends of the line
+  double offset_weight = 1e-3;
+};
+
+// Plans the track from the car at period on a thread of its own, for the
+// MPC of the car to track at its own rate: the slow, long look-ahead half
+// of a hierarchical controller, while the fast loop keeps the short
+// horizon it solves every tick.
+//
+// Each plan is made over the kStations stations ahead of the latest
+// request. The racing line is the offset at each station, within
+// half_width of the center line, that least bends the line: the squared
+// second differences of its points, linear in the offsets, plus a small
+// weight on the offsets, a box-constrained least squares solved by
+// projected Gauss-Seidel, with the first offset held at the car's. The
+// speed is then the fastest profile along the line within the limits: at
+// most the top speed and the speed of the lateral limit in the curvature
+// of the line at each station, reached from the slower stations before by
+// the forward pass of the acceleration limit and left in time for the next
+// corner by the backward pass of the braking one, which for a point mass
+// is the minimum time profile.
+//
+// The requests and the plans change hands through triple buffers (see
+// LatestValue in Mailbox.h): Request and Latest never wait for the planner
+// thread or allocate, whatever it is doing, and the planner never waits
+// for the fast loop. Request and Latest are called from one thread at a
+// time.
+class TrackPlanner {
+public:
+  MPC_CACHE_LINE_OPERATOR_NEW
+
+  TrackPlanner(std::shared_ptr<const TrackMap> track, std::chrono::milliseconds period,
+               const PlannerLimits &limits = PlannerLimits());
+  // Stops and joins the planner thread
+  ~TrackPlanner();
+  TrackPlanner(const TrackPlanner &) = delete;
+  TrackPlanner &operator=(const TrackPlanner &) = delete;
+
+  // Plan from request at the next period
+  void Request(const PlanRequest &request);
+  // The latest plan, of version 0 until there is one
+  const TrackPlan &Latest();
+
+  const TrackMap *track() const { return track_.get(); }
+  // Plans made so far, from any thread
+  uint64_t plans() const { return plans_.load(std::memory_order_relaxed); }
+
+  // Plan from request on the calling thread into plan
+  static void Plan(const TrackSpline &spline, const PlanRequest &request,
+                   const PlannerLimits &limits, TrackPlan &plan);
+
+private:
+  void Work();
+
+  const std::shared_ptr<const TrackMap> track_;
+  const std::chrono::milliseconds period_;
+  const PlannerLimits limits_;
+  LatestValue<PlanRequest> requests_;
+  LatestValue<TrackPlan> plans_made_;
+  std::atomic<uint64_t> plans_{0};
+  uint64_t sequence_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable stop_;
+  bool stopping_ = false;
+  std::thread thread_;
+};
+
+#endif /* TRACK_PLANNER_H */
@@ -0,0 +1,156 @@
+#include "TrackSolutionCache.h"
+#include <algorithm>
+#include <cmath>
+
+// Of the key of a bin, spread over the bits of the table index
+static size_t Hash(int64_t station, int64_t speed) {
+  uint64_t h = static_cast<uint64_t>(station) * 0x9E3779B97F4A7C15ULL;
+  h ^= static_cast<uint64_t>(speed) * 0xC2B2AE3D27D4EB4FULL;
+  return static_cast<size_t>(h ^ (h >> 29));
+}
+
+const size_t TrackSolutionCache::kNone;
+
+TrackSolutionCache::TrackSolutionCache(size_t capacity, size_t actuations, double bin_length,
+                                       double bin_speed)
+    : capacity_(std::max<size_t>(capacity, 1)),
+      actuations_(actuations),
+      bin_length_(bin_length),
+      bin_speed_(bin_speed),
+      entries_(capacity_),
+      values_(capacity_ * actuations) {
+  size_t slots = 1;
+  while (slots < 2 * capacity_) {
+    slots *= 2;
+  }
+  table_.assign(slots, kNone);
+}
+
+size_t TrackSolutionCache::bytes() const {
+  return sizeof(*this) + entries_.size() * sizeof(Entry) + values_.size() * sizeof(double) +
+         table_.size() * sizeof(size_t);
+}
+
+size_t TrackSolutionCache::Probe(int64_t station, int64_t speed) const {
+  const size_t mask = table_.size() - 1;
+  size_t slot = Hash(station, speed) & mask;
+  // Never full, the table has twice the slots of the entries
+  while (table_[slot] != kNone) {
+    const Entry &entry = entries_[table_[slot]];
+    if (entry.station == station && entry.speed == speed) {
+      return slot;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+size_t TrackSolutionCache::Lookup(int64_t station, int64_t speed) const {
+  return table_[Probe(station, speed)];
+}
+
+void TrackSolutionCache::Erase(size_t slot) {
+  const size_t mask = table_.size() - 1;
+  table_[slot] = kNone;
+  for (size_t next = (slot + 1) & mask; table_[next] != kNone; next = (next + 1) & mask) {
+    const Entry &entry = entries_[table_[next]];
+    const size_t home = Hash(entry.station, entry.speed) & mask;
+    // Move it into the hole unless its home lies cyclically in (slot, next]
+    const bool stays =
+        slot <= next ? (slot < home && home <= next) : (slot < home || home <= next);
+    if (!stays) {
+      table_[slot] = table_[next];
+      table_[next] = kNone;
+      slot = next;
+    }
+  }
+}
+
+void TrackSolutionCache::Unlink(size_t entry) {
+  Entry &e = entries_[entry];
+  if (e.newer != kNone) {
+    entries_[e.newer].older = e.older;
+  } else {
+    newest_ = e.older;
+  }
+  if (e.older != kNone) {
+    entries_[e.older].newer = e.newer;
+  } else {
+    oldest_ = e.newer;
+  }
+  e.newer = e.older = kNone;
+}
+
+void TrackSolutionCache::Touch(size_t entry) {
+  if (entry == newest_) {
+    return;
+  }
+  // Linked unless new, and then not the newest
+  if (entries_[entry].newer != kNone) {
+    Unlink(entry);
+  }
+  Entry &e = entries_[entry];
+  e.older = newest_;
+  if (newest_ != kNone) {
+    entries_[newest_].newer = entry;
+  }
+  newest_ = entry;
+  if (oldest_ == kNone) {
+    oldest_ = entry;
+  }
+}
+
+void TrackSolutionCache::Insert(double progress, double v, const double *actuations) {
+  if (progress < 0) {
+    return;
+  }
+  const int64_t station = static_cast<int64_t>(std::floor(progress / bin_length_));
+  const int64_t speed = static_cast<int64_t>(std::floor(v / bin_speed_));
+  size_t slot = Probe(station, speed);
+  size_t entry = table_[slot];
+  if (entry == kNone) {
+    if (size_ < capacity_) {
+      entry = size_++;
+    } else {
+      // The least recently used bin makes way
+      entry = oldest_;
+      const Entry &old = entries_[entry];
+      Erase(Probe(old.station, old.speed));
+      slot = Probe(station, speed);
+    }
+    entries_[entry].station = station;
+    entries_[entry].speed = speed;
+    table_[slot] = entry;
+  }
+  std::copy(actuations, actuations + actuations_, values_.begin() + entry * actuations_);
+  Touch(entry);
+}
+
+void TrackSolutionCache::Save(std::vector<double> &out) const {
+  for (size_t entry = oldest_; entry != kNone; entry = entries_[entry].newer) {
+    const Entry &e = entries_[entry];
+    out.push_back((e.station + 0.5) * bin_length_);
+    out.push_back((e.speed + 0.5) * bin_speed_);
+    const double *values = values_.data() + entry * actuations_;
+    out.insert(out.end(), values, values + actuations_);
+  }
+}
+
+const double *TrackSolutionCache::Find(double progress, double v) {
+  if (progress < 0 || size_ == 0) {
+    return nullptr;
+  }
+  const int64_t station = static_cast<int64_t>(std::floor(progress / bin_length_));
+  const double bins = v / bin_speed_;
+  const int64_t speed = static_cast<int64_t>(std::floor(bins));
+  // The nearer neighbour first
+  const int64_t side = bins - speed < 0.5 ? -1 : 1;
+  for (int64_t bin : {speed, speed + side, speed - side}) {
+    const size_t entry = Lookup(station, bin);
+    if (entry != kNone) {
+      Touch(entry);
+      return values_.data() + entry * actuations_;
+    }
+  }
+  return nullptr;
+}
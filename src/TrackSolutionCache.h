@@ -0,0 +1,88 @@
+#ifndef TRACK_SOLUTION_CACHE_H
+#define TRACK_SOLUTION_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bounded store of converged plans by where on a closed track they were
+// solved, for warm starting the laps after: the actuations of a plan under
+// the bin of the car's progress along the track and the bin of its speed.
+//
+// Every lap passes the same corners at much the same speeds, so the plan of
+// the bin the car is in is a good start wherever the shifted plan of the
+// last tick isn't, e.g. back on the line after leaving it. Unlike
+// SolutionDatabase, whose keys are the errors of the car to the reference
+// and so alike on every straight, the key tells the corners apart. The
+// actuations are frame free, an MPC rolls them out from its own state (see
+// MPC::Solve).
+//
+// Once full, the bin used least recently is replaced: a session that
+// drives only part of the track keeps the bins of that part. The memory is
+// taken whole on construction, a slot of actuations per entry and a hash
+// table of twice as many indices, so that Insert and Find never allocate
+// on the control path.
+class TrackSolutionCache {
+public:
+  // Up to capacity plans of actuations values each, in bins of bin_length
+  // meters of progress and bin_speed mph
+  TrackSolutionCache(size_t capacity, size_t actuations, double bin_length = 5,
+                     double bin_speed = 5);
+
+  // Keep the actuations of a plan solved at progress m along the track and
+  // v mph, in place of those of its bin. Nothing for a negative progress.
+  void Insert(double progress, double v, const double *actuations);
+
+  // The actuations of the bin of progress and v, or else of the speed bins
+  // either side of it, as most recently used; null when there are none.
+  // Valid until the next Insert.
+  const double *Find(double progress, double v);
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  size_t actuations() const { return actuations_; }
+
+  // Append every entry to out, the least recently used first, as the
+  // progress and speed of the middle of its bin then its actuations, for a
+  // snapshot: inserted again in that order they make the same cache
+  void Save(std::vector<double> &out) const;
+  // What it holds in memory, for SolverFootprint
+  size_t bytes() const;
+
+private:
+  static const size_t kNone = static_cast<size_t>(-1);
+
+  struct Entry {
+    int64_t station = 0;
+    int64_t speed = 0;
+    // Neighbours in the order of use, kNone at the ends
+    size_t newer = kNone;
+    size_t older = kNone;
+  };
+
+  // Slot in table_ of the key, or of the empty slot it would go in
+  size_t Probe(int64_t station, int64_t speed) const;
+  // Entry of the key, kNone if there is none
+  size_t Lookup(int64_t station, int64_t speed) const;
+  // Take the key of slot out of table_, moving back the entries probed past
+  // it so that none is lost
+  void Erase(size_t slot);
+  // Make entry the most recently used
+  void Unlink(size_t entry);
+  void Touch(size_t entry);
+
+  const size_t capacity_;
+  const size_t actuations_;
+  const double bin_length_;
+  const double bin_speed_;
+  std::vector<Entry> entries_;
+  // The actuations of entry k from k * actuations_
+  std::vector<double> values_;
+  // Open addressing with linear probing, a power of two of entry indices
+  std::vector<size_t> table_;
+  size_t size_ = 0;
+  size_t newest_ = kNone;
+  size_t oldest_ = kNone;
+};
+
+#endif /* TRACK_SOLUTION_CACHE_H */
@@ -0,0 +1,202 @@
+#include "TrackSpline.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include "Eigen-3.3/Eigen/Dense"
+
+namespace {
+
+// Passes of replacing the parameter by the arc length
+const int kArcLengthPasses = 4;
+// Newton steps of Project, and the step below which it stops
+const int kProjectIterations = 8;
+const double kProjectTolerance = 1e-9;
+
+// Value and derivatives at t in a segment of length h between the values
+// y0, y1 with the second derivatives m0, m1
+void Cubic(double y0, double y1, double m0, double m1, double h, double t, double *d) {
+  const double u = h - t;
+  const double a = y0 / h - m0 * h / 6;
+  const double b = y1 / h - m1 * h / 6;
+  d[0] = m0 * u * u * u / (6 * h) + m1 * t * t * t / (6 * h) + a * u + b * t;
+  d[1] = -m0 * u * u / (2 * h) + m1 * t * t / (2 * h) - a + b;
+  d[2] = (m0 * u + m1 * t) / h;
+  d[3] = (m1 - m0) / h;
+}
+
+}  // namespace
+
+bool TrackSpline::Load(const std::string &path, std::vector<double> &xs,
+                       std::vector<double> &ys) {
+  std::ifstream in(path.c_str());
+  std::string line;
+  std::getline(in, line);  // header
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    double x;
+    double y;
+    char comma;
+    if (fields >> x >> comma >> y) {
+      xs.push_back(x);
+      ys.push_back(y);
+    }
+  }
+  return xs.size() >= 4;
+}
+
+TrackSpline::TrackSpline(size_t n, const double *data) : n_(n) { Bind(data); }
+
+TrackSpline::TrackSpline(const std::vector<double> &xs, const std::vector<double> &ys)
+    : n_(xs.size()), storage_(BlockSize(xs.size()), 0.0) {
+  const size_t n = n_;
+  std::copy(xs.begin(), xs.end(), storage_.begin());
+  std::copy(ys.begin(), ys.end(), storage_.begin() + n);
+  Bind(&storage_[0]);
+  double *knots = &storage_[2 * n];
+  for (size_t i = 0; i < n; i++) {
+    const size_t j = (i + 1) % n;
+    knots[i + 1] = knots[i] + std::hypot(xs_[j] - xs_[i], ys_[j] - ys_[i]);
+  }
+  Interpolate();
+
+  // Arc length of every segment by 5 point Gauss-Legendre, then the spline
+  // again over those
+  const double nodes[5] = {-0.9061798459386640, -0.5384693101056831, 0.0, 0.5384693101056831,
+                           0.9061798459386640};
+  const double weights[5] = {0.2369268850561891, 0.4786286704993665, 0.5688888888888889,
+                             0.4786286704993665, 0.2369268850561891};
+  for (int pass = 0; pass < kArcLengthPasses; pass++) {
+    std::vector<double> knots(n + 1, 0.0);
+    for (size_t i = 0; i < n; i++) {
+      const double h = knots_[i + 1] - knots_[i];
+      double length = 0;
+      for (int k = 0; k < 5; k++) {
+        const TrackPoint p = At(knots_[i] + 0.5 * h * (1 + nodes[k]));
+        length += weights[k] * std::hypot(p.dx, p.dy);
+      }
+      knots[i + 1] = knots[i] + 0.5 * h * length;
+    }
+    std::copy(knots.begin(), knots.end(), &storage_[2 * n]);
+    Interpolate();
+  }
+}
+
+void TrackSpline::Bind(const double *data) {
+  xs_ = data;
+  ys_ = xs_ + n_;
+  knots_ = ys_ + n_;
+  mx_ = knots_ + n_ + 1;
+  my_ = mx_ + n_;
+}
+
+void TrackSpline::Interpolate() {
+  // Periodic spline: for every waypoint i, with h the lengths of the
+  // segments before and after it,
+  // h0 m[i-1] + 2 (h0 + h1) m[i] + h1 m[i+1] = 6 (slope after - slope before)
+  const size_t n = n_;
+  Eigen::MatrixXd A = Eigen::MatrixXd::Zero(n, n);
+  Eigen::MatrixXd rhs(n, 2);
+  for (size_t i = 0; i < n; i++) {
+    const size_t prev = (i + n - 1) % n;
+    const size_t next = (i + 1) % n;
+    const double h0 = i > 0 ? knots_[i] - knots_[i - 1] : knots_[n] - knots_[n - 1];
+    const double h1 = knots_[i + 1] - knots_[i];
+    A(i, prev) += h0;
+    A(i, i) += 2 * (h0 + h1);
+    A(i, next) += h1;
+    rhs(i, 0) = 6 * ((xs_[next] - xs_[i]) / h1 - (xs_[i] - xs_[prev]) / h0);
+    rhs(i, 1) = 6 * ((ys_[next] - ys_[i]) / h1 - (ys_[i] - ys_[prev]) / h0);
+  }
+  const Eigen::MatrixXd m = A.partialPivLu().solve(rhs);
+  std::copy(m.col(0).data(), m.col(0).data() + n, &storage_[3 * n + 1]);
+  std::copy(m.col(1).data(), m.col(1).data() + n, &storage_[4 * n + 1]);
+}
+
+double TrackSpline::Wrap(double s) const {
+  s = std::fmod(s, length());
+  return s < 0 ? s + length() : s;
+}
+
+size_t TrackSpline::Segment(double s) const {
+  const size_t i = std::upper_bound(knots_, knots_ + n_ + 1, s) - knots_;
+  return std::min(i == 0 ? 0 : i - 1, n_ - 1);
+}
+
+TrackPoint TrackSpline::At(double s) const {
+  s = Wrap(s);
+  const size_t i = Segment(s);
+  const size_t j = (i + 1) % n_;
+  const double h = knots_[i + 1] - knots_[i];
+  const double t = s - knots_[i];
+  double dx[4];
+  double dy[4];
+  Cubic(xs_[i], xs_[j], mx_[i], mx_[j], h, t, dx);
+  Cubic(ys_[i], ys_[j], my_[i], my_[j], h, t, dy);
+  return TrackPoint{dx[0], dy[0], dx[1], dy[1], dx[2], dy[2], dx[3], dy[3]};
+}
+
+double TrackSpline::Project(double px, double py, double s_guess) const {
+  double s = s_guess;
+  if (s < 0) {
+    double best = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < n_; i++) {
+      const double d = std::hypot(xs_[i] - px, ys_[i] - py);
+      if (d < best) {
+        best = d;
+        s = knots_[i];
+      }
+    }
+  }
+
+  // Newton on the half squared distance
+  for (int k = 0; k < kProjectIterations; k++) {
+    const TrackPoint p = At(s);
+    const double ex = p.x - px;
+    const double ey = p.y - py;
+    const double gradient = ex * p.dx + ey * p.dy;
+    double curvature = p.dx * p.dx + p.dy * p.dy + ex * p.ddx + ey * p.ddy;
+    if (curvature <= 0) {
+      // Far off the inside of a bend: a gradient step instead
+      curvature = p.dx * p.dx + p.dy * p.dy;
+    }
+    const double step = gradient / curvature;
+    s = Wrap(s - step);
+    if (std::fabs(step) < kProjectTolerance) {
+      break;
+    }
+  }
+  return s;
+}
+
+MPCCoeffs TrackSpline::LocalReference(double px, double py, double psi, double s,
+                                      double look_ahead) const {
+  const double c = std::cos(psi);
+  const double sn = std::sin(psi);
+  // The ends of the stretch at s and s + look_ahead in the vehicle frame, x
+  // ahead and y to the left, and the slopes dy / dx of the track there
+  double x[2];
+  double y[2];
+  double slope[2];
+  for (int k = 0; k < 2; k++) {
+    const TrackPoint p = At(s + k * look_ahead);
+    x[k] = (p.x - px) * c + (p.y - py) * sn;
+    y[k] = (p.y - py) * c - (p.x - px) * sn;
+    slope[k] = (p.dy * c - p.dx * sn) / (p.dx * c + p.dy * sn);
+  }
+
+  // The Hermite cubic through both, in powers of t = x - x[0], then of x by
+  // synthetic division
+  const double h = x[1] - x[0];
+  const double secant = (y[1] - y[0]) / h;
+  MPCCoeffs coeffs;
+  coeffs << y[0], slope[0], (3 * secant - 2 * slope[0] - slope[1]) / h,
+      (slope[0] + slope[1] - 2 * secant) / (h * h);
+  for (int k = 0; k < 3; k++) {
+    for (int i = 2; i >= k; i--) {
+      coeffs(i) -= x[0] * coeffs(i + 1);
+    }
+  }
+  return coeffs;
+}
@@ -0,0 +1,103 @@
+#ifndef TRACK_SPLINE_H
+#define TRACK_SPLINE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "Horizon.h"
+
+// A point of the track and its first three derivatives by the distance
+// along it (see TrackSpline): the tangent, about a unit vector, the
+// curvature vector and its rate of change
+struct TrackPoint {
+  double x;
+  double y;
+  double dx;
+  double dy;
+  double ddx;
+  double ddy;
+  double dddx;
+  double dddy;
+};
+
+// The closed track through the waypoints of a file such as
+// lake_track_waypoints.csv, as a periodic cubic spline of x and y over the
+// distance along it, built once at startup.
+//
+// The spline interpolates the waypoints with continuous curvature across
+// them and around the loop. Its parameter starts as the chord lengths
+// between waypoints and is replaced by the arc lengths of the spline a few
+// times over, after which it is the arc length to about 1e-6 of a segment.
+//
+// LocalReference gives the cubic the MPC takes (see MPCBase::Solve) from
+// the track instead of a fit of waypoints, as y of x in the vehicle frame
+// over the stretch ahead of the point nearest the vehicle. A query costs
+// binary searches over the segments and a few Newton steps of the
+// projection, started from the progress of the last query.
+//
+// The arrays of the spline are one block of doubles, its own or one that
+// outlives it, e.g. in a file mapped by TrackMap.
+class TrackSpline {
+public:
+  // The waypoints of the csv file at path (a header line, then x,y per
+  // line); false if it has fewer than 4
+  static bool Load(const std::string &path, std::vector<double> &xs, std::vector<double> &ys);
+
+  // The spline through the closed polygon xs, ys of at least 4 points
+  TrackSpline(const std::vector<double> &xs, const std::vector<double> &ys);
+
+  // The arrays may be another's
+  TrackSpline(const TrackSpline &) = delete;
+  TrackSpline &operator=(const TrackSpline &) = delete;
+
+  double length() const { return knots_[n_]; }
+  size_t waypoints() const { return n_; }
+
+  // The point at distance s along the track, wrapped to [0, length())
+  TrackPoint At(double s) const;
+
+  // Distance along the track of the point nearest (px, py), by Newton steps
+  // from s_guess when it is given (>= 0), e.g. from a TrackIndex, else from
+  // the nearest waypoint
+  double Project(double px, double py, double s_guess = -1) const;
+
+  // The cubic y(x) of the track in the frame of the vehicle at (px, py)
+  // heading psi, from the distance s along it (see Project) to look_ahead
+  // further: the cubic with the position and slope of the track at both
+  // ends. Like a fit of waypoints, it needs the track ahead of the vehicle
+  // to run along its x axis rather than across it.
+  MPCCoeffs LocalReference(double px, double py, double psi, double s,
+                           double look_ahead = 30) const;
+
+private:
+  friend class TrackMap;
+
+  // The spline of n waypoints over the block at data, see Bind
+  TrackSpline(size_t n, const double *data);
+
+  // Doubles in the block of n waypoints
+  static size_t BlockSize(size_t n) { return 5 * n + 1; }
+  // Point the arrays into the block at data: xs_, ys_, knots_, mx_, my_
+  void Bind(const double *data);
+
+  // Fit the splines through the waypoints at the distances knots_, into
+  // mx_ and my_ of storage_
+  void Interpolate();
+  // Segment of s in [0, length())
+  size_t Segment(double s) const;
+  double Wrap(double s) const;
+
+  size_t n_;
+  const double *xs_;
+  const double *ys_;
+  // Distance along the track of each waypoint, and the length of the loop
+  // last (n_ + 1 values)
+  const double *knots_;
+  // Second derivatives of x and y at the waypoints
+  const double *mx_;
+  const double *my_;
+  // The block, unless it is another's
+  std::vector<double> storage_;
+};
+
+#endif /* TRACK_SPLINE_H */
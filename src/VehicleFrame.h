@@ -0,0 +1,56 @@
+#ifndef VEHICLE_FRAME_H
+#define VEHICLE_FRAME_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include "Eigen-3.3/Eigen/Core"
+#include "Polynomial.h"
+
+// Transform the n points (xs, ys) of the map frame into the frame of a
+// vehicle at (px, py) heading psi, x ahead and y to the left, writing them
+// to (out_x, out_y), which may be xs and ys themselves.
+//
+// The rotation is computed once and applied to the coordinate arrays a
+// block of points at a time: each block is translated into arrays on the
+// stack, then rotated over SIMD lanes into the outputs, as wide as the host
+// has (see RotatePoints of SimdKernels.h), so that the transform works in
+// place and on the track map or the waypoints of many vehicles alike
+// without allocating.
+inline void ToVehicleFrame(double px, double py, double psi, const double *xs, const double *ys,
+                           size_t n, double *out_x, double *out_y) {
+  RotatePoints(px, py, std::cos(psi), std::sin(psi), xs, ys, n, out_x, out_y);
+}
+
+// Transform the n > Order waypoints (xs, ys) into the vehicle frame like
+// ToVehicleFrame and fit a polynomial of order Order to them like polyfit,
+// in one pass: each point is transformed, written out (in place if out_x
+// and out_y are xs and ys) and added to the normal equations in turn. The
+// abscissae are normalized by those of the first and the last waypoint,
+// which bound the others closely enough on a road ahead (see
+// PolyfitNormalEquations), without a pass for their range.
+template <int Order>
+inline Eigen::Matrix<double, Order + 1, 1> FitInVehicleFrame(double px, double py, double psi,
+                                                             const double *xs, const double *ys,
+                                                             int n, double *out_x,
+                                                             double *out_y) {
+  assert(n > Order);
+  const double c = std::cos(psi);
+  const double s = std::sin(psi);
+  const double first = (xs[0] - px) * c + (ys[0] - py) * s;
+  const double last = (xs[n - 1] - px) * c + (ys[n - 1] - py) * s;
+  const double half_width = 0.5 * std::fabs(last - first);
+  PolyfitNormalEquations<Order> normal(0.5 * (first + last),
+                                       half_width > 1e-6 ? half_width : 1.0);
+  for (int j = 0; j < n; j++) {
+    const double dx = xs[j] - px;
+    const double dy = ys[j] - py;
+    out_x[j] = dx * c + dy * s;
+    out_y[j] = dy * c - dx * s;
+    normal.Add(out_x[j], out_y[j]);
+  }
+  return normal.Solve();
+}
+
+#endif /* VEHICLE_FRAME_H */
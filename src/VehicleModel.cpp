@@ -0,0 +1,115 @@
+#include "VehicleModel.h"
+#include <cmath>
+#include "KinematicModel.h"
+
+namespace {
+
+// The operations of the Counted values so far
+StageOps counted;
+
+// A double that counts the operations on it into counted
+struct Counted {
+  Counted(double value = 0) : value(value) {}
+
+  Counted &operator+=(const Counted &b) {
+    counted.arithmetic++;
+    value += b.value;
+    return *this;
+  }
+  Counted &operator-=(const Counted &b) {
+    counted.arithmetic++;
+    value -= b.value;
+    return *this;
+  }
+  Counted &operator*=(const Counted &b) {
+    counted.arithmetic++;
+    value *= b.value;
+    return *this;
+  }
+  Counted &operator/=(const Counted &b) {
+    counted.arithmetic++;
+    value /= b.value;
+    return *this;
+  }
+
+  double value;
+};
+
+Counted operator+(Counted a, const Counted &b) { return a += b; }
+Counted operator-(Counted a, const Counted &b) { return a -= b; }
+Counted operator*(Counted a, const Counted &b) { return a *= b; }
+Counted operator/(Counted a, const Counted &b) { return a /= b; }
+Counted operator-(const Counted &a) {
+  counted.arithmetic++;
+  return Counted(-a.value);
+}
+
+Counted cos(const Counted &x) {
+  counted.transcendental++;
+  return Counted(std::cos(x.value));
+}
+Counted sin(const Counted &x) {
+  counted.transcendental++;
+  return Counted(std::sin(x.value));
+}
+Counted atan(const Counted &x) {
+  counted.transcendental++;
+  return Counted(std::atan(x.value));
+}
+
+template <Integrator I, class Vehicle>
+StageOps CountStage() {
+  const Counted z[6] = {1.0, 0.5, 0.1, 30.0, 0.2, 0.05};
+  const Counted coeffs[4] = {0.1, 0.05, 0.01, 0.001};
+  const Counted delta = 0.05;
+  const Counted a = 0.5;
+  Counted z1[6];
+  counted = StageOps();
+  ModelStep<I, Vehicle>(z, delta, a, coeffs, 0.1, z1);
+  return counted;
+}
+
+template <class Vehicle>
+StageOps CountStage(Integrator integrator) {
+  switch (integrator) {
+    case Integrator::kEuler:
+      return CountStage<Integrator::kEuler, Vehicle>();
+    case Integrator::kMidpoint:
+      return CountStage<Integrator::kMidpoint, Vehicle>();
+    case Integrator::kRK4:
+      return CountStage<Integrator::kRK4, Vehicle>();
+  }
+  return StageOps();
+}
+
+}  // namespace
+
+const char *VehicleModelName(VehicleModel model) {
+  switch (model) {
+    case VehicleModel::kKinematic:
+      return KinematicBicycle::name();
+    case VehicleModel::kDynamic:
+      return DynamicBicycle::name();
+  }
+  return "";
+}
+
+bool ParseVehicleModel(const std::string &name, VehicleModel &model) {
+  for (VehicleModel m : kVehicleModels) {
+    if (name == VehicleModelName(m)) {
+      model = m;
+      return true;
+    }
+  }
+  return false;
+}
+
+StageOps ModelStageOps(VehicleModel model, Integrator integrator) {
+  switch (model) {
+    case VehicleModel::kKinematic:
+      return CountStage<KinematicBicycle>(integrator);
+    case VehicleModel::kDynamic:
+      return CountStage<DynamicBicycle>(integrator);
+  }
+  return StageOps();
+}
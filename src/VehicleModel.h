@@ -0,0 +1,38 @@
+#ifndef VEHICLE_MODEL_H
+#define VEHICLE_MODEL_H
+
+#include <cstddef>
+#include <string>
+#include "Horizon.h"
+
+// The vehicle models of KinematicModel.h by name, for the command lines
+enum class VehicleModel {
+  // KinematicBicycle, the model the cost is tuned with
+  kKinematic,
+  // DynamicBicycle, with the slip of the tyres
+  kDynamic
+};
+
+// Every model, in the order above
+const VehicleModel kVehicleModels[] = {VehicleModel::kKinematic, VehicleModel::kDynamic};
+
+// "kinematic" or "dynamic", the name() of the model
+const char *VehicleModelName(VehicleModel model);
+// False if name is none of them
+bool ParseVehicleModel(const std::string &name, VehicleModel &model);
+
+// The cost of one stage of a model (see StageModel), the step of the
+// integrator along the cubic polynomial: its arithmetic operations and its
+// calls of transcendental functions (cos, sin, atan), counted by evaluating
+// it once on a scalar that counts them, so the figures follow the model as
+// it is written. Operations on constants alone aren't counted, the compiler
+// folds them. What a stage costs on the tape, in the generated code and in
+// the AutoDiff stages grows with these.
+struct StageOps {
+  size_t arithmetic = 0;
+  size_t transcendental = 0;
+};
+
+StageOps ModelStageOps(VehicleModel model, Integrator integrator);
+
+#endif /* VEHICLE_MODEL_H */
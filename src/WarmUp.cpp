@@ -0,0 +1,49 @@
+#include "WarmUp.h"
+#include <chrono>
+#include <cmath>
+
+std::vector<WarmUpScenario> WarmUpScenarios() {
+  const double speeds[] = {0, 20, 40, 60};
+  // Offset of the road, slope, curvature
+  const double roads[][3] = {{0, 0, 0}, {1, 0.1, 0.005}, {-1, -0.1, -0.005}, {3, 0, 0.02},
+                             {-3, 0, -0.02}};
+  std::vector<WarmUpScenario> scenarios;
+  for (double v : speeds) {
+    for (const double *road : roads) {
+      WarmUpScenario scenario;
+      scenario.coeffs << road[0], road[1], road[2], 0;
+      scenario.state << 0, 0, 0, v, road[0], -std::atan(road[1]);
+      scenarios.push_back(scenario);
+    }
+  }
+  return scenarios;
+}
+
+WarmUpReport WarmUp(MPCBase &mpc, const std::vector<WarmUpScenario> &scenarios,
+                    size_t rounds) {
+  typedef std::chrono::steady_clock Clock;
+  WarmUpReport report;
+  const Clock::time_point start = Clock::now();
+  for (size_t round = 0; round < rounds; round++) {
+    for (const WarmUpScenario &scenario : scenarios) {
+      mpc.Reset();
+      mpc.prev_a = 0;
+      for (int tick = 0; tick < 3; tick++) {
+        const Clock::time_point solve_start = Clock::now();
+        const MPCSolution plan = mpc.Solve(scenario.state, scenario.coeffs);
+        const double seconds = std::chrono::duration<double>(Clock::now() - solve_start).count();
+        mpc.prev_a = plan.a[0];
+        mpc.Prepare();
+        if (report.solves == 0) {
+          report.first = seconds;
+        }
+        report.last = seconds;
+        report.solves++;
+      }
+    }
+  }
+  mpc.Reset();
+  mpc.prev_a = 0;
+  report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  return report;
+}
@@ -0,0 +1,44 @@
+#ifndef WARM_UP_H
+#define WARM_UP_H
+
+#include <cstddef>
+#include <vector>
+#include "MPC.h"
+
+// A synthetic problem solved at startup, in the car frame like those of the
+// telemetry: the car at the origin heading along x, the reference
+// polynomial coeffs around it
+struct WarmUpScenario {
+  MPCState state;
+  MPCCoeffs coeffs;
+};
+
+// Outcome of WarmUp
+struct WarmUpReport {
+  size_t solves = 0;
+  // Wall time of all of them, of the first and of the last, in seconds
+  double seconds = 0;
+  double first = 0;
+  double last = 0;
+};
+
+// Speeds from standstill to past the reference, straight and curved roads
+// both ways, and the car off the road on either side
+std::vector<WarmUpScenario> WarmUpScenarios();
+
+// Solve every scenario, rounds times over, before the first real tick.
+//
+// The first Solve of an MPC pays for much that its later ones don't: taping
+// and optimizing the model, the sparsity patterns and colorings, Ipopt's
+// setup, the first factorizations, the allocations of every buffer and the
+// pages under them. Each scenario is solved cold, then twice more warm
+// started with a Prepare between them, like a tick that follows it, so that
+// both paths have run. The plan is forgotten and prev_a cleared after, so
+// that the first real tick starts cold from its own state as it would have.
+//
+// Call it before the solver is wrapped or given a SolutionDatabase or an
+// EffortController, which would otherwise keep the synthetic solves.
+WarmUpReport WarmUp(MPCBase &mpc, const std::vector<WarmUpScenario> &scenarios,
+                    size_t rounds = 1);
+
+#endif /* WARM_UP_H */
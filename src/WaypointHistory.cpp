@@ -0,0 +1,129 @@
+#include "WaypointHistory.h"
+#include <cmath>
+#include "VehicleFrame.h"
+
+WaypointHistory::WaypointHistory(size_t capacity, double spacing)
+    : capacity_(capacity < 4 ? 4 : capacity),
+      spacing_(spacing),
+      xs_(capacity_),
+      ys_(capacity_),
+      s_(capacity_) {}
+
+size_t WaypointHistory::Add(const Telemetry::Waypoints &ptsx, const Telemetry::Waypoints &ptsy) {
+  size_t added = 0;
+  // Whether the last waypoint of the message was the newest held
+  bool after_newest = false;
+  for (size_t j = 0; j < ptsx.size() && j < ptsy.size() && !closed_; j++) {
+    size_t k;
+    if (!Find(ptsx[j], ptsy[j], k)) {
+      Push(ptsx[j], ptsy[j]);
+      added++;
+      after_newest = true;
+      continue;
+    }
+    if (after_newest && k == Oldest() && Oldest() == 0 && size_ >= 4) {
+      closed_ = true;
+    }
+    after_newest = k == count_ - 1;
+  }
+  return added;
+}
+
+bool WaypointHistory::Reference(double px, double py, double psi, double look_ahead,
+                                MPCCoeffs &coeffs) {
+  if (size_ < 4) {
+    return false;
+  }
+  size_t nearest = Oldest();
+  double best = INFINITY;
+  for (size_t k = Oldest(); k < count_; k++) {
+    const double d = std::hypot(xs_[Slot(k)] - px, ys_[Slot(k)] - py);
+    if (d < best) {
+      best = d;
+      nearest = k;
+    }
+  }
+
+  ahead_x_.clear();
+  ahead_y_.clear();
+  // The waypoint behind the nearest one anchors the fit at the car
+  size_t k = nearest;
+  if (nearest > Oldest()) {
+    k = nearest - 1;
+  } else if (closed_) {
+    k = count_ - 1;
+  }
+  ahead_x_.push_back(xs_[Slot(k)]);
+  ahead_y_.push_back(ys_[Slot(k)]);
+  if (k != nearest) {
+    k = nearest;
+    ahead_x_.push_back(xs_[Slot(k)]);
+    ahead_y_.push_back(ys_[Slot(k)]);
+  }
+  double distance = 0;
+  size_t next;
+  while ((distance < look_ahead || ahead_x_.size() < 4) && ahead_x_.size() < size_ &&
+         Next(k, next)) {
+    distance += std::hypot(xs_[Slot(next)] - xs_[Slot(k)], ys_[Slot(next)] - ys_[Slot(k)]);
+    k = next;
+    ahead_x_.push_back(xs_[Slot(k)]);
+    ahead_y_.push_back(ys_[Slot(k)]);
+  }
+  if (ahead_x_.size() < 4) {
+    return false;
+  }
+  frame_x_.resize(ahead_x_.size());
+  frame_y_.resize(ahead_y_.size());
+  coeffs = FitInVehicleFrame<3>(px, py, psi, ahead_x_.data(), ahead_y_.data(),
+                                static_cast<int>(ahead_x_.size()), frame_x_.data(),
+                                frame_y_.data());
+  return true;
+}
+
+void WaypointHistory::Waypoints(std::vector<double> &xs, std::vector<double> &ys) const {
+  xs.clear();
+  ys.clear();
+  for (size_t k = Oldest(); k < count_; k++) {
+    xs.push_back(xs_[Slot(k)]);
+    ys.push_back(ys_[Slot(k)]);
+  }
+}
+
+double WaypointHistory::length() const {
+  return size_ == 0 ? 0 : s_[Slot(count_ - 1)] - s_[Slot(Oldest())];
+}
+
+bool WaypointHistory::Next(size_t k, size_t &next) const {
+  if (k + 1 < count_) {
+    next = k + 1;
+    return true;
+  }
+  next = Oldest();
+  return closed_;
+}
+
+bool WaypointHistory::Find(double x, double y, size_t &k) const {
+  for (k = Oldest(); k < count_; k++) {
+    if (std::hypot(xs_[Slot(k)] - x, ys_[Slot(k)] - y) <= spacing_) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void WaypointHistory::Push(double x, double y) {
+  const size_t slot = Slot(count_);
+  // Extended by the segment from the newest waypoint
+  s_[slot] = 0;
+  if (size_ > 0) {
+    const size_t newest = Slot(count_ - 1);
+    s_[slot] = s_[newest] + std::hypot(x - xs_[newest], y - ys_[newest]);
+  }
+  xs_[slot] = x;
+  ys_[slot] = y;
+  if (size_ == capacity_) {
+    size_--;
+  }
+  size_++;
+  count_++;
+}
@@ -0,0 +1,77 @@
+#ifndef WAYPOINT_HISTORY_H
+#define WAYPOINT_HISTORY_H
+
+#include <cstddef>
+#include <vector>
+#include "Horizon.h"
+#include "Telemetry.h"
+
+// The waypoints of the telemetry messages so far, in the map frame, for a
+// reference that reaches past the few waypoints of a single message.
+//
+// The simulator sends six or so waypoints per message, mostly those of the
+// message before. A waypoint within spacing of one already held is the
+// same; the others are appended in the order they come, the oldest leaving
+// once capacity are held, each with the distance to it along the polygon
+// of the history, extended by the one segment it adds. When a message runs
+// from the newest waypoint on to the oldest, with none of them dropped, the
+// history has gone around the loop: it is closed, holds the whole track and
+// takes no more waypoints, and main builds the spline of the track from it
+// once (see TrackMap).
+//
+// Reference fits the cubic of the waypoints from the one behind the
+// nearest to the car to look_ahead meters ahead of it, around the loop
+// when it is closed, without waiting for the next message's window to
+// catch up. The nearest one is found by a scan of the history, which is
+// short.
+class WaypointHistory {
+public:
+  // Up to capacity waypoints, the same within spacing meters
+  explicit WaypointHistory(size_t capacity = 128, double spacing = 0.5);
+
+  // Append the waypoints (ptsx, ptsy) of a message that aren't held yet;
+  // the number appended
+  size_t Add(const Telemetry::Waypoints &ptsx, const Telemetry::Waypoints &ptsy);
+
+  // The cubic in the frame of the vehicle at (px, py) heading psi of the
+  // waypoints ahead, at least 4 of them, see above; false if there are
+  // fewer
+  bool Reference(double px, double py, double psi, double look_ahead, MPCCoeffs &coeffs);
+
+  // The waypoints held, oldest first
+  void Waypoints(std::vector<double> &xs, std::vector<double> &ys) const;
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  bool closed() const { return closed_; }
+  // Distance from the oldest waypoint held to the newest
+  double length() const;
+
+private:
+  // Number of the waypoint appended k-th, from 0, held in slot k % capacity_
+  size_t Slot(size_t k) const { return k % capacity_; }
+  size_t Oldest() const { return count_ - size_; }
+  // Next waypoint after k, around the loop when closed; false after the
+  // newest of an open history
+  bool Next(size_t k, size_t &next) const;
+  // The held waypoint within spacing of (x, y), if any
+  bool Find(double x, double y, size_t &k) const;
+  void Push(double x, double y);
+
+  size_t capacity_;
+  double spacing_;
+  std::vector<double> xs_;
+  std::vector<double> ys_;
+  // Distance along the history to each waypoint, from the first appended
+  std::vector<double> s_;
+  size_t count_ = 0;
+  size_t size_ = 0;
+  bool closed_ = false;
+  // The waypoints of the last Reference, and in the vehicle frame
+  std::vector<double> ahead_x_;
+  std::vector<double> ahead_y_;
+  std::vector<double> frame_x_;
+  std::vector<double> frame_y_;
+};
+
+#endif /* WAYPOINT_HISTORY_H */
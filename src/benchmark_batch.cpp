@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "BatchSQP.h"
+#include "Log.h"
+#include "MPC_SQP.h"
+
+// Throughput of BatchSQP against one MPC_SQP per scenario.
+//
+//   ./benchmark_batch [scenarios]
+//
+// Draws scenarios (10000 by default) of random speed, offset, heading error
+// and road curvature, solves them all with BatchSQP<Horizon15>, then one by
+// one with a cold MPC_SQP<15>, and prints both times, where the batch QPs
+// ran and the largest difference of the first actuations and the costs.
+// MPC_SQP logs every solve to stdout; that is switched off.
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double Seconds(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const size_t n = argc > 1 ? std::atoi(argv[1]) : 10000;
+  if (n == 0) {
+    std::cerr << "The number of scenarios must be positive" << std::endl;
+    return -1;
+  }
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> unit(-1, 1);
+  std::vector<MPCState> states(n);
+  std::vector<MPCCoeffs> coeffs(n);
+  for (size_t k = 0; k < n; k++) {
+    coeffs[k] << 1.5 * unit(rng), 0.2 * unit(rng), 0.02 * unit(rng), 0.001 * unit(rng);
+    states[k] << 0, 0, 0, 35 + 30 * unit(rng), coeffs[k][0], -std::atan(coeffs[k][1]);
+  }
+
+  std::vector<MPCSolution> results(n);
+  BatchSQP<Horizon15> batch(n);
+  Clock::time_point start = Clock::now();
+  batch.Solve(states.data(), coeffs.data(), results.data());
+  const double batch_seconds = Seconds(start);
+
+  // Without the Cost lines of every solve
+  SetLogLevel(LogLevel::kWarning);
+  double serial_seconds = 0;
+  double actuation_error = 0;
+  double cost_error = 0;
+  for (size_t k = 0; k < n; k++) {
+    MPC_SQP<15> mpc;
+    mpc.max_solve_time = 1;
+    start = Clock::now();
+    const MPCSolution result = mpc.Solve(states[k], coeffs[k]);
+    serial_seconds += Seconds(start);
+    actuation_error =
+        std::max(actuation_error, std::max(std::fabs(result.delta[0] - results[k].delta[0]),
+                                           std::fabs(result.a[0] - results[k].a[0])));
+    cost_error = std::max(cost_error, std::fabs(batch.cost(k) - mpc.cost()) /
+                                          std::max(1.0, std::fabs(mpc.cost())));
+  }
+
+  std::cout << n << " scenarios: batch " << batch_seconds << " s (QPs on the "
+            << (batch.on_gpu() ? "GPU" : "CPU") << "), one by one " << serial_seconds << " s"
+            << std::endl;
+  std::cout << "Largest difference: actuations " << actuation_error << ", relative cost "
+            << cost_error << std::endl;
+  return 0;
+}
@@ -0,0 +1,355 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/bench/BenchTimer.h"
+#include "FlightRecorder.h"
+#include "MPC.h"
+#include "MessagePack.h"
+#include "Polynomial.h"
+#include "ReferenceFit.h"
+#include "SocketIOFrame.h"
+#include "SteerMessage.h"
+#include "Telemetry.h"
+#include "TrackSpline.h"
+#include "VehicleFrame.h"
+#include "json.hpp"
+
+// Benchmark of the stages of a tick around the solve, each against the code
+// of main.cpp it replaced, so that a new parser or serializer can be judged
+// on the same frames.
+//
+//   ./benchmark_ingest [tries] [<segment>...]
+//
+// The frames are the JSON telemetry of the flight recorder segments given
+// (see FlightRecorder.h), or else 1000 frames of the car along
+// lake_track_waypoints.csv, written with the digits of the simulator's
+// floats. Each stage runs over every frame, tries times (10 by default), and
+// prints the best and the mean of the tries per frame in nanoseconds:
+//
+//   frame       hasData, the substring after the socket.io prefix, against
+//               DecodeFrame
+//   parse       json::parse and reading the fields into a Telemetry,
+//               against ParseTelemetry into the same struct
+//   transform   the waypoints into the vehicle frame point by point,
+//               against ToVehicleFrame
+//   polyfit     the QR fit on Eigen vectors, against polyfit<3> and
+//               FitInVehicleFrame<3>, which also transforms
+//   fit         ReferenceFitCache over the frames in order, as a session
+//               fits them
+//   polyeval    the reference at the 25 points of the line to display
+//   serialize   the steer reply through json::dump, against SteerMessage and
+//               SteerPack
+//
+// The results of every stage are kept live (escape of BenchTimer.h), so
+// the compiler can't drop the work.
+
+namespace {
+
+using json = nlohmann::json;
+
+// Frames made up when no segment is given, and the points of the lines of
+// the reply
+const size_t kFrames = 1000;
+const size_t kTelemetryWaypoints = 6;
+const size_t kLinePoints = 25;
+const size_t kPlanPoints = 15;
+
+// The JSON payload of main.cpp before DecodeFrame, a copy of the substring
+// from the first '[' to the last "}]", or empty
+std::string hasData(const std::string &s) {
+  auto found_null = s.find("null");
+  auto b1 = s.find_first_of('[');
+  auto b2 = s.rfind("}]");
+  if (found_null != std::string::npos) {
+    return "";
+  } else if (b1 != std::string::npos && b2 != std::string::npos) {
+    return s.substr(b1, b2 - b1 + 2);
+  }
+  return "";
+}
+
+// The telemetry frames of the car along the waypoints xs, ys, n of them
+// spread over the track, with the speed swept between 0 and 50
+std::vector<std::string> MakeFrames(const std::vector<double> &xs, const std::vector<double> &ys,
+                                    size_t n) {
+  const TrackSpline track(xs, ys);
+  std::vector<std::string> frames;
+  char text[128];
+  for (size_t k = 0; k < n; k++) {
+    const double s = track.length() * k / n;
+    const TrackPoint at = track.At(s);
+    size_t closest = 0;
+    double best = INFINITY;
+    for (size_t i = 0; i < xs.size(); i++) {
+      const double d = (xs[i] - at.x) * (xs[i] - at.x) + (ys[i] - at.y) * (ys[i] - at.y);
+      if (d < best) {
+        best = d;
+        closest = i;
+      }
+    }
+    std::string frame = "42[\"telemetry\",{";
+    for (const char *axis : {"ptsx", "ptsy"}) {
+      frame += std::string("\"") + axis + "\":[";
+      for (size_t j = 0; j < kTelemetryWaypoints; j++) {
+        const size_t i = (closest + xs.size() - 1 + j) % xs.size();
+        std::snprintf(text, sizeof(text), "%s%.7g", j > 0 ? "," : "",
+                      axis[3] == 'x' ? xs[i] : ys[i]);
+        frame += text;
+      }
+      frame += "],";
+    }
+    const double psi = std::atan2(at.dy, at.dx);
+    double psi_unity = std::fmod(5 * M_PI / 2 - psi, 2 * M_PI);
+    if (psi_unity < 0) {
+      psi_unity += 2 * M_PI;
+    }
+    std::snprintf(text, sizeof(text),
+                  "\"psi\":%.7g,\"psi_unity\":%.7g,\"speed\":%.7g,\"steering_angle\":%.7g,",
+                  psi < 0 ? psi + 2 * M_PI : psi, psi_unity, 25 + 25 * std::sin(0.01 * k),
+                  0.05 * std::sin(0.1 * k));
+    frame += text;
+    std::snprintf(text, sizeof(text), "\"throttle\":%.7g,\"x\":%.7g,\"y\":%.7g}]",
+                  0.5 + 0.5 * std::cos(0.1 * k), at.x + 0.3 * std::sin(0.05 * k),
+                  at.y - 0.3 * std::cos(0.05 * k));
+    frame += text;
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+// The JSON telemetry frames of the segments at paths, false if one can't be
+// read
+bool ReadFrames(const std::vector<std::string> &paths, std::vector<std::string> &frames) {
+  for (const std::string &path : paths) {
+    std::unique_ptr<FlightReader> reader = FlightReader::Open(path);
+    if (!reader) {
+      std::cerr << "Could not read the flight records of " << path << std::endl;
+      return false;
+    }
+    FlightRecordHeader header;
+    MessageView payload;
+    Telemetry telemetry;
+    while (reader->Next(header, payload)) {
+      SocketIOFrame frame;
+      if (header.type == static_cast<uint16_t>(FlightRecordType::kTelemetry) &&
+          static_cast<WireFormat>(header.format) == WireFormat::kJson &&
+          DecodeFrame(payload, frame) && frame.event.equals("telemetry") &&
+          ParseTelemetry(frame.data, telemetry)) {
+        frames.emplace_back(payload.begin(), payload.end());
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const int tries = argc > 1 ? std::atoi(argv[1]) : 10;
+  if (tries < 1) {
+    std::cerr << "Run a try at least" << std::endl;
+    return -1;
+  }
+  std::vector<std::string> frames;
+  if (argc > 2) {
+    if (!ReadFrames(std::vector<std::string>(argv + 2, argv + argc), frames)) {
+      return -1;
+    }
+  } else {
+    std::vector<double> xs;
+    std::vector<double> ys;
+    if (!TrackSpline::Load("lake_track_waypoints.csv", xs, ys) ||
+        xs.size() < kTelemetryWaypoints) {
+      std::cerr << "Could not read the waypoints of lake_track_waypoints.csv" << std::endl;
+      return -1;
+    }
+    frames = MakeFrames(xs, ys, kFrames);
+  }
+  if (frames.empty()) {
+    std::cerr << "No JSON telemetry in the segments" << std::endl;
+    return -1;
+  }
+
+  // The telemetry of every frame, for the stages after the parse
+  const size_t n = frames.size();
+  std::vector<Telemetry> telemetry(n);
+  std::vector<SocketIOFrame> decoded(n);
+  for (size_t k = 0; k < n; k++) {
+    DecodeFrame(MessageView(frames[k].data(), frames[k].size()), decoded[k]);
+    ParseTelemetry(decoded[k].data, telemetry[k]);
+  }
+  // A plan and lines of the size of a reply
+  double mpc_x[kPlanPoints];
+  double mpc_y[kPlanPoints];
+  double next_x[kLinePoints];
+  double next_y[kLinePoints];
+  for (size_t i = 0; i < kLinePoints; i++) {
+    next_x[i] = 2.5 * i;
+    next_y[i] = 0.01 * i * i;
+    if (i < kPlanPoints) {
+      mpc_x[i] = 1.7 * (i + 1);
+      mpc_y[i] = 0.008 * i * i;
+    }
+  }
+
+  std::cout << n << " frames, " << tries << " tries" << std::endl
+            << std::left << std::setw(12) << "stage" << std::setw(22) << "code" << std::right
+            << std::setw(12) << "best ns" << std::setw(12) << "mean ns" << std::endl;
+  Eigen::BenchTimer timer;
+  const auto report = [&](const char *stage, const char *code) {
+    std::cout << std::left << std::setw(12) << stage << std::setw(22) << code << std::right
+              << std::fixed << std::setprecision(1) << std::setw(12)
+              << timer.best(Eigen::REAL_TIMER) / n * 1e9 << std::setw(12)
+              << timer.total(Eigen::REAL_TIMER) / tries / n * 1e9 << std::endl;
+  };
+
+  std::string payload;
+  BENCH(timer, tries, 1, for (const std::string &frame : frames) {
+    payload = hasData(frame);
+    escape(&payload[0]);
+  });
+  report("frame", "hasData");
+  SocketIOFrame frame;
+  BENCH(timer, tries, 1, for (const std::string &text : frames) {
+    DecodeFrame(MessageView(text.data(), text.size()), frame);
+    escape(&frame);
+  });
+  report("", "DecodeFrame");
+
+  Telemetry parsed;
+  BENCH(timer, tries, 1, for (const std::string &text : frames) {
+    auto j = json::parse(hasData(text));
+    const std::vector<double> ptsx = j[1]["ptsx"].get<std::vector<double> >();
+    const std::vector<double> ptsy = j[1]["ptsy"].get<std::vector<double> >();
+    parsed.ptsx.assign(ptsx.begin(), ptsx.end());
+    parsed.ptsy.assign(ptsy.begin(), ptsy.end());
+    parsed.x = j[1]["x"];
+    parsed.y = j[1]["y"];
+    parsed.psi = j[1]["psi"];
+    parsed.speed = j[1]["speed"];
+    parsed.steering_angle = j[1]["steering_angle"];
+    parsed.throttle = j[1]["throttle"];
+    escape(&parsed);
+  });
+  report("parse", "json::parse");
+  BENCH(timer, tries, 1, for (const SocketIOFrame &event : decoded) {
+    ParseTelemetry(event.data, parsed);
+    escape(&parsed);
+  });
+  report("", "ParseTelemetry");
+
+  double xs[kTelemetryWaypoints];
+  double ys[kTelemetryWaypoints];
+  BENCH(timer, tries, 1, for (const Telemetry &car : telemetry) {
+    const double c = std::cos(car.psi);
+    const double s = std::sin(car.psi);
+    for (size_t i = 0; i < car.ptsx.size() && i < kTelemetryWaypoints; i++) {
+      const double dx = car.ptsx[i] - car.x;
+      const double dy = car.ptsy[i] - car.y;
+      xs[i] = dx * c + dy * s;
+      ys[i] = dy * c - dx * s;
+    }
+    escape(xs);
+    escape(ys);
+  });
+  report("transform", "per point");
+  BENCH(timer, tries, 1, for (const Telemetry &car : telemetry) {
+    ToVehicleFrame(car.x, car.y, car.psi, car.ptsx.data(), car.ptsy.data(),
+                   std::min(car.ptsx.size(), kTelemetryWaypoints), xs, ys);
+    escape(xs);
+    escape(ys);
+  });
+  report("", "ToVehicleFrame");
+
+  std::vector<double> frame_xs(n * kTelemetryWaypoints);
+  std::vector<double> frame_ys(n * kTelemetryWaypoints);
+  std::vector<int> sizes(n);
+  for (size_t k = 0; k < n; k++) {
+    const Telemetry &car = telemetry[k];
+    sizes[k] = static_cast<int>(std::min(car.ptsx.size(), kTelemetryWaypoints));
+    ToVehicleFrame(car.x, car.y, car.psi, car.ptsx.data(), car.ptsy.data(), sizes[k],
+                   &frame_xs[k * kTelemetryWaypoints], &frame_ys[k * kTelemetryWaypoints]);
+  }
+  Eigen::VectorXd coeffs;
+  BENCH(timer, tries, 1, for (size_t k = 0; k < n; k++) {
+    polyfit(Eigen::Map<const Eigen::VectorXd>(&frame_xs[k * kTelemetryWaypoints], sizes[k]),
+            Eigen::Map<const Eigen::VectorXd>(&frame_ys[k * kTelemetryWaypoints], sizes[k]), 3,
+            coeffs);
+    escape(coeffs.data());
+  });
+  report("polyfit", "QR on VectorXd");
+  MPCCoeffs fixed;
+  BENCH(timer, tries, 1, for (size_t k = 0; k < n; k++) {
+    fixed = polyfit<3>(&frame_xs[k * kTelemetryWaypoints], &frame_ys[k * kTelemetryWaypoints],
+                       sizes[k]);
+    escape(fixed.data());
+  });
+  report("", "polyfit<3>");
+  BENCH(timer, tries, 1, for (const Telemetry &car : telemetry) {
+    fixed = FitInVehicleFrame<3>(car.x, car.y, car.psi, car.ptsx.data(), car.ptsy.data(),
+                                 static_cast<int>(std::min(car.ptsx.size(), kTelemetryWaypoints)),
+                                 xs, ys);
+    escape(fixed.data());
+  });
+  report("", "FitInVehicleFrame<3>");
+
+  BENCH(timer, tries, 1, {
+    ReferenceFitCache reference_fit;
+    for (const Telemetry &car : telemetry) {
+      escape(const_cast<double *>(
+          reference_fit.Fit(car.ptsx, car.ptsy, car.x, car.y, car.psi).data()));
+    }
+  });
+  report("fit", "ReferenceFitCache");
+
+  double line_y[kLinePoints];
+  BENCH(timer, tries, 1, for (size_t k = 0; k < n; k++) {
+    for (size_t i = 0; i < kLinePoints; i++) {
+      line_y[i] = polyeval(coeffs, next_x[i]);
+    }
+    escape(line_y);
+  });
+  report("polyeval", "per point");
+  BENCH(timer, tries, 1, for (size_t k = 0; k < n; k++) {
+    polyeval(fixed, next_x, kLinePoints, line_y);
+    escape(line_y);
+  });
+  report("", "over the points");
+
+  std::string reply;
+  BENCH(timer, tries, 1, for (size_t k = 0; k < n; k++) {
+    json msgJson;
+    msgJson["steering_angle"] = telemetry[k].steering_angle;
+    msgJson["throttle"] = telemetry[k].throttle;
+    msgJson["mpc_x"] = std::vector<double>(mpc_x, mpc_x + kPlanPoints);
+    msgJson["mpc_y"] = std::vector<double>(mpc_y, mpc_y + kPlanPoints);
+    msgJson["next_x"] = std::vector<double>(next_x, next_x + kLinePoints);
+    msgJson["next_y"] = std::vector<double>(next_y, next_y + kLinePoints);
+    reply = "42[\"steer\"," + msgJson.dump() + "]";
+    escape(&reply[0]);
+  });
+  report("serialize", "json::dump");
+  SteerMessage steer_message;
+  BENCH(timer, tries, 1, for (size_t k = 0; k < n; k++) {
+    const std::string &message =
+        steer_message.Write(telemetry[k].steering_angle, telemetry[k].throttle, mpc_x, mpc_y,
+                            kPlanPoints, next_x, next_y, kLinePoints);
+    escape(const_cast<char *>(message.data()));
+  });
+  report("", "SteerMessage");
+  SteerPack steer_pack;
+  BENCH(timer, tries, 1, for (size_t k = 0; k < n; k++) {
+    const std::string &message =
+        steer_pack.Write(telemetry[k].steering_angle, telemetry[k].throttle, mpc_x, mpc_y,
+                         kPlanPoints, next_x, next_y, kLinePoints);
+    escape(const_cast<char *>(message.data()));
+  });
+  report("", "SteerPack");
+  return 0;
+}
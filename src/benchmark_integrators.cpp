@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "KinematicModel.h"
+
+// Prediction error of each integrator against the stages of the horizon.
+//
+//   ./benchmark_integrators [seconds] [target]
+//
+// Over a look ahead of seconds (1.4 by default, that of 15 stages of 0.1 s)
+// the vehicle is rolled out with N stages of each integrator, N from 3 to
+// 30, and compared at every stage with an accurate solution of the same
+// motion. The motions cover the speeds and the steering and throttle range
+// up to a yaw rate of kMaxYawRate, each with the actuations held. The table
+// gives the largest position error over the stages and the motions, then
+// the fewest stages every integrator needs to stay within target: by default
+// the error of the tuned horizon, 15 Euler stages.
+
+namespace {
+
+struct Motion {
+  double v;
+  double delta;
+  double a;
+};
+
+const size_t kMaxStages = 30;
+// Substeps of the reference solution per stage
+const size_t kReferenceSteps = 1000;
+// Fastest turn of the motions, in rad/s
+const double kMaxYawRate = 1.0;
+
+// Straight reference line, the errors play no part in the position
+MPCCoeffs Line() {
+  MPCCoeffs coeffs;
+  coeffs << 0, 0, 0, 0;
+  return coeffs;
+}
+
+// Largest position error of n_stages stages of I over seconds
+template <Integrator I>
+double StageError(const std::vector<Motion> &motions, size_t n_stages, double seconds) {
+  const double dt = seconds / (n_stages - 1);
+  double error = 0;
+  for (const Motion &m : motions) {
+    MPCState z;
+    z << 0, 0, 0, m.v, 0, 0;
+    // The reference, by fine RK4 steps
+    MPCState reference = z;
+    for (size_t t = 1; t < n_stages; t++) {
+      z = ModelStep<I>(z, m.delta, m.a, Line(), dt);
+      for (size_t i = 0; i < kReferenceSteps; i++) {
+        reference = ModelStep<Integrator::kRK4>(reference, m.delta, m.a, Line(),
+                                                dt / kReferenceSteps);
+      }
+      error = std::max(error, std::hypot(z[0] - reference[0], z[1] - reference[1]));
+    }
+  }
+  return error;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const double seconds = argc > 1 ? std::atof(argv[1]) : 1.4;
+  if (seconds <= 0) {
+    std::cerr << "The look ahead must be positive" << std::endl;
+    return -1;
+  }
+
+  std::vector<Motion> motions;
+  for (double v : {10.0, 30.0, 50.0, 70.0}) {
+    for (double delta : {0.0, 0.25 * max_delta, 0.5 * max_delta, max_delta}) {
+      for (double a : {-max_a, 0.0, max_a}) {
+        if (v * delta / Lf <= kMaxYawRate) {
+          motions.push_back({v, delta, a});
+        }
+      }
+    }
+  }
+
+  const double target =
+      argc > 2 ? std::atof(argv[2]) : StageError<Integrator::kEuler>(motions, 15, seconds);
+  if (target <= 0) {
+    std::cerr << "The target must be positive" << std::endl;
+    return -1;
+  }
+
+  std::cout << std::setw(8) << "stages" << std::setw(10) << "dt" << std::setw(12) << "euler"
+            << std::setw(12) << "midpoint" << std::setw(12) << "rk4" << std::endl;
+  const char *names[] = {"euler", "midpoint", "rk4"};
+  size_t needed[] = {0, 0, 0};
+  for (size_t n = 3; n <= kMaxStages; n++) {
+    const double errors[] = {StageError<Integrator::kEuler>(motions, n, seconds),
+                             StageError<Integrator::kMidpoint>(motions, n, seconds),
+                             StageError<Integrator::kRK4>(motions, n, seconds)};
+    std::cout << std::setw(8) << n << std::setw(10) << std::fixed << std::setprecision(3)
+              << seconds / (n - 1);
+    for (size_t k = 0; k < 3; k++) {
+      std::cout << std::setw(12) << std::scientific << std::setprecision(2) << errors[k];
+      if (needed[k] == 0 && errors[k] <= target) {
+        needed[k] = n;
+      }
+    }
+    std::cout << std::endl;
+  }
+
+  std::cout << std::endl << std::defaultfloat << "Stages within " << target << " over "
+            << seconds << " s:";
+  for (size_t k = 0; k < 3; k++) {
+    std::cout << " " << names[k] << " ";
+    if (needed[k] > 0) {
+      std::cout << needed[k];
+    } else {
+      std::cout << "more than " << kMaxStages;
+    }
+  }
+  std::cout << std::endl;
+  return 0;
+}
@@ -0,0 +1,373 @@
+#include <dirent.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Dense"
+#include "Eigen-3.3/Eigen/OrderingMethods"
+#include "Eigen-3.3/Eigen/SparseCholesky"
+#include "Eigen-3.3/Eigen/SparseCore"
+#include "Eigen-3.3/Eigen/SparseLU"
+#include "BenchResults.h"
+#include "KKTDump.h"
+
+// Shootout of the linear solvers on the KKT systems of our own solves.
+//
+//   ./benchmark_kkt <file or dir>... [repeat=<n>] [delta=<d>] [json=<path>] [csv=<path>]
+//
+// The systems are those mpc_replay kkt=<dir> writes (see KKTDump.h), or any
+// coordinate real symmetric Matrix Market file; a directory stands for the
+// .mtx files in it. Each is factored and solved by every factorization at
+// hand:
+//
+//   ldlt-amd      Eigen's SimplicialLDLT, the lower triangle, AMD ordering
+//   ldlt-natural  the same in the order of the variables of the NLP
+//   ldlt-stage    the same with the rows in the order of the stages, each
+//                 stage's variables then the constraints of its step: the
+//                 banded elimination a Riccati recursion does by its blocks
+//                 (only for the systems with their stages)
+//   lu-colamd     Eigen's SparseLU of the whole matrix, COLAMD ordering
+//   lu-amd        the same with the AMD ordering
+//   dense-lu      Eigen's PartialPivLU of the matrix made dense
+//
+// The LDLT factorizations don't pivot, so the rows with no diagonal, the
+// constraints, get -delta (1e-8, Ipopt's smallest regularization of the
+// constraints) there, which makes the system quasidefinite and every
+// ordering stable; the residual is of the system as it was. HSL, MUMPS or
+// Pardiso, which Ipopt may factor with, are not linked here.
+//
+// The ordering and the symbolic analysis are done once a system, as Ipopt
+// does them once a structure; then the numeric factorization and the solve
+// repeat times (20). It prints for each factorization the systems it
+// failed on, the microseconds of the analysis and the median, 99th
+// percentile and maximum of the factorization and the solve, the fill-in,
+// the entries of the factors over those of the matrix it took (the lower
+// triangle for the LDLT, all of them for the others), the mean entries of
+// the factors and the largest relative residual. json and csv write them as
+// the benchmarks kkt/<factorization> (see BenchResults.h).
+
+namespace {
+
+typedef Eigen::SparseMatrix<double, Eigen::ColMajor, int> SparseMatrix;
+typedef Eigen::Triplet<double, int> Triplet;
+
+const char *const kFactorizations[] = {"ldlt-amd", "ldlt-natural", "ldlt-stage",
+                                       "lu-colamd", "lu-amd",       "dense-lu"};
+const size_t kNumFactorizations = sizeof(kFactorizations) / sizeof(kFactorizations[0]);
+
+double Seconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double>(duration).count();
+}
+
+// The .mtx files of path, itself if it isn't a directory, without the
+// right hand sides and stages of KKTDump
+bool ListSystems(const std::string &path, std::vector<std::string> &files) {
+  DIR *directory = opendir(path.c_str());
+  if (directory == nullptr) {
+    files.push_back(path);
+    return true;
+  }
+  std::vector<std::string> names;
+  while (const dirent *entry = readdir(directory)) {
+    const std::string name = entry->d_name;
+    const auto ends_with = [&name](const std::string &suffix) {
+      return name.size() >= suffix.size() &&
+             name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    if (ends_with(".mtx") && !ends_with("-rhs.mtx") && !ends_with("-stage.mtx")) {
+      names.push_back(path + "/" + name);
+    }
+  }
+  closedir(directory);
+  std::sort(names.begin(), names.end());
+  files.insert(files.end(), names.begin(), names.end());
+  return !names.empty();
+}
+
+// What a factorization did over all the systems
+struct Shootout {
+  size_t systems = 0;
+  size_t failed = 0;
+  std::vector<double> analyses;
+  std::vector<double> times;
+  double fill = 0;
+  double factor_entries = 0;
+  double residual = 0;
+};
+
+// One system, its matrix whole and by its lower triangle regularized
+struct System {
+  KKTSystem kkt;
+  SparseMatrix full;
+  SparseMatrix lower;
+  Eigen::VectorXd rhs;
+};
+
+// |A x - b| relative to |A| |x| + |b|, in the largest entries
+double Residual(const System &system, const Eigen::VectorXd &x) {
+  double a_norm = 0;
+  for (int k = 0; k < system.full.outerSize(); k++) {
+    double column = 0;
+    for (SparseMatrix::InnerIterator it(system.full, k); it; ++it) {
+      column += std::fabs(it.value());
+    }
+    a_norm = std::max(a_norm, column);
+  }
+  const double scale = a_norm * x.lpNorm<Eigen::Infinity>() + system.rhs.lpNorm<Eigen::Infinity>();
+  const double residual = (system.full * x - system.rhs).lpNorm<Eigen::Infinity>();
+  return scale > 0 ? residual / scale : residual;
+}
+
+// The entries of the factors: the diagonal and those of L below it
+template <class Ordering>
+double FactorEntries(
+    const Eigen::SimplicialLDLT<SparseMatrix, Eigen::Lower, Ordering> &solver) {
+  return static_cast<double>(solver.matrixL().nestedExpression().nonZeros() +
+                             solver.matrixL().rows());
+}
+
+// Those the supernodes of L hold, and those of U. The iterator of the
+// supernodes takes them mutable, though it only reads them.
+template <class Ordering>
+double FactorEntries(const Eigen::SparseLU<SparseMatrix, Ordering> &solver) {
+  typedef Eigen::internal::MappedSuperNodalMatrix<double, int> SuperNodes;
+  SuperNodes &l = const_cast<SuperNodes &>(solver.matrixL().m_mapL);
+  double count = 0;
+  for (Eigen::Index j = 0; j < l.cols(); j++) {
+    for (SuperNodes::InnerIterator it(l, j); it; ++it) {
+      count++;
+    }
+  }
+  return count + static_cast<double>(solver.matrixU().m_mapU.nonZeros());
+}
+
+// Factor and solve system repeat times with solver, after its analysis,
+// into shootout; matrix and rhs are those of system permuted by
+// permutation, unless it is null
+template <class Solver>
+void Run(Solver &solver, const SparseMatrix &matrix, const System &system,
+         const Eigen::VectorXd &rhs, size_t repeat, double matrix_entries,
+         const Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> *permutation,
+         Shootout &shootout) {
+  shootout.systems++;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  solver.analyzePattern(matrix);
+  shootout.analyses.push_back(Seconds(std::chrono::steady_clock::now() - start));
+  Eigen::VectorXd x;
+  for (size_t k = 0; k < repeat; k++) {
+    start = std::chrono::steady_clock::now();
+    solver.factorize(matrix);
+    if (solver.info() != Eigen::Success) {
+      shootout.failed++;
+      return;
+    }
+    x = solver.solve(rhs);
+    shootout.times.push_back(Seconds(std::chrono::steady_clock::now() - start));
+  }
+  const double factor = FactorEntries(solver);
+  shootout.factor_entries += factor;
+  shootout.fill += factor / matrix_entries;
+  if (permutation != nullptr) {
+    x = permutation->inverse() * x;
+  }
+  shootout.residual = std::max(shootout.residual, Residual(system, x));
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  size_t repeat = 20;
+  double delta = 1e-8;
+  std::string json_path;
+  std::string csv_path;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const std::string repeat_flag = "repeat=";
+    const std::string delta_flag = "delta=";
+    const std::string json_flag = "json=";
+    const std::string csv_flag = "csv=";
+    if (arg.compare(0, repeat_flag.size(), repeat_flag) == 0) {
+      repeat = std::strtoul(arg.c_str() + repeat_flag.size(), nullptr, 10);
+    } else if (arg.compare(0, delta_flag.size(), delta_flag) == 0) {
+      delta = std::strtod(arg.c_str() + delta_flag.size(), nullptr);
+    } else if (arg.compare(0, json_flag.size(), json_flag) == 0) {
+      json_path = arg.substr(json_flag.size());
+    } else if (arg.compare(0, csv_flag.size(), csv_flag) == 0) {
+      csv_path = arg.substr(csv_flag.size());
+    } else if (!ListSystems(arg, files)) {
+      std::cerr << "No .mtx files in " << arg << std::endl;
+      return -1;
+    }
+  }
+  if (files.empty()) {
+    std::cerr << "Usage: " << argv[0] << " <file or dir>... [repeat=<n>] [delta=<d>] "
+              << "[json=<path>] [csv=<path>]" << std::endl;
+    return -1;
+  }
+  if (repeat == 0 || delta < 0) {
+    std::cerr << "Repeat once at least, with a delta of 0 or more" << std::endl;
+    return -1;
+  }
+
+  std::vector<Shootout> shootouts(kNumFactorizations);
+  size_t min_n = 0;
+  size_t max_n = 0;
+  double entries = 0;
+  for (const std::string &file : files) {
+    System system;
+    std::string error;
+    if (!ReadKKTSystem(file, system.kkt, error)) {
+      std::cerr << error << std::endl;
+      return -1;
+    }
+    const KKTSystem &kkt = system.kkt;
+    const int n = static_cast<int>(kkt.n);
+    min_n = min_n == 0 ? kkt.n : std::min(min_n, kkt.n);
+    max_n = std::max(max_n, kkt.n);
+
+    std::vector<Triplet> full;
+    std::vector<Triplet> lower;
+    std::vector<bool> diagonal(kkt.n, false);
+    for (size_t k = 0; k < kkt.values.size(); k++) {
+      full.emplace_back(kkt.rows[k], kkt.cols[k], kkt.values[k]);
+      if (kkt.rows[k] != kkt.cols[k]) {
+        full.emplace_back(kkt.cols[k], kkt.rows[k], kkt.values[k]);
+      } else if (kkt.values[k] != 0) {
+        diagonal[kkt.rows[k]] = true;
+      }
+      lower.emplace_back(kkt.rows[k], kkt.cols[k], kkt.values[k]);
+    }
+    for (int i = 0; i < n; i++) {
+      if (!diagonal[i]) {
+        lower.emplace_back(i, i, -delta);
+      }
+    }
+    system.full.resize(n, n);
+    system.full.setFromTriplets(full.begin(), full.end());
+    system.lower.resize(n, n);
+    system.lower.setFromTriplets(lower.begin(), lower.end());
+    system.rhs = Eigen::Map<const Eigen::VectorXd>(kkt.rhs.data(), n);
+    entries += system.full.nonZeros();
+    const double lower_entries = static_cast<double>(system.lower.nonZeros());
+    const double full_entries = static_cast<double>(system.full.nonZeros());
+    {
+      Eigen::SimplicialLDLT<SparseMatrix, Eigen::Lower, Eigen::AMDOrdering<int> > solver;
+      Run(solver, system.lower, system, system.rhs, repeat, lower_entries, nullptr,
+          shootouts[0]);
+    }
+    {
+      Eigen::SimplicialLDLT<SparseMatrix, Eigen::Lower, Eigen::NaturalOrdering<int> > solver;
+      Run(solver, system.lower, system, system.rhs, repeat, lower_entries, nullptr,
+          shootouts[1]);
+    }
+    if (kkt.stages.size() == kkt.n) {
+      // Stably by stage: the variables before the constraints of a stage,
+      // as they come in the system
+      std::vector<int> order(kkt.n);
+      for (int i = 0; i < n; i++) {
+        order[i] = i;
+      }
+      std::stable_sort(order.begin(), order.end(),
+                       [&kkt](int a, int b) { return kkt.stages[a] < kkt.stages[b]; });
+      // Row i of the system is row position[i] of the permuted one
+      Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> permutation(n);
+      for (int p = 0; p < n; p++) {
+        permutation.indices()[order[p]] = p;
+      }
+      SparseMatrix permuted(n, n);
+      permuted.selfadjointView<Eigen::Lower>() =
+          system.lower.selfadjointView<Eigen::Lower>().twistedBy(permutation);
+      const Eigen::VectorXd rhs = permutation * system.rhs;
+      Eigen::SimplicialLDLT<SparseMatrix, Eigen::Lower, Eigen::NaturalOrdering<int> > solver;
+      Run(solver, permuted, system, rhs, repeat, lower_entries, &permutation,
+          shootouts[2]);
+    }
+    {
+      Eigen::SparseLU<SparseMatrix, Eigen::COLAMDOrdering<int> > solver;
+      Run(solver, system.full, system, system.rhs, repeat, full_entries, nullptr,
+          shootouts[3]);
+    }
+    {
+      Eigen::SparseLU<SparseMatrix, Eigen::AMDOrdering<int> > solver;
+      Run(solver, system.full, system, system.rhs, repeat, full_entries, nullptr,
+          shootouts[4]);
+    }
+    {
+      Shootout &shootout = shootouts[5];
+      shootout.systems++;
+      const Eigen::MatrixXd dense(system.full);
+      shootout.analyses.push_back(0);
+      Eigen::PartialPivLU<Eigen::MatrixXd> solver(n);
+      Eigen::VectorXd x;
+      for (size_t k = 0; k < repeat; k++) {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        solver.compute(dense);
+        x = solver.solve(system.rhs);
+        shootout.times.push_back(Seconds(std::chrono::steady_clock::now() - start));
+      }
+      shootout.factor_entries += static_cast<double>(n) * n;
+      shootout.fill += static_cast<double>(n) * n / full_entries;
+      const double residual = Residual(system, x);
+      if (!std::isfinite(residual)) {
+        shootout.failed++;
+      } else {
+        shootout.residual = std::max(shootout.residual, residual);
+      }
+    }
+  }
+
+  std::cout << files.size() << " KKT systems of " << min_n << " to " << max_n << " rows, "
+            << std::fixed << std::setprecision(0) << entries / files.size()
+            << " entries on average, each factored " << repeat << " times" << std::endl
+            << std::endl;
+  std::cout << std::left << std::setw(14) << "factorization" << std::right << std::setw(8)
+            << "systems" << std::setw(8) << "failed" << std::setw(12) << "analyze us"
+            << std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << std::setw(10)
+            << "max us" << std::setw(8) << "fill" << std::setw(10) << "entries" << std::setw(12)
+            << "residual" << std::endl;
+  std::vector<BenchResult> results;
+  for (size_t f = 0; f < kNumFactorizations; f++) {
+    const Shootout &shootout = shootouts[f];
+    if (shootout.systems == 0) {
+      continue;
+    }
+    BenchResult result =
+        SummarizeTimes(std::string("kkt/") + kFactorizations[f], shootout.times);
+    const size_t factored = shootout.systems - shootout.failed;
+    double analysis = 0;
+    for (double seconds : shootout.analyses) {
+      analysis += seconds / shootout.analyses.size();
+    }
+    const double fill = factored > 0 ? shootout.fill / factored : 0;
+    const double factor_entries = factored > 0 ? shootout.factor_entries / factored : 0;
+    std::cout << std::left << std::setw(14) << kFactorizations[f] << std::right << std::setw(8)
+              << shootout.systems << std::setw(8) << shootout.failed << std::setprecision(1)
+              << std::setw(12) << analysis * 1e6 << std::setw(10) << result.p50 * 1e6
+              << std::setw(10) << result.p99 * 1e6 << std::setw(10) << result.max * 1e6
+              << std::setprecision(2) << std::setw(8) << fill << std::setprecision(0)
+              << std::setw(10) << factor_entries << std::scientific << std::setprecision(1)
+              << std::setw(12) << shootout.residual << std::fixed << std::endl;
+    result.counters["systems"] = static_cast<double>(shootout.systems);
+    result.counters["failed"] = static_cast<double>(shootout.failed);
+    result.counters["analyze_us"] = analysis * 1e6;
+    result.counters["fill"] = fill;
+    result.counters["factor_entries"] = factor_entries;
+    result.counters["residual"] = shootout.residual;
+    results.push_back(result);
+  }
+  if (!json_path.empty() && !WriteBenchJSON(json_path, "benchmark_kkt", results)) {
+    std::cerr << "Could not write the results to " << json_path << std::endl;
+    return -1;
+  }
+  if (!csv_path.empty() && !WriteBenchCSV(csv_path, results)) {
+    std::cerr << "Could not write the results to " << csv_path << std::endl;
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CacheLine.h"
+#include "Mailbox.h"
+#include "Metrics.h"
+#include "ReferenceFit.h"
+#include "SocketIOFrame.h"
+#include "SteerMessage.h"
+#include "Telemetry.h"
+
+// Benchmark of sessions served side by side on threads of their own, for
+// the cache lines they would share (see CacheLine.h): the round trips a
+// second of each session should stay those of a session alone however many
+// run at once, as long as there are cores for them.
+//
+//   ./benchmark_sharing [seconds] [pairs] [nometrics]
+//
+// Each session is a pair of threads over the mailboxes of a session of the
+// server, made by std::allocate_shared with CacheLineAllocator next to each
+// other on the heap as the server makes them: one in the role of its event
+// loop posts a telemetry frame into frames and waits for the reply, the
+// other in the role of its solver thread takes the frame, decodes and parses
+// it, fits its waypoints, writes the reply into replies and counts the tick
+// into Metrics() as the solver threads do (not with "nometrics"). Both
+// poll rather than wait, so a round trip is the cache lines going back and
+// forth between the two cores and the work of the tick around the solve.
+//
+// For 1, 2, 4, ... sessions up to pairs (half the cores by default) it runs
+// seconds (1 by default) and prints the round trips a second of each
+// session, the slowest and the mean, and the mean against one session
+// alone. The counters of Metrics() are shared by every solver thread, each
+// add a line taken from the others, so with "nometrics" what remains is the
+// sessions' own layout.
+
+namespace {
+
+// The telemetry of the simulator, with the six waypoints it sends
+const char *const kFrame =
+    "42[\"telemetry\",{\"ptsx\":[-32.16173,-43.49173,-61.09,-78.29172,-93.05002,-107.7717],"
+    "\"ptsy\":[113.361,105.941,92.88499,78.73102,65.34102,50.57938],\"psi\":3.733651,"
+    "\"psi_unity\":4.12033,\"speed\":23.4,\"steering_angle\":-0.01,\"throttle\":0.5,"
+    "\"x\":-40.62,\"y\":108.73}]";
+
+// A session of the server in miniature: its mailboxes, laid out as they are
+// there, and what its solver thread touches every tick
+struct Session {
+  Session() : reference_fit(ReferenceFitTolerance()) {}
+
+  Mailbox frames;
+  Mailbox replies;
+  // Of the solver thread
+  alignas(kCacheLine) Telemetry telemetry;
+  ReferenceFitCache reference_fit;
+  SteerMessage steer_message;
+  // Of the event loop
+  alignas(kCacheLine) Mailbox::Mail reply;
+  uint64_t round_trips = 0;
+};
+
+// The event loop of session: post a frame, wait for its reply, until stop
+void Loop(Session &session, const std::atomic<bool> &stop) {
+  const MessageView frame(kFrame, std::strlen(kFrame));
+  while (!stop.load(std::memory_order_relaxed)) {
+    session.frames.Post(frame, Mailbox::Clock::now());
+    while (!session.replies.Take(session.reply)) {
+      if (stop.load(std::memory_order_relaxed)) {
+        return;
+      }
+    }
+    session.round_trips++;
+  }
+}
+
+// The solver thread of session: the tick of the server but for the solve
+void Solve(Session &session, const std::atomic<bool> &stop, bool metrics) {
+  Mailbox::Mail mail;
+  const double line[2] = {0, 1};
+  while (!stop.load(std::memory_order_relaxed)) {
+    if (!session.frames.Take(mail)) {
+      continue;
+    }
+    SocketIOFrame frame;
+    DecodeFrame(MessageView(mail.message.data(), mail.message.size()), frame);
+    Telemetry &telemetry = session.telemetry;
+    ParseTelemetry(frame.data, telemetry);
+    const MPCCoeffs &coeffs = session.reference_fit.Fit(telemetry.ptsx, telemetry.ptsy,
+                                                        telemetry.x, telemetry.y, telemetry.psi);
+    const std::string &reply =
+        session.steer_message.Write(-coeffs[1], 0.5, line, line, 2, line, line, 2);
+    if (metrics) {
+      ServerMetrics &server = Metrics();
+      server.ticks.Add();
+      server.parse.Observe(1e-6);
+      server.fit.Observe(1e-6);
+    }
+    session.replies.Post(MessageView(reply.data(), reply.size()), mail.arrival);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const double seconds = argc > 1 ? std::atof(argv[1]) : 1;
+  const size_t cores = std::max(2u, std::thread::hardware_concurrency());
+  const size_t max_pairs =
+      argc > 2 ? std::strtoul(argv[2], nullptr, 10) : std::max<size_t>(1, cores / 2);
+  const bool metrics = !(argc > 3 && std::string(argv[3]) == "nometrics");
+  if (seconds <= 0 || max_pairs == 0) {
+    std::cerr << "Usage: " << argv[0] << " [seconds] [pairs] [nometrics]" << std::endl;
+    return 1;
+  }
+
+  std::cout << std::setw(10) << "sessions" << std::setw(14) << "slowest/s" << std::setw(14)
+            << "mean/s" << std::setw(10) << "vs 1" << std::endl;
+  std::vector<size_t> counts;
+  for (size_t pairs = 1; pairs < max_pairs; pairs *= 2) {
+    counts.push_back(pairs);
+  }
+  counts.push_back(max_pairs);
+  double alone = 0;
+  for (size_t pairs : counts) {
+    std::vector<std::shared_ptr<Session>> sessions;
+    for (size_t k = 0; k < pairs; k++) {
+      sessions.push_back(std::allocate_shared<Session>(CacheLineAllocator<Session>()));
+    }
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> threads;
+    for (size_t k = 0; k < pairs; k++) {
+      Session &session = *sessions[k];
+      threads.push_back(std::thread([&session, &stop] { Loop(session, stop); }));
+      threads.push_back(
+          std::thread([&session, &stop, metrics] { Solve(session, stop, metrics); }));
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(true);
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+
+    double slowest = INFINITY;
+    double sum = 0;
+    for (const std::shared_ptr<Session> &session : sessions) {
+      const double rate = session->round_trips / seconds;
+      slowest = std::min(slowest, rate);
+      sum += rate;
+    }
+    const double mean = sum / pairs;
+    if (pairs == 1) {
+      alone = mean;
+    }
+    std::cout << std::setw(10) << pairs << std::fixed << std::setprecision(0) << std::setw(14)
+              << slowest << std::setw(14) << mean << std::setprecision(2) << std::setw(10)
+              << mean / alone << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "KinematicModel.h"
+#include "Log.h"
+#include "MPC.h"
+#include "Polynomial.h"
+#include "SolverBackend.h"
+#include "TerminalCost.h"
+#include "VehicleFrame.h"
+
+// Head-to-head benchmark of the solver backends on identical inputs.
+//
+//   ./benchmark_solvers [N] [ticks] [waypoints]
+//
+// The Ipopt backend drives the kinematic model around the waypoints
+// (lake_track_waypoints.csv by default) for ticks control ticks (600 by
+// default), and the state and polynomial handed to every Solve are recorded
+// the way main.cpp builds them. Each backend then solves the same recorded
+// sequence, warm starting from its own previous plans, and is compared with
+// the Ipopt solution of the same tick, along with the mean number of
+// iterations of its solves (0 for the RTI). A second table does the same
+// for Ipopt on the horizons of 8 and 10 stages shorter than N, without and
+// with the LQR terminal cost (see TerminalCost.h): how close a short horizon
+// comes to the actuations of the long one, and at what solve time. The
+// backends log every solve to stdout; that is switched off, so the tables are
+// the only output.
+
+namespace {
+
+// Control period and actuation latency of main.cpp
+const double kTick = 0.1;
+// Waypoints fitted each tick, like the simulator sends
+const size_t kFitPoints = 6;
+
+struct Tick {
+  MPCState state;
+  MPCCoeffs coeffs;
+};
+
+struct Reference {
+  double delta;
+  double a;
+  double cost;
+};
+
+bool LoadWaypoints(const std::string &path, std::vector<double> &xs, std::vector<double> &ys) {
+  std::ifstream in(path.c_str());
+  std::string line;
+  std::getline(in, line);  // header
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    double x;
+    double y;
+    char comma;
+    if (fields >> x >> comma >> y) {
+      xs.push_back(x);
+      ys.push_back(y);
+    }
+  }
+  return xs.size() > kFitPoints;
+}
+
+// The input main.cpp hands to Solve for the vehicle at (px, py, psi, v) after
+// applying delta, a: the waypoints ahead in the vehicle frame, fitted by a
+// cubic, and the state predicted one tick ahead
+Tick Measure(const std::vector<double> &xs, const std::vector<double> &ys, double px, double py,
+             double psi, double v, double delta, double a) {
+  size_t closest = 0;
+  double best = std::numeric_limits<double>::infinity();
+  for (size_t i = 0; i < xs.size(); i++) {
+    const double d = (xs[i] - px) * (xs[i] - px) + (ys[i] - py) * (ys[i] - py);
+    if (d < best) {
+      best = d;
+      closest = i;
+    }
+  }
+
+  double fx[kFitPoints];
+  double fy[kFitPoints];
+  for (size_t k = 0; k < kFitPoints; k++) {
+    const size_t i = (closest + xs.size() - 1 + k) % xs.size();
+    fx[k] = xs[i];
+    fy[k] = ys[i];
+  }
+
+  Tick tick;
+  tick.coeffs = FitInVehicleFrame<3>(px, py, psi, fx, fy, kFitPoints, fx, fy);
+  const double cte = polyeval(tick.coeffs, 0);
+  const double epsi = -atan(tick.coeffs[1]);
+  const double predicted_psi = -v * delta / Lf * kTick;
+  tick.state << v * kTick, 0, predicted_psi, v + a * kTick, cte + v * sin(epsi) * kTick,
+      epsi + predicted_psi;
+  return tick;
+}
+
+// Means over the ticks of a backend replaying the recorded inputs, compared
+// with the reference solutions
+struct Stats {
+  double mean_us = 0;
+  double max_us = 0;
+  double iterations = 0;
+  size_t failed = 0;
+  double cost_ratio = 0;
+  double delta_error = 0;
+  double a_error = 0;
+};
+
+Stats Replay(MPCBase &mpc, const std::vector<Tick> &ticks,
+             const std::vector<Reference> &solutions) {
+  Stats stats;
+  double prev_a = 0;
+  for (size_t k = 0; k < ticks.size(); k++) {
+    mpc.prev_a = prev_a;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const MPCSolution result = mpc.Solve(ticks[k].state, ticks[k].coeffs);
+    const double us = std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - start).count();
+    mpc.Prepare();
+    prev_a = solutions[k].a;
+
+    // The first solve is cold for every backend, leave it out of the times
+    if (k > 0) {
+      stats.mean_us += us;
+      stats.max_us = std::max(stats.max_us, us);
+    }
+    stats.iterations += mpc.iterations();
+    if (mpc.status() == SolveStatus::kFailed) {
+      stats.failed++;
+    }
+    stats.cost_ratio += mpc.cost() / std::max(solutions[k].cost, 1e-9);
+    stats.delta_error += fabs(result.delta[0] - solutions[k].delta);
+    stats.a_error += fabs(result.a[0] - solutions[k].a);
+  }
+  const double n = static_cast<double>(ticks.size());
+  stats.mean_us /= n - 1;
+  stats.iterations /= n;
+  stats.cost_ratio /= n;
+  stats.delta_error /= n;
+  stats.a_error /= n;
+  return stats;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  MPCProblem problem;
+  problem.horizon = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 15;
+  const size_t n_ticks = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 600;
+  const std::string path = argc > 3 ? argv[3] : "lake_track_waypoints.csv";
+  if (n_ticks < 2) {
+    std::cerr << "Run at least 2 ticks" << std::endl;
+    return -1;
+  }
+
+  std::vector<double> xs;
+  std::vector<double> ys;
+  if (!LoadWaypoints(path, xs, ys)) {
+    std::cerr << "Could not read the waypoints of " << path << std::endl;
+    return -1;
+  }
+
+  std::unique_ptr<MPCBase> reference = MakeSolver(SolverBackend::kIpopt, problem);
+  if (!reference) {
+    std::cerr << "No MPC compiled for a horizon of " << problem.horizon
+              << " timesteps, use 10, 15 or 25" << std::endl;
+    return -1;
+  }
+
+  // Silence the Cost lines of the backends, they would be timed too
+  SetLogLevel(LogLevel::kWarning);
+  std::ostream &out = std::cout;
+
+  // Record the inputs by driving the model with the reference, started on
+  // the first waypoint heading to the second
+  std::vector<Tick> ticks;
+  std::vector<Reference> solutions;
+  double px = xs[0];
+  double py = ys[0];
+  double psi = atan2(ys[1] - ys[0], xs[1] - xs[0]);
+  double v = 10;
+  double delta = 0;
+  double a = 0;
+  for (size_t k = 0; k < n_ticks; k++) {
+    const Tick tick = Measure(xs, ys, px, py, psi, v, delta, a);
+    reference->prev_a = a;
+    const MPCSolution result = reference->Solve(tick.state, tick.coeffs);
+    ticks.push_back(tick);
+    solutions.push_back({result.delta[0], result.a[0], result.cost});
+
+    // The latency is a whole tick: the last actuations act until the next
+    // measurement, the new ones from then on
+    px += v * cos(psi) * kTick;
+    py += v * sin(psi) * kTick;
+    psi -= v * delta / Lf * kTick;
+    v += a * kTick;
+    delta = result.delta[0];
+    a = result.a[0];
+  }
+
+  out << std::setw(14) << "backend" << std::setw(12) << "mean us" << std::setw(12) << "max us"
+      << std::setw(8) << "iters" << std::setw(8) << "failed" << std::setw(12) << "cost/ref"
+      << std::setw(12) << "|d delta|" << std::setw(12) << "|d a|" << std::endl;
+  const auto print_backend = [&out](const std::string &name, const Stats &stats) {
+    out << std::setw(14) << name << std::setw(12) << std::fixed << std::setprecision(1)
+        << stats.mean_us << std::setw(12) << stats.max_us << std::setw(8) << stats.iterations
+        << std::setw(8) << stats.failed << std::setw(12) << std::setprecision(4)
+        << stats.cost_ratio << std::setw(12) << stats.delta_error << std::setw(12)
+        << stats.a_error << std::endl;
+  };
+  for (SolverBackend backend : kSolverBackends) {
+    std::unique_ptr<MPCBase> mpc = MakeSolver(backend, problem);
+    if (!mpc) {
+      continue;
+    }
+    print_backend(SolverBackendName(backend), Replay(*mpc, ticks, solutions));
+  }
+  // Ipopt with the reference sampled along its starting point instead of
+  // the polynomial in the tape
+  std::unique_ptr<MPCBase> sampled = MakeSolver(SolverBackend::kIpopt, problem);
+  sampled->SampleReference(true);
+  print_backend("ipopt-sampled", Replay(*sampled, ticks, solutions));
+  // Ipopt with the step of a stage a checkpoint function the tape calls for
+  // every stage, its sweeps against those of the whole tape
+  std::unique_ptr<MPCBase> checkpointed = MakeSolver(SolverBackend::kIpopt, problem);
+  checkpointed->CheckpointStages(true);
+  print_backend("ipopt-checkpt", Replay(*checkpointed, ticks, solutions));
+
+  // The shorter horizons with Ipopt, without and with the LQR terminal cost
+  // of their timestep, against the same reference
+  out << std::endl
+      << std::setw(14) << "horizon" << std::setw(10) << "terminal" << std::setw(12) << "mean us"
+      << std::setw(12) << "max us" << std::setw(8) << "failed" << std::setw(12) << "|d delta|"
+      << std::setw(12) << "|d a|" << std::endl;
+  for (size_t horizon : {8, 10}) {
+    if (horizon >= problem.horizon) {
+      continue;
+    }
+    for (bool terminal : {false, true}) {
+      MPCProblem short_problem;
+      short_problem.horizon = horizon;
+      std::unique_ptr<MPCBase> mpc = MakeSolver(SolverBackend::kIpopt, short_problem);
+      if (!mpc) {
+        continue;
+      }
+      if (terminal) {
+        mpc->cost_schedule.AddPoint(0, LQRTerminalCost(CostWeights(), mpc->timestep()));
+      }
+      const Stats stats = Replay(*mpc, ticks, solutions);
+      std::ostringstream name;
+      name << mpc->horizon_length() << " x " << mpc->timestep();
+      out << std::setw(14) << name.str() << std::setw(10) << (terminal ? "lqr" : "none")
+          << std::setw(12) << std::fixed << std::setprecision(1) << stats.mean_us
+          << std::setw(12) << stats.max_us << std::setw(8) << stats.failed << std::setw(12)
+          << std::setprecision(4) << stats.delta_error << std::setw(12) << stats.a_error
+          << std::endl;
+    }
+  }
+  return 0;
+}
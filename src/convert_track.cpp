@@ -0,0 +1,51 @@
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "TrackMap.h"
+
+// Converter of a csv of waypoints into the binary map read by
+// "./mpc <N> <solver> track=<path>".
+//
+//   ./convert_track [csv] [map]
+//
+// Fits the spline through the waypoints of csv (lake_track_waypoints.csv by
+// default), builds its index and writes both to map (lake_track.map by
+// default), then maps the file back and checks it against them.
+int main(int argc, char *argv[]) {
+  const std::string csv = argc > 1 ? argv[1] : "lake_track_waypoints.csv";
+  const std::string path = argc > 2 ? argv[2] : "lake_track.map";
+
+  std::vector<double> xs;
+  std::vector<double> ys;
+  if (!TrackSpline::Load(csv, xs, ys)) {
+    std::cerr << "Could not read the waypoints of " << csv << std::endl;
+    return -1;
+  }
+  const TrackMap map(xs, ys);
+  if (!map.Save(path)) {
+    std::cerr << "Could not write " << path << std::endl;
+    return -1;
+  }
+
+  std::unique_ptr<TrackMap> loaded = TrackMap::Load(path);
+  if (!loaded) {
+    std::cerr << "Could not map " << path << " back" << std::endl;
+    return -1;
+  }
+  for (size_t i = 0; i < 100; i++) {
+    const double s = map.spline().length() * i / 100;
+    const TrackPoint p = map.spline().At(s);
+    const TrackPoint q = loaded->spline().At(s);
+    const TrackMatch a = map.index().Nearest(p.x + 1, p.y - 1);
+    const TrackMatch b = loaded->index().Nearest(p.x + 1, p.y - 1);
+    if (p.x != q.x || p.y != q.y || a.segment != b.segment || a.s != b.s) {
+      std::cerr << path << " differs from the track at " << s << " m" << std::endl;
+      return -1;
+    }
+  }
+  std::cerr << "Wrote " << path << ": " << xs.size() << " waypoints, "
+            << map.index().segments() << " segments, " << map.spline().length() << " m"
+            << std::endl;
+  return 0;
+}
@@ -0,0 +1,41 @@
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "ExplicitMPC.h"
+#include "MPC.h"
+
+// Offline generator of the ExplicitMPC table used by "./mpc <N> <solver> table".
+//
+//   ./generate_table [path] [N]
+//
+// Solves the FG_eval problem of every node of the default grid with Ipopt over
+// N timesteps (15 by default) and writes the table to path
+// (explicit_mpc.table by default).
+int main(int argc, char *argv[]) {
+  const std::string path = argc > 1 ? argv[1] : "explicit_mpc.table";
+  const size_t horizon = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 15;
+
+  std::unique_ptr<MPCBase> mpc = MakeMPC(horizon);
+  if (!mpc) {
+    std::cerr << "No MPC compiled for a horizon of " << horizon
+              << " timesteps, use 10, 15 or 25" << std::endl;
+    return -1;
+  }
+  // Offline, so let every node converge
+  mpc->max_solve_time = 1.0;
+
+  ExplicitMPC table(ExplicitMPC::DefaultAxes());
+  std::cerr << "Solving " << table.size() << " nodes" << std::endl;
+  const size_t failed = table.Generate(*mpc);
+  if (failed > 0) {
+    std::cerr << failed << " nodes failed to solve and are left out" << std::endl;
+  }
+
+  if (!table.Save(path)) {
+    std::cerr << "Could not write " << path << std::endl;
+    return -1;
+  }
+  std::cerr << "Wrote " << path << std::endl;
+  return 0;
+}
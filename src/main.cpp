@@ -1,273 +1,3538 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
 #include <cmath>
 #include <uWS/uWS.h>
 #include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <vector>
 #include <cppad/cppad.hpp>
 #include <cppad/ipopt/solve.hpp>
 #include "Eigen-3.3/Eigen/Core"
-#include "Eigen-3.3/Eigen/QR"
+#include "AdaptiveHorizonMPC.h"
+#include "Admission.h"
+#include "Allocations.h"
+#include "BatchMPC.h"
+#include "CpuQuota.h"
+#include "CppADThreads.h"
+#include "DelayQueue.h"
+#include "EventTriggeredMPC.h"
+#include "ExplicitMPC.h"
+#include "FlightRecorder.h"
+#include "FrenetReference.h"
+#include "Instrumentation.h"
+#include "IpoptTuning.h"
+#include "KinematicModel.h"
+#include "LatencyEstimator.h"
+#include "LinearSolverThreads.h"
+#include "LinearizationTable.h"
+#include "LinesPolicy.h"
+#include "Log.h"
+#include "Mailbox.h"
 #include "MPC.h"
+#include "MessagePack.h"
+#include "MessageView.h"
+#include "Metrics.h"
+#include "MultiStartMPC.h"
+#include "NeuralPolicy.h"
+#include "ObserverFeed.h"
+#include "Polynomial.h"
+#include "ProblemCapture.h"
+#include "ProximityGrid.h"
+#include "RealTime.h"
+#include "ReceiveTimestamps.h"
+#include "ReferenceFit.h"
+#include "ReferenceTable.h"
+#include "RefiningMPC.h"
+#include "RegimeMPC.h"
+#include "RoutedMPC.h"
+#include "RuntimeConfig.h"
+#include "SensitivityMPC.h"
+#include "Session.h"
+#include "SessionPipeline.h"
+#include "SharedArtifact.h"
+#include "SharedChannel.h"
+#include "SimdKernels.h"
+#include "Soak.h"
+#include "SocketIOFrame.h"
+#include "SolveCache.h"
+#include "SolverSnapshot.h"
+#include "SolverBackend.h"
+#include "SpeculativeMPC.h"
+#include "SteerMessage.h"
+#include "Telemetry.h"
+#include "TerminalCost.h"
+#include "TrackMap.h"
+#include "TrackPlanner.h"
+#include "VehicleFrame.h"
+#include "WarmUp.h"
+#include "WaypointHistory.h"
 #include "json.hpp"
 
 // for convenience
 using json = nlohmann::json;
 
-// For converting back and forth between radians and degrees.
-constexpr double pi() { return M_PI; }
-double deg2rad(double x) { return x * pi() / 180; }
-double rad2deg(double x) { return x * 180 / pi(); }
-
-// Checks if the SocketIO event has JSON data.
-// If there is data the JSON object in string format will be returned,
-// else the empty string "" will be returned.
-string hasData(const string &s) {
-  auto found_null = s.find("null");
-  auto b1 = s.find_first_of('[');
-  auto b2 = s.rfind("}]");
-  if (found_null != string::npos) {
-    return "";
-  } else if (b1 != string::npos && b2 != string::npos) {
-    return s.substr(b1, b2 - b1 + 2);
-  }
-  return "";
-}
+// Distance from the track past which the car is found again from scratch,
+// e.g. after a reset of the simulator, in m
+const double kTrackRecapture = 10;
+// Distance ahead of the car the waypoint history is fitted over, in m
+const double kHistoryLookAhead = 50;
+// The points of the racing line of a plan the cubic is fitted to, over the
+// look-ahead of the center line's (see TrackSpline::LocalReference)
+const size_t kPlanPoints = 7;
+const double kPlanLookAhead = 30;
+// How often the stages of the ticks of a session are summarized in the log
+const std::chrono::seconds kStageSummaryPeriod(10);
+// The cost of a unit of slack of the soft constraints
+const double kSoftPenalty = 1e5;
+// Bins of the track whose plans a solver keeps with "lapcache", 5 m and
+// 5 mph each: the lake track is some 230 stations long
+const size_t kLapCacheEntries = 2048;
+// The last ticks of a solver thread a burst of deadline misses is counted
+// over, for the black box
+const size_t kBurstWindow = 20;
+// The ticks of a solver thread its ring for the observers holds, some 10 s
+// of 16 sessions at 10 Hz, for the observer thread to fall behind by
+const size_t kObserverTicks = 2048;
+// How often a solver thread takes the snapshot of its sessions with
+// "snapshot", and the ticks in a row a restored session solves warm and as
+// quickly as before it is counted steady again
+const std::chrono::seconds kSnapshotPeriod(10);
+const size_t kSteadyTicks = 3;
+// Batches a client of the problem service may have waiting for the solver
+// before the next is refused
+const size_t kMaxProblemBatches = 16;
 
-// Evaluate a polynomial.
-double polyeval(Eigen::VectorXd coeffs, double x) {
-  double result = 0.0;
-  for (int i = 0; i < coeffs.size(); i++) {
-    result += coeffs[i] * pow(x, i);
+int main(int argc, char *argv[]) {
+  // "config=<path>" anywhere on the command line: the settings of a file,
+  // "name = value" a line (see LoadConfigFile), the horizon, solver,
+  // weights, budget, tolerances and CPU quota of the first configuration by
+  // the names of POST /config, and any of the flags below by theirs, e.g.
+  // "workers = 4", "record = /var/mpc" or "blocked". The command line is
+  // then read as if the flags of the file came first, so its own win; the
+  // horizon and solver of the file are those unless the command line starts
+  // with a horizon.
+  RuntimeConfig file_config;
+  std::vector<std::string> arguments(argv, argv + argc);
+  std::vector<std::string> file_flags;
+  const std::string config_flag = "config=";
+  for (size_t i = 1; i < arguments.size();) {
+    if (arguments[i].compare(0, config_flag.size(), config_flag) != 0) {
+      i++;
+      continue;
+    }
+    std::string error;
+    if (!LoadConfigFile(arguments[i].substr(config_flag.size()), file_config, file_flags,
+                        error)) {
+      std::cerr << "Bad configuration, " << error << std::endl;
+      return -1;
+    }
+    arguments.erase(arguments.begin() + i);
   }
-  return result;
-}
+  const bool positional = arguments.size() > 1 && std::isdigit(static_cast<unsigned char>(arguments[1][0]));
+  if (!positional) {
+    arguments.insert(arguments.begin() + 1, std::to_string(file_config.horizon));
+  }
+  if (!positional || arguments.size() < 3) {
+    arguments.insert(arguments.begin() + 2, SolverBackendName(file_config.solver));
+  }
+  arguments.insert(arguments.begin() + 3, file_flags.begin(), file_flags.end());
+  std::vector<char *> argument_pointers;
+  for (std::string &argument : arguments) {
+    argument_pointers.push_back(&argument[0]);
+  }
+  argc = static_cast<int>(argument_pointers.size());
+  argv = argument_pointers.data();
 
-// Fit a polynomial.
-// Adapted from
-// https://github.com/JuliaMath/Polynomials.jl/blob/master/src/Polynomials.jl#L676-L716
-Eigen::VectorXd polyfit(Eigen::VectorXd xvals, const Eigen::VectorXd &yvals,
-                        int order) {
-  assert(xvals.size() == yvals.size());
-  assert(order >= 1 && order <= xvals.size() - 1);
-  Eigen::MatrixXd A(xvals.size(), order + 1);
+  // Number of timesteps of the horizon, 15 unless given on the command line
+  // or in the file,
+  // then the solver: "ipopt" (default), "analytic" for Ipopt with closed form
+  // derivatives, "autodiff" for Ipopt with AutoDiffScalar stage derivatives,
+  // "compiled" for Ipopt with the compiled model, "chunked" for Ipopt with
+  // the derivatives of chunks of the horizon on every core,
+  // "gauss-newton" for Ipopt with the Gauss-Newton Hessian, "sqp" for SQP
+  // on the condensed QP, "sqp-float" for the same with single precision
+  // QPs, "rti" for one SQP step per tick, "ipm" for the
+  // Riccati interior-point method, "admm" for ADMM on the linearized QP,
+  // "ilqr" for iterative LQR or "decoupled" for the speed profile then the
+  // steering over it
+  const size_t horizon = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 15;
+  SolverBackend solver = SolverBackend::kIpopt;
+  if (argc > 2 && !ParseSolverBackend(argv[2], solver)) {
+    std::cerr << "Unknown solver " << argv[2]
+              << ", use ipopt, analytic, autodiff, compiled, chunked, gauss-newton, sqp, sqp-float, rti, ipm, admm, ilqr or decoupled" << std::endl;
+    return -1;
+  }
+  const bool ipopt = solver == SolverBackend::kIpopt || solver == SolverBackend::kIpoptAnalytic ||
+                     solver == SolverBackend::kIpoptAutoDiff ||
+                     solver == SolverBackend::kIpoptCompiled ||
+                     solver == SolverBackend::kIpoptChunked;
+  const Derivatives derivatives = IpoptDerivatives(solver);
 
-  for (int i = 0; i < xvals.size(); i++) {
-    A(i, 0) = 1.0;
+  // "blocked" after the solver: hold the actuations over blocks of stages.
+  // "adaptive": pick the horizon every tick from the speed and the solve
+  // times, with Ipopt only (the horizon argument is then ignored).
+  // "regimes": pick the MPC every tick from the curvature of the reference
+  // ahead, 8 steps of 0.2 s on straights, 15 of 0.1 s in curves and in
+  // hairpins, those at a slower reference speed (see RegimeMPC), with Ipopt
+  // only (the horizon argument is then ignored; the hairpins keep their own
+  // weights over those of terminal).
+  // "routes": route every tick to the Ipopt solver, the RTI's QP or, with
+  // table, the explicit MPC table, from the curvature of the reference
+  // ahead, the speed, the tracking errors, the time of the solve and the
+  // solve times of the routes (see RoutedMPC), with Ipopt only; the
+  // horizon argument is that of all three. "routelog=<path>" writes every
+  // decision and how its solve went to the CSV file path, for tuning the
+  // policy offline.
+  // "dynamic=<mph>": plan 15 steps with the dynamic bicycle model, the
+  // slip of the tyres, from that speed on and with the kinematic one below
+  // it, with Ipopt only (the horizon argument is then ignored).
+  // "multistart": solve from several starting points concurrently, with
+  // Ipopt only, and keep the cheapest plan.
+  // "recall": keep past solutions and start from the nearest one after the
+  // state jumps, with Ipopt only.
+  // "lapcache" with "track" or "history": keep the plans of every 5 m of
+  // the track at every 5 mph, the 2048 used last, and start from that of
+  // the car's bin when the last plan is a poor start, e.g. back on the
+  // line after leaving it, with Ipopt only (see TrackSolutionCache).
+  // "effort": lower the Ipopt tolerances and iteration limit while the p99
+  // solve time is over its target, e.g. on a loaded host, with Ipopt only.
+  // "soft": relax the model constraints with penalized slacks, so that no
+  // state leaves Ipopt without a feasible point, with Ipopt only.
+  // "terminal": weigh the last stage with the LQR cost to go of the model
+  // (see TerminalCost.h), so that a shorter horizon steers like a longer
+  // one, with Ipopt only.
+  // "sampled": Ipopt takes the reference sampled along its starting point
+  // as parameters instead of the polynomial inside its tape (see
+  // MPCBase::SampleReference), with Ipopt only.
+  // "checkpoint": record the step of a stage once, as a CppAD checkpoint
+  // function the tape of Ipopt calls for every stage (see
+  // MPCBase::CheckpointStages), for the long horizons, with Ipopt only.
+  // "lintable": take the model Jacobians of the SQP, RTI and ADMM from a
+  // table built at startup instead of closed form.
+  // "track": take the reference from a spline of lake_track_waypoints.csv
+  // (see TrackSpline) instead of fitting the waypoints of every message;
+  // "track=<path>" of another csv, or of a map made by convert_track when
+  // path ends in ".map" (see TrackMap).
+  // "shared": build the linearization table, the explicit MPC table and the
+  // map of a csv track once per host, into files of /dev/shm/mpc-<uid> or
+  // $MPC_ARTIFACTS that every server process maps read only (see
+  // SharedArtifact.h); "artifacts=<dir>" into dir instead.
+  // "tracktable" with "track": the SQP solvers, or Ipopt with "sampled",
+  // follow a table of the track ahead (see ReferenceTable) in their model
+  // instead of the cubic.
+  // "frenet" with "track": the SQP solvers solve in path coordinates along
+  // the curvature of the track (see FrenetReference) instead of the vehicle
+  // frame and the cubic.
+  // "history": keep the waypoints of the messages so far and fit the
+  // reference over those ahead of the car (see WaypointHistory), then the
+  // spline of the track through them once they go around it.
+  // "plan" with "track" or "history": plan a racing line and the speed
+  // along it over the 300 m of the track ahead on a thread of every
+  // session, twice a second ("planrate=<hz>" for another rate), and have
+  // the MPC track them, the cubic fitted to the line and the reference
+  // speed of the cost that of the plan (see TrackPlanner).
+  // "proximity=<m>": in multi-vehicle sessions, find the stages of the
+  // plans of the last tick of two cars less than that many meters and a
+  // stage apart through a spatial hash (see ProximityGrid), and hold the
+  // car of each pair that gets there later to a reference speed that keeps
+  // it that far short of the other; off by default.
+  // "floatfit": fit the waypoints as a Chebyshev series in single
+  // precision (see ReferenceFitCache).
+  // "prefit": parse the telemetry and fit its waypoints on the event loop
+  // as it comes in, while the solver thread solves the last frame, for the
+  // tick to take them ready (see PreparedFrame); not with track or history,
+  // whose references the solver thread keeps.
+  // "reforder=<m>": fit a line or a parabola instead of the cubic when it
+  // follows the waypoints within that many meters, root mean square, and
+  // solve along it with a tape of its order, where the solver has one (see
+  // MPCBase::SetReferenceOrder); off by default.
+  // "warmup=<rounds>": rounds of synthetic solves before listening, 1 by
+  // default, 0 for none (see WarmUp).
+  // "tune" with Ipopt: measure the Ipopt options of this host before
+  // listening, the linear solvers it finds, the barrier updates, the
+  // Hessians and the threads of the chunked derivatives, over the warm-up
+  // problems, keep the fastest in the tuning file and solve with them (see
+  // IpoptTuning.h). Without it the options an earlier "tune" kept for this
+  // host, solver and horizon are loaded from the file, if it has them.
+  // With the tape's derivatives (ipopt and ipopt-gn), "tune" then measures
+  // the strategies of their sparse evaluation on top of the fastest
+  // options, the forward and the reverse Jacobian and the colourings of
+  // CppAD and of ColPack, and keeps the fastest with them.
+  // "tuning=<path>": the file, $XDG_CACHE_HOME/mpc/ipopt_tuning.json or
+  // ~/.cache/mpc/ipopt_tuning.json by default.
+  // "sparsity=<jacobian>,<coloring>,<hessian coloring>" with ipopt or
+  // ipopt-gn: evaluate the tape's derivatives so instead of as tuned, e.g.
+  // "reverse,cppad,cppad.general" (see MPC_NLP::SetTapeSparsity).
+  // "linsolver=<name>" with Ipopt: factor the KKT systems with mumps, ma27,
+  // ma57, ma86, ma97 or pardiso instead of as tuned, checked at startup to
+  // be there; "linsolverthreads=<n>": on n OpenMP threads a solver thread,
+  // for the multithreaded ones, by default the cores shared among the
+  // workers so that the solves of the workers don't oversubscribe them (see
+  // LinearSolverThreads.h).
+  // "snapshot=<dir>": every 10 s, keep the starts, past solutions and last
+  // throttles of the sessions of each worker in a file of dir, and at start
+  // hand those the last process kept, if it was on this host with the
+  // same model, solver and horizon, to the first sessions to connect, the
+  // most experienced first, logging how many ticks and seconds each takes
+  // to solve warm as quickly as before (see SolverSnapshot.h).
+  // "lines=<k>": send the lines to draw on every k-th reply only, none for
+  // 0; "decimals=<d>": write them with d decimals in JSON, 3 by default.
+  // Both are defaults a client can override in the query of its url (see
+  // LinesPolicy).
+  // "maxbuffered=<bytes>": hold back the commands to a client while more
+  // than that many bytes to it are still unsent, sending only the newest
+  // once it catches up, 65536 by default, 0 for no limit (see DelayQueue).
+  // "cork[=<ms>]": hold the frames the event loops send and write those of
+  // a socket together, at most that many milliseconds after the first, 0
+  // by default, on the next turn of the loop: a write a socket a flush
+  // rather than one a frame, with many sessions a worker (see CorkedSends).
+  // "port=<n>": listen to port n, 4567 by default.
+  // "latency=<ms>": the delay from telemetry to actuation the first tick of
+  // a session predicts over, before any is measured, 100 by default (see
+  // LatencyEstimator).
+  // "maxage=<ms>": drop the telemetry that has waited longer than that by
+  // the time the solver takes it, unparsed, 250 by default, 0 for no limit.
+  // "workers=<n>": serve the simulators on n workers, each an event loop
+  // and a solver thread of its own sharing the port, 1 by default.
+  // "steal" with workers: a solver thread with no telemetry of its own
+  // waiting solves that of the sessions of a busy worker, those of the
+  // solvers without CppAD tapes only (the SQP, RTI, IPM, ADMM and iLQR
+  // backends, without adaptive or dynamic), while their own worker keeps
+  // every session it can get to itself.
+  // "pin=<cpu>": keep the solver thread of the first worker on cpu, of the
+  // next on the next cpu and so on, Linux only; "iopin=<cpu>": the same for
+  // the event loops.
+  // "numa": keep both threads of every worker on one NUMA node, the workers
+  // spread over the nodes in turn, or each on the node of the cpu its
+  // solver is pinned to, and the worker, its solvers and its sessions
+  // allocated there; with steal, a worker steals only from the workers of
+  // its node (see RealTime.h), Linux only.
+  // "realtime[=<priority>]": run the solver threads under SCHED_FIFO at
+  // priority, 80 by default, and the event loops one above, lock the memory
+  // of the process and fault in the stacks and heaps of the threads, each
+  // step reported (see RealTime.h), Linux only.
+  // "busypoll[=<us>]": have the event loops poll their sockets and the
+  // solver threads their doorbells in a loop instead of sleeping until
+  // something comes, for the frames to be taken in the time of a poll
+  // rather than that of a wakeup, served as mpc_wakeup_seconds either way.
+  // A thread that finds nothing for a while backs off, pausing, yielding
+  // and at last sleeping that many microseconds between its polls, 50 by
+  // default; "busypoll=0" never sleeps and holds both cores of every
+  // worker for good (see BusyPollPolicy). Best with pin and iopin.
+  // "record=<dir>": record every telemetry frame and command as it was on
+  // the wire into segments of files in dir, for mpc_replay (see
+  // FlightRecorder); "recordsize=<MiB>" of 64 MiB by default,
+  // "recordkeep=<n>" keeping the newest 16 by default, 0 for all.
+  // "capture=<dir>": write the problem of every solve slower than 20 ms
+  // into a file of dir, for mpc_replay problem=<file> to solve again (see
+  // ProblemCapture.h); "captureslow=<ms>" for another threshold,
+  // "capturekeep=<n>" for another limit than 100 files.
+  // "trace=<path>": write a timeline of the stages of the ticks and of the
+  // iterations of the solves on every thread to path, for chrome://tracing
+  // or ui.perfetto.dev, in builds with the full instrumentation (see
+  // Instrumentation.h and Trace.h).
+  // "perf": count the cycles, instructions, cache misses and branch misses
+  // of the stages of the ticks on the solver threads, and of the phases of
+  // the solves, into /metrics and the log (see PerfCounters.h), Linux only.
+  // "slo=<ms>": the control period the ticks are judged against, from the
+  // arrival of the telemetry to its reply, 100 ms by default (see
+  // ControlSLO.h).
+  // "edf": take the telemetry of every session of a worker before solving
+  // any, then solve it by its deadline, the control period from its
+  // arrival, the earliest first; a tick the solver of its session is
+  // expected to finish past the deadline goes to an RTI solver of the
+  // session instead, or a table with "table", unless the solver is an RTI
+  // or needs Ipopt (adaptive, dynamic, multistart, speculative). The time
+  // left at the start of every tick, the ticks demoted and those started
+  // late go to /metrics.
+  // "allocfree=<stage>,...": the stages of the ticks, by their names in the
+  // metrics like "fit,serialize", or "all" of them, that must not allocate;
+  // a tick that does is counted and logged (see Allocations.h).
+  // "log=<level>": the least severe records printed, "debug" for the
+  // messages to and from the simulator too, "info" (default), "warning",
+  // "error" or "off" (see Log.h).
+  // "admin": take changes of the weights, the reference speed, the
+  // horizon, the solver, the budget of a solve, the tolerances and the CPU
+  // quota of a session by POST /config?<name>=<value>&... while serving,
+  // picked up by every session at its next tick (see RuntimeConfig.h); GET
+  // /config shows them either way.
+  // The CPU time of every tick on the thread that solves it is charged to
+  // its session and shown in /metrics; with cpu_quota=<cores> in the
+  // configuration, a session that uses more than that on average over 2 s
+  // has its ticks solved by an RTI, like those edf demotes, until its use
+  // falls under 80% of the quota (see CpuQuota.h).
+  // "admission[=<cores>]": refuse the connections a worker has no room for,
+  // closed with 1013 (Try Again Later), once the sessions it has, at the
+  // cores their ticks were measured to use, and one more like them would
+  // use over that many cores of its solver thread, 0.8 by default; "shed"
+  // with it: admit them all, and solve the sessions of the lowest priority
+  // on an RTI while the worker is over, giving them their solvers back as
+  // it gets under 80% of it again. A client asks for its priority in the
+  // query of its url, "priority=<n>", 0 by default (see Admission.h).
+  // "blackbox=<dir>": keep the last 1024 ticks of every solver thread in
+  // memory ("blackboxticks=<n>" for another count), their telemetry, stage
+  // times, solves and commands, and dump them to a file in dir once 5 of
+  // the last 20 miss the control period ("blackboxburst=<misses>", 0 for
+  // never), on a crash, or on POST /blackbox with admin (see
+  // TickRecorder.h), in builds with the counters.
+  // "observe=<port>": stream every tick, its telemetry, state, solve,
+  // command and plan, as a line of JSON to whoever connects to port, for
+  // dashboards and loggers, from a thread at the idle priority that the
+  // solver threads only hand a copy of each tick to (see ObserverFeed.h).
+  // "baseline=<k>": every k-th tick of a session, after its reply, fit the
+  // waypoints and solve the state again without the caches, to measure what
+  // they saved into /metrics (see CacheBaseline.h), in builds with the
+  // counters.
+  // "commandrate=<hz>": send commands hz times a second between the
+  // replies, each the actuations of the plan of the last tick at the time
+  // it goes out, linear between its stages (see CommandPlan.h), so that the
+  // car is actuated faster than it is solved for; off by default.
+  // "rxtimestamps": take the arrival of the frames of a websocket from the
+  // kernel's receive timestamps rather than the clock of its message
+  // handler, so that the latencies and ages of the metrics cover the time
+  // frames waited in the socket's buffer for the event loop, itself served
+  // as mpc_socket_queue_seconds (see ReceiveTimestamps.h); off by default.
+  // "problemrate=<n>": at most n problems a second on average from each
+  // client of the problem service, in bursts of up to a second of them, its
+  // batches past that refused; no limit by default. "problemchunk=<n>": the
+  // problems of a batch solved at a time and sent back in one message, 16
+  // by default (see ProblemService.h).
+  bool move_blocking = false;
+  bool adaptive = false;
+  bool regimes = false;
+  bool routes = false;
+  std::string route_log_path;
+  double dynamic_speed = -1;
+  bool multistart = false;
+  bool recall = false;
+  bool lap_cache = false;
+  double proximity_radius = 0;
+  bool effort = false;
+  bool soft = false;
+  bool terminal = false;
+  bool sampled = false;
+  bool checkpoint = false;
+  bool track = false;
+  std::string track_path = "lake_track_waypoints.csv";
+  bool track_table = false;
+  bool history = false;
+  bool frenet = false;
+  bool linearization_table = false;
+  bool shared_artifacts = false;
+  std::string artifact_directory;
+  bool float_fit = false;
+  bool prefit = false;
+  double reference_order_tolerance = 0;
+  bool receive_timestamps = false;
+  bool perf_counters = false;
+  bool admin = false;
+  bool steal = false;
+  bool numa = false;
+  bool edf = false;
+  size_t baseline_period = 0;
+  bool plan = false;
+  double plan_rate = 2;
+  double problem_rate = 0;
+  double command_rate = 0;
+  size_t problem_chunk = 16;
+  std::string blackbox_directory;
+  size_t blackbox_ticks = 1024;
+  size_t blackbox_burst = 5;
+  int observe_port = 0;
+  size_t warm_up_rounds = 1;
+  bool tune = false;
+  std::string tuning_path = IpoptTuningFile::DefaultPath();
+  std::string sparsity;
+  std::string linear_solver;
+  size_t linear_solver_threads = 0;
+  std::string snapshot_directory;
+  size_t pooled_solvers = 4;
+  LogLevel log_level = LogLevel::kInfo;
+  size_t workers = 1;
+  size_t max_buffered = 65536;
+  bool cork = false;
+  long cork_ms = 0;
+  bool admission = false;
+  AdmissionPolicy admission_policy;
+  long max_age_ms = 250;
+  int port = 4567;
+  double latency_ms = 100;
+  LinesPolicy lines;
+  int pin_cpu = -1;
+  int io_pin_cpu = -1;
+  int realtime_priority = 0;
+  bool busy_poll = false;
+  BusyPollPolicy busy_poll_policy;
+  std::string record_directory;
+  size_t record_mib = 64;
+  size_t record_keep = 16;
+  bool record_compress = false;
+  std::string capture_directory;
+  double capture_ms = 20;
+  size_t capture_keep = 100;
+  std::string trace_path;
+  std::array<bool, kTickStages> allocation_free;
+  allocation_free.fill(false);
+  long control_period_ms = kControlPeriod.count();
+  for (int i = 3; i < argc; i++) {
+    const std::string max_buffered_flag = "maxbuffered=";
+    if (std::string(argv[i]).compare(0, max_buffered_flag.size(), max_buffered_flag) == 0) {
+      max_buffered = std::strtoul(argv[i] + max_buffered_flag.size(), nullptr, 10);
+    }
+    const std::string cork_flag = "cork=";
+    if (std::string(argv[i]) == "cork") {
+      cork = true;
+    } else if (std::string(argv[i]).compare(0, cork_flag.size(), cork_flag) == 0) {
+      cork = true;
+      cork_ms = std::atol(argv[i] + cork_flag.size());
+      if (cork_ms < 0) {
+        std::cerr << "The frames are held 0 or more milliseconds" << std::endl;
+        return -1;
+      }
+    }
+    const std::string admission_flag = "admission=";
+    if (std::string(argv[i]) == "admission") {
+      admission = true;
+    } else if (std::string(argv[i]).compare(0, admission_flag.size(), admission_flag) == 0) {
+      admission = true;
+      admission_policy.utilization = std::atof(argv[i] + admission_flag.size());
+      if (!(admission_policy.utilization > 0)) {
+        std::cerr << "The sessions of a worker are admitted up to more than 0 cores"
+                  << std::endl;
+        return -1;
+      }
+    }
+    if (std::string(argv[i]) == "shed") {
+      admission_policy.mode = AdmissionMode::kShed;
+    }
+    const std::string port_flag = "port=";
+    if (std::string(argv[i]).compare(0, port_flag.size(), port_flag) == 0) {
+      port = std::atoi(argv[i] + port_flag.size());
+      if (port < 1 || port > 65535) {
+        std::cerr << "The port is from 1 to 65535" << std::endl;
+        return -1;
+      }
+    }
+    const std::string latency_flag = "latency=";
+    if (std::string(argv[i]).compare(0, latency_flag.size(), latency_flag) == 0) {
+      latency_ms = std::strtod(argv[i] + latency_flag.size(), nullptr);
+      if (!(latency_ms >= 0)) {
+        std::cerr << "The latency is 0 or more milliseconds" << std::endl;
+        return -1;
+      }
+    }
+    const std::string max_age_flag = "maxage=";
+    if (std::string(argv[i]).compare(0, max_age_flag.size(), max_age_flag) == 0) {
+      max_age_ms = std::strtol(argv[i] + max_age_flag.size(), nullptr, 10);
+      if (max_age_ms < 0) {
+        std::cerr << "The maximum age of the telemetry is 0 or more milliseconds" << std::endl;
+        return -1;
+      }
+    }
+    const std::string lines_flag = "lines=";
+    const std::string decimals_flag = "decimals=";
+    if (std::string(argv[i]).compare(0, lines_flag.size(), lines_flag) == 0 ||
+        std::string(argv[i]).compare(0, decimals_flag.size(), decimals_flag) == 0) {
+      // The same parameters as the query of a client
+      const std::string query = std::string("?") + argv[i];
+      if (!ParseLinesQuery(MessageView(query.data(), query.size()), lines)) {
+        std::cerr << "Bad " << argv[i] << ", the lines need a count of 0 or more and the "
+                  << "decimals an integer" << std::endl;
+        return -1;
+      }
+    }
+    const std::string workers_flag = "workers=";
+    if (std::string(argv[i]).compare(0, workers_flag.size(), workers_flag) == 0) {
+      workers = std::strtoul(argv[i] + workers_flag.size(), nullptr, 10);
+    }
+    const std::string pin_flag = "pin=";
+    if (std::string(argv[i]).compare(0, pin_flag.size(), pin_flag) == 0) {
+      pin_cpu = std::atoi(argv[i] + pin_flag.size());
+    }
+    const std::string io_pin_flag = "iopin=";
+    if (std::string(argv[i]).compare(0, io_pin_flag.size(), io_pin_flag) == 0) {
+      io_pin_cpu = std::atoi(argv[i] + io_pin_flag.size());
+    }
+    const std::string realtime_flag = "realtime=";
+    if (std::string(argv[i]) == "realtime") {
+      realtime_priority = 80;
+    } else if (std::string(argv[i]).compare(0, realtime_flag.size(), realtime_flag) == 0) {
+      realtime_priority = std::atoi(argv[i] + realtime_flag.size());
+      // The event loops one above, within the priorities of SCHED_FIFO
+      if (realtime_priority < 1 || realtime_priority > 98) {
+        std::cerr << "The real-time priority is from 1 to 98" << std::endl;
+        return -1;
+      }
+    }
+    const std::string busy_poll_flag = "busypoll=";
+    if (std::string(argv[i]) == "busypoll") {
+      busy_poll = true;
+    } else if (std::string(argv[i]).compare(0, busy_poll_flag.size(), busy_poll_flag) == 0) {
+      busy_poll = true;
+      const long sleep_us = std::atol(argv[i] + busy_poll_flag.size());
+      if (sleep_us < 0) {
+        std::cerr << "The busy poll sleeps 0 or more microseconds" << std::endl;
+        return -1;
+      }
+      busy_poll_policy.sleep = std::chrono::microseconds(sleep_us);
+    }
+    const std::string record_flag = "record=";
+    if (std::string(argv[i]).compare(0, record_flag.size(), record_flag) == 0) {
+      record_directory = argv[i] + record_flag.size();
+      if (record_directory.empty()) {
+        std::cerr << "The flight recorder needs a directory" << std::endl;
+        return -1;
+      }
+    }
+    const std::string record_size_flag = "recordsize=";
+    if (std::string(argv[i]).compare(0, record_size_flag.size(), record_size_flag) == 0) {
+      record_mib = std::strtoul(argv[i] + record_size_flag.size(), nullptr, 10);
+      // The lengths inside a segment are of 32 bits
+      if (record_mib < 1 || record_mib > 4095) {
+        std::cerr << "The segments of the flight recorder are from 1 to 4095 MiB" << std::endl;
+        return -1;
+      }
+    }
+    const std::string record_keep_flag = "recordkeep=";
+    if (std::string(argv[i]).compare(0, record_keep_flag.size(), record_keep_flag) == 0) {
+      record_keep = std::strtoul(argv[i] + record_keep_flag.size(), nullptr, 10);
+    }
+    if (std::string(argv[i]) == "recordcompress") {
+      record_compress = true;
+    }
+    const std::string route_log_flag = "routelog=";
+    if (std::string(argv[i]).compare(0, route_log_flag.size(), route_log_flag) == 0) {
+      route_log_path = argv[i] + route_log_flag.size();
+    }
+    const std::string capture_flag = "capture=";
+    if (std::string(argv[i]).compare(0, capture_flag.size(), capture_flag) == 0) {
+      capture_directory = argv[i] + capture_flag.size();
+      if (capture_directory.empty()) {
+        std::cerr << "The problem capture needs a directory" << std::endl;
+        return -1;
+      }
+    }
+    const std::string capture_slow_flag = "captureslow=";
+    if (std::string(argv[i]).compare(0, capture_slow_flag.size(), capture_slow_flag) == 0) {
+      capture_ms = std::strtod(argv[i] + capture_slow_flag.size(), nullptr);
+    }
+    const std::string capture_keep_flag = "capturekeep=";
+    if (std::string(argv[i]).compare(0, capture_keep_flag.size(), capture_keep_flag) == 0) {
+      capture_keep = std::strtoul(argv[i] + capture_keep_flag.size(), nullptr, 10);
+    }
+    const std::string trace_flag = "trace=";
+    if (std::string(argv[i]).compare(0, trace_flag.size(), trace_flag) == 0) {
+      trace_path = argv[i] + trace_flag.size();
+      if (!kInstrumentFull) {
+        std::cerr << "Built without tracing, configure with -DMPC_INSTRUMENTATION=full"
+                  << std::endl;
+        return -1;
+      }
+    }
+    const std::string slo_flag = "slo=";
+    if (std::string(argv[i]).compare(0, slo_flag.size(), slo_flag) == 0) {
+      control_period_ms = std::strtol(argv[i] + slo_flag.size(), nullptr, 10);
+      if (control_period_ms <= 0) {
+        std::cerr << "The control period is 1 or more milliseconds" << std::endl;
+        return -1;
+      }
+    }
+    const std::string allocation_free_flag = "allocfree=";
+    if (std::string(argv[i]).compare(0, allocation_free_flag.size(), allocation_free_flag) == 0 &&
+        !ParseAllocationFree(argv[i] + allocation_free_flag.size(), allocation_free)) {
+      std::cerr << "Unknown stage in " << argv[i] << std::endl;
+      return -1;
+    }
+    const std::string log_flag = "log=";
+    if (std::string(argv[i]).compare(0, log_flag.size(), log_flag) == 0 &&
+        !ParseLogLevel(argv[i] + log_flag.size(), log_level)) {
+      std::cerr << "Unknown log level " << argv[i] + log_flag.size()
+                << ", use debug, info, warning, error or off" << std::endl;
+      return -1;
+    }
+    const std::string warm_up_flag = "warmup=";
+    if (std::string(argv[i]).compare(0, warm_up_flag.size(), warm_up_flag) == 0) {
+      warm_up_rounds = std::strtoul(argv[i] + warm_up_flag.size(), nullptr, 10);
+    }
+    const std::string proximity_flag = "proximity=";
+    if (std::string(argv[i]).compare(0, proximity_flag.size(), proximity_flag) == 0) {
+      proximity_radius = std::strtod(argv[i] + proximity_flag.size(), nullptr);
+      if (!(proximity_radius >= 0)) {
+        std::cerr << "The proximity needs a distance of 0 or more in m" << std::endl;
+        return -1;
+      }
+    }
+    const std::string reference_order_flag = "reforder=";
+    if (std::string(argv[i]).compare(0, reference_order_flag.size(), reference_order_flag) ==
+        0) {
+      reference_order_tolerance = std::strtod(argv[i] + reference_order_flag.size(), nullptr);
+      if (!(reference_order_tolerance >= 0)) {
+        std::cerr << "The reference order needs a tolerance of 0 or more in m" << std::endl;
+        return -1;
+      }
+    }
+    const std::string snapshot_flag = "snapshot=";
+    if (std::string(argv[i]).compare(0, snapshot_flag.size(), snapshot_flag) == 0) {
+      snapshot_directory = argv[i] + snapshot_flag.size();
+      if (snapshot_directory.empty()) {
+        std::cerr << "The snapshot needs a directory" << std::endl;
+        return -1;
+      }
+    }
+    const std::string tuning_flag = "tuning=";
+    if (std::string(argv[i]).compare(0, tuning_flag.size(), tuning_flag) == 0) {
+      tuning_path = argv[i] + tuning_flag.size();
+    }
+    const std::string linear_solver_flag = "linsolver=";
+    if (std::string(argv[i]).compare(0, linear_solver_flag.size(), linear_solver_flag) == 0) {
+      linear_solver = argv[i] + linear_solver_flag.size();
+    }
+    const std::string linear_solver_threads_flag = "linsolverthreads=";
+    if (std::string(argv[i]).compare(0, linear_solver_threads_flag.size(),
+                                     linear_solver_threads_flag) == 0) {
+      linear_solver_threads =
+          std::strtoul(argv[i] + linear_solver_threads_flag.size(), nullptr, 10);
+    }
+    const std::string sparsity_flag = "sparsity=";
+    if (std::string(argv[i]).compare(0, sparsity_flag.size(), sparsity_flag) == 0) {
+      sparsity = argv[i] + sparsity_flag.size();
+    }
+    const std::string pool_flag = "pool=";
+    if (std::string(argv[i]).compare(0, pool_flag.size(), pool_flag) == 0) {
+      pooled_solvers = std::strtoul(argv[i] + pool_flag.size(), nullptr, 10);
+    }
+    const std::string blackbox_flag = "blackbox=";
+    if (std::string(argv[i]).compare(0, blackbox_flag.size(), blackbox_flag) == 0) {
+      blackbox_directory = argv[i] + blackbox_flag.size();
+      if (blackbox_directory.empty()) {
+        std::cerr << "The black box needs a directory" << std::endl;
+        return -1;
+      }
+    }
+    const std::string blackbox_ticks_flag = "blackboxticks=";
+    if (std::string(argv[i]).compare(0, blackbox_ticks_flag.size(), blackbox_ticks_flag) == 0) {
+      blackbox_ticks = std::strtoul(argv[i] + blackbox_ticks_flag.size(), nullptr, 10);
+      if (blackbox_ticks < 2) {
+        std::cerr << "The black box keeps 2 or more ticks" << std::endl;
+        return -1;
+      }
+    }
+    const std::string blackbox_burst_flag = "blackboxburst=";
+    if (std::string(argv[i]).compare(0, blackbox_burst_flag.size(), blackbox_burst_flag) == 0) {
+      blackbox_burst = std::strtoul(argv[i] + blackbox_burst_flag.size(), nullptr, 10);
+    }
+    const std::string observe_flag = "observe=";
+    if (std::string(argv[i]).compare(0, observe_flag.size(), observe_flag) == 0) {
+      observe_port = std::atoi(argv[i] + observe_flag.size());
+      if (observe_port < 1 || observe_port > 65535) {
+        std::cerr << "The port of the observers is from 1 to 65535" << std::endl;
+        return -1;
+      }
+    }
+    const std::string baseline_flag = "baseline=";
+    if (std::string(argv[i]).compare(0, baseline_flag.size(), baseline_flag) == 0) {
+      baseline_period = std::strtoul(argv[i] + baseline_flag.size(), nullptr, 10);
+      if (baseline_period == 0) {
+        std::cerr << "The baseline is measured every 1 or more ticks" << std::endl;
+        return -1;
+      }
+    }
+    const std::string command_rate_flag = "commandrate=";
+    if (std::string(argv[i]).compare(0, command_rate_flag.size(), command_rate_flag) == 0) {
+      command_rate = std::strtod(argv[i] + command_rate_flag.size(), nullptr);
+      if (!(command_rate >= 0 && command_rate <= 1000)) {
+        std::cerr << "Commands are sampled from 0 to 1000 times a second" << std::endl;
+        return -1;
+      }
+    }
+    const std::string problem_rate_flag = "problemrate=";
+    if (std::string(argv[i]).compare(0, problem_rate_flag.size(), problem_rate_flag) == 0) {
+      problem_rate = std::strtod(argv[i] + problem_rate_flag.size(), nullptr);
+      if (problem_rate < 0) {
+        std::cerr << "The problem service takes 0 or more problems a second" << std::endl;
+        return -1;
+      }
+    }
+    const std::string problem_chunk_flag = "problemchunk=";
+    if (std::string(argv[i]).compare(0, problem_chunk_flag.size(), problem_chunk_flag) == 0) {
+      problem_chunk = std::strtoul(argv[i] + problem_chunk_flag.size(), nullptr, 10);
+      if (problem_chunk == 0) {
+        std::cerr << "The problem service solves chunks of 1 or more problems" << std::endl;
+        return -1;
+      }
+    }
+    const std::string plan_rate_flag = "planrate=";
+    if (std::string(argv[i]).compare(0, plan_rate_flag.size(), plan_rate_flag) == 0) {
+      plan_rate = std::strtod(argv[i] + plan_rate_flag.size(), nullptr);
+      if (!(plan_rate > 0 && plan_rate <= 1000)) {
+        std::cerr << "The planner plans from 0 to 1000 times a second" << std::endl;
+        return -1;
+      }
+    }
+    const std::string dynamic_flag = "dynamic=";
+    if (std::string(argv[i]).compare(0, dynamic_flag.size(), dynamic_flag) == 0) {
+      dynamic_speed = std::strtod(argv[i] + dynamic_flag.size(), nullptr);
+      if (dynamic_speed < 0) {
+        std::cerr << "The dynamic model is taken from a speed of 0 or more" << std::endl;
+        return -1;
+      }
+    }
+    const std::string artifacts_flag = "artifacts=";
+    if (std::string(argv[i]).compare(0, artifacts_flag.size(), artifacts_flag) == 0) {
+      shared_artifacts = true;
+      artifact_directory = argv[i] + artifacts_flag.size();
+    }
+    const std::string track_flag = "track=";
+    if (std::string(argv[i]).compare(0, track_flag.size(), track_flag) == 0) {
+      track = true;
+      track_path = argv[i] + track_flag.size();
+    }
+    move_blocking |= std::string(argv[i]) == "blocked";
+    adaptive |= std::string(argv[i]) == "adaptive";
+    regimes |= std::string(argv[i]) == "regimes";
+    routes |= std::string(argv[i]) == "routes";
+    multistart |= std::string(argv[i]) == "multistart";
+    recall |= std::string(argv[i]) == "recall";
+    lap_cache |= std::string(argv[i]) == "lapcache";
+    effort |= std::string(argv[i]) == "effort";
+    soft |= std::string(argv[i]) == "soft";
+    terminal |= std::string(argv[i]) == "terminal";
+    sampled |= std::string(argv[i]) == "sampled";
+    checkpoint |= std::string(argv[i]) == "checkpoint";
+    track |= std::string(argv[i]) == "track";
+    track_table |= std::string(argv[i]) == "tracktable";
+    history |= std::string(argv[i]) == "history";
+    frenet |= std::string(argv[i]) == "frenet";
+    plan |= std::string(argv[i]) == "plan";
+    linearization_table |= std::string(argv[i]) == "lintable";
+    shared_artifacts |= std::string(argv[i]) == "shared";
+    float_fit |= std::string(argv[i]) == "floatfit";
+    prefit |= std::string(argv[i]) == "prefit";
+    receive_timestamps |= std::string(argv[i]) == "rxtimestamps";
+    perf_counters |= std::string(argv[i]) == "perf";
+    admin |= std::string(argv[i]) == "admin";
+    steal |= std::string(argv[i]) == "steal";
+    numa |= std::string(argv[i]) == "numa";
+    edf |= std::string(argv[i]) == "edf";
+    tune |= std::string(argv[i]) == "tune";
   }
+  SetLogLevel(log_level);
+  if (shared_artifacts && artifact_directory.empty()) {
+    artifact_directory = DefaultArtifactDirectory();
+  }
+  const bool dynamic = dynamic_speed >= 0;
 
-  for (int j = 0; j < xvals.size(); j++) {
-    for (int i = 0; i < order; i++) {
-      A(j, i + 1) = A(j, i) * xvals(j);
+  if ((adaptive || regimes || routes || dynamic || multistart || recall || lap_cache || effort ||
+       soft || terminal || sampled || checkpoint) &&
+      !ipopt) {
+    std::cerr << "The adaptive horizon, regimes, routes, dynamic, multistart, recall, lapcache, "
+                 "effort, soft, terminal, sampled and checkpoint need an Ipopt solver"
+              << std::endl;
+    return -1;
+  }
+  if (lap_cache && !track && !history) {
+    std::cerr << "The lap cache needs track or history" << std::endl;
+    return -1;
+  }
+  // The options of one Ipopt MPC, not of those the wrappers make
+  const bool tunable = (ipopt || solver == SolverBackend::kIpoptGaussNewton) && !adaptive &&
+                       !regimes && !routes && !dynamic && !multistart;
+  if (tune && !tunable) {
+    std::cerr << "Tuning needs an Ipopt solver, without adaptive, regimes, routes, dynamic or "
+                 "multistart"
+              << std::endl;
+    return -1;
+  }
+  // The solvers whose derivatives come from the tape
+  const bool taped =
+      tunable && (solver == SolverBackend::kIpopt || solver == SolverBackend::kIpoptGaussNewton);
+  IpoptOptions sparsity_options;
+  if (!sparsity.empty() && (!taped || !ParseTapeSparsity(sparsity, sparsity_options))) {
+    std::cerr << "The sparsity needs ipopt or ipopt-gn, and a forward or reverse Jacobian, a "
+                 "cppad or colpack colouring and a cppad.symmetric, cppad.general, "
+                 "colpack.symmetric or colpack.general one of the Hessian, ColPack where "
+                 "CppAD has it"
+              << std::endl;
+    return -1;
+  }
+  if (!linear_solver.empty() && !tunable) {
+    std::cerr << "The linear solver needs an Ipopt solver, without adaptive, regimes, routes, "
+                 "dynamic or multistart"
+              << std::endl;
+    return -1;
+  }
+  // A solver thread a worker, each factoring on its share of the cores
+  if (linear_solver_threads == 0) {
+    linear_solver_threads = LinearSolverThreadsFor(workers);
+  }
+  const bool linearizes = solver == SolverBackend::kSQP || solver == SolverBackend::kSQPFloat ||
+                          solver == SolverBackend::kRTI || solver == SolverBackend::kADMM;
+  if (linearization_table && !linearizes) {
+    std::cerr << "The linearization table needs the sqp, sqp-float, rti or admm solver"
+              << std::endl;
+    return -1;
+  }
+  const bool follows_table = solver == SolverBackend::kSQP ||
+                             solver == SolverBackend::kSQPFloat ||
+                             (sampled && !adaptive && !regimes && !routes && !dynamic &&
+                              !multistart);
+  if (track_table && (!track || !follows_table)) {
+    std::cerr << "The track table needs track and the sqp or sqp-float solver, or Ipopt with "
+                 "sampled"
+              << std::endl;
+    return -1;
+  }
+  const bool condensed = solver == SolverBackend::kSQP || solver == SolverBackend::kSQPFloat;
+  if (frenet && (!track || !condensed || track_table)) {
+    std::cerr << "Path coordinates need track and the sqp or sqp-float solver, without "
+                 "tracktable"
+              << std::endl;
+    return -1;
+  }
+  if (plan && (!(track || history) || track_table || frenet)) {
+    std::cerr << "The planner needs track or history, without tracktable or frenet, which "
+                 "follow the center line"
+              << std::endl;
+    return -1;
+  }
+  // The wrappers predict and compare states in the vehicle frame
+  for (int i = 3; frenet && i < argc; i++) {
+    const std::string flag = argv[i];
+    if (flag == "speculative" || flag == "table" || flag == "event" ||
+        flag.compare(0, 7, "policy=") == 0) {
+      std::cerr << "Path coordinates don't work with " << flag << std::endl;
+      return -1;
     }
   }
+  if (track && history) {
+    std::cerr << "Use either the track or the waypoint history" << std::endl;
+    return -1;
+  }
+  if (adaptive + regimes + routes + dynamic + multistart > 1) {
+    std::cerr << "Use one of the adaptive horizon, regimes, routes, dynamic and multistart"
+              << std::endl;
+    return -1;
+  }
+  // The linearization table, read only, is shared by the solvers of every
+  // session, and with "shared" by the processes of the host
+  std::shared_ptr<const LinearizationTable> shared_linearization_table;
+  if (linearization_table && !multistart && !adaptive && !regimes && !dynamic) {
+    if (shared_artifacts) {
+      std::string error;
+      shared_linearization_table = LinearizationTable::Share(artifact_directory, error);
+      if (!shared_linearization_table) {
+        std::cerr << "Could not share the linearization table: " << error << std::endl;
+        return -1;
+      }
+    } else {
+      shared_linearization_table = std::make_shared<const LinearizationTable>();
+    }
+    Log(LogLevel::kInfo, "Linearization table: {} KiB{}", shared_linearization_table->size() / 1024,
+        shared_linearization_table->mapped() ? ", mapped" : "");
+  }
+  bool speculative = false;
+  bool refine = false;
+  bool explicit_table = false;
+  bool event = false;
+  bool sensitivity = false;
+  size_t shared_solves = 0;
+  std::string policy_path;
+  bool policy_refine = false;
+  for (int i = 3; i < argc; i++) {
+    const std::string arg = argv[i];
+    const std::string policy_flag = "policy=";
+    if (arg.compare(0, policy_flag.size(), policy_flag) == 0) {
+      policy_path = arg.substr(policy_flag.size());
+    }
+    policy_refine |= arg == "policyrefine";
+    speculative |= std::string(argv[i]) == "speculative";
+    refine |= arg == "refine";
+    sensitivity |= std::string(argv[i]) == "sensitivity";
+    explicit_table |= std::string(argv[i]) == "table";
+    event |= std::string(argv[i]) == "event";
+    const std::string shared_solves_flag = "sharedsolves=";
+    if (arg == "sharedsolves") {
+      shared_solves = 1024;
+    } else if (arg.compare(0, shared_solves_flag.size(), shared_solves_flag) == 0) {
+      shared_solves = std::strtoul(argv[i] + shared_solves_flag.size(), nullptr, 10);
+      if (shared_solves == 0) {
+        std::cerr << "The shared solves are 1 or more" << std::endl;
+        return -1;
+      }
+    }
+  }
+  // The sensitivities are those of the kinematic model on the polynomial,
+  // at the horizon of the solver
+  if (sensitivity &&
+      (adaptive || regimes || routes || dynamic || multistart || track_table || frenet)) {
+    std::cerr << "The sensitivity update doesn't work with adaptive, regimes, routes, dynamic, "
+                 "multistart, tracktable or frenet"
+              << std::endl;
+    return -1;
+  }
+  // The policy reads the state and polynomial of the vehicle frame, and its
+  // closed loop is checked by the kinematic model
+  if (!policy_path.empty() &&
+      (adaptive || regimes || routes || dynamic || multistart || track_table)) {
+    std::cerr << "The policy doesn't work with adaptive, regimes, routes, dynamic, multistart or "
+                 "tracktable"
+              << std::endl;
+    return -1;
+  }
+  // The refinement predicts the next tick in the vehicle frame of the
+  // polynomial and preempts the solver of the backend itself, and
+  // speculative takes the same idle time
+  if (refine &&
+      (adaptive || regimes || routes || dynamic || multistart || track_table || frenet ||
+       speculative)) {
+    std::cerr << "The refinement doesn't work with adaptive, regimes, routes, dynamic, "
+                 "multistart, tracktable, frenet or speculative"
+              << std::endl;
+    return -1;
+  }
+  // A shared solve must be a solution of the problem of its state and
+  // polynomial: not of a horizon or model picked by the time the solves
+  // took, a reference of the track, a predicted state or an older plan
+  if (shared_solves > 0 && (adaptive || dynamic || routes || speculative || event ||
+                            sensitivity || track_table || frenet)) {
+    std::cerr << "The shared solves don't work with adaptive, dynamic, routes, speculative, "
+                 "event, sensitivity, tracktable or frenet"
+              << std::endl;
+    return -1;
+  }
+  // The solutions shared by the solvers of every session
+  std::shared_ptr<SolveCache> shared_solve_cache;
+  if (shared_solves > 0) {
+    shared_solve_cache = std::make_shared<SolveCache>(shared_solves);
+  }
+  if (policy_refine && policy_path.empty()) {
+    std::cerr << "policyrefine needs policy=<path>" << std::endl;
+    return -1;
+  }
+  // The policy, read only, shared by the solvers of every session
+  std::shared_ptr<const NeuralPolicy> shared_policy;
+  if (!policy_path.empty()) {
+    shared_policy = NeuralPolicy::Load(policy_path);
+    if (!shared_policy) {
+      std::cerr << "Could not load the policy " << policy_path << ", run train_policy"
+                << std::endl;
+      return -1;
+    }
+  }
+  // Likewise the explicit MPC table
+  std::shared_ptr<const ExplicitMPC> shared_explicit_table;
+  if (explicit_table) {
+    std::string error = "run generate_table";
+    if (shared_artifacts) {
+      shared_explicit_table = ExplicitMPC::Share("explicit_mpc.table", artifact_directory, error);
+    } else {
+      shared_explicit_table = ExplicitMPC::Load("explicit_mpc.table");
+    }
+    if (!shared_explicit_table) {
+      std::cerr << "Could not load explicit_mpc.table: " << error << std::endl;
+      return -1;
+    }
+  }
+  // What needs the measurements of the ticks, which aren't compiled in
+  if (!kInstrumentCounters &&
+      (perf_counters || !capture_directory.empty() || baseline_period > 0 ||
+       !blackbox_directory.empty() ||
+       std::find(allocation_free.begin(), allocation_free.end(), true) != allocation_free.end())) {
+    std::cerr << "Built without instrumentation, perf, allocfree, capture, baseline and blackbox "
+                 "need "
+                 "-DMPC_INSTRUMENTATION=counters"
+              << std::endl;
+    return -1;
+  }
+  // The solves of the wrappers and of the tables of the track are more
+  // than a Solve of the polynomial from a start of the backend
+  if (!capture_directory.empty() &&
+      (adaptive || regimes || routes || dynamic || multistart || speculative || refine ||
+       explicit_table || event || sensitivity || shared_policy || track_table || frenet)) {
+    std::cerr << "The problem capture doesn't work with adaptive, regimes, routes, dynamic, "
+                 "multistart, speculative, refine, table, event, sensitivity, policy, tracktable "
+                 "or frenet"
+              << std::endl;
+    return -1;
+  }
+  // Nor is a cold solve of theirs the work their caches save
+  if (baseline_period > 0 &&
+      (adaptive || regimes || routes || dynamic || multistart || explicit_table || event ||
+       sensitivity || shared_policy || track_table || frenet)) {
+    std::cerr << "The baseline doesn't work with adaptive, regimes, routes, dynamic, multistart, "
+                 "table, event, sensitivity, policy, tracktable or frenet"
+              << std::endl;
+    return -1;
+  }
+  if (workers == 0) {
+    std::cerr << "There must be a worker at least" << std::endl;
+    return -1;
+  }
+  // Their solves run on threads CppAD doesn't know of, which the solver
+  // threads of the workers would share numbers with
+  if (workers > 1 && (multistart || speculative || solver == SolverBackend::kIpoptChunked)) {
+    std::cerr << "Several workers don't work with multistart, speculative or chunked"
+              << std::endl;
+    return -1;
+  }
+  // A thread number for the solver thread of every worker
+  if (workers > 1 && SetupCppADThreads(workers) < workers) {
+    std::cerr << "CppAD takes at most " << SetupCppADThreads(workers) << " workers" << std::endl;
+    return -1;
+  }
+  // The tapes and sweeps of every solve then reuse the memory of the last
+  // ones, held in the pool of their thread from the warm-up on
+  HoldCppADMemory();
 
-  auto Q = A.householderQr();
-  auto result = Q.solve(yvals);
-  return result;
-}
+  // Before the solvers are made and warmed up, so that the pages of their
+  // tapes and workspaces are locked as they are touched
+  if (realtime_priority > 0) {
+    if (RetainHeap()) {
+      Log(LogLevel::kInfo, "Real time: malloc keeps what is freed");
+    } else {
+      Log(LogLevel::kWarning, "Real time: malloc may hand freed memory back, not glibc");
+    }
+    if (LockMemory()) {
+      Log(LogLevel::kInfo, "Real time: memory locked");
+    } else {
+      Log(LogLevel::kWarning,
+          "Real time: memory not locked, needs CAP_IPC_LOCK or a memlock limit (ulimit -l)");
+    }
+  }
+  // With numa, the cpus of each node, and the node of worker k: that of
+  // the cpu its solver is pinned to, or the nodes in turn; -1 without
+  std::vector<std::vector<int>> numa_nodes;
+  if (numa) {
+    numa_nodes = NumaNodeCpus();
+    if (numa_nodes.empty()) {
+      Log(LogLevel::kWarning, "NUMA: no nodes in /sys/devices/system/node, numa ignored");
+    } else {
+      Log(LogLevel::kInfo, "NUMA: {} nodes", numa_nodes.size());
+    }
+  }
+  const auto worker_node = [&numa_nodes, pin_cpu](size_t k) {
+    if (numa_nodes.empty()) {
+      return -1;
+    }
+    if (pin_cpu < 0) {
+      return static_cast<int>(k % numa_nodes.size());
+    }
+    const int cpu = pin_cpu + static_cast<int>(k);
+    for (size_t node = 0; node < numa_nodes.size(); node++) {
+      const std::vector<int> &cpus = numa_nodes[node];
+      if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end()) {
+        return static_cast<int>(node);
+      }
+    }
+    return -1;
+  };
+  // With numa, the calling thread onto the cpus of the node of worker k, for
+  // what it allocates and touches first for the worker to be on the node
+  const auto place_thread = [&numa_nodes, &worker_node](size_t k) {
+    const int node = worker_node(k);
+    return node >= 0 && PinThread(numa_nodes[node]);
+  };
+  // Pin the calling thread, the thread of the given role of worker k, to
+  // cpu unless it is negative, else with numa to the node of the worker, and
+  // with realtime run it at priority with its stack and heap faulted in,
+  // reporting each step
+  const auto prepare_thread = [realtime_priority, &worker_node, &place_thread](
+                                  const char *role, size_t k, int cpu, int priority) {
+    MPC_TRACE_THREAD(role, k);
+    if (cpu >= 0) {
+      if (PinThread(cpu)) {
+        Log(LogLevel::kInfo, "Real time: {} of worker {} on cpu {}", role, k, cpu);
+      } else {
+        Log(LogLevel::kWarning, "Couldn't pin the {} of worker {} to cpu {}", role, k, cpu);
+      }
+    } else if (worker_node(k) >= 0) {
+      if (place_thread(k)) {
+        Log(LogLevel::kInfo, "NUMA: {} of worker {} on node {}", role, k, worker_node(k));
+      } else {
+        Log(LogLevel::kWarning, "Couldn't keep the {} of worker {} on node {}", role, k,
+            worker_node(k));
+      }
+    }
+    if (realtime_priority == 0) {
+      return;
+    }
+    if (SetRealTimePriority(priority)) {
+      Log(LogLevel::kInfo, "Real time: {} of worker {} under SCHED_FIFO at {}", role, k,
+          priority);
+    } else {
+      Log(LogLevel::kWarning,
+          "Real time: {} of worker {} not under SCHED_FIFO, needs CAP_SYS_NICE or an rtprio "
+          "limit (ulimit -r)",
+          role, k);
+    }
+    PrefaultStack(kPrefaultStack);
+    if (PrefaultHeap(kPrefaultHeap)) {
+      Log(LogLevel::kInfo, "Real time: {} KiB of stack and {} MiB of heap of the {} faulted in",
+          kPrefaultStack / 1024, kPrefaultHeap / (1024 * 1024), role);
+    } else {
+      Log(LogLevel::kWarning, "Real time: no heap of the {} faulted in", role);
+    }
+  };
 
-int main() {
-  uWS::Hub h;
-
-  // MPC is initialized here!
-  MPC mpc;
-
-  h.onMessage([&mpc](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
-                     uWS::OpCode opCode) {
-    // "42" at the start of the message means there's a websocket message event.
-    // The 4 signifies a websocket message
-    // The 2 signifies a websocket event
-    string sdata = string(data).substr(0, length);
-    cout << sdata << endl;
-    if (sdata.size() > 2 && sdata[0] == '4' && sdata[1] == '2') {
-      string s = hasData(sdata);
-      if (!s.empty()) {
-        auto j = json::parse(s);
-        string event = j[0].get<string>();
-        if (event == "telemetry") {
-          // j[1] is the data JSON object
-          vector<double> ptsx = j[1]["ptsx"];
-          vector<double> ptsy = j[1]["ptsy"];
-          const double px = j[1]["x"];
-          const double py = j[1]["y"];
-          const double psi = j[1]["psi"];
-          const double v = j[1]["speed"];
-
-          /*
-           * Calculate steeering angle and throttle using MPC.
-           * Both are in between [-1, 1].
-           */
-          ///*********************************
-          ///*   Start of implementation     *
-          ///*********************************
-
-          // Transform ptsx, ptsy to car the coordinate
-          /// Implement in separate function
-          for (size_t i = 0; i < ptsx.size(); i++) {
-            const double dtx = ptsx[i] - px;
-            const double dty = ptsy[i] - py;
-
-            ptsx[i] = dtx * cos(psi) + dty * sin(psi);
-            ptsy[i] = dty * cos(psi) - dtx * sin(psi);
-          }
+  // The Ipopt options measured on this host, by solver and horizon (see
+  // "tune"), read only once the solvers are made
+  const std::string host = HostFingerprint();
+  IpoptTuningFile tuning;
+  if (tunable) {
+    std::string error;
+    if (!tuning.Load(tuning_path, error)) {
+      Log(LogLevel::kWarning, "Ipopt tuning: {}, solving with the defaults", error);
+    }
+  }
+  const auto tuning_problem = [&](const RuntimeConfig &config) {
+    return std::string(SolverBackendName(config.solver)) + "/" +
+           std::to_string(config.horizon) + (move_blocking ? "/blocked" : "");
+  };
 
-          // Put ptsx and ptsy data into vectors
-          Eigen::VectorXd ptsxvec = Eigen::VectorXd::Map(ptsx.data(), ptsx.size());
-          Eigen::VectorXd ptsyvec = Eigen::VectorXd::Map(ptsy.data(), ptsy.size());
+  // What the solves of a shared solver are made with beyond their inputs:
+  // the backend, the horizon and the version of the configuration
+  const auto shared_problem = [&](const RuntimeConfig &config) {
+    return tuning_problem(config) + "/" + std::to_string(config.version);
+  };
 
-          // Fit polynomial to x and y coordinates
-          auto coeffs = polyfit(ptsxvec, ptsyvec, 3);
+  // MPC is initialized here! Once at startup, warmed up, for the first
+  // worker, once as every other worker starts, then for a simulator that
+  // starts sending telemetry with no solver of a closed session pooled on
+  // its worker, on the solver thread of the worker, and again when the
+  // runtime configuration changes its horizon or solver. A null mpc if it
+  // can't be made.
+  const auto make_solver = [&](size_t warm_up_rounds, const RuntimeConfig &config) {
+    const size_t horizon = config.horizon;
+    const SolverBackend solver = config.solver;
+    SessionSolver made;
+    std::unique_ptr<MPCBase> &mpc = made.mpc;
+    if (multistart) {
+      // A candidate per core, the warm start one included
+      const size_t count = std::max(2u, std::thread::hardware_concurrency());
+      made.multistart_mpc = MakeMultiStartMPC(horizon, count, derivatives).release();
+      mpc.reset(made.multistart_mpc);
+    } else if (adaptive) {
+      made.adaptive_mpc = MakeAdaptiveMPC(HorizonPolicy(), derivatives).release();
+      mpc.reset(made.adaptive_mpc);
+    } else if (regimes) {
+      made.regime_mpc = MakeRegimeMPC(RegimePolicy(), derivatives).release();
+      mpc.reset(made.regime_mpc);
+    } else if (routes) {
+      made.routed_mpc =
+          MakeRoutedMPC(RoutePolicy(), solver, horizon, shared_explicit_table).release();
+      mpc.reset(made.routed_mpc);
+    } else if (dynamic) {
+      made.adaptive_mpc =
+          MakeVehicleModelMPC(HorizonPolicy(), dynamic_speed, derivatives).release();
+      mpc.reset(made.adaptive_mpc);
+    } else {
+      MPCProblem problem;
+      problem.horizon = horizon;
+      problem.move_blocking = move_blocking;
+      problem.linearization_table = shared_linearization_table;
+      mpc = MakeSolver(solver, problem);
+      IpoptOptions options;
+      const bool tuned = mpc && tunable && tuning.Find(host, tuning_problem(config), options);
+      if (mpc && !sparsity.empty()) {
+        options.jacobian = sparsity_options.jacobian;
+        options.coloring = sparsity_options.coloring;
+        options.hessian_coloring = sparsity_options.hessian_coloring;
+      }
+      if (mpc && !linear_solver.empty()) {
+        options.linear_solver = linear_solver;
+      }
+      // The threads of the workers of this run, whatever the tuning ran with
+      options.linear_solver_threads = linear_solver_threads;
+      if (mpc && tunable) {
+        mpc->SetIpoptOptions(options);
+      }
+    }
+    if (!mpc) {
+      std::cerr << "No " << SolverBackendName(solver) << " MPC compiled for a horizon of "
+                << horizon << " timesteps" << (move_blocking ? " with blocking" : "")
+                << ", use 10, 15 or 25 (or 40 with Ipopt)" << std::endl;
+      return made;
+    }
+    made.core = mpc.get();
+    made.backend = solver;
+    made.horizon = horizon;
+    made.portable =
+        !UsesCppAD(solver) && !multistart && !adaptive && !regimes && !routes && !dynamic;
+    if (sampled) {
+      mpc->SampleReference(true);
+    }
+    if (checkpoint) {
+      mpc->CheckpointStages(true);
+    }
+    made.reference_mpc = track_table ? mpc.get() : nullptr;
+    made.frenet_mpc = frenet ? mpc.get() : nullptr;
+    if (soft) {
+      mpc->SoftenConstraints(kSoftPenalty);
+    }
+    if (terminal) {
+      mpc->cost_schedule.AddPoint(0, LQRTerminalCost(CostWeights(), mpc->timestep()));
+    }
+    // Pay for the first solves now rather than on the first ticks, before the
+    // solves are recorded or wrapped
+    if (warm_up_rounds > 0) {
+      const WarmUpReport report = WarmUp(*mpc, WarmUpScenarios(), warm_up_rounds);
+      const CppADPool pool = CppADPoolOfThread();
+      Log(LogLevel::kInfo,
+          "Warm-up: {} solves in {} s, the first {} s, the last {} s, CppAD pool {} KiB in use "
+          "and {} KiB held",
+          report.solves, report.seconds, report.first, report.last, pool.inuse / 1024,
+          pool.available / 1024);
+    }
+    if (recall) {
+      mpc->KeepSolutions(1024);
+    }
+    if (lap_cache) {
+      mpc->KeepTrackSolutions(kLapCacheEntries);
+    }
+    if (effort) {
+      mpc->ControlEffort(EffortPolicy());
+    }
 
-          // Shifted coords so car at 0,0 and angle is 0, so set x to 0
+    // "refine" on the solver: solve again for the predicted next tick in
+    // the idle time after the reply, for the next solve to start from
+    if (refine) {
+      made.refining_mpc = new RefiningMPC(std::move(mpc), RefinementPolicy());
+      mpc.reset(made.refining_mpc);
+    }
 
-          // Estimate cross-track error (horizontal works reasonably well unless there's a lot of warpage
-          const double cte = polyeval(coeffs, 0);
-          // Calculate orientation error
-          /// Check derivation is correct
-          const double epsi = -atan(coeffs[1]);
+    // "sensitivity" after the solver: follow its converged solutions by
+    // their first order updates, solving again when an update is off
+    if (sensitivity) {
+      std::unique_ptr<SensitivityMPC> sensitivity_mpc =
+          MakeSensitivityMPC(std::move(mpc), move_blocking, SensitivityPolicy());
+      if (!sensitivity_mpc) {
+        std::cerr << "No sensitivity update for a horizon of " << horizon
+                  << " timesteps, use 10, 15 or 25" << std::endl;
+        return SessionSolver();
+      }
+      made.sensitivity_mpc = sensitivity_mpc.release();
+      mpc.reset(made.sensitivity_mpc);
+    }
 
-          Eigen::VectorXd state(6);
+    // "policy=<path>" after the solver: take the actuations of the distilled
+    // policy when its closed loop over the horizon holds, the solver when it
+    // doesn't; with "policyrefine" the solver every tick, started from them
+    if (shared_policy) {
+      made.neural_mpc = new NeuralMPC(std::move(mpc), shared_policy,
+                                      policy_refine ? PolicyMode::kRefined : PolicyMode::kChecked);
+      mpc.reset(made.neural_mpc);
+    }
 
-          /* Convert units */
-          std::cout << "cte: " << cte << "m?" << endl;
+    // "speculative" after the solver: solve for the predicted next state
+    // while waiting for its telemetry
+    if (speculative) {
+      made.speculative_mpc = new SpeculativeMPC(std::move(mpc), SpeculationTolerance());
+      mpc.reset(made.speculative_mpc);
+    }
 
-          std::cout << "velocity: " << v << "mph" << endl;
-          // the car weaves a lot if I convert from mph to m/s
-          // v = v * 1600 / 3600;
-          // std::cout << "velocity: " << v << "m/s" << endl;
+    // "table" after the solver: use the explicit MPC table made by
+    // generate_table inside its region, the solver outside; with routes a
+    // route of its own
+    if (explicit_table && !routes) {
+      made.table_mpc = new TableMPC(std::move(mpc), shared_explicit_table, TableMode::kTableFirst);
+      mpc.reset(made.table_mpc);
+    }
 
-          const double Lf = 2.67;
+    // "event" after the solver: only re-optimize when the state leaves the
+    // plan
+    if (event) {
+      made.event_mpc = new EventTriggeredMPC(std::move(mpc), EventTrigger());
+      mpc.reset(made.event_mpc);
+    }
 
-          // predict the state 100ms into the future before you send it to the solver in order to compensate for the latency.
+    // "sharedsolves[=<entries>]" around it all: answer the ticks whose
+    // problem a solver of any session solved before from a cache of 1024
+    // solutions by default
+    if (shared_solve_cache) {
+      made.shared_mpc = new SharedSolveMPC(std::move(mpc), shared_solve_cache);
+      made.shared_mpc->SetProblem(shared_problem(config));
+      mpc.reset(made.shared_mpc);
+    }
+    return made;
+  };
+  // The horizon and solver of the command line, then whatever the admin
+  // requests change, for the solvers of every session
+  RuntimeConfig initial_config = file_config;
+  initial_config.horizon = horizon;
+  initial_config.solver = solver;
+  RuntimeConfigStore runtime_config(initial_config);
+  // What the solver is made with beyond its backend and horizon, which
+  // another backend or horizon wouldn't be right for: the Ipopt options and
+  // wrappers, and the tables made for a backend
+  const bool fixed_solver = adaptive || regimes || routes || dynamic || multistart || recall ||
+                            lap_cache || effort || soft || terminal || sampled || checkpoint ||
+                            linearization_table || track_table || frenet || explicit_table;
 
-          // Latency of 100ms, so predict 100ms (0.1s) ahead
+  // The sessions of the last process, for those of this one
+  const std::string snapshot_problem = tuning_problem(runtime_config.Current());
+  SnapshotRestore snapshot_restore;
+  if (!snapshot_directory.empty()) {
+    std::string error;
+    if (mkdir(snapshot_directory.c_str(), 0755) != 0 && errno != EEXIST) {
+      std::cerr << "Could not make the snapshot directory " << snapshot_directory << std::endl;
+      return -1;
+    }
+    if (!snapshot_restore.Load(snapshot_directory, host, snapshot_problem, error)) {
+      Log(LogLevel::kWarning, "Snapshot: {}, starting cold", error);
+    }
+    Log(LogLevel::kInfo, "Snapshot: {} sessions of the last process to restore",
+        snapshot_restore.size());
+  }
 
-          const double dt = 0.1;
-          // Previous steering angle and throttle
-          const double delta = j[1]["steering_angle"];
-          const double prev_a = mpc.prev_a;
+  // For the first simulator to connect to the first worker, made on its node
+  place_thread(0);
+  if (!linear_solver.empty()) {
+    // Ipopt only finds out that it can't load the library of a linear
+    // solver as it solves
+    MPCProblem problem;
+    problem.horizon = horizon;
+    problem.move_blocking = move_blocking;
+    std::unique_ptr<MPCBase> probe = MakeSolver(solver, problem);
+    IpoptOptions options;
+    options.linear_solver = linear_solver;
+    options.linear_solver_threads = linear_solver_threads;
+    if (probe) {
+      probe->SetIpoptOptions(options);
+      const WarmUpScenario &scenario = WarmUpScenarios().front();
+      probe->Solve(scenario.state, scenario.coeffs);
+    }
+    if (!probe || probe->status() == SolveStatus::kFailed) {
+      std::cerr << "Ipopt can't solve with the linear solver " << linear_solver
+                << ", is it built in or its library on the library path?" << std::endl;
+      return -1;
+    }
+    Log(LogLevel::kInfo, "Linear solver: {} on {} threads a solver thread{}", linear_solver,
+        linear_solver_threads,
+        SetLinearSolverThreads(linear_solver_threads) ? "" : ", its own without OpenMP");
+  }
+  if (tune) {
+    // On a solver with the options that change the problem, without the
+    // wrappers and the controllers that would keep the solves
+    MPCProblem problem;
+    problem.horizon = horizon;
+    problem.move_blocking = move_blocking;
+    std::unique_ptr<MPCBase> prototype = MakeSolver(solver, problem);
+    if (!prototype) {
+      std::cerr << "No " << SolverBackendName(solver) << " MPC compiled for a horizon of "
+                << horizon << " timesteps" << std::endl;
+      return -1;
+    }
+    if (sampled) {
+      prototype->SampleReference(true);
+    }
+    if (checkpoint) {
+      prototype->CheckpointStages(true);
+    }
+    if (soft) {
+      prototype->SoftenConstraints(kSoftPenalty);
+    }
+    IpoptCalibration calibration =
+        CalibrateIpopt(*prototype, WarmUpScenarios(),
+                       IpoptCandidates(solver == SolverBackend::kIpoptChunked,
+                                       linear_solver_threads));
+    const IpoptOptions &best = calibration.best;
+    Log(LogLevel::kInfo,
+        "Ipopt tuning: {} candidates, {} rejected, {} {} {} {} threads at {} s a solve against "
+        "{} s with the defaults",
+        calibration.candidates, calibration.rejected,
+        best.linear_solver.empty() ? "default" : best.linear_solver,
+        best.mu_strategy.empty() ? "monotone" : best.mu_strategy,
+        best.hessian.empty() ? "exact" : best.hessian, best.threads, calibration.seconds,
+        calibration.default_seconds);
+    if (taped && sparsity.empty()) {
+      // With those, how the tape's derivatives are best evaluated for this
+      // horizon, against the default strategy measured again in the same
+      // run
+      const IpoptCalibration strategies =
+          CalibrateIpopt(*prototype, WarmUpScenarios(), TapeSparsityCandidates(best));
+      Log(LogLevel::kInfo,
+          "Ipopt tuning: {} strategies of the sparse derivatives, {} rejected, {} at {} s a "
+          "solve",
+          strategies.candidates, strategies.rejected, TapeSparsityName(strategies.best),
+          strategies.seconds);
+      if (strategies.seconds > 0) {
+        calibration.best = strategies.best;
+        calibration.seconds = strategies.seconds;
+      }
+    }
+    tuning.Set(host, tuning_problem(runtime_config.Current()), best, calibration.seconds);
+    std::string error;
+    if (!tuning.Save(tuning_path, error)) {
+      Log(LogLevel::kWarning, "Ipopt tuning: {}", error);
+    }
+  }
+  SessionSolver spare_solver = make_solver(warm_up_rounds, runtime_config.Current());
+  if (!spare_solver.mpc) {
+    return -1;
+  }
 
-          // Predict (x = y = psi = 0)
-          const double predicted_x = v * dt;
-          const double predicted_y = 0;
-          const double predicted_psi = - v * delta / Lf * dt;
-          const double predicted_v = v + prev_a * dt;
-          const double predicted_cte = cte + v * CppAD::sin(epsi) * dt;
-          const double predicted_epsi = epsi + predicted_psi;
-          state << predicted_x, predicted_y, predicted_psi, predicted_v, predicted_cte, predicted_epsi;
+  // The track, read only, is shared by every session, and a csv one with
+  // "shared" by the processes of the host
+  std::shared_ptr<const TrackMap> track_map;
+  const std::string map_extension = ".map";
+  if (track && track_path.size() > map_extension.size() &&
+      track_path.compare(track_path.size() - map_extension.size(), map_extension.size(),
+                         map_extension) == 0) {
+    track_map = TrackMap::Load(track_path);
+    if (!track_map) {
+      std::cerr << "Could not map the track of " << track_path << std::endl;
+      return -1;
+    }
+  } else if (track) {
+    std::vector<double> xs;
+    std::vector<double> ys;
+    if (!TrackSpline::Load(track_path, xs, ys)) {
+      std::cerr << "Could not read the waypoints of " << track_path << std::endl;
+      return -1;
+    }
+    if (shared_artifacts) {
+      std::string error;
+      track_map = TrackMap::Share(xs, ys, artifact_directory, error);
+      if (!track_map) {
+        std::cerr << "Could not share the track of " << track_path << ": " << error << std::endl;
+        return -1;
+      }
+    } else {
+      track_map.reset(new TrackMap(xs, ys));
+    }
+  }
+  if (track_map) {
+    Log(LogLevel::kInfo, "Track: {} waypoints, {} m", track_map->spline().waypoints(),
+        track_map->spline().length());
+  }
+  // Before the workers, so that it outlives their sessions
+  std::unique_ptr<FlightRecorder> recorder;
+  if (!record_directory.empty()) {
+    recorder =
+        FlightRecorder::Open(record_directory, record_mib << 20, record_keep, record_compress);
+    if (!recorder) {
+      std::cerr << "Could not record into " << record_directory << std::endl;
+      return -1;
+    }
+    Log(LogLevel::kInfo, "Recording into {}, segments of {} MiB{}", record_directory, record_mib,
+        record_compress ? ", compressed once full" : "");
+  }
+  std::unique_ptr<RouteLog> route_log;
+  if (!route_log_path.empty()) {
+    if (!routes) {
+      std::cerr << "The route log needs routes" << std::endl;
+      return -1;
+    }
+    route_log.reset(new RouteLog(route_log_path));
+    if (!route_log->ok()) {
+      std::cerr << "Could not write the route log to " << route_log_path << std::endl;
+      return -1;
+    }
+    Log(LogLevel::kInfo, "Logging the routes of the ticks to {}", route_log_path);
+  }
+  std::unique_ptr<ProblemCapture> capture;
+  if (!capture_directory.empty()) {
+    capture.reset(new ProblemCapture(capture_directory, capture_ms * 1e-3, capture_keep));
+    if (!capture->ok()) {
+      std::cerr << "Could not capture into " << capture_directory << std::endl;
+      return -1;
+    }
+    Log(LogLevel::kInfo, "Capturing the problems of the solves over {} ms into {}", capture_ms,
+        capture_directory);
+  }
+#if MPC_INSTRUMENTATION >= MPC_INSTRUMENTATION_FULL
+  if (!trace_path.empty()) {
+    if (!StartTrace(trace_path)) {
+      std::cerr << "Could not write the trace to " << trace_path << std::endl;
+      return -1;
+    }
+    Log(LogLevel::kInfo, "Tracing into {}", trace_path);
+  }
+#endif
+  std::vector<std::unique_ptr<Worker>> served;
+  // The event loop of a worker with the handlers of its sockets, listening
+  // to the port; false if it can't
+  const auto start_listening = [&](Worker *worker) {
+    uWS::Hub &h = worker->hub;
 
-          // Solve using MPC
-          // coeffs to predict future cte and epsi
-          auto result = mpc.Solve(state, coeffs);
+    // Wakes the event loop for the commands of the solver
+    worker->reply_ready = new uS::Async(h.getLoop());
+    worker->reply_ready->setData(worker);
+    // Beats every kHeartbeat on the loop, measuring how late
+    const int kHeartbeat = 100;
+    uS::Timer *heartbeat = new uS::Timer(h.getLoop());
+    heartbeat->setData(worker);
+    heartbeat->start([](uS::Timer *timer) {
+      Worker &worker = *static_cast<Worker *>(timer->getData());
+      const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      // From the second beat on, the first comes once the loop runs
+      if (worker.beat != std::chrono::steady_clock::time_point()) {
+        const double late =
+            std::chrono::duration<double>(now - worker.beat).count() - kHeartbeat * 1e-3;
+        worker.loop_lag.Set(std::max(0.0, late));
+        MPC_COUNT(Metrics().loop_lag.Observe(std::max(0.0, late)));
+      }
+      worker.beat = now;
+    }, kHeartbeat, kHeartbeat);
 
-          const double steer_value = result[0]/ (deg2rad(25)*Lf);
-          std::cout << "steer_value: " << steer_value << endl;
-          const double throttle_value = result[1];
+    // With commandrate, samples the plans of the sessions between replies
+    if (command_rate > 0) {
+      worker->command_period = 1 / command_rate;
+      const int period = std::max(1, static_cast<int>(std::lround(1000 / command_rate)));
+      uS::Timer *sampler = new uS::Timer(h.getLoop());
+      sampler->setData(worker);
+      sampler->start([](uS::Timer *timer) {
+        SampleCommands(*static_cast<Worker *>(timer->getData()));
+      }, period, period);
+    }
 
-          // Discarded.
-          // Delete attribute
-          // mpc.prev_delta = steer_value;
-          mpc.prev_a = throttle_value;
+    if (cork) {
+      worker->cork.reset(new CorkedSends(h.getLoop(), std::chrono::milliseconds(cork_ms)));
+    }
 
-          json msgJson;
-          msgJson["steering_angle"] = steer_value;
-          msgJson["throttle"] = throttle_value;
+    worker->reply_ready->start([](uS::Async *async) {
+      DeliverReplies(*static_cast<Worker *>(async->getData()));
+    });
 
-          //Display the MPC predicted trajectory
-          vector<double> mpc_x_vals;
-          vector<double> mpc_y_vals;
+    // The stages of a tick on the loop, see SessionPipeline.h
+    h.onMessage(ReceiveMessage);
 
-          //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
-          // the points in the simulator are connected by a Green line
-          // std::cout << "result size: " << result.size() << endl;
-          for (size_t i = 2; i < result.size(); i++) {
-            if(i%2 == 0){
-              mpc_x_vals.push_back(result[i]);
-            } else {
-              mpc_y_vals.push_back(result[i]);
+    // The metrics for Prometheus on /metrics, the lag of the event loops on
+    // /healthz, "lagging" once one of them is 100 ms late, and the runtime
+    // configuration on /config, changed by a POST with admin, as is a dump
+    // of the black box by a POST to /blackbox
+    h.onHttpRequest([&served, &runtime_config, perf_counters, admin, fixed_solver, effort,
+                     workers](uWS::HttpResponse *res, uWS::HttpRequest req, char *data,
+                              size_t, size_t) {
+      const uWS::Header url = req.getUrl();
+      const MessageView target(url.value, url.valueLength);
+      const MessageView path = target.substr(0, target.find('?'));
+      const std::string s = "<h1>Hello world!</h1>";
+      if (path.equals("/metrics")) {
+        std::string metrics = RenderMetrics();
+        // The memory of the process, for the soaks of mpc_loadgen
+        RenderProcessMemory(metrics);
+        // And the stages of every session, rendered outside the lock the
+        // solver threads take
+        RenderStageHeader(metrics);
+        std::vector<std::shared_ptr<Session>> sessions;
+        for (const std::unique_ptr<Worker> &worker : served) {
+          std::lock_guard<std::mutex> lock(worker->sessions_mutex);
+          sessions.insert(sessions.end(), worker->sessions.begin(), worker->sessions.end());
+        }
+        for (const std::shared_ptr<Session> &session : sessions) {
+          session->stages.Render(session->id, metrics);
+        }
+        RenderSLOHeader(metrics);
+        for (const std::shared_ptr<Session> &session : sessions) {
+          session->slo.Render(session->id, metrics);
+        }
+        RenderFootprintHeader(metrics);
+        for (const std::shared_ptr<Session> &session : sessions) {
+          session->footprint.Render(session->id, metrics);
+        }
+        RenderSessionCpuHeader(metrics);
+        for (const std::shared_ptr<Session> &session : sessions) {
+          session->cpu.Render(session->id, metrics);
+        }
+        if (perf_counters) {
+          RenderEventHeader(metrics);
+          for (const std::shared_ptr<Session> &session : sessions) {
+            session->events.Render(session->id, metrics);
+          }
+        }
+        res->end(metrics.data(), metrics.length());
+      } else if (path.equals("/healthz")) {
+        std::string lags;
+        bool lagging = false;
+        for (const std::unique_ptr<Worker> &worker : served) {
+          const double lag = worker->loop_lag.value();
+          lags += (lags.empty() ? "" : ",") + std::to_string(lag);
+          lagging |= lag > 0.1;
+        }
+        const std::string health =
+            std::string("{\"status\":\"") + (lagging ? "lagging" : "ok") + "\",\"sessions\":" +
+            std::to_string(static_cast<long>(Metrics().sessions.value())) +
+            ",\"loop_lag_seconds\":[" + lags + "]}";
+        res->end(health.data(), health.length());
+      } else if (path.equals("/config")) {
+        std::string reply;
+        if (req.getMethod() == uWS::HttpMethod::METHOD_POST) {
+          std::string error = admin ? "" : "not an admin server, start it with admin";
+          const bool published = admin && runtime_config.Update([&](RuntimeConfig &config) {
+            const RuntimeConfig current = config;
+            if (!ParseConfigQuery(target, config, error)) {
+              return false;
+            }
+            if (fixed_solver &&
+                (config.horizon != current.horizon || config.solver != current.solver)) {
+              error = "the horizon and solver are fixed by the options of the server";
+              return false;
+            }
+            if (workers > 1 && config.solver == SolverBackend::kIpoptChunked &&
+                current.solver != SolverBackend::kIpoptChunked) {
+              error = "chunked doesn't work with several workers";
+              return false;
+            }
+            if (effort && (config.tolerance != current.tolerance ||
+                           config.max_iterations != current.max_iterations)) {
+              error = "the tolerances are set by effort";
+              return false;
             }
+            return true;
+          });
+          if (published) {
+            reply = ConfigJSON(runtime_config.Current());
+            Metrics().config_version.Set(static_cast<double>(runtime_config.Current().version));
+            Log(LogLevel::kInfo, "Config: {}", reply);
+          } else {
+            reply = "{\"error\":\"" + error + "\"}";
+            Log(LogLevel::kWarning, "Config: {} refused, {}", target, error);
           }
+        } else {
+          reply = ConfigJSON(runtime_config.Current());
+        }
+        res->end(reply.data(), reply.length());
+      } else if (path.equals("/blackbox") &&
+                 req.getMethod() == uWS::HttpMethod::METHOD_POST) {
+        // Taken by every solver thread at its next tick
+        std::string reply;
+        if (!admin) {
+          reply = "{\"error\":\"not an admin server, start it with admin\"}";
+        } else if (!served.front()->tick_recorder) {
+          reply = "{\"error\":\"no black box, start the server with blackbox=<dir>\"}";
+        } else {
+          for (const std::unique_ptr<Worker> &worker : served) {
+            worker->tick_recorder->RequestDump();
+          }
+          reply = "{\"requested\":" + std::to_string(served.size()) + "}";
+          Log(LogLevel::kInfo, "Black box: dump requested");
+        }
+        res->end(reply.data(), reply.length());
+      } else if (url.valueLength == 1) {
+        res->end(s.data(), s.length());
+      } else {
+        // i guess this should be done more gracefully?
+        res->end(nullptr, 0);
+      }
+    });
+
+    h.onConnection([worker, float_fit, history, &track_map, lines, max_buffered, &recorder,
+                    baseline_period, latency_ms, problem_rate, receive_timestamps,
+                    reference_order_tolerance, prefit, admission,
+                    admission_policy](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
+      // Shared memory or MessagePack if the client offered it, else the JSON
+      // of the simulator
+      const uWS::Header subprotocols = req.getHeader("sec-websocket-protocol");
+      const WireFormat format =
+          NegotiateWireFormat(MessageView(subprotocols.value, subprotocols.valueLength));
+      Log(LogLevel::kInfo, "Connected!!! {}",
+          format == WireFormat::kSharedMemory  ? "shared memory"
+          : format == WireFormat::kMessagePack ? "MessagePack"
+          : format == WireFormat::kProblems    ? "problem service"
+                                               : "JSON");
+      const uWS::Header url = req.getUrl();
+      int priority = 0;
+      if (!ParsePriorityQuery(MessageView(url.value, url.valueLength), priority)) {
+        Log(LogLevel::kWarning, "Bad priority in {}, priority 0",
+            MessageView(url.value, url.valueLength));
+      }
+      // With admission, refused before anything is made for it if the
+      // sessions of the worker and one more like them wouldn't fit
+      if (admission && admission_policy.mode == AdmissionMode::kRefuse) {
+        WorkerLoad load;
+        {
+          std::lock_guard<std::mutex> lock(worker->sessions_mutex);
+          for (const std::shared_ptr<Session> &other : worker->sessions) {
+            if (other->closed.load()) {
+              continue;
+            }
+            load.sessions++;
+            if (other->cpu.seconds() > 0) {
+              load.measured++;
+              load.cores += other->cpu.cores();
+            }
+          }
+        }
+        if (!Admits(load, admission_policy)) {
+          Log(LogLevel::kWarning, "Admission: refused, {} sessions at {} cores of {}",
+              load.sessions, load.cores, admission_policy.utilization);
+          MPC_COUNT(Metrics().sessions_refused.Add());
+          std::string reason = kCapacityCloseReason;
+          ws.close(kCapacityCloseCode, &reason[0], reason.size());
+          return;
+        }
+      }
+      static std::atomic<uint64_t> connections{0};
+      std::shared_ptr<Session> session = std::allocate_shared<Session>(
+          CacheLineAllocator<Session>(), &worker->telemetry_posted, connections++, format,
+          float_fit, history, track_map, latency_ms * 1e-3);
+      session->priority = priority;
+      // The lines as the client asked for them in its url, or by default
+      session->lines = lines;
+      if (!ParseLinesQuery(MessageView(url.value, url.valueLength), session->lines)) {
+        Log(LogLevel::kWarning, "Bad lines or decimals in {}, the default lines",
+            MessageView(url.value, url.valueLength));
+      }
+      session->steer_message.set_precision(session->lines.precision);
+      session->recorder = recorder.get();
+      session->reference_fit.SetAdaptiveOrder(reference_order_tolerance);
+      session->prefit = prefit && !history && !track_map;
+      session->prefit_fit.SetAdaptiveOrder(reference_order_tolerance);
+      if (receive_timestamps && !EnableReceiveTimestamps(ws.getFd())) {
+        Log(LogLevel::kWarning, "No receive timestamps for session {}, arrivals as handled",
+            session->id);
+      }
+      if (baseline_period > 0) {
+        session->baseline.reset(new CacheBaseline(float_fit));
+      }
+      if (format == WireFormat::kSharedMemory) {
+        // A channel of its own, named for the client in the first message
+        static std::atomic<unsigned> channels{0};
+        const std::string name =
+            "/mpc-" + std::to_string(getpid()) + "-" + std::to_string(channels++);
+        session->shared = SharedChannel::Create(name);
+        if (!session->shared) {
+          Log(LogLevel::kWarning, "Couldn't make the shared memory {}", name);
+          ws.close();
+          return;
+        }
+        Session *fed = session.get();
+        session->shared_reader = std::thread([fed] {
+          std::string record;
+          while (fed->shared->WaitTelemetry(record)) {
+            const Mailbox::Clock::time_point arrival = Mailbox::Clock::now();
+            fed->Record(FlightRecordType::kTelemetry, arrival,
+                        MessageView(record.data(), record.size()));
+            fed->frames.Post(MessageView(record.data(), record.size()), arrival);
+          }
+        });
+        const std::string named = "{\"shm\":\"" + name + "\"}";
+        ws.send(named.data(), named.length(), uWS::OpCode::TEXT);
+      } else if (format == WireFormat::kProblems) {
+        // No telemetry and no commands, batches in and plans out as they are
+        // solved, without a latency to wait out
+        session->problems.reset(new ProblemQueue(kMaxProblemBatches));
+        session->socket.reset(new uWS::WebSocket<uWS::SERVER>(ws));
+        session->problem_limit.reset(new ProblemRateLimit(problem_rate));
+      } else {
+        // The commands to this simulator, waiting out the actuator latency
+        Session *measured = session.get();
+        const DelayQueue::SentCallback sent = [measured](DelayQueue::Clock::time_point arrival,
+                                                         DelayQueue::Clock::time_point sending,
+                                                         const std::string &message) {
+          const DelayQueue::Clock::time_point now = DelayQueue::Clock::now();
+          // A command sampled between replies answers no telemetry, and
+          // takes no part in the latency or the jitter
+          if (arrival == DelayQueue::Clock::time_point()) {
+            measured->Record(FlightRecordType::kCommand, sending,
+                             MessageView(message.data(), message.size()), sending);
+            return;
+          }
+          measured->Record(FlightRecordType::kCommand, sending,
+                           MessageView(message.data(), message.size()), arrival);
+          if (kInstrumentCounters) {
+            Metrics().command_latency.Observe(
+                std::chrono::duration<double>(now - arrival).count());
+            const double jitter = measured->jitter.Sent(arrival, now);
+            if (jitter >= 0) {
+              Metrics().command_jitter.Observe(jitter);
+            }
+            measured->stages.Record(TickStage::kSend,
+                                    std::chrono::duration<double>(now - sending).count());
+          }
+          MPC_TRACE_SPAN("send", sending, now);
+          std::lock_guard<std::mutex> lock(measured->latency_mutex);
+          measured->latency.Sent(arrival, now);
+        };
+        const uWS::OpCode op_code =
+            format == WireFormat::kMessagePack ? uWS::OpCode::BINARY : uWS::OpCode::TEXT;
+        session->commands.reset(
+            new DelayQueue(worker->hub.getLoop(), ws, sent, op_code, max_buffered,
+                           worker->cork.get()));
+      }
+      session->home = worker;
+      ws.setUserData(session.get());
+      std::lock_guard<std::mutex> lock(worker->sessions_mutex);
+      worker->sessions.push_back(session);
+      Metrics().sessions.Add(1);
+    });
 
+    h.onDisconnection([worker](uWS::WebSocket<uWS::SERVER> ws, int code, char *message,
+                               size_t length) {
+      Session *session = static_cast<Session *>(ws.getUserData());
+      if (session != nullptr) {
+        // Before the queue its frames would call back
+        if (worker->cork) {
+          worker->cork->Drop(ws);
+        }
+        session->commands.reset();
+        session->socket.reset();
+        if (session->shared) {
+          session->shared->Close();
+        }
+        session->closed.store(true);
+        // For the solver thread to release it
+        worker->telemetry_posted.Ring();
+      }
+      ws.setUserData(nullptr);
+      ws.close();
+      Log(LogLevel::kInfo, "Disconnected");
+    });
 
-          msgJson["mpc_x"] = mpc_x_vals;
-          msgJson["mpc_y"] = mpc_y_vals;
+    // The workers share the port, the kernel spreading the connections
+    // over them
+    if (!h.listen(port, nullptr, workers > 1 ? uS::ListenOptions::REUSE_PORT : 0)) {
+      std::cerr << "Failed to listen to port" << std::endl;
+      return false;
+    }
+    return true;
+  };
+
+  // Serve the sessions of worker k on the calling thread, starting with
+  // spare_solver, until its event loop stops; with steal, frames of the
+  // sessions of the other workers too whenever none of its own wait
+  const auto run = [&](Worker &worker, size_t k, SessionSolver spare_solver) {
+    // The state of the car in its own frame dt seconds ahead (see
+    // PredictState)
+    const auto predict = PredictState;
+    // The frames skipped and commands dropped of a session since the last
+    // tick, counted on the event loop and read once
+    const auto count_backlog = [](Session &session) {
+      ServerMetrics &metrics = Metrics();
+      const uint64_t skipped = session.frames.skipped();
+      const size_t dropped = session.dropped.load(std::memory_order_relaxed);
+      MPC_COUNT(metrics.frames_skipped.Add(skipped - session.skipped));
+      MPC_COUNT(metrics.commands_dropped.Add(dropped - session.dropped_logged));
+      if (skipped > session.skipped) {
+        session.skipped = skipped;
+        Log(LogLevel::kInfo, "Mailbox: {} stale frames skipped", session.skipped);
+      }
+      if (dropped > session.dropped_logged) {
+        session.dropped_logged = dropped;
+        Log(LogLevel::kWarning, "Backpressure: {} stale commands dropped, {} queued",
+            session.dropped_logged, session.pending.load(std::memory_order_relaxed));
+      }
+    };
+    // The outcome of a solve and the work its backend counted
+    const auto count_solve = [](const MPCSolution &result) {
+      if (!kInstrumentCounters) {
+        return;
+      }
+      ServerMetrics &metrics = Metrics();
+      const SolveStatistics &statistics = result.statistics;
+      metrics.iterations.Observe(statistics.iterations);
+      if (result.status == SolveStatus::kDeadline) {
+        metrics.deadline_misses.Add();
+      } else if (result.status == SolveStatus::kFailed) {
+        metrics.failed_solves.Add();
+      }
+      metrics.cost_evaluations.Add(statistics.cost_evaluations);
+      metrics.gradient_evaluations.Add(statistics.gradient_evaluations);
+      metrics.constraint_evaluations.Add(statistics.constraint_evaluations);
+      metrics.jacobian_evaluations.Add(statistics.jacobian_evaluations);
+      metrics.hessian_evaluations.Add(statistics.hessian_evaluations);
+      metrics.forward_sweeps_saved.Add(statistics.forward_sweeps_saved);
+      metrics.restorations.Add(statistics.restorations);
+      metrics.model_seconds.Add(statistics.phases.model);
+      metrics.derivative_seconds.Add(statistics.phases.derivatives);
+      metrics.linear_solve_seconds.Add(statistics.phases.linear_solve);
+    };
+    const auto seconds = [](Mailbox::Clock::duration duration) {
+      return std::chrono::duration<double>(duration).count();
+    };
+    // The stages of the ticks of a session so far, every kStageSummaryPeriod
+    const auto log_stages = [perf_counters](Session &session, Mailbox::Clock::time_point now) {
+      if (kInstrumentCounters && now - session.stages_logged >= kStageSummaryPeriod &&
+          LogEnabled(LogLevel::kInfo)) {
+        session.stages_logged = now;
+        Log(LogLevel::kInfo, "Stages of session {}, p50/p99/max ms: {}", session.id,
+            session.stages.Summary());
+        Log(LogLevel::kInfo, "Control period of session {}: {} of the last ticks met", session.id,
+            session.slo.compliance());
+        if (perf_counters) {
+          Log(LogLevel::kInfo, "Events of session {}, IPC/cache misses/branch misses: {}",
+              session.id, session.events.Summary());
+        }
+      }
+    };
+
+    // A tick of a multi-vehicle session: every car of the telemetry_batch
+    // data fitted and predicted like the car of a single simulator, all of
+    // them solved by one SolveBatch on this thread, and their commands
+    // posted back in one steer_batch frame. The cars follow the fits of
+    // their own waypoints; the track, the history and the wrappers of the
+    // solver are for single cars.
+    // A tick of a session restored from a snapshot: steady once it has
+    // solved warm kSteadyTicks times in a row within half again the solve
+    // time it had, any solve time without the counters, which don't time
+    // them, here or in the last process
+    const auto settle = [&](Session &session, const MPCSolution &result, double took) {
+      session.restored_ticks++;
+      const bool steady = result.status == SolveStatus::kSolved &&
+                          result.statistics.start == SolveStart::kWarm &&
+                          (!kInstrumentCounters || session.restored_seconds <= 0 ||
+                           took <= 1.5 * session.restored_seconds);
+      session.settled_ticks = steady ? session.settled_ticks + 1 : 0;
+      if (session.settled_ticks >= kSteadyTicks) {
+        session.settling = false;
+        Log(LogLevel::kInfo, "Snapshot: session {} steady after {} ticks, {} s from its restore",
+            session.id, session.restored_ticks,
+            seconds(Mailbox::Clock::now() - session.restored));
+      }
+    };
+    const auto solve_batch = [&](Session &session, const MessageView &data,
+                                 const Mailbox::Mail &mail) {
+      const Mailbox::Clock::time_point started = InstrumentNow();
+      size_t n = 0;
+      if (!ParseTelemetryBatch(data, session.cars, n)) {
+        Log(session.solve_warnings, LogLevel::kWarning, "Malformed telemetry batch, {} bytes",
+            data.size());
+        return;
+      }
+      if (n == 0) {
+        return;
+      }
+      const Mailbox::Clock::time_point parsed = InstrumentNow();
+      if (!session.batch || session.batch->size() != n) {
+        // Copies of the session's solver, started cold, on this thread alone
+        // like the rest of the worker's models, or portable like it
+        session.batch = MakeBatchMPC(*session.solver.mpc, n, 1);
+        if (!session.batch) {
+          Log(session.solve_warnings, LogLevel::kWarning,
+              "MPC: the solver can't be copied for a batch of {} cars", n);
+          return;
+        }
+        session.car_fits.assign(n, ReferenceFitCache(ReferenceFitTolerance(), session.float_fit));
+        session.batch_states.resize(n);
+        session.batch_coeffs.resize(n);
+        session.batch_results.resize(n);
+        if (proximity_radius > 0) {
+          session.proximity.reset(new ProximityGrid(proximity_radius, MPCSolution::max_stages));
+        }
+        Log(LogLevel::kInfo, "Batch: {} cars", n);
+      }
+      BatchMPC &batch = *session.batch;
+      std::unique_lock<std::mutex> latency_lock(session.latency_mutex);
+      const double dt = session.latency.latency();
+      latency_lock.unlock();
+      session.fleet_fitted =
+          !session.float_fit &&
+          session.fleet_fit.Fit(session.cars.data(), n, session.batch_coeffs.data());
+      for (size_t k = 0; k < n; k++) {
+        const Telemetry &car = session.cars[k];
+        if (!session.fleet_fitted) {
+          session.batch_coeffs[k] =
+              session.car_fits[k].Fit(car.ptsx, car.ptsy, car.x, car.y, car.psi);
+        }
+        const MPCCoeffs &coeffs = session.batch_coeffs[k];
+        session.batch_states[k] = predict(car.speed, car.steering_angle, batch.vehicle(k).prev_a,
+                                          polyeval(coeffs, 0), -atan(coeffs[1]), dt);
+      }
+      // The cars that came close in the plans of the last tick, each pair
+      // rather than every stage of every car against every other, and the
+      // reference speed of the cost of those that yield
+      size_t yielding = 0;
+      if (session.proximity) {
+        ProximityGrid &grid = *session.proximity;
+        grid.NearPairs(proximity_radius, 1, session.proximity_pairs);
+        MPCSolution::StageArray times{};
+        for (size_t t = 0; t < batch.vehicle(0).horizon_length(); t++) {
+          times[t] = batch.vehicle(0).stage_time(t);
+        }
+        YieldSpeeds(grid, session.proximity_pairs, times.data(), proximity_radius,
+                    session.yield_speeds);
+        for (size_t k = 0; k < n; k++) {
+          MPCBase &car = batch.vehicle(k);
+          car.cost_schedule = session.solver.mpc->cost_schedule;
+          if (k < session.yield_speeds.size() && std::isfinite(session.yield_speeds[k])) {
+            CostWeights weights = car.cost_schedule.At(session.batch_states[k][3]);
+            weights.v_ref = std::min(weights.v_ref, session.yield_speeds[k] / kMphToMs);
+            car.cost_schedule.Clear();
+            car.cost_schedule.AddPoint(0, weights);
+            yielding++;
+          }
+        }
+        MPC_COUNT(Metrics().proximity_pairs.Add(session.proximity_pairs.size()));
+      }
+      const Mailbox::Clock::time_point fitted = InstrumentNow();
+      batch.SolveBatch(session.batch_states.data(), session.batch_coeffs.data(),
+                       session.batch_results.data());
+      const Mailbox::Clock::time_point solved = InstrumentNow();
+      if (session.proximity) {
+        // Out of the vehicle frame of each car into the frame they share
+        for (size_t k = 0; k < n; k++) {
+          const Telemetry &car = session.cars[k];
+          const MPCSolution &result = session.batch_results[k];
+          MPCSolution::StageArray xs, ys;
+          const double c = std::cos(car.psi);
+          const double s = std::sin(car.psi);
+          for (size_t t = 0; t < result.stages; t++) {
+            xs[t] = car.x + c * result.x[t] - s * result.y[t];
+            ys[t] = car.y + s * result.x[t] + c * result.y[t];
+          }
+          session.proximity->Update(k, xs.data(), ys.data(), result.stages);
+        }
+        if (yielding > 0) {
+          Log(LogLevel::kInfo, "Proximity: {} pairs of stages, {} cars yielding",
+              session.proximity_pairs.size(), yielding);
+        }
+      }
+
+      ServerMetrics &metrics = Metrics();
+      const bool draw = session.lines.Due(session.ticks++) &&
+                        !session.congested.load(std::memory_order_relaxed);
+      session.steer_message.BeginBatch();
+      // The waypoints each car is drawn with, in its frame
+      Telemetry::Waypoints next_x, next_y;
+      for (size_t k = 0; k < n; k++) {
+        const MPCSolution &result = session.batch_results[k];
+        const double steer_value = SteerCommand(result.delta[0]);
+        const double throttle_value = result.a[0];
+        batch.vehicle(k).prev_a = throttle_value;
+        const size_t mpc_n = draw && result.stages > 0 ? result.stages - 1 : 0;
+        if (draw && session.fleet_fitted) {
+          session.fleet_fit.Waypoints(k, next_x, next_y);
+        } else if (draw) {
+          next_x = session.car_fits[k].xs();
+          next_y = session.car_fits[k].ys();
+        }
+        session.steer_message.AddToBatch(steer_value, throttle_value, result.x.data() + 1,
+                                         result.y.data() + 1, mpc_n, next_x.data(),
+                                         next_y.data(), draw ? next_x.size() : 0);
+        count_solve(result);
+      }
+      const std::string &msg = session.steer_message.EndBatch();
+      Log(LogLevel::kDebug, "{}", msg);
+      Log(LogLevel::kInfo, "Batch: {} cars solved in {} s, latency {} s predicted", n,
+          seconds(solved - fitted), dt);
+      // Held back by the event loop like the command of a single car
+      const Mailbox::Clock::time_point replied = InstrumentNow();
+      session.replies.Post(MessageView(msg.data(), msg.size()), mail.arrival);
+      session.home->reply_ready->send();
+
+      if (kInstrumentCounters) {
+        metrics.ticks.Add(n);
+        metrics.wait.Observe(seconds(started - mail.arrival));
+        metrics.parse.Observe(seconds(parsed - started));
+        metrics.fit.Observe(seconds(fitted - parsed));
+        metrics.solve.Observe(seconds(solved - fitted));
+        metrics.reply.Observe(seconds(replied - solved));
+        // The fits and predictions of the cars are interleaved, both go
+        // under fit
+        StageHistograms &stages = session.stages;
+        stages.Record(TickStage::kWait, seconds(started - mail.arrival));
+        stages.Record(TickStage::kParse, seconds(parsed - started));
+        stages.Record(TickStage::kFit, seconds(fitted - parsed));
+        stages.Record(TickStage::kSolve, seconds(solved - fitted));
+        stages.Record(TickStage::kSerialize, seconds(replied - solved));
+      }
+      MPC_TRACE_SPAN("wait", mail.arrival, started);
+      MPC_TRACE_SPAN("parse", started, parsed);
+      MPC_TRACE_SPAN("fit", parsed, fitted);
+      MPC_TRACE_SPAN("solve batch", fitted, solved);
+      MPC_TRACE_SPAN("serialize", solved, replied);
+      log_stages(session, replied);
+      count_backlog(session);
+    };
+
+    // With plan, the reference of a tick on the track from the latest plan
+    // of the session's planner, once it has one from around the car: the
+    // cubic fitted to the racing line instead of the center line, and the
+    // reference speed of the cost that of the plan half a horizon ahead,
+    // where the plan has left room to brake for the corners past the
+    // horizon. The car's place goes to the planner for its next plan.
+    const std::chrono::milliseconds plan_period(static_cast<long>(1000 / plan_rate));
+    const auto follow_plan = [&](Session &session, double px, double py, double psi, double v,
+                                 MPCCoeffs &coeffs) {
+      const std::shared_ptr<const TrackMap> &track_map = session.track_map;
+      if (!session.planner || session.planner->track() != track_map.get()) {
+        session.planner.reset(new TrackPlanner(track_map, plan_period));
+      }
+      const TrackSpline &spline = track_map->spline();
+      const double length = spline.length();
+      const TrackPoint at = spline.At(session.track_progress);
+      PlanRequest request;
+      request.progress = session.track_progress;
+      request.offset = ((py - at.y) * at.dx - (px - at.x) * at.dy) / std::hypot(at.dx, at.dy);
+      request.top_speed = runtime_config.Current().weights.v_ref;
+      session.planner->Request(request);
+      const TrackPlan &latest = session.planner->Latest();
+      MPCBase &mpc = *session.solver.mpc;
+      CostWeights weights = mpc.cost_schedule.At(0);
+      weights.v_ref = request.top_speed;
+      if (latest.Covers(session.track_progress, length)) {
+        double xs[kPlanPoints];
+        double ys[kPlanPoints];
+        for (size_t k = 0; k < kPlanPoints; k++) {
+          const double s = session.track_progress + k * kPlanLookAhead / (kPlanPoints - 1);
+          const TrackPoint p = spline.At(s);
+          const double offset = latest.OffsetAt(s, length) / std::hypot(p.dx, p.dy);
+          xs[k] = p.x - offset * p.dy;
+          ys[k] = p.y + offset * p.dx;
+        }
+        coeffs = FitInVehicleFrame<3>(px, py, psi, xs, ys, kPlanPoints, xs, ys);
+        const double preview = 0.5 * v * kMphToMs * mpc.horizon_length() * mpc.timestep();
+        weights.v_ref = latest.SpeedAt(session.track_progress + preview, length);
+      }
+      // In place of the one point of the configuration, which configure
+      // puts back at a change
+      mpc.cost_schedule.Clear();
+      mpc.cost_schedule.AddPoint(0, weights);
+    };
 
-          //Display the waypoints/reference line
-          vector<double> next_x_vals;
-          vector<double> next_y_vals;
+    // A tick of a session: its telemetry in mail solved, and the command
+    // posted back to the event loop
+    const auto solve = [&](Session &session, const Mailbox::Mail &mail) {
+      // The state of the session, under the names of a single simulator
+      std::unique_ptr<MPCBase> &mpc = session.solver.mpc;
+      MPCBase *const reference_mpc = session.solver.reference_mpc;
+      MPCBase *const frenet_mpc = session.solver.frenet_mpc;
+      AdaptiveHorizonMPC *const adaptive_mpc = session.solver.adaptive_mpc;
+      RegimeMPC *const regime_mpc = session.solver.regime_mpc;
+      RoutedMPC *const routed_mpc = session.solver.routed_mpc;
+      MultiStartMPC *const multistart_mpc = session.solver.multistart_mpc;
+      RefiningMPC *const refining_mpc = session.solver.refining_mpc;
+      SensitivityMPC *const sensitivity_mpc = session.solver.sensitivity_mpc;
+      NeuralMPC *const neural_mpc = session.solver.neural_mpc;
+      SpeculativeMPC *const speculative_mpc = session.solver.speculative_mpc;
+      SharedSolveMPC *const shared_mpc = session.solver.shared_mpc;
+      TableMPC *const table_mpc = session.solver.table_mpc;
+      EventTriggeredMPC *const event_mpc = session.solver.event_mpc;
+      ReferenceFitCache &reference_fit = session.reference_fit;
+      std::unique_ptr<WaypointHistory> &waypoint_history = session.waypoint_history;
+      std::shared_ptr<const TrackMap> &track_map = session.track_map;
+      TrackMatch &track_match = session.track_match;
+      double &track_progress = session.track_progress;
+      Telemetry &telemetry = session.telemetry;
+      SteerMessage &steer_message = session.steer_message;
+      LogRateLimit &solve_warnings = session.solve_warnings;
+      LatencyEstimator &latency = session.latency;
+      // For the metrics of the tick
+      const Mailbox::Clock::time_point started = InstrumentNow();
+      const PerfCounts started_events = ReadPerfCounters();
+      const size_t fit_hits = reference_fit.hits();
+      const size_t fit_refits = reference_fit.refits();
+      const size_t fit_misses = reference_fit.misses();
 
-          next_x_vals.resize(static_cast<unsigned long>(ptsxvec.size()));
-          next_y_vals.resize(static_cast<unsigned long>(ptsyvec.size()));
+      const MessageView sdata(mail.message.data(), mail.message.size());
+      const bool packed = session.format == WireFormat::kMessagePack;
+      const bool shared = session.format == WireFormat::kSharedMemory;
+      BeginTickAllocations(packed || shared ? TickStage::kParse : TickStage::kDecode);
+      // With prefit, the frame parsed and fitted on the event loop while the
+      // last tick solved, unless a newer one was prepared meanwhile
+      const PreparedFrame *prepared = nullptr;
+      if (session.prefit) {
+        session.prepared.Update();
+        if (session.prepared.Front().sequence == mail.sequence) {
+          prepared = &session.prepared.Front();
+          telemetry = prepared->telemetry;
+          MPC_COUNT(Metrics().frames_prepared.Add());
+        }
+      }
+      if (prepared == nullptr && packed && !UnpackTelemetry(sdata, telemetry)) {
+        Log(solve_warnings, LogLevel::kWarning, "Malformed MessagePack telemetry, {} bytes",
+            sdata.size());
+        return;
+      }
+      if (prepared == nullptr && shared && !ReadSharedTelemetry(sdata, telemetry)) {
+        Log(solve_warnings, LogLevel::kWarning, "Malformed shared telemetry, {} bytes",
+            sdata.size());
+        return;
+      }
+      Mailbox::Clock::time_point decoded = started;
+      PerfCounts decoded_events = started_events;
+      if (prepared == nullptr && !packed && !shared) {
+        SocketIOFrame frame;
+        DecodeFrame(sdata, frame);
+        decoded = InstrumentNow();
+        decoded_events = ReadPerfCounters();
+        MPC_COUNT(session.stages.Record(TickStage::kDecode, seconds(decoded - started)));
+        MPC_TRACE_SPAN("decode", started, decoded);
+        if (frame.event.equals("telemetry_batch")) {
+          EndTickAllocations();
+          solve_batch(session, frame.data, mail);
+          return;
+        }
+        AllocationStage(TickStage::kParse);
+        // The telemetry straight into its struct, through the JSON library
+        // only if it isn't in the form of DATA.md
+        if (!ParseTelemetry(frame.data, telemetry)) {
+          auto j = json::parse(frame.payload.begin(), frame.payload.end());
+          const vector<double> ptsx = j[1]["ptsx"].get<vector<double> >();
+          const vector<double> ptsy = j[1]["ptsy"].get<vector<double> >();
+          // The waypoints past those a message holds are dropped
+          telemetry.ptsx.assign(ptsx.begin(),
+                                ptsx.begin() + std::min(ptsx.size(), Telemetry::kMaxWaypoints));
+          telemetry.ptsy.assign(ptsy.begin(),
+                                ptsy.begin() + std::min(ptsy.size(), Telemetry::kMaxWaypoints));
+          telemetry.x = j[1]["x"];
+          telemetry.y = j[1]["y"];
+          telemetry.psi = j[1]["psi"];
+          telemetry.speed = j[1]["speed"];
+          telemetry.steering_angle = j[1]["steering_angle"];
+        }
+      }
+      const Mailbox::Clock::time_point parsed = InstrumentNow();
+      const PerfCounts parsed_events = ReadPerfCounters();
+      AllocationStage(TickStage::kFit);
+      const Telemetry::Waypoints &ptsx = telemetry.ptsx;
+      const Telemetry::Waypoints &ptsy = telemetry.ptsy;
+      const double px = telemetry.x;
+      const double py = telemetry.y;
+      const double psi = telemetry.psi;
+      const double v = telemetry.speed;
 
+      /*
+       * Calculate steeering angle and throttle using MPC.
+       * Both are in between [-1, 1].
+       */
+      ///*********************************
+      ///*   Start of implementation     *
+      ///*********************************
 
-          //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
-          // the points in the simulator are connected by a Yellow line
-          for (int i = 0; i < ptsxvec.size(); i++) {
-            next_x_vals[i] = ptsxvec[i];
-            next_y_vals[i] = ptsyvec[i];
+      // Transform ptsx, ptsy to car the coordinate and fit polynomial to
+      // them, or take the last fit if neither they nor the pose changed.
+      // With the track, the reference comes from its stretch ahead of
+      // the car, searched for near the last message's match unless the
+      // car jumped. With the history, from its waypoints ahead of the
+      // car, until they close the loop and make the track.
+      if (waypoint_history && !track_map) {
+        waypoint_history->Add(ptsx, ptsy);
+        if (waypoint_history->closed()) {
+          std::vector<double> xs;
+          std::vector<double> ys;
+          waypoint_history->Waypoints(xs, ys);
+          track_map.reset(new TrackMap(xs, ys));
+          Log(LogLevel::kInfo, "Track: {} waypoints of the history, {} m", xs.size(),
+              track_map->spline().length());
+        }
+      }
+      MPCCoeffs coeffs;
+      bool fitted_waypoints = false;
+      if (track_map) {
+        if (track_match.distance >= 0) {
+          track_match = track_map->index().Track(px, py, track_match);
+        }
+        if (track_match.distance < 0 || track_match.distance > kTrackRecapture) {
+          track_match = track_map->index().Nearest(px, py);
+        }
+        track_progress = track_map->spline().Project(px, py, track_match.s);
+        coeffs = track_map->spline().LocalReference(px, py, psi, track_progress);
+        if (plan) {
+          follow_plan(session, px, py, psi, v, coeffs);
+        }
+        // The solver lets go of the references of the last tick first, so
+        // that they are rebuilt in place rather than allocated anew
+        if (reference_mpc != nullptr) {
+          reference_mpc->reference_table.reset();
+          if (session.reference_table.use_count() == 1) {
+            session.reference_table->Build(track_map->spline(), px, py, psi, track_progress);
+          } else {
+            session.reference_table = std::make_shared<ReferenceTable>(
+                track_map->spline(), px, py, psi, track_progress);
+          }
+          reference_mpc->reference_table = session.reference_table;
+        }
+        if (frenet_mpc != nullptr) {
+          frenet_mpc->frenet_reference.reset();
+          if (session.frenet_reference.use_count() == 1 &&
+              session.frenet_track == track_map.get()) {
+            session.frenet_reference->Build(track_progress);
+          } else {
+            session.frenet_reference =
+                std::make_shared<FrenetReference>(track_map->spline(), track_progress);
+            session.frenet_track = track_map.get();
           }
+          frenet_mpc->frenet_reference = session.frenet_reference;
+        }
+      } else if (prepared != nullptr) {
+        coeffs = prepared->coeffs;
+        fitted_waypoints = true;
+      } else if (!waypoint_history ||
+                 !waypoint_history->Reference(px, py, psi, kHistoryLookAhead, coeffs)) {
+        coeffs = reference_fit.Fit(ptsx, ptsy, px, py, psi);
+        fitted_waypoints = true;
+      }
+      // The cubic of the track and the history, or the order of the fit
+      const size_t reference_order = prepared != nullptr ? prepared->order : reference_fit.order();
+      session.solver.core->SetReferenceOrder(fitted_waypoints ? reference_order : 3);
+      const Mailbox::Clock::time_point fitted = InstrumentNow();
+      const PerfCounts fitted_events = ReadPerfCounters();
+      AllocationStage(TickStage::kPredict);
+
+      // Shifted coords so car at 0,0 and angle is 0, so set x to 0
+
+      // Estimate cross-track error (horizontal works reasonably well unless there's a lot of warpage
+      const double cte = polyeval(coeffs, 0);
+      // Calculate orientation error
+      /// Check derivation is correct
+      const double epsi = -atan(coeffs[1]);
 
 
-          msgJson["next_x"] = next_x_vals;
-          msgJson["next_y"] = next_y_vals;
+      /* Convert units */
+      Log(LogLevel::kInfo, "cte: {}m?", cte);
 
-          ///*********************************
-          ///*    End of implementation      *
-          ///*********************************
+      Log(LogLevel::kInfo, "velocity: {}mph", v);
+      // the car weaves a lot if I convert from mph to m/s
+      // v = v * 1600 / 3600;
+      // std::cout << "velocity: " << v << "m/s" << endl;
+
+      // predict the state 100ms into the future before you send it to the solver in order to compensate for the latency.
+
+      // Latency of 100ms plus the processing, so predict by the
+      // measured delay of the last ticks, 0.1 s until there are some
+      std::unique_lock<std::mutex> latency_lock(session.latency_mutex);
+      const double dt = latency.latency();
+      const double last_latency = latency.last();
+      latency_lock.unlock();
+      // Previous steering angle and throttle
+      const double delta = telemetry.steering_angle;
+      const double prev_a = mpc->prev_a;
+
+      // Predict (x = y = psi = 0)
+      MPCState state = predict(v, delta, prev_a, cte, epsi, dt);
+      // In path coordinates the model itself predicts, from the pose
+      // against the track
+      if (frenet_mpc != nullptr) {
+        state = ModelStep(FrenetReference::State(track_map->spline(), px, py, psi, v,
+                                                 track_progress),
+                          delta, prev_a, *frenet_mpc->frenet_reference, dt);
+      }
 
-          auto msg = "42[\"steer\"," + msgJson.dump() + "]";
-          std::cout << msg << std::endl;
-          // Latency
-          // The purpose is to mimic real driving conditions where
-          // the car does actuate the commands instantly.
-          //
-          // Feel free to play around with this value but should be to drive
-          // around the track with 100ms latency.
-          //
-          // NOTE: REMEMBER TO SET THIS TO 100 MILLISECONDS BEFORE
-          // SUBMITTING.
-          this_thread::sleep_for(chrono::milliseconds(100));
-          ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+      // Solve using MPC
+      // coeffs to predict future cte and epsi
+      const Mailbox::Clock::time_point predicted = InstrumentNow();
+      const PerfCounts predicted_events = ReadPerfCounters();
+      AllocationStage(TickStage::kSolve);
+      // Of the solver under the wrappers, which keeps the plans
+      if (lap_cache) {
+        session.solver.core->SetTrackPosition(track_map ? track_progress : -1);
+      }
+      const MPCSolution result = mpc->Solve(state, coeffs);
+      const Mailbox::Clock::time_point solved = InstrumentNow();
+      const PerfCounts solved_events = ReadPerfCounters();
+      AllocationOutsideStages();
+      // For the snapshot, and the restored session until it is steady
+      const double solve_took = seconds(solved - predicted);
+      session.solve_seconds =
+          session.solve_seconds > 0 ? 0.9 * session.solve_seconds + 0.1 * solve_took : solve_took;
+      if (session.settling) {
+        settle(session, result, solve_took);
+      }
+      if (capture && seconds(solved - predicted) > capture->threshold()) {
+        CapturedProblem &problem = session.captured;
+        problem.backend = SolverBackendName(session.solver.backend);
+        problem.horizon = session.solver.horizon;
+        problem.move_blocking = move_blocking;
+        problem.sampled = sampled;
+        problem.linearization_table = linearization_table;
+        problem.soft_penalty = soft ? kSoftPenalty : 0;
+        problem.state = state;
+        problem.coeffs = coeffs;
+        problem.prev_a = prev_a;
+        problem.max_solve_time = mpc->max_solve_time;
+        problem.weights = mpc->cost_schedule.At(state[3]);
+        mpc->SaveStart(problem.start);
+        problem.session = session.id;
+        problem.arrival_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 mail.arrival.time_since_epoch())
+                                 .count();
+        problem.seconds = seconds(solved - predicted);
+        problem.iterations = result.statistics.iterations;
+        problem.status = static_cast<int>(result.status);
+        problem.restorations = result.statistics.restorations;
+        problem.cost = result.cost;
+        if (capture->Capture(problem)) {
+          MPC_COUNT(Metrics().problems_captured.Add());
+          Log(LogLevel::kInfo, "Captured the problem of a {} s solve of session {}",
+              seconds(solved - predicted), session.id);
+        } else {
+          MPC_COUNT(Metrics().problems_dropped.Add());
+        }
+      }
+      // The size of its problem, once the first solve has set it up
+      if (kInstrumentCounters && !session.footprint.known()) {
+        session.footprint.Set(mpc->Footprint());
+      }
+      if (result.status == SolveStatus::kDeadline) {
+        Log(solve_warnings, LogLevel::kWarning,
+            "MPC: deadline hit, using the best feasible plan");
+      } else if (result.status == SolveStatus::kFailed) {
+        Log(solve_warnings, LogLevel::kWarning,
+            "MPC: no solution, following the previous plan");
+      }
+      if (mpc->effort() != nullptr) {
+        const EffortLevel &setpoint = mpc->effort()->setpoint();
+        Log(LogLevel::kInfo, "Effort: level {}, tol {}, max_iter {}, p99 {} s",
+            mpc->effort()->level(), setpoint.tol, setpoint.max_iter,
+            mpc->effort()->latency());
+      }
+      Log(LogLevel::kInfo, "Latency: {} s predicted, last tick {} s", dt, last_latency);
+      if (track_map) {
+        Log(LogLevel::kInfo, "Track: {} m of {}", track_progress,
+            track_map->spline().length());
+        if (session.planner) {
+          const TrackPlan &latest = session.planner->Latest();
+          Log(LogLevel::kInfo, "Plan: {} of the last {} made in {} s, {} mph to track",
+              latest.version, session.planner->plans(), latest.seconds,
+              mpc->cost_schedule.At(0).v_ref);
         }
+      } else if (waypoint_history) {
+        Log(LogLevel::kInfo, "History: {} waypoints, {} m", waypoint_history->size(),
+            waypoint_history->length());
+      } else if (!session.prefit) {
+        // With prefit the counts are the event loop's, in the metrics
+        Log(LogLevel::kInfo, "Reference fit: {} reused, {} refitted, {} new waypoints",
+            reference_fit.hits(), reference_fit.refits(), reference_fit.misses());
+      }
+      if (soft) {
+        Log(LogLevel::kInfo, "Soft constraints: slacks active on {} solves",
+            mpc->slack_activations());
+      }
+      if (adaptive_mpc != nullptr) {
+        Log(LogLevel::kInfo, "Horizon: {} x {} s, {} switches", mpc->horizon_length(),
+            mpc->timestep(), adaptive_mpc->switches());
+      }
+      if (regime_mpc != nullptr) {
+        Log(LogLevel::kInfo, "Regime: {}, {} x {} s, {} switches",
+            RoadRegimeName(regime_mpc->regime()), mpc->horizon_length(), mpc->timestep(),
+            regime_mpc->switches());
+      }
+      if (routed_mpc != nullptr) {
+        const RouteDecision &decision = routed_mpc->decision();
+        Log(LogLevel::kInfo, "Route: {} for the {}, {} s, {} switches",
+            RouteName(decision.route), RouteReasonName(decision.reason), decision.seconds,
+            routed_mpc->switches());
+        if (route_log) {
+          route_log->Write(session.id, decision);
+        }
+      }
+      if (multistart_mpc != nullptr) {
+        Log(LogLevel::kInfo, "Multistart: candidate {}, seeds won {} ticks",
+            multistart_mpc->best(), multistart_mpc->seed_wins());
+      }
+      if (refining_mpc != nullptr && refining_mpc->refinements() > 0) {
+        Log(LogLevel::kInfo, "Refinement: {} sweeps{}, cost {} to {}, {} of {} preempted",
+            refining_mpc->sweeps(), refining_mpc->interrupted() ? ", preempted" : "",
+            refining_mpc->first_cost(), refining_mpc->refined_cost(),
+            refining_mpc->preemptions(), refining_mpc->refinements());
+      }
+      if (sensitivity_mpc != nullptr) {
+        Log(LogLevel::kInfo, "Sensitivity: {}, updated {} of {}",
+            SensitivityReasonName(sensitivity_mpc->reason()), sensitivity_mpc->updates(),
+            sensitivity_mpc->updates() + sensitivity_mpc->solves());
+      }
+      if (neural_mpc != nullptr) {
+        Log(LogLevel::kInfo, "Policy: {}, {} policy ticks, {} fallbacks",
+            neural_mpc->used_policy() ? "taken" : "solved", neural_mpc->policy_ticks(),
+            neural_mpc->fallbacks());
+      }
+      if (speculative_mpc != nullptr) {
+        Log(LogLevel::kInfo, "Speculation: {}, {} hits of {}",
+            speculative_mpc->hit() ? "hit" : "missed, solved", speculative_mpc->hits(),
+            speculative_mpc->speculations());
+      }
+      if (table_mpc != nullptr) {
+        Log(LogLevel::kInfo, "Table: {}, {} table ticks",
+            table_mpc->used_table() ? "used" : "outside, solved", table_mpc->table_ticks());
+      }
+      if (event_mpc != nullptr) {
+        Log(LogLevel::kInfo, "Event trigger: {}, skipped {} of {}",
+            TriggerReasonName(event_mpc->reason()), event_mpc->skips(),
+            event_mpc->skips() + event_mpc->solves());
+      }
+
+      const double steer_value = SteerCommand(result.delta[0]);
+      Log(LogLevel::kInfo, "steer_value: {}", steer_value);
+      const double throttle_value = result.a[0];
+
+      // Discarded.
+      // Delete attribute
+      // mpc.prev_delta = steer_value;
+      mpc->prev_a = throttle_value;
+
+      // The lines to draw, on the replies the session takes them with, and
+      // empty on the others and while the client is behind
+      const bool draw = session.lines.Due(session.ticks++) &&
+                        !session.congested.load(std::memory_order_relaxed);
+
+      //Display the MPC predicted trajectory
+      //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
+      // the points in the simulator are connected by a Green line. The
+      // first stage is the car itself.
+      MPCSolution::StageArray mpc_x_vals = result.x;
+      MPCSolution::StageArray mpc_y_vals = result.y;
+      const size_t mpc_n = draw && result.stages > 0 ? result.stages - 1 : 0;
+      if (frenet_mpc != nullptr) {
+        // From path coordinates through the map into the vehicle frame
+        for (size_t i = 1; i <= mpc_n; i++) {
+          frenet_mpc->frenet_reference->Position(mpc_x_vals[i], mpc_y_vals[i],
+                                                 mpc_x_vals[i], mpc_y_vals[i]);
+        }
+        ToVehicleFrame(px, py, psi, mpc_x_vals.data() + 1, mpc_y_vals.data() + 1, mpc_n,
+                       mpc_x_vals.data() + 1, mpc_y_vals.data() + 1);
+      }
+
+      //Display the waypoints/reference line
+      //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
+      // the points in the simulator are connected by a Yellow line
+      const Telemetry::Waypoints &next_xs = prepared != nullptr ? prepared->xs : reference_fit.xs();
+      const Telemetry::Waypoints &next_ys = prepared != nullptr ? prepared->ys : reference_fit.ys();
+      const double *next_x_vals = next_xs.data();
+      const double *next_y_vals = next_ys.data();
+      size_t next_n = draw ? next_xs.size() : 0;
+      std::array<double, 16> track_x_vals;
+      std::array<double, 16> track_y_vals;
+      if (track_map && draw) {
+        // The reference itself, every 2 m ahead
+        for (size_t i = 0; i < track_x_vals.size(); i++) {
+          track_x_vals[i] = 2.0 * i;
+        }
+        polyeval(coeffs, track_x_vals.data(), track_x_vals.size(), track_y_vals.data());
+        next_x_vals = track_x_vals.data();
+        next_y_vals = track_y_vals.data();
+        next_n = track_x_vals.size();
+      }
+
+      ///*********************************
+      ///*    End of implementation      *
+      ///*********************************
+
+      const double *const mpc_x = mpc_x_vals.data() + 1;
+      const double *const mpc_y = mpc_y_vals.data() + 1;
+      const Mailbox::Clock::time_point serializing = InstrumentNow();
+      const PerfCounts serializing_events = ReadPerfCounters();
+      AllocationStage(TickStage::kSerialize);
+      const std::string &msg =
+          packed   ? session.steer_pack.Write(steer_value, throttle_value, mpc_x, mpc_y, mpc_n,
+                                              next_x_vals, next_y_vals, next_n)
+          : shared ? session.steer_record.Write(steer_value, throttle_value, mpc_x, mpc_y,
+                                                mpc_n, next_x_vals, next_y_vals, next_n)
+                   : steer_message.Write(steer_value, throttle_value, mpc_x, mpc_y, mpc_n,
+                                         next_x_vals, next_y_vals, next_n);
+      const Mailbox::Clock::time_point serialized = InstrumentNow();
+      const PerfCounts serialized_events = ReadPerfCounters();
+      AllocationOutsideStages();
+      if (packed || shared) {
+        Log(LogLevel::kDebug, "Steer: {} bytes", msg.size());
       } else {
-        // Manual driving
-        std::string msg = "42[\"manual\",{}]";
-        ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+        Log(LogLevel::kDebug, "{}", msg);
+      }
+      // Latency
+      // The purpose is to mimic real driving conditions where
+      // the car does actuate the commands instantly.
+      //
+      // Feel free to play around with this value but should be to drive
+      // around the track with 100ms latency.
+      //
+      // NOTE: REMEMBER TO SET THIS TO 100 MILLISECONDS BEFORE
+      // SUBMITTING.
+      //
+      // Handed to the event loop, which holds it back on a timer (see
+      // reply_ready) and serves the other sockets meanwhile; the latency is
+      // measured when it goes out.
+      const Mailbox::Clock::time_point replied = Mailbox::Clock::now();
+      if (shared) {
+        // Or straight to the client on the same host, which actuates it
+        // with the latency it simulates itself
+        AllocationStage(TickStage::kSend);
+        if (!session.shared->SendCommand(MessageView(msg.data(), msg.size()))) {
+          session.dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        session.Record(FlightRecordType::kCommand, replied, MessageView(msg.data(), msg.size()),
+                       mail.arrival);
+        const Mailbox::Clock::time_point sent = Mailbox::Clock::now();
+        AllocationOutsideStages();
+        if (kInstrumentCounters) {
+          session.stages.Record(TickStage::kSend, seconds(sent - replied));
+          Metrics().command_latency.Observe(seconds(sent - mail.arrival));
+          const double jitter = session.jitter.Sent(mail.arrival, sent);
+          if (jitter >= 0) {
+            Metrics().command_jitter.Observe(jitter);
+          }
+        }
+        MPC_TRACE_SPAN("send", replied, sent);
+        std::lock_guard<std::mutex> lock(session.latency_mutex);
+        latency.Sent(mail.arrival, sent);
+      } else {
+        // The plan first, for the event loop to find it with the reply
+        if (command_rate > 0) {
+          CommandPlan &plan = session.command_plans.Back();
+          plan.actuations = result.stages > 0 ? result.stages - 1 : 0;
+          for (size_t t = 0; t < plan.actuations; t++) {
+            plan.time[t] = mpc->stage_time(t);
+            plan.steering[t] = SteerCommand(result.delta[t]);
+            plan.throttle[t] = result.a[t];
+          }
+          session.command_plans.Publish();
+        }
+        session.replies.Post(MessageView(msg.data(), msg.size()), mail.arrival);
+        session.home->reply_ready->send();
       }
-    }
-  });
 
-  // We don't need this since we're not using HTTP but if it's removed the
-  // program
-  // doesn't compile :-(
-  h.onHttpRequest([](uWS::HttpResponse *res, uWS::HttpRequest req, char *data,
-                     size_t, size_t) {
-    const std::string s = "<h1>Hello world!</h1>";
-    if (req.getUrl().valueLength == 1) {
-      res->end(s.data(), s.length());
-    } else {
-      // i guess this should be done more gracefully?
-      res->end(nullptr, 0);
-    }
-  });
+      // The tick for the observers, once its command is on its way
+      if (worker.observer_ring) {
+        ObservedTick &observed = worker.observer_ring->Begin();
+        observed.session = session.id;
+        observed.arrival_ns =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(mail.arrival.time_since_epoch())
+                .count();
+        observed.x = px;
+        observed.y = py;
+        observed.psi = psi;
+        observed.speed = v;
+        observed.steering_angle = telemetry.steering_angle;
+        observed.throttle = telemetry.throttle;
+        std::copy(state.data(), state.data() + state.size(), observed.state);
+        observed.status = static_cast<int32_t>(result.status);
+        observed.iterations = result.statistics.iterations;
+        observed.cost = result.cost;
+        observed.solve_seconds = seconds(solved - predicted);
+        observed.steer_value = steer_value;
+        observed.throttle_value = throttle_value;
+        // In the vehicle frame, which path coordinates are only brought
+        // back to on the ticks that draw
+        const size_t plan_points =
+            frenet_mpc != nullptr ? mpc_n : result.stages > 0 ? result.stages - 1 : 0;
+        observed.plan_points =
+            static_cast<uint32_t>(std::min(plan_points, kObservedPlanPoints));
+        std::copy(mpc_x_vals.data() + 1, mpc_x_vals.data() + 1 + observed.plan_points,
+                  observed.plan_x);
+        std::copy(mpc_y_vals.data() + 1, mpc_y_vals.data() + 1 + observed.plan_points,
+                  observed.plan_y);
+        worker.observer_ring->Publish();
+      }
+
+      TickCaches tick_caches;
+      if (kInstrumentCounters) {
+        ServerMetrics &metrics = Metrics();
+        metrics.ticks.Add();
+        metrics.wait.Observe(seconds(started - mail.arrival));
+        metrics.parse.Observe(seconds(parsed - started));
+        metrics.fit.Observe(seconds(fitted - parsed));
+        metrics.solve.Observe(seconds(solved - fitted));
+        metrics.reply.Observe(seconds(replied - solved));
+        StageHistograms &stages = session.stages;
+        stages.Record(TickStage::kWait, seconds(started - mail.arrival));
+        stages.Record(TickStage::kParse, seconds(parsed - decoded));
+        stages.Record(TickStage::kFit, seconds(fitted - parsed));
+        stages.Record(TickStage::kPredict, seconds(predicted - fitted));
+        stages.Record(TickStage::kSolve, seconds(solved - predicted));
+        // Broken out by the backends that time their phases
+        const SolvePhases &phases = result.statistics.phases;
+        if (phases.model > 0 || phases.derivatives > 0 || phases.linear_solve > 0) {
+          stages.Record(TickStage::kModel, phases.model);
+          stages.Record(TickStage::kDerivatives, phases.derivatives);
+          stages.Record(TickStage::kLinearSolve, phases.linear_solve);
+        }
+        stages.Record(TickStage::kSerialize, seconds(serialized - serializing));
+        if (perf_counters) {
+          StageEvents &events = session.events;
+          if (!packed && !shared) {
+            events.Add(TickStage::kDecode, decoded_events - started_events);
+          }
+          events.Add(TickStage::kParse, parsed_events - decoded_events);
+          events.Add(TickStage::kFit, fitted_events - parsed_events);
+          events.Add(TickStage::kPredict, predicted_events - fitted_events);
+          events.Add(TickStage::kSolve, solved_events - predicted_events);
+          if (phases.model > 0 || phases.derivatives > 0 || phases.linear_solve > 0) {
+            events.Add(TickStage::kModel, phases.model_events);
+            events.Add(TickStage::kDerivatives, phases.derivative_events);
+            events.Add(TickStage::kLinearSolve, phases.linear_solve_events);
+          }
+          events.Add(TickStage::kSerialize, serialized_events - serializing_events);
+        }
+        // Against the control period, up to the reply
+        TickDeadline deadline;
+        deadline.wait = seconds(started - mail.arrival);
+        deadline.parse = seconds(parsed - started);
+        deadline.solve = seconds(solved - parsed);
+        deadline.reply = seconds(replied - solved);
+        deadline.iteration_cap = result.status == SolveStatus::kDeadline;
+        deadline.restoration = result.statistics.restorations > 0;
+        DeadlineMiss miss;
+        const bool missed = MissedDeadline(deadline, control_period_ms * 1e-3, miss);
+        metrics.slo_ticks.Add();
+        if (missed) {
+          metrics.slo_misses[static_cast<size_t>(miss)].Add();
+          Log(solve_warnings, LogLevel::kWarning, "Control period missed by {} ms, {}",
+              (deadline.total() - control_period_ms * 1e-3) * 1e3, DeadlineMissName(miss));
+        }
+        session.slo.Record(!missed);
+        if (worker.tick_recorder) {
+          TickRecord &record = worker.tick_recorder->Next();
+          record = TickRecord();
+          record.session = session.id;
+          record.arrival_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  mail.arrival.time_since_epoch())
+                                  .count();
+          record.config_version = session.solver.config_version;
+          record.x = px;
+          record.y = py;
+          record.psi = psi;
+          record.speed = v;
+          record.steering_angle = telemetry.steering_angle;
+          record.throttle = telemetry.throttle;
+          record.waypoints = static_cast<uint32_t>(std::min(ptsx.size(), kTickWaypoints));
+          std::copy(ptsx.begin(), ptsx.begin() + record.waypoints, record.ptsx);
+          std::copy(ptsy.begin(), ptsy.begin() + record.waypoints, record.ptsy);
+          record.latency = dt;
+          std::copy(state.data(), state.data() + state.size(), record.state);
+          float *const stage_seconds = record.stage_seconds;
+          stage_seconds[static_cast<size_t>(TickStage::kWait)] = seconds(started - mail.arrival);
+          stage_seconds[static_cast<size_t>(TickStage::kDecode)] = seconds(decoded - started);
+          stage_seconds[static_cast<size_t>(TickStage::kParse)] = seconds(parsed - decoded);
+          stage_seconds[static_cast<size_t>(TickStage::kFit)] = seconds(fitted - parsed);
+          stage_seconds[static_cast<size_t>(TickStage::kPredict)] = seconds(predicted - fitted);
+          stage_seconds[static_cast<size_t>(TickStage::kSolve)] = seconds(solved - predicted);
+          stage_seconds[static_cast<size_t>(TickStage::kModel)] = phases.model;
+          stage_seconds[static_cast<size_t>(TickStage::kDerivatives)] = phases.derivatives;
+          stage_seconds[static_cast<size_t>(TickStage::kLinearSolve)] = phases.linear_solve;
+          stage_seconds[static_cast<size_t>(TickStage::kSerialize)] =
+              seconds(serialized - serializing);
+          record.status = static_cast<int32_t>(result.status);
+          record.start = static_cast<int32_t>(result.statistics.start);
+          record.iterations = result.statistics.iterations;
+          record.restorations = result.statistics.restorations;
+          record.cost = result.cost;
+          record.steer_value = steer_value;
+          record.throttle_value = throttle_value;
+          record.missed = missed ? 1 + static_cast<uint32_t>(miss) : 0;
+          worker.tick_recorder->Commit();
+        }
+        const TickAllocations tick_allocations = EndTickAllocations();
+        // The pool of this thread into the sum of those of the solver threads
+        const CppADPool pool = CppADPoolOfThread();
+        metrics.cppad_inuse_bytes.Add(static_cast<double>(pool.inuse) -
+                                      static_cast<double>(worker.cppad_pool.inuse));
+        metrics.cppad_available_bytes.Add(static_cast<double>(pool.available) -
+                                          static_cast<double>(worker.cppad_pool.available));
+        worker.cppad_pool = pool;
+        metrics.allocations.Observe(static_cast<double>(tick_allocations.TotalCount()));
+        metrics.allocation_bytes.Observe(static_cast<double>(tick_allocations.TotalBytes()));
+        TickStage allocating;
+        if (session.ticks > kAllocationWarmTicks &&
+            AllocationFreeViolation(tick_allocations, allocation_free, allocating)) {
+          metrics.allocation_free_violations.Add();
+          Log(solve_warnings, LogLevel::kWarning, "Allocations in {}: {}, {} bytes",
+              TickStageName(allocating), tick_allocations.count(allocating),
+              tick_allocations.bytes_of(allocating));
+        }
+        const bool fit_hit =
+            prepared != nullptr ? prepared->fit_hit : reference_fit.hits() > fit_hits;
+        metrics.fit_hits.Add(fit_hit ? 1 : 0);
+        metrics.fit_refits.Add(prepared != nullptr ? prepared->fit_refit
+                                                   : reference_fit.refits() - fit_refits);
+        metrics.fit_misses.Add(prepared != nullptr ? prepared->fit_miss
+                                                   : reference_fit.misses() - fit_misses);
+        tick_caches.fitted = fitted_waypoints;
+        tick_caches.fit_hit = fit_hit;
+        tick_caches.fit_seconds = seconds(fitted - parsed);
+        tick_caches.start = result.statistics.start;
+        tick_caches.recall = recall || lap_cache;
+        tick_caches.table = shared_linearization_table != nullptr;
+        tick_caches.speculated = speculative_mpc != nullptr;
+        tick_caches.speculation_hit = speculative_mpc != nullptr && speculative_mpc->hit();
+        tick_caches.shared = shared_mpc != nullptr;
+        tick_caches.shared_hit = shared_mpc != nullptr && shared_mpc->hit();
+        tick_caches.solve_seconds = seconds(solved - predicted);
+        tick_caches.iterations = result.statistics.iterations;
+        tick_caches.prev_a = prev_a;
+        RecordTickCaches(tick_caches, metrics.caches);
+      }
+      MPC_TRACE_SPAN("wait", mail.arrival, started);
+      MPC_TRACE_SPAN("parse", decoded, parsed);
+      MPC_TRACE_SPAN("fit", parsed, fitted);
+      MPC_TRACE_SPAN("predict", fitted, predicted);
+      MPC_TRACE_SPAN("solve", predicted, solved);
+      MPC_TRACE_SPAN("serialize", serializing, serialized);
+      log_stages(session, replied);
+      count_solve(result);
+      count_backlog(session);
 
-  h.onConnection([&h](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
-    std::cout << "Connected!!!" << std::endl;
-  });
+      // The tick again without its caches, every baseline_period ticks
+      if (kInstrumentCounters && session.baseline && session.ticks % baseline_period == 0) {
+        const MPCBase &measured = speculative_mpc != nullptr ? speculative_mpc->inner()
+                                  : refining_mpc != nullptr  ? refining_mpc->inner()
+                                                             : *mpc;
+        session.baseline->Measure(measured, ptsx, ptsy, px, py, psi, state, coeffs, tick_caches,
+                                  Metrics().caches);
+      }
 
-  h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code,
-                         char *message, size_t length) {
-    ws.close();
-    std::cout << "Disconnected" << std::endl;
-  });
+      // Get the next solve ready while waiting for telemetry
+      mpc->Prepare();
+    };
 
-  int port = 4567;
-  if (h.listen(port)) {
-    std::cout << "Listening to port " << port << std::endl;
-  } else {
-    std::cerr << "Failed to listen to port" << std::endl;
-    return -1;
+    // The weights, the budget and the tolerances of config set on a solver
+    const auto configure = [&](SessionSolver &current, const RuntimeConfig &config) {
+      MPCBase &mpc = *current.mpc;
+      mpc.cost_schedule.Clear();
+      mpc.cost_schedule.AddPoint(
+          0, terminal ? LQRTerminalCost(config.weights, mpc.timestep()) : config.weights);
+      mpc.max_solve_time = config.max_solve_time;
+      if (config.tolerance > 0 || config.max_iterations > 0) {
+        current.core->SetTolerances(config.tolerance, config.max_iterations);
+      }
+      if (current.shared_mpc != nullptr) {
+        current.shared_mpc->SetProblem(shared_problem(config));
+      }
+      current.config_version = config.version;
+    };
+    // The runtime configuration config taken into the solver of session,
+    // between two of its ticks: the solver made anew for another horizon or
+    // backend, the old one kept if it can't be, then configured. The copies
+    // for a batch and for the baseline are made again from it.
+    const auto apply_config = [&](Session &session, const RuntimeConfig &config) {
+      SessionSolver &current = session.solver;
+      if (config.horizon != current.horizon || config.solver != current.backend) {
+        SessionSolver remade = make_solver(0, config);
+        if (remade.mpc) {
+          remade.mpc->prev_a = current.mpc->prev_a;
+          current = std::move(remade);
+          session.footprint.Reset();
+          Log(LogLevel::kInfo, "Config: session {} on {} with a horizon of {}", session.id,
+              SolverBackendName(config.solver), config.horizon);
+        } else {
+          Log(LogLevel::kWarning, "Config: session {} keeps {} with a horizon of {}",
+              session.id, SolverBackendName(current.backend), current.horizon);
+        }
+      }
+      configure(current, config);
+      session.batch.reset();
+      session.proximity.reset();
+      if (session.baseline) {
+        session.baseline->Reset();
+      }
+    };
+
+    // The event loop on a thread of its own, while this one, which makes the
+    // models of the worker, solves the telemetry of its sessions (see
+    // CppADThreads.h)
+    // The cpus of the worker's threads follow those of the workers before
+    const int cpu = pin_cpu >= 0 ? pin_cpu + static_cast<int>(k) : -1;
+    const int io_cpu = io_pin_cpu >= 0 ? io_pin_cpu + static_cast<int>(k) : -1;
+    std::thread io([&worker, &prepare_thread, k, io_cpu, realtime_priority, busy_poll,
+                    &busy_poll_policy] {
+      // Above the solver, for the arrivals to be stamped and the commands
+      // sent on time
+      prepare_thread("event loop", k, io_cpu, realtime_priority + 1);
+      if (!busy_poll) {
+        worker.hub.run();
+        worker.telemetry_posted.Close();
+        return;
+      }
+      // Served for as long as the server listens, like run; a poll that
+      // handled a frame or a reply resets the backoff
+      PollBackoff backoff(busy_poll_policy);
+      for (uint64_t events = worker.loop_events;;) {
+        worker.hub.poll();
+        if (worker.loop_events != events) {
+          events = worker.loop_events;
+          backoff.Reset();
+        } else {
+          backoff.Idle();
+        }
+      }
+    });
+    prepare_thread("solver", k, cpu, realtime_priority);
+    if (perf_counters && !OpenPerfCounters()) {
+      Log(LogLevel::kWarning,
+          "No hardware counters on the solver of worker {}, needs perf_event_paranoid at 2 or "
+          "below and a PMU",
+          k);
+    }
+    // The sessions of this worker as of the last pass over them, and of the
+    // one it last looked for frames to steal from
+    std::vector<std::shared_ptr<Session>> active;
+    std::vector<std::shared_ptr<Session>> stolen_from;
+    // With edf, the sessions of this worker whose frames were taken in a
+    // pass, to be solved in the order of their deadlines
+    std::vector<Session *> due;
+    // The solvers of the sessions closed on this worker, taped, warm and
+    // their workspaces allocated, for the next sessions to connect: up to
+    // pooled_solvers of them, the one warmed up at startup first. A
+    // simulator connecting gets one of these with the plan of its last
+    // session forgotten rather than a solver made and taped anew.
+    std::vector<SessionSolver> pool;
+    pool.reserve(std::max<size_t>(pooled_solvers, 1));
+    if (spare_solver.mpc) {
+      pool.push_back(std::move(spare_solver));
+    }
+    const Mailbox::Clock::duration max_age = std::chrono::milliseconds(max_age_ms);
+    const Mailbox::Clock::duration budget = std::chrono::milliseconds(control_period_ms);
+    // The frame of a session this thread has claimed taken into its frame,
+    // false if it has none or it is too old to solve
+    const auto take = [&](Session &session) {
+      if (!session.frames.Take(session.frame)) {
+        return false;
+      }
+      // A frame that waited out a slow solve or a stall would only be solved
+      // for a car that has moved on; the newer one replaces it
+      const Mailbox::Clock::duration age = Mailbox::Clock::now() - session.frame.arrival;
+      if (max_age_ms > 0 && age > max_age) {
+        MPC_COUNT(Metrics().frames_expired.Add());
+        Log(session.solve_warnings, LogLevel::kWarning, "Mailbox: telemetry {} dropped, {} s old",
+            session.frame.sequence, seconds(age));
+        return false;
+      }
+      return true;
+    };
+    // With edf, or over the CPU quota, the tick of session solved on its RTI
+    // instead of its solver, which carries on from the throttle of the RTI
+    // at the next. False if there is no RTI to fall back on: the solver is
+    // one already, under the wrappers that need Ipopt, or the RTI isn't
+    // compiled for the horizon.
+    const bool demotable =
+        !adaptive && !regimes && !routes && !dynamic && !multistart && !speculative;
+    const auto demote = [&](Session &session, const RuntimeConfig &config) {
+      if (!demotable || session.solver.backend == SolverBackend::kRTI) {
+        return false;
+      }
+      SessionSolver &fast = session.fast_solver;
+      if (fast.horizon != config.horizon) {
+        RuntimeConfig rti = config;
+        rti.solver = SolverBackend::kRTI;
+        fast = make_solver(0, rti);
+        fast.horizon = config.horizon;
+      }
+      if (!fast.mpc) {
+        return false;
+      }
+      if (fast.config_version != config.version) {
+        configure(fast, config);
+      }
+      fast.mpc->prev_a = session.solver.mpc->prev_a;
+      std::swap(session.solver, fast);
+      solve(session, session.frame);
+      std::swap(session.solver, fast);
+      session.solver.mpc->prev_a = fast.mpc->prev_a;
+      return true;
+    };
+    // The frame taken of a session this thread has claimed solved, on the
+    // solver of the session's worker (stolen) or on this one's. A stolen
+    // tick never makes or remakes the solver: one that comes just as the
+    // configuration changes follows the last, and the session's worker
+    // applies the new one at its next tick. With edf, a tick of this
+    // worker's that its solver is expected to finish past the deadline,
+    // the control period from the arrival of its telemetry, is demoted.
+    // The solver of a session of this worker, from the pool or made, with
+    // config taken into it; false if there is none
+    const auto equip = [&](Session &session, const RuntimeConfig &config) {
+      if (!session.solver.mpc) {
+        // A solver of the pool, made again by apply_config below if the
+        // configuration has changed its horizon or backend since
+        if (!pool.empty()) {
+          session.solver = std::move(pool.back());
+          pool.pop_back();
+          MPC_COUNT(Metrics().solvers_reused.Add());
+        } else {
+          session.solver = make_solver(0, config);
+          MPC_COUNT(Metrics().solvers_made.Add());
+        }
+      }
+      if (!session.solver.mpc) {
+        return false;
+      }
+      if (session.solver.config_version != config.version) {
+        apply_config(session, config);
+      }
+      return true;
+    };
+    // With snapshot, the first tick of a session on one of the last process
+    // if there is one left: its caches, its last start, which the frame of
+    // the car makes a fair start for the same car, and its last throttle
+    const auto restore = [&](Session &session) {
+      session.snapshot_checked = true;
+      SessionSnapshot restored;
+      if (!snapshot_restore.Take(restored)) {
+        return;
+      }
+      MPCBase &core = *session.solver.core;
+      const bool caches = core.RestoreCaches(restored.caches);
+      const bool start = core.RestoreStart(restored.start);
+      session.solver.mpc->prev_a = restored.prev_a;
+      session.settling = true;
+      session.restored = Mailbox::Clock::now();
+      session.restored_seconds = restored.solve_seconds;
+      Log(LogLevel::kInfo,
+          "Snapshot: session {} from session {} of the last process, after {} ticks, caches {}, "
+          "start {}",
+          session.id, restored.session, restored.ticks, caches ? "restored" : "left",
+          start ? "restored" : "left");
+    };
+    // The frame of session solved with config, on its solver, or with edf
+    // on its RTI when the solver wouldn't make the deadline
+    const auto run = [&](Session &session, bool stolen, const RuntimeConfig &config) {
+      if (!edf || stolen) {
+        solve(session, session.frame);
+        return;
+      }
+      const Mailbox::Clock::time_point started = Mailbox::Clock::now();
+      const double slack = seconds(session.frame.arrival + budget - started);
+      MPC_COUNT(Metrics().edf_slack.Observe(slack));
+      if (slack <= 0) {
+        MPC_COUNT(Metrics().edf_late.Add());
+      }
+      if (slack < session.tick_seconds && demote(session, config)) {
+        MPC_COUNT(Metrics().edf_demoted.Add());
+        return;
+      }
+      solve(session, session.frame);
+      // Over the last few ticks, for a slow one to count without a single
+      // one deciding
+      const double took = seconds(Mailbox::Clock::now() - started);
+      session.tick_seconds =
+          session.tick_seconds > 0 ? 0.75 * session.tick_seconds + 0.25 * took : took;
+    };
+    // The CPU quota of config for every session
+    const auto quota_policy = [](const RuntimeConfig &config) {
+      CpuQuotaPolicy policy;
+      policy.cores = config.cpu_quota;
+      return policy;
+    };
+    const auto tick = [&](Session &session, bool stolen) {
+      // The configuration as it is at this tick, for the whole of it
+      const RuntimeConfig &config = runtime_config.Current();
+      if (stolen ? !session.solver.mpc : !equip(session, config)) {
+        return;
+      }
+      if (!stolen && !session.snapshot_checked) {
+        restore(session);
+      }
+      // The thread CPU time of the tick, on whichever worker solves it, is
+      // the session's; over its quota its ticks go to its RTI like those edf
+      // demotes, until its use falls back under it, so that it doesn't take
+      // the solver thread from the other sessions of the worker; likewise
+      // while admission has it shed
+      const double cpu_started = ThreadCpuSeconds();
+      const bool was_over = session.cpu.over();
+      if (!stolen && (was_over || session.shed) && demote(session, config)) {
+        if (was_over) {
+          session.cpu.Degraded();
+          MPC_COUNT(Metrics().quota_degraded.Add());
+        } else {
+          MPC_COUNT(Metrics().shed_degraded.Add());
+        }
+      } else {
+        run(session, stolen, config);
+      }
+      const bool over = session.cpu.Charge(ThreadCpuSeconds() - cpu_started,
+                                           Mailbox::Clock::now(), quota_policy(config));
+      if (over != was_over) {
+        Log(LogLevel::kWarning, "CPU quota: session {} {} at {} cores of {}", session.id,
+            over ? "over, degraded" : "back under", session.cpu.cores(), config.cpu_quota);
+      }
+    };
+    // A chunk of the batches of a client of the problem service solved, on
+    // copies of the session's solver, each problem cold with its own weights
+    // and last throttle, and their plans posted to the event loop in one
+    // message. The rest of the batch waits for the next pass, after the
+    // ticks of the other sessions of the worker, for which the doorbell is
+    // rung again.
+    const auto serve = [&](Session &session) {
+      ProblemQueue &queue = *session.problems;
+      if (session.service_next >= session.service_batch.size()) {
+        session.service_batch.clear();
+        session.service_next = 0;
+        std::string batch;
+        // Counted on the event loop, as it is read here
+        if (!queue.Take(batch) ||
+            !ReadProblems(MessageView(batch.data(), batch.size()), session.service_batch)) {
+          return;
+        }
+      }
+      const RuntimeConfig &config = runtime_config.Current();
+      if (!equip(session, config)) {
+        Log(LogLevel::kWarning, "Problems: no solver, a batch of {} dropped",
+            session.service_batch.size());
+        session.service_batch.clear();
+        return;
+      }
+      if (!session.batch || session.batch->size() != problem_chunk) {
+        session.batch = MakeBatchMPC(*session.solver.mpc, problem_chunk, 1);
+        session.batch_states.resize(problem_chunk);
+        session.batch_coeffs.resize(problem_chunk);
+        session.batch_results.resize(problem_chunk);
+      }
+      const size_t n =
+          std::min(problem_chunk, session.service_batch.size() - session.service_next);
+      const ServiceProblem *problems = &session.service_batch[session.service_next];
+      // The solver of problem k of the chunk, as the problem asks
+      const auto pose = [&](size_t k) -> MPCBase & {
+        MPCBase &mpc = session.batch ? session.batch->vehicle(k) : *session.solver.mpc;
+        mpc.Reset();
+        mpc.prev_a = problems[k].prev_a;
+        mpc.cost_schedule.Clear();
+        mpc.cost_schedule.AddPoint(0, problems[k].weights);
+        return mpc;
+      };
+      std::vector<double> &took = session.service_seconds;
+      took.assign(n, 0);
+      if (session.batch && n == problem_chunk) {
+        for (size_t k = 0; k < n; k++) {
+          pose(k);
+          session.batch_states[k] = problems[k].state;
+          session.batch_coeffs[k] = problems[k].coeffs;
+        }
+        const Mailbox::Clock::time_point started = Mailbox::Clock::now();
+        session.batch->SolveBatch(session.batch_states.data(), session.batch_coeffs.data(),
+                                  session.batch_results.data());
+        // Solved together, the chunk shares its time out
+        took.assign(n, seconds(Mailbox::Clock::now() - started) / n);
+      } else {
+        // The tail of a batch, or a solver without copies, one at a time
+        for (size_t k = 0; k < n; k++) {
+          MPCBase &mpc = pose(k);
+          const Mailbox::Clock::time_point started = Mailbox::Clock::now();
+          session.batch_results[k] = mpc.Solve(problems[k].state, problems[k].coeffs);
+          took[k] = seconds(Mailbox::Clock::now() - started);
+        }
+      }
+      std::string plans;
+      for (size_t k = 0; k < n; k++) {
+        AppendResult(problems[k].id, session.batch_results[k], took[k], plans);
+        count_solve(session.batch_results[k]);
+      }
+      queue.Reply(std::move(plans));
+      session.home->reply_ready->send();
+      MPC_COUNT(Metrics().service_problems.Add(n));
+      session.service_next += n;
+      if (session.service_next < session.service_batch.size() || queue.pending()) {
+        worker.telemetry_posted.Ring();
+      }
+    };
+    // With steal, once this thread has nothing of its own to solve: a frame
+    // of a portable session of a busy worker, the workers after this one
+    // first. True if it solved one. The worker of the session is rung if the
+    // session closed or got another frame meanwhile, as it may have passed
+    // it over while claimed here.
+    const auto steal_one = [&]() {
+      for (size_t j = 1; j < served.size(); j++) {
+        Worker &victim = *served[(k + j) % served.size()];
+        // An idle worker takes its frames itself, on the cores its tapes
+        // are warm on; with numa, the memory of a session of another node
+        // stays out of reach
+        if (victim.idle.load() || victim.node != worker.node) {
+          continue;
+        }
+        {
+          std::lock_guard<std::mutex> lock(victim.sessions_mutex);
+          stolen_from = victim.sessions;
+        }
+        for (const std::shared_ptr<Session> &session : stolen_from) {
+          if (!session->frames.pending() ||
+              session->claimed.exchange(true, std::memory_order_acquire)) {
+            continue;
+          }
+          const bool portable = !session->closed.load() && session->solver.portable;
+          if (portable && take(*session)) {
+            MPC_COUNT(Metrics().solves_stolen.Add());
+            tick(*session, true);
+          }
+          session->claimed.store(false, std::memory_order_release);
+          if (session->closed.load() || session->frames.pending()) {
+            victim.telemetry_posted.Ring();
+          }
+          if (portable) {
+            return true;
+          }
+        }
+      }
+      return false;
+    };
+    // With steal, before a tick of session: ring a worker that ran dry if
+    // portable sessions of this one have frames waiting meanwhile
+    const auto wake_thief = [&](const Session &solving) {
+      bool waiting = false;
+      for (const std::shared_ptr<Session> &session : active) {
+        waiting |= session.get() != &solving && session->solver.portable &&
+                   session->frames.pending();
+      }
+      if (!waiting) {
+        return;
+      }
+      for (size_t j = 1; j < served.size(); j++) {
+        Worker &thief = *served[(k + j) % served.size()];
+        if (thief.idle.load() && thief.node == worker.node) {
+          thief.telemetry_posted.Ring();
+          return;
+        }
+      }
+    };
+    // With shed, the sessions of this worker shed to their RTIs, the lowest
+    // priority first, while they use more than admission allows, and given
+    // their solvers back once there is room again (see Shed), between passes
+    // over them. Only this thread's ticks read shed, not those stolen.
+    const auto shed_sessions = [&]() {
+      worker.shed_checked = std::chrono::steady_clock::now();
+      worker.shedding.clear();
+      for (const std::shared_ptr<Session> &session : active) {
+        SheddingEntry entry;
+        entry.priority = session->priority;
+        entry.cores = session->closed.load() ? 0 : session->cpu.cores();
+        entry.shed = session->shed;
+        entry.full_cores = session->shed_cores;
+        worker.shedding.push_back(entry);
+      }
+      if (Shed(worker.shedding, admission_policy) == 0) {
+        return;
+      }
+      for (size_t k = 0; k < active.size(); k++) {
+        Session &session = *active[k];
+        const SheddingEntry &entry = worker.shedding[k];
+        if (entry.shed != session.shed) {
+          Log(LogLevel::kWarning, "Admission: session {} of priority {} {} at {} cores",
+              session.id, session.priority, entry.shed ? "shed" : "given its solver back",
+              entry.cores);
+          Metrics().sessions_shed.Add(entry.shed ? 1 : -1);
+        }
+        session.shed = entry.shed;
+        session.shed_cores = entry.full_cores;
+      }
+    };
+    // With snapshot, that of the sessions of this worker that have ticked,
+    // for the writer to put in their file: between passes over them, each
+    // claimed while it is copied. Without any, the last file stays.
+    const auto take_snapshot = [&]() {
+      worker.snapshot_taken = std::chrono::steady_clock::now();
+      worker.snapshots.clear();
+      for (const std::shared_ptr<Session> &session : active) {
+        if (session->claimed.exchange(true, std::memory_order_acquire)) {
+          continue;
+        }
+        if (!session->closed.load() && session->solver.core != nullptr && session->ticks > 0 &&
+            !session->problems) {
+          worker.snapshots.emplace_back();
+          SessionSnapshot &snapshot = worker.snapshots.back();
+          snapshot.session = session->id;
+          snapshot.ticks = session->ticks;
+          snapshot.prev_a = session->solver.mpc->prev_a;
+          snapshot.solve_seconds = session->solve_seconds;
+          session->solver.core->SaveStart(snapshot.start);
+          session->solver.core->SaveCaches(snapshot.caches);
+        }
+        session->claimed.store(false, std::memory_order_release);
+      }
+      if (!worker.snapshots.empty() && !worker.snapshot_writer->Write(worker.snapshots)) {
+        Log(LogLevel::kWarning, "Snapshot: the last one of worker {} still being written", k);
+      }
+    };
+    // A session closed on this worker released: its models go on this
+    // thread, and it stays claimed for good
+    const auto release = [&](const std::shared_ptr<Session> &session) {
+      session->batch.reset();
+      session->proximity.reset();
+      session->planner.reset();
+      session->service_batch.clear();
+      session->fast_solver = SessionSolver();
+      if (session->solver.mpc && pool.size() < pooled_solvers) {
+        // Only the state of the session goes: its plan, last throttle and
+        // the tables of its track
+        SessionSolver &pooled = session->solver;
+        pooled.mpc->Reset();
+        pooled.mpc->prev_a = 0;
+        if (pooled.reference_mpc != nullptr) {
+          pooled.reference_mpc->reference_table.reset();
+        }
+        if (pooled.frenet_mpc != nullptr) {
+          pooled.frenet_mpc->frenet_reference.reset();
+        }
+        pool.push_back(std::move(pooled));
+      }
+      session->solver = SessionSolver();
+      if (session->shed) {
+        Metrics().sessions_shed.Add(-1);
+      }
+      std::lock_guard<std::mutex> lock(worker.sessions_mutex);
+      worker.sessions.erase(std::remove(worker.sessions.begin(), worker.sessions.end(), session),
+                            worker.sessions.end());
+      Metrics().sessions.Add(-1);
+    };
+    // With refine, the plans of the sessions refined in turn until the next
+    // ring, which stops the one under way; true once there was one
+    const auto refine_plans = [&](uint64_t &rung) {
+      if (worker.telemetry_posted.Disarm(rung)) {
+        return true;
+      }
+      {
+        std::lock_guard<std::mutex> lock(worker.sessions_mutex);
+        active = worker.sessions;
+      }
+      for (const std::shared_ptr<Session> &session : active) {
+        // Closed ones are left for the loop to release
+        if (session->closed.load() || session->claimed.exchange(true, std::memory_order_acquire)) {
+          continue;
+        }
+        // Not for a session over its CPU quota, whose refinements are its
+        // CPU time as well
+        RefiningMPC *const refining_mpc = session->solver.refining_mpc;
+        const double cpu_started = ThreadCpuSeconds();
+        if (refining_mpc != nullptr && !session->cpu.over() &&
+            refining_mpc->Refine(worker.telemetry_posted.alarm())) {
+          session->cpu.Charge(ThreadCpuSeconds() - cpu_started, Mailbox::Clock::now(),
+                              quota_policy(runtime_config.Current()));
+          Metrics().refinements.Add();
+          Metrics().refinement_sweeps.Add(refining_mpc->sweeps());
+          Metrics().refinements_preempted.Add(refining_mpc->interrupted() ? 1 : 0);
+        }
+        session->claimed.store(false, std::memory_order_release);
+        if (worker.telemetry_posted.Poll(rung)) {
+          return true;
+        }
+      }
+      return false;
+    };
+    PollBackoff backoff(busy_poll_policy);
+    for (uint64_t rung = 0;;) {
+      worker.idle.store(true);
+      // Only a thread that found nothing rung while it solved, or refined,
+      // waits, and only its wait is the latency of a wakeup
+      if (!worker.telemetry_posted.Poll(rung) && !(refine && refine_plans(rung))) {
+        if (!(busy_poll ? worker.telemetry_posted.Spin(rung, backoff)
+                        : worker.telemetry_posted.Wait(rung))) {
+          break;
+        }
+        MPC_COUNT(Metrics().wakeup.Observe(std::chrono::duration<double>(
+            Doorbell::Clock::now() - worker.telemetry_posted.rung_at()).count()));
+      }
+      worker.idle.store(false);
+      do {
+        {
+          std::lock_guard<std::mutex> lock(worker.sessions_mutex);
+          active = worker.sessions;
+        }
+        // Without edf, the frame of each session solved as it is taken, in
+        // the order the sessions connected
+        due.clear();
+        for (const std::shared_ptr<Session> &session : active) {
+          // Solved by another worker for now, which rings this one when done
+          if (session->claimed.exchange(true, std::memory_order_acquire)) {
+            continue;
+          }
+          if (session->closed.load()) {
+            release(session);
+            continue;
+          }
+          if (session->problems) {
+            serve(*session);
+            session->claimed.store(false, std::memory_order_release);
+            continue;
+          }
+          if (!take(*session)) {
+            session->claimed.store(false, std::memory_order_release);
+            continue;
+          }
+          if (edf) {
+            due.push_back(session.get());
+            continue;
+          }
+          if (steal) {
+            wake_thief(*session);
+          }
+          tick(*session, false);
+          session->claimed.store(false, std::memory_order_release);
+        }
+        // With edf, every frame taken first, then solved by its deadline,
+        // the earliest first: a control period from its arrival, so the
+        // one that waited longest first
+        std::sort(due.begin(), due.end(), [](const Session *a, const Session *b) {
+          return a->frame.arrival < b->frame.arrival;
+        });
+        for (Session *session : due) {
+          if (steal) {
+            wake_thief(*session);
+          }
+          tick(*session, false);
+          session->claimed.store(false, std::memory_order_release);
+        }
+      } while (steal && steal_one());
+      if (admission && admission_policy.mode == AdmissionMode::kShed &&
+          std::chrono::steady_clock::now() - worker.shed_checked >= admission_policy.interval) {
+        shed_sessions();
+      }
+      if (worker.snapshot_writer &&
+          std::chrono::steady_clock::now() - worker.snapshot_taken >= kSnapshotPeriod) {
+        take_snapshot();
+      }
+    }
+    io.join();
+  };
+
+  // The simulators connected, each with a session of its own on the worker
+  // that accepted it
+  for (size_t k = 0; k < workers; k++) {
+    // Its event loop and buffers on its node, first touched from there
+    place_thread(k);
+    served.emplace_back(new Worker());
+    served.back()->node = worker_node(k);
+    if (numa && pin_cpu >= 0 && served.back()->node < 0) {
+      Log(LogLevel::kWarning, "NUMA: cpu {} of worker {} on no node", pin_cpu + k, k);
+    }
+    if (!blackbox_directory.empty()) {
+      served.back()->tick_recorder.reset(
+          new TickRecorder(blackbox_directory, k, blackbox_ticks, blackbox_burst, kBurstWindow));
+      if (!served.back()->tick_recorder->ok()) {
+        std::cerr << "Could not dump the black box into " << blackbox_directory << std::endl;
+        return -1;
+      }
+    }
+    if (observe_port > 0) {
+      served.back()->observer_ring.reset(new ObserverRing(kObserverTicks));
+    }
+    if (!snapshot_directory.empty()) {
+      served.back()->snapshot_writer.reset(
+          new SnapshotWriter(SnapshotPath(snapshot_directory, k), host, snapshot_problem));
+    }
+    if (!start_listening(served.back().get())) {
+      return -1;
+    }
   }
-  h.run();
-}
\ No newline at end of file
+  if (!blackbox_directory.empty()) {
+    TickRecorder::InstallCrashHandlers();
+    Log(LogLevel::kInfo, "Keeping the last {} ticks of every solver for {}", blackbox_ticks,
+        blackbox_directory);
+  }
+  std::unique_ptr<ObserverFeed> observer_feed;
+  if (observe_port > 0) {
+    std::vector<const ObserverRing *> rings;
+    for (const std::unique_ptr<Worker> &worker : served) {
+      rings.push_back(worker->observer_ring.get());
+    }
+    observer_feed.reset(new ObserverFeed(rings));
+    if (!observer_feed->Start(static_cast<uint16_t>(observe_port))) {
+      std::cerr << "Could not listen to the observers on port " << observe_port << std::endl;
+      return -1;
+    }
+    Log(LogLevel::kInfo, "Streaming the ticks to the observers on port {}", observe_port);
+  }
+  Log(LogLevel::kInfo, "Listening to port {} on {} workers, the kernels of the ticks on {}", port,
+      workers, SimdKernelTarget());
+  // Every worker but the first on a thread of its own, with solvers made
+  // there; the first on this thread, with the one made above
+  std::vector<std::thread> threads;
+  for (size_t k = 1; k < workers; k++) {
+    threads.push_back(std::thread([&run, &make_solver, &served, &runtime_config, &place_thread,
+                                   k, warm_up_rounds] {
+      CppADThread cppad_thread;
+      // The solver made on the node of the worker, before run pins the thread
+      place_thread(k);
+      run(*served[k], k, make_solver(warm_up_rounds, runtime_config.Current()));
+    }));
+  }
+  run(*served[0], 0, std::move(spare_solver));
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+#if MPC_INSTRUMENTATION >= MPC_INSTRUMENTATION_FULL
+  StopTrace();
+#endif
+}
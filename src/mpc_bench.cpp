@@ -0,0 +1,1197 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "BenchResults.h"
+#include "CppADThreads.h"
+#include "ExplicitMPC.h"
+#include "FlightRecorder.h"
+#include "KinematicModel.h"
+#include "Log.h"
+#include "MPC.h"
+#include "MessagePack.h"
+#include "Polynomial.h"
+#include "ReferenceFit.h"
+#include "SharedChannel.h"
+#include "SimdKernels.h"
+#include "SocketIOFrame.h"
+#include "SolverBackend.h"
+#include "Telemetry.h"
+#include "TrackSpline.h"
+#include "VehicleModel.h"
+#include "WarmUp.h"
+
+// Microbenchmarks of MPCBase::Solve, for the effect of a change to a solver
+// to be measured the same way every time.
+//
+//   ./mpc_bench [solvers=<a,b,...>] [horizons=<n,m,...>] [models=<a,b,...>]
+//               [filter=<text>] [min_time=<ms>] [ticks=<n>] [track=<csv>]
+//               [linsolvers=<a,b,...>] [linsolverthreads=<n,m,...>]
+//               [json=<path>] [csv=<path>] [<segment>...]
+//   ./mpc_bench pareto [budgets=<ms,...>] [quality=<ratio>] [solvers=...] ...
+//   ./mpc_bench agree [random=<n>] [seed=<n>] [threads=<n>] [table=<path>]
+//               [delta_tol=<rad>] [a_tol=<a>] [baseline=<json>] [solvers=...] ...
+//   ./mpc_bench compare=<baseline.json>,<candidate.json> [threshold=<percent>]
+//
+// Every benchmark is a backend, a horizon, a start and a set of inputs,
+// named e.g. sqp/15/warm/trace:
+//
+//   - The backends are those of SolverBackend.h, all by default, and the
+//     horizons 5, 8, 10, 11, 15, 25, 40 and 60; those a backend isn't
+//     compiled for are listed at the end rather than run.
+//   - cold solves every input from Reset, with no plan to start from; warm
+//     solves the trace in order, each tick from the plan of the last after
+//     a Prepare, as the ticks of the server do, and each scenario from a
+//     plan of its own, solved once untimed before it.
+//   - scenarios are the synthetic states of WarmUp; trace the states a
+//     closed loop handed to Solve: those of the telemetry in the flight
+//     recorder segments given (see FlightRecorder.h), predicted over 100 ms,
+//     or else of ticks ticks (300) of Ipopt at 15 stages driving the model
+//     around track (lake_track_waypoints.csv) at 10 m/s, recorded once and
+//     shared by every benchmark.
+//
+// Each solver is made and warmed up once (see WarmUp) before it is timed,
+// then solves its inputs over and over until min_time (200 ms) has passed,
+// one pass at least. A benchmark prints the solves timed, the mean, median,
+// 90th and 99th percentiles and the maximum of their times in microseconds,
+// the mean iterations per solve (0 for the RTI, which takes a single step)
+// and the solves that failed. filter runs only the benchmarks whose names
+// contain it. A table of the footprint of every solver made follows (see
+// SolverFootprint.h): its tape, the non-zeros of its derivatives, KKT
+// matrix and factor, and its bytes, which go into the counters of its
+// benchmarks too; for the tape of Ipopt, also its constraints linear in the
+// variables, whose non-zeros of the Jacobian are evaluated once a solve,
+// and the sweeps an evaluation of the Jacobian takes for the other rows
+// out of those it would take for every row.
+//
+// models are the vehicle models the stages follow (see VehicleModel.h),
+// kinematic by default; a benchmark of another has its name after the
+// horizon, e.g. ipopt/15/dynamic/warm/trace, and is compiled for 15 stages
+// of the Ipopt backends only. A table of the arithmetic operations and the
+// transcendental functions of one stage of each model in each integrator
+// follows the footprints, what its solves cost more comes from.
+//
+// linsolvers are linear solvers of the KKT systems of Ipopt (see
+// IpoptOptions::linear_solver), each run with every count of
+// linsolverthreads (1) OpenMP threads on top of Ipopt's default, e.g.
+// linsolvers=mumps,ma97 linsolverthreads=1,4 horizons=15,25,40,60 for how
+// the multithreaded factorizations scale with the horizon; a benchmark of
+// one has it after the horizon, e.g. ipopt/40/ma97x4/warm/trace, and the
+// other backends, which have no KKT systems of Ipopt, are run with the
+// default only. A linear solver Ipopt can't load fails every solve.
+//
+// pareto trades the time of the solves against their quality instead: each
+// backend and horizon solves the trace warm, as the server does, with every
+// max_solve_time of budgets (0.25, 0.5, 1, 2, 5, 10, 20 and 50 ms), and the
+// cost of each plan is divided by that of Ipopt converged on the same tick
+// with a budget of 1 s, every tick of both from the last actuation of the
+// reference, so that all solve the same problems. A benchmark, named e.g.
+// sqp/15/budget/2ms, prints the mean and 99th percentile of its times, the
+// mean, 90th percentile and maximum of its relative costs, and the solves
+// stopped at their deadline and those that failed; then the Pareto front of
+// the mean time and the mean relative cost over all of them, the points no
+// faster one beats, and the fastest whose mean relative cost is within
+// quality (1.01). The backends take no iteration limit from outside, so the
+// budget is the only knob swept; a plan cut short by it may still violate
+// the model, which the cost alone doesn't show.
+//
+// agree is the differential test of the backends against Ipopt converged
+// as in pareto, before a faster one is trusted with the cars: on a corpus
+// of the trace, the scenarios and random (2000) draws about the ticks of
+// the trace, their speeds, errors, curvatures and last throttles moved
+// from a generator of seed (1), so the corpus is the same from run to run.
+// The references of every horizon are solved first, then each backend and
+// horizon, a benchmark named e.g. rti/15/agree, solves the whole corpus,
+// the trace warm in order and the rest cold, the backends spread over
+// threads threads (every core) with a solver each. A benchmark prints the
+// mean and 99th percentile of its times, which the other solves on the
+// cores meanwhile weigh on, so they are compared with runs of as many
+// threads only; the 99th percentiles and maxima of the differences of its
+// first steering and throttle from those of the reference; the mean and
+// 99th percentile of the gap of its cost to the reference's, relative; and
+// the cases it disagreed on, off by more than delta_tol (0.01 rad) or a_tol
+// (0.05) or failed, and those that failed. table adds the explicit MPC of
+// the file (see ExplicitMPC.h) in front of Ipopt, as table/<horizon>/agree.
+// With baseline, the results of an earlier agree, the changes of the times
+// are printed as by compare, then those of the agreement, and the run exits
+// with 1 if a benchmark got significantly slower by more than threshold,
+// disagreed on more than a hundredth of the corpus more, or had a 99th
+// percentile of its cost gap up by more than threshold.
+//
+// The instruction sets the run is on head the output, those of the kernels
+// of the points (see SimdKernels.h) and of Eigen, so that the results of a
+// cross built AArch64 run on the device (see cmake/aarch64-linux-gnu.cmake)
+// say they are of NEON.
+//
+// json and csv write the results to a file as well (see BenchResults.h),
+// from mpc_replay too: the JSON of one revision is the baseline of the
+// next. compare reads two of them, of either tool, and prints the change of
+// the mean time and the throughput of every benchmark of both, with the 95%
+// confidence interval of the change of the mean, and whether it is
+// significant; it exits with 1 if a benchmark got significantly slower by
+// more than threshold (5%), for a check in a script.
+
+namespace {
+
+const size_t kHorizons[] = {5, 8, 10, 11, 15, 25, 40, 60};
+// Control period and latency of main.cpp, the timestep of the trace
+const double kTick = 0.1;
+// Waypoints the simulator sends, from the one behind the car
+const size_t kTelemetryWaypoints = 6;
+// The budgets of pareto, in seconds, and that of its converged reference
+const double kBudgets[] = {0.25e-3, 0.5e-3, 1e-3, 2e-3, 5e-3, 10e-3, 20e-3, 50e-3};
+const double kReferenceTime = 1;
+
+struct Input {
+  MPCState state;
+  MPCCoeffs coeffs;
+};
+
+std::vector<std::string> Split(const std::string &list) {
+  std::vector<std::string> items;
+  std::istringstream in(list);
+  std::string item;
+  while (std::getline(in, item, ',')) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+// The inputs of the telemetry frames of the segments at paths, false if one
+// can't be read
+bool ReadTrace(const std::vector<std::string> &paths, std::vector<Input> &inputs) {
+  ReferenceFitCache reference_fit;
+  Telemetry telemetry;
+  for (const std::string &path : paths) {
+    std::unique_ptr<FlightReader> reader = FlightReader::Open(path);
+    if (!reader) {
+      std::cerr << "Could not read the flight records of " << path << std::endl;
+      return false;
+    }
+    FlightRecordHeader header;
+    MessageView payload;
+    while (reader->Next(header, payload)) {
+      if (header.type != static_cast<uint16_t>(FlightRecordType::kTelemetry)) {
+        continue;
+      }
+      bool parsed = false;
+      switch (static_cast<WireFormat>(header.format)) {
+        case WireFormat::kMessagePack:
+          parsed = UnpackTelemetry(payload, telemetry);
+          break;
+        case WireFormat::kSharedMemory:
+          parsed = ReadSharedTelemetry(payload, telemetry);
+          break;
+        default: {
+          SocketIOFrame frame;
+          // The batches of many cars are left out
+          parsed = DecodeFrame(payload, frame) && frame.event.equals("telemetry") &&
+                   ParseTelemetry(frame.data, telemetry);
+        }
+      }
+      if (!parsed) {
+        continue;
+      }
+      Input input;
+      input.coeffs = reference_fit.Fit(telemetry.ptsx, telemetry.ptsy, telemetry.x, telemetry.y,
+                                       telemetry.psi);
+      input.state = PredictState(telemetry.speed, telemetry.steering_angle, telemetry.throttle,
+                                 polyeval(input.coeffs, 0), -atan(input.coeffs[1]), kTick);
+      inputs.push_back(input);
+    }
+  }
+  return true;
+}
+
+// The inputs of ticks ticks of Ipopt driving the model around the waypoints
+// xs, ys from the first, the latency a whole tick
+void DriveTrace(const std::vector<double> &xs, const std::vector<double> &ys, size_t ticks,
+                std::vector<Input> &inputs) {
+  MPCProblem problem;
+  std::unique_ptr<MPCBase> mpc = MakeSolver(SolverBackend::kIpopt, problem);
+  ReferenceFitCache reference_fit;
+  double s[6] = {xs[0], ys[0], std::atan2(ys[1] - ys[0], xs[1] - xs[0]), 10, 0, 0};
+  double delta = 0;
+  double a = 0;
+  Telemetry::Waypoints ptsx;
+  Telemetry::Waypoints ptsy;
+  ptsx.resize(kTelemetryWaypoints);
+  ptsy.resize(kTelemetryWaypoints);
+  for (size_t k = 0; k < ticks; k++) {
+    size_t closest = 0;
+    double best = INFINITY;
+    for (size_t i = 0; i < xs.size(); i++) {
+      const double d = (xs[i] - s[0]) * (xs[i] - s[0]) + (ys[i] - s[1]) * (ys[i] - s[1]);
+      if (d < best) {
+        best = d;
+        closest = i;
+      }
+    }
+    for (size_t j = 0; j < kTelemetryWaypoints; j++) {
+      const size_t i = (closest + xs.size() - 1 + j) % xs.size();
+      ptsx[j] = xs[i];
+      ptsy[j] = ys[i];
+    }
+    Input input;
+    input.coeffs = reference_fit.Fit(ptsx, ptsy, s[0], s[1], s[2]);
+    input.state = PredictState(s[3], delta, a, polyeval(input.coeffs, 0),
+                               -atan(input.coeffs[1]), kTick);
+    inputs.push_back(input);
+
+    mpc->prev_a = a;
+    const MPCSolution result = mpc->Solve(input.state, input.coeffs);
+    mpc->Prepare();
+    // The last actuations act until the next measurement, the new ones
+    // from then on
+    IntegrateModel<Integrator::kRK4>(s, delta, a, kTick);
+    delta = result.delta[0];
+    a = result.a[0];
+  }
+}
+
+// The footprint of a solver in the counters of result, the bytes in KiB
+void AddFootprint(const SolverFootprint &footprint, BenchResult &result) {
+  result.counters["tape_operations"] = static_cast<double>(footprint.tape_operations);
+  result.counters["tape_variables"] = static_cast<double>(footprint.tape_variables);
+  result.counters["tape_kib"] = footprint.tape_bytes / 1024.0;
+  result.counters["jacobian_nonzeros"] = static_cast<double>(footprint.jacobian_nonzeros);
+  result.counters["hessian_nonzeros"] = static_cast<double>(footprint.hessian_nonzeros);
+  result.counters["kkt_nonzeros"] = static_cast<double>(footprint.kkt_nonzeros);
+  result.counters["factor_nonzeros"] = static_cast<double>(footprint.factor_nonzeros);
+  result.counters["linear_constraints"] = static_cast<double>(footprint.linear_constraints);
+  result.counters["constant_jacobian_nonzeros"] =
+      static_cast<double>(footprint.constant_jacobian_nonzeros);
+  result.counters["jacobian_sweeps"] = static_cast<double>(footprint.jacobian_sweeps);
+  result.counters["full_jacobian_sweeps"] = static_cast<double>(footprint.full_jacobian_sweeps);
+  result.counters["workspace_kib"] = footprint.workspace_bytes / 1024.0;
+}
+
+// Print the footprints of the solvers made, one line each, 0 where the
+// backend doesn't know it
+void PrintFootprints(const std::vector<std::pair<std::string, SolverFootprint>> &footprints) {
+  std::cout << std::endl
+            << std::left << std::setw(16) << "solver" << std::right << std::setw(10)
+            << "tape ops" << std::setw(10) << "tape vars" << std::setw(10) << "tape KiB"
+            << std::setw(9) << "jac nnz" << std::setw(9) << "hes nnz" << std::setw(9)
+            << "kkt nnz" << std::setw(11) << "factor nnz" << std::setw(10) << "work KiB"
+            << std::setw(9) << "lin rows" << std::setw(11) << "const nnz" << std::setw(12)
+            << "jac sweeps" << std::endl;
+  for (const auto &solver : footprints) {
+    const SolverFootprint &footprint = solver.second;
+    std::cout << std::left << std::setw(16) << solver.first << std::right << std::setw(10)
+              << footprint.tape_operations << std::setw(10) << footprint.tape_variables
+              << std::fixed << std::setprecision(1) << std::setw(10)
+              << footprint.tape_bytes / 1024.0 << std::setw(9) << footprint.jacobian_nonzeros
+              << std::setw(9) << footprint.hessian_nonzeros << std::setw(9)
+              << footprint.kkt_nonzeros << std::setw(11) << footprint.factor_nonzeros
+              << std::setw(10) << footprint.workspace_bytes / 1024.0 << std::setw(9)
+              << footprint.linear_constraints << std::setw(11)
+              << footprint.constant_jacobian_nonzeros << std::setw(12)
+              << (std::to_string(footprint.jacobian_sweeps) + "/" +
+                  std::to_string(footprint.full_jacobian_sweeps))
+              << std::endl;
+  }
+}
+
+// Print the operations of one stage of each of models (see ModelStageOps),
+// a column of arithmetic and transcendental ones for each integrator
+void PrintStageOps(const std::vector<VehicleModel> &models) {
+  const Integrator integrators[] = {Integrator::kEuler, Integrator::kMidpoint, Integrator::kRK4};
+  std::cout << std::endl
+            << std::left << std::setw(16) << "model" << std::right << std::setw(12) << "euler ops"
+            << std::setw(8) << "transc" << std::setw(12) << "midpt ops" << std::setw(8)
+            << "transc" << std::setw(12) << "rk4 ops" << std::setw(8) << "transc" << std::endl;
+  for (VehicleModel model : models) {
+    std::cout << std::left << std::setw(16) << VehicleModelName(model) << std::right;
+    for (Integrator integrator : integrators) {
+      const StageOps ops = ModelStageOps(model, integrator);
+      std::cout << std::setw(12) << ops.arithmetic << std::setw(8) << ops.transcendental;
+    }
+    std::cout << std::endl;
+  }
+}
+
+// Time mpc on inputs, from its plans if warm, until min_time seconds have
+// passed; the inputs of a trace follow from each other, the others are
+// started from a solve of their own. The result is named name, with the
+// mean iterations a solve, the solves that failed and the footprint of mpc
+// after them (see AddFootprint) in its counters.
+BenchResult Run(const std::string &name, MPCBase &mpc, const std::vector<Input> &inputs,
+                bool warm, bool trace, double min_time) {
+  std::vector<double> times;
+  double iterations = 0;
+  size_t failed = 0;
+  double elapsed = 0;
+  while (times.empty() || elapsed < min_time) {
+    mpc.Reset();
+    mpc.prev_a = 0;
+    for (const Input &input : inputs) {
+      if (!warm) {
+        mpc.Reset();
+        mpc.prev_a = 0;
+      } else if (!trace) {
+        mpc.Reset();
+        mpc.prev_a = 0;
+        mpc.Solve(input.state, input.coeffs);
+        mpc.Prepare();
+      }
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      const MPCSolution solution = mpc.Solve(input.state, input.coeffs);
+      const double seconds =
+          std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      if (warm) {
+        mpc.prev_a = solution.a[0];
+        mpc.Prepare();
+      }
+      times.push_back(seconds);
+      elapsed += seconds;
+      iterations += solution.statistics.iterations;
+      failed += solution.status == SolveStatus::kFailed;
+    }
+  }
+  BenchResult result = SummarizeTimes(name, times);
+  result.counters["iterations"] = iterations / times.size();
+  result.counters["failed"] = static_cast<double>(failed);
+  AddFootprint(mpc.Footprint(), result);
+  mpc.Reset();
+  mpc.prev_a = 0;
+  return result;
+}
+
+// The converged Ipopt solve of a tick of the trace, that the solves of a
+// budget are judged against
+struct ReferencePlan {
+  double cost;
+  double a;
+  double delta;
+};
+
+// The converged Ipopt solves of the trace at horizon, in order, each from
+// the plan of the last; false if Ipopt isn't compiled for horizon
+bool ReferencePlans(size_t horizon, const std::vector<Input> &trace,
+                    std::vector<ReferencePlan> &plans) {
+  MPCProblem problem;
+  problem.horizon = horizon;
+  problem.max_solve_time = kReferenceTime;
+  std::unique_ptr<MPCBase> mpc = MakeSolver(SolverBackend::kIpopt, problem);
+  if (!mpc) {
+    return false;
+  }
+  WarmUp(*mpc, WarmUpScenarios());
+  mpc->Reset();
+  double prev_a = 0;
+  for (const Input &input : trace) {
+    mpc->prev_a = prev_a;
+    const MPCSolution solution = mpc->Solve(input.state, input.coeffs);
+    mpc->Prepare();
+    plans.push_back({solution.cost, solution.a[0], solution.delta[0]});
+    prev_a = solution.a[0];
+  }
+  return true;
+}
+
+// Time mpc on the trace with budget seconds a solve, warm from its plans as
+// the server solves, until min_time seconds have passed. Every tick starts
+// from the last actuation of the reference, so each backend solves the
+// problems the reference solved, whose costs its own are divided by. The
+// result is named name, with the budget in ms, the mean, 90th percentile
+// and maximum of the costs relative to the reference, and the solves
+// stopped at their deadline and those that failed in its counters.
+BenchResult RunBudget(const std::string &name, MPCBase &mpc, const std::vector<Input> &trace,
+                      const std::vector<ReferencePlan> &reference, double budget,
+                      double min_time) {
+  const double max_solve_time = mpc.max_solve_time;
+  mpc.max_solve_time = budget;
+  std::vector<double> times;
+  std::vector<double> ratios;
+  size_t deadlines = 0;
+  size_t failed = 0;
+  double elapsed = 0;
+  while (times.empty() || elapsed < min_time) {
+    mpc.Reset();
+    for (size_t k = 0; k < trace.size(); k++) {
+      mpc.prev_a = k > 0 ? reference[k - 1].a : 0;
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      const MPCSolution solution = mpc.Solve(trace[k].state, trace[k].coeffs);
+      const double seconds =
+          std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      mpc.Prepare();
+      times.push_back(seconds);
+      elapsed += seconds;
+      ratios.push_back(solution.cost / std::max(reference[k].cost, 1e-9));
+      deadlines += solution.status == SolveStatus::kDeadline;
+      failed += solution.status == SolveStatus::kFailed;
+    }
+  }
+  BenchResult result = SummarizeTimes(name, times);
+  double sum = 0;
+  for (double ratio : ratios) {
+    sum += ratio;
+  }
+  std::sort(ratios.begin(), ratios.end());
+  result.counters["budget_ms"] = budget * 1e3;
+  result.counters["cost_ratio"] = sum / ratios.size();
+  result.counters["cost_ratio_p90"] =
+      ratios[std::min(ratios.size() - 1, static_cast<size_t>(0.9 * ratios.size()))];
+  result.counters["cost_ratio_max"] = ratios.back();
+  result.counters["deadlines"] = static_cast<double>(deadlines);
+  result.counters["failed"] = static_cast<double>(failed);
+  mpc.Reset();
+  mpc.prev_a = 0;
+  mpc.max_solve_time = max_solve_time;
+  return result;
+}
+
+void PrintBudget(const BenchResult &result) {
+  std::cout << std::left << std::setw(34) << result.name << std::right << std::setw(8)
+            << result.count << std::fixed << std::setprecision(1) << std::setw(10)
+            << result.mean * 1e6 << std::setw(10) << result.p99 * 1e6 << std::setprecision(4)
+            << std::setw(10) << result.counters.at("cost_ratio") << std::setw(10)
+            << result.counters.at("cost_ratio_p90") << std::setw(10)
+            << result.counters.at("cost_ratio_max") << std::setw(10)
+            << static_cast<size_t>(result.counters.at("deadlines")) << std::setw(8)
+            << static_cast<size_t>(result.counters.at("failed")) << std::endl;
+}
+
+// Sweep the budgets of every backend and horizon on the trace, printing
+// each as it is run, then the Pareto front of the mean time and the mean
+// relative cost and the fastest within quality; the results are appended
+// to results, and the backends not compiled for a horizon to not_compiled
+void RunPareto(const std::vector<SolverBackend> &solvers, const std::vector<size_t> &horizons,
+               const std::string &filter, const std::vector<double> &budgets,
+               const std::vector<Input> &trace, double min_time, double quality,
+               std::vector<BenchResult> &results, std::vector<std::string> &not_compiled) {
+  std::cout << std::left << std::setw(34) << "benchmark" << std::right << std::setw(8)
+            << "solves" << std::setw(10) << "mean us" << std::setw(10) << "p99 us"
+            << std::setw(10) << "cost/ref" << std::setw(10) << "p90" << std::setw(10) << "max"
+            << std::setw(10) << "deadline" << std::setw(8) << "failed" << std::endl;
+  std::map<size_t, std::vector<ReferencePlan>> references;
+  for (SolverBackend backend : solvers) {
+    for (size_t horizon : horizons) {
+      const std::string prefix =
+          std::string(SolverBackendName(backend)) + "/" + std::to_string(horizon) + "/budget/";
+      std::unique_ptr<MPCBase> mpc;
+      for (double budget : budgets) {
+        std::ostringstream name;
+        name << prefix << budget * 1e3 << "ms";
+        if (name.str().find(filter) == std::string::npos) {
+          continue;
+        }
+        if (!mpc) {
+          MPCProblem problem;
+          problem.horizon = horizon;
+          mpc = MakeSolver(backend, problem);
+          const std::string benchmark = prefix.substr(0, prefix.size() - 8);
+          if (!mpc) {
+            not_compiled.push_back(benchmark);
+            break;
+          }
+          if (references.count(horizon) == 0 &&
+              !ReferencePlans(horizon, trace, references[horizon])) {
+            not_compiled.push_back(benchmark + " (no Ipopt reference)");
+            references.erase(horizon);
+            break;
+          }
+          WarmUp(*mpc, WarmUpScenarios());
+        }
+        results.push_back(RunBudget(name.str(), *mpc, trace, references[horizon], budget,
+                                    min_time));
+        PrintBudget(results.back());
+      }
+    }
+  }
+  if (results.empty()) {
+    return;
+  }
+
+  // Every point that no faster one is as close to the reference as
+  std::vector<const BenchResult *> front;
+  for (const BenchResult &result : results) {
+    front.push_back(&result);
+  }
+  std::sort(front.begin(), front.end(),
+            [](const BenchResult *a, const BenchResult *b) { return a->mean < b->mean; });
+  double best = INFINITY;
+  const BenchResult *fastest = nullptr;
+  std::cout << std::endl << "Pareto front of the mean time and cost/ref:" << std::endl;
+  for (const BenchResult *result : front) {
+    const double ratio = result->counters.at("cost_ratio");
+    if (!fastest && ratio <= quality) {
+      fastest = result;
+    }
+    if (ratio < best) {
+      best = ratio;
+      PrintBudget(*result);
+    }
+  }
+  std::cout << std::endl << "Fastest within " << std::setprecision(4) << quality
+            << " of the cost of the reference: " << (fastest ? fastest->name : "none")
+            << std::endl;
+}
+
+// An input of agree and the last throttle it is solved from: a tick of the
+// trace, solved from the plan of the tick before and the throttle of the
+// reference on it, or a scenario or a random draw, solved cold
+struct AgreeCase {
+  Input input;
+  double prev_a = 0;
+  bool trace = false;
+};
+
+// What agree takes for agreement: the first steering and throttle of a
+// candidate within these of those of the reference
+struct AgreeTolerance {
+  double delta = 0.01;
+  double a = 0.05;
+};
+
+// The corpus of agree: the trace in order, the scenarios, and random draws
+// about the ticks of the trace, each a tick picked at random with its speed,
+// cross track and heading errors, curvature and last throttle moved within
+// what the simulator reaches, from a generator of seed so a corpus is the
+// same from run to run
+std::vector<AgreeCase> AgreeCorpus(const std::vector<Input> &trace,
+                                   const std::vector<Input> &scenarios, size_t random,
+                                   uint64_t seed) {
+  std::vector<AgreeCase> corpus;
+  for (const Input &input : trace) {
+    AgreeCase tick;
+    tick.input = input;
+    tick.trace = true;
+    corpus.push_back(tick);
+  }
+  for (const Input &input : scenarios) {
+    AgreeCase scenario;
+    scenario.input = input;
+    corpus.push_back(scenario);
+  }
+  std::mt19937_64 generator(seed);
+  std::uniform_real_distribution<double> uniform(-1, 1);
+  std::uniform_int_distribution<size_t> pick(0, trace.size() - 1);
+  for (size_t k = 0; k < random; k++) {
+    AgreeCase draw;
+    draw.input = trace[pick(generator)];
+    MPCState &state = draw.input.state;
+    MPCCoeffs &coeffs = draw.input.coeffs;
+    state[3] = std::max(0.0, state[3] * (1 + 0.5 * uniform(generator)));
+    state[4] += uniform(generator);
+    state[5] += 0.15 * uniform(generator);
+    coeffs[0] = state[4];
+    coeffs[2] += 2e-3 * uniform(generator);
+    coeffs[3] += 5e-5 * uniform(generator);
+    draw.prev_a = uniform(generator);
+    corpus.push_back(draw);
+  }
+  return corpus;
+}
+
+// Run work(item) for every item of items on threads threads, the calling
+// one the first, each taking the next item as it is done with one
+void RunParallel(size_t threads, size_t items, const std::function<void(size_t)> &work) {
+  std::atomic<size_t> next(0);
+  const auto run = [&] {
+    for (size_t item = next++; item < items; item = next++) {
+      work(item);
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t k = 1; k < std::min(threads, items); k++) {
+    workers.push_back(std::thread([&run] {
+      CppADThread cppad_thread;
+      run();
+    }));
+  }
+  run();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+// The converged Ipopt solves of corpus at horizon, a cost of NaN where the
+// reference failed: the trace in order from the plan of each last tick, as
+// ReferencePlans, the others cold in chunks spread over threads threads;
+// false if Ipopt isn't compiled for horizon
+bool AgreeReferences(size_t horizon, std::vector<AgreeCase> &corpus, size_t threads,
+                     std::vector<ReferencePlan> &plans) {
+  std::vector<Input> trace;
+  for (const AgreeCase &tick : corpus) {
+    if (tick.trace) {
+      trace.push_back(tick.input);
+    }
+  }
+  plans.assign(corpus.size(), ReferencePlan{NAN, 0, 0});
+  const size_t chunk = 32;
+  const size_t chunks = 1 + (corpus.size() - trace.size() + chunk - 1) / chunk;
+  std::atomic<bool> compiled(true);
+  RunParallel(threads, chunks, [&](size_t item) {
+    if (item == 0) {
+      std::vector<ReferencePlan> traced;
+      if (!ReferencePlans(horizon, trace, traced)) {
+        compiled = false;
+        return;
+      }
+      std::copy(traced.begin(), traced.end(), plans.begin());
+      return;
+    }
+    MPCProblem problem;
+    problem.horizon = horizon;
+    problem.max_solve_time = kReferenceTime;
+    std::unique_ptr<MPCBase> mpc = MakeSolver(SolverBackend::kIpopt, problem);
+    if (!mpc) {
+      compiled = false;
+      return;
+    }
+    const size_t begin = trace.size() + (item - 1) * chunk;
+    for (size_t k = begin; k < std::min(begin + chunk, corpus.size()); k++) {
+      mpc->Reset();
+      mpc->prev_a = corpus[k].prev_a;
+      const MPCSolution solution = mpc->Solve(corpus[k].input.state, corpus[k].input.coeffs);
+      if (solution.status != SolveStatus::kFailed) {
+        plans[k] = {solution.cost, solution.a[0], solution.delta[0]};
+      }
+    }
+  });
+  // The ticks of the trace from the throttle of the reference on the last
+  for (size_t k = 1; k < trace.size(); k++) {
+    corpus[k].prev_a = plans[k - 1].a;
+  }
+  return compiled;
+}
+
+// Solve corpus with mpc, the trace warm from its own plans and the others
+// cold, and judge every solve against the reference of its case: the
+// result, named name, has the times of the solves, and in its counters the
+// 99th percentiles and maxima of the differences of the first steering
+// (rad) and throttle from those of the reference, the mean and the 99th
+// percentile of the gap of the cost to that of the reference relative to
+// it, the cases solved out of tolerance of the reference or failed where
+// the reference didn't, and those the reference failed, left out
+BenchResult RunAgree(const std::string &name, MPCBase &mpc, const std::vector<AgreeCase> &corpus,
+                     const std::vector<ReferencePlan> &reference,
+                     const AgreeTolerance &tolerance) {
+  std::vector<double> times;
+  std::vector<double> delta_errors;
+  std::vector<double> a_errors;
+  std::vector<double> gaps;
+  size_t disagreements = 0;
+  size_t failed = 0;
+  size_t unreferenced = 0;
+  mpc.Reset();
+  for (size_t k = 0; k < corpus.size(); k++) {
+    const AgreeCase &tick = corpus[k];
+    if (!tick.trace) {
+      mpc.Reset();
+    }
+    mpc.prev_a = tick.prev_a;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const MPCSolution solution = mpc.Solve(tick.input.state, tick.input.coeffs);
+    times.push_back(
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    if (tick.trace) {
+      mpc.Prepare();
+    }
+    if (std::isnan(reference[k].cost)) {
+      unreferenced++;
+      continue;
+    }
+    if (solution.status == SolveStatus::kFailed) {
+      failed++;
+      disagreements++;
+      continue;
+    }
+    const double delta_error = std::fabs(solution.delta[0] - reference[k].delta);
+    const double a_error = std::fabs(solution.a[0] - reference[k].a);
+    delta_errors.push_back(delta_error);
+    a_errors.push_back(a_error);
+    gaps.push_back(solution.cost / std::max(reference[k].cost, 1e-9) - 1);
+    disagreements += delta_error > tolerance.delta || a_error > tolerance.a;
+  }
+  BenchResult result = SummarizeTimes(name, times);
+  const auto quantile = [](std::vector<double> &values, double q) {
+    if (values.empty()) {
+      return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(q * values.size()))];
+  };
+  double gap_sum = 0;
+  for (double gap : gaps) {
+    gap_sum += gap;
+  }
+  result.counters["delta_error_p99"] = quantile(delta_errors, 0.99);
+  result.counters["delta_error_max"] = quantile(delta_errors, 1);
+  result.counters["a_error_p99"] = quantile(a_errors, 0.99);
+  result.counters["a_error_max"] = quantile(a_errors, 1);
+  result.counters["cost_gap"] = gaps.empty() ? 0 : gap_sum / gaps.size();
+  result.counters["cost_gap_p99"] = quantile(gaps, 0.99);
+  result.counters["disagreements"] = static_cast<double>(disagreements);
+  result.counters["failed"] = static_cast<double>(failed);
+  result.counters["unreferenced"] = static_cast<double>(unreferenced);
+  mpc.Reset();
+  mpc.prev_a = 0;
+  return result;
+}
+
+void PrintAgree(const BenchResult &result) {
+  std::cout << std::left << std::setw(24) << result.name << std::right << std::setw(8)
+            << result.count << std::fixed << std::setprecision(1) << std::setw(10)
+            << result.mean * 1e6 << std::setw(10) << result.p99 * 1e6 << std::setprecision(4)
+            << std::setw(10) << result.counters.at("delta_error_p99") << std::setw(10)
+            << result.counters.at("delta_error_max") << std::setw(10)
+            << result.counters.at("a_error_p99") << std::setw(10)
+            << result.counters.at("a_error_max") << std::setw(10)
+            << result.counters.at("cost_gap") << std::setw(10)
+            << result.counters.at("cost_gap_p99") << std::setw(9)
+            << static_cast<size_t>(result.counters.at("disagreements")) << std::setw(8)
+            << static_cast<size_t>(result.counters.at("failed")) << std::endl;
+}
+
+// Judge every backend and horizon, and the explicit table of table_path if
+// given, against the converged Ipopt on corpus, the references and then the
+// backends spread over threads threads, printing them as they finish; the
+// results are appended to results, and the backends not compiled for a
+// horizon to not_compiled
+void RunAgreement(const std::vector<SolverBackend> &solvers, const std::vector<size_t> &horizons,
+                  const std::string &filter, const std::string &table_path,
+                  std::vector<AgreeCase> corpus, size_t threads,
+                  const AgreeTolerance &tolerance, std::vector<BenchResult> &results,
+                  std::vector<std::string> &not_compiled) {
+  std::cout << "Corpus of " << corpus.size() << " problems on " << threads << " threads"
+            << std::endl
+            << std::endl
+            << std::left << std::setw(24) << "benchmark" << std::right << std::setw(8)
+            << "solves" << std::setw(10) << "mean us" << std::setw(10) << "p99 us"
+            << std::setw(10) << "delta p99" << std::setw(10) << "max" << std::setw(10)
+            << "a p99" << std::setw(10) << "max" << std::setw(10) << "cost gap" << std::setw(10)
+            << "p99" << std::setw(9) << "disagree" << std::setw(8) << "failed" << std::endl;
+  // The backend of a candidate, or the table over Ipopt
+  struct Candidate {
+    std::string name;
+    SolverBackend backend;
+    size_t horizon;
+    bool table;
+  };
+  std::vector<Candidate> candidates;
+  std::map<size_t, std::vector<AgreeCase>> corpora;
+  std::map<size_t, std::vector<ReferencePlan>> references;
+  for (size_t horizon : horizons) {
+    const std::string suffix = "/" + std::to_string(horizon) + "/agree";
+    for (SolverBackend backend : solvers) {
+      const std::string name = SolverBackendName(backend) + suffix;
+      if (name.find(filter) != std::string::npos) {
+        candidates.push_back({name, backend, horizon, false});
+      }
+    }
+    if (!table_path.empty() && ("table" + suffix).find(filter) != std::string::npos) {
+      candidates.push_back({"table" + suffix, SolverBackend::kIpopt, horizon, true});
+    }
+    if (!candidates.empty() && candidates.back().horizon == horizon) {
+      corpora[horizon] = corpus;
+      if (!AgreeReferences(horizon, corpora[horizon], threads, references[horizon])) {
+        not_compiled.push_back("ipopt/" + std::to_string(horizon) + " (no Ipopt reference)");
+        corpora.erase(horizon);
+      }
+    }
+  }
+  std::mutex mutex;
+  RunParallel(threads, candidates.size(), [&](size_t item) {
+    const Candidate &candidate = candidates[item];
+    const std::string benchmark = candidate.name.substr(0, candidate.name.size() - 6);
+    std::unique_ptr<MPCBase> mpc;
+    if (corpora.count(candidate.horizon) > 0) {
+      MPCProblem problem;
+      problem.horizon = candidate.horizon;
+      mpc = MakeSolver(candidate.backend, problem);
+    }
+    if (mpc && candidate.table) {
+      std::unique_ptr<ExplicitMPC> table = ExplicitMPC::Load(table_path);
+      if (!table) {
+        std::lock_guard<std::mutex> lock(mutex);
+        not_compiled.push_back(benchmark + " (could not read " + table_path + ")");
+        return;
+      }
+      mpc.reset(new TableMPC(std::move(mpc), std::move(table), TableMode::kTableFirst));
+    }
+    if (!mpc) {
+      std::lock_guard<std::mutex> lock(mutex);
+      not_compiled.push_back(benchmark);
+      return;
+    }
+    WarmUp(*mpc, WarmUpScenarios());
+    const BenchResult result = RunAgree(candidate.name, *mpc, corpora[candidate.horizon],
+                                        references[candidate.horizon], tolerance);
+    std::lock_guard<std::mutex> lock(mutex);
+    PrintAgree(result);
+    results.push_back(result);
+  });
+  // In the order of the candidates, whatever the order they finished in
+  std::sort(results.begin(), results.end(), [&](const BenchResult &a, const BenchResult &b) {
+    const auto index = [&](const BenchResult &result) {
+      return std::find_if(candidates.begin(), candidates.end(),
+                          [&](const Candidate &c) { return c.name == result.name; }) -
+             candidates.begin();
+    };
+    return index(a) < index(b);
+  });
+}
+
+// Print the benchmarks of agree in candidate that agree less with the
+// reference than in baseline: more of their cases out of tolerance or
+// failed, by more than a hundredth of the cases, or a 99th percentile of
+// the cost gap up by more than threshold; return their number
+size_t PrintAgreementRegressions(const std::vector<BenchResult> &baseline,
+                                 const std::vector<BenchResult> &candidate, double threshold) {
+  std::map<std::string, const BenchResult *> by_name;
+  for (const BenchResult &result : baseline) {
+    if (result.counters.count("disagreements") > 0) {
+      by_name[result.name] = &result;
+    }
+  }
+  size_t regressions = 0;
+  std::cout << std::endl << "Agreement with the reference against the baseline:" << std::endl;
+  for (const BenchResult &result : candidate) {
+    const auto base = by_name.find(result.name);
+    if (base == by_name.end()) {
+      continue;
+    }
+    const BenchResult &before = *base->second;
+    const double cases = static_cast<double>(std::max<size_t>(result.count, 1));
+    const double more = result.counters.at("disagreements") -
+                        before.counters.at("disagreements");
+    const double gap =
+        result.counters.at("cost_gap_p99") - before.counters.at("cost_gap_p99");
+    const bool worse = more > 0.01 * cases || gap > threshold;
+    regressions += worse;
+    std::cout << std::left << std::setw(24) << result.name << std::right << std::showpos
+              << std::setw(9) << static_cast<long>(more) << " disagreements"
+              << std::setprecision(4) << std::setw(10) << gap << " cost gap p99"
+              << std::noshowpos << (worse ? "  worse" : "") << std::endl;
+  }
+  return regressions;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::vector<SolverBackend> solvers(std::begin(kSolverBackends), std::end(kSolverBackends));
+  std::vector<size_t> horizons(std::begin(kHorizons), std::end(kHorizons));
+  std::vector<VehicleModel> models = {VehicleModel::kKinematic};
+  std::string filter;
+  double min_time = 0.2;
+  size_t ticks = 300;
+  std::string track_path = "lake_track_waypoints.csv";
+  std::string json_path;
+  std::string csv_path;
+  std::vector<std::string> compared;
+  double threshold = 0.05;
+  bool pareto = false;
+  bool agree = false;
+  size_t random = 2000;
+  uint64_t seed = 1;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string table_path;
+  AgreeTolerance tolerance;
+  std::string baseline_path;
+  std::vector<double> budgets(std::begin(kBudgets), std::end(kBudgets));
+  double quality = 1.01;
+  std::vector<std::string> segments;
+  std::vector<std::string> linear_solvers;
+  std::vector<size_t> linear_solver_threads = {1};
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const std::string solvers_flag = "solvers=";
+    const std::string horizons_flag = "horizons=";
+    const std::string models_flag = "models=";
+    const std::string filter_flag = "filter=";
+    const std::string min_time_flag = "min_time=";
+    const std::string ticks_flag = "ticks=";
+    const std::string track_flag = "track=";
+    const std::string json_flag = "json=";
+    const std::string csv_flag = "csv=";
+    const std::string compare_flag = "compare=";
+    const std::string threshold_flag = "threshold=";
+    const std::string budgets_flag = "budgets=";
+    const std::string quality_flag = "quality=";
+    const std::string random_flag = "random=";
+    const std::string seed_flag = "seed=";
+    const std::string threads_flag = "threads=";
+    const std::string table_flag = "table=";
+    const std::string delta_tol_flag = "delta_tol=";
+    const std::string a_tol_flag = "a_tol=";
+    const std::string baseline_flag = "baseline=";
+    const std::string linear_solvers_flag = "linsolvers=";
+    const std::string linear_solver_threads_flag = "linsolverthreads=";
+    if (arg == "pareto") {
+      pareto = true;
+    } else if (arg == "agree") {
+      agree = true;
+    } else if (arg.compare(0, random_flag.size(), random_flag) == 0) {
+      random = std::strtoul(arg.c_str() + random_flag.size(), nullptr, 10);
+    } else if (arg.compare(0, seed_flag.size(), seed_flag) == 0) {
+      seed = std::strtoull(arg.c_str() + seed_flag.size(), nullptr, 10);
+    } else if (arg.compare(0, threads_flag.size(), threads_flag) == 0) {
+      threads = std::strtoul(arg.c_str() + threads_flag.size(), nullptr, 10);
+    } else if (arg.compare(0, table_flag.size(), table_flag) == 0) {
+      table_path = arg.substr(table_flag.size());
+    } else if (arg.compare(0, delta_tol_flag.size(), delta_tol_flag) == 0) {
+      tolerance.delta = std::strtod(arg.c_str() + delta_tol_flag.size(), nullptr);
+    } else if (arg.compare(0, a_tol_flag.size(), a_tol_flag) == 0) {
+      tolerance.a = std::strtod(arg.c_str() + a_tol_flag.size(), nullptr);
+    } else if (arg.compare(0, baseline_flag.size(), baseline_flag) == 0) {
+      baseline_path = arg.substr(baseline_flag.size());
+    } else if (arg.compare(0, linear_solvers_flag.size(), linear_solvers_flag) == 0) {
+      linear_solvers = Split(arg.substr(linear_solvers_flag.size()));
+    } else if (arg.compare(0, linear_solver_threads_flag.size(),
+                           linear_solver_threads_flag) == 0) {
+      linear_solver_threads.clear();
+      for (const std::string &count : Split(arg.substr(linear_solver_threads_flag.size()))) {
+        linear_solver_threads.push_back(std::max<size_t>(1, std::strtoul(count.c_str(), nullptr, 10)));
+      }
+    } else if (arg.compare(0, solvers_flag.size(), solvers_flag) == 0) {
+      solvers.clear();
+      for (const std::string &name : Split(arg.substr(solvers_flag.size()))) {
+        SolverBackend backend;
+        if (!ParseSolverBackend(name, backend)) {
+          std::cerr << "Unknown solver " << name << std::endl;
+          return -1;
+        }
+        solvers.push_back(backend);
+      }
+    } else if (arg.compare(0, horizons_flag.size(), horizons_flag) == 0) {
+      horizons.clear();
+      for (const std::string &horizon : Split(arg.substr(horizons_flag.size()))) {
+        horizons.push_back(std::strtoul(horizon.c_str(), nullptr, 10));
+      }
+    } else if (arg.compare(0, models_flag.size(), models_flag) == 0) {
+      models.clear();
+      for (const std::string &name : Split(arg.substr(models_flag.size()))) {
+        VehicleModel model;
+        if (!ParseVehicleModel(name, model)) {
+          std::cerr << "Unknown vehicle model " << name << std::endl;
+          return -1;
+        }
+        models.push_back(model);
+      }
+    } else if (arg.compare(0, filter_flag.size(), filter_flag) == 0) {
+      filter = arg.substr(filter_flag.size());
+    } else if (arg.compare(0, min_time_flag.size(), min_time_flag) == 0) {
+      min_time = std::strtod(arg.c_str() + min_time_flag.size(), nullptr) * 1e-3;
+    } else if (arg.compare(0, ticks_flag.size(), ticks_flag) == 0) {
+      ticks = std::strtoul(arg.c_str() + ticks_flag.size(), nullptr, 10);
+    } else if (arg.compare(0, track_flag.size(), track_flag) == 0) {
+      track_path = arg.substr(track_flag.size());
+    } else if (arg.compare(0, json_flag.size(), json_flag) == 0) {
+      json_path = arg.substr(json_flag.size());
+    } else if (arg.compare(0, csv_flag.size(), csv_flag) == 0) {
+      csv_path = arg.substr(csv_flag.size());
+    } else if (arg.compare(0, compare_flag.size(), compare_flag) == 0) {
+      compared = Split(arg.substr(compare_flag.size()));
+      if (compared.size() != 2) {
+        std::cerr << "Compare a baseline and a candidate: " << arg << std::endl;
+        return -1;
+      }
+    } else if (arg.compare(0, threshold_flag.size(), threshold_flag) == 0) {
+      threshold = std::strtod(arg.c_str() + threshold_flag.size(), nullptr) * 1e-2;
+    } else if (arg.compare(0, budgets_flag.size(), budgets_flag) == 0) {
+      budgets.clear();
+      for (const std::string &budget : Split(arg.substr(budgets_flag.size()))) {
+        budgets.push_back(std::strtod(budget.c_str(), nullptr) * 1e-3);
+      }
+    } else if (arg.compare(0, quality_flag.size(), quality_flag) == 0) {
+      quality = std::strtod(arg.c_str() + quality_flag.size(), nullptr);
+    } else if (arg.find('=') == std::string::npos) {
+      segments.push_back(arg);
+    } else {
+      std::cerr << "Unknown argument " << arg << std::endl;
+      return -1;
+    }
+  }
+  if (!compared.empty()) {
+    std::vector<BenchResult> baseline;
+    std::vector<BenchResult> candidate;
+    std::string error;
+    if (!ReadBenchJSON(compared[0], baseline, error) ||
+        !ReadBenchJSON(compared[1], candidate, error)) {
+      std::cerr << "Could not read the results: " << error << std::endl;
+      return -1;
+    }
+    return PrintBenchComparison(baseline, candidate, threshold, std::cout) > 0 ? 1 : 0;
+  }
+  if (solvers.empty() || horizons.empty() || models.empty() || ticks == 0 || budgets.empty() ||
+      threads == 0 || linear_solver_threads.empty()) {
+    std::cerr << "Run a solver, a horizon, a model, a tick, a budget and a thread at least"
+              << std::endl;
+    return -1;
+  }
+  std::vector<BenchResult> baseline;
+  if (!baseline_path.empty()) {
+    std::string error;
+    if (!ReadBenchJSON(baseline_path, baseline, error)) {
+      std::cerr << "Could not read the baseline: " << error << std::endl;
+      return -1;
+    }
+  }
+  if (agree && threads > 1) {
+    threads = SetupCppADThreads(threads);
+  }
+  // The Cost lines of the backends, and the warnings of the solves that
+  // fail, counted instead, would be timed too
+  SetLogLevel(LogLevel::kError);
+
+  std::vector<Input> trace;
+  if (!segments.empty()) {
+    if (!ReadTrace(segments, trace)) {
+      return -1;
+    }
+  } else {
+    std::vector<double> xs;
+    std::vector<double> ys;
+    if (!TrackSpline::Load(track_path, xs, ys) || xs.size() < kTelemetryWaypoints) {
+      std::cerr << "Could not read the waypoints of " << track_path << std::endl;
+      return -1;
+    }
+    DriveTrace(xs, ys, ticks, trace);
+  }
+  if (trace.empty()) {
+    std::cerr << "No telemetry in the segments" << std::endl;
+    return -1;
+  }
+  std::vector<Input> scenarios;
+  for (const WarmUpScenario &scenario : WarmUpScenarios()) {
+    scenarios.push_back({scenario.state, scenario.coeffs});
+  }
+
+  std::vector<std::string> not_compiled;
+  std::vector<BenchResult> results;
+  std::vector<std::pair<std::string, SolverFootprint>> footprints;
+  std::cout << "Kernels on " << SimdKernelTarget() << ", Eigen on "
+            << Eigen::SimdInstructionSetsInUse() << std::endl
+            << std::endl;
+  size_t regressions = 0;
+  if (agree) {
+    RunAgreement(solvers, horizons, filter, table_path,
+                 AgreeCorpus(trace, scenarios, random, seed), threads, tolerance, results,
+                 not_compiled);
+    if (!baseline.empty()) {
+      std::cout << std::endl;
+      regressions += PrintBenchComparison(baseline, results, threshold, std::cout);
+      regressions += PrintAgreementRegressions(baseline, results, threshold);
+    }
+  } else if (pareto) {
+    RunPareto(solvers, horizons, filter, budgets, trace, min_time, quality, results,
+              not_compiled);
+  } else {
+    std::cout << std::left << std::setw(34) << "benchmark" << std::right << std::setw(8)
+              << "solves" << std::setw(10) << "mean us" << std::setw(10) << "p50 us"
+              << std::setw(10) << "p90 us" << std::setw(10) << "p99 us" << std::setw(10)
+              << "max us" << std::setw(8) << "iters" << std::setw(8) << "failed" << std::endl;
+    // Ipopt's default linear solver, then those of linsolvers
+    std::vector<IpoptOptions> linear_options(1);
+    for (const std::string &linear_solver : linear_solvers) {
+      for (size_t count : linear_solver_threads) {
+        IpoptOptions options;
+        options.linear_solver = linear_solver;
+        options.linear_solver_threads = count;
+        linear_options.push_back(options);
+      }
+    }
+    for (SolverBackend backend : solvers) {
+      for (size_t horizon : horizons) {
+        for (VehicleModel model : models) {
+        for (const IpoptOptions &linear : linear_options) {
+          const bool default_linear = linear.linear_solver.empty();
+          if (!default_linear && !UsesCppAD(backend)) {
+            continue;
+          }
+          std::string prefix =
+              std::string(SolverBackendName(backend)) + "/" + std::to_string(horizon) + "/";
+          if (model != VehicleModel::kKinematic) {
+            prefix += std::string(VehicleModelName(model)) + "/";
+          }
+          if (!default_linear) {
+            prefix += linear.linear_solver + "x" + std::to_string(linear.linear_solver_threads) +
+                      "/";
+          }
+          std::unique_ptr<MPCBase> mpc;
+          bool compiled = true;
+          for (const char *start : {"cold", "warm"}) {
+            for (const char *set : {"scenarios", "trace"}) {
+              const std::string name = prefix + start + "/" + set;
+              if (name.find(filter) == std::string::npos) {
+                continue;
+              }
+              if (!mpc) {
+                MPCProblem problem;
+                problem.horizon = horizon;
+                problem.vehicle = model;
+                mpc = MakeSolver(backend, problem);
+                if (!mpc) {
+                  not_compiled.push_back(prefix.substr(0, prefix.size() - 1));
+                  compiled = false;
+                  break;
+                }
+                if (!default_linear) {
+                  mpc->SetIpoptOptions(linear);
+                }
+                WarmUp(*mpc, WarmUpScenarios());
+              }
+              const bool is_trace = set == std::string("trace");
+              const BenchResult result = Run(name, *mpc, is_trace ? trace : scenarios,
+                                             start == std::string("warm"), is_trace, min_time);
+              std::cout << std::left << std::setw(34) << name << std::right << std::setw(8)
+                        << result.count << std::fixed << std::setprecision(1) << std::setw(10)
+                        << result.mean * 1e6 << std::setw(10) << result.p50 * 1e6
+                        << std::setw(10) << result.p90 * 1e6 << std::setw(10)
+                        << result.p99 * 1e6 << std::setw(10) << result.max * 1e6
+                        << std::setw(8) << result.counters.at("iterations") << std::setw(8)
+                        << static_cast<size_t>(result.counters.at("failed")) << std::endl;
+              results.push_back(result);
+            }
+            if (!compiled) {
+              break;
+            }
+          }
+          if (mpc) {
+            footprints.emplace_back(prefix.substr(0, prefix.size() - 1), mpc->Footprint());
+          }
+        }
+        }
+      }
+    }
+    if (!footprints.empty()) {
+      PrintFootprints(footprints);
+    }
+    PrintStageOps(models);
+  }
+  if (!not_compiled.empty()) {
+    std::cout << std::endl << "Not compiled:";
+    for (const std::string &name : not_compiled) {
+      std::cout << " " << name;
+    }
+    std::cout << std::endl;
+  }
+  if (!json_path.empty() && !WriteBenchJSON(json_path, "mpc_bench", results)) {
+    std::cerr << "Could not write the results to " << json_path << std::endl;
+    return -1;
+  }
+  if (!csv_path.empty() && !WriteBenchCSV(csv_path, results)) {
+    std::cerr << "Could not write the results to " << csv_path << std::endl;
+    return -1;
+  }
+  return regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,491 @@
+#include <uWS/uWS.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FlightRecorder.h"
+#include "Metrics.h"
+#include "Soak.h"
+#include "SocketIOFrame.h"
+
+// Load generator of the websocket server: many simulated clients, each on a
+// connection of its own, replaying recorded telemetry to ./mpc at a rate.
+//
+//   ./mpc_loadgen <segment>... [url=<ws url>] [clients=<n>] [rate=<hz>]
+//                 [duration=<s>|hours=<h>] [timeout=<ms>] [perclient]
+//                 [soak [interval=<s>] [churn=<s>] [metrics=<url>] [csv=<path>]]
+//
+// The telemetry is that of the JSON sessions of the segments a server
+// recorded with record=<dir> (see FlightRecorder.h), the frames as they were
+// on the wire; each client goes around all of them from an offset of its
+// own, so the clients don't send the same car at once. The clients (100 by
+// default) connect to url (ws://localhost:4567 by default) at once, on one
+// event loop, and each sends a frame every 1/rate s (10 Hz by default),
+// their sends spread over the period, for duration s (10 by default).
+//
+// A client has one frame in flight at a time: the server answers the
+// freshest telemetry of a session and drops those it replaces, so a reply
+// is only known to be that of a frame when no other was sent after it. The
+// round trip of every frame is timed from its send to its steer reply,
+// which holds the actuator latency of the server; a frame that comes due
+// while the last is unanswered is held back to the next period and
+// counted, and one unanswered after timeout ms (1000 by default) is given
+// up. At the end it prints the frames sent and answered, the replies a
+// second, the median, 99th percentile and maximum of the round trips of
+// all clients and the spread of the 99th percentiles over the clients
+// (with perclient, those of every client), and the errors: connections
+// refused or lost, frames timed out and replies that weren't a steer. Only
+// the JSON of the simulator is spoken, so MessagePack and shared memory
+// sessions of the recordings are left out.
+//
+// With soak the run is a soak (see Soak.h), for hours rather than seconds
+// (an hour unless duration or hours is given): every interval s (60 by
+// default) a thread of its own scrapes the metrics of the server (metrics=,
+// by default /metrics of url over http) for its resident set, the heap of
+// its malloc and how fragmented it is, its CppAD pools and sessions, and
+// takes the round trips of the interval, a line each, written to csv= as
+// well if given. With churn=<s> each client closes its connection, and the
+// session of the server with it, after that long and connects again, the
+// first lifetimes staggered so that sessions are made and dropped all
+// along: where a leak shows. At the end it prints the quantities that
+// drifted, if any, and exits with 1 then.
+
+namespace {
+
+// Every client on the loop, its state there
+struct Client {
+  size_t id = 0;
+  // Its socket once connected
+  std::unique_ptr<uWS::WebSocket<uWS::CLIENT>> ws;
+  bool connected = false;
+  bool failed = false;
+  bool lost = false;
+  // The next frame of the telemetry, and when it is due
+  size_t next = 0;
+  std::chrono::steady_clock::time_point due;
+  // The frame in flight, if any, sent at sent
+  bool in_flight = false;
+  std::chrono::steady_clock::time_point sent;
+  // Connections made, and when the last is to be closed for a new one
+  uint64_t sessions = 0;
+  std::chrono::steady_clock::time_point closes;
+
+  uint64_t frames = 0;
+  uint64_t replies = 0;
+  uint64_t held = 0;
+  uint64_t timeouts = 0;
+  uint64_t unexpected = 0;
+  LatencyHistogram round_trips;
+};
+
+// The run, for the callbacks of the loop
+struct LoadGen {
+  std::vector<std::string> telemetry;
+  std::vector<std::unique_ptr<Client>> clients;
+  std::chrono::steady_clock::duration period;
+  std::chrono::steady_clock::duration timeout;
+  std::chrono::steady_clock::time_point end;
+  size_t connecting = 0;
+  LatencyHistogram round_trips;
+
+  // Of a soak: the loop and url to connect again on, how long a connection
+  // lasts (0 for as long as the run), the connections closed for new ones,
+  // and the round trips since the last sample
+  uWS::Hub *hub = nullptr;
+  std::string url;
+  std::chrono::steady_clock::duration churn{0};
+  std::atomic<uint64_t> churned{0};
+  std::mutex window_mutex;
+  std::unique_ptr<LatencyHistogram> window;
+};
+
+// How often the timer of the loop looks at the clients that are due
+const int kPollMilliseconds = 1;
+
+double Seconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double>(duration).count();
+}
+
+// Send the frames that are due, give up those that timed out, and close the
+// connections once the run is over
+void Poll(LoadGen &run) {
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  for (const std::unique_ptr<Client> &held : run.clients) {
+    Client &client = *held;
+    if (!client.connected) {
+      continue;
+    }
+    if (now >= run.end) {
+      client.connected = false;
+      client.ws->close();
+      continue;
+    }
+    if (client.in_flight && now - client.sent > run.timeout) {
+      client.in_flight = false;
+      client.timeouts++;
+    }
+    if (run.churn.count() > 0 && !client.in_flight && now >= client.closes) {
+      // Closed for a new session, not lost; the replies on its way to the
+      // old one are dropped
+      client.connected = false;
+      client.ws->setUserData(nullptr);
+      client.ws->close();
+      client.ws.reset();
+      run.churned++;
+      run.connecting++;
+      run.hub->connect(run.url, &client);
+      continue;
+    }
+    if (now < client.due) {
+      continue;
+    }
+    if (client.in_flight) {
+      // Held back to the next period, counted once for each period missed
+      client.held++;
+      client.due += run.period;
+      continue;
+    }
+    const std::string &frame = run.telemetry[client.next];
+    client.next = (client.next + 1) % run.telemetry.size();
+    client.ws->send(frame.data(), frame.size(), uWS::OpCode::TEXT);
+    client.in_flight = true;
+    client.sent = now;
+    client.frames++;
+    client.due += run.period;
+  }
+}
+
+void PrintRoundTrips(const char *name, const LatencyHistogram &round_trips) {
+  std::cout << std::setw(10) << name << std::setw(10) << round_trips.count() << std::fixed
+            << std::setprecision(3) << std::setw(10) << round_trips.Quantile(0.5) * 1e3
+            << std::setw(10) << round_trips.Quantile(0.99) * 1e3 << std::setw(10)
+            << round_trips.max() * 1e3 << std::endl;
+}
+
+// The /metrics url of the server of the websocket url
+std::string MetricsUrl(const std::string &url) {
+  const size_t scheme = url.find("://");
+  const size_t start = scheme == std::string::npos ? 0 : scheme + 3;
+  const size_t slash = url.find('/', start);
+  return "http://" + url.substr(start, slash - start) + "/metrics";
+}
+
+// Sample the server every interval s of the run into log, on a thread of
+// its own, so that the scrapes don't hold up the loop
+void Sample(LoadGen &run, const std::string &metrics_url, double interval,
+            std::chrono::steady_clock::time_point started, SoakLog &log) {
+  const std::chrono::steady_clock::duration every =
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(interval));
+  for (std::chrono::steady_clock::time_point next = started + every; next <= run.end;
+       next += every) {
+    std::this_thread::sleep_until(next);
+    std::string metrics;
+    std::string error;
+    const bool scraped = HttpGet(metrics_url, metrics, error);
+    std::unique_ptr<LatencyHistogram> window(new LatencyHistogram());
+    uint64_t churned;
+    {
+      std::lock_guard<std::mutex> lock(run.window_mutex);
+      run.window.swap(window);
+      churned = run.churned.load();
+    }
+    if (!scraped) {
+      std::cerr << "Could not sample the server: " << error << std::endl;
+      continue;
+    }
+    SoakSample sample;
+    sample.elapsed = Seconds(std::chrono::steady_clock::now() - started);
+    sample.memory.resident = MetricSample(metrics, "mpc_process_resident_bytes");
+    sample.memory.heap_inuse = MetricSample(metrics, "mpc_heap_bytes{state=\"inuse\"}");
+    sample.memory.heap_free = MetricSample(metrics, "mpc_heap_bytes{state=\"free\"}");
+    sample.cppad_inuse = MetricSample(metrics, "mpc_cppad_pool_bytes{state=\"inuse\"}");
+    sample.cppad_available = MetricSample(metrics, "mpc_cppad_pool_bytes{state=\"available\"}");
+    sample.sessions = MetricSample(metrics, "mpc_sessions");
+    sample.churned = churned;
+    sample.ticks = window->count();
+    sample.p50 = window->Quantile(0.5);
+    sample.p99 = window->Quantile(0.99);
+    sample.p999 = window->Quantile(0.999);
+    log.Add(sample);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::string url = "ws://localhost:4567";
+  size_t clients = 100;
+  double rate = 10;
+  double duration = 10;
+  bool duration_given = false;
+  double timeout_ms = 1000;
+  bool per_client = false;
+  bool soak = false;
+  double interval = 60;
+  double churn = 0;
+  std::string metrics_url;
+  std::string csv;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const std::string url_flag = "url=";
+    const std::string clients_flag = "clients=";
+    const std::string rate_flag = "rate=";
+    const std::string duration_flag = "duration=";
+    const std::string hours_flag = "hours=";
+    const std::string timeout_flag = "timeout=";
+    const std::string interval_flag = "interval=";
+    const std::string churn_flag = "churn=";
+    const std::string metrics_flag = "metrics=";
+    const std::string csv_flag = "csv=";
+    if (arg.compare(0, url_flag.size(), url_flag) == 0) {
+      url = arg.substr(url_flag.size());
+    } else if (arg.compare(0, clients_flag.size(), clients_flag) == 0) {
+      clients = std::strtoul(arg.c_str() + clients_flag.size(), nullptr, 10);
+    } else if (arg.compare(0, rate_flag.size(), rate_flag) == 0) {
+      rate = std::strtod(arg.c_str() + rate_flag.size(), nullptr);
+    } else if (arg.compare(0, duration_flag.size(), duration_flag) == 0) {
+      duration = std::strtod(arg.c_str() + duration_flag.size(), nullptr);
+      duration_given = true;
+    } else if (arg.compare(0, hours_flag.size(), hours_flag) == 0) {
+      duration = std::strtod(arg.c_str() + hours_flag.size(), nullptr) * 3600;
+      duration_given = true;
+    } else if (arg.compare(0, timeout_flag.size(), timeout_flag) == 0) {
+      timeout_ms = std::strtod(arg.c_str() + timeout_flag.size(), nullptr);
+    } else if (arg.compare(0, interval_flag.size(), interval_flag) == 0) {
+      interval = std::strtod(arg.c_str() + interval_flag.size(), nullptr);
+    } else if (arg.compare(0, churn_flag.size(), churn_flag) == 0) {
+      churn = std::strtod(arg.c_str() + churn_flag.size(), nullptr);
+    } else if (arg.compare(0, metrics_flag.size(), metrics_flag) == 0) {
+      metrics_url = arg.substr(metrics_flag.size());
+    } else if (arg.compare(0, csv_flag.size(), csv_flag) == 0) {
+      csv = arg.substr(csv_flag.size());
+    } else if (arg == "perclient") {
+      per_client = true;
+    } else if (arg == "soak") {
+      soak = true;
+    } else {
+      paths.push_back(arg);
+    }
+  }
+  if (paths.empty()) {
+    std::cerr << "Usage: " << argv[0] << " <segment>... [url=<ws url>] [clients=<n>] "
+              << "[rate=<hz>] [duration=<s>|hours=<h>] [timeout=<ms>] [perclient] "
+              << "[soak [interval=<s>] [churn=<s>] [metrics=<url>] [csv=<path>]]" << std::endl;
+    return -1;
+  }
+  if (soak && !duration_given) {
+    duration = 3600;
+  }
+  if (clients == 0 || rate <= 0 || duration <= 0 || timeout_ms <= 0) {
+    std::cerr << "The clients, rate, duration and timeout are all more than 0" << std::endl;
+    return -1;
+  }
+  if (soak && (interval <= 0 || churn < 0)) {
+    std::cerr << "The interval of a soak is more than 0, and its churn not less" << std::endl;
+    return -1;
+  }
+  if (metrics_url.empty()) {
+    metrics_url = MetricsUrl(url);
+  }
+  std::unique_ptr<SoakLog> soak_log;
+  if (soak) {
+    soak_log.reset(new SoakLog(csv));
+    if (!soak_log->ok()) {
+      std::cerr << "Could not write " << csv << std::endl;
+      return -1;
+    }
+  }
+
+  LoadGen run;
+  for (const std::string &path : paths) {
+    std::unique_ptr<FlightReader> reader = FlightReader::Open(path);
+    if (!reader) {
+      std::cerr << "Could not read the flight records of " << path << std::endl;
+      return -1;
+    }
+    FlightRecordHeader header;
+    MessageView payload;
+    while (reader->Next(header, payload)) {
+      SocketIOFrame frame;
+      if (header.type == static_cast<uint16_t>(FlightRecordType::kTelemetry) &&
+          header.format == static_cast<uint8_t>(WireFormat::kJson) &&
+          DecodeFrame(payload, frame) && frame.event.equals("telemetry") && frame.has_data()) {
+        run.telemetry.push_back(std::string(payload.begin(), payload.end()));
+      }
+    }
+  }
+  if (run.telemetry.empty()) {
+    std::cerr << "No JSON telemetry in the segments" << std::endl;
+    return -1;
+  }
+  run.period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(1 / rate));
+  run.timeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(timeout_ms * 1e-3));
+
+  uWS::Hub h;
+  run.hub = &h;
+  run.url = url;
+  if (soak) {
+    run.churn = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(churn));
+    run.window.reset(new LatencyHistogram());
+  }
+  h.onConnection([&run](uWS::WebSocket<uWS::CLIENT> ws, uWS::HttpRequest) {
+    Client &client = *static_cast<Client *>(ws.getUserData());
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    client.ws.reset(new uWS::WebSocket<uWS::CLIENT>(ws));
+    client.connected = true;
+    // The sends of the clients spread over the period from now, and their
+    // first connections over the churn
+    client.due = now + run.period * client.id / run.clients.size();
+    client.sessions++;
+    if (client.sessions == 1) {
+      client.closes = now + run.churn * (client.id + 1) / run.clients.size();
+    } else {
+      client.closes = now + run.churn;
+    }
+    run.connecting--;
+  });
+  h.onError([&run](void *user) {
+    static_cast<Client *>(user)->failed = true;
+    run.connecting--;
+  });
+  h.onMessage([&run](uWS::WebSocket<uWS::CLIENT> ws, char *data, size_t length, uWS::OpCode) {
+    if (ws.getUserData() == nullptr) {
+      // To a connection closed for a new one
+      return;
+    }
+    Client &client = *static_cast<Client *>(ws.getUserData());
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    SocketIOFrame frame;
+    if (!DecodeFrame(MessageView(data, length), frame) || !frame.event.equals("steer")) {
+      client.unexpected++;
+      return;
+    }
+    if (!client.in_flight) {
+      // The reply of a frame given up on
+      return;
+    }
+    client.in_flight = false;
+    client.replies++;
+    client.round_trips.Record(Seconds(now - client.sent));
+    run.round_trips.Record(Seconds(now - client.sent));
+    std::lock_guard<std::mutex> lock(run.window_mutex);
+    if (run.window) {
+      run.window->Record(Seconds(now - client.sent));
+    }
+  });
+  h.onDisconnection([](uWS::WebSocket<uWS::CLIENT> ws, int, char *, size_t) {
+    if (ws.getUserData() == nullptr) {
+      return;
+    }
+    Client &client = *static_cast<Client *>(ws.getUserData());
+    // Closed by the server before the run was over
+    client.lost = client.connected;
+    client.connected = false;
+  });
+
+  const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+  run.end = started + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                          std::chrono::duration<double>(duration));
+  for (size_t k = 0; k < clients; k++) {
+    run.clients.emplace_back(new Client());
+    Client &client = *run.clients.back();
+    client.id = k;
+    client.next = k * run.telemetry.size() / clients;
+  }
+  run.connecting = clients;
+  for (const std::unique_ptr<Client> &client : run.clients) {
+    h.connect(url, client.get());
+  }
+  uS::Timer *poll = new uS::Timer(h.getLoop());
+  poll->setData(&run);
+  poll->start([](uS::Timer *timer) {
+    LoadGen &run = *static_cast<LoadGen *>(timer->getData());
+    Poll(run);
+    const bool open = std::any_of(run.clients.begin(), run.clients.end(),
+                                  [](const std::unique_ptr<Client> &client) {
+                                    return client->connected;
+                                  });
+    if (!open && run.connecting == 0 && std::chrono::steady_clock::now() >= run.end) {
+      timer->stop();
+      timer->close();
+    }
+  }, kPollMilliseconds, kPollMilliseconds);
+  std::thread sampler;
+  if (soak_log) {
+    sampler = std::thread(Sample, std::ref(run), metrics_url, interval, started,
+                          std::ref(*soak_log));
+  }
+  h.run();
+  if (sampler.joinable()) {
+    sampler.join();
+  }
+  const double elapsed = Seconds(std::chrono::steady_clock::now() - started);
+
+  uint64_t frames = 0;
+  uint64_t replies = 0;
+  uint64_t held = 0;
+  uint64_t timeouts = 0;
+  uint64_t unexpected = 0;
+  size_t failed = 0;
+  size_t lost = 0;
+  std::vector<double> p99s;
+  for (const std::unique_ptr<Client> &client : run.clients) {
+    frames += client->frames;
+    replies += client->replies;
+    held += client->held;
+    timeouts += client->timeouts;
+    unexpected += client->unexpected;
+    failed += client->failed;
+    lost += client->lost;
+    if (client->round_trips.count() > 0) {
+      p99s.push_back(client->round_trips.Quantile(0.99));
+    }
+  }
+  std::cout << clients << " clients to " << url << " at " << rate << " Hz for " << duration
+            << " s, " << run.telemetry.size() << " recorded frames" << std::endl;
+  std::cout << frames << " frames sent, " << replies << " answered, " << std::fixed
+            << std::setprecision(1) << replies / elapsed << " replies/s" << std::endl
+            << std::endl;
+  std::cout << std::setw(10) << "client" << std::setw(10) << "replies" << std::setw(10)
+            << "p50 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << std::endl;
+  if (per_client) {
+    for (const std::unique_ptr<Client> &client : run.clients) {
+      PrintRoundTrips(std::to_string(client->id).c_str(), client->round_trips);
+    }
+  }
+  PrintRoundTrips("all", run.round_trips);
+  if (!p99s.empty()) {
+    std::sort(p99s.begin(), p99s.end());
+    std::cout << std::endl
+              << std::setprecision(3) << "p99 of the clients, ms: min " << p99s.front() * 1e3
+              << ", median " << p99s[p99s.size() / 2] * 1e3 << ", max " << p99s.back() * 1e3
+              << std::endl;
+  }
+  std::cout << std::endl
+            << failed << " connections refused, " << lost << " lost, " << timeouts
+            << " frames timed out, " << held << " held back, " << unexpected
+            << " replies not a steer" << std::endl;
+  bool drifted = false;
+  if (soak_log) {
+    std::cout << run.churned.load() << " connections closed for new sessions" << std::endl;
+    const std::vector<std::string> drifts = soak_log->Drifts(SoakPolicy());
+    std::cout << std::endl << (drifts.empty() ? "No drift" : "Drift:") << std::endl;
+    for (const std::string &drift : drifts) {
+      std::cout << "  " << drift << std::endl;
+    }
+    drifted = !drifts.empty();
+  }
+  return failed > 0 || lost > 0 || drifted ? 1 : 0;
+}
@@ -0,0 +1,1021 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Allocations.h"
+#include "ArrowFile.h"
+#include "BenchResults.h"
+#include "CacheBaseline.h"
+#include "CppADThreads.h"
+#include "FlightRecorder.h"
+#include "KKTDump.h"
+#include "KinematicModel.h"
+#include "LatencyEstimator.h"
+#include "LinearizationTable.h"
+#include "Log.h"
+#include "MPC.h"
+#include "MessagePack.h"
+#include "Metrics.h"
+#include "PerfCounters.h"
+#include "Polynomial.h"
+#include "ProblemCapture.h"
+#include "ReferenceFit.h"
+#include "SharedChannel.h"
+#include "SocketIOFrame.h"
+#include "SolverBackend.h"
+#include "SteerMessage.h"
+#include "Telemetry.h"
+#include "TickRecorder.h"
+#include "WarmUp.h"
+
+// Offline replay of the telemetry a flight recorder kept (see
+// FlightRecorder.h), through the tick of main.cpp without the socket.
+//
+//   ./mpc_replay [N] [solver] <segment>... [paced] [blocked] [lintable] [floatfit]
+//                [recall] [baseline=<k>] [warmup=<rounds>] [allocfree=<stage>,...] [perf]
+//                [json=<path>] [csv=<path>] [arrow=<path>] [kkt=<dir>] [log=<level>]
+//   ./mpc_replay problem=<file> [repeat=<n>] [warmup=<rounds>] [kkt=<dir>] [log=<level>]
+//   ./mpc_replay ticks=<file> [arrow=<path>]
+//   ./mpc_replay compress <segment>...
+//
+// The records of the segments, of one or several processes, are taken in
+// the order of their times. Each session gets a solver of its own, made
+// and warmed up the way the server makes it, and every telemetry frame is
+// decoded, parsed, fitted, predicted over the latency and solved, and its
+// reply written, in the format it came in. The latency is estimated from
+// the recorded commands, each fed to the estimator of its session as it
+// comes in the records, so the prediction sees the delays the server saw.
+// The replayed actuations are compared with the recorded command of the
+// same telemetry.
+//
+// By default the frames are replayed back to back, as fast as they solve;
+// "paced" waits for the time of each as it was recorded instead. At the end
+// it prints the ticks per second, the median, 99th percentile and maximum
+// of every stage and of the whole tick, the work of the solves, and the
+// differences of the actuations from those recorded, and the heap
+// allocations of every stage a tick (see Allocations.h). With "allocfree"
+// the stages named must not allocate, by their names in the table like
+// "fit,serialize" or "all" of them: a tick that does is reported, and the
+// replay fails with an exit status of 1, for a check of a recording in a
+// script. The first ticks of each session size the buffers the later ones
+// reuse, so they are let allocate (see kAllocationWarmTicks). With "perf"
+// the hardware counters of the stages are read too, and their instructions
+// a cycle and cache and branch misses a tick printed (see PerfCounters.h).
+// The hits and misses of the caches of the tick are printed too, with the
+// time and iterations of the stage they serve on each, as in the cache
+// metrics of the server: the reference fit, the warm start, the solution
+// database with "recall" (Ipopt keeping past solutions, as the server does)
+// and the linearization table. "baseline" fits and solves every k-th tick
+// of a session again without them, after the tick, for the time and
+// iterations each saved where it hit (see CacheBaseline.h).
+// json and csv write the times of every stage and of the whole tick to a
+// file as the benchmarks replay/<stage> and replay/tick, with the ticks per
+// second and the hit rates and savings of the caches in the counters of
+// the tick, for mpc_bench compare= to judge a
+// change by against the file of the last revision (see BenchResults.h).
+// arrow writes a row a replayed tick to an Arrow IPC file instead, for the
+// analysis of millions of ticks by the tools that scan columns (see
+// ArrowFile.h): the process, session and time of its record, the seconds
+// of every stage ("solve_s", 0 for the stages it didn't have) and of the
+// tick, the iterations, restorations, cost, status and start of the solve,
+// whether it failed or stopped at its deadline, whether each cache hit (1),
+// missed (0) or wasn't looked up (-1) ("fit_hit"), the heap allocations
+// and the command.
+// kkt writes the KKT system of every Ipopt iteration of the solves replayed,
+// those of the warm-up aside, into dir in Matrix Market format, up to
+// kktkeep=<n> (1000) of them, for benchmark_kkt to factor (see KKTDump.h);
+// with "problem" too. They are written inside the solves, which are slower
+// for it, and only the Ipopt backend has them.
+// The multi-vehicle telemetry_batch frames, and the track and waypoint
+// history of the server, are not replayed: the reference is the fit of the
+// waypoints of every frame.
+//
+// "problem" solves a slow problem the server captured (capture=, see
+// ProblemCapture.h) again, repeat times, by the solver, the options and the
+// weights it was captured with, each time from the start it was captured
+// from, and prints how every solve went against how it went in the server.
+// The horizon, the solver and the flags of the records don't apply.
+//
+// "ticks" prints a dump of the black box of the server (blackbox=, see
+// TickRecorder.h), a line a tick, oldest first: its session, its arrival
+// in ms before the dump, the speed, cte and epsi solved for, the ms of its
+// stages, how the solve went, the command and why it missed the control
+// period, if it did; with arrow, into an Arrow IPC file instead, a row a
+// tick, the stages in "<stage>_s" and the cause of a miss in "miss" (-1 for
+// none, else the DeadlineMiss).
+//
+// "compress" writes each segment as a compressed segment next to it, its
+// path with a "z" appended, the way a server with recordcompress does as
+// it closes them, and prints its bytes before and after and the seconds
+// taken to compress it and to read it back. The segments of a replay may be
+// compressed or not; the chunks of a compressed one are inflated on every
+// core as it is read.
+
+namespace {
+
+struct Record {
+  FlightRecordHeader header;
+  uint64_t pid;
+  std::string payload;
+};
+
+// The actuations of a reply
+struct Actuation {
+  double steering_angle;
+  double throttle;
+};
+
+// A session of the recording, as the server kept it
+struct ReplaySession {
+  ReplaySession(WireFormat format, bool float_fit)
+      : format(format), reference_fit(ReferenceFitTolerance(), float_fit), baseline(float_fit) {}
+
+  const WireFormat format;
+  std::unique_ptr<MPCBase> mpc;
+  ReferenceFitCache reference_fit;
+  // Its ticks without the caches, with baseline, and how many it had so far
+  CacheBaseline baseline;
+  size_t ticks = 0;
+  Telemetry telemetry;
+  LatencyEstimator latency;
+  SteerMessage steer_message;
+  SteerPack steer_pack;
+  SteerRecord steer_record;
+  // The actuations replayed for the telemetry that arrived at each time,
+  // until its recorded command comes
+  std::unordered_map<uint64_t, Actuation> replayed;
+};
+
+// The differences of one actuation from those recorded
+struct Difference {
+  double sum = 0;
+  double max = 0;
+
+  void Add(double replayed, double recorded) {
+    const double d = std::fabs(replayed - recorded);
+    sum += d;
+    max = std::max(max, d);
+  }
+};
+
+// The heap allocations of one stage over the ticks
+struct StageAllocations {
+  uint64_t count = 0;
+  uint64_t bytes = 0;
+  uint64_t max = 0;
+
+  void Add(uint64_t tick_count, uint64_t tick_bytes) {
+    count += tick_count;
+    bytes += tick_bytes;
+    max = std::max(max, tick_count);
+  }
+};
+
+std::chrono::steady_clock::time_point SteadyTime(uint64_t nanoseconds) {
+  return std::chrono::steady_clock::time_point(std::chrono::nanoseconds(nanoseconds));
+}
+
+double Seconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double>(duration).count();
+}
+
+// The actuations of a recorded command of format; false if it isn't a
+// steer reply of a single car
+bool ReadCommand(WireFormat format, const MessageView &message, Actuation &command) {
+  if (format == WireFormat::kMessagePack) {
+    return UnpackSteer(message, command.steering_angle, command.throttle);
+  }
+  if (format == WireFormat::kSharedMemory) {
+    SharedCommand shared;
+    if (!ReadSharedCommand(message, shared)) {
+      return false;
+    }
+    command.steering_angle = shared.steering_angle;
+    command.throttle = shared.throttle;
+    return true;
+  }
+  SocketIOFrame frame;
+  return DecodeFrame(message, frame) && frame.event.equals("steer") &&
+         ParseSteer(frame.data, command.steering_angle, command.throttle);
+}
+
+// The lookups of the caches that had any, the time and iterations of the
+// stage they serve on a hit and on a miss, and what a hit saved against the
+// baselines measured
+void PrintCaches(const std::array<CacheCounters, kCaches> &caches) {
+  std::cout << std::endl
+            << std::setw(20) << "cache" << std::setw(8) << "hits" << std::setw(8) << "misses"
+            << std::setw(8) << "hit %" << std::setw(10) << "hit ms" << std::setw(10)
+            << "miss ms" << std::setw(8) << "hit it" << std::setw(8) << "miss it"
+            << std::setw(11) << "baselines" << std::setw(10) << "saved ms" << std::setw(10)
+            << "saved it" << std::endl;
+  for (size_t k = 0; k < kCaches; k++) {
+    const CacheCounters &cache = caches[k];
+    const uint64_t hits = cache.hits();
+    const uint64_t misses = cache.misses();
+    if (hits + misses == 0) {
+      continue;
+    }
+    const double hit_ticks = std::max<uint64_t>(hits, 1);
+    const double miss_ticks = std::max<uint64_t>(misses, 1);
+    const double baselines = std::max<uint64_t>(cache.baselines(), 1);
+    std::cout << std::setw(20) << CacheName(static_cast<Cache>(k)) << std::fixed
+              << std::setw(8) << hits << std::setw(8) << misses << std::setprecision(1)
+              << std::setw(8) << 100.0 * hits / (hits + misses) << std::setprecision(3)
+              << std::setw(10) << cache.hit_seconds() * 1e3 / hit_ticks << std::setw(10)
+              << cache.miss_seconds() * 1e3 / miss_ticks << std::setprecision(1)
+              << std::setw(8) << cache.hit_iterations() / hit_ticks << std::setw(8)
+              << cache.miss_iterations() / miss_ticks << std::setw(11) << cache.baselines()
+              << std::setprecision(3) << std::setw(10)
+              << cache.saved_seconds() * 1e3 / baselines << std::setprecision(1)
+              << std::setw(10) << cache.saved_iterations() / baselines << std::endl;
+  }
+}
+
+void PrintAllocations(const char *name, const StageAllocations &allocations, uint64_t ticks) {
+  std::cout << std::setw(14) << name << std::fixed << std::setprecision(1) << std::setw(10)
+            << static_cast<double>(allocations.count) / ticks << std::setw(10) << allocations.max
+            << std::setw(12) << static_cast<double>(allocations.bytes) / ticks << std::endl;
+}
+
+void PrintStage(const char *name, const LatencyHistogram &histogram) {
+  std::cout << std::setw(14) << name << std::setw(10) << histogram.count() << std::fixed
+            << std::setprecision(3) << std::setw(10) << histogram.Quantile(0.5) * 1e3
+            << std::setw(10) << histogram.Quantile(0.99) * 1e3 << std::setw(10)
+            << histogram.max() * 1e3 << std::endl;
+}
+
+// Solve the problem of path again repeat times, as mpc_replay problem=
+int ReplayProblem(const std::string &path, size_t repeat, size_t warm_up_rounds,
+                  KKTDump *kkt) {
+  CapturedProblem captured;
+  std::string error;
+  if (!ReadProblem(path, captured, error)) {
+    std::cerr << "Could not read the problem: " << error << std::endl;
+    return -1;
+  }
+  SolverBackend solver;
+  if (!ParseSolverBackend(captured.backend, solver)) {
+    std::cerr << "Unknown solver " << captured.backend << " in " << path << std::endl;
+    return -1;
+  }
+  MPCProblem problem;
+  problem.horizon = captured.horizon;
+  problem.move_blocking = captured.move_blocking;
+  if (captured.linearization_table) {
+    problem.linearization_table = std::make_shared<const LinearizationTable>();
+  }
+  std::unique_ptr<MPCBase> mpc = MakeSolver(solver, problem);
+  if (!mpc) {
+    std::cerr << "No " << captured.backend << " MPC compiled for a horizon of "
+              << captured.horizon << " timesteps"
+              << (captured.move_blocking ? " with blocking" : "") << std::endl;
+    return -1;
+  }
+  if (captured.sampled) {
+    mpc->SampleReference(true);
+  }
+  if (captured.soft_penalty > 0) {
+    mpc->SoftenConstraints(captured.soft_penalty);
+  }
+  if (warm_up_rounds > 0) {
+    WarmUp(*mpc, WarmUpScenarios(), warm_up_rounds);
+  }
+  mpc->DumpKKT(kkt);
+  // The weights it solved with at the speed of the state, from any speed
+  mpc->cost_schedule.Clear();
+  mpc->cost_schedule.AddPoint(0, captured.weights);
+
+  std::cout << "Session " << captured.session << ", " << captured.backend << " over "
+            << captured.horizon << " timesteps" << std::endl;
+  std::cout << std::setw(10) << "solve" << std::setw(10) << "ms" << std::setw(8) << "iter"
+            << std::setw(8) << "status" << std::setw(8) << "restor" << std::setw(14) << "cost"
+            << std::endl;
+  std::cout << std::setw(10) << "captured" << std::fixed << std::setprecision(3) << std::setw(10)
+            << captured.seconds * 1e3 << std::setw(8) << captured.iterations << std::setw(8)
+            << captured.status << std::setw(8) << captured.restorations << std::setw(14)
+            << std::setprecision(6) << captured.cost << std::endl;
+  bool restored = true;
+  for (size_t k = 0; k < repeat; k++) {
+    restored &= mpc->RestoreStart(captured.start);
+    mpc->prev_a = captured.prev_a;
+    mpc->max_solve_time = captured.max_solve_time;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const MPCSolution result = mpc->Solve(captured.state, captured.coeffs);
+    const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+    std::cout << std::setw(10) << k << std::setprecision(3) << std::setw(10)
+              << seconds.count() * 1e3 << std::setw(8) << result.statistics.iterations
+              << std::setw(8) << static_cast<int>(result.status) << std::setw(8)
+              << result.statistics.restorations << std::setw(14) << std::setprecision(6)
+              << result.cost << std::endl;
+  }
+  if (!restored) {
+    std::cerr << "The start of the problem could not be restored, the solves started cold"
+              << std::endl;
+  }
+  if (kkt != nullptr) {
+    std::cout << "Wrote " << kkt->written() << " KKT systems" << std::endl;
+  }
+  return 0;
+}
+
+// Print the ticks of a dump of the black box, oldest first, each at its
+// arrival in ms before the dump
+int PrintTickDump(const std::string &path, const std::string &arrow_path) {
+  TickDumpHeader header;
+  std::vector<TickRecord> records;
+  std::string error;
+  if (!ReadTickDump(path, header, records, error)) {
+    std::cerr << "Could not read the ticks: " << error << std::endl;
+    return -1;
+  }
+  if (!error.empty()) {
+    std::cerr << "The dump is " << error << ", " << records.size() << " of " << header.records
+              << " ticks" << std::endl;
+  }
+  std::cout << records.size() << " ticks of solver " << header.worker << " of process "
+            << header.pid << ", dumped for "
+            << TickDumpReasonName(static_cast<TickDumpReason>(header.reason)) << std::endl
+            << std::endl;
+  if (!arrow_path.empty()) {
+    std::vector<ArrowColumn> columns = {
+        {"session", ArrowType::kUInt64}, {"arrival_ns", ArrowType::kUInt64},
+        {"speed", ArrowType::kFloat64},  {"cte", ArrowType::kFloat64},
+        {"epsi", ArrowType::kFloat64}};
+    for (size_t k = 0; k < kTickStages; k++) {
+      columns.push_back(
+          {std::string(TickStageName(static_cast<TickStage>(k))) + "_s", ArrowType::kFloat32});
+    }
+    const std::vector<ArrowColumn> solve_columns = {
+        {"iterations", ArrowType::kInt32}, {"restorations", ArrowType::kInt32},
+        {"cost", ArrowType::kFloat64},     {"status", ArrowType::kInt32},
+        {"start", ArrowType::kInt32},      {"steer", ArrowType::kFloat64},
+        {"throttle", ArrowType::kFloat64}, {"miss", ArrowType::kInt8}};
+    columns.insert(columns.end(), solve_columns.begin(), solve_columns.end());
+    ArrowFileWriter writer(arrow_path, columns);
+    for (const TickRecord &record : records) {
+      size_t c = 0;
+      writer.Append(c++, record.session);
+      writer.Append(c++, record.arrival_ns);
+      writer.Append(c++, record.speed);
+      writer.Append(c++, record.state[4]);
+      writer.Append(c++, record.state[5]);
+      for (size_t k = 0; k < kTickStages; k++) {
+        writer.Append(c++, static_cast<double>(record.stage_seconds[k]));
+      }
+      writer.Append(c++, record.iterations);
+      writer.Append(c++, record.restorations);
+      writer.Append(c++, record.cost);
+      writer.Append(c++, record.status);
+      writer.Append(c++, record.start);
+      writer.Append(c++, record.steer_value);
+      writer.Append(c++, record.throttle_value);
+      writer.Append(c++, static_cast<int64_t>(record.missed) - 1);
+      writer.EndRow();
+    }
+    if (!writer.Close()) {
+      std::cerr << "Could not write the ticks to " << arrow_path << std::endl;
+      return -1;
+    }
+    std::cout << "Wrote " << writer.rows() << " ticks to " << arrow_path << std::endl;
+    return 0;
+  }
+  std::cout << std::setw(8) << "session" << std::setw(10) << "at ms" << std::setw(8) << "mph"
+            << std::setw(8) << "cte" << std::setw(8) << "epsi" << std::setw(8) << "wait"
+            << std::setw(8) << "parse" << std::setw(8) << "fit" << std::setw(8) << "solve"
+            << std::setw(8) << "serial" << std::setw(6) << "it" << std::setw(7) << "status"
+            << std::setw(6) << "start" << std::setw(8) << "steer" << std::setw(8) << "throt"
+            << "  missed" << std::endl;
+  for (const TickRecord &record : records) {
+    const auto stage_ms = [&record](TickStage stage) {
+      return record.stage_seconds[static_cast<size_t>(stage)] * 1e3;
+    };
+    const char *const missed =
+        record.missed > 0 ? DeadlineMissName(static_cast<DeadlineMiss>(record.missed - 1)) : "";
+    std::cout << std::fixed << std::setw(8) << record.session << std::setprecision(1)
+              << std::setw(10)
+              << (static_cast<double>(record.arrival_ns) - static_cast<double>(header.steady_ns)) *
+                     1e-6
+              << std::setw(8) << record.speed << std::setprecision(3) << std::setw(8)
+              << record.state[4] << std::setw(8) << record.state[5] << std::setprecision(2)
+              << std::setw(8) << stage_ms(TickStage::kWait) << std::setw(8)
+              << stage_ms(TickStage::kDecode) + stage_ms(TickStage::kParse) << std::setw(8)
+              << stage_ms(TickStage::kFit) << std::setw(8) << stage_ms(TickStage::kSolve)
+              << std::setw(8) << stage_ms(TickStage::kSerialize) << std::setw(6)
+              << record.iterations << std::setw(7) << record.status << std::setw(6)
+              << record.start << std::setprecision(3) << std::setw(8) << record.steer_value
+              << std::setw(8) << record.throttle_value << "  " << missed << std::endl;
+  }
+  return 0;
+}
+
+// Compress each of the segments at paths next to it
+int CompressSegments(const std::vector<std::string> &paths) {
+  std::cout << std::setw(12) << "records" << std::setw(14) << "bytes" << std::setw(14)
+            << "compressed" << std::setw(8) << "ratio" << std::setw(12) << "deflate s"
+            << std::setw(12) << "inflate s" << "  segment" << std::endl;
+  for (const std::string &path : paths) {
+    const std::string compressed_path = path + "z";
+    std::string error;
+    const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    if (!CompressFlightSegment(path, compressed_path, error)) {
+      std::cerr << "Could not compress " << path << ": " << error << std::endl;
+      return -1;
+    }
+    const std::chrono::steady_clock::time_point compressed = std::chrono::steady_clock::now();
+    std::unique_ptr<FlightReader> reader = FlightReader::Open(compressed_path);
+    const std::chrono::steady_clock::time_point inflated = std::chrono::steady_clock::now();
+    size_t records = 0;
+    FlightRecordHeader header;
+    MessageView payload;
+    while (reader && reader->Next(header, payload)) {
+      records++;
+    }
+    std::ifstream raw(path, std::ios::binary | std::ios::ate);
+    std::ifstream deflated(compressed_path, std::ios::binary | std::ios::ate);
+    const double bytes = static_cast<double>(raw.tellg());
+    const double compressed_bytes = static_cast<double>(deflated.tellg());
+    std::cout << std::setw(12) << records << std::setw(14) << std::fixed << std::setprecision(0)
+              << bytes << std::setw(14) << compressed_bytes << std::setprecision(1)
+              << std::setw(8) << bytes / compressed_bytes << std::setprecision(3)
+              << std::setw(12) << Seconds(compressed - started) << std::setw(12)
+              << Seconds(inflated - compressed) << "  " << path << std::endl;
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  // As the server: the tapes and sweeps reuse the memory of the last ones
+  HoldCppADMemory();
+  MPCProblem problem;
+  problem.horizon = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 15;
+  SolverBackend solver = SolverBackend::kIpopt;
+  if (argc > 2 && !ParseSolverBackend(argv[2], solver)) {
+    std::cerr << "Unknown solver " << argv[2] << std::endl;
+    return -1;
+  }
+  bool paced = false;
+  bool perf_counters = false;
+  bool float_fit = false;
+  bool linearization_table = false;
+  bool recall = false;
+  size_t baseline_period = 0;
+  size_t warm_up_rounds = 1;
+  LogLevel log_level = LogLevel::kWarning;
+  std::array<bool, kTickStages> allocation_free;
+  allocation_free.fill(false);
+  std::string json_path;
+  std::string csv_path;
+  std::string arrow_path;
+  std::string problem_path;
+  std::string ticks_path;
+  std::string kkt_directory;
+  size_t kkt_keep = 1000;
+  size_t repeat = 1;
+  std::vector<std::string> paths;
+  // A problem or a dump of ticks stands alone, without the horizon and the
+  // solver
+  const bool compress = argc > 1 && std::string(argv[1]) == "compress";
+  const int first_flag = argc > 1 && (std::string(argv[1]).compare(0, 8, "problem=") == 0 ||
+                                      std::string(argv[1]).compare(0, 6, "ticks=") == 0)
+                             ? 1
+                             : compress ? 2 : 3;
+  for (int i = first_flag; i < argc; i++) {
+    const std::string arg = argv[i];
+    const std::string warm_up_flag = "warmup=";
+    const std::string allocation_free_flag = "allocfree=";
+    const std::string json_flag = "json=";
+    const std::string csv_flag = "csv=";
+    const std::string arrow_flag = "arrow=";
+    const std::string log_flag = "log=";
+    const std::string problem_flag = "problem=";
+    const std::string repeat_flag = "repeat=";
+    const std::string baseline_flag = "baseline=";
+    const std::string ticks_flag = "ticks=";
+    const std::string kkt_flag = "kkt=";
+    const std::string kkt_keep_flag = "kktkeep=";
+    if (arg == "paced") {
+      paced = true;
+    } else if (arg == "perf") {
+      perf_counters = true;
+    } else if (arg == "blocked") {
+      problem.move_blocking = true;
+    } else if (arg == "lintable") {
+      linearization_table = true;
+    } else if (arg == "floatfit") {
+      float_fit = true;
+    } else if (arg == "recall") {
+      recall = true;
+    } else if (arg.compare(0, baseline_flag.size(), baseline_flag) == 0) {
+      baseline_period = std::strtoul(arg.c_str() + baseline_flag.size(), nullptr, 10);
+      if (baseline_period == 0) {
+        std::cerr << "The baseline is measured every 1 or more ticks" << std::endl;
+        return -1;
+      }
+    } else if (arg.compare(0, warm_up_flag.size(), warm_up_flag) == 0) {
+      warm_up_rounds = std::strtoul(arg.c_str() + warm_up_flag.size(), nullptr, 10);
+    } else if (arg.compare(0, allocation_free_flag.size(), allocation_free_flag) == 0) {
+      if (!ParseAllocationFree(arg.substr(allocation_free_flag.size()), allocation_free)) {
+        std::cerr << "Unknown stage in " << arg << std::endl;
+        return -1;
+      }
+    } else if (arg.compare(0, json_flag.size(), json_flag) == 0) {
+      json_path = arg.substr(json_flag.size());
+    } else if (arg.compare(0, csv_flag.size(), csv_flag) == 0) {
+      csv_path = arg.substr(csv_flag.size());
+    } else if (arg.compare(0, arrow_flag.size(), arrow_flag) == 0) {
+      arrow_path = arg.substr(arrow_flag.size());
+    } else if (arg.compare(0, problem_flag.size(), problem_flag) == 0) {
+      problem_path = arg.substr(problem_flag.size());
+    } else if (arg.compare(0, ticks_flag.size(), ticks_flag) == 0) {
+      ticks_path = arg.substr(ticks_flag.size());
+    } else if (arg.compare(0, kkt_flag.size(), kkt_flag) == 0) {
+      kkt_directory = arg.substr(kkt_flag.size());
+    } else if (arg.compare(0, kkt_keep_flag.size(), kkt_keep_flag) == 0) {
+      kkt_keep = std::strtoul(arg.c_str() + kkt_keep_flag.size(), nullptr, 10);
+    } else if (arg.compare(0, repeat_flag.size(), repeat_flag) == 0) {
+      repeat = std::strtoul(arg.c_str() + repeat_flag.size(), nullptr, 10);
+    } else if (arg.compare(0, log_flag.size(), log_flag) == 0) {
+      if (!ParseLogLevel(arg.c_str() + log_flag.size(), log_level)) {
+        std::cerr << "Unknown log level " << arg.c_str() + log_flag.size() << std::endl;
+        return -1;
+      }
+    } else {
+      paths.push_back(arg);
+    }
+  }
+  std::unique_ptr<KKTDump> kkt;
+  if (!kkt_directory.empty()) {
+    kkt.reset(new KKTDump(kkt_directory, kkt_keep));
+    if (!kkt->ok()) {
+      std::cerr << "Could not write the KKT systems to " << kkt_directory << std::endl;
+      return -1;
+    }
+  }
+  if (!problem_path.empty()) {
+    SetLogLevel(log_level);
+    return ReplayProblem(problem_path, repeat, warm_up_rounds, kkt.get());
+  }
+  if (!ticks_path.empty()) {
+    return PrintTickDump(ticks_path, arrow_path);
+  }
+  if (compress && !paths.empty()) {
+    return CompressSegments(paths);
+  }
+  if (paths.empty()) {
+    std::cerr << "Usage: " << argv[0] << " [N] [solver] <segment>... [paced] [blocked] "
+              << "[lintable] [floatfit] [recall] [baseline=<k>] [warmup=<rounds>] "
+              << "[allocfree=<stage>,...] [perf] [json=<path>] [csv=<path>] [arrow=<path>] "
+              << "[kkt=<dir>] [kktkeep=<n>] [log=<level>]" << std::endl
+              << "       " << argv[0] << " problem=<file> [repeat=<n>] [warmup=<rounds>] "
+              << "[kkt=<dir>] [kktkeep=<n>] [log=<level>]" << std::endl
+              << "       " << argv[0] << " ticks=<file> [arrow=<path>]" << std::endl
+              << "       " << argv[0] << " compress <segment>..." << std::endl;
+    return -1;
+  }
+  // The Cost lines of the backends would be timed too
+  SetLogLevel(log_level);
+  if (perf_counters && !OpenPerfCounters()) {
+    std::cerr << "No hardware counters, they need perf_event_paranoid at 2 or below and a PMU"
+              << std::endl;
+    return -1;
+  }
+  if (linearization_table) {
+    problem.linearization_table = std::make_shared<const LinearizationTable>();
+  }
+  // The backends that take the table, as the server allows it
+  const bool linearizes = solver == SolverBackend::kSQP || solver == SolverBackend::kSQPFloat ||
+                          solver == SolverBackend::kRTI || solver == SolverBackend::kADMM;
+
+  std::vector<Record> records;
+  for (const std::string &path : paths) {
+    std::unique_ptr<FlightReader> reader = FlightReader::Open(path);
+    if (!reader) {
+      std::cerr << "Could not read the flight records of " << path << std::endl;
+      return -1;
+    }
+    FlightRecordHeader header;
+    MessageView payload;
+    while (reader->Next(header, payload)) {
+      records.push_back(
+          {header, reader->header().pid, std::string(payload.begin(), payload.end())});
+    }
+  }
+  // The processes of a host share the steady clock
+  std::stable_sort(records.begin(), records.end(), [](const Record &a, const Record &b) {
+    return a.header.time_ns < b.header.time_ns;
+  });
+  if (records.empty()) {
+    std::cerr << "No records in the segments" << std::endl;
+    return -1;
+  }
+
+  std::map<std::pair<uint64_t, uint64_t>, std::unique_ptr<ReplaySession>> sessions;
+  StageHistograms stages;
+  StageEvents events;
+  LatencyHistogram ticks;
+  size_t malformed = 0;
+  size_t batches = 0;
+  size_t failed = 0;
+  size_t deadlines = 0;
+  uint64_t iterations = 0;
+  size_t compared = 0;
+  size_t unmatched = 0;
+  Difference steering;
+  Difference throttle;
+  std::array<CacheCounters, kCaches> caches;
+  std::array<StageAllocations, kTickStages> stage_allocations;
+  StageAllocations other_allocations;
+  StageAllocations tick_allocations;
+  size_t allocation_violations = 0;
+  // Every time of every stage and tick, in order, for the results files
+  std::array<std::vector<double>, kTickStages> stage_times;
+  std::vector<double> tick_times;
+  // The seconds of the stages of the tick being replayed
+  std::array<double, kTickStages> tick_stages;
+  const auto record_stage = [&stages, &stage_times, &tick_stages](TickStage stage,
+                                                                  double seconds) {
+    stages.Record(stage, seconds);
+    stage_times[static_cast<size_t>(stage)].push_back(seconds);
+    tick_stages[static_cast<size_t>(stage)] = seconds;
+  };
+  // With arrow, a row a tick: its record, the seconds of its stages and of
+  // the whole, its solve, its caches, its allocations and its command
+  std::unique_ptr<ArrowFileWriter> arrow;
+  if (!arrow_path.empty()) {
+    std::vector<ArrowColumn> columns = {{"pid", ArrowType::kUInt64},
+                                        {"session", ArrowType::kUInt64},
+                                        {"time_ns", ArrowType::kUInt64}};
+    for (size_t k = 0; k < kTickStages; k++) {
+      columns.push_back(
+          {std::string(TickStageName(static_cast<TickStage>(k))) + "_s", ArrowType::kFloat64});
+    }
+    const std::vector<ArrowColumn> solve_columns = {
+        {"tick_s", ArrowType::kFloat64},   {"iterations", ArrowType::kInt32},
+        {"restorations", ArrowType::kInt32}, {"cost", ArrowType::kFloat64},
+        {"status", ArrowType::kInt32},     {"start", ArrowType::kInt32},
+        {"failed", ArrowType::kBool},      {"deadline", ArrowType::kBool}};
+    columns.insert(columns.end(), solve_columns.begin(), solve_columns.end());
+    for (size_t k = 0; k < kCaches; k++) {
+      columns.push_back({std::string(CacheName(static_cast<Cache>(k))) + "_hit", ArrowType::kInt8});
+    }
+    const std::vector<ArrowColumn> command_columns = {{"allocations", ArrowType::kInt64},
+                                                      {"allocation_bytes", ArrowType::kInt64},
+                                                      {"steer", ArrowType::kFloat64},
+                                                      {"throttle", ArrowType::kFloat64}};
+    columns.insert(columns.end(), command_columns.begin(), command_columns.end());
+    arrow.reset(new ArrowFileWriter(arrow_path, columns));
+    if (!arrow->ok()) {
+      std::cerr << "Could not write the ticks to " << arrow_path << std::endl;
+      return -1;
+    }
+  }
+  const std::chrono::steady_clock::time_point first = SteadyTime(records.front().header.time_ns);
+  std::chrono::steady_clock::duration solving(0);
+  std::chrono::steady_clock::time_point replay_start;
+  for (const Record &record : records) {
+    const FlightRecordHeader &header = record.header;
+    const WireFormat format = static_cast<WireFormat>(header.format);
+    std::unique_ptr<ReplaySession> &made = sessions[std::make_pair(record.pid, header.session)];
+    if (!made) {
+      made.reset(new ReplaySession(format, float_fit));
+      made->mpc = MakeSolver(solver, problem);
+      if (!made->mpc) {
+        std::cerr << "No " << SolverBackendName(solver) << " MPC compiled for a horizon of "
+                  << problem.horizon << " timesteps"
+                  << (problem.move_blocking ? " with blocking" : "") << std::endl;
+        return -1;
+      }
+      if (warm_up_rounds > 0) {
+        WarmUp(*made->mpc, WarmUpScenarios(), warm_up_rounds);
+      }
+      if (recall) {
+        made->mpc->KeepSolutions(1024);
+      }
+      made->mpc->DumpKKT(kkt.get());
+    }
+    ReplaySession &session = *made;
+    const MessageView message(record.payload.data(), record.payload.size());
+
+    if (header.type == static_cast<uint16_t>(FlightRecordType::kCommand)) {
+      // The delay the server measured, for the next predictions, and the
+      // actuations it sent against those replayed
+      session.latency.Sent(SteadyTime(header.arrival_ns), SteadyTime(header.time_ns));
+      Actuation recorded;
+      const auto replayed = session.replayed.find(header.arrival_ns);
+      if (!ReadCommand(session.format, message, recorded) || replayed == session.replayed.end()) {
+        unmatched++;
+        continue;
+      }
+      steering.Add(replayed->second.steering_angle, recorded.steering_angle);
+      throttle.Add(replayed->second.throttle, recorded.throttle);
+      compared++;
+      session.replayed.erase(replayed);
+      continue;
+    }
+    if (header.type != static_cast<uint16_t>(FlightRecordType::kTelemetry)) {
+      continue;
+    }
+
+    if (paced) {
+      if (replay_start == std::chrono::steady_clock::time_point()) {
+        replay_start = std::chrono::steady_clock::now();
+      }
+      std::this_thread::sleep_until(replay_start + (SteadyTime(header.time_ns) - first));
+    }
+    const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    const PerfCounts started_events = ReadPerfCounters();
+    tick_stages.fill(0);
+    Telemetry &telemetry = session.telemetry;
+    const bool packed = session.format == WireFormat::kMessagePack;
+    const bool shared = session.format == WireFormat::kSharedMemory;
+    std::chrono::steady_clock::time_point decoded = started;
+    PerfCounts decoded_events = started_events;
+    bool parsed_ok = false;
+    BeginTickAllocations(packed || shared ? TickStage::kParse : TickStage::kDecode);
+    if (packed) {
+      parsed_ok = UnpackTelemetry(message, telemetry);
+    } else if (shared) {
+      parsed_ok = ReadSharedTelemetry(message, telemetry);
+    } else {
+      SocketIOFrame frame;
+      DecodeFrame(message, frame);
+      decoded = std::chrono::steady_clock::now();
+      decoded_events = ReadPerfCounters();
+      if (frame.event.equals("telemetry_batch")) {
+        EndTickAllocations();
+        batches++;
+        continue;
+      }
+      AllocationStage(TickStage::kParse);
+      record_stage(TickStage::kDecode, Seconds(decoded - started));
+      if (perf_counters) {
+        events.Add(TickStage::kDecode, decoded_events - started_events);
+      }
+      parsed_ok = ParseTelemetry(frame.data, telemetry);
+    }
+    if (!parsed_ok) {
+      EndTickAllocations();
+      malformed++;
+      continue;
+    }
+    const std::chrono::steady_clock::time_point parsed = std::chrono::steady_clock::now();
+    const PerfCounts parsed_events = ReadPerfCounters();
+    AllocationStage(TickStage::kFit);
+    const size_t fit_hits = session.reference_fit.hits();
+    const MPCCoeffs coeffs = session.reference_fit.Fit(telemetry.ptsx, telemetry.ptsy, telemetry.x,
+                                                       telemetry.y, telemetry.psi);
+    const std::chrono::steady_clock::time_point fitted = std::chrono::steady_clock::now();
+    const PerfCounts fitted_events = ReadPerfCounters();
+    AllocationStage(TickStage::kPredict);
+    MPCBase &mpc = *session.mpc;
+    const double prev_a = mpc.prev_a;
+    const MPCState state =
+        PredictState(telemetry.speed, telemetry.steering_angle, prev_a, polyeval(coeffs, 0),
+                     -atan(coeffs[1]), session.latency.latency());
+    const std::chrono::steady_clock::time_point predicted = std::chrono::steady_clock::now();
+    const PerfCounts predicted_events = ReadPerfCounters();
+    AllocationStage(TickStage::kSolve);
+    const MPCSolution result = mpc.Solve(state, coeffs);
+    const std::chrono::steady_clock::time_point solved = std::chrono::steady_clock::now();
+    const PerfCounts solved_events = ReadPerfCounters();
+    AllocationStage(TickStage::kSerialize);
+    const double steer_value = SteerCommand(result.delta[0]);
+    const double throttle_value = result.a[0];
+    mpc.prev_a = throttle_value;
+    // The reply with its lines, as the server writes it on the ticks that
+    // draw them
+    const size_t mpc_n = result.stages > 0 ? result.stages - 1 : 0;
+    const double *next_x = session.reference_fit.xs().data();
+    const double *next_y = session.reference_fit.ys().data();
+    const size_t next_n = session.reference_fit.xs().size();
+    const std::string &reply =
+        packed   ? session.steer_pack.Write(steer_value, throttle_value, result.x.data() + 1,
+                                            result.y.data() + 1, mpc_n, next_x, next_y, next_n)
+        : shared ? session.steer_record.Write(steer_value, throttle_value, result.x.data() + 1,
+                                              result.y.data() + 1, mpc_n, next_x, next_y, next_n)
+                 : session.steer_message.Write(steer_value, throttle_value, result.x.data() + 1,
+                                               result.y.data() + 1, mpc_n, next_x, next_y,
+                                               next_n);
+    const std::chrono::steady_clock::time_point serialized = std::chrono::steady_clock::now();
+    const PerfCounts serialized_events = ReadPerfCounters();
+    const TickAllocations allocations = EndTickAllocations();
+    Log(LogLevel::kDebug, "Replayed: {} bytes", reply.size());
+    session.replayed[header.time_ns] = {steer_value, throttle_value};
+
+    record_stage(TickStage::kParse, Seconds(parsed - decoded));
+    record_stage(TickStage::kFit, Seconds(fitted - parsed));
+    record_stage(TickStage::kPredict, Seconds(predicted - fitted));
+    record_stage(TickStage::kSolve, Seconds(solved - predicted));
+    const SolvePhases &phases = result.statistics.phases;
+    if (phases.model > 0 || phases.derivatives > 0 || phases.linear_solve > 0) {
+      record_stage(TickStage::kModel, phases.model);
+      record_stage(TickStage::kDerivatives, phases.derivatives);
+      record_stage(TickStage::kLinearSolve, phases.linear_solve);
+    }
+    record_stage(TickStage::kSerialize, Seconds(serialized - solved));
+    if (perf_counters) {
+      events.Add(TickStage::kParse, parsed_events - decoded_events);
+      events.Add(TickStage::kFit, fitted_events - parsed_events);
+      events.Add(TickStage::kPredict, predicted_events - fitted_events);
+      events.Add(TickStage::kSolve, solved_events - predicted_events);
+      if (phases.model > 0 || phases.derivatives > 0 || phases.linear_solve > 0) {
+        events.Add(TickStage::kModel, phases.model_events);
+        events.Add(TickStage::kDerivatives, phases.derivative_events);
+        events.Add(TickStage::kLinearSolve, phases.linear_solve_events);
+      }
+      events.Add(TickStage::kSerialize, serialized_events - solved_events);
+    }
+    ticks.Record(Seconds(serialized - started));
+    tick_times.push_back(Seconds(serialized - started));
+    solving += serialized - started;
+    iterations += result.statistics.iterations;
+    failed += result.status == SolveStatus::kFailed;
+    deadlines += result.status == SolveStatus::kDeadline;
+    for (size_t k = 0; k < kTickStages; k++) {
+      stage_allocations[k].Add(allocations.counts[k], allocations.bytes[k]);
+    }
+    other_allocations.Add(allocations.other_count, allocations.other_bytes);
+    tick_allocations.Add(allocations.TotalCount(), allocations.TotalBytes());
+    TickStage allocating;
+    const bool warming = session.ticks++ < kAllocationWarmTicks;
+    if (!warming && AllocationFreeViolation(allocations, allocation_free, allocating)) {
+      if (allocation_violations++ == 0) {
+        std::cerr << "Allocations in " << TickStageName(allocating) << " at the record of "
+                  << header.time_ns << " ns: " << allocations.count(allocating) << ", "
+                  << allocations.bytes_of(allocating) << " bytes" << std::endl;
+      }
+    }
+    TickCaches tick_caches;
+    tick_caches.fitted = true;
+    tick_caches.fit_hit = session.reference_fit.hits() > fit_hits;
+    tick_caches.fit_seconds = Seconds(fitted - parsed);
+    tick_caches.start = result.statistics.start;
+    tick_caches.recall = recall;
+    tick_caches.table = linearization_table && linearizes;
+    tick_caches.solve_seconds = Seconds(solved - predicted);
+    tick_caches.iterations = result.statistics.iterations;
+    tick_caches.prev_a = prev_a;
+    // Against the counts after, which caches the tick hit and missed
+    std::array<uint64_t, kCaches> hits_before;
+    std::array<uint64_t, kCaches> misses_before;
+    for (size_t k = 0; k < kCaches; k++) {
+      hits_before[k] = caches[k].hits();
+      misses_before[k] = caches[k].misses();
+    }
+    RecordTickCaches(tick_caches, caches);
+    if (arrow) {
+      size_t c = 0;
+      arrow->Append(c++, record.pid);
+      arrow->Append(c++, header.session);
+      arrow->Append(c++, header.time_ns);
+      for (size_t k = 0; k < kTickStages; k++) {
+        arrow->Append(c++, tick_stages[k]);
+      }
+      arrow->Append(c++, Seconds(serialized - started));
+      arrow->Append(c++, result.statistics.iterations);
+      arrow->Append(c++, result.statistics.restorations);
+      arrow->Append(c++, result.cost);
+      arrow->Append(c++, static_cast<int>(result.status));
+      arrow->Append(c++, static_cast<int>(result.statistics.start));
+      arrow->Append(c++, result.status == SolveStatus::kFailed);
+      arrow->Append(c++, result.status == SolveStatus::kDeadline);
+      for (size_t k = 0; k < kCaches; k++) {
+        arrow->Append(c++, caches[k].hits() > hits_before[k]
+                               ? 1
+                               : caches[k].misses() > misses_before[k] ? 0 : -1);
+      }
+      arrow->Append(c++, static_cast<uint64_t>(allocations.TotalCount()));
+      arrow->Append(c++, static_cast<uint64_t>(allocations.TotalBytes()));
+      arrow->Append(c++, steer_value);
+      arrow->Append(c++, throttle_value);
+      arrow->EndRow();
+    }
+    if (baseline_period > 0 && (session.ticks - 1) % baseline_period == 0) {
+      session.baseline.Measure(mpc, telemetry.ptsx, telemetry.ptsy, telemetry.x, telemetry.y,
+                               telemetry.psi, state, coeffs, tick_caches, caches);
+    }
+  }
+
+  const uint64_t n = ticks.count();
+  const double recorded = Seconds(SteadyTime(records.back().header.time_ns) - first);
+  std::cout << "Replayed " << n << " ticks of " << sessions.size() << " sessions, "
+            << recorded << " s of recording, with " << SolverBackendName(solver)
+            << (paced ? " at the recorded pace" : "") << std::endl;
+  if (n == 0) {
+    std::cerr << "No telemetry replayed (" << malformed << " malformed, " << batches
+              << " batches)" << std::endl;
+    return -1;
+  }
+  std::cout << std::fixed << std::setprecision(1) << n / Seconds(solving)
+            << " ticks/s of pipeline time" << std::endl
+            << std::endl;
+  std::cout << std::setw(14) << "stage" << std::setw(10) << "count" << std::setw(10) << "p50 ms"
+            << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << std::endl;
+  for (size_t k = 0; k < kTickStages; k++) {
+    const TickStage stage = static_cast<TickStage>(k);
+    if (stages[stage].count() > 0) {
+      PrintStage(TickStageName(stage), stages[stage]);
+    }
+  }
+  PrintStage("tick", ticks);
+  std::cout << std::endl
+            << std::setw(14) << "stage" << std::setw(10) << "allocs" << std::setw(10) << "max"
+            << std::setw(12) << "bytes" << std::endl;
+  for (size_t k = 0; k < kTickStages; k++) {
+    const TickStage stage = static_cast<TickStage>(k);
+    if (stages[stage].count() > 0) {
+      PrintAllocations(TickStageName(stage), stage_allocations[k], n);
+    }
+  }
+  PrintAllocations("other", other_allocations, n);
+  PrintAllocations("tick", tick_allocations, n);
+  const CppADPool pool = CppADPoolOfThread();
+  std::cout << "CppAD pool: " << pool.inuse / 1024 << " KiB in use, " << pool.available / 1024
+            << " KiB held" << std::endl;
+  if (perf_counters) {
+    std::cout << std::endl
+              << "IPC/cache misses/branch misses a tick: " << events.Summary() << std::endl;
+  }
+  std::cout << std::endl
+            << std::setprecision(2) << static_cast<double>(iterations) / n
+            << " iterations a solve, " << failed << " failed, " << deadlines
+            << " at their deadline" << std::endl;
+  PrintCaches(caches);
+  if (malformed > 0 || batches > 0) {
+    std::cout << malformed << " frames malformed, " << batches << " batches not replayed"
+              << std::endl;
+  }
+  std::cout << compared << " commands compared with those recorded, " << unmatched
+            << " without a replayed tick" << std::endl;
+  if (compared > 0) {
+    std::cout << std::setprecision(6) << "steering |d| mean " << steering.sum / compared
+              << ", max " << steering.max << std::endl
+              << "throttle |d| mean " << throttle.sum / compared << ", max " << throttle.max
+              << std::endl;
+  }
+  if (!json_path.empty() || !csv_path.empty()) {
+    std::vector<BenchResult> results;
+    for (size_t k = 0; k < kTickStages; k++) {
+      if (!stage_times[k].empty()) {
+        results.push_back(SummarizeTimes(
+            std::string("replay/") + TickStageName(static_cast<TickStage>(k)), stage_times[k]));
+      }
+    }
+    results.push_back(SummarizeTimes("replay/tick", tick_times));
+    results.back().counters["ticks_per_second"] = n / Seconds(solving);
+    results.back().counters["iterations"] = static_cast<double>(iterations) / n;
+    results.back().counters["failed"] = static_cast<double>(failed);
+    for (size_t k = 0; k < kCaches; k++) {
+      const CacheCounters &cache = caches[k];
+      const uint64_t lookups = cache.hits() + cache.misses();
+      if (lookups == 0) {
+        continue;
+      }
+      const std::string name = CacheName(static_cast<Cache>(k));
+      results.back().counters[name + "_hit_rate"] = static_cast<double>(cache.hits()) / lookups;
+      if (cache.baselines() > 0) {
+        results.back().counters[name + "_saved_ms"] =
+            cache.saved_seconds() * 1e3 / cache.baselines();
+        results.back().counters[name + "_saved_iterations"] =
+            cache.saved_iterations() / cache.baselines();
+      }
+    }
+    if (!json_path.empty() && !WriteBenchJSON(json_path, "mpc_replay", results)) {
+      std::cerr << "Could not write the results to " << json_path << std::endl;
+      return -1;
+    }
+    if (!csv_path.empty() && !WriteBenchCSV(csv_path, results)) {
+      std::cerr << "Could not write the results to " << csv_path << std::endl;
+      return -1;
+    }
+  }
+  if (arrow) {
+    if (!arrow->Close()) {
+      std::cerr << "Could not write the ticks to " << arrow_path << std::endl;
+      return -1;
+    }
+    std::cout << "Wrote " << arrow->rows() << " ticks to " << arrow_path << std::endl;
+  }
+  if (kkt) {
+    std::cout << "Wrote " << kkt->written() << " KKT systems to " << kkt_directory << std::endl;
+  }
+  if (allocation_violations > 0) {
+    std::cerr << allocation_violations << " ticks allocated in a stage that must not"
+              << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,999 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BenchResults.h"
+#include "ClosedLoop.h"
+#include "Cluster.h"
+#include "CppADThreads.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "NeuralPolicy.h"
+#include "Soak.h"
+#include "SolverBackend.h"
+#include "TrackSpline.h"
+#include "WarmUp.h"
+
+// Headless closed-loop simulator: the controller of main.cpp driving the
+// vehicle model around a track, in simulated time.
+//
+//   ./mpc_sim [N] [solver] [laps=<n>] [latency=<ms>] [tick=<ms>] [instances=<k>]
+//             [track=<csv>] [warmup=<rounds>] [log=<level>]
+//   ./mpc_sim sweep [solvers=<a,b,...>] [horizons=<n,m,...>] [speeds=<v,...>]
+//                   [laps=<n>] [json=<path>] [csv=<path>] [instances=<k>] ...
+//   ./mpc_sim montecarlo [N] [solver] [episodes=<n>] [seed=<n>] [threads=<n>]
+//                        [latencies=<ms,ms>] [noise=<scale>] [offset=<m>] [lf=<fraction>]
+//                        [episode=<k>] [json=<path>] [csv=<path>]
+//                        [samples=<path>] [policy=<path>]
+//                        [coordinator=<port> | worker=<host:port>] ...
+//   ./mpc_sim soak [N] [solver] [hours=<h> | duration=<s>] [interval=<s>]
+//                  [laps=<n>] [instances=<k>] [csv=<path>] ...
+//
+// The plant is the kinematic model the solvers plan with, integrated in
+// steps of 10 ms, and the controller the tick of the server (see
+// ClosedLoop.h). Every tick (100 ms by default) the plant sends its
+// telemetry and applies the actuations of the reply once the latency (100
+// ms by default) has passed. The solves take no simulated time, so the loop
+// runs as fast as they do.
+//
+// Each instance drives laps laps (1 by default) from its own start, spread
+// evenly along the track, on a thread and with a solver of its own. Each
+// reports its lap times, the distance of the car from the track, the
+// ticks and the solve cost of each tick; then the whole run reports the
+// distribution of the tick costs and how much faster than real time it ran.
+// An instance that leaves the track by more than kOffTrack, or takes more
+// than kMaxLapTime over a lap, stops there.
+//
+// sweep drives every backend (or those of solvers) and horizon (10, 15 and
+// 25, or those of horizons) at every reference speed of speeds (30 to 80
+// mph by tens, the v_ref of the cost) for laps laps (3 in a sweep) of each
+// instance, and prints a line for each: the laps completed of those asked,
+// the mean lap time, speed and distance from the track, the solves per
+// second per core, the ticks over the seconds the controller spent on them,
+// every instance being on a core of its own, and the median, 99th and
+// 99.9th percentiles and maximum of the tick costs, with the iterations a
+// tick and the failed solves. That is how fast the controller drives the
+// track and what it costs to; a speed it can't hold shows as laps short of
+// those asked. json and csv write them as the benchmarks
+// sim/<backend>/<horizon>/v<speed> of BenchResults.h, the tick costs timed
+// and the rest in the counters, for mpc_bench compare= to judge two runs.
+// The backends and horizons not compiled are listed at the end.
+//
+// montecarlo drives episodes episodes (1000) of laps laps each, spread
+// over threads threads (every core), each thread with a solver of its own
+// reset between its episodes. Every episode draws, from a generator seeded
+// with seed (1) and its number, its start along the track, its latency
+// (uniform between the two of latencies, 50 and 150 ms), how far its car
+// starts off the track (up to offset, 1 m, to either side) and turned from
+// it (up to a tenth of a radian a meter of offset), Lf of its plant (within
+// the fraction lf, 10%, of the model's) and the seed of the noise of its
+// sensors, whose standard deviations are noise (1) times 0.1 m, 0.01 rad
+// and 0.5 mph. So an episode drives the same whatever the threads, and
+// episode=<k> drives episode k alone again. The run prints the episodes
+// off the track or short of their laps, the median, 90th and 99th
+// percentiles and maximum over the episodes of their RMS and largest
+// distance from the track and of the lap times, the tails of the tick
+// costs of all of them, and the worst ten episodes with what they drew;
+// json and csv write it as the benchmark montecarlo/<backend>/<horizon>.
+// With coordinator, the episodes are driven by the workers of a cluster
+// that connect to port (see Cluster.h), each mpc_sim montecarlo started
+// with the same horizon, solver, seed, ranges, laps, tick, track and
+// warmup and worker=<host:port> of the coordinator, which reports once the
+// last episode is back.
+//
+// samples appends the problem and first actuations of every converged
+// solve of the episodes to path, for train_policy to distill into a
+// NeuralPolicy; policy drives the episodes by such a policy checked by the
+// solver, which solves when the check fails (see NeuralMPC), and reports
+// the ticks of the policy and the rate of fallbacks to the solver. With
+// both, the solves recorded are those the policy fell back on, the states
+// it drives into but doesn't know yet. Neither works with a cluster.
+//
+// soak is a soak of the solvers in this process (see Soak.h; mpc_loadgen
+// soaks the server): for duration s (an hour) each instance, on a thread
+// of its own, makes a solver, warms it up, drives laps laps with it from
+// its start and destroys it, over and over, as the sessions of the server
+// come and go. Every interval s (60) it prints a line of the resident set
+// of the process, the heap of its malloc and how fragmented it is, the
+// CppAD pools of the instances as of their last solver destroyed, the
+// solvers made so far, and the median, 99th and 99.9th percentiles of the
+// ticks of the drives that ended in the interval, written to csv as well;
+// then the quantities that drifted, and exits with 1 if any did.
+
+namespace {
+
+// The horizons and reference speeds of a sweep, and its laps
+const size_t kSweepHorizons[] = {10, 15, 25};
+const double kSweepSpeeds[] = {30, 40, 50, 60, 70, 80};
+const size_t kSweepLaps = 3;
+
+std::vector<std::string> Split(const std::string &list) {
+  std::vector<std::string> items;
+  std::istringstream in(list);
+  std::string item;
+  while (std::getline(in, item, ',')) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+// One line of a sweep, and its benchmark into results
+void ReportSweep(const std::string &name, double speed, const SimOptions &options,
+                 const std::vector<SimReport> &reports, std::vector<BenchResult> &results) {
+  size_t laps = 0;
+  size_t ticks = 0;
+  double lap_time = 0;
+  double error_squares = 0;
+  double speed_sum = 0;
+  double solve_seconds = 0;
+  uint64_t iterations = 0;
+  size_t failed = 0;
+  std::vector<double> times;
+  for (const SimReport &report : reports) {
+    laps += report.lap_times.size();
+    for (double lap : report.lap_times) {
+      lap_time += lap;
+    }
+    ticks += report.ticks;
+    error_squares += report.error_squares;
+    speed_sum += report.speed_sum;
+    solve_seconds += report.solve_seconds;
+    iterations += report.iterations;
+    failed += report.failed;
+    times.insert(times.end(), report.tick_seconds.begin(), report.tick_seconds.end());
+  }
+  BenchResult result = SummarizeTimes(name, times);
+  const double n = static_cast<double>(std::max<size_t>(ticks, 1));
+  std::vector<double> sorted(times);
+  std::sort(sorted.begin(), sorted.end());
+  const double p999 =
+      sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, sorted.size() * 999 / 1000)];
+  result.counters["ref_v"] = speed;
+  result.counters["laps"] = static_cast<double>(options.laps * reports.size());
+  result.counters["laps_completed"] = static_cast<double>(laps);
+  result.counters["lap_s"] = laps > 0 ? lap_time / laps : 0;
+  result.counters["speed"] = speed_sum / n;
+  result.counters["rms_m"] = std::sqrt(error_squares / n);
+  result.counters["solves_per_core_s"] = solve_seconds > 0 ? ticks / solve_seconds : 0;
+  result.counters["p999"] = p999;
+  result.counters["iterations"] = iterations / n;
+  result.counters["failed"] = static_cast<double>(failed);
+  std::cout << std::left << std::setw(24) << name << std::right << std::setw(6) << laps << "/"
+            << std::left << std::setw(4) << options.laps * reports.size() << std::right
+            << std::fixed << std::setprecision(1) << std::setw(8) << result.counters["lap_s"]
+            << std::setw(8) << result.counters["speed"] << std::setprecision(3) << std::setw(8)
+            << result.counters["rms_m"] << std::setprecision(0) << std::setw(12)
+            << result.counters["solves_per_core_s"] << std::setprecision(3) << std::setw(9)
+            << result.p50 * 1e3 << std::setw(9) << result.p99 * 1e3 << std::setw(9)
+            << p999 * 1e3 << std::setw(9) << result.max * 1e3 << std::setprecision(1)
+            << std::setw(7) << result.counters["iterations"] << std::setw(8) << failed
+            << std::endl;
+  results.push_back(result);
+}
+
+// The ranges a Monte Carlo episode draws its latency (s), the scale of the
+// noise of its sensors, the largest offset of its start from the track (m)
+// and the largest mismatch of Lf of its plant, as a fraction of the model's
+struct MonteCarloRanges {
+  double latency_min = 0.05;
+  double latency_max = 0.15;
+  double noise = 1;
+  double offset = 1;
+  double lf = 0.1;
+};
+
+// The standard deviations of the noise on the position (m), heading (rad)
+// and speed of the telemetry at a noise of 1, and the largest heading of
+// the start, in rad for each m of offset
+const double kPositionNoise = 0.1;
+const double kHeadingNoise = 0.01;
+const double kSpeedNoise = 0.5;
+const double kHeadingPerOffset = 0.1;
+
+// A Monte Carlo episode: what it drew and how it drove
+struct MonteCarloEpisode {
+  size_t index = 0;
+  double start = 0;
+  SimOptions options;
+  SimReport report;
+};
+
+// The draws of episode index of the run of seed, from a generator seeded
+// with both, so that an episode draws the same whichever thread drives it
+// and in whatever order
+void DrawEpisode(const MonteCarloRanges &ranges, uint64_t seed, size_t index, double length,
+                 const SimOptions &base, MonteCarloEpisode &episode) {
+  std::seed_seq seeds{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32),
+                      static_cast<uint32_t>(index), static_cast<uint32_t>(uint64_t(index) >> 32)};
+  std::mt19937_64 random(seeds);
+  std::uniform_real_distribution<double> uniform(-1, 1);
+  const auto between = [&](double low, double high) {
+    return low + (high - low) * (uniform(random) + 1) / 2;
+  };
+  episode.index = index;
+  episode.options = base;
+  episode.start = between(0, length);
+  episode.options.latency = between(ranges.latency_min, ranges.latency_max);
+  episode.options.position_noise = kPositionNoise * ranges.noise;
+  episode.options.heading_noise = kHeadingNoise * ranges.noise;
+  episode.options.speed_noise = kSpeedNoise * ranges.noise;
+  episode.options.lateral_offset = ranges.offset * uniform(random);
+  episode.options.heading_offset = kHeadingPerOffset * ranges.offset * uniform(random);
+  episode.options.lf = Lf * (1 + ranges.lf * uniform(random));
+  episode.options.seed = random();
+}
+
+// The solver of an episode, whose converged solves are kept as samples of
+// a NeuralPolicy
+class SampledMPC : public MPCBase {
+public:
+  SampledMPC(std::unique_ptr<MPCBase> mpc, PolicySamples &samples)
+      : mpc_(std::move(mpc)), samples_(samples) {}
+
+  MPCSolution Solve(const MPCState &state, const MPCCoeffs &coeffs) override {
+    mpc_->prev_a = prev_a;
+    mpc_->max_solve_time = max_solve_time;
+    mpc_->cost_schedule = cost_schedule;
+    const MPCSolution result = mpc_->Solve(state, coeffs);
+    status_ = mpc_->status();
+    cost_ = mpc_->cost();
+    iterations_ = mpc_->iterations();
+    if (status_ == SolveStatus::kSolved) {
+      PolicySample sample;
+      sample.state = state;
+      sample.coeffs = coeffs;
+      sample.delta = result.delta[0];
+      sample.a = result.a[0];
+      samples_.push_back(sample);
+    }
+    return result;
+  }
+
+  void Prepare() override { mpc_->Prepare(); }
+  void Reset() override { mpc_->Reset(); }
+
+  size_t horizon_length() const override { return mpc_->horizon_length(); }
+  double timestep() const override { return mpc_->timestep(); }
+  double stage_time(size_t t) const override { return mpc_->stage_time(t); }
+
+  MPCState planned_state(size_t t) const override { return mpc_->planned_state(t); }
+  void planned_actuations(size_t t, double &delta, double &a) const override {
+    mpc_->planned_actuations(t, delta, a);
+  }
+
+private:
+  std::unique_ptr<MPCBase> mpc_;
+  PolicySamples &samples_;
+};
+
+// What a Monte Carlo run distills (see NeuralPolicy.h): whether it records
+// samples, and those of every thread; the policy driving in place of the
+// solver, and the ticks it drove and fell back on over every thread
+struct Distillation {
+  bool record = false;
+  std::shared_ptr<const NeuralPolicy> policy;
+  std::mutex lock;
+  PolicySamples samples;
+  size_t policy_ticks = 0;
+  size_t fallbacks = 0;
+};
+
+// Drive episodes on threads threads, the calling one the first, each with
+// a solver of backend for problem made and warmed up on its thread and
+// reset between its episodes, recording its samples or under the policy of
+// distillation, the cost of every tick into ticks; false if backend isn't
+// compiled for problem
+bool DriveMonteCarlo(const TrackSpline &track, const std::vector<double> &xs,
+                     const std::vector<double> &ys, SolverBackend backend,
+                     const MPCProblem &problem, size_t warm_up_rounds, size_t threads,
+                     std::vector<MonteCarloEpisode> &episodes, LatencyHistogram &ticks,
+                     Distillation &distillation) {
+  std::atomic<size_t> next(0);
+  std::atomic<bool> made(true);
+  const auto run = [&] {
+    std::unique_ptr<MPCBase> mpc = MakeSolver(backend, problem);
+    if (!mpc) {
+      made = false;
+      return;
+    }
+    if (warm_up_rounds > 0) {
+      WarmUp(*mpc, WarmUpScenarios(), warm_up_rounds);
+    }
+    PolicySamples samples;
+    if (distillation.record) {
+      mpc.reset(new SampledMPC(std::move(mpc), samples));
+    }
+    NeuralMPC *neural_mpc = nullptr;
+    if (distillation.policy) {
+      neural_mpc = new NeuralMPC(std::move(mpc), distillation.policy, PolicyMode::kChecked);
+      mpc.reset(neural_mpc);
+    }
+    for (size_t i = next++; i < episodes.size(); i = next++) {
+      MonteCarloEpisode &episode = episodes[i];
+      mpc->Reset();
+      Drive(track, xs, ys, *mpc, episode.options, episode.start, episode.report, ticks);
+    }
+    std::lock_guard<std::mutex> guard(distillation.lock);
+    distillation.samples.insert(distillation.samples.end(), samples.begin(), samples.end());
+    if (neural_mpc != nullptr) {
+      distillation.policy_ticks += neural_mpc->policy_ticks();
+      distillation.fallbacks += neural_mpc->fallbacks();
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t k = 1; k < threads; k++) {
+    workers.push_back(std::thread([&run] {
+      CppADThread cppad_thread;
+      run();
+    }));
+  }
+  run();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  return made;
+}
+
+// The q quantile of values, sorted
+double SortedQuantile(const std::vector<double> &values, double q) {
+  if (values.empty()) {
+    return 0;
+  }
+  return values[std::min(values.size() - 1, static_cast<size_t>(values.size() * q))];
+}
+
+// The distributions of a Monte Carlo run, with its worst episodes, and its
+// benchmark into results
+void ReportMonteCarlo(const std::string &name, const SimOptions &options,
+                      const std::vector<MonteCarloEpisode> &episodes,
+                      const LatencyHistogram &ticks, double wall,
+                      std::vector<BenchResult> &results) {
+  std::vector<double> rms;
+  std::vector<double> max;
+  std::vector<double> laps;
+  std::vector<double> times;
+  std::vector<const MonteCarloEpisode *> worst;
+  size_t off_track = 0;
+  size_t short_laps = 0;
+  size_t failed = 0;
+  double simulated = 0;
+  for (const MonteCarloEpisode &episode : episodes) {
+    const SimReport &report = episode.report;
+    const double n = static_cast<double>(std::max<size_t>(report.ticks, 1));
+    rms.push_back(std::sqrt(report.error_squares / n));
+    max.push_back(report.error_max);
+    for (double lap : report.lap_times) {
+      laps.push_back(lap);
+    }
+    times.insert(times.end(), report.tick_seconds.begin(), report.tick_seconds.end());
+    off_track += report.off_track;
+    short_laps += !report.off_track && report.lap_times.size() < options.laps;
+    failed += report.failed;
+    simulated += report.seconds;
+    worst.push_back(&episode);
+  }
+  std::sort(rms.begin(), rms.end());
+  std::sort(max.begin(), max.end());
+  std::sort(laps.begin(), laps.end());
+  // Off the track first, then by the distance from it
+  std::sort(worst.begin(), worst.end(),
+            [](const MonteCarloEpisode *a, const MonteCarloEpisode *b) {
+              if (a->report.off_track != b->report.off_track) {
+                return a->report.off_track;
+              }
+              return a->report.error_max > b->report.error_max;
+            });
+  worst.resize(std::min<size_t>(worst.size(), 10));
+
+  std::cout << name << ": " << episodes.size() << " episodes, " << off_track
+            << " off the track, " << short_laps << " short of their laps, " << failed
+            << " failed solves" << std::endl
+            << std::endl
+            << std::left << std::setw(10) << "" << std::right << std::setw(9) << "p50"
+            << std::setw(9) << "p90" << std::setw(9) << "p99" << std::setw(9) << "max"
+            << std::endl;
+  const auto row = [](const char *label, const std::vector<double> &values, double scale) {
+    std::cout << std::left << std::setw(10) << label << std::right << std::fixed
+              << std::setprecision(3);
+    for (double q : {0.5, 0.9, 0.99, 1.0}) {
+      std::cout << std::setw(9) << SortedQuantile(values, q) * scale;
+    }
+    std::cout << std::endl;
+  };
+  row("rms m", rms, 1);
+  row("max m", max, 1);
+  row("lap s", laps, 1);
+  std::cout << std::endl
+            << "Ticks: p50 " << ticks.Quantile(0.5) * 1e3 << " ms, p99 "
+            << ticks.Quantile(0.99) * 1e3 << " ms, p99.9 " << ticks.Quantile(0.999) * 1e3
+            << " ms, max " << ticks.max() * 1e3 << " ms" << std::endl
+            << std::setprecision(1) << simulated << " s simulated in " << wall << " s, "
+            << simulated / wall << "x real time" << std::endl
+            << std::endl
+            << "Worst episodes (episode=<k> to drive one again):" << std::endl
+            << std::setw(8) << "episode" << std::setw(10) << "start m" << std::setw(12)
+            << "latency ms" << std::setw(10) << "offset m" << std::setw(12) << "heading rad"
+            << std::setw(8) << "lf m" << std::setw(8) << "laps" << std::setw(9) << "rms m"
+            << std::setw(9) << "max m" << std::endl;
+  for (const MonteCarloEpisode *episode : worst) {
+    const SimReport &report = episode->report;
+    const double n = static_cast<double>(std::max<size_t>(report.ticks, 1));
+    std::cout << std::setw(8) << episode->index << std::setprecision(1) << std::setw(10)
+              << episode->start << std::setw(12) << episode->options.latency * 1e3
+              << std::setprecision(2) << std::setw(10) << episode->options.lateral_offset
+              << std::setprecision(3) << std::setw(12) << episode->options.heading_offset
+              << std::setprecision(2) << std::setw(8) << episode->options.lf << std::setw(8)
+              << report.lap_times.size() << std::setprecision(3) << std::setw(9)
+              << std::sqrt(report.error_squares / n) << std::setw(9) << report.error_max
+              << (report.off_track ? "  off the track" : "") << std::endl;
+  }
+
+  BenchResult result = SummarizeTimes(name, times);
+  result.counters["episodes"] = static_cast<double>(episodes.size());
+  result.counters["off_track"] = static_cast<double>(off_track);
+  result.counters["short"] = static_cast<double>(short_laps);
+  result.counters["failed"] = static_cast<double>(failed);
+  result.counters["rms_m_p50"] = SortedQuantile(rms, 0.5);
+  result.counters["rms_m_p99"] = SortedQuantile(rms, 0.99);
+  result.counters["max_m_p50"] = SortedQuantile(max, 0.5);
+  result.counters["max_m_p99"] = SortedQuantile(max, 0.99);
+  result.counters["max_m"] = SortedQuantile(max, 1);
+  result.counters["p999"] = ticks.Quantile(0.999);
+  results.push_back(result);
+}
+
+// The soak of the solvers of backend for problem by instances threads for
+// duration s, sampled every interval s into log; false if backend isn't
+// compiled for problem
+bool Soak(const TrackSpline &track, const std::vector<double> &xs, const std::vector<double> &ys,
+          SolverBackend backend, const MPCProblem &problem, const SimOptions &options,
+          size_t instances, size_t warm_up_rounds, double duration, double interval,
+          SoakLog &log) {
+  std::atomic<bool> stop{false};
+  std::atomic<bool> made{true};
+  // Of the drives since the last sample, and of every instance as of its
+  // last solver destroyed
+  std::mutex mutex;
+  std::unique_ptr<LatencyHistogram> window(new LatencyHistogram());
+  std::vector<CppADPool> pools(instances, CppADPool{0, 0});
+  uint64_t churned = 0;
+  size_t off_track = 0;
+  std::vector<std::thread> threads;
+  for (size_t k = 0; k < instances; k++) {
+    threads.push_back(std::thread([&, k] {
+      CppADThread cppad_thread;
+      while (!stop.load(std::memory_order_relaxed)) {
+        std::unique_ptr<MPCBase> mpc = MakeSolver(backend, problem);
+        if (!mpc) {
+          made = false;
+          stop = true;
+          return;
+        }
+        if (warm_up_rounds > 0) {
+          WarmUp(*mpc, WarmUpScenarios(), warm_up_rounds);
+        }
+        SimReport report;
+        LatencyHistogram ticks;
+        Drive(track, xs, ys, *mpc, options, track.length() * k / instances, report, ticks);
+        mpc.reset();
+        std::lock_guard<std::mutex> lock(mutex);
+        for (double tick : report.tick_seconds) {
+          window->Record(tick);
+        }
+        pools[k] = CppADPoolOfThread();
+        churned++;
+        off_track += report.off_track;
+      }
+    }));
+  }
+
+  const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+  const std::chrono::steady_clock::duration every =
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(interval));
+  const std::chrono::steady_clock::time_point end =
+      started + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(duration));
+  for (std::chrono::steady_clock::time_point next = started + every;
+       next <= end && !stop.load(std::memory_order_relaxed); next += every) {
+    std::this_thread::sleep_until(next);
+    SoakSample sample;
+    std::unique_ptr<LatencyHistogram> ended(new LatencyHistogram());
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      window.swap(ended);
+      for (const CppADPool &pool : pools) {
+        sample.cppad_inuse += pool.inuse;
+        sample.cppad_available += pool.available;
+      }
+      sample.churned = churned;
+    }
+    ReadProcessMemory(sample.memory);
+    sample.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started)
+                         .count();
+    sample.sessions = static_cast<double>(instances);
+    sample.ticks = ended->count();
+    sample.p50 = ended->Quantile(0.5);
+    sample.p99 = ended->Quantile(0.99);
+    sample.p999 = ended->Quantile(0.999);
+    log.Add(sample);
+  }
+  stop = true;
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  if (off_track > 0) {
+    std::cout << off_track << " drives of " << churned << " left the track" << std::endl;
+  }
+  return made;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const bool sweep = argc > 1 && std::string(argv[1]) == "sweep";
+  const bool monte_carlo = argc > 1 && std::string(argv[1]) == "montecarlo";
+  const bool soak = argc > 1 && std::string(argv[1]) == "soak";
+  // The horizon and solver, after montecarlo in a Monte Carlo run and soak
+  // in a soak
+  const int positional = monte_carlo || soak ? 2 : 1;
+  MPCProblem problem;
+  SolverBackend solver = SolverBackend::kIpopt;
+  if (!sweep) {
+    problem.horizon = argc > positional ? std::strtoul(argv[positional], nullptr, 10) : 15;
+    if (argc > positional + 1 && !ParseSolverBackend(argv[positional + 1], solver)) {
+      std::cerr << "Unknown solver " << argv[positional + 1] << std::endl;
+      return -1;
+    }
+  }
+  SimOptions options;
+  bool laps_given = false;
+  size_t instances = 1;
+  size_t warm_up_rounds = 1;
+  std::string track_path = "lake_track_waypoints.csv";
+  LogLevel log_level = LogLevel::kWarning;
+  std::vector<SolverBackend> solvers(std::begin(kSolverBackends), std::end(kSolverBackends));
+  std::vector<size_t> horizons(std::begin(kSweepHorizons), std::end(kSweepHorizons));
+  std::vector<double> speeds(std::begin(kSweepSpeeds), std::end(kSweepSpeeds));
+  std::string json_path;
+  std::string csv_path;
+  MonteCarloRanges ranges;
+  size_t episodes = 1000;
+  size_t first_episode = 0;
+  uint64_t seed = 1;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  unsigned long coordinator_port = 0;
+  std::string coordinator_address;
+  std::string samples_path;
+  std::string policy_path;
+  double soak_duration = 3600;
+  double soak_interval = 60;
+  for (int i = sweep ? 2 : positional + 2; i < argc; i++) {
+    const std::string arg = argv[i];
+    const std::string solvers_flag = "solvers=";
+    const std::string horizons_flag = "horizons=";
+    const std::string speeds_flag = "speeds=";
+    const std::string json_flag = "json=";
+    const std::string csv_flag = "csv=";
+    const std::string laps_flag = "laps=";
+    const std::string latency_flag = "latency=";
+    const std::string tick_flag = "tick=";
+    const std::string instances_flag = "instances=";
+    const std::string track_flag = "track=";
+    const std::string warm_up_flag = "warmup=";
+    const std::string log_flag = "log=";
+    const std::string episodes_flag = "episodes=";
+    const std::string episode_flag = "episode=";
+    const std::string seed_flag = "seed=";
+    const std::string threads_flag = "threads=";
+    const std::string latencies_flag = "latencies=";
+    const std::string noise_flag = "noise=";
+    const std::string offset_flag = "offset=";
+    const std::string lf_flag = "lf=";
+    const std::string coordinator_flag = "coordinator=";
+    const std::string worker_flag = "worker=";
+    const std::string samples_flag = "samples=";
+    const std::string policy_flag = "policy=";
+    const std::string hours_flag = "hours=";
+    const std::string duration_flag = "duration=";
+    const std::string interval_flag = "interval=";
+    if (sweep && arg.compare(0, solvers_flag.size(), solvers_flag) == 0) {
+      solvers.clear();
+      for (const std::string &name : Split(arg.substr(solvers_flag.size()))) {
+        SolverBackend backend;
+        if (!ParseSolverBackend(name, backend)) {
+          std::cerr << "Unknown solver " << name << std::endl;
+          return -1;
+        }
+        solvers.push_back(backend);
+      }
+    } else if (sweep && arg.compare(0, horizons_flag.size(), horizons_flag) == 0) {
+      horizons.clear();
+      for (const std::string &horizon : Split(arg.substr(horizons_flag.size()))) {
+        horizons.push_back(std::strtoul(horizon.c_str(), nullptr, 10));
+      }
+    } else if (sweep && arg.compare(0, speeds_flag.size(), speeds_flag) == 0) {
+      speeds.clear();
+      for (const std::string &speed : Split(arg.substr(speeds_flag.size()))) {
+        speeds.push_back(std::strtod(speed.c_str(), nullptr));
+      }
+    } else if ((sweep || monte_carlo) && arg.compare(0, json_flag.size(), json_flag) == 0) {
+      json_path = arg.substr(json_flag.size());
+    } else if ((sweep || monte_carlo || soak) &&
+               arg.compare(0, csv_flag.size(), csv_flag) == 0) {
+      csv_path = arg.substr(csv_flag.size());
+    } else if (monte_carlo && arg.compare(0, episodes_flag.size(), episodes_flag) == 0) {
+      episodes = std::strtoul(arg.c_str() + episodes_flag.size(), nullptr, 10);
+    } else if (monte_carlo && arg.compare(0, episode_flag.size(), episode_flag) == 0) {
+      first_episode = std::strtoul(arg.c_str() + episode_flag.size(), nullptr, 10);
+      episodes = 1;
+    } else if (monte_carlo && arg.compare(0, seed_flag.size(), seed_flag) == 0) {
+      seed = std::strtoull(arg.c_str() + seed_flag.size(), nullptr, 10);
+    } else if (monte_carlo && arg.compare(0, threads_flag.size(), threads_flag) == 0) {
+      threads = std::strtoul(arg.c_str() + threads_flag.size(), nullptr, 10);
+    } else if (monte_carlo && arg.compare(0, latencies_flag.size(), latencies_flag) == 0) {
+      const std::vector<std::string> bounds = Split(arg.substr(latencies_flag.size()));
+      if (bounds.size() != 2) {
+        std::cerr << "latencies= takes the least and the most, in ms" << std::endl;
+        return -1;
+      }
+      ranges.latency_min = std::strtod(bounds[0].c_str(), nullptr) * 1e-3;
+      ranges.latency_max = std::strtod(bounds[1].c_str(), nullptr) * 1e-3;
+    } else if (monte_carlo && arg.compare(0, noise_flag.size(), noise_flag) == 0) {
+      ranges.noise = std::strtod(arg.c_str() + noise_flag.size(), nullptr);
+    } else if (monte_carlo && arg.compare(0, offset_flag.size(), offset_flag) == 0) {
+      ranges.offset = std::strtod(arg.c_str() + offset_flag.size(), nullptr);
+    } else if (monte_carlo && arg.compare(0, lf_flag.size(), lf_flag) == 0) {
+      ranges.lf = std::strtod(arg.c_str() + lf_flag.size(), nullptr);
+    } else if (monte_carlo && arg.compare(0, coordinator_flag.size(), coordinator_flag) == 0) {
+      coordinator_port = std::strtoul(arg.c_str() + coordinator_flag.size(), nullptr, 10);
+      if (coordinator_port == 0 || coordinator_port > 65535) {
+        std::cerr << "coordinator= takes a port" << std::endl;
+        return -1;
+      }
+    } else if (monte_carlo && arg.compare(0, worker_flag.size(), worker_flag) == 0) {
+      coordinator_address = arg.substr(worker_flag.size());
+    } else if (monte_carlo && arg.compare(0, samples_flag.size(), samples_flag) == 0) {
+      samples_path = arg.substr(samples_flag.size());
+    } else if (monte_carlo && arg.compare(0, policy_flag.size(), policy_flag) == 0) {
+      policy_path = arg.substr(policy_flag.size());
+    } else if (soak && arg.compare(0, hours_flag.size(), hours_flag) == 0) {
+      soak_duration = std::strtod(arg.c_str() + hours_flag.size(), nullptr) * 3600;
+    } else if (soak && arg.compare(0, duration_flag.size(), duration_flag) == 0) {
+      soak_duration = std::strtod(arg.c_str() + duration_flag.size(), nullptr);
+    } else if (soak && arg.compare(0, interval_flag.size(), interval_flag) == 0) {
+      soak_interval = std::strtod(arg.c_str() + interval_flag.size(), nullptr);
+    } else if (arg.compare(0, laps_flag.size(), laps_flag) == 0) {
+      options.laps = std::strtoul(arg.c_str() + laps_flag.size(), nullptr, 10);
+      laps_given = true;
+    } else if (arg.compare(0, latency_flag.size(), latency_flag) == 0) {
+      options.latency = std::strtod(arg.c_str() + latency_flag.size(), nullptr) * 1e-3;
+    } else if (arg.compare(0, tick_flag.size(), tick_flag) == 0) {
+      options.tick = std::strtod(arg.c_str() + tick_flag.size(), nullptr) * 1e-3;
+    } else if (arg.compare(0, instances_flag.size(), instances_flag) == 0) {
+      instances = std::strtoul(arg.c_str() + instances_flag.size(), nullptr, 10);
+    } else if (arg.compare(0, track_flag.size(), track_flag) == 0) {
+      track_path = arg.substr(track_flag.size());
+    } else if (arg.compare(0, warm_up_flag.size(), warm_up_flag) == 0) {
+      warm_up_rounds = std::strtoul(arg.c_str() + warm_up_flag.size(), nullptr, 10);
+    } else if (arg.compare(0, log_flag.size(), log_flag) == 0) {
+      if (!ParseLogLevel(arg.c_str() + log_flag.size(), log_level)) {
+        std::cerr << "Unknown log level " << arg.c_str() + log_flag.size() << std::endl;
+        return -1;
+      }
+    } else {
+      std::cerr << "Unknown argument " << arg << std::endl;
+      return -1;
+    }
+  }
+  if (sweep && !laps_given) {
+    options.laps = kSweepLaps;
+  }
+  if (options.laps == 0 || instances == 0) {
+    std::cerr << "Drive a lap and an instance at least" << std::endl;
+    return -1;
+  }
+  if (monte_carlo && (episodes == 0 || threads == 0)) {
+    std::cerr << "Drive an episode on a thread at least" << std::endl;
+    return -1;
+  }
+  if (monte_carlo && (ranges.latency_min < 0 || ranges.latency_max < ranges.latency_min ||
+                      ranges.noise < 0 || ranges.lf < 0 || ranges.lf >= 1)) {
+    std::cerr << "The latencies are 0 ms or more, the noise 0 or more and lf below 1"
+              << std::endl;
+    return -1;
+  }
+  if (soak && (soak_duration <= 0 || soak_interval <= 0)) {
+    std::cerr << "The duration and interval of a soak are more than 0" << std::endl;
+    return -1;
+  }
+  if ((!samples_path.empty() || !policy_path.empty()) &&
+      (coordinator_port != 0 || !coordinator_address.empty())) {
+    std::cerr << "samples and policy don't work with a cluster" << std::endl;
+    return -1;
+  }
+  Distillation distillation;
+  distillation.record = !samples_path.empty();
+  if (!policy_path.empty()) {
+    distillation.policy = NeuralPolicy::Load(policy_path);
+    if (!distillation.policy) {
+      std::cerr << "Could not load the policy " << policy_path << std::endl;
+      return -1;
+    }
+  }
+  if (options.latency < 0 || options.tick < kPlantStep) {
+    std::cerr << "The latency is 0 ms or more and the tick 10 ms or more" << std::endl;
+    return -1;
+  }
+  // The Cost lines of the backends would be timed too
+  SetLogLevel(log_level);
+
+  std::vector<double> xs;
+  std::vector<double> ys;
+  if (!TrackSpline::Load(track_path, xs, ys) || xs.size() < kTelemetryWaypoints) {
+    std::cerr << "Could not read the waypoints of " << track_path << std::endl;
+    return -1;
+  }
+  const TrackSpline track(xs, ys);
+  // A thread number in CppAD for every instance, this thread the first
+  if (monte_carlo && !coordinator_address.empty()) {
+    // Its threads all drive, this one reads and writes the socket
+    if (SetupCppADThreads(threads + 1) < threads + 1) {
+      threads = SetupCppADThreads(threads + 1) - 1;
+    }
+  } else if (monte_carlo) {
+    threads = std::min(threads, episodes);
+    if (threads > 1 && SetupCppADThreads(threads) < threads) {
+      threads = SetupCppADThreads(threads);
+    }
+  } else if (soak) {
+    // Its instances all drive, this thread samples
+    if (SetupCppADThreads(instances + 1) < instances + 1) {
+      std::cerr << "CppAD takes at most " << SetupCppADThreads(instances + 1) - 1
+                << " instances in a soak" << std::endl;
+      return -1;
+    }
+  } else if (instances > 1 && SetupCppADThreads(instances) < instances) {
+    std::cerr << "CppAD takes at most " << SetupCppADThreads(instances) << " instances"
+              << std::endl;
+    return -1;
+  }
+
+  if (monte_carlo) {
+    // What every episode depends on but its number, for the workers of a
+    // cluster to drive them the same as this process would
+    std::ostringstream job;
+    job << std::setprecision(17) << "mpc_sim montecarlo " << SolverBackendName(solver) << " "
+        << problem.horizon << " laps=" << options.laps << " tick=" << options.tick
+        << " track=" << track_path << " warmup=" << warm_up_rounds << " seed=" << seed
+        << " latencies=" << ranges.latency_min << "," << ranges.latency_max
+        << " noise=" << ranges.noise << " offset=" << ranges.offset << " lf=" << ranges.lf;
+    if (!coordinator_address.empty()) {
+      // A solver for each thread, made with its first episode
+      const auto make_work = [&] {
+        std::shared_ptr<MPCBase> mpc;
+        return ClusterWork([&, mpc](const std::string &item) mutable {
+          if (!mpc) {
+            mpc = MakeSolver(solver, problem);
+            if (!mpc) {
+              return std::string("none");
+            }
+            if (warm_up_rounds > 0) {
+              WarmUp(*mpc, WarmUpScenarios(), warm_up_rounds);
+            }
+          }
+          MonteCarloEpisode episode;
+          DrawEpisode(ranges, seed, std::strtoull(item.c_str(), nullptr, 10), track.length(),
+                      options, episode);
+          mpc->Reset();
+          LatencyHistogram ticks;
+          Drive(track, xs, ys, *mpc, episode.options, episode.start, episode.report, ticks);
+          return FormatReport(episode.report);
+        });
+      };
+      const bool finished = RunClusterWorker(coordinator_address, job.str(), threads, make_work);
+      return finished ? 0 : -1;
+    }
+
+    std::vector<MonteCarloEpisode> drawn(episodes);
+    for (size_t k = 0; k < episodes; k++) {
+      DrawEpisode(ranges, seed, first_episode + k, track.length(), options, drawn[k]);
+    }
+    LatencyHistogram ticks;
+    const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    bool made = true;
+    if (coordinator_port != 0) {
+      ClusterCoordinator coordinator(job.str());
+      if (!coordinator.Listen(static_cast<uint16_t>(coordinator_port))) {
+        std::cerr << "Could not listen on port " << coordinator_port << std::endl;
+        return -1;
+      }
+      std::cerr << "Waiting for the workers of \"" << job.str() << "\" on port "
+                << coordinator_port << std::endl;
+      std::vector<std::string> items;
+      for (const MonteCarloEpisode &episode : drawn) {
+        items.push_back(std::to_string(episode.index));
+      }
+      size_t received = 0;
+      const size_t every = std::max<size_t>(1, episodes / 20);
+      coordinator.Run(items, [&](size_t k, const std::string &result) {
+        made &= ParseReport(result, drawn[k].report);
+        for (double tick : drawn[k].report.tick_seconds) {
+          ticks.Record(tick);
+        }
+        if (++received % every == 0 || received == episodes) {
+          std::cerr << received << " of " << episodes << " episodes driven" << std::endl;
+        }
+      });
+    } else {
+      made = DriveMonteCarlo(track, xs, ys, solver, problem, warm_up_rounds, threads, drawn,
+                             ticks, distillation);
+    }
+    if (!made) {
+      std::cerr << "No " << SolverBackendName(solver) << " MPC compiled for a horizon of "
+                << problem.horizon << " timesteps" << std::endl;
+      return -1;
+    }
+    const double wall =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::vector<BenchResult> results;
+    ReportMonteCarlo(std::string("montecarlo/") + SolverBackendName(solver) + "/" +
+                         std::to_string(problem.horizon),
+                     options, drawn, ticks, wall, results);
+    if (distillation.policy) {
+      const size_t policy_ticks = distillation.policy_ticks + distillation.fallbacks;
+      const double fallback_rate =
+          double(distillation.fallbacks) / double(std::max<size_t>(policy_ticks, 1));
+      std::cout << std::endl
+                << "Policy: " << distillation.policy_ticks << " of " << policy_ticks
+                << " ticks, " << distillation.fallbacks << " fallbacks to the solver ("
+                << std::setprecision(2) << fallback_rate * 100 << "%)" << std::endl;
+      results.back().counters["policy_ticks"] = double(distillation.policy_ticks);
+      results.back().counters["fallback_rate"] = fallback_rate;
+    }
+    if (distillation.record) {
+      if (!SavePolicySamples(samples_path, distillation.samples)) {
+        std::cerr << "Could not write the samples to " << samples_path << std::endl;
+        return -1;
+      }
+      std::cout << "Appended " << distillation.samples.size() << " samples to " << samples_path
+                << std::endl;
+    }
+    if (!json_path.empty() && !WriteBenchJSON(json_path, "mpc_sim", results)) {
+      std::cerr << "Could not write the results to " << json_path << std::endl;
+      return -1;
+    }
+    if (!csv_path.empty() && !WriteBenchCSV(csv_path, results)) {
+      std::cerr << "Could not write the results to " << csv_path << std::endl;
+      return -1;
+    }
+    return 0;
+  }
+
+  if (soak) {
+    SoakLog log(csv_path);
+    if (!log.ok()) {
+      std::cerr << "Could not write the samples to " << csv_path << std::endl;
+      return -1;
+    }
+    if (!Soak(track, xs, ys, solver, problem, options, instances, warm_up_rounds, soak_duration,
+              soak_interval, log)) {
+      std::cerr << "No " << SolverBackendName(solver) << " MPC compiled for a horizon of "
+                << problem.horizon << " timesteps" << std::endl;
+      return -1;
+    }
+    const std::vector<std::string> drifts = log.Drifts(SoakPolicy());
+    std::cout << std::endl << (drifts.empty() ? "No drift" : "Drift:") << std::endl;
+    for (const std::string &drift : drifts) {
+      std::cout << "  " << drift << std::endl;
+    }
+    return drifts.empty() ? 0 : 1;
+  }
+
+  if (sweep) {
+    std::cout << std::left << std::setw(24) << "benchmark" << std::right << std::setw(11)
+              << "laps" << std::setw(8) << "lap s" << std::setw(8) << "speed" << std::setw(8)
+              << "rms m" << std::setw(12) << "solves/core" << std::setw(9) << "p50 ms"
+              << std::setw(9) << "p99 ms" << std::setw(9) << "p999 ms" << std::setw(9)
+              << "max ms" << std::setw(7) << "iters" << std::setw(8) << "failed" << std::endl;
+    std::vector<BenchResult> results;
+    std::vector<std::string> not_compiled;
+    for (SolverBackend backend : solvers) {
+      for (size_t horizon : horizons) {
+        const std::string prefix =
+            std::string("sim/") + SolverBackendName(backend) + "/" + std::to_string(horizon);
+        for (double speed : speeds) {
+          MPCProblem swept;
+          swept.horizon = horizon;
+          CostWeights weights;
+          weights.v_ref = speed;
+          swept.cost_schedule.AddPoint(0, weights);
+          std::vector<SimReport> reports;
+          LatencyHistogram ticks;
+          double wall = 0;
+          if (!Simulate(track, xs, ys, backend, swept, options, instances, warm_up_rounds,
+                        reports, ticks, wall)) {
+            not_compiled.push_back(prefix.substr(4));
+            break;
+          }
+          char speed_name[32];
+          std::snprintf(speed_name, sizeof(speed_name), "/v%g", speed);
+          ReportSweep(prefix + speed_name, speed, options, reports, results);
+        }
+      }
+    }
+    if (!not_compiled.empty()) {
+      std::cout << std::endl << "Not compiled:";
+      for (const std::string &name : not_compiled) {
+        std::cout << " " << name;
+      }
+      std::cout << std::endl;
+    }
+    if (!json_path.empty() && !WriteBenchJSON(json_path, "mpc_sim", results)) {
+      std::cerr << "Could not write the results to " << json_path << std::endl;
+      return -1;
+    }
+    if (!csv_path.empty() && !WriteBenchCSV(csv_path, results)) {
+      std::cerr << "Could not write the results to " << csv_path << std::endl;
+      return -1;
+    }
+    return 0;
+  }
+
+  std::vector<SimReport> reports;
+  LatencyHistogram ticks;
+  double wall = 0;
+  const bool made = Simulate(track, xs, ys, solver, problem, options, instances, warm_up_rounds,
+                             reports, ticks, wall);
+  if (!made) {
+    std::cerr << "No " << SolverBackendName(solver) << " MPC compiled for a horizon of "
+              << problem.horizon << " timesteps" << std::endl;
+    return -1;
+  }
+
+  std::cout << std::setw(9) << "instance" << std::setw(10) << "start m" << std::setw(7)
+            << "laps" << std::setw(10) << "lap s" << std::setw(10) << "|err| m" << std::setw(10)
+            << "rms m" << std::setw(10) << "max m" << std::setw(9) << "speed" << std::setw(8)
+            << "ticks" << std::setw(10) << "tick ms" << std::setw(8) << "iters" << std::setw(8)
+            << "failed" << std::endl;
+  double simulated = 0;
+  bool all_laps = true;
+  for (size_t k = 0; k < instances; k++) {
+    const SimReport &report = reports[k];
+    const double n = static_cast<double>(std::max<size_t>(report.ticks, 1));
+    double lap = 0;
+    for (double lap_time : report.lap_times) {
+      lap += lap_time / report.lap_times.size();
+    }
+    simulated += report.seconds;
+    all_laps &= report.lap_times.size() == options.laps;
+    std::cout << std::setw(9) << k << std::fixed << std::setprecision(1) << std::setw(10)
+              << report.start << std::setw(7) << report.lap_times.size() << std::setw(10)
+              << lap << std::setprecision(3) << std::setw(10) << report.error_sum / n
+              << std::setw(10) << std::sqrt(report.error_squares / n) << std::setw(10)
+              << report.error_max << std::setprecision(1) << std::setw(9)
+              << report.speed_sum / n << std::setw(8) << report.ticks << std::setprecision(3)
+              << std::setw(10) << report.solve_seconds / n * 1e3 << std::setprecision(1)
+              << std::setw(8) << report.iterations / n << std::setw(8) << report.failed
+              << (report.off_track ? "  off the track" : "") << std::endl;
+  }
+  std::cout << std::endl
+            << std::setprecision(3) << "Ticks: p50 " << ticks.Quantile(0.5) * 1e3 << " ms, p99 "
+            << ticks.Quantile(0.99) * 1e3 << " ms, max " << ticks.max() * 1e3 << " ms" << std::endl
+            << std::setprecision(1) << simulated << " s simulated in " << wall << " s, "
+            << simulated / wall << "x real time" << std::endl;
+  return all_laps ? 0 : 1;
+}
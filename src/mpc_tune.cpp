@@ -0,0 +1,643 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Eigen/Dense>
+#include "ClosedLoop.h"
+#include "Cluster.h"
+#include "CppADThreads.h"
+#include "Log.h"
+#include "RuntimeConfig.h"
+#include "SolverBackend.h"
+#include "TrackSpline.h"
+#include "WarmUp.h"
+
+// Parameter tuner: episodes of the closed loop of mpc_sim (see ClosedLoop.h)
+// for many settings of the cost weights, the reference speed and the
+// horizon at once, one on every core, scored and reduced to those no other
+// beats on every score.
+//
+//   ./mpc_tune [solver] [search=grid|bayes] [cte=<a,b,...>] [epsi=<a,b,...>]
+//              [diff_delta=<a,b,...>] [ref_v=<a,b,...>] [horizons=<n,m,...>]
+//              [rounds=<n>] [threads=<n>] [seed=<n>] [laps=<n>] [latency=<ms>]
+//              [tick=<ms>] [track=<csv>] [warmup=<rounds>] [out=<dir>] [log=<level>]
+//              [coordinator=<port> | worker=<host:port>]
+//
+// Every episode drives laps laps (1 by default) from the start of the track
+// with a solver of its own, made and warmed up on the thread that drives
+// it, and is scored on three counts, all to be made small: the mean lap
+// time, the root mean square distance from the track, and the mean cost of
+// a tick in ms. An episode that leaves the track or falls short of its laps
+// is scored but can't be among the best.
+//
+// search=grid (the default) drives every combination of the values given
+// for cte, epsi, diff_delta and ref_v (the weights and reference speed of
+// CostWeights, three values around the defaults of KinematicModel.h each
+// by default) and of horizons (10, 15 and 25 by default). search=bayes
+// takes the same lists as the ranges to search instead, the weights on a
+// log scale, and drives rounds rounds (8 by default) of threads episodes
+// (a core each by default): random ones first, then at every round those
+// that promise the most improvement of a random weighting of the three
+// scores under a Gaussian process fitted to the episodes so far (ParEGO).
+// seed makes the random draws repeatable. dt is the 0.1 s the horizons are
+// compiled with (see Horizon.h), so it is tuned through the horizon.
+//
+// Every episode is printed as it ends; then those no other episode beats
+// on all three scores, the Pareto front, by their lap time, each as the
+// configuration file the server takes with config=<path> (see
+// RuntimeConfig.h), into out/pareto-<k>.conf with out and on the standard
+// output otherwise.
+//
+// With coordinator, the episodes are driven by the workers of a cluster
+// instead, which connect to port (see Cluster.h): each is mpc_tune started
+// on a node of its own with the solver, laps, latency, tick, track and
+// warmup of the coordinator and worker=<host:port> of it, and drives the
+// episodes handed to it on its threads, the coordinator printing each as
+// its scores come back. A round of bayes is then of the threads of the
+// coordinator, so set them to the cores of the cluster.
+
+namespace {
+
+// Three values around each default, halved and doubled, and the reference
+// speeds and horizons of a grid by default
+const double kGridScales[] = {0.5, 1, 2};
+const double kGridSpeeds[] = {40, 60, 80};
+const size_t kGridHorizons[] = {10, 15, 25};
+const size_t kBayesRounds = 8;
+// Random points the expected improvement is evaluated at to pick each
+// episode of a round, the length scale of the kernel of the Gaussian
+// process on the unit cube of the parameters, and the weight of the sum in
+// the augmented Tchebycheff scalarization of ParEGO
+const size_t kAcquisitionSamples = 2000;
+const double kLengthScale = 0.25;
+const double kAugmentation = 0.05;
+
+// The tuned parameters, continuous ones first, by their names in the
+// configuration file
+const char *const kParameterNames[] = {"cte", "epsi", "diff_delta", "ref_v"};
+const size_t kContinuous = 4;
+
+// What an episode is driven with, and its scores
+struct Episode {
+  RuntimeConfig config;
+  // The point of the unit cube it was picked at, with bayes
+  std::vector<double> point;
+  bool made = false;
+  bool complete = false;
+  double lap_s = 0;
+  double rms_m = 0;
+  double tick_ms = 0;
+};
+
+// The values of the grid, or the ranges of bayes, of each parameter
+struct SearchSpace {
+  std::vector<double> values[kContinuous];
+  std::vector<size_t> horizons;
+};
+
+std::vector<std::string> Split(const std::string &list) {
+  std::vector<std::string> items;
+  std::istringstream in(list);
+  std::string item;
+  while (std::getline(in, item, ',')) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+double &Parameter(CostWeights &weights, size_t k) {
+  switch (k) {
+    case 0:
+      return weights.cte;
+    case 1:
+      return weights.epsi;
+    case 2:
+      return weights.diff_delta;
+    default:
+      return weights.v_ref;
+  }
+}
+
+// The weights go on a log scale, the reference speed on a linear one
+bool LogScale(size_t k) { return k < 3; }
+
+// The episode at point of the unit cube of space: a coordinate per
+// continuous parameter between the ends of its range, and the last for the
+// horizon, of those of the list
+RuntimeConfig Decode(const SearchSpace &space, const std::vector<double> &point,
+                     const RuntimeConfig &base) {
+  RuntimeConfig config = base;
+  for (size_t k = 0; k < kContinuous; k++) {
+    const std::vector<double> &range = space.values[k];
+    const double lo = *std::min_element(range.begin(), range.end());
+    const double hi = *std::max_element(range.begin(), range.end());
+    Parameter(config.weights, k) = LogScale(k) && lo > 0
+                                       ? lo * std::pow(hi / lo, point[k])
+                                       : lo + (hi - lo) * point[k];
+  }
+  const size_t n = space.horizons.size();
+  config.horizon = space.horizons[std::min(n - 1, static_cast<size_t>(point[kContinuous] * n))];
+  return config;
+}
+
+// Drive episode with a solver of backend made on this thread, false if
+// backend isn't compiled for its horizon
+bool DriveEpisode(const TrackSpline &track, const std::vector<double> &xs,
+                  const std::vector<double> &ys, SolverBackend backend,
+                  const SimOptions &options, size_t warm_up_rounds, Episode &episode) {
+  MPCProblem problem;
+  problem.horizon = episode.config.horizon;
+  problem.cost_schedule.AddPoint(0, episode.config.weights);
+  std::unique_ptr<MPCBase> mpc = MakeSolver(backend, problem);
+  if (!mpc) {
+    return false;
+  }
+  if (warm_up_rounds > 0) {
+    WarmUp(*mpc, WarmUpScenarios(), warm_up_rounds);
+  }
+  SimReport report;
+  LatencyHistogram ticks;
+  Drive(track, xs, ys, *mpc, options, 0, report, ticks);
+  const double n = static_cast<double>(std::max<size_t>(report.ticks, 1));
+  episode.made = true;
+  episode.complete = !report.off_track && report.lap_times.size() == options.laps;
+  episode.lap_s = 0;
+  for (double lap : report.lap_times) {
+    episode.lap_s += lap / report.lap_times.size();
+  }
+  episode.rms_m = std::sqrt(report.error_squares / n);
+  episode.tick_ms = report.solve_seconds / n * 1e3;
+  return true;
+}
+
+// The line of episode i, in one write so that the lines of the threads
+// don't mix
+void PrintEpisode(size_t i, const Episode &episode) {
+  CostWeights weights = episode.config.weights;
+  std::ostringstream line;
+  line << std::setw(6) << i << std::setw(9) << episode.config.horizon << std::fixed
+       << std::setprecision(0);
+  for (size_t k = 0; k < kContinuous; k++) {
+    line << std::setw(12) << Parameter(weights, k);
+  }
+  line << std::setprecision(1) << std::setw(9) << episode.lap_s << std::setprecision(3)
+       << std::setw(9) << episode.rms_m << std::setw(10) << episode.tick_ms
+       << (episode.complete ? "" : "  short") << "\n";
+  std::cout << line.str() << std::flush;
+}
+
+// What a worker of a cluster needs of episode to drive it, its horizon and
+// tuned parameters, and back (see Cluster.h)
+std::string FormatItem(const Episode &episode) {
+  CostWeights weights = episode.config.weights;
+  std::ostringstream item;
+  item << std::setprecision(17) << episode.config.horizon;
+  for (size_t k = 0; k < kContinuous; k++) {
+    item << " " << Parameter(weights, k);
+  }
+  return item.str();
+}
+
+bool ParseItem(const std::string &item, Episode &episode) {
+  std::istringstream in(item);
+  in >> episode.config.horizon;
+  for (size_t k = 0; k < kContinuous; k++) {
+    in >> Parameter(episode.config.weights, k);
+  }
+  return static_cast<bool>(in);
+}
+
+// The scores of an episode a worker drove, and back
+std::string FormatScores(const Episode &episode) {
+  std::ostringstream scores;
+  scores << std::setprecision(17) << episode.made << " " << episode.complete << " "
+         << episode.lap_s << " " << episode.rms_m << " " << episode.tick_ms;
+  return scores.str();
+}
+
+bool ParseScores(const std::string &scores, Episode &episode) {
+  std::istringstream in(scores);
+  in >> episode.made >> episode.complete >> episode.lap_s >> episode.rms_m >> episode.tick_ms;
+  return static_cast<bool>(in);
+}
+
+// Drive the episodes of episodes from first on threads threads, the calling
+// one the first, each with a solver of backend made on its thread; or with
+// coordinator, on the workers of its cluster
+void DriveEpisodes(const TrackSpline &track, const std::vector<double> &xs,
+                   const std::vector<double> &ys, SolverBackend backend,
+                   const SimOptions &options, size_t warm_up_rounds, size_t threads,
+                   ClusterCoordinator *coordinator, std::vector<Episode> &episodes,
+                   size_t first) {
+  if (coordinator) {
+    std::vector<std::string> items;
+    for (size_t i = first; i < episodes.size(); i++) {
+      items.push_back(FormatItem(episodes[i]));
+    }
+    coordinator->Run(items, [&](size_t k, const std::string &scores) {
+      Episode &episode = episodes[first + k];
+      if (ParseScores(scores, episode) && episode.made) {
+        PrintEpisode(first + k, episode);
+      }
+    });
+    return;
+  }
+  std::atomic<size_t> next(first);
+  const auto run = [&] {
+    for (size_t i = next++; i < episodes.size(); i = next++) {
+      if (DriveEpisode(track, xs, ys, backend, options, warm_up_rounds, episodes[i])) {
+        PrintEpisode(i, episodes[i]);
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t k = 1; k < threads; k++) {
+    workers.push_back(std::thread([&run] {
+      CppADThread cppad_thread;
+      run();
+    }));
+  }
+  run();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+// Whether a is no worse than b on every score and better on one
+bool Dominates(const Episode &a, const Episode &b) {
+  return a.lap_s <= b.lap_s && a.rms_m <= b.rms_m && a.tick_ms <= b.tick_ms &&
+         (a.lap_s < b.lap_s || a.rms_m < b.rms_m || a.tick_ms < b.tick_ms);
+}
+
+// The next round of bayes after episodes, threads points of the unit cube
+// of dimensions dimensions into next: each the best of kAcquisitionSamples
+// random points by its expected improvement of a scalarization of the
+// scores, under a random weighting of them, fitted by a Gaussian process
+void NextRound(const std::vector<Episode> &episodes, size_t dimensions, size_t threads,
+               const SearchSpace &space, const RuntimeConfig &base, std::mt19937 &random,
+               std::vector<Episode> &next) {
+  std::uniform_real_distribution<double> uniform(0, 1);
+  // The scores on [0, 1] over the complete episodes so far
+  double lo[3] = {INFINITY, INFINITY, INFINITY};
+  double hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+  std::vector<const Episode *> scored;
+  for (const Episode &episode : episodes) {
+    if (!episode.made) {
+      continue;
+    }
+    scored.push_back(&episode);
+    if (episode.complete) {
+      const double scores[3] = {episode.lap_s, episode.rms_m, episode.tick_ms};
+      for (size_t j = 0; j < 3; j++) {
+        lo[j] = std::min(lo[j], scores[j]);
+        hi[j] = std::max(hi[j], scores[j]);
+      }
+    }
+  }
+  const size_t n = scored.size();
+  Eigen::MatrixXd kernel(n, n);
+  const auto covariance = [](const std::vector<double> &a, const std::vector<double> &b) {
+    double d2 = 0;
+    for (size_t k = 0; k < a.size(); k++) {
+      d2 += (a[k] - b[k]) * (a[k] - b[k]);
+    }
+    return std::exp(-0.5 * d2 / (kLengthScale * kLengthScale));
+  };
+  for (size_t i = 0; i < n; i++) {
+    for (size_t j = 0; j < n; j++) {
+      kernel(i, j) = covariance(scored[i]->point, scored[j]->point) + (i == j ? 1e-6 : 0);
+    }
+  }
+  const Eigen::LLT<Eigen::MatrixXd> factor(kernel);
+  for (size_t b = 0; b < threads; b++) {
+    // A weighting of the three scores, uniform on the simplex
+    double lambda[3];
+    double sum = 0;
+    for (double &l : lambda) {
+      l = -std::log(1 - uniform(random));
+      sum += l;
+    }
+    Eigen::VectorXd g(n);
+    double worst = 0;
+    for (size_t i = 0; i < n; i++) {
+      const Episode &episode = *scored[i];
+      if (!episode.complete) {
+        continue;
+      }
+      const double scores[3] = {episode.lap_s, episode.rms_m, episode.tick_ms};
+      double max = 0;
+      double total = 0;
+      for (size_t j = 0; j < 3; j++) {
+        const double f = hi[j] > lo[j] ? (scores[j] - lo[j]) / (hi[j] - lo[j]) : 0;
+        max = std::max(max, lambda[j] / sum * f);
+        total += lambda[j] / sum * f;
+      }
+      g[i] = max + kAugmentation * total;
+      worst = std::max(worst, g[i]);
+    }
+    // Those that didn't make their laps worse than any that did
+    for (size_t i = 0; i < n; i++) {
+      if (!scored[i]->complete) {
+        g[i] = worst + 1;
+      }
+    }
+    const double mean = g.mean();
+    const double scale = std::max(1e-9, std::sqrt((g.array() - mean).square().mean()));
+    const Eigen::VectorXd alpha = factor.solve(((g.array() - mean) / scale).matrix());
+    const double best = (g.minCoeff() - mean) / scale;
+    std::vector<double> point(dimensions);
+    std::vector<double> chosen(dimensions);
+    double chosen_improvement = -1;
+    Eigen::VectorXd k(n);
+    for (size_t s = 0; s < kAcquisitionSamples; s++) {
+      for (double &x : point) {
+        x = uniform(random);
+      }
+      for (size_t i = 0; i < n; i++) {
+        k[i] = covariance(point, scored[i]->point);
+      }
+      const double mu = k.dot(alpha);
+      const double sigma = std::sqrt(std::max(1e-12, 1 - k.dot(factor.solve(k))));
+      const double z = (best - mu) / sigma;
+      const double improvement =
+          (best - mu) * 0.5 * std::erfc(-z / std::sqrt(2.0)) +
+          sigma * std::exp(-0.5 * z * z) / std::sqrt(2 * M_PI);
+      if (improvement > chosen_improvement) {
+        chosen_improvement = improvement;
+        chosen = point;
+      }
+    }
+    Episode episode;
+    episode.point = chosen;
+    episode.config = Decode(space, chosen, base);
+    next.push_back(episode);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  SolverBackend solver = SolverBackend::kIpopt;
+  int first_flag = 1;
+  if (argc > 1 && std::string(argv[1]).find('=') == std::string::npos) {
+    if (!ParseSolverBackend(argv[1], solver)) {
+      std::cerr << "Unknown solver " << argv[1] << std::endl;
+      return -1;
+    }
+    first_flag = 2;
+  }
+  SearchSpace space;
+  CostWeights defaults;
+  for (size_t k = 0; k < kContinuous; k++) {
+    if (k == 3) {
+      space.values[k].assign(std::begin(kGridSpeeds), std::end(kGridSpeeds));
+      continue;
+    }
+    for (double scale : kGridScales) {
+      space.values[k].push_back(Parameter(defaults, k) * scale);
+    }
+  }
+  space.horizons.assign(std::begin(kGridHorizons), std::end(kGridHorizons));
+  bool bayes = false;
+  size_t rounds = kBayesRounds;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  unsigned seed = 1;
+  SimOptions options;
+  size_t warm_up_rounds = 1;
+  std::string track_path = "lake_track_waypoints.csv";
+  std::string out_directory;
+  unsigned long coordinator_port = 0;
+  std::string coordinator_address;
+  LogLevel log_level = LogLevel::kWarning;
+  for (int i = first_flag; i < argc; i++) {
+    const std::string arg = argv[i];
+    const size_t equals = arg.find('=');
+    const std::string name = arg.substr(0, equals);
+    const std::string value = equals == std::string::npos ? "" : arg.substr(equals + 1);
+    const char *const *parameter =
+        std::find(std::begin(kParameterNames), std::end(kParameterNames), name);
+    if (parameter != std::end(kParameterNames)) {
+      std::vector<double> &values = space.values[parameter - std::begin(kParameterNames)];
+      values.clear();
+      for (const std::string &item : Split(value)) {
+        values.push_back(std::strtod(item.c_str(), nullptr));
+      }
+      if (values.empty() || *std::min_element(values.begin(), values.end()) < 0) {
+        std::cerr << name << " takes numbers of 0 or more" << std::endl;
+        return -1;
+      }
+    } else if (name == "search" && (value == "grid" || value == "bayes")) {
+      bayes = value == "bayes";
+    } else if (name == "horizons") {
+      space.horizons.clear();
+      for (const std::string &item : Split(value)) {
+        space.horizons.push_back(std::strtoul(item.c_str(), nullptr, 10));
+      }
+      if (space.horizons.empty()) {
+        std::cerr << "horizons takes a horizon at least" << std::endl;
+        return -1;
+      }
+    } else if (name == "rounds") {
+      rounds = std::strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "threads") {
+      threads = std::strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "seed") {
+      seed = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (name == "laps") {
+      options.laps = std::strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "latency") {
+      options.latency = std::strtod(value.c_str(), nullptr) * 1e-3;
+    } else if (name == "tick") {
+      options.tick = std::strtod(value.c_str(), nullptr) * 1e-3;
+    } else if (name == "track") {
+      track_path = value;
+    } else if (name == "warmup") {
+      warm_up_rounds = std::strtoul(value.c_str(), nullptr, 10);
+    } else if (name == "out") {
+      out_directory = value;
+    } else if (name == "coordinator") {
+      coordinator_port = std::strtoul(value.c_str(), nullptr, 10);
+      if (coordinator_port == 0 || coordinator_port > 65535) {
+        std::cerr << "coordinator takes a port" << std::endl;
+        return -1;
+      }
+    } else if (name == "worker") {
+      coordinator_address = value;
+    } else if (name == "log") {
+      if (!ParseLogLevel(value.c_str(), log_level)) {
+        std::cerr << "Unknown log level " << value << std::endl;
+        return -1;
+      }
+    } else {
+      std::cerr << "Unknown argument " << arg << std::endl;
+      return -1;
+    }
+  }
+  if (options.laps == 0 || threads == 0 || rounds == 0) {
+    std::cerr << "Drive a lap, on a thread, for a round at least" << std::endl;
+    return -1;
+  }
+  if (options.latency < 0 || options.tick < kPlantStep) {
+    std::cerr << "The latency is 0 ms or more and the tick 10 ms or more" << std::endl;
+    return -1;
+  }
+  SetLogLevel(log_level);
+
+  std::vector<double> xs;
+  std::vector<double> ys;
+  if (!TrackSpline::Load(track_path, xs, ys) || xs.size() < kTelemetryWaypoints) {
+    std::cerr << "Could not read the waypoints of " << track_path << std::endl;
+    return -1;
+  }
+  const TrackSpline track(xs, ys);
+  // What every episode depends on but its weights and horizon, for the
+  // workers of a cluster to drive them the same as this process would
+  std::ostringstream job;
+  job << std::setprecision(17) << "mpc_tune " << SolverBackendName(solver)
+      << " laps=" << options.laps << " latency=" << options.latency << " tick=" << options.tick
+      << " track=" << track_path << " warmup=" << warm_up_rounds;
+  if (!coordinator_address.empty()) {
+    // Its threads all drive, this one reads and writes the socket
+    if (SetupCppADThreads(threads + 1) < threads + 1) {
+      threads = SetupCppADThreads(threads + 1) - 1;
+    }
+    const auto make_work = [&] {
+      return ClusterWork([&](const std::string &item) {
+        Episode episode;
+        if (ParseItem(item, episode)) {
+          DriveEpisode(track, xs, ys, solver, options, warm_up_rounds, episode);
+        }
+        return FormatScores(episode);
+      });
+    };
+    return RunClusterWorker(coordinator_address, job.str(), threads, make_work) ? 0 : -1;
+  }
+  std::unique_ptr<ClusterCoordinator> coordinator;
+  if (coordinator_port != 0) {
+    coordinator.reset(new ClusterCoordinator(job.str()));
+    if (!coordinator->Listen(static_cast<uint16_t>(coordinator_port))) {
+      std::cerr << "Could not listen on port " << coordinator_port << std::endl;
+      return -1;
+    }
+    std::cerr << "Waiting for the workers of \"" << job.str() << "\" on port "
+              << coordinator_port << std::endl;
+  } else if (threads > 1 && SetupCppADThreads(threads) < threads) {
+    // A thread number in CppAD for every thread, this one the first
+    threads = SetupCppADThreads(threads);
+  }
+
+  RuntimeConfig base;
+  base.solver = solver;
+  std::vector<Episode> episodes;
+  std::cout << std::setw(6) << "#" << std::setw(9) << "horizon";
+  for (const char *name : kParameterNames) {
+    std::cout << std::setw(12) << name;
+  }
+  std::cout << std::setw(9) << "lap s" << std::setw(9) << "rms m" << std::setw(10) << "tick ms"
+            << std::endl;
+  if (!bayes) {
+    // Every combination, the horizon outermost
+    for (size_t horizon : space.horizons) {
+      std::vector<size_t> index(kContinuous, 0);
+      for (bool more = true; more;) {
+        Episode episode;
+        episode.config = base;
+        episode.config.horizon = horizon;
+        for (size_t k = 0; k < kContinuous; k++) {
+          Parameter(episode.config.weights, k) = space.values[k][index[k]];
+        }
+        episodes.push_back(episode);
+        more = false;
+        for (size_t k = kContinuous; k-- > 0;) {
+          if (++index[k] < space.values[k].size()) {
+            more = true;
+            break;
+          }
+          index[k] = 0;
+        }
+      }
+    }
+    DriveEpisodes(track, xs, ys, solver, options, warm_up_rounds, threads, coordinator.get(),
+                  episodes, 0);
+  } else {
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    const size_t dimensions = kContinuous + 1;
+    for (size_t round = 0; round < rounds; round++) {
+      const size_t first = episodes.size();
+      if (round == 0) {
+        for (size_t b = 0; b < threads; b++) {
+          Episode episode;
+          episode.point.resize(dimensions);
+          for (double &x : episode.point) {
+            x = uniform(random);
+          }
+          episode.config = Decode(space, episode.point, base);
+          episodes.push_back(episode);
+        }
+      } else {
+        std::vector<Episode> next;
+        NextRound(episodes, dimensions, threads, space, base, random, next);
+        episodes.insert(episodes.end(), next.begin(), next.end());
+      }
+      DriveEpisodes(track, xs, ys, solver, options, warm_up_rounds, threads, coordinator.get(),
+                    episodes, first);
+    }
+  }
+
+  // The Pareto front of the complete episodes, by lap time
+  std::vector<const Episode *> front;
+  size_t not_made = 0;
+  for (const Episode &episode : episodes) {
+    not_made += !episode.made;
+    if (!episode.complete) {
+      continue;
+    }
+    bool dominated = false;
+    for (const Episode &other : episodes) {
+      dominated |= other.complete && Dominates(other, episode);
+    }
+    if (!dominated) {
+      front.push_back(&episode);
+    }
+  }
+  std::sort(front.begin(), front.end(),
+            [](const Episode *a, const Episode *b) { return a->lap_s < b->lap_s; });
+  if (not_made > 0) {
+    std::cout << std::endl
+              << not_made << " episodes not driven, " << SolverBackendName(solver)
+              << " isn't compiled for their horizon" << std::endl;
+  }
+  std::cout << std::endl
+            << front.size() << " of " << episodes.size() << " episodes on the Pareto front"
+            << std::endl;
+  for (size_t k = 0; k < front.size(); k++) {
+    std::ostringstream file;
+    file << std::fixed << std::setprecision(3) << "# mpc_tune: lap " << front[k]->lap_s
+         << " s, rms " << front[k]->rms_m << " m, tick " << front[k]->tick_ms << " ms\n"
+         << ConfigFile(front[k]->config);
+    if (out_directory.empty()) {
+      std::cout << std::endl << file.str();
+      continue;
+    }
+    const std::string path = out_directory + "/pareto-" + std::to_string(k) + ".conf";
+    std::ofstream out(path);
+    if (!(out << file.str())) {
+      std::cerr << "Could not write " << path << std::endl;
+      return -1;
+    }
+    std::cout << path << std::endl;
+  }
+  return front.empty() ? 1 : 0;
+}
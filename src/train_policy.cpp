@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "NeuralPolicy.h"
+
+// Offline trainer of the NeuralPolicy used by "./mpc <N> <solver>
+// policy=<path>".
+//
+//   ./train_policy <samples>... [out=<path>] [epochs=<n>] [batch=<n>]
+//                  [rate=<r>] [seed=<n>] [holdout=<fraction>]
+//
+// Reads the solves recorded by mpc_sim montecarlo samples=<path> from every
+// samples file, holds out a fraction (0.1) of them drawn with seed (1),
+// fits the network to the others over epochs (200) epochs of Adam in
+// batches of batch (128) at the learning rate rate (0.001), and writes it
+// to out (neural.policy by default). It prints the RMS errors of the
+// steering and the throttle over the held out solves, the share of them
+// inside the range of the policy, and the time of an evaluation.
+//
+// Drive the policy with mpc_sim montecarlo policy=<path> for its fallback
+// rate, and record with samples= at the same time for the states it
+// falls back on, to train again on.
+int main(int argc, char *argv[]) {
+  std::vector<std::string> sample_paths;
+  std::string out_path = "neural.policy";
+  PolicyTraining training;
+  double holdout = 0.1;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const std::string out_flag = "out=";
+    const std::string epochs_flag = "epochs=";
+    const std::string batch_flag = "batch=";
+    const std::string rate_flag = "rate=";
+    const std::string seed_flag = "seed=";
+    const std::string holdout_flag = "holdout=";
+    if (arg.compare(0, out_flag.size(), out_flag) == 0) {
+      out_path = arg.substr(out_flag.size());
+    } else if (arg.compare(0, epochs_flag.size(), epochs_flag) == 0) {
+      training.epochs = std::strtoul(arg.c_str() + epochs_flag.size(), nullptr, 10);
+    } else if (arg.compare(0, batch_flag.size(), batch_flag) == 0) {
+      training.batch = std::strtoul(arg.c_str() + batch_flag.size(), nullptr, 10);
+    } else if (arg.compare(0, rate_flag.size(), rate_flag) == 0) {
+      training.learning_rate = std::strtod(arg.c_str() + rate_flag.size(), nullptr);
+    } else if (arg.compare(0, seed_flag.size(), seed_flag) == 0) {
+      training.seed = std::strtoull(arg.c_str() + seed_flag.size(), nullptr, 10);
+    } else if (arg.compare(0, holdout_flag.size(), holdout_flag) == 0) {
+      holdout = std::strtod(arg.c_str() + holdout_flag.size(), nullptr);
+    } else {
+      sample_paths.push_back(arg);
+    }
+  }
+  if (sample_paths.empty() || training.epochs == 0 || training.batch == 0 ||
+      !(training.learning_rate > 0) || !(holdout > 0 && holdout < 1)) {
+    std::cerr << "Usage: train_policy <samples>... [out=<path>] [epochs=<n>] [batch=<n>] "
+                 "[rate=<r>] [seed=<n>] [holdout=<fraction>]"
+              << std::endl;
+    return -1;
+  }
+
+  PolicySamples samples;
+  for (const std::string &path : sample_paths) {
+    if (!LoadPolicySamples(path, samples)) {
+      std::cerr << "Could not read the samples of " << path << std::endl;
+      return -1;
+    }
+  }
+  std::mt19937_64 random(training.seed);
+  std::shuffle(samples.begin(), samples.end(), random);
+  const size_t held = static_cast<size_t>(samples.size() * holdout);
+  if (held == 0 || held == samples.size()) {
+    std::cerr << "Too few samples, " << samples.size() << std::endl;
+    return -1;
+  }
+  const PolicySamples validation(samples.end() - held, samples.end());
+  samples.resize(samples.size() - held);
+
+  std::cerr << "Training on " << samples.size() << " samples, " << held << " held out"
+            << std::endl;
+  NeuralPolicy policy;
+  double delta_rms = 0;
+  double a_rms = 0;
+  policy.Train(samples, validation, training, delta_rms, a_rms);
+
+  // The held out solves once for the range, then over and over for the
+  // time of an evaluation
+  size_t inside = 0;
+  double delta;
+  double a;
+  for (const PolicySample &sample : validation) {
+    inside += policy.Evaluate(sample.state, sample.coeffs, delta, a);
+  }
+  const size_t rounds = std::max<size_t>(1, 1000000 / validation.size());
+  // Written every evaluation, so the evaluations aren't optimized away
+  volatile double sink = 0;
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t round = 0; round < rounds; round++) {
+    for (const PolicySample &sample : validation) {
+      policy.Evaluate(sample.state, sample.coeffs, delta, a);
+      sink = sink + delta;
+    }
+  }
+  const double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "Held out RMS: steering " << delta_rms << " rad, throttle " << a_rms << std::endl
+            << "Inside the range: " << inside << " of " << validation.size() << std::endl
+            << "Evaluation: " << seconds / double(rounds * validation.size()) * 1e9 << " ns"
+            << std::endl;
+
+  if (!policy.Save(out_path)) {
+    std::cerr << "Could not write " << out_path << std::endl;
+    return -1;
+  }
+  std::cerr << "Wrote " << out_path << std::endl;
+  return 0;
+}